@@ -55,6 +55,7 @@ class VoiceTuberConan(ConanFile):
         self.requires("fmt/10.2.1")
         self.requires("spdlog/1.14.1")
         self.requires("rapidjson/cci.20230929")
+        self.requires("opus/1.4")
 
     def build(self):
         cmake = CMake(self)
@@ -1,54 +1,68 @@
 #include "ai-mouth.hpp"
 
+#include <algorithm>
 #include <fmt/core.h>
 #include <spdlog/spdlog.h>
 
 #include "audio-in.hpp"
 #include "audio-out.hpp"
-#include "azure-stt.hpp"
+#include "azure-tts.hpp"
+#include "imgui-helpers.hpp"
 #include "ui.hpp"
 #include "undo.hpp"
-#include "wav-2-visemes.hpp"
+#include "visemes-source.hpp"
 
 AiMouth::AiMouth(Lib &aLib,
                  Undo &aUndo,
                  AudioIn &aAudioIn,
-                 AudioOut &audioOut,
-                 Wav2Visemes &aWav2Visemes,
+                 AudioOut &aAudioOut,
+                 VisemesSource &aVisemes,
                  const std::filesystem::path &path)
   : Node(aLib, aUndo, path.filename().string()),
     sprite(aLib, aUndo, path),
     lib(aLib),
+    mainAudioIn(aAudioIn),
+    mainVisemes(aVisemes),
     audioIn(aAudioIn),
-    wav2Visemes(aWav2Visemes),
-    stt(lib.get().queryAzureStt()),
-    tts(lib.get().queryAzureTts(audioOut)),
+    audioOut(aAudioOut),
+    visemes(aVisemes),
+    stt(lib.get().querySpeechToText()),
+    tts(lib.get().queryAzureTts(aAudioOut)),
     twitch(aLib.queryTwitch("mika314")),
+    wavBuf(static_cast<size_t>(aAudioIn.sampleRate()) * MaxBufferedSeconds),
     systemPrompt(lib.get().gpt().systemPrompt())
 {
-  viseme2Sprite[Viseme::sil] = 0;
-  viseme2Sprite[Viseme::PP] = 1;
-  viseme2Sprite[Viseme::FF] = 2;
-  viseme2Sprite[Viseme::TH] = 3;
-  viseme2Sprite[Viseme::DD] = 4;
-  viseme2Sprite[Viseme::kk] = 5;
-  viseme2Sprite[Viseme::CH] = 6;
-  viseme2Sprite[Viseme::SS] = 7;
-  viseme2Sprite[Viseme::nn] = 8;
-  viseme2Sprite[Viseme::RR] = 9;
-  viseme2Sprite[Viseme::aa] = 10;
-  viseme2Sprite[Viseme::E] = 11;
-  viseme2Sprite[Viseme::I] = 12;
-  viseme2Sprite[Viseme::O] = 13;
-  viseme2Sprite[Viseme::U] = 14;
-  wav2Visemes.get().reg(*this);
+  auto &sprites = viseme2Sprite.edit();
+  sprites[Viseme::sil] = 0;
+  sprites[Viseme::PP] = 1;
+  sprites[Viseme::FF] = 2;
+  sprites[Viseme::TH] = 3;
+  sprites[Viseme::DD] = 4;
+  sprites[Viseme::kk] = 5;
+  sprites[Viseme::CH] = 6;
+  sprites[Viseme::SS] = 7;
+  sprites[Viseme::nn] = 8;
+  sprites[Viseme::RR] = 9;
+  sprites[Viseme::aa] = 10;
+  sprites[Viseme::E] = 11;
+  sprites[Viseme::I] = 12;
+  sprites[Viseme::O] = 13;
+  sprites[Viseme::U] = 14;
+  visemes.get().reg(*this);
+  // the cues of the cohost's own voice come from the playback
+  audioOut.get().reg(playbackCues);
   audioIn.get().reg(*this);
   twitch->reg(*this);
 }
 
 AiMouth::~AiMouth()
 {
-  wav2Visemes.get().unreg(*this);
+  if (sttStream)
+    sttStream->cancel();
+  for (auto &s : sttPending)
+    s->cancel();
+  visemes.get().unreg(*this);
+  audioOut.get().unreg(playbackCues);
   audioIn.get().unreg(*this);
   twitch->unreg(*this);
 }
@@ -58,85 +72,168 @@ auto AiMouth::do_clone() const -> std::shared_ptr<Node>
   return std::make_shared<AiMouth>(*this);
 }
 
-auto AiMouth::ingest(Wav wav, bool /*overlap*/) -> void
+auto AiMouth::ingest(const AudioBlock &block) -> void
 {
   if (!visible)
     return;
-  wavBuf.insert(std::end(wavBuf), std::begin(wav), std::end(wav));
+  wavBuf.push(block.samples());
   using namespace std::chrono_literals;
-  if (std::chrono::high_resolution_clock::now() > silStart + 1000ms)
+  const auto now = std::chrono::steady_clock::now();
+  const auto sampleRate = audioIn.get().sampleRate();
+  if (sttStream)
+    sttStream->push(block.samples());
+  else if (now <= silStart + 1000ms && now >= talkStart + 3s)
   {
-    const auto sampleRate = audioIn.get().sampleRate();
-    if (static_cast<int>(wavBuf.size()) > 1 * sampleRate)
-    {
-      auto max = std::max_element(std::begin(wavBuf), std::end(wavBuf));
-      if (*max > 0x2000 || static_cast<int>(wavBuf.size()) > 10 * sampleRate)
-        stt->perform(Wav{std::begin(wavBuf), std::end(wavBuf)},
-                     sampleRate,
-                     [alive = weak_self()](std::string_view txt) {
-                       if (auto self = alive.lock())
-                       {
-                         if (!self->hostMsg.empty())
-                           self->hostMsg += '\n';
-                         self->hostMsg += txt;
-                         SPDLOG_INFO("{}: {}", self->host, txt);
-                         if (self->hostMsg.size() < 75)
-                           return;
-
-                         self->lib.get().gpt().prompt(
-                           "Host", std::move(self->hostMsg), [alive](std::string_view rsp) {
-                             if (auto self = alive.lock())
-                             {
-                               SPDLOG_INFO("{}: {}", self->cohost, rsp);
-                               self->tts->say("en-US-AmberNeural", std::string(rsp), false);
-                               self->talkStart = std::chrono::high_resolution_clock::now();
-                             }
-                             else
-                             {
-                               SPDLOG_INFO("this was destroyed");
-                             };
-                           });
-                         self->hostMsg.clear();
-                       }
-                       else
-                       {
-                         SPDLOG_INFO("this was destroyed");
-                       }
-                     });
-    }
-    while (static_cast<int>(wavBuf.size()) > sampleRate / 5)
-      wavBuf.pop_front();
+    // the host started talking, the buffered lead-in goes first
+    dropSpeculative();
+    if (sttPending.empty())
+      stt = lib.get().querySpeechToText();
+    sttStream = stt->stream(sampleRate, onTranscript(), onPartial());
+    sttStream->push(wavBuf.linear());
   }
-  if (std::chrono::high_resolution_clock::now() > silStart + 5000ms && hostMsg.size() > 5)
+  if (now > silStart + 1000ms)
   {
-    lib.get().gpt().prompt(host, std::move(hostMsg), [alive = weak_self()](std::string_view rsp) {
-      if (auto self = alive.lock())
+    const auto isSpeech = static_cast<int>(wavBuf.size()) > 1 * sampleRate &&
+                          (wavBuf.peak() > 0x2000 || static_cast<int>(wavBuf.size()) > 10 * sampleRate);
+    std::erase_if(sttPending, [](const auto &s) { return s->done(); });
+    if (isSpeech)
+      speechEnd = silStart;
+    if (sttStream)
+    {
+      if (isSpeech)
       {
-        if (rsp.empty())
-          return;
-        SPDLOG_INFO("{}: {}", self->cohost, rsp);
-        self->tts->say("en-US-AmberNeural", std::string(rsp), false);
-        self->talkStart = std::chrono::high_resolution_clock::now();
+        sttStream->finish();
+        sttPending.push_back(std::move(sttStream));
       }
       else
-      {
-        SPDLOG_INFO("this was destroyed");
-      }
-    });
+        sttStream->cancel();
+      sttStream = nullptr;
+    }
+    else if (isSpeech)
+    {
+      if (sttPending.empty())
+        stt = lib.get().querySpeechToText();
+      sttPending.push_back(stt->perform(wavBuf.linear(), sampleRate, onTranscript()));
+    }
+    wavBuf.keepLast(static_cast<size_t>(sampleRate / 5));
+  }
+  if (std::chrono::steady_clock::now() > silStart + 5000ms && hostMsg.size() > 5)
+  {
+    ask(host, std::move(hostMsg));
     hostMsg.clear();
   }
 }
 
+auto AiMouth::onPartial() -> SttBackend::Callback
+{
+  return [alive = weak_self()](std::string_view txt) {
+    if (auto self = alive.lock())
+      self->partial = txt;
+    else
+      SPDLOG_INFO("this was destroyed");
+  };
+}
+
+auto AiMouth::onTranscript() -> SttBackend::Callback
+{
+  return [alive = weak_self()](std::string_view txt) {
+    if (auto self = alive.lock())
+    {
+      self->partial.clear();
+      self->transcribed = std::chrono::steady_clock::now();
+      if (!self->hostMsg.empty())
+        self->hostMsg += '\n';
+      self->hostMsg += txt;
+      SPDLOG_INFO("{}: {}", self->host, txt);
+      const auto listening = self->sttStream || std::ranges::any_of(self->sttPending, [](const auto &s) {
+                               return !s->done();
+                             });
+      if (!listening)
+      {
+        // the host paused, the answer is asked for right away instead of after the silence
+        self->dropSpeculative();
+        self->speculative = self->ask("Host", std::move(self->hostMsg));
+        self->hostMsg.clear();
+        return;
+      }
+      if (self->hostMsg.size() < 75)
+        return;
+
+      self->ask("Host", std::move(self->hostMsg));
+      self->hostMsg.clear();
+    }
+    else
+    {
+      SPDLOG_INFO("this was destroyed");
+    }
+  };
+}
+
+AiMouth::PlaybackCues::PlaybackCues(AiMouth &aOwner)
+  : owner(&aOwner)
+{
+}
+
+AiMouth::PlaybackCues::PlaybackCues(const PlaybackCues &)
+  : VisemesSink(), owner(nullptr)
+{
+}
+
+auto AiMouth::PlaybackCues::ingest(Viseme v) -> void
+{
+  if (owner)
+    owner->onCue(v);
+}
+
 auto AiMouth::ingest(Viseme v) -> void
 {
-  viseme = v;
+  // the host's visemes only tell when the host talks, the mouth shows the cohost's
   if (v != Viseme::sil)
-    silStart = std::chrono::high_resolution_clock::now();
+    silStart = std::chrono::steady_clock::now();
 }
 
-auto AiMouth::sampleRate() const -> int
+auto AiMouth::onCue(Viseme v) -> void
 {
-  return audioIn.get().sampleRate();
+  if (viseme != v)
+    scheduler.get().invalidate();
+  viseme = v;
+  if (v == Viseme::sil)
+    return;
+  const auto now = std::chrono::steady_clock::now();
+  using namespace std::chrono_literals;
+  // keep following the cues for as long as the answer plays
+  if (now < talkStart + 3s)
+    talkStart = now;
+}
+
+auto AiMouth::listen(int source) -> void
+{
+  visemes.get().unreg(*this);
+  audioIn.get().unreg(*this);
+  // the switch cuts off what the host was saying
+  if (sttStream)
+  {
+    sttStream->cancel();
+    sttStream = nullptr;
+  }
+  wavBuf.keepLast(0);
+  mic = source;
+  micSource = lib.get().queryMic(source);
+  visemes = micSource ? micSource->visemes() : mainVisemes.get();
+  audioIn = micSource ? micSource->audioIn() : mainAudioIn.get();
+  visemes.get().reg(*this);
+  audioIn.get().reg(*this);
+}
+
+auto AiMouth::loadAttrs(const std::map<std::string, std::string> &attrs) -> void
+{
+  if (const auto source = MicSource::load(attrs); source != mic)
+    listen(source);
+}
+
+auto AiMouth::saveAttrs(std::map<std::string, std::string> &attrs) const -> void
+{
+  MicSource::save(mic, attrs);
 }
 
 auto AiMouth::load(IStrm &strm) -> void
@@ -151,8 +248,11 @@ auto AiMouth::load(IStrm &strm) -> void
 auto AiMouth::render(float dt, Node *hovered, Node *selected) -> void
 {
   using namespace std::chrono_literals;
-  if (std::chrono::high_resolution_clock::now() < talkStart + 3s && sprite.numFrames() > 0)
-    sprite.frame(rand() % sprite.numFrames());
+  if (frameCtx.get().now < talkStart + 3s && sprite.numFrames() > 0)
+  {
+    const auto it = viseme2Sprite->find(viseme);
+    sprite.frame(std::clamp(it != std::end(*viseme2Sprite) ? it->second : 0, 0, sprite.numFrames() - 1));
+  }
   else
     sprite.frame(0);
   sprite.render();
@@ -163,6 +263,20 @@ auto AiMouth::renderUi() -> void
 {
   Node::renderUi();
   sprite.renderUi();
+  if (const auto picked = MicSource::combo(lib, mic))
+    undo.get().record(
+      [source = *picked, alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->listen(source);
+        else
+          SPDLOG_INFO("this was destroyed");
+      },
+      [source = mic, alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->listen(source);
+        else
+          SPDLOG_INFO("this was destroyed");
+      });
   ImGui::TableNextColumn();
   Ui::textRj("System Prompt");
   ImGui::TableNextColumn();
@@ -204,6 +318,18 @@ auto AiMouth::renderUi() -> void
     }
   }
   ImGui::TableNextColumn();
+  Ui::textRj("Hearing");
+  ImGui::TableNextColumn();
+  ImGui::TextUnformatted(partial.c_str());
+  ImGui::TableNextColumn();
+  Ui::textRj("Latency");
+  ImGui::TableNextColumn();
+  ImGui::TextF("STT {:.0f} ms, LLM {:.0f} ms, TTS {:.0f} ms, total {:.0f} ms",
+               latency.stt,
+               latency.llm,
+               latency.tts,
+               latency.total);
+  ImGui::TableNextColumn();
   {
     ImGui::PushStyleColor(ImGuiCol_Text, ImGui::GetStyle().Colors[ImGuiCol_TextDisabled]); // Set text color to disabled color
     Ui::textRj("Viseme");
@@ -233,7 +359,7 @@ auto AiMouth::renderUi() -> void
   }
 
   auto visUi = [&](auto vis, auto txt, auto txt2) {
-    auto &f = viseme2Sprite[vis];
+    auto f = viseme2Sprite->contains(vis) ? viseme2Sprite->at(vis) : 0;
     ImGui::TableNextColumn();
     Ui::textRj(txt);
     ImGui::TableNextColumn();
@@ -241,26 +367,26 @@ auto AiMouth::renderUi() -> void
     if (ImGui::InputInt(txt2, &f))
     {
       undo.get().record(
-        [&f, newF = f, alive = weak_self(), vis]() {
+        [newF = f, alive = weak_self(), vis]() {
           if (auto self = alive.lock())
           {
             using namespace std::chrono_literals;
-            f = std::move(newF);
+            self->viseme2Sprite.edit()[vis] = newF;
             self->viseme = std::move(vis);
-            self->freezeTime = std::chrono::high_resolution_clock::now() + 1s;
+            self->freezeTime = self->frameCtx.get().now + 1s;
           }
           else
           {
             SPDLOG_INFO("this was destroyed");
           }
         },
-        [&f, oldF, alive = weak_self(), vis]() {
+        [oldF, alive = weak_self(), vis]() {
           if (auto self = alive.lock())
           {
             using namespace std::chrono_literals;
-            f = std::move(oldF);
+            self->viseme2Sprite.edit()[vis] = oldF;
             self->viseme = std::move(vis);
-            self->freezeTime = std::chrono::high_resolution_clock::now() + 1s;
+            self->freezeTime = self->frameCtx.get().now + 1s;
           }
           else
           {
@@ -277,7 +403,7 @@ auto AiMouth::renderUi() -> void
     {
       viseme = vis;
       using namespace std::chrono_literals;
-      freezeTime = std::chrono::high_resolution_clock::now() + 1s;
+      freezeTime = frameCtx.get().now + 1s;
     }
   };
   visUi(Viseme::sil, "sil", "##sil");
@@ -306,24 +432,99 @@ auto AiMouth::save(OStrm &strm) const -> void
   Node::save(strm);
 }
 
-auto AiMouth::onMsg(Msg val) -> void
+auto AiMouth::onMsg(const MsgPtr &val) -> void
 {
-  lib.get().gpt().prompt(
-    val.displayName + " from chat", val.msg, [alive = weak_self()](std::string_view rsp) {
-      if (auto self = alive.lock())
-      {
-        if (rsp.empty())
-          return;
+  transcribed = speechEnd = std::chrono::steady_clock::now();
+  ask(val->chatter->displayName + " from chat", val->msg);
+}
 
-        SPDLOG_INFO("{}: {}", self->cohost, rsp);
-        self->tts->say("en-US-AmberNeural", std::string(rsp), false);
-        self->talkStart = std::chrono::high_resolution_clock::now();
-      }
-      else
+auto AiMouth::ask(std::string name, std::string msg) -> std::shared_ptr<Answer>
+{
+  auto answer = std::make_shared<Answer>();
+  answer->heard = speechEnd;
+  answer->transcribed = transcribed;
+  answer->prompted = std::chrono::steady_clock::now();
+  answer->ticket = lib.get().gpt().prompt(std::move(name), std::move(msg), onReply(), onSentence(answer));
+  return answer;
+}
+
+auto AiMouth::dropSpeculative() -> void
+{
+  if (!speculative)
+    return;
+  if (!speculative->started)
+  {
+    // what the host said so far stays in the conversation, the next answer covers it
+    SPDLOG_INFO("The host went on, the early answer is dropped");
+    speculative->ticket->cancelled = true;
+  }
+  speculative = nullptr;
+}
+
+auto AiMouth::onFirstAudio(const Answer &answer) -> void
+{
+  const auto now = std::chrono::steady_clock::now();
+  const auto ms = [](auto d) { return std::chrono::duration<float, std::milli>(d).count(); };
+  latency.stt = ms(answer.transcribed - answer.heard);
+  latency.llm = ms(answer.firstSentence - answer.prompted);
+  latency.tts = ms(now - answer.firstSentence);
+  latency.total = ms(now - answer.heard);
+  SPDLOG_INFO("Answer latency: STT {:.0f} ms, LLM {:.0f} ms, TTS {:.0f} ms, total {:.0f} ms",
+              latency.stt,
+              latency.llm,
+              latency.tts,
+              latency.total);
+}
+
+auto AiMouth::onReply() -> Gpt::Callback
+{
+  // the reply was already spoken sentence by sentence
+  return [alive = weak_self()](std::string_view rsp) {
+    if (auto self = alive.lock())
+    {
+      if (rsp.empty())
+        return;
+      SPDLOG_INFO("{}: {}", self->cohost, rsp);
+    }
+    else
+    {
+      SPDLOG_INFO("this was destroyed");
+    }
+  };
+}
+
+auto AiMouth::onSentence(std::shared_ptr<Answer> answer) -> Gpt::Callback
+{
+  return [alive = weak_self(), answer = std::move(answer)](std::string_view sentence) {
+    if (auto self = alive.lock())
+    {
+      auto onStart = AzureTts::StartCallback{};
+      if (!answer->started)
       {
-        SPDLOG_INFO("this was destroyed");
+        answer->started = true;
+        answer->firstSentence = std::chrono::steady_clock::now();
+        if (self->speculative == answer)
+          self->speculative = nullptr;
+        onStart = [alive, answer]() {
+          if (auto self = alive.lock())
+            self->onFirstAudio(*answer);
+          else
+            SPDLOG_INFO("this was destroyed");
+        };
       }
-    });
+      self->tts->say("en-US-AmberNeural", std::string(sentence), false, std::move(onStart));
+      self->talkStart = std::chrono::steady_clock::now();
+    }
+    else
+    {
+      SPDLOG_INFO("this was destroyed");
+    }
+  };
+}
+
+auto AiMouth::heldBytes(Counted &counted) const -> size_t
+{
+  return sizeof(*this) + sprite.textureBytes(counted);
 }
 
 auto AiMouth::h() const -> float
@@ -1,11 +1,14 @@
 #pragma once
-#include "audio-sink.hpp"
+#include "capture-sink.hpp"
 #include "gpt.hpp"
+#include "mic-source.hpp"
 #include "node.hpp"
+#include "peak-ring.hpp"
 #include "sprite-sheet.hpp"
+#include "stt-backend.hpp"
 #include "visemes-sink.hpp"
 
-class AiMouth final : public AudioSink, public VisemesSink, public TwitchSink, public Node
+class AiMouth final : public CaptureSink, public VisemesSink, public TwitchSink, public Node
 {
 public:
 #define SER_PROP_LIST      \
@@ -22,42 +25,106 @@ public:
           Undo &,
           class AudioIn &,
           class AudioOut &,
-          class Wav2Visemes &,
+          class VisemesSource &,
           const std::filesystem::path &);
   ~AiMouth() final;
 
   static constexpr const char *className = "AiMouth";
+  // longest stretch of the host's speech sent to recognition in one piece
+  static constexpr auto MaxBufferedSeconds = 30;
 
 private:
+  // one answer of the cohost on its way through recognition, the completion and speech
+  struct Answer
+  {
+    std::shared_ptr<Gpt::Ticket> ticket;
+    // when the host stopped talking, or the chat message came in
+    std::chrono::steady_clock::time_point heard;
+    std::chrono::steady_clock::time_point transcribed;
+    std::chrono::steady_clock::time_point prompted;
+    std::chrono::steady_clock::time_point firstSentence;
+    bool started = false;
+  };
+  // milliseconds each stage of the last answer waited
+  struct Latency
+  {
+    float stt = 0.f;
+    float llm = 0.f;
+    float tts = 0.f;
+    float total = 0.f;
+  };
+
+  // the cues of the cohost's own voice from the playback, kept apart from the host's mic visemes
+  // that drive the silence detection
+  struct PlaybackCues final : public VisemesSink
+  {
+    explicit PlaybackCues(AiMouth &);
+    // a copy is not registered anywhere and feeds no node
+    PlaybackCues(const PlaybackCues &);
+    auto ingest(Viseme) -> void final;
+    AiMouth *owner;
+  };
+
   SpriteSheet sprite;
   std::reference_wrapper<Lib> lib;
+  // the host's mic and its visemes, the main ones or those of the source picked
+  std::reference_wrapper<AudioIn> mainAudioIn;
+  std::reference_wrapper<VisemesSource> mainVisemes;
+  int mic = 0;
+  std::shared_ptr<MicSource> micSource;
   std::reference_wrapper<AudioIn> audioIn;
-  std::reference_wrapper<Wav2Visemes> wav2Visemes;
-  std::shared_ptr<AzureStt> stt;
+  std::reference_wrapper<AudioOut> audioOut;
+  std::reference_wrapper<VisemesSource> visemes;
+  // the recognizer the preferences chose, looked up again while no segment is waiting on it
+  std::shared_ptr<SttBackend> stt;
+  // open while the host is talking
+  std::shared_ptr<SttBackend::Stream> sttStream;
+  // finished segments still waiting for their transcript
+  std::vector<std::shared_ptr<SttBackend::Stream>> sttPending;
+  // the words recognized so far of the segment the host is saying, from the backends that have them
+  std::string partial;
   std::shared_ptr<AzureTts> tts;
   std::shared_ptr<Twitch> twitch;
   Viseme viseme;
-  std::chrono::high_resolution_clock::time_point freezeTime;
-  std::map<Viseme, int> viseme2Sprite;
+  PlaybackCues playbackCues{*this};
+  std::chrono::steady_clock::time_point freezeTime;
+  // shared with the clones until one of them remaps a viseme
+  Cow<std::map<Viseme, int>> viseme2Sprite;
   std::string voice;
-  std::deque<int16_t> wavBuf;
-  std::chrono::high_resolution_clock::time_point silStart;
+  PeakRing wavBuf;
+  std::chrono::steady_clock::time_point silStart;
   std::string hostMsg;
   std::string systemPrompt;
   std::string host = "Mika";
   std::string cohost = "Clara";
-  std::chrono::high_resolution_clock::time_point talkStart;
+  std::chrono::steady_clock::time_point talkStart;
+  std::chrono::steady_clock::time_point speechEnd;
+  std::chrono::steady_clock::time_point transcribed;
+  // asked as soon as the host paused, dropped if the host goes on before it is spoken
+  std::shared_ptr<Answer> speculative;
+  Latency latency;
 
   auto h() const -> float final;
+  auto heldBytes(Counted &) const -> size_t final;
   auto ingest(Viseme) -> void final;
-  auto ingest(Wav, bool overlap) -> void final;
+  auto ingest(const AudioBlock &) -> void final;
   auto isTransparent(glm::vec2) const -> bool final;
+  auto listen(int source) -> void;
   auto load(IStrm &) -> void final;
-  auto onMsg(Msg) -> void final;
+  auto loadAttrs(const std::map<std::string, std::string> &) -> void final;
+  auto onMsg(const MsgPtr &) -> void final;
+  auto ask(std::string name, std::string msg) -> std::shared_ptr<Answer>;
+  auto dropSpeculative() -> void;
+  auto onCue(Viseme) -> void;
+  auto onFirstAudio(const Answer &) -> void;
+  auto onReply() -> Gpt::Callback;
+  auto onSentence(std::shared_ptr<Answer>) -> Gpt::Callback;
+  auto onPartial() -> SttBackend::Callback;
+  auto onTranscript() -> SttBackend::Callback;
   auto render(float dt, Node *hovered, Node *selected) -> void final;
   auto renderUi() -> void final;
-  auto sampleRate() const -> int final;
   auto save(OStrm &) const -> void final;
+  auto saveAttrs(std::map<std::string, std::string> &) const -> void final;
   auto w() const -> float final;
   auto do_clone() const -> std::shared_ptr<Node> final;
 };
@@ -0,0 +1,96 @@
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "alloc-stats.hpp"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+namespace
+{
+  std::atomic<uint64_t> allocs = 0;
+  constinit thread_local uint64_t threadAllocs = 0;
+
+  auto alloc(std::size_t sz) -> void *
+  {
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    ++threadAllocs;
+    if (auto p = std::malloc(sz ? sz : 1))
+      return p;
+    throw std::bad_alloc{};
+  }
+} // namespace
+
+auto AllocStats::count() -> uint64_t
+{
+  return allocs.load(std::memory_order_relaxed);
+}
+
+auto AllocStats::threadCount() -> uint64_t
+{
+  return threadAllocs;
+}
+
+auto AllocStats::residentBytes() -> uint64_t
+{
+#if defined(_WIN32)
+  auto counters = PROCESS_MEMORY_COUNTERS{};
+  // the kernel32 export, so psapi does not have to be linked
+  if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    return 0;
+  return counters.WorkingSetSize;
+#elif defined(__linux__)
+  // the second field is the resident pages
+  auto fp = std::fopen("/proc/self/statm", "r");
+  if (!fp)
+    return 0;
+  auto size = 0ull;
+  auto resident = 0ull;
+  const auto n = std::fscanf(fp, "%llu %llu", &size, &resident);
+  std::fclose(fp);
+  if (n != 2)
+    return 0;
+  return resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+#else
+  return 0;
+#endif
+}
+
+auto operator new(std::size_t sz) -> void *
+{
+  return alloc(sz);
+}
+
+auto operator new[](std::size_t sz) -> void *
+{
+  return alloc(sz);
+}
+
+auto operator delete(void *p) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete[](void *p) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete(void *p, std::size_t) noexcept -> void
+{
+  std::free(p);
+}
+
+auto operator delete[](void *p, std::size_t) noexcept -> void
+{
+  std::free(p);
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+
+// Counts calls to the replaceable global operator new so the benchmark mode can report
+// allocations per frame. The counter is a relaxed atomic and is always on.
+namespace AllocStats
+{
+  auto count() -> uint64_t;
+  // the calling thread's share of count(), what the main loop itself allocates while the workers,
+  // the recognizer and the network threads go about their business
+  auto threadCount() -> uint64_t;
+  // resident set size of the process, 0 where the platform does not tell
+  auto residentBytes() -> uint64_t;
+} // namespace AllocStats
@@ -0,0 +1,32 @@
+#include "alpha-mask.hpp"
+#include <algorithm>
+
+AlphaMask::AlphaMask(const unsigned char *rgba, int aW, int aH)
+{
+  while ((std::max(aW, aH) >> shift) > MaxSide)
+    ++shift;
+  w = (aW + (1 << shift) - 1) >> shift;
+  h = (aH + (1 << shift) - 1) >> shift;
+  wordsPerRow = (w + 63) / 64;
+  bits.resize(static_cast<size_t>(wordsPerRow) * h);
+  for (auto y = 0; y < aH; ++y)
+  {
+    const auto row = rgba + static_cast<size_t>(y) * aW * 4;
+    auto dst = bits.data() + static_cast<size_t>(y >> shift) * wordsPerRow;
+    for (auto x = 0; x < aW; ++x)
+      if (row[x * 4 + 3] >= Threshold)
+      {
+        const auto mx = x >> shift;
+        dst[mx / 64] |= uint64_t{1} << (mx % 64);
+      }
+  }
+}
+
+auto AlphaMask::isOpaque(int x, int y) const -> bool
+{
+  const auto mx = x >> shift;
+  const auto my = y >> shift;
+  if (mx < 0 || mx >= w || my < 0 || my >= h)
+    return false;
+  return (bits[static_cast<size_t>(my) * wordsPerRow + mx / 64] >> (mx % 64)) & 1;
+}
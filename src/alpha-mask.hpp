@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 1 bit per texel "alpha >= threshold" mask used for hit testing once the RGBA pixels are freed.
+// Images whose longest side exceeds MaxSide are sampled in power of two blocks; a block is opaque
+// if any texel in it is, so clicks never fall through visible pixels.
+class AlphaMask
+{
+public:
+  AlphaMask() = default;
+  AlphaMask(const unsigned char *rgba, int w, int h);
+  auto bytes() const -> size_t { return bits.size() * sizeof(uint64_t); }
+  auto empty() const -> bool { return bits.empty(); }
+  auto isOpaque(int x, int y) const -> bool;
+
+  static constexpr auto Threshold = 127;
+  static constexpr auto MaxSide = 2048;
+
+private:
+  int w = 0;
+  int h = 0;
+  int shift = 0;
+  int wordsPerRow = 0;
+  std::vector<uint64_t> bits;
+};
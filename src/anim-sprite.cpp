@@ -1,3 +1,4 @@
+#include <cmath>
 #include <imgui.h>
 #include <spdlog/spdlog.h>
 
@@ -5,72 +6,55 @@
 #include "ui.hpp"
 #include "undo.hpp"
 
-AnimSprite::AnimSprite(Lib &lib, Undo &aUndo, const std::filesystem::path &path)
+template <typename S, typename ClassName>
+BasicAnimSprite<S, ClassName>::BasicAnimSprite(Lib &lib, Undo &aUndo, const std::filesystem::path &path)
   : Node(lib, aUndo, path.filename().string()),
     sprite(lib, aUndo, path),
-    startTime(std::chrono::high_resolution_clock::now()),
-    arrowN(lib.queryTex("engine:arrow-n-circle.png", true)),
-    arrowNE(lib.queryTex("engine:arrow-ne-circle.png", true)),
-    arrowE(lib.queryTex("engine:arrow-e-circle.png", true)),
-    arrowSE(lib.queryTex("engine:arrow-se-circle.png", true)),
-    arrowS(lib.queryTex("engine:arrow-s-circle.png", true)),
-    arrowSW(lib.queryTex("engine:arrow-sw-circle.png", true)),
-    arrowW(lib.queryTex("engine:arrow-w-circle.png", true)),
-    arrowNW(lib.queryTex("engine:arrow-nw-circle.png", true)),
-    center(lib.queryTex("engine:center-circle.png", true))
+    startTime(frameCtx.get().now),
+    body(lib.physics())
 {
 }
 
-static auto getProjectionMatrix() -> glm::mat4
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::do_clone() const -> std::shared_ptr<Node>
 {
-  GLfloat projectionMatrixData[16];
-  glGetFloatv(GL_PROJECTION_MATRIX, projectionMatrixData);
-  return glm::make_mat4(projectionMatrixData);
+  return std::make_shared<BasicAnimSprite>(*this);
 }
 
-auto AnimSprite::do_clone() const -> std::shared_ptr<Node>
-{
-  return std::make_shared<AnimSprite>(*this);
-}
-
-auto AnimSprite::render(float dt, Node *hovered, Node *selected) -> void
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::animate(float /*dt*/) -> void
 {
   if (sprite.numFrames() > 0)
     sprite.frame(static_cast<int>(std::chrono::duration_cast<std::chrono::microseconds>(
-                                    std::chrono::high_resolution_clock::now() - startTime)
+                                    frameCtx.get().now - startTime)
                                     .count() *
                                   fps / 1'000'000) %
                  sprite.numFrames());
-  sprite.render();
-  Node::render(dt, hovered, selected);
-  if (dt <= 0.f)
-    return;
-
-  const auto projMat = getProjectionMatrix();
-  const auto pivot4 = glm::vec4{pivot().x, pivot().y, 0.f, 1.f};
-  const auto projPivot = projMat * modelViewMat * pivot4;
-  const auto v = (glm::vec2{projPivot.x, projPivot.y} - lastProjPivot) / dt;
-  const auto gForce = glm::vec2{0.f, .3f};
-  const auto a = (v - lastProjPivotV) / dt + gForce;
-  lastProjPivot = glm::vec2{projPivot.x, projPivot.y};
-  lastProjPivotV = v;
-  if (!physics)
-    return;
+  if (sprite.numFrames() > 1 && fps > 0.f)
+    scheduler.get().wakeIn(std::chrono::microseconds(static_cast<int64_t>(1'000'000 / fps)));
 
-  if (glm::length(end - pivot()) < 1.f)
-    return;
+  // the spring itself is stepped by Physics before the next frame; each body has its own slot
+  const auto &projMat = frameCtx.get().projMat;
+  const auto projPivot = projMat * modelViewMat * glm::vec4{pivot().x, pivot().y, 0.f, 1.f};
+  const auto projEnd = projMat * modelViewMat * glm::vec4{end.x, end.y, 0.f, 1.f};
+  body.sample(glm::vec2{projPivot},
+              glm::vec2{projEnd},
+              physics && glm::length(end - pivot()) >= 1.f,
+              force,
+              damping,
+              springiness,
+              &dRot);
+}
 
-  const auto end4 = glm::vec4{end.x, end.y, 0.f, 1.f};
-  const auto projEnd = projMat * modelViewMat * end4;
-  const auto pivotToEnd = glm::vec2(projEnd) - glm::vec2(projPivot);
-  const auto orthogonalVec = glm::vec2{-pivotToEnd.y, pivotToEnd.x};
-  const auto normalizedOrthogonalVec = glm::normalize(orthogonalVec);
-  float projection = glm::dot(a, normalizedOrthogonalVec);
-  animRotV += (-force * projection - dRot * springiness - animRotV * damping) * dt;
-  dRot += animRotV * dt;
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::render(float dt, Node *hovered, Node *selected) -> void
+{
+  sprite.render();
+  Node::render(dt, hovered, selected);
 
-  if (selected != this)
+  if (!physics || selected != this)
     return;
+  batch.get().immediate();
   glColor4f(1.f, .7f, .0f, 1.f);
   glBegin(GL_LINES);
   glVertex2f(pivot().x, pivot().y);
@@ -78,7 +62,8 @@ auto AnimSprite::render(float dt, Node *hovered, Node *selected) -> void
   glEnd();
 }
 
-auto AnimSprite::renderUi() -> void
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::renderUi() -> void
 {
   Node::renderUi();
   sprite.renderUi();
@@ -92,7 +77,7 @@ auto AnimSprite::renderUi() -> void
   ImGui::TableNextColumn();
   if (Ui::checkbox(undo, "##Physics", physics))
   {
-    animRotV = {};
+    body.reset();
     dRot = {};
     dLoc = {};
     dScale = {};
@@ -118,7 +103,7 @@ auto AnimSprite::renderUi() -> void
                   std::numeric_limits<float>::max(),
                   "%.1f");
     const auto sz = 2 * ImGui::GetFontSize();
-    if (Ui::btnImg("nw2", *arrowNW, sz, sz))
+    if (icons.get().button("nw2", EditorIcons::Icon::arrowNW, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{0, h()}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -141,7 +126,7 @@ auto AnimSprite::renderUi() -> void
           }
         });
     ImGui::SameLine();
-    if (Ui::btnImg("n2", *arrowN, sz, sz))
+    if (icons.get().button("n2", EditorIcons::Icon::arrowN, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{w() / 2, h()}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -164,7 +149,7 @@ auto AnimSprite::renderUi() -> void
           }
         });
     ImGui::SameLine();
-    if (Ui::btnImg("ne2", *arrowNE, sz, sz))
+    if (icons.get().button("ne2", EditorIcons::Icon::arrowNE, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{w(), h()}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -186,7 +171,7 @@ auto AnimSprite::renderUi() -> void
             SPDLOG_INFO("this was destroyed");
           }
         });
-    if (Ui::btnImg("w2", *arrowW, sz, sz))
+    if (icons.get().button("w2", EditorIcons::Icon::arrowW, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{0, h() / 2}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -209,7 +194,7 @@ auto AnimSprite::renderUi() -> void
           }
         });
     ImGui::SameLine();
-    if (Ui::btnImg("c2", *center, sz, sz))
+    if (icons.get().button("c2", EditorIcons::Icon::center, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{w() / 2, h() / 2}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -232,7 +217,7 @@ auto AnimSprite::renderUi() -> void
           }
         });
     ImGui::SameLine();
-    if (Ui::btnImg("e2", *arrowE, sz, sz))
+    if (icons.get().button("e2", EditorIcons::Icon::arrowE, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{w(), h() / 2}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -254,7 +239,7 @@ auto AnimSprite::renderUi() -> void
             SPDLOG_INFO("this was destroyed");
           }
         });
-    if (Ui::btnImg("sw2", *arrowSW, sz, sz))
+    if (icons.get().button("sw2", EditorIcons::Icon::arrowSW, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{0, 0}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -277,7 +262,7 @@ auto AnimSprite::renderUi() -> void
           }
         });
     ImGui::SameLine();
-    if (Ui::btnImg("s2", *arrowS, sz, sz))
+    if (icons.get().button("s2", EditorIcons::Icon::arrowS, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{w() / 2, 0}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -300,7 +285,7 @@ auto AnimSprite::renderUi() -> void
           }
         });
     ImGui::SameLine();
-    if (Ui::btnImg("se2", *arrowSE, sz, sz))
+    if (icons.get().button("se2", EditorIcons::Icon::arrowSE, sz, sz))
       undo.get().record(
         [newEnd = glm::vec2{w(), 0}, alive = weak_self()]() {
           if (auto self = alive.lock())
@@ -358,7 +343,8 @@ auto AnimSprite::renderUi() -> void
   }
 }
 
-auto AnimSprite::save(OStrm &strm) const -> void
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::save(OStrm &strm) const -> void
 {
   ::ser(strm, className);
   ::ser(strm, name);
@@ -367,24 +353,44 @@ auto AnimSprite::save(OStrm &strm) const -> void
   Node::save(strm);
 }
 
-auto AnimSprite::load(IStrm &strm) -> void
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::load(IStrm &strm) -> void
 {
   ::deser(strm, *this);
   sprite.load(strm);
   Node::load(strm);
 }
 
-auto AnimSprite::h() const -> float
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::isStatic() const -> bool
+{
+  // the physics body is sampled while rendering
+  return sprite.numFrames() <= 1 && !physics;
+}
+
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::heldBytes(Counted &counted) const -> size_t
+{
+  return sizeof(*this) + sprite.textureBytes(counted);
+}
+
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::h() const -> float
 {
   return sprite.h();
 }
 
-auto AnimSprite::isTransparent(glm::vec2 v) const -> bool
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::isTransparent(glm::vec2 v) const -> bool
 {
   return sprite.isTransparent(v);
 }
 
-auto AnimSprite::w() const -> float
+template <typename S, typename ClassName>
+auto BasicAnimSprite<S, ClassName>::w() const -> float
 {
   return sprite.w();
 }
+
+template class BasicAnimSprite<SpriteSheet, AnimSpriteClassName>;
+template class BasicAnimSprite<AnimatedImage, AnimatedImageSpriteClassName>;
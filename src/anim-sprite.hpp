@@ -1,9 +1,12 @@
 #pragma once
+#include "animated-image.hpp"
 #include "node.hpp"
+#include "physics.hpp"
 #include "sprite-sheet.hpp"
 #include <chrono>
 
-class AnimSprite : public Node
+template <typename S, typename ClassName>
+class BasicAnimSprite : public Node
 {
 public:
 #define SER_PROP_LIST \
@@ -17,17 +20,20 @@ public:
   SER_DEF_PROPS()
 #undef SER_PROP_LIST
 
-  AnimSprite(Lib &, Undo &, const std::filesystem::path &);
-  static constexpr const char *className = "AnimSprite";
+  BasicAnimSprite(Lib &, Undo &, const std::filesystem::path &);
+  constexpr static const char *className = ClassName::v;
 
 protected:
+  auto animate(float dt) -> void override;
   auto render(float dt, Node *hovered, Node *selected) -> void override;
   auto save(OStrm &) const -> void override;
   auto load(IStrm &) -> void override;
   auto renderUi() -> void override;
+  auto isStatic() const -> bool override;
+  auto heldBytes(Counted &) const -> size_t override;
 
 protected:
-  SpriteSheet sprite;
+  S sprite;
 
 private:
   float fps = 30.f;
@@ -36,22 +42,24 @@ private:
   float force = 200.f;
   float damping = 1.f;
   float springiness = 2.f;
-  std::chrono::high_resolution_clock::time_point startTime;
-  float animRotV = 0.f;
-  glm::vec2 lastProjPivot = {0.f, 0.f};
-  glm::vec2 lastProjPivotV = {0.f, 0.f};
-  std::shared_ptr<const Texture> arrowN;
-  std::shared_ptr<const Texture> arrowNE;
-  std::shared_ptr<const Texture> arrowE;
-  std::shared_ptr<const Texture> arrowSE;
-  std::shared_ptr<const Texture> arrowS;
-  std::shared_ptr<const Texture> arrowSW;
-  std::shared_ptr<const Texture> arrowW;
-  std::shared_ptr<const Texture> arrowNW;
-  std::shared_ptr<const Texture> center;
+  std::chrono::steady_clock::time_point startTime;
+  PhysicsBody body;
 
   auto h() const -> float final;
   auto isTransparent(glm::vec2) const -> bool final;
   auto w() const -> float final;
   auto do_clone() const -> std::shared_ptr<Node>;
 };
+
+struct AnimSpriteClassName
+{
+  constexpr static const char *v = "AnimSprite";
+};
+
+struct AnimatedImageSpriteClassName
+{
+  constexpr static const char *v = "AnimatedImageSprite";
+};
+
+using AnimSprite = BasicAnimSprite<SpriteSheet, AnimSpriteClassName>;
+using AnimatedImageSprite = BasicAnimSprite<AnimatedImage, AnimatedImageSpriteClassName>;
@@ -0,0 +1,304 @@
+#include "animated-image.hpp"
+#include "file.hpp"
+#include "gif-decoder.hpp"
+#include "imgui-helpers.hpp"
+#include "ui.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+struct AnimatedImage::Stream
+{
+  explicit Stream(const std::filesystem::path &path) : file(path), decoder(file.view()) {}
+  MappedFile file;
+  GifDecoder decoder;
+};
+
+namespace
+{
+  struct Frame
+  {
+    int index = 0;
+    // bottom row first, as the textures are drawn
+    std::vector<unsigned char> rgba;
+    AlphaMask alphaMask;
+  };
+
+  auto flipped(const unsigned char *rgba, int w, int h) -> std::vector<unsigned char>
+  {
+    const auto stride = static_cast<size_t>(w) * 4;
+    auto ret = std::vector<unsigned char>(stride * h);
+    for (auto y = 0; y < h; ++y)
+      std::memcpy(ret.data() + (h - 1 - y) * stride, rgba + y * stride, stride);
+    return ret;
+  }
+
+  // runs on a worker and is the only user of the decoder until it returns
+  auto decode(GifDecoder &decoder, int w, int h, int from, int count) -> std::vector<Frame>
+  {
+    auto ret = std::vector<Frame>{};
+    if (decoder.index() > from)
+      decoder.rewind();
+    while (decoder.index() < from)
+      if (!decoder.next())
+      {
+        decoder.rewind();
+        return ret;
+      }
+    for (auto i = 0; i < count; ++i)
+    {
+      const auto index = decoder.index();
+      const auto rgba = decoder.next();
+      if (!rgba)
+      {
+        decoder.rewind();
+        break;
+      }
+      auto frame = Frame{index, flipped(rgba, w, h), {}};
+      frame.alphaMask = AlphaMask{frame.rgba.data(), w, h};
+      ret.push_back(std::move(frame));
+    }
+    return ret;
+  }
+} // namespace
+
+AnimatedImage::AnimatedImage(Lib &aLib, Undo &aUndo, const std::filesystem::path &aPath)
+  : lib(aLib),
+    undo(aUndo),
+    path([&]() {
+      try
+      {
+        if (!std::filesystem::exists(aPath.filename()))
+          std::filesystem::copy(aPath, aPath.filename());
+      }
+      catch (std::runtime_error &e)
+      {
+        SPDLOG_ERROR("{:t}", e);
+      }
+      return aPath.filename().string();
+    }()),
+    alive(std::make_shared<AnimatedImage *>(this))
+{
+  auto s = std::make_shared<Stream>(path);
+  if (!s->file)
+  {
+    SPDLOG_ERROR("Error opening animation {:?}: {}", path, std::strerror(errno));
+    return;
+  }
+  const auto info = GifDecoder::scan(s->file.view());
+  if (info.frames == 0)
+  {
+    SPDLOG_ERROR("{:?} is not a GIF", path);
+    return;
+  }
+  w_ = info.w;
+  h_ = info.h;
+  numFrames_ = info.frames;
+  stream = std::move(s);
+}
+
+AnimatedImage::AnimatedImage(const AnimatedImage &other) : AnimatedImage(other.lib, other.undo, other.path)
+{
+  frame_ = other.frame_;
+}
+
+AnimatedImage::~AnimatedImage()
+{
+  // a decode in flight keeps the stream alive and drops its frames
+  *alive = nullptr;
+  lib.get().streamer().remove(this);
+  decoding.cancel();
+  for (auto &slot : slots)
+    if (slot.texture)
+      glDeleteTextures(1, &slot.texture);
+}
+
+auto AnimatedImage::frame() const -> int
+{
+  return frame_;
+}
+
+auto AnimatedImage::frame(int v) -> void
+{
+  frame_ = v;
+}
+
+auto AnimatedImage::numFrames() const -> int
+{
+  return numFrames_;
+}
+
+auto AnimatedImage::w() const -> float
+{
+  return numFrames_ > 0 ? static_cast<float>(w_) : 100.f;
+}
+
+auto AnimatedImage::h() const -> float
+{
+  return numFrames_ > 0 ? static_cast<float>(h_) : 100.f;
+}
+
+auto AnimatedImage::find(int f) const -> int
+{
+  for (auto i = 0; i < RingSize; ++i)
+    if (slots[i].frame == f)
+      return i;
+  return -1;
+}
+
+auto AnimatedImage::isWanted(int f) const -> bool
+{
+  return numFrames_ > 0 && (f - frame_ % numFrames_ + numFrames_) % numFrames_ < Lookahead;
+}
+
+auto AnimatedImage::victim() const -> int
+{
+  auto ret = -1;
+  for (auto i = 0; i < RingSize; ++i)
+  {
+    const auto &slot = slots[i];
+    if (slot.frame < 0)
+      return i;
+    if (i == shown || isWanted(slot.frame))
+      continue;
+    if (ret < 0 || slot.used < slots[ret].used)
+      ret = i;
+  }
+  // the window covers the ring, the oldest frame apart from the one on screen goes
+  if (ret < 0)
+    for (auto i = 0; i < RingSize; ++i)
+      if (i != shown && (ret < 0 || slots[i].used < slots[ret].used))
+        ret = i;
+  return ret;
+}
+
+auto AnimatedImage::pump() -> void
+{
+  if (isDecoding || !stream)
+    return;
+  // the first frame of the window not in the ring, and the rest of the window up to the loop end
+  auto from = -1;
+  auto count = 0;
+  for (auto i = 0; i < std::min(Lookahead, numFrames_); ++i)
+    if (const auto f = (frame_ + i) % numFrames_; find(f) < 0)
+    {
+      from = f;
+      count = std::min(Lookahead - i, numFrames_ - f);
+      break;
+    }
+  if (from < 0)
+    return;
+  isDecoding = true;
+  // the streamer drops the entry when the image goes away before its turn, so this stays valid
+  lib.get().streamer().add(this, [this, from, count](TextureStreamer::Finished finished) mutable {
+    auto frames = std::make_shared<std::vector<Frame>>();
+    decoding = lib.get().streamer().uv().queueWork(
+      [frames, stream = stream, w = w_, h = h_, from, count]() {
+        *frames = decode(stream->decoder, w, h, from, count);
+      },
+      [frames, from, alive = alive, finished = std::move(finished)](int status) mutable {
+        finished();
+        auto self = *alive;
+        if (!self)
+          return;
+        self->isDecoding = false;
+        if (status != 0)
+          return;
+        if (frames->empty())
+        {
+          // the file holds fewer frames than its blocks promised, or a corrupt one
+          SPDLOG_ERROR("Error decoding frame {} of {:?}", from, self->path);
+          self->numFrames_ = from;
+          if (from == 0)
+            self->stream = nullptr;
+          return;
+        }
+        auto isCurrent = false;
+        for (auto &f : *frames)
+        {
+          if (f.index >= self->numFrames_ || self->find(f.index) >= 0)
+            continue;
+          auto &slot = self->slots[self->victim()];
+          if (!slot.texture)
+          {
+            glGenTextures(1, &slot.texture);
+            glBindTexture(GL_TEXTURE_2D, slot.texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(
+              GL_TEXTURE_2D, 0, GL_RGBA, self->w_, self->h_, 0, GL_RGBA, GL_UNSIGNED_BYTE, f.rgba.data());
+          }
+          else
+          {
+            glBindTexture(GL_TEXTURE_2D, slot.texture);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, self->w_, self->h_, GL_RGBA, GL_UNSIGNED_BYTE, f.rgba.data());
+          }
+          slot.frame = f.index;
+          slot.alphaMask = std::move(f.alphaMask);
+          slot.used = ++self->useCount;
+          isCurrent = isCurrent || f.index == self->frame_ % self->numFrames_;
+        }
+        if (isCurrent)
+          self->lib.get().scheduler().invalidateLayers();
+        self->pump();
+      });
+  });
+}
+
+auto AnimatedImage::render() -> void
+{
+  pump();
+  if (numFrames_ == 0)
+    return;
+  if (const auto i = find(frame_ % numFrames_); i >= 0)
+  {
+    shown = i;
+    slots[i].used = ++useCount;
+  }
+  if (shown < 0)
+    return;
+  lib.get().spriteBatch().quad(
+    slots[shown].texture, glm::vec2{.0f, .0f}, glm::vec2{w(), h()}, glm::vec2{.0f, .0f}, glm::vec2{1.f, 1.f});
+}
+
+auto AnimatedImage::isTransparent(glm::vec2 v) const -> bool
+{
+  if (shown < 0)
+    return false;
+  const auto x = static_cast<int>(v.x);
+  const auto y = static_cast<int>(v.y);
+  if (x < 0 || x >= w_ || y < 0 || y >= h_)
+    return true;
+  return !slots[shown].alphaMask.isOpaque(x, y);
+}
+
+auto AnimatedImage::renderUi() -> void
+{
+  ImGui::TableNextColumn();
+  Ui::textRj("Animation");
+  ImGui::TableNextColumn();
+  ImGui::TextF("{} {}x{}, {} frames", path, w_, h_, numFrames_);
+}
+
+auto AnimatedImage::textureBytes(Node::Counted &) const -> size_t
+{
+  const auto pixels = static_cast<size_t>(w_) * static_cast<size_t>(h_);
+  auto ret = size_t{0};
+  for (const auto &slot : slots)
+    if (slot.texture)
+      ret += pixels * 4 + slot.alphaMask.bytes();
+  // the frame being composed, its background and the disposal history
+  if (stream)
+    ret += pixels * 9;
+  return ret;
+}
+
+// the file is the node's name, there is nothing else to keep
+auto AnimatedImage::save(OStrm &) const -> void {}
+
+auto AnimatedImage::load(IStrm &) -> void {}
@@ -0,0 +1,71 @@
+#pragma once
+#include "alpha-mask.hpp"
+#include "lib.hpp"
+#include "node.hpp"
+#include <SDL_opengl.h>
+#include <array>
+#include <filesystem>
+#include <memory>
+#include <string>
+
+// A frame source for AnimSprite, Mouth and Blink that plays an animated GIF without holding the
+// whole loop: frames are decoded in order on the texture streamer's workers and uploaded into a
+// ring of RingSize textures, the frame asked for and the ones after it. A frame that is not in
+// the ring yet keeps the last one on screen until it arrives. Asking for a frame behind the
+// decoder restarts it from the first frame, as GIF frames are drawn over the ones before.
+class AnimatedImage
+{
+public:
+  AnimatedImage(Lib &, Undo &, const std::filesystem::path &path);
+  // the ring is not shared, the copy decodes on its own
+  AnimatedImage(const AnimatedImage &);
+  ~AnimatedImage();
+  auto frame() const -> int;
+  auto frame(int) -> void;
+  auto h() const -> float;
+  auto isTransparent(glm::vec2) const -> bool;
+  auto load(IStrm &) -> void;
+  auto numFrames() const -> int;
+  auto render() -> void;
+  auto renderUi() -> void;
+  auto save(OStrm &) const -> void;
+  // the ring and the decoder, nothing is shared
+  auto textureBytes(Node::Counted &) const -> size_t;
+  auto w() const -> float;
+
+  static constexpr auto RingSize = 8;
+  // how many frames from the current one on are decoded ahead
+  static constexpr auto Lookahead = RingSize - 2;
+
+private:
+  struct Stream;
+  struct Slot
+  {
+    int frame = -1;
+    GLuint texture = 0;
+    AlphaMask alphaMask;
+    // when the slot last held the frame on screen, the lowest goes first
+    uint64_t used = 0;
+  };
+
+  std::reference_wrapper<Lib> lib;
+  std::reference_wrapper<Undo> undo;
+  std::string path;
+  int w_ = 0;
+  int h_ = 0;
+  int numFrames_ = 0;
+  int frame_ = 0;
+  std::shared_ptr<Stream> stream;
+  std::array<Slot, RingSize> slots;
+  // the slot drawn last, shown again while the frame asked for is on its way
+  int shown = -1;
+  uint64_t useCount = 0;
+  bool isDecoding = false;
+  uv::Work decoding;
+  std::shared_ptr<AnimatedImage *> alive;
+
+  auto find(int frame) const -> int;
+  auto isWanted(int frame) const -> bool;
+  auto pump() -> void;
+  auto victim() const -> int;
+};
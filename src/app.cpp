@@ -1,67 +1,67 @@
 #include "app.hpp"
 #include "add-as-dialog.hpp"
 #include "ai-mouth.hpp"
+#include "alloc-stats.hpp"
 #include "anim-sprite.hpp"
+#include "avatar.hpp"
 #include "blink.hpp"
 #include "bouncer.hpp"
 #include "bouncer2.hpp"
+#include "chat-flood.hpp"
 #include "chat-v2.hpp"
 #include "chat.hpp"
 #include "eye-v2.hpp"
 #include "eye.hpp"
 #include "file-open.hpp"
+#include "file.hpp"
+#include "gl-ext.hpp"
 #include "imgui-helpers.hpp"
 #include "input-dialog.hpp"
 #include "message-dialog.hpp"
 #include "mouth.hpp"
 #include "preferences-dialog.hpp"
 #include "prj-dialog.hpp"
+#include "project-format.hpp"
 #include "root.hpp"
+#include "session-replay.hpp"
+#include "trace.hpp"
 #include "ui.hpp"
 #include "version.hpp"
 
 #include <imgui_impl_opengl3.h>
 #include <imgui_impl_sdl2.h>
 #include <SDL_opengl.h>
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fmt/chrono.h>
 #include <fmt/std.h>
-#include <fstream>
+#include <glm/gtc/matrix_transform.hpp>
+#include <numeric>
 #include <spdlog/spdlog.h>
-
-static auto getProjMat() -> glm::mat4
-{
-  GLfloat projMatData[16];
-  glGetFloatv(GL_PROJECTION_MATRIX, projMatData);
-  return glm::make_mat4(projMatData);
-}
+#include <thread>
 
 App::App(sdl::Window &aWindow, int argc, char *argv[])
   : window(aWindow),
     gl_context(SDL_GL_CreateContext(window.get().get())),
-    lastUpdate(std::chrono::high_resolution_clock::now()),
-    audioOut(preferences.audioOut),
-    audioIn(uv, preferences.audioIn, wav2Visemes.sampleRate(), wav2Visemes.frameSize()),
-    mouseTracking(uv),
+    lastUpdate(std::chrono::steady_clock::now()),
+    audioDevices(uv),
+    audioOut(audioDevices, preferences.audioOut),
+    audioIn(uv, audioDevices, preferences.audioIn, wav2Visemes.sampleRate(), preferences.latencyBudgetMs),
+    mouseTracking(uv, frameCtx, preferences),
     httpClient(uv),
-    lib(preferences, uv, httpClient),
-    selectIco(lib.queryTex("engine:select.png", true)),
-    translateIco(lib.queryTex("engine:transalte.png", true)),
-    scaleIco(lib.queryTex("engine:scale.png", true)),
-    rotateIco(lib.queryTex("engine:rotate.png", true)),
-    selectDisabledIco(lib.queryTex("engine:select-disabled.png", true)),
-    translateDisabledIco(lib.queryTex("engine:transalte-disabled.png", true)),
-    scaleDisabledIco(lib.queryTex("engine:scale-disabled.png", true)),
-    rotateDisabledIco(lib.queryTex("engine:rotate-disabled.png", true)),
-    hideIco(lib.queryTex("engine:eye-sprite.png", true)),
-    showIco(lib.queryTex("engine:not-visable.png", true)),
-    arrowN(lib.queryTex("engine:arrow-n-circle.png", true)),
-    arrowE(lib.queryTex("engine:arrow-e-circle.png", true)),
-    arrowS(lib.queryTex("engine:arrow-s-circle.png", true)),
-    arrowW(lib.queryTex("engine:arrow-w-circle.png", true)),
+    lib(preferences, uv, audioDevices, httpClient, frameCtx),
+    perfHud(uv, preferences, audioIn, wav2Visemes, httpClient, lib),
     renderTimer(uv.createTimer()),
-    renderIdle(uv.createIdle())
+    powerTimer(uv.createTimer()),
+    autosaveTimer(uv.createTimer())
 {
+  Trace::nameThread("main");
   SDL_GL_MakeCurrent(window.get().get(), gl_context);
   SDL_GL_SetSwapInterval(preferences.vsync ? 1 : 0);
+  GlExt::init();
 
   // Decide GL+GLSL versions
 #if defined(IMGUI_IMPL_OPENGL_ES2)
@@ -115,58 +115,90 @@ App::App(sdl::Window &aWindow, int argc, char *argv[])
   io.Fonts->AddFontFromFileTTF("assets/notepad_font/NotepadFont.ttf", 17.5f);
   // ImFont* font = io.Fonts->AddFontFromFileTTF("c:\\Windows\\Fonts\\ArialUni.ttf", 18.0f, NULL,
   // io.Fonts->GetGlyphRangesJapanese()); IM_ASSERT(font != NULL);
+  startup.mark("ImGui");
 
   window.get().getPosition(&originalX, &originalY);
   window.get().getSize(&width, &height);
 
   SPDLOG_INFO("sample rate: {}", wav2Visemes.sampleRate());
   SPDLOG_INFO("frame rate: {}", wav2Visemes.frameSize());
+  wav2Visemes.setNoiseFloor(preferences.noiseFloor);
   audioIn.reg(wav2Visemes);
-  saveFactory.reg<Bouncer>(
-    [this](std::string) { return std::make_unique<Bouncer>(lib, undo, audioIn); });
-  saveFactory.reg<Bouncer2>([this](std::string name) {
-    return std::make_unique<Bouncer2>(lib, undo, audioIn, std::move(name));
-  });
-  saveFactory.reg<Root>([this](std::string) { return std::make_unique<Root>(lib, undo); });
-  saveFactory.reg<SpriteSheetMouth>([this](std::string name) {
-    return std::make_unique<SpriteSheetMouth>(wav2Visemes, lib, undo, std::move(name));
-  });
-  saveFactory.reg<ImageListMouth>([this](std::string name) {
-    return std::make_unique<ImageListMouth>(wav2Visemes, lib, undo, std::move(name));
-  });
-  saveFactory.reg<AnimSprite>(
-    [this](std::string name) { return std::make_unique<AnimSprite>(lib, undo, std::move(name)); });
-  saveFactory.reg<Eye>([this](std::string name) {
-    return std::make_unique<Eye>(mouseTracking, lib, undo, std::move(name));
-  });
-  saveFactory.reg<EyeV2>([this](std::string name) {
-    return std::make_unique<EyeV2>(mouseTracking, lib, undo, std::move(name));
-  });
-  saveFactory.reg<Chat>([this](std::string name) {
-    return std::make_unique<Chat>(lib, undo, uv, audioOut, std::move(name));
-  });
-  saveFactory.reg<ChatV2>([this](std::string name) {
-    return std::make_unique<ChatV2>(lib, undo, uv, audioOut, std::move(name));
-  });
-  saveFactory.reg<AiMouth>([this](std::string name) {
-    return std::make_unique<AiMouth>(lib, undo, audioIn, audioOut, wav2Visemes, std::move(name));
-  });
-  saveFactory.reg<SpriteSheetBlink>(
-    [this](std::string name) { return std::make_unique<SpriteSheetBlink>(lib, undo, std::move(name)); });
-  saveFactory.reg<ImageListBlink>(
-    [this](std::string name) { return std::make_unique<ImageListBlink>(lib, undo, std::move(name)); });
+  registerNodes(saveFactory, undo, wav2Visemes);
 
   if (argc == 2)
   {
     std::filesystem::current_path(argv[1]);
     showUi = false;
     loadPrj();
+    startup.mark("project");
   }
   setupRendering();
+  setupOutput();
+  startup.mark("output");
+  autosaveTimer.start(
+    [this]() {
+      if (isBenchmark || isSaving || undo.version() == savedVersion)
+        return;
+      savePrj();
+    },
+    AutosaveMs,
+    AutosaveMs);
+  // the decodes of the icons and the project textures, and the recognizer model, go on loading
+  startup.done();
+}
+
+auto App::registerNodes(SaveFactory &factory, Undo &sceneUndo, VisemesSource &visemes) -> void
+{
+  factory.reg<Bouncer>(
+    [this, &sceneUndo](std::string) { return std::make_unique<Bouncer>(lib, sceneUndo, audioIn); });
+  factory.reg<Bouncer2>([this, &sceneUndo](std::string name) {
+    return std::make_unique<Bouncer2>(lib, sceneUndo, audioIn, std::move(name));
+  });
+  factory.reg<Root>([this, &sceneUndo](std::string) { return std::make_unique<Root>(lib, sceneUndo); });
+  factory.reg<SpriteSheetMouth>([this, &sceneUndo, &visemes](std::string name) {
+    return std::make_unique<SpriteSheetMouth>(visemes, lib, sceneUndo, std::move(name));
+  });
+  factory.reg<ImageListMouth>([this, &sceneUndo, &visemes](std::string name) {
+    return std::make_unique<ImageListMouth>(visemes, lib, sceneUndo, std::move(name));
+  });
+  factory.reg<AnimSprite>([this, &sceneUndo](std::string name) {
+    return std::make_unique<AnimSprite>(lib, sceneUndo, std::move(name));
+  });
+  factory.reg<AnimatedImageSprite>([this, &sceneUndo](std::string name) {
+    return std::make_unique<AnimatedImageSprite>(lib, sceneUndo, std::move(name));
+  });
+  factory.reg<AnimatedImageMouth>([this, &sceneUndo, &visemes](std::string name) {
+    return std::make_unique<AnimatedImageMouth>(visemes, lib, sceneUndo, std::move(name));
+  });
+  factory.reg<Eye>([this, &sceneUndo](std::string name) {
+    return std::make_unique<Eye>(mouseTracking, lib, sceneUndo, std::move(name));
+  });
+  factory.reg<EyeV2>([this, &sceneUndo](std::string name) {
+    return std::make_unique<EyeV2>(mouseTracking, lib, sceneUndo, std::move(name));
+  });
+  factory.reg<Chat>([this, &sceneUndo](std::string name) {
+    return std::make_unique<Chat>(lib, sceneUndo, uv, audioOut, std::move(name));
+  });
+  factory.reg<ChatV2>([this, &sceneUndo](std::string name) {
+    return std::make_unique<ChatV2>(lib, sceneUndo, uv, audioOut, std::move(name));
+  });
+  factory.reg<AiMouth>([this, &sceneUndo, &visemes](std::string name) {
+    return std::make_unique<AiMouth>(lib, sceneUndo, audioIn, audioOut, visemes, std::move(name));
+  });
+  factory.reg<SpriteSheetBlink>([this, &sceneUndo](std::string name) {
+    return std::make_unique<SpriteSheetBlink>(lib, sceneUndo, std::move(name));
+  });
+  factory.reg<ImageListBlink>([this, &sceneUndo](std::string name) {
+    return std::make_unique<ImageListBlink>(lib, sceneUndo, std::move(name));
+  });
 }
 
 auto App::render(float dt) -> void
 {
+  // textures that finish uploading this frame are drawn in it, the rest keep the frames coming
+  if (lib.streamer().uploader().pump())
+    lib.scheduler().invalidate();
   if (!root)
   {
     glClearColor(0x45 / 255.f, 0x44 / 255.f, 0x7d / 255.f, 1.f);
@@ -174,13 +206,42 @@ auto App::render(float dt) -> void
     return;
   }
 
-  if (showUi && !isMinimized)
+  const auto isEditing = showUi && !isMinimized;
+  // with an output the outlines are drawn on the window after it, so they stay off the stream
+  const auto outlined = isEditing && !frameOutput;
+  frameCtx.transparent = static_cast<bool>(frameOutput);
+  if (frameOutput)
+    frameOutput->begin(glm::ivec2{frameCtx.viewport});
+  lib.physics().step(dt);
+  root->renderAll(dt, outlined ? hovered : nullptr, outlined ? selected : nullptr);
+  if (isFlashing)
   {
-    root->renderAll(dt, hovered, selected);
+    // over the scene, so the shared memory output flashes with the window
+    GLfloat prevClearColor[4];
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, prevClearColor);
+    glClearColor(1.f, 1.f, 1.f, 1.f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glClearColor(prevClearColor[0], prevClearColor[1], prevClearColor[2], prevClearColor[3]);
+  }
+  if (frameOutput)
+  {
+    frameOutput->end(preferences.outputToWindow);
+    if (isEditing && hovered && hovered != selected)
+      hovered->renderOutline(hovered, selected);
+    if (isEditing && selected)
+      selected->renderOutline(hovered, selected);
+  }
+  // the other characters only go to their outputs, the window shows the project's
+  frameCtx.transparent = true;
+  for (auto &avatar : avatars)
+    avatar->render(glm::ivec2{frameCtx.viewport}, dt);
+  frameCtx.transparent = false;
 
+  if (isEditing)
+  {
     if (selected)
     {
-      const auto projMat = getProjMat();
+      const auto &projMat = frameCtx.projMat;
       auto local = selected->localToScreen(projMat, selected->pivot());
       auto localX = selected->localToScreen(projMat, selected->pivot() + glm::vec2{1.f, 0.f});
       auto localY = selected->localToScreen(projMat, selected->pivot() + glm::vec2{0.f, 1.f});
@@ -264,8 +325,6 @@ auto App::render(float dt) -> void
       }
     }
   }
-  else
-    root->renderAll(dt, nullptr, nullptr);
 }
 
 auto App::renderUi(float /*dt*/) -> void
@@ -283,13 +342,15 @@ auto App::renderUi(float /*dt*/) -> void
   ImGuiStyle &style = ImGui::GetStyle();
   if (isMinimized)
     return;
+  using Icon = EditorIcons::Icon;
+  auto &icons = lib.editorIcons();
   if (!showUi)
   {
     if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
       style.Colors[ImGuiCol_WindowBg].w = .2f;
     auto showUiWindow = Ui::Window("##Show UI");
     const auto sz = 2 * ImGui::GetFontSize();
-    if (Ui::btnImg("Show UI (U)", *showIco, sz, sz))
+    if (icons.button("Show UI (U)", Icon::show, sz, sz))
       showUi = true;
     if (ImGui::IsItemHovered())
       ImGui::SetTooltip("Show UI (U)");
@@ -304,6 +365,14 @@ auto App::renderUi(float /*dt*/) -> void
     {
       if (ImGui::MenuItem("Save", "Ctrl+S"))
         savePrj();
+      if (ImGui::MenuItem("Export Asset Bundle"))
+        lib.exportBundle("prj.vtb");
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Pack the images and fonts in use into prj.vtb, which is loaded instead of the loose files");
+      if (ImGui::MenuItem("Record Session", nullptr, recorder != nullptr))
+        toggleRecording();
+      if (ImGui::IsItemHovered())
+        ImGui::SetTooltip("Record the mic, chat, mouse and HTTP responses for VoiceTuber --replay");
       ImGui::Separator();
       if (ImGui::MenuItem("Quit", "Alt+F4"))
         done = true;
@@ -336,6 +405,12 @@ auto App::renderUi(float /*dt*/) -> void
             if (r)
               addNode(AnimSprite::className, filePath.string());
           });
+      if (ImGui::MenuItem("Add Animated GIF..."))
+        dialog =
+          std::make_unique<FileOpen>(lib, "Add Animated GIF Dialog", [this](bool r, const auto &filePath) {
+            if (r)
+              addNode(AnimatedImageSprite::className, filePath.string());
+          });
       if (ImGui::MenuItem("Add Sprite Sheet Mouth..."))
         dialog = std::make_unique<FileOpen>(
           lib, "Add Sprite Sheet Mouth Dialog", [this](bool r, const auto &filePath) {
@@ -399,9 +474,49 @@ auto App::renderUi(float /*dt*/) -> void
           if (!r)
             return;
           lib.flush();
+          mouseTracking.updateRate();
           setupRendering();
+          setupOutput();
+          wav2Visemes.setNoiseFloor(preferences.noiseFloor);
+          audioIn.setLatencyBudget(preferences.latencyBudgetMs);
         });
     }
+    if (auto avatarsMenu = Ui::Menu{"Avatars"})
+    {
+      if (ImGui::MenuItem("Save Scene as Avatar..."))
+        dialog = std::make_unique<InputDialog>("Enter Avatar Name", "guest", [this](bool r, const auto &name) {
+          if (!r || name.empty())
+            return;
+          finishLoading();
+          writeAvatar(name, Avatar::snapshot(*root, false), true);
+        });
+      if (!avatars.empty())
+        ImGui::Separator();
+      auto removed = avatars.end();
+      for (auto it = avatars.begin(); it != avatars.end(); ++it)
+      {
+        auto &avatar = **it;
+        if (auto avatarMenu = Ui::Menu{avatar.name().c_str()})
+        {
+          ImGui::TextDisabled("%s", avatar.ringName().c_str());
+          if (ImGui::MenuItem("Mic", nullptr, !avatar.isMuted()))
+          {
+            avatar.mute(!avatar.isMuted());
+            writeAvatar(avatar.name(), avatar.snapshot(), false);
+          }
+          if (ImGui::MenuItem("Remove"))
+            removed = it;
+        }
+      }
+      if (removed != avatars.end())
+      {
+        auto ec = std::error_code{};
+        std::filesystem::remove(Avatar::path((*removed)->name()), ec);
+        if (ec)
+          SPDLOG_ERROR("Cannot remove avatar {:?}: {}", (*removed)->name(), ec.message());
+        avatars.erase(removed);
+      }
+    }
   }
 
   if (dialog)
@@ -412,30 +527,28 @@ auto App::renderUi(float /*dt*/) -> void
     {
       {
         const auto sz = 2 * ImGui::GetFontSize();
-        if (Ui::btnImg("Hide UI (U)", *hideIco, sz, sz))
+        if (icons.button("Hide UI (U)", Icon::hide, sz, sz))
           showUi = false;
         if (ImGui::IsItemHovered())
           ImGui::SetTooltip("Hide UI (U)");
         ImGui::SameLine();
-        if (Ui::btnImg("Select", editMode == EditMode::select ? *selectIco : *selectDisabledIco, sz, sz))
+        if (icons.button("Select", editMode == EditMode::select ? Icon::select : Icon::selectDisabled, sz, sz))
           editMode = EditMode::select;
         if (ImGui::IsItemHovered())
           ImGui::SetTooltip("Select (Shift+Q)");
         ImGui::SameLine();
-        if (Ui::btnImg("Translate",
-                       editMode == EditMode::translate ? *translateIco : *translateDisabledIco,
-                       sz,
-                       sz))
+        if (icons.button(
+              "Translate", editMode == EditMode::translate ? Icon::translate : Icon::translateDisabled, sz, sz))
           editMode = EditMode::translate;
         if (ImGui::IsItemHovered())
           ImGui::SetTooltip("Translate (Shift+W)");
         ImGui::SameLine();
-        if (Ui::btnImg("Rotate", editMode == EditMode::rotate ? *rotateIco : *rotateDisabledIco, sz, sz))
+        if (icons.button("Rotate", editMode == EditMode::rotate ? Icon::rotate : Icon::rotateDisabled, sz, sz))
           editMode = EditMode::rotate;
         if (ImGui::IsItemHovered())
           ImGui::SetTooltip("Rotate (Shift+E)");
         ImGui::SameLine();
-        if (Ui::btnImg("Scale", editMode == EditMode::scale ? *scaleIco : *scaleDisabledIco, sz, sz))
+        if (icons.button("Scale", editMode == EditMode::scale ? Icon::scale : Icon::scaleDisabled, sz, sz))
           editMode = EditMode::scale;
         if (ImGui::IsItemHovered())
           ImGui::SetTooltip("Scale (Shift+R)");
@@ -443,29 +556,63 @@ auto App::renderUi(float /*dt*/) -> void
 
       auto hierarchyButtonsDisabled = Ui::Disabled(!selected);
       const auto sz = ImGui::GetFontSize();
-      if (Ui::btnImg("<", *arrowW, sz, sz))
+      if (icons.button("<", Icon::arrowW, sz, sz))
         selected->unparent();
       if (ImGui::IsItemHovered())
         ImGui::SetTooltip("Unparent");
       ImGui::SameLine();
-      if (Ui::btnImg("^", *arrowN, sz, sz))
+      if (icons.button("^", Icon::arrowN, sz, sz))
         selected->moveUp();
       if (ImGui::IsItemHovered())
         ImGui::SetTooltip("Move up");
       ImGui::SameLine();
-      if (Ui::btnImg("V", *arrowS, sz, sz))
+      if (icons.button("V", Icon::arrowS, sz, sz))
         selected->moveDown();
       if (ImGui::IsItemHovered())
         ImGui::SetTooltip("Move down");
       ImGui::SameLine();
-      if (Ui::btnImg(">", *arrowE, sz, sz))
+      if (icons.button(">", Icon::arrowE, sz, sz))
         selected->parentWithBellow();
       if (ImGui::IsItemHovered())
         ImGui::SetTooltip("Parent with below");
     }
     renderTree(*root);
+    if (prjLoader)
+      ImGui::TextF("Loading nodes {:.0f}%", 100.f * prjLoader->progress());
     ImGui::TextF("{:3f} ms/frame ({:1f} FPS)", 1000.0f / io.Framerate, io.Framerate);
+    ImGui::TextF("{} draw calls, {} binds, {} quads",
+                 lib.spriteBatch().drawCalls(),
+                 lib.spriteBatch().binds(),
+                 lib.spriteBatch().quads());
+    if (lib.spriteBatch().canInstance())
+    {
+      ImGui::SameLine();
+      auto isInstanced = lib.spriteBatch().isInstanced();
+      if (ImGui::Checkbox("GPU transforms", &isInstanced))
+        lib.spriteBatch().instanced(isInstanced);
+    }
+    ImGui::Checkbox("Profile", &frameCtx.profile);
+    ImGui::SameLine();
+    {
+      auto gpuDisabled = Ui::Disabled(!frameCtx.profile || !NodeProfile::hasGpuTimer());
+      ImGui::Checkbox("GPU", &frameCtx.profileGpu);
+      if (ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled))
+        ImGui::SetTooltip("Time each node with GL timer queries; flushes the batch after every node");
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Performance", &showPerformance);
+    ImGui::SameLine();
+    if (auto isCalibrating = calibration != nullptr; ImGui::Checkbox("Calibrate", &isCalibrating))
+      calibration = isCalibrating ? std::make_unique<LatencyCalibration>(audioIn, audioOut, wav2Visemes) : nullptr;
+    if (ImGui::IsItemHovered())
+      ImGui::SetTooltip("Measure the mic to mouth latency by beeping into the microphone and flashing the frame");
   }
+  if (frameCtx.profile)
+    renderProfiler();
+  if (showPerformance)
+    perfHud.render();
+  if (calibration)
+    calibration->render();
   {
     auto detailsWindow = Ui::Window("Details");
     if (selected)
@@ -496,7 +643,7 @@ auto App::processIo() -> void
       {
         int mouseX, mouseY;
         SDL_GetMouseState(&mouseX, &mouseY);
-        const auto projMat = getProjMat();
+        const auto &projMat = frameCtx.projMat;
         auto newSelected = root->nodeUnder(projMat, glm::vec2{1.f * mouseX, 1.f * mouseY});
         if (newSelected != selected)
           undo.record([newSelected, this]() { selected = newSelected; },
@@ -641,11 +788,12 @@ auto App::cancel() -> void
 
 auto App::renderTree(Node &v) -> void
 {
+  using Icon = EditorIcons::Icon;
+  auto &icons = lib.editorIcons();
   ImGuiTreeNodeFlags baseFlags = ImGuiTreeNodeFlags_OpenOnArrow | ImGuiTreeNodeFlags_OpenOnDoubleClick |
                                  ImGuiTreeNodeFlags_SpanAvailWidth;
   ImGuiTreeNodeFlags nodeFlags = baseFlags;
 
-  const auto nm = v.getName();
   if (selected == &v)
     nodeFlags |= ImGuiTreeNodeFlags_Selected;
   auto dragAndDrop = [&]() {
@@ -674,6 +822,8 @@ auto App::renderTree(Node &v) -> void
       return;
     if (ImGui::AcceptDragDropPayload("_TREENODE"))
     {
+      // moving a node keeps where it is drawn by changing its transform, which is read with it
+      finishLoading();
       if (!io.KeyCtrl && !io.KeyShift && !io.KeyAlt && !io.KeySuper)
       {
         SPDLOG_INFO("{} -> {}", srcNode->getName(), v.getName());
@@ -689,11 +839,22 @@ auto App::renderTree(Node &v) -> void
   const auto &nodes = v.getNodes();
   const auto sz = ImGui::GetFontSize();
   auto const label = fmt::format("##{}", static_cast<void *>(&v));
+  // the tree node id is the pointer, so the changing timings do not affect open state
+  const auto nm = !frameCtx.profile        ? v.getName()
+                  : !frameCtx.profileGpu ? fmt::format("{}  {:.2f} ms", v.getName(), v.profile().cpuMs())
+                                         : fmt::format("{}  {:.2f} ms / {:.2f} ms GPU",
+                                                       v.getName(),
+                                                       v.profile().cpuMs(),
+                                                       v.profile().gpuMs());
   if (!nodes.empty())
   {
-    if (Ui::btnImg(label, v.visible ? *hideIco : *showIco, sz, sz))
+    if (icons.button(label, v.visible ? Icon::hide : Icon::show, sz, sz))
+    {
+      // the loader shows the nodes it has read, the rest are read first so the toggle sticks
+      finishLoading();
       undo.record([&v, newVisibility = !v.visible]() { v.visible = newVisibility; },
                   [&v, oldVisibility = v.visible]() { v.visible = oldVisibility; });
+    }
 
     ImGui::SameLine();
     nodeFlags |= ImGuiTreeNodeFlags_DefaultOpen;
@@ -711,9 +872,13 @@ auto App::renderTree(Node &v) -> void
   }
   else
   {
-    if (Ui::btnImg(label, v.visible ? *hideIco : *showIco, sz, sz))
+    if (icons.button(label, v.visible ? Icon::hide : Icon::show, sz, sz))
+    {
+      // the loader shows the nodes it has read, the rest are read first so the toggle sticks
+      finishLoading();
       undo.record([&v, newVisibility = !v.visible]() { v.visible = newVisibility; },
                   [&v, oldVisibility = v.visible]() { v.visible = oldVisibility; });
+    }
     ImGui::SameLine();
     nodeFlags |=
       ImGuiTreeNodeFlags_Leaf | ImGuiTreeNodeFlags_NoTreePushOnOpen; // ImGuiTreeNodeFlags_Bullet
@@ -725,24 +890,145 @@ auto App::renderTree(Node &v) -> void
   }
 }
 
+namespace
+{
+  struct ProfileRow
+  {
+    Node *node;
+    float selfCpu;
+    float subtreeCpu;
+    float selfGpu;
+    float subtreeGpu;
+  };
+
+  auto collectProfile(Node &v, std::vector<ProfileRow> &rows) -> const ProfileRow &
+  {
+    const auto idx = rows.size();
+    const auto &p = v.profile();
+    rows.push_back(ProfileRow{&v, p.cpuMs(), p.cpuMs(), p.gpuMs(), p.gpuMs()});
+    for (const auto &n : v.getNodes())
+    {
+      const auto &child = collectProfile(*n, rows);
+      rows[idx].subtreeCpu += child.subtreeCpu;
+      rows[idx].subtreeGpu += child.subtreeGpu;
+    }
+    return rows[idx];
+  }
+} // namespace
+
+auto App::renderProfiler() -> void
+{
+  auto profilerWindow = Ui::Window("Profiler");
+  if (ImGui::Button(Trace::enabled() ? "Stop Trace" : "Record Trace"))
+  {
+    if (!Trace::enabled())
+      Trace::start();
+    else if (!Trace::stop("trace.json"))
+      SPDLOG_ERROR("Cannot write trace.json: {}", std::strerror(errno));
+    else
+      SPDLOG_INFO("Trace written to trace.json");
+  }
+  if (ImGui::IsItemHovered())
+    ImGui::SetTooltip("Records the main loop, the uv callbacks, HTTP, audio and the worker threads to trace.json, "
+                      "which opens in ui.perfetto.dev or chrome://tracing");
+  auto rows = std::vector<ProfileRow>{};
+  collectProfile(*root, rows);
+  if (auto profilerTable = Ui::Table{"##profiler",
+                                     5,
+                                     ImGuiTableFlags_Sortable | ImGuiTableFlags_RowBg |
+                                       ImGuiTableFlags_ScrollY | ImGuiTableFlags_Resizable})
+  {
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("Node", ImGuiTableColumnFlags_WidthStretch);
+    ImGui::TableSetupColumn("CPU ms", ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("Subtree CPU ms",
+                            ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("GPU ms", ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableSetupColumn("Subtree GPU ms", ImGuiTableColumnFlags_PreferSortDescending);
+    ImGui::TableHeadersRow();
+
+    // the averages move every frame, so the rows are re-sorted every frame rather than on SpecsDirty
+    if (auto specs = ImGui::TableGetSortSpecs(); specs && specs->SpecsCount > 0)
+    {
+      const auto &spec = specs->Specs[0];
+      const auto key = [&](const ProfileRow &r) -> float {
+        switch (spec.ColumnIndex)
+        {
+        case 1: return r.selfCpu;
+        case 2: return r.subtreeCpu;
+        case 3: return r.selfGpu;
+        case 4: return r.subtreeGpu;
+        }
+        return 0.f;
+      };
+      std::stable_sort(std::begin(rows), std::end(rows), [&](const auto &a, const auto &b) {
+        if (spec.ColumnIndex == 0)
+          return spec.SortDirection == ImGuiSortDirection_Ascending ? a.node->getName() < b.node->getName()
+                                                                    : b.node->getName() < a.node->getName();
+        return spec.SortDirection == ImGuiSortDirection_Ascending ? key(a) < key(b) : key(b) < key(a);
+      });
+    }
+
+    for (const auto &r : rows)
+    {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      const auto label = fmt::format("{}##{}", r.node->getName(), static_cast<void *>(r.node));
+      if (ImGui::Selectable(label.c_str(), selected == r.node, ImGuiSelectableFlags_SpanAllColumns))
+        undo.record([n = r.node, this]() { selected = n; },
+                    [oldSelected = selected, this]() { selected = oldSelected; });
+      ImGui::TableNextColumn();
+      ImGui::TextF("{:.3f}", r.selfCpu);
+      ImGui::TableNextColumn();
+      ImGui::TextF("{:.3f}", r.subtreeCpu);
+      ImGui::TableNextColumn();
+      ImGui::TextF("{:.3f}", r.selfGpu);
+      ImGui::TableNextColumn();
+      ImGui::TextF("{:.3f}", r.subtreeGpu);
+    }
+  }
+}
+
 auto App::loadPrj() -> void
 {
   ImGui::LoadIniSettingsFromDisk("imgui.ini");
+  savedVersion = undo.version();
+  prjLoader = nullptr;
+  // the first save of a project compacts whatever journal it was opened with
+  journal.invalidate();
+  // opened before the nodes so their textures and fonts come from it
+  lib.openBundle("prj.vtb");
+  loadAvatars();
 
-  std::ifstream st("prj.tpp", std::ofstream::binary);
-  if (!st)
+  // deserialized straight from the page cache, with no copy of the file in between
+  auto file = std::make_unique<const MappedFile>("prj.tpp");
+  if (!*file)
   {
     root = std::make_unique<Root>(lib, undo);
     SPDLOG_INFO("Create new project");
     return;
   }
 
-  std::ostringstream buffer;
-  buffer << st.rdbuf();
-
-  auto buf = buffer.str();
+  if (ProjectFormat::isContainer(file->view()))
+  {
+    // the tree is there at once, the frames read the nodes into it
+    try
+    {
+      auto changes = std::make_unique<const MappedFile>(ProjectJournal::path("prj.tpp"));
+      prjLoader = std::make_unique<ProjectLoader>(std::move(file), *changes ? std::move(changes) : nullptr, saveFactory);
+      root = prjLoader->takeRoot();
+    }
+    catch (std::runtime_error &e)
+    {
+      SPDLOG_ERROR("{:t}", e);
+      prjLoader = nullptr;
+      root = std::make_unique<Root>(lib, undo);
+    }
+    return;
+  }
 
-  IStrm strm(buf.data(), buf.data() + buf.size());
+  // the sequential stream of the older saves
+  IStrm strm(file->data(), file->data() + file->size());
 
   uint32_t v;
   ::deser(strm, v);
@@ -762,15 +1048,147 @@ auto App::loadPrj() -> void
   root->loadAll(saveFactory, strm);
 }
 
+auto App::finishLoading() -> void
+{
+  if (!prjLoader)
+    return;
+  prjLoader->finish();
+  prjLoader = nullptr;
+}
+
+auto App::toggleRecording() -> void
+{
+  if (recorder)
+  {
+    recorder = nullptr;
+    return;
+  }
+  // absolute, the recording goes on when another project is opened
+  const auto path = std::filesystem::absolute(
+    fmt::format("session-{:%Y%m%d-%H%M%S}.vts", std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now())));
+  try
+  {
+    recorder = std::make_unique<SessionRecorder>(audioIn, lib, mouseTracking, httpClient, path);
+  }
+  catch (std::runtime_error &e)
+  {
+    SPDLOG_ERROR("{:t}", e);
+    dialog = std::make_unique<MessageDialog>("Error", e.what());
+  }
+}
+
+auto App::loadAvatars() -> void
+{
+  avatars.clear();
+  auto ec = std::error_code{};
+  for (const auto &entry : std::filesystem::directory_iterator{".", ec})
+    if (const auto name = Avatar::nameOf(entry.path()); !name.empty())
+      addAvatar(name, entry.path());
+}
+
+auto App::addAvatar(const std::string &name, const std::filesystem::path &path) -> void
+{
+  auto avatar = std::make_unique<Avatar>(
+    wav2Visemes,
+    [this](SaveFactory &factory, Undo &sceneUndo, VisemesSource &visemes) {
+      registerNodes(factory, sceneUndo, visemes);
+    },
+    name);
+  if (!avatar->load(path))
+    return;
+  SPDLOG_INFO("avatar {:?} publishes to {:?}", name, avatar->ringName());
+  // saving over an avatar replaces it
+  std::erase_if(avatars, [&](const auto &a) { return a->name() == name; });
+  avatars.push_back(std::move(avatar));
+}
+
+auto App::writeAvatar(const std::string &name, std::string data, bool reload) -> void
+{
+  // resolved now, a project switch changes the working directory before the write lands
+  auto path = std::filesystem::absolute(Avatar::path(name));
+  auto err = std::make_shared<int>(0);
+  uv.queueWork(
+    [err, path, data = std::move(data)]() {
+      if (!write_file_atomically(path, data))
+        *err = errno;
+    },
+    [err, name, path, reload, this](int status) {
+      if (status != 0 || *err != 0)
+      {
+        SPDLOG_ERROR("Cannot save avatar {:?}: {}", name, status != 0 ? uv_strerror(status) : std::strerror(*err));
+        return;
+      }
+      // an avatar saved by the project switched away from is not one of the new project's
+      if (reload && std::filesystem::absolute(Avatar::path(name)) == path)
+        addAvatar(name, path);
+    });
+}
+
 auto App::savePrj() -> void
 {
   if (!root)
     return;
-  OStrm strm;
-  ::ser(strm, saveVersion());
-  root->saveAll(strm);
-  std::ofstream st("prj.tpp", std::ofstream::binary);
-  st.write(strm.str().data(), strm.str().size());
+  // the nodes not read yet would be saved at their defaults
+  finishLoading();
+  // records for the journal cannot follow a snapshot that is not written yet
+  if (pendingSave && !pendingSave->isAppend)
+    journal.invalidate();
+  // only the snapshot is taken on the main thread, the disk is left to a worker
+  auto save = journal.save(*root);
+  if (!save.isSnapshot && save.data.empty())
+  {
+    // the edits were undone, or changed nothing that is saved
+    if (!isSaving)
+      savedVersion = undo.version();
+    return;
+  }
+  // resolved now, a project switch changes the working directory before the write lands
+  writePrj(PendingSave{std::filesystem::absolute("prj.tpp"), std::move(save.data), undo.version(), !save.isSnapshot});
+}
+
+auto App::writePrj(PendingSave save) -> void
+{
+  if (isSaving)
+  {
+    if (save.isAppend && pendingSave && pendingSave->isAppend)
+    {
+      pendingSave->data += save.data;
+      pendingSave->version = save.version;
+    }
+    else
+      pendingSave = std::move(save);
+    return;
+  }
+  isSaving = true;
+  auto err = std::make_shared<int>(0);
+  uv.queueWork(
+    [err, path = save.path, data = std::move(save.data), isAppend = save.isAppend]() {
+      const auto journalPath = ProjectJournal::path(path);
+      // a journal left over from the snapshot before does not match this one, and is dropped at
+      // load if the crash comes between the two writes
+      if (isAppend ? !append_file_synced(journalPath, data)
+                   : !write_file_atomically(path, data) ||
+                       !write_file_atomically(journalPath, ProjectJournal::header(data)))
+        *err = errno;
+    },
+    [err, path = save.path, version = save.version, this](int status) {
+      isSaving = false;
+      if (status != 0 || *err != 0)
+      {
+        SPDLOG_ERROR("Cannot save {:?}: {}", path, status != 0 ? uv_strerror(status) : std::strerror(*err));
+        // what the journal compared with did not make it to the disk
+        journal.invalidate();
+        if (pendingSave && pendingSave->isAppend)
+          pendingSave.reset();
+      }
+      else
+        savedVersion = version;
+      if (!pendingSave)
+        return;
+      auto next = std::move(*pendingSave);
+      pendingSave.reset();
+      writePrj(std::move(next));
+    });
 }
 
 auto App::addNode(const std::string &class_, const std::string &name) -> void
@@ -803,10 +1221,16 @@ auto App::droppedFile(std::string droppedFile) -> void
     std::make_unique<AddAsDialog>(droppedFile, [this, droppedFile](bool r, AddAsDialog::NodeType t) {
       if (!r)
         return;
+      // GIFs play their own frames rather than being cut into a sprite sheet
+      const auto isGif = std::filesystem::path{droppedFile}.extension() == ".gif";
       switch (t)
       {
-      case AddAsDialog::NodeType::sprite: addNode(AnimSprite::className, droppedFile); break;
-      case AddAsDialog::NodeType::mouth: addNode(SpriteSheetMouth::className, droppedFile); break;
+      case AddAsDialog::NodeType::sprite:
+        addNode(isGif ? AnimatedImageSprite::className : AnimSprite::className, droppedFile);
+        break;
+      case AddAsDialog::NodeType::mouth:
+        addNode(isGif ? AnimatedImageMouth::className : SpriteSheetMouth::className, droppedFile);
+        break;
       case AddAsDialog::NodeType::eye: addNode(EyeV2::className, droppedFile); break;
       case AddAsDialog::NodeType::aiMouth: addNode(AiMouth::className, droppedFile); break;
       }
@@ -820,7 +1244,11 @@ auto App::tick() -> void
 
 App::~App()
 {
-  savePrj();
+  if (!isBenchmark)
+    savePrj();
+  // the final write has to land before the process goes away
+  while (isSaving)
+    uv.tick();
 
   // Cleanup
   ImGui_ImplOpenGL3_Shutdown();
@@ -829,19 +1257,12 @@ App::~App()
   SDL_GL_DeleteContext(gl_context);
 }
 
-auto App::sdlEventsAndRender() -> void
+auto App::pollEvents() -> void
 {
-  // Poll and handle events (inputs, window resize, etc.)
-  // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants
-  // to use your inputs.
-  // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application,
-  // or clear/overwrite your copy of the mouse data.
-  // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main
-  // application, or clear/overwrite your copy of the keyboard data. Generally you may always pass
-  // all inputs to dear imgui, and hide them from your application based on those two flags.
   SDL_Event event;
   while (SDL_PollEvent(&event))
   {
+    uiLingerFrames = UiLingerFrames;
     ImGui_ImplSDL2_ProcessEvent(&event);
     switch (event.type)
     {
@@ -877,6 +1298,16 @@ auto App::sdlEventsAndRender() -> void
         }
       }
       break;
+    case SDL_AUDIODEVICEREMOVED:
+      // the preference is kept, the device is used again on the next start if it is back
+      if (event.adevice.iscapture)
+      {
+        audioIn.deviceRemoved(event.adevice.which);
+        lib.micDeviceRemoved(event.adevice.which);
+      }
+      else
+        audioOut.deviceRemoved(event.adevice.which);
+      break;
     case SDL_DROPFILE: {
       auto file = event.drop.file;
       SPDLOG_INFO("dropped file {}", file);
@@ -884,30 +1315,68 @@ auto App::sdlEventsAndRender() -> void
       SDL_free(file);
       break;
     }
-    case SDL_MOUSEMOTION: {
-      if (!root)
-        break;
-      const auto projMat = getProjMat();
-      const auto mouseX = event.motion.x;
-      const auto mouseY = event.motion.y;
-      hovered = nullptr;
-      const auto mousePos = glm::vec2{1.f * mouseX, 1.f * mouseY};
-      if (!selected || selected->editMode() == Node::EditMode::select)
-        hovered = root->nodeUnder(projMat, mousePos);
-      else
-      {
-        if (selected)
-          selected->update(projMat, mousePos);
-      }
+    case SDL_MOUSEMOTION:
+      // only the latest position matters, the hit test runs once per frame below
+      pendingMouse = glm::vec2{1.f * event.motion.x, 1.f * event.motion.y};
       break;
     }
+  }
+}
+
+auto App::sdlEventsAndRender() -> void
+{
+  auto span = Trace::Span{"frame"};
+  const auto frameStart = std::chrono::steady_clock::now();
+  // Poll and handle events (inputs, window resize, etc.)
+  // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants
+  // to use your inputs.
+  // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application,
+  // or clear/overwrite your copy of the mouse data.
+  // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main
+  // application, or clear/overwrite your copy of the keyboard data. Generally you may always pass
+  // all inputs to dear imgui, and hide them from your application based on those two flags.
+  auto &scheduler = lib.scheduler();
+  scheduler.beginFrame();
+  lib.frameArena().reset();
+  if (prjLoader)
+  {
+    // a node not read yet would lose its edits once it is, so a selection, what any edit of the
+    // panel or the canvas starts with, reads the rest of the project at once
+    if (selected)
+      finishLoading();
+    else if (!prjLoader->step(frameStart + std::chrono::milliseconds{LoadStepMs}))
+      prjLoader = nullptr;
+    scheduler.invalidate();
+  }
+  wav2Visemes.poll();
+  lib.pollMics();
+  audioOut.poll();
+  pollEvents();
+  isFlashing = calibration && calibration->tick(std::chrono::steady_clock::now());
+  // the beeps are timed by the frames, on demand rendering would space them out
+  if (calibration)
+    scheduler.invalidate();
+
+  if (pendingMouse && root)
+  {
+    const auto &projMat = frameCtx.projMat;
+    hovered = nullptr;
+    if (!selected || selected->editMode() == Node::EditMode::select)
+      hovered = root->nodeUnder(projMat, *pendingMouse);
+    else
+    {
+      if (selected)
+        selected->update(projMat, *pendingMouse);
     }
   }
+  pendingMouse = std::nullopt;
 
-  auto now = std::chrono::high_resolution_clock::now();
+  auto now = std::chrono::steady_clock::now();
   std::chrono::duration<float> diff = now - lastUpdate;
   lastUpdate = now;
-  const auto dt = diff.count();
+  // after an idle stretch the first on demand frame would otherwise see a huge step
+  const auto dt = preferences.fps == 0 ? std::min(diff.count(), OnDemandMaxDt) : diff.count();
+  publishFrame(dt, now);
 
   // Start the Dear ImGui frame
   ImGui_ImplOpenGL3_NewFrame();
@@ -926,9 +1395,10 @@ auto App::sdlEventsAndRender() -> void
   const auto w = (int)io.DisplaySize.x == 0 ? width : (int)io.DisplaySize.x;
   const auto h = (int)io.DisplaySize.y == 0 ? height : (int)io.DisplaySize.y;
   glViewport(0, 0, w, h);
+  frameCtx.viewport = glm::vec2{w, h};
+  frameCtx.projMat = glm::ortho(0.f, 1.f * w, 0.f, 1.f * h, -1.f, 1.f);
   glMatrixMode(GL_PROJECTION);
-  glLoadIdentity();
-  glOrtho(0, w, 0, h, -1, 1);
+  glLoadMatrixf(glm::value_ptr(frameCtx.projMat));
   glMatrixMode(GL_MODELVIEW);
   glLoadIdentity();
   render(dt);
@@ -948,17 +1418,430 @@ auto App::sdlEventsAndRender() -> void
     SDL_GL_MakeCurrent(backup_current_window, backup_current_context);
   }
 
+  // the swap waits for vsync, which is not the frame's cost
+  perfHud.frame(frameStart, std::chrono::steady_clock::now() - frameStart);
   window.get().glSwap();
+  wav2Visemes.presented(std::chrono::steady_clock::now());
   processIo();
+
+  if (uiLingerFrames > 0)
+  {
+    --uiLingerFrames;
+    scheduler.invalidate();
+  }
+  if (dialog)
+    scheduler.invalidate();
+}
+
+auto App::prepareBench() -> glm::ivec2
+{
+  isBenchmark = true;
+  // the benchmarks feed their own input, recognition would only add noise to the numbers
+  audioIn.unreg(wav2Visemes);
+  renderTimer.stop();
+  powerTimer.stop();
+  autosaveTimer.stop();
+  SDL_GL_SetSwapInterval(0);
+  finishLoading();
+
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{30};
+  while (lib.texturesLoading() > 0 && std::chrono::steady_clock::now() < deadline)
+  {
+    uv.poll();
+    // nothing renders yet to pump the uploads the decodes hand over
+    lib.streamer().uploader().pump();
+    std::this_thread::sleep_for(std::chrono::milliseconds{1});
+  }
+
+  const auto size = glm::ivec2{width, height};
+  frameCtx.viewport = glm::vec2{size};
+  frameCtx.projMat = glm::ortho(0.f, 1.f * size.x, 0.f, 1.f * size.y, -1.f, 1.f);
+  glViewport(0, 0, size.x, size.y);
+  glEnable(GL_BLEND);
+  glEnable(GL_ALPHA_TEST);
+  glAlphaFunc(GL_GREATER, 0.1f);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  glMatrixMode(GL_PROJECTION);
+  glLoadMatrixf(glm::value_ptr(frameCtx.projMat));
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+  return size;
+}
+
+auto App::publishFrame(float dt, std::chrono::steady_clock::time_point now) -> void
+{
+  frameCtx.dt = dt;
+  frameCtx.now = now;
+  ++frameCtx.frame;
+  frameCtx.cacheLayers = preferences.cacheStaticLayers;
+}
+
+auto App::renderBenchFrame(FrameOutput &output,
+                           glm::ivec2 size,
+                           float dt,
+                           std::chrono::steady_clock::time_point start) -> void
+{
+  lib.frameArena().reset();
+  // a texture reloaded during the run uploads as it would in App::render
+  lib.streamer().uploader().pump();
+  publishFrame(dt, start);
+  output.begin(size);
+  lib.physics().step(dt);
+  root->renderAll(dt, nullptr, nullptr);
+  output.end(false);
+  glFinish();
+}
+
+namespace
+{
+  auto percentile(const std::vector<double> &sorted, double p) -> double
+  {
+    return sorted.empty() ? 0. : sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+  }
+} // namespace
+
+auto App::benchmark(int frames) -> int
+{
+  if (!root)
+  {
+    SPDLOG_ERROR("benchmark: no project loaded");
+    return 1;
+  }
+  const auto size = prepareBench();
+  auto output = FrameOutput{false};
+
+  const auto dt = 1.f / 60.f;
+  const auto samplesPerFrame = audioIn.sampleRate() / 60;
+  auto times = std::vector<double>{};
+  times.reserve(frames);
+  auto wav = Wav{};
+  // the first frames rasterize glyphs, size the batch and grow the frame arena
+  const auto warmup = std::min(frames / 2, BenchWarmupFrames);
+  const auto allocsBefore = AllocStats::count();
+  auto steadyBefore = AllocStats::threadCount();
+  const auto epoch = std::chrono::steady_clock::now();
+  for (auto i = 0; i < frames; ++i)
+  {
+    if (i == warmup)
+      steadyBefore = AllocStats::threadCount();
+    const auto start = std::chrono::steady_clock::now();
+    uv.poll();
+    // a new viseme every 4 frames and a 2 Hz amplitude envelope, roughly like speech
+    if (i % 4 == 0)
+      wav2Visemes.emit(static_cast<Viseme>((i / 4) % (static_cast<int>(Viseme::U) + 1)));
+    wav.resize(samplesPerFrame);
+    const auto amp = 0x3000 * (.5f + .5f * std::sin(i * dt * 2.f * glm::pi<float>() * 2.f));
+    for (auto j = 0; j < samplesPerFrame; ++j)
+      wav[j] = static_cast<int16_t>(amp * std::sin((i * samplesPerFrame + j) * .05f));
+    audioIn.inject(wav);
+    wav2Visemes.poll();
+    // the frames are a fixed step apart whatever they take, so the animation is the same every run
+    renderBenchFrame(output,
+                     size,
+                     dt,
+                     epoch + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>{i * static_cast<double>(dt)}));
+    times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+  }
+  const auto allocs = AllocStats::count() - allocsBefore;
+  const auto steadyAllocs = AllocStats::threadCount() - steadyBefore;
+
+  std::sort(std::begin(times), std::end(times));
+  const auto total = std::accumulate(std::begin(times), std::end(times), 0.);
+  fmt::print("frames: {} at {}x{}\n", frames, size.x, size.y);
+  fmt::print("frame time ms: mean {:.3f} p50 {:.3f} p90 {:.3f} p99 {:.3f} max {:.3f}\n",
+             times.empty() ? 0. : total / times.size(),
+             percentile(times, .5),
+             percentile(times, .9),
+             percentile(times, .99),
+             times.empty() ? 0. : times.back());
+  fmt::print("allocations: {} total, {:.1f} per frame\n", allocs, frames > 0 ? 1. * allocs / frames : 0.);
+  fmt::print("main thread allocations after {} warm-up frames: {}\n", warmup, steadyAllocs);
+  fmt::print("draw calls: {}, binds: {}, quads: {} (last frame)\n",
+             lib.spriteBatch().drawCalls(),
+             lib.spriteBatch().binds(),
+             lib.spriteBatch().quads());
+  assert(steadyAllocs == 0 && "a loaded project should render without touching the heap");
+  return 0;
+}
+
+auto App::floodTest(int seconds, int maxRate, const std::filesystem::path &capture, bool stubTts) -> int
+{
+  if (!root)
+  {
+    SPDLOG_ERROR("flood: no project loaded");
+    return 1;
+  }
+  auto flood = std::optional<ChatFlood>{};
+  try
+  {
+    flood.emplace(capture);
+  }
+  catch (std::runtime_error &e)
+  {
+    SPDLOG_ERROR("{:t}", e);
+    return 1;
+  }
+  const auto channels = lib.twitchChannels();
+  if (channels.empty())
+  {
+    SPDLOG_ERROR("flood: the project has no chat");
+    return 1;
+  }
+  auto chats = std::vector<const Chat *>{};
+  auto collect = [&](auto &&self, const Node &n) -> void {
+    if (auto chat = dynamic_cast<const Chat *>(&n))
+      chats.push_back(chat);
+    for (const auto &child : n.getNodes())
+      self(self, *child);
+  };
+  collect(collect, *root);
+  lib.stubTts(stubTts);
+  const auto size = prepareBench();
+  auto output = FrameOutput{false};
+
+  using Clock = std::chrono::steady_clock;
+  // the rate goes up in steps, a rate held for a while is easier to read than a ramp
+  constexpr auto Steps = 10;
+  constexpr auto FrameBudgetMs = 1000. / 60.;
+  const auto rssBefore = AllocStats::residentBytes();
+  const auto begin = Clock::now();
+  const auto duration = std::chrono::duration_cast<Clock::duration>(std::chrono::seconds{seconds});
+  auto sent = uint64_t{0};
+  auto credit = 0.;
+  auto last = begin;
+  auto times = std::vector<double>{};
+  fmt::print("{} channel(s), {} chat node(s), TTS {}\n", channels.size(), chats.size(), stubTts ? "stubbed" : "live");
+  fmt::print("msg/s  frames    p50 ms    p99 ms    max ms  over 60Hz  behind  shown  tts queue s  dropped  RSS +MB\n");
+  for (auto step = 1; step <= Steps; ++step)
+  {
+    const auto rate = static_cast<double>(maxRate) * step / Steps;
+    const auto stepEnd = begin + duration * step / Steps;
+    times.clear();
+    for (auto now = Clock::now(); now < stepEnd; now = Clock::now())
+    {
+      credit += rate * std::chrono::duration<double>(now - last).count();
+      const auto dt = std::min(std::chrono::duration<float>(now - last).count(), OnDemandMaxDt);
+      last = now;
+      if (const auto n = static_cast<int>(credit); n > 0)
+      {
+        credit -= n;
+        sent += static_cast<uint64_t>(n);
+        auto bytes = std::string{};
+        for (const auto &channel : channels)
+          flood->generate(channel, n, bytes);
+        lib.replayChat(std::move(bytes));
+      }
+      uv.poll();
+      renderBenchFrame(output, size, dt, now);
+      times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - now).count());
+    }
+    std::sort(std::begin(times), std::end(times));
+    const auto over = std::count_if(std::begin(times), std::end(times), [](double t) { return t > FrameBudgetMs; });
+    // the messages sent that the slowest chat node has not drawn yet
+    auto received = sent;
+    auto shown = size_t{0};
+    auto queuedSec = 0.f;
+    auto dropped = uint64_t{0};
+    for (const auto chat : chats)
+    {
+      received = std::min(received, chat->received());
+      shown += chat->historySize();
+      const auto stats = chat->admissionStats();
+      queuedSec = std::max(queuedSec, stats.queuedSec);
+      dropped += stats.dropped + stats.rateLimited;
+    }
+    const auto rss = AllocStats::residentBytes();
+    fmt::print("{:5.0f}  {:6}  {:8.3f}  {:8.3f}  {:8.3f}  {:9}  {:6}  {:5}  {:11.1f}  {:7}  {:+7.1f}\n",
+               rate,
+               times.size(),
+               percentile(times, .5),
+               percentile(times, .99),
+               times.empty() ? 0. : times.back(),
+               over,
+               chats.empty() ? 0 : sent - received,
+               shown,
+               queuedSec,
+               dropped,
+               (static_cast<double>(rss) - static_cast<double>(rssBefore)) / (1 << 20));
+  }
+  lib.stubTts(false);
+  return 0;
+}
+
+auto App::replaySession(const std::filesystem::path &session, float speed, std::optional<MockApi::Config> mock)
+  -> int
+{
+  if (!root)
+  {
+    SPDLOG_ERROR("replay: no project loaded");
+    return 1;
+  }
+  auto replay = std::optional<SessionReplay>{};
+  try
+  {
+    replay.emplace(session, audioIn, lib, mouseTracking, httpClient, speed);
+  }
+  catch (std::runtime_error &e)
+  {
+    SPDLOG_ERROR("{:t}", e);
+    return 1;
+  }
+  // the recorded voice still drives the pipeline, the services take the same time on every run
+  if (mock)
+    httpClient.mock(MockApi{*mock}, speed);
+  const auto size = prepareBench();
+  // unlike the benchmarks' made up input the recorded voice is part of the load
+  audioIn.reg(wav2Visemes);
+  const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds{30};
+  while (!wav2Visemes.isReady() && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+  auto output = FrameOutput{false};
+
+  using Clock = std::chrono::steady_clock;
+  constexpr auto FrameBudgetMs = 1000. / 60.;
+  auto times = std::vector<double>{};
+  const auto allocsBefore = AllocStats::count();
+  const auto begin = Clock::now();
+  auto last = begin;
+  replay->start(begin);
+  for (auto isPlaying = true; isPlaying;)
+  {
+    const auto now = Clock::now();
+    const auto dt = std::min(std::chrono::duration<float>(now - last).count(), OnDemandMaxDt);
+    last = now;
+    uv.poll();
+    isPlaying = replay->tick(now);
+    wav2Visemes.poll();
+    audioOut.poll();
+    renderBenchFrame(output, size, dt, now);
+    wav2Visemes.presented(Clock::now());
+    times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - now).count());
+  }
+  const auto wall = std::chrono::duration<double>(Clock::now() - begin).count();
+  const auto allocs = AllocStats::count() - allocsBefore;
+
+  std::sort(std::begin(times), std::end(times));
+  const auto over = std::count_if(std::begin(times), std::end(times), [](double t) { return t > FrameBudgetMs; });
+  const auto &metrics = wav2Visemes.metrics();
+  fmt::print("session: {:.1f} s replayed in {:.1f} s at {}x, {}\n",
+             std::chrono::duration<double>(replay->duration()).count(),
+             wall,
+             speed,
+             replay->counts());
+  if (mock)
+    fmt::print("services: mocked, {} ms latency, {} ms jitter, seed {}\n", mock->latency, mock->jitter, mock->seed);
+  fmt::print("frames: {} at {}x{}, {} over 60Hz\n", times.size(), size.x, size.y, over);
+  fmt::print("frame time ms: p50 {:.3f} p90 {:.3f} p99 {:.3f} max {:.3f}\n",
+             percentile(times, .5),
+             percentile(times, .9),
+             percentile(times, .99),
+             times.empty() ? 0. : times.back());
+  fmt::print("mic to mouth ms: p50 {:.0f} p95 {:.0f} max {:.0f} over {} visemes\n",
+             metrics.total.percentile(.5f),
+             metrics.total.percentile(.95f),
+             metrics.total.maxMs(),
+             metrics.total.count());
+  fmt::print("allocations: {} total, {:.1f} per frame\n", allocs, times.empty() ? 0. : 1. * allocs / times.size());
+  return 0;
+}
+
+auto App::pacedTick() -> void
+{
+  if (preferences.lowPower && !isWatched())
+  {
+    enterLowPower();
+    return;
+  }
+  if (!pacer.isNear(FramePacer::Clock::now()))
+    return;
+  const auto waitStart = FramePacer::Clock::now();
+  pacer.waitForDeadline();
+  const auto now = FramePacer::Clock::now();
+  perfHud.waited(now - waitStart);
+  pacer.frameStarted(now);
+  sdlEventsAndRender();
+
+  if (now - lastMissedReport >= std::chrono::seconds{1})
+  {
+    if (pacer.missed() != reportedMissed)
+      SPDLOG_WARN("missed {} frame deadlines in the last second", pacer.missed() - reportedMissed);
+    reportedMissed = pacer.missed();
+    lastMissedReport = now;
+  }
+}
+
+auto App::onDemandTick() -> void
+{
+  if (preferences.lowPower && !isWatched())
+  {
+    enterLowPower();
+    return;
+  }
+  SDL_PumpEvents();
+  if (SDL_HasEvents(SDL_FIRSTEVENT, SDL_LASTEVENT))
+    lib.scheduler().invalidate();
+  // the mouths invalidate the scheduler when a new viseme reaches them
+  wav2Visemes.poll();
+  audioOut.poll();
+  if (lib.scheduler().isDue(RenderScheduler::Clock::now()))
+    sdlEventsAndRender();
+}
+
+auto App::setupOutput() -> void
+{
+  if (preferences.sharedOutput == static_cast<bool>(frameOutput))
+    return;
+  if (preferences.sharedOutput)
+    frameOutput = std::make_unique<FrameOutput>();
+  else
+    frameOutput = nullptr;
+}
+
+auto App::isWatched() -> bool
+{
+  // the minimize button parks the window off screen, see pollEvents()
+  const auto flags = SDL_GetWindowFlags(window.get().get());
+  if (!isMinimized && !(flags & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED)))
+    return true;
+  if (frameOutput && frameOutput->isRead())
+    return true;
+  return std::ranges::any_of(avatars, [](const auto &avatar) { return avatar->isWatched(); });
+}
+
+auto App::enterLowPower() -> void
+{
+  SPDLOG_INFO("nothing is watching, rendering is paused");
+  renderTimer.stop();
+  powerTimer.start([this]() { lowPowerTick(); }, LowPowerPollMs, LowPowerPollMs);
+}
+
+auto App::lowPowerTick() -> void
+{
+  // no GL at all; recognition, speech and chat live on their own callbacks and keep going
+  pollEvents();
+  wav2Visemes.poll();
+  audioOut.poll();
+  if (preferences.lowPower && !isWatched())
+    return;
+  SPDLOG_INFO("rendering is resumed");
+  // the first tick draws right away
+  setupRendering();
 }
 
 auto App::setupRendering() -> void
 {
+  powerTimer.stop();
   renderTimer.stop();
-  renderIdle.stop();
   const auto fps = preferences.fps;
+  lib.scheduler().invalidate();
   if (fps == 0)
-    renderIdle.start([this]() { sdlEventsAndRender(); });
+    renderTimer.start([this]() { onDemandTick(); }, 0, OnDemandPollMs);
   else
-    renderTimer.start([this]() { sdlEventsAndRender(); }, 0, 1'000 / fps);
+  {
+    pacer.reset(fps);
+    reportedMissed = 0;
+    // polls every millisecond; FramePacer spins the sub-millisecond rest
+    renderTimer.start([this]() { pacedTick(); }, 0, 1);
+  }
 }
@@ -1,22 +1,37 @@
 #pragma once
 #include "audio-in.hpp"
+#include "avatar.hpp"
 #include "audio-out.hpp"
 #include "azure-tts.hpp"
 #include "dialog.hpp"
+#include "frame-ctx.hpp"
+#include "frame-output.hpp"
+#include "frame-pacer.hpp"
+#include "latency-calibration.hpp"
 #include "http-client.hpp"
 #include "lib.hpp"
+#include "mock-api.hpp"
 #include "mouse-tracking.hpp"
+#include "perf-hud.hpp"
 #include "preferences.hpp"
+#include "project-journal.hpp"
+#include "project-loader.hpp"
 #include "save-factory.hpp"
+#include "session-recorder.hpp"
+#include "startup-profile.hpp"
 #include "twitch.hpp"
 #include "undo.hpp"
 #include "uv.hpp"
 #include "wav-2-visemes.hpp"
 #include <chrono>
+#include <filesystem>
 #include <functional>
 #include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 class App
 {
@@ -24,61 +39,135 @@ public:
   App(sdl::Window &, int argc, char *argv[]);
   ~App();
   auto tick() -> void;
+  // renders the loaded project offscreen with synthetic input and prints frame statistics
+  auto benchmark(int frames) -> int;
+  // replays chat into the project's channels at a rate ramping up to maxRate messages per second
+  // per channel over the given seconds, and prints frame times and chat backlogs for every step
+  auto floodTest(int seconds, int maxRate, const std::filesystem::path &capture, bool stubTts) -> int;
+  // plays a recorded session into the project offscreen at speed times the recorded pace and
+  // prints frame statistics, the same session on two builds gives numbers to compare; with a mock
+  // the services answer from MockApi instead of the recorded responses
+  auto replaySession(const std::filesystem::path &session, float speed, std::optional<MockApi::Config> mock) -> int;
   bool done = false;
 
 private:
   enum class EditMode { select, translate, rotate, scale };
 
+  StartupProfile startup;
   std::reference_wrapper<sdl::Window> window;
   SDL_GLContext gl_context;
-  std::chrono::high_resolution_clock::time_point lastUpdate;
+  StartupProfile::Mark glContextReady{startup, "GL context"};
+  std::chrono::steady_clock::time_point lastUpdate;
   bool isMinimized = false;
   uv::Uv uv;
   Preferences preferences;
   SaveFactory saveFactory;
   Wav2Visemes wav2Visemes;
+  StartupProfile::Mark recognizerReady{startup, "recognizer"};
+  // outlives the devices, which close on it
+  AudioDevices audioDevices;
   AudioOut audioOut;
   AudioIn audioIn;
+  StartupProfile::Mark audioReady{startup, "audio devices"};
+  FrameCtx frameCtx;
   MouseTracking mouseTracking;
   HttpClient httpClient;
   Lib lib;
+  StartupProfile::Mark libReady{startup, "lib"};
+  PerfHud perfHud;
+  bool showPerformance = false;
+  // set while the loopback calibration runs
+  std::unique_ptr<LatencyCalibration> calibration;
+  bool isFlashing = false;
+  std::unique_ptr<SessionRecorder> recorder;
   Undo undo;
   Node *hovered = nullptr;
   Node *selected = nullptr;
   bool isNodeDragging = false;
+  std::optional<glm::vec2> pendingMouse;
   std::unique_ptr<Dialog> dialog = nullptr;
   std::unique_ptr<Node> root;
+  // reads the nodes of the project opened last into root a few at a time, null once it is done
+  std::unique_ptr<ProjectLoader> prjLoader;
+  // the other characters of the project, before lib in destruction order like root
+  std::vector<std::unique_ptr<Avatar>> avatars;
   bool showUi = true;
   std::vector<std::function<auto()->void>> postponedActions;
   EditMode editMode = EditMode::select;
-  std::shared_ptr<const Texture> selectIco;
-  std::shared_ptr<const Texture> translateIco;
-  std::shared_ptr<const Texture> scaleIco;
-  std::shared_ptr<const Texture> rotateIco;
-  std::shared_ptr<const Texture> selectDisabledIco;
-  std::shared_ptr<const Texture> translateDisabledIco;
-  std::shared_ptr<const Texture> scaleDisabledIco;
-  std::shared_ptr<const Texture> rotateDisabledIco;
-  std::shared_ptr<const Texture> hideIco;
-  std::shared_ptr<const Texture> showIco;
-  std::shared_ptr<const Texture> arrowN;
-  std::shared_ptr<const Texture> arrowE;
-  std::shared_ptr<const Texture> arrowS;
-  std::shared_ptr<const Texture> arrowW;
   int originalX, originalY;
   int width, height;
   uv::Timer renderTimer;
-  uv::Idle renderIdle;
+  // runs instead of renderTimer while nobody watches, see isWatched()
+  uv::Timer powerTimer;
+  std::unique_ptr<FrameOutput> frameOutput;
+  FramePacer pacer;
+  uint64_t reportedMissed = 0;
+  std::chrono::steady_clock::time_point lastMissedReport;
+  int uiLingerFrames = 0;
+  bool isBenchmark = false;
+  uv::Timer autosaveTimer;
+  // undo version of the project on disk, autosave kicks in when the undo stack moves past it
+  uint64_t savedVersion = 0;
+  bool isSaving = false;
+  // keeps the saves between snapshots to the nodes that changed
+  ProjectJournal journal;
+  // what was saved while a write was in flight: the latest snapshot supersedes everything before
+  // it, records for the journal add up
+  struct PendingSave
+  {
+    std::filesystem::path path;
+    std::string data;
+    uint64_t version;
+    bool isAppend = false;
+  };
+  std::optional<PendingSave> pendingSave;
 
+  // how often the on demand mode services SDL and the scheduler while nothing is drawn
+  static constexpr auto OnDemandPollMs = 5;
+  // how often the low power mode services SDL and the audio while nothing is drawn
+  static constexpr auto LowPowerPollMs = 50;
+  // ImGui needs a few frames after input to settle hover and active states
+  static constexpr auto UiLingerFrames = 3;
+  static constexpr auto OnDemandMaxDt = .1f;
+  // the journal keeps most of these writes to a few bytes
+  static constexpr auto AutosaveMs = 5'000;
+  // of a frame spent reading the nodes of a project that is still loading
+  static constexpr auto LoadStepMs = 4;
+  // frames the benchmark draws before it expects the main thread to stop allocating
+  static constexpr auto BenchWarmupFrames = 60;
+
+  auto addAvatar(const std::string &name, const std::filesystem::path &) -> void;
   auto addNode(const std::string &class_, const std::string &name) -> void;
   auto cancel() -> void;
   auto droppedFile(std::string) -> void;
+  // reads the rest of the nodes of the project now
+  auto finishLoading() -> void;
+  auto loadAvatars() -> void;
+  auto toggleRecording() -> void;
   auto loadPrj() -> void;
+  auto registerNodes(SaveFactory &, Undo &, VisemesSource &) -> void;
+  // turns the live loop off and sets up offscreen rendering, returns the frame size
+  auto prepareBench() -> glm::ivec2;
+  // fills in frameCtx for the frame starting at now
+  auto publishFrame(float dt, std::chrono::steady_clock::time_point now) -> void;
+  auto renderBenchFrame(FrameOutput &, glm::ivec2 size, float dt, std::chrono::steady_clock::time_point) -> void;
   auto processIo() -> void;
   auto render(float dt) -> void;
+  auto renderProfiler() -> void;
   auto renderTree(Node &) -> void;
   auto renderUi(float dt) -> void;
   auto savePrj() -> void;
+  auto writePrj(PendingSave) -> void;
+  // reload to pick up a new scene, a mic toggle only rewrites the file
+  auto writeAvatar(const std::string &name, std::string data, bool reload) -> void;
   auto sdlEventsAndRender() -> void;
+  auto pollEvents() -> void;
+  // false while the window is minimized or hidden and no shared memory reader is attached
+  auto isWatched() -> bool;
+  auto enterLowPower() -> void;
+  auto lowPowerTick() -> void;
+  auto onDemandTick() -> void;
+  auto pacedTick() -> void;
+  auto setupOutput() -> void;
   auto setupRendering() -> void;
 };
@@ -0,0 +1,135 @@
+#include "asset-bundle.hpp"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fmt/std.h>
+#include <stdexcept>
+
+namespace
+{
+  constexpr uint32_t Magic = 0x31425456; // "VTB1"
+
+  struct Header
+  {
+    uint32_t magic = Magic;
+    uint32_t count = 0;
+  };
+
+  // followed by pathLen bytes of the path
+  struct IndexEntry
+  {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    uint32_t pathLen = 0;
+  };
+
+  template <typename T>
+  auto append(std::string &out, const T &v) -> void
+  {
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+  auto alignUp(size_t v) -> size_t
+  {
+    return (v + AssetBundle::Align - 1) / AssetBundle::Align * AssetBundle::Align;
+  }
+
+  auto readFile(const std::filesystem::path &path) -> std::string
+  {
+    auto fp = open_file(path, "rb");
+    if (!fp)
+      throw std::runtime_error(fmt::format("Error opening {:?}: {}", path, std::strerror(errno)));
+    auto ret = std::string{};
+    char buf[64 * 1024];
+    for (;;)
+    {
+      const auto n = std::fread(buf, 1, sizeof(buf), fp.get());
+      ret.append(buf, n);
+      if (n < sizeof(buf))
+        break;
+    }
+    if (std::ferror(fp.get()))
+      throw std::runtime_error(fmt::format("Error reading {:?}", path));
+    return ret;
+  }
+} // namespace
+
+AssetBundle::AssetBundle(const std::filesystem::path &path) : file(path)
+{
+  if (!file)
+    throw std::runtime_error(fmt::format("Error opening asset bundle {:?}: {}", path, std::strerror(errno)));
+  const auto bytes = file.view();
+  auto pos = size_t{0};
+  auto read = [&](auto &v) {
+    if (bytes.size() - pos < sizeof(v))
+      throw std::runtime_error(fmt::format("Truncated asset bundle {:?}", path));
+    std::memcpy(&v, bytes.data() + pos, sizeof(v));
+    pos += sizeof(v);
+  };
+  auto header = Header{};
+  read(header.magic);
+  read(header.count);
+  if (header.magic != Magic)
+    throw std::runtime_error(fmt::format("{:?} is not an asset bundle", path));
+  index.reserve(header.count);
+  for (auto i = 0u; i < header.count; ++i)
+  {
+    auto entry = IndexEntry{};
+    read(entry.offset);
+    read(entry.size);
+    read(entry.pathLen);
+    if (bytes.size() - pos < entry.pathLen || entry.offset > bytes.size() || bytes.size() - entry.offset < entry.size)
+      throw std::runtime_error(fmt::format("Corrupted asset bundle {:?}", path));
+    index.emplace(bytes.substr(pos, entry.pathLen), bytes.substr(entry.offset, entry.size));
+    pos += entry.pathLen;
+  }
+}
+
+auto AssetBundle::find(std::string_view path) const -> std::optional<std::string_view>
+{
+  auto it = index.find(path);
+  if (it == std::end(index))
+    return std::nullopt;
+  return it->second;
+}
+
+auto AssetBundle::write(const std::filesystem::path &path,
+                        const std::vector<std::string> &paths,
+                        const AssetBundle *from) -> void
+{
+  auto files = std::vector<std::string>{};
+  files.reserve(paths.size());
+  auto ec = std::error_code{};
+  for (const auto &p : paths)
+  {
+    // the loose file wins, it may have been edited since the old bundle was made
+    auto bytes = from && !std::filesystem::exists(p, ec) ? from->find(p) : std::nullopt;
+    files.push_back(bytes ? std::string{*bytes} : readFile(p));
+  }
+
+  auto indexBytes = sizeof(Header::magic) + sizeof(Header::count);
+  for (const auto &p : paths)
+    indexBytes += sizeof(IndexEntry::offset) + sizeof(IndexEntry::size) + sizeof(IndexEntry::pathLen) + p.size();
+
+  auto out = std::string{};
+  append(out, Magic);
+  append(out, static_cast<uint32_t>(paths.size()));
+  auto offset = alignUp(indexBytes);
+  for (auto i = 0u; i < paths.size(); ++i)
+  {
+    append(out, static_cast<uint64_t>(offset));
+    append(out, static_cast<uint64_t>(files[i].size()));
+    append(out, static_cast<uint32_t>(paths[i].size()));
+    out += paths[i];
+    offset = alignUp(offset + files[i].size());
+  }
+  out.reserve(offset);
+  for (const auto &f : files)
+  {
+    out.resize(alignUp(out.size()), '\0');
+    out += f;
+  }
+
+  if (!write_file_atomically(path, out))
+    throw std::runtime_error(fmt::format("Error writing asset bundle {:?}: {}", path, std::strerror(errno)));
+}
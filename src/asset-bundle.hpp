@@ -0,0 +1,36 @@
+#pragma once
+#include "file.hpp"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The files a project references packed into one file next to prj.tpp, so opening the project is
+// one memory map instead of hundreds of opens and seeks. The index at the front maps each path as
+// the project spells it to the bytes of the file, stored as they were on disk with every file
+// starting on a page boundary.
+class AssetBundle
+{
+public:
+  // maps the bundle, throws if it cannot be read or is not a bundle
+  AssetBundle(const std::filesystem::path &);
+  AssetBundle(const AssetBundle &) = delete;
+  auto operator=(const AssetBundle &) -> AssetBundle & = delete;
+  auto find(std::string_view path) const -> std::optional<std::string_view>;
+  auto size() const -> size_t { return index.size(); }
+
+  // packs the files under the names given, taking the ones without a loose file any more from
+  // from, throws if one of them cannot be read
+  static auto write(const std::filesystem::path &,
+                    const std::vector<std::string> &paths,
+                    const AssetBundle *from = nullptr) -> void;
+
+  static constexpr auto Align = size_t{4096};
+
+private:
+  MappedFile file;
+  // views into the mapping
+  std::unordered_map<std::string_view, std::string_view> index;
+};
@@ -0,0 +1,98 @@
+#include "asset-watcher.hpp"
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+
+AssetWatcher::Dir::Dir(uv::Uv &uv)
+  : event(uv.createFsEvent()), debounce(uv.createTimer())
+{
+}
+
+AssetWatcher::AssetWatcher(uv::Uv &aUv)
+  : uv(aUv)
+{
+}
+
+auto AssetWatcher::watch(const std::filesystem::path &path, Cb cb) -> Id
+{
+  auto ec = std::error_code{};
+  const auto abs = std::filesystem::absolute(path, ec);
+  if (ec)
+  {
+    SPDLOG_ERROR("Cannot watch {:?}: {}", path, ec.message());
+    return 0;
+  }
+  const auto dirPath = abs.parent_path();
+  auto it = dirs.find(dirPath);
+  if (it == std::end(dirs))
+  {
+    auto dir = std::make_unique<Dir>(uv.get());
+    auto &ref = *dir;
+    const auto r = ref.event.start(
+      [this, &ref](std::string filename, int /*events*/, int status) {
+        if (status != 0)
+          return;
+        onEvent(ref, std::move(filename));
+      },
+      dirPath.string(),
+      0);
+    if (r < 0)
+    {
+      SPDLOG_ERROR("Cannot watch {:?}: {}", dirPath, uv_err_name(r));
+      return 0;
+    }
+    it = dirs.emplace(dirPath, std::move(dir)).first;
+  }
+  const auto id = nextId++;
+  auto filename = abs.filename().string();
+  it->second->subscribers[filename].emplace(id, std::move(cb));
+  subscriptions.emplace(id, std::pair{dirPath, std::move(filename)});
+  return id;
+}
+
+auto AssetWatcher::unwatch(Id id) -> void
+{
+  auto sub = subscriptions.find(id);
+  if (sub == std::end(subscriptions))
+    return;
+  const auto &[dirPath, filename] = sub->second;
+  if (auto dir = dirs.find(dirPath); dir != std::end(dirs))
+  {
+    auto &subscribers = dir->second->subscribers;
+    if (auto file = subscribers.find(filename); file != std::end(subscribers))
+    {
+      file->second.erase(id);
+      if (file->second.empty())
+        subscribers.erase(file);
+    }
+    if (subscribers.empty())
+      dirs.erase(dir);
+  }
+  subscriptions.erase(sub);
+}
+
+auto AssetWatcher::onEvent(Dir &dir, std::string filename) -> void
+{
+  if (!dir.subscribers.contains(filename))
+    return;
+  dir.pending.insert(std::move(filename));
+  dir.debounce.start(
+    [this, &dir]() {
+      auto pending = std::move(dir.pending);
+      dir.pending.clear();
+      for (const auto &file : pending)
+      {
+        auto it = dir.subscribers.find(file);
+        if (it == std::end(dir.subscribers))
+          continue;
+        std::erase_if(it->second, [this](auto &sub) {
+          if (sub.second())
+            return false;
+          subscriptions.erase(sub.first);
+          return true;
+        });
+        if (it->second.empty())
+          dir.subscribers.erase(it);
+      }
+    },
+    DebounceMs);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "uv.hpp"
+#include <filesystem>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// One uv::FsEvent per directory instead of one per asset. Bursts of events (editors writing a file
+// in several steps, rename-over saves) are collapsed by a short per-directory timer, so every
+// subscriber of a file is notified once per save.
+class AssetWatcher
+{
+public:
+  // return false from the callback once the subscriber is gone to drop the subscription
+  using Cb = std::function<auto()->bool>;
+  // 0 is never handed out
+  using Id = uint64_t;
+
+  AssetWatcher(uv::Uv &);
+  auto watch(const std::filesystem::path &, Cb) -> Id;
+  // drops the subscription, and the directory watch with the last of its subscribers
+  auto unwatch(Id) -> void;
+
+  static constexpr auto DebounceMs = 150;
+
+private:
+  struct Dir
+  {
+    Dir(uv::Uv &);
+    uv::FsEvent event;
+    uv::Timer debounce;
+    std::map<std::string, std::map<Id, Cb>> subscribers;
+    std::set<std::string> pending;
+  };
+
+  std::reference_wrapper<uv::Uv> uv;
+  std::map<std::filesystem::path, std::unique_ptr<Dir>> dirs;
+  // the directory and file name of each subscription
+  std::map<Id, std::pair<std::filesystem::path, std::string>> subscriptions;
+  Id nextId = 1;
+
+  auto onEvent(Dir &, std::string filename) -> void;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include "audio-kernels.hpp"
+#include "wav.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+// Immutable, reference counted block of captured samples. AudioIn hands the same block to every
+// CaptureSink; sinks read it through samples() and keep a copy of the block, not of the samples,
+// when they need it later. The levels are measured once when the block is made.
+class AudioBlock
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  AudioBlock() = default;
+  explicit AudioBlock(Wav v, Clock::time_point aCaptured = Clock::now())
+    : AudioBlock(std::make_shared<const Wav>(std::move(v)), aCaptured)
+  {
+  }
+  // for a producer that recycles its buffers once no block refers to them any more
+  explicit AudioBlock(std::shared_ptr<const Wav> v, Clock::time_point aCaptured = Clock::now())
+    : wav(std::move(v)), levels_(AudioKernels::levels(wav->data(), wav->size())), captured_(aCaptured)
+  {
+  }
+  auto levels() const -> const AudioKernels::Levels & { return levels_; }
+  // when the device delivered the newest sample, the start of the mic to mouth latency
+  auto captured() const -> Clock::time_point { return captured_; }
+  auto samples() const -> std::span<const int16_t>
+  {
+    if (!wav)
+      return {};
+    return *wav;
+  }
+  auto size() const -> size_t { return wav ? wav->size() : 0; }
+  auto empty() const -> bool { return size() == 0; }
+
+private:
+  std::shared_ptr<const Wav> wav;
+  AudioKernels::Levels levels_;
+  Clock::time_point captured_;
+};
@@ -0,0 +1,44 @@
+#include "audio-devices.hpp"
+#include "trace.hpp"
+
+AudioDevices::AudioDevices(uv::Uv &uv) : outbox(uv.createAsync()), thread(&AudioDevices::run, this) {}
+
+AudioDevices::~AudioDevices()
+{
+  {
+    auto lock = std::lock_guard{mutex};
+    stopping = true;
+  }
+  wake.notify_one();
+  thread.join();
+}
+
+auto AudioDevices::queue(Task work, Task done) -> void
+{
+  {
+    auto lock = std::lock_guard{mutex};
+    jobs.push_back(Job{std::move(work), std::move(done)});
+  }
+  wake.notify_one();
+}
+
+auto AudioDevices::run() -> void
+{
+  Trace::nameThread("audio devices");
+  for (;;)
+  {
+    auto job = Job{};
+    {
+      auto lock = std::unique_lock{mutex};
+      wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+      if (jobs.empty())
+        return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job.work();
+    // a done posted while the loop shuts down is dropped with the outbox
+    if (job.done)
+      outbox.post(std::move(job.done));
+  }
+}
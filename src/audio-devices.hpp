@@ -0,0 +1,50 @@
+#pragma once
+#include "uv.hpp"
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <thread>
+
+// The thread every capture and output device is opened and closed on. SDL's audio device calls
+// are not safe to make from several threads at once, and the driver can block any of them for a
+// long time, so they neither run on the main loop nor race each other on the uv thread pool. They
+// run one at a time in the order queued; what they return comes back on the main loop.
+class AudioDevices
+{
+public:
+  using Task = uv::Async::Task;
+
+  AudioDevices(uv::Uv &);
+  AudioDevices(const AudioDevices &) = delete;
+  // runs the work queued so far, then stops the thread
+  ~AudioDevices();
+  // runs work on the device thread, then done on the main loop
+  auto queue(Task work, Task done) -> void;
+  // runs fn on the device thread and waits for it, for the device a constructor opens; rethrows
+  // what fn throws
+  template <typename Fn>
+  auto call(Fn fn) -> decltype(fn())
+  {
+    auto task = std::packaged_task<decltype(fn())()>{std::move(fn)};
+    auto ret = task.get_future();
+    queue(std::move(task), nullptr);
+    return ret.get();
+  }
+
+private:
+  struct Job
+  {
+    Task work;
+    Task done;
+  };
+
+  uv::Async outbox;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Job> jobs;
+  bool stopping = false;
+  std::thread thread;
+
+  auto run() -> void;
+};
@@ -1,87 +1,233 @@
 #include "audio-in.hpp"
 
+#include <algorithm>
+
 #include <spdlog/spdlog.h>
 
 #include "preferences.hpp"
 
-AudioIn::AudioIn(uv::Uv &uv, const std::string &device, int sampleRate, int frameSize)
-  : prepare(uv.createPrepare()),
-    want([sampleRate, frameSize]() {
+AudioIn::AudioIn(uv::Uv &uv, AudioDevices &aDevices, const std::string &aDevice, int sampleRate, int latencyBudgetMs)
+  : devices(aDevices),
+    wakeup(uv.createAsync()),
+    want([sampleRate, latencyBudgetMs]() {
       SDL_AudioSpec ret;
       SDL_zero(ret);
       ret.freq = sampleRate;
       ret.format = AUDIO_S16SYS;
       ret.channels = 1;
-      ret.samples = static_cast<Uint16>(frameSize);
+      ret.samples = static_cast<Uint16>(bufferFor(sampleRate, latencyBudgetMs));
       return ret;
     }()),
-    audio(makeDevice(device))
+    ring(static_cast<size_t>(std::max(sampleRate, MaxDeviceRate)) * RingSeconds),
+    device(aDevice),
+    alive(std::make_shared<AudioIn *>(this))
+{
+  adopt(devices.get().call([this]() { return makeDevice(device, want); }));
+  wakeup.onWake(std::bind_front(&AudioIn::tick, this));
+}
+
+AudioIn::~AudioIn()
 {
+  // an open in flight closes its device when it finishes
+  *alive = nullptr;
+}
 
-  prepare.start(std::bind_front(&AudioIn::tick, this));
+auto AudioIn::buffer() -> std::shared_ptr<Wav>
+{
+  // a sink that kept the last block keeps its samples, a new buffer takes their place
+  if (!spare || spare.use_count() > 1)
+    spare = std::make_shared<Wav>();
+  spare->clear();
+  return spare;
 }
 
 auto AudioIn::tick() -> void
 {
-  audio->lock();
-  auto v = std::move(buf);
-  buf.clear();
-  audio->unlock();
+  auto v = buffer();
+  auto &popped = resampler ? captured : *v;
+  // read before the ring, a callback between the two only makes the block look a little older
+  const auto arrived =
+    AudioBlock::Clock::time_point{AudioBlock::Clock::duration{lastCallback.load(std::memory_order_acquire)}};
+  popped.resize(ring.size());
+  popped.resize(ring.pop(popped.data(), popped.size()));
+  if (resampler)
+    resampler->process(captured, *v);
+  if (const auto overruns = ring.overruns(); overruns != reportedOverruns)
+  {
+    SPDLOG_WARN("audio capture dropped {} samples", overruns - reportedOverruns);
+    reportedOverruns = overruns;
+  }
+  dispatch(AudioBlock{std::move(v), popped.empty() ? AudioBlock::Clock::now() : arrived});
+}
 
-  if (sinks.empty())
-    return;
-  auto last = sinks.back();
-  for (auto it = std::begin(sinks); it != std::end(sinks); ++it)
-    if (&it->get() != &last.get())
-      it->get().ingest(v);
-    else
-      it->get().ingest(std::move(v));
+auto AudioIn::inject(std::span<const int16_t> samples) -> void
+{
+  auto v = buffer();
+  v->assign(std::begin(samples), std::end(samples));
+  dispatch(AudioBlock{std::move(v)});
 }
 
-auto AudioIn::reg(AudioSink &v) -> void
+auto AudioIn::dispatch(const AudioBlock &block) -> void
+{
+  for (auto &sink : sinks)
+    sink.get().ingest(block);
+}
+
+auto AudioIn::reg(CaptureSink &v) -> void
 {
   sinks.push_back(v);
 }
 
-auto AudioIn::unreg(AudioSink &v) -> void
+auto AudioIn::unreg(CaptureSink &v) -> void
 {
   sinks.erase(
     std::remove_if(std::begin(sinks), std::end(sinks), [&](const auto &x) { return &x.get() == &v; }),
     std::end(sinks));
 }
 
-auto AudioIn::updateDevice(const std::string &device) -> void
+auto AudioIn::updateDevice(const std::string &v) -> void
+{
+  device = v;
+  reopen();
+}
+
+auto AudioIn::deviceRemoved(SDL_AudioDeviceID id) -> void
+{
+  if (!audio || audio->get() != id)
+    return;
+  SPDLOG_WARN("capture device was removed, falling back to the default one");
+  updateDevice(Preferences::DefaultAudio);
+}
+
+auto AudioIn::reopen() -> void
+{
+  const auto seq = ++swapSeq;
+  auto opened = std::make_shared<Opened>();
+  auto error = std::make_shared<std::string>();
+  devices.get().queue(
+    [this, opened, error, name = device, spec = want]() {
+      try
+      {
+        *opened = makeDevice(name, spec);
+      }
+      catch (const std::runtime_error &e)
+      {
+        *error = e.what();
+      }
+    },
+    [opened, error, name = device, seq, alive = alive, devices = devices]() {
+      auto self = *alive;
+      if (!self)
+      {
+        // the device still closes on the device thread
+        devices.get().queue([opened]() { opened->audio = nullptr; }, nullptr);
+        return;
+      }
+      if (!opened->audio)
+      {
+        SPDLOG_ERROR("Cannot open capture device {:?}: {}", name, *error);
+        return;
+      }
+      if (seq != self->swapSeq)
+      {
+        self->close(std::move(opened->audio));
+        return;
+      }
+      SPDLOG_INFO("switched capture to {:?}", name);
+      self->adopt(std::move(*opened));
+    });
+}
+
+auto AudioIn::setLatencyBudget(int ms) -> void
+{
+  const auto samples = static_cast<Uint16>(bufferFor(want.freq, ms));
+  if (samples == want.samples)
+    return;
+  want.samples = samples;
+  reopen();
+}
+
+auto AudioIn::bufferFor(int sampleRate, int latencyBudgetMs) -> int
 {
-  audio = nullptr;
-  audio = makeDevice(device);
+  const auto fit = sampleRate * latencyBudgetMs / 2000;
+  auto ret = MinBufferSamples;
+  while (ret * 2 <= std::min(fit, MaxBufferSamples))
+    ret *= 2;
+  return ret;
+}
+
+auto AudioIn::bufferMs() const -> float
+{
+  return 1000.f * static_cast<float>(deviceSamples) / static_cast<float>(want.freq);
 }
 
 void AudioIn::callback(unsigned char const *stream, int len)
 {
   std::size_t const stream_len = len / sizeof(int16_t);
   auto const stream_begin = reinterpret_cast<int16_t const *>(stream);
-  auto const stream_end = stream_begin + stream_len;
 
-  buf.insert(std::end(buf), stream_begin, stream_end);
+  ring.push(stream_begin, stream_len);
+  lastCallback.store(AudioBlock::Clock::now().time_since_epoch().count(), std::memory_order_release);
+  wakeup.wake();
 }
 
-std::unique_ptr<sdl::Audio> AudioIn::makeDevice(const std::string &device)
+auto AudioIn::makeDevice(const std::string &name, SDL_AudioSpec spec) -> Opened
 {
-  SDL_AudioSpec have;
-  auto ret = std::make_unique<sdl::Audio>(
-    device != Preferences::DefaultAudio ? device.c_str() : nullptr,
+  auto ret = Opened{};
+  ret.audio = std::make_unique<sdl::Audio>(
+    name != Preferences::DefaultAudio ? name.c_str() : nullptr,
     1,
-    &want,
-    &have,
-    0,
+    &spec,
+    &ret.have,
+    SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_SAMPLES_CHANGE,
     std::bind_front(&AudioIn::callback, this));
-  if (have.format != want.format)
+  if (ret.have.format != spec.format)
     throw std::runtime_error("Failed to get the desired AudioSpec");
-  ret->pause(0);
   return ret;
 }
 
+auto AudioIn::adopt(Opened v) -> void
+{
+  // the old device stops first, so the ring keeps a single producer, and what it captured is
+  // dispatched at its own rate before the resampler changes
+  if (audio)
+  {
+    audio->pause(1);
+    tick();
+  }
+  const auto &have = v.have;
+  if (have.freq != want.freq)
+  {
+    SPDLOG_INFO("capture device runs at {} Hz, resampling to {} Hz", have.freq, want.freq);
+    resampler = std::make_unique<Resampler>(have.freq, want.freq);
+  }
+  else
+    resampler = nullptr;
+  // the device buffer runs at the device rate, the budget is in the rate the sinks see
+  deviceSamples = static_cast<int>(static_cast<int64_t>(have.samples) * want.freq / have.freq);
+  SPDLOG_INFO("capture buffer {} samples, asked for {}", have.samples, want.samples);
+  std::swap(audio, v.audio);
+  audio->pause(0);
+  if (v.audio)
+    close(std::move(v.audio));
+}
+
+auto AudioIn::close(std::unique_ptr<sdl::Audio> v) -> void
+{
+  devices.get().queue([old = std::move(v)]() mutable { old = nullptr; }, nullptr);
+}
+
 auto AudioIn::sampleRate() const -> int
 {
   return want.freq;
 }
+
+auto AudioIn::overruns() const -> uint64_t
+{
+  return ring.overruns();
+}
+
+auto AudioIn::ringFill() const -> float
+{
+  return static_cast<float>(ring.size()) / static_cast<float>(ring.capacity());
+}
@@ -1,36 +1,98 @@
 #pragma once
+#include <atomic>
 #include <memory>
+#include <span>
 
 #include <sdlpp/sdlpp.hpp>
 
-#include "audio-sink.hpp"
+#include "audio-devices.hpp"
+#include "capture-sink.hpp"
+#include "resampler.hpp"
 #include "shared_from_this.hpp"
+#include "spsc-ring.hpp"
 #include "uv.hpp"
 #include "wav.hpp"
 
 class AudioIn : public virtual enable_shared_from_this
 {
 public:
-  AudioIn(uv::Uv &, const std::string &device, int sampleRate, int frameSize);
+  // the device buffer is sized from the latency budget alone, the sinks take blocks of any size
+  AudioIn(uv::Uv &, AudioDevices &, const std::string &device, int sampleRate, int latencyBudgetMs);
   AudioIn(AudioIn const &) = delete;
   AudioIn(AudioIn &&) = delete;
 
   AudioIn operator=(AudioIn const &) = delete;
   AudioIn operator=(AudioIn &&) = delete;
+  ~AudioIn();
 
-  auto reg(AudioSink &) -> void;
-  auto unreg(AudioSink &) -> void;
+  auto reg(CaptureSink &) -> void;
+  auto unreg(CaptureSink &) -> void;
+  // opens the device on the AudioDevices thread and switches over once it is open, capture goes
+  // on from the old device in the meantime and stays with it if the new one fails to open
   auto updateDevice(const std::string &device) -> void;
+  // moves to the default device when the one capturing was unplugged
+  auto deviceRemoved(SDL_AudioDeviceID) -> void;
+  // reopens the device when the budget asks for another buffer size
+  auto setLatencyBudget(int ms) -> void;
+  // what the device granted, which may be more than asked for
+  auto bufferSamples() const -> int { return deviceSamples; }
+  auto bufferMs() const -> float;
+  // feeds samples to the sinks as if they were captured, used by the benchmark mode
+  auto inject(std::span<const int16_t>) -> void;
   auto sampleRate() const -> int;
+  // samples the capture callback had to drop because the main loop did not drain the ring in time
+  auto overruns() const -> uint64_t;
+  // how full the capture ring is, 0..1; near 1 the main loop is about to drop samples
+  auto ringFill() const -> float;
+
+  // seconds of audio the capture ring holds at rates up to MaxDeviceRate
+  static constexpr auto RingSeconds = 2;
+  static constexpr auto MaxDeviceRate = 48000;
+  // the device buffer is a power of two in this range
+  static constexpr auto MinBufferSamples = 64;
+  static constexpr auto MaxBufferSamples = 4096;
+  // buffer samples for a budget; half of it goes to the buffer, the rest to draining it
+  static auto bufferFor(int sampleRate, int latencyBudgetMs) -> int;
 
 private:
-  uv::Prepare prepare;
-  std::vector<std::reference_wrapper<AudioSink>> sinks;
+  struct Opened
+  {
+    std::unique_ptr<sdl::Audio> audio;
+    SDL_AudioSpec have;
+  };
+
+  std::reference_wrapper<AudioDevices> devices;
+  // the callback wakes the loop and the ring is drained right then, so a block is dispatched when
+  // it arrives and the loop sleeps between blocks instead of coming around to look
+  uv::Async wakeup;
+  std::vector<std::reference_wrapper<CaptureSink>> sinks;
   SDL_AudioSpec want;
+  int deviceSamples = 0;
+  // filled by the SDL audio thread, drained by tick()
+  SpscRing<int16_t> ring;
+  // steady clock ticks of the last callback, when the newest sample in the ring arrived
+  std::atomic<int64_t> lastCallback = 0;
+  uint64_t reportedOverruns = 0;
+  // set when the device runs at its native rate instead of the one the sinks expect
+  std::unique_ptr<Resampler> resampler;
   std::unique_ptr<sdl::Audio> audio;
-  Wav buf;
+  std::string device;
+  // the latest device asked for, an open that finishes after a newer request is thrown away
+  uint64_t swapSeq = 0;
+  std::shared_ptr<AudioIn *> alive;
+  // the samples of the last block, reused once the sinks let go of it so a tick does not allocate
+  std::shared_ptr<Wav> spare;
+  // what the ring held before resampling
+  Wav captured;
 
   void callback(unsigned char const *buf, int len);
-  auto makeDevice(const std::string &device) -> std::unique_ptr<sdl::Audio>;
+  // opens the device paused, safe on any thread
+  auto makeDevice(const std::string &name, SDL_AudioSpec spec) -> Opened;
+  auto reopen() -> void;
+  auto adopt(Opened) -> void;
+  // closing can block on the driver as long as opening, so it is done on the device thread as well
+  auto close(std::unique_ptr<sdl::Audio>) -> void;
   auto tick() -> void;
+  auto buffer() -> std::shared_ptr<Wav>;
+  auto dispatch(const AudioBlock &) -> void;
 };
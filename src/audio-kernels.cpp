@@ -0,0 +1,158 @@
+#include "audio-kernels.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define AUDIO_KERNELS_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define AUDIO_KERNELS_NEON
+#endif
+
+namespace AudioKernels
+{
+  auto addSaturate(int16_t *dst, const int16_t *src, size_t n) -> void
+  {
+    auto i = size_t{0};
+#if defined(AUDIO_KERNELS_SSE2)
+    for (; i + 8 <= n; i += 8)
+    {
+      const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+      const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_adds_epi16(a, b));
+    }
+#elif defined(AUDIO_KERNELS_NEON)
+    for (; i + 8 <= n; i += 8)
+      vst1q_s16(dst + i, vqaddq_s16(vld1q_s16(dst + i), vld1q_s16(src + i)));
+#endif
+    for (; i < n; ++i)
+      dst[i] = static_cast<int16_t>(std::clamp(dst[i] + src[i], INT16_MIN, INT16_MAX));
+  }
+
+  auto levels(const int16_t *src, size_t n) -> Levels
+  {
+    auto ret = Levels{};
+    auto i = size_t{0};
+    auto sumSq = uint64_t{0};
+    auto positiveSumSq = uint64_t{0};
+    auto peak = 0;
+    auto positivePeak = 0;
+#if defined(AUDIO_KERNELS_SSE2)
+    {
+      const auto zero = _mm_setzero_si128();
+      auto vPeak = zero;
+      auto vPositivePeak = zero;
+      auto vSumSq = zero;
+      auto vPositiveSumSq = zero;
+      for (; i + 8 <= n; i += 8)
+      {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        vPeak = _mm_max_epi16(vPeak, _mm_max_epi16(v, _mm_subs_epi16(zero, v)));
+        vPositivePeak = _mm_max_epi16(vPositivePeak, v);
+        const auto gt = _mm_cmpgt_epi16(v, zero);
+        ret.positive += static_cast<size_t>(std::popcount(static_cast<unsigned>(_mm_movemask_epi8(gt)))) / 2;
+        const auto eq = _mm_cmpeq_epi16(v, zero);
+        ret.zeros += static_cast<size_t>(std::popcount(static_cast<unsigned>(_mm_movemask_epi8(eq)))) / 2;
+        // the pair sums are at most 2^31, which fits when read as unsigned
+        const auto sq = _mm_madd_epi16(v, v);
+        vSumSq = _mm_add_epi64(vSumSq, _mm_unpacklo_epi32(sq, zero));
+        vSumSq = _mm_add_epi64(vSumSq, _mm_unpackhi_epi32(sq, zero));
+        const auto pv = _mm_and_si128(v, gt);
+        const auto psq = _mm_madd_epi16(pv, pv);
+        vPositiveSumSq = _mm_add_epi64(vPositiveSumSq, _mm_unpacklo_epi32(psq, zero));
+        vPositiveSumSq = _mm_add_epi64(vPositiveSumSq, _mm_unpackhi_epi32(psq, zero));
+      }
+      alignas(16) int16_t peaks[8];
+      alignas(16) int16_t positivePeaks[8];
+      alignas(16) uint64_t sums[2];
+      alignas(16) uint64_t positiveSums[2];
+      _mm_store_si128(reinterpret_cast<__m128i *>(peaks), vPeak);
+      _mm_store_si128(reinterpret_cast<__m128i *>(positivePeaks), vPositivePeak);
+      _mm_store_si128(reinterpret_cast<__m128i *>(sums), vSumSq);
+      _mm_store_si128(reinterpret_cast<__m128i *>(positiveSums), vPositiveSumSq);
+      peak = std::ranges::max(peaks);
+      positivePeak = std::ranges::max(positivePeaks);
+      sumSq = sums[0] + sums[1];
+      positiveSumSq = positiveSums[0] + positiveSums[1];
+    }
+#elif defined(AUDIO_KERNELS_NEON)
+    {
+      auto vPeak = vdupq_n_s16(0);
+      auto vPositivePeak = vdupq_n_s16(0);
+      auto vPositive = vdupq_n_u32(0);
+      auto vZeros = vdupq_n_u32(0);
+      auto vSumSq = vdupq_n_s64(0);
+      auto vPositiveSumSq = vdupq_n_s64(0);
+      for (; i + 8 <= n; i += 8)
+      {
+        const auto v = vld1q_s16(src + i);
+        vPeak = vmaxq_s16(vPeak, vqabsq_s16(v));
+        vPositivePeak = vmaxq_s16(vPositivePeak, v);
+        const auto gt = vcgtq_s16(v, vdupq_n_s16(0));
+        vPositive = vpadalq_u16(vPositive, vshrq_n_u16(gt, 15));
+        vZeros = vpadalq_u16(vZeros, vshrq_n_u16(vceqq_s16(v, vdupq_n_s16(0)), 15));
+        const auto pv = vbslq_s16(gt, v, vdupq_n_s16(0));
+        vPositiveSumSq = vpadalq_s32(vPositiveSumSq, vmull_s16(vget_low_s16(pv), vget_low_s16(pv)));
+        vPositiveSumSq = vpadalq_s32(vPositiveSumSq, vmull_s16(vget_high_s16(pv), vget_high_s16(pv)));
+        vSumSq = vpadalq_s32(vSumSq, vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+        vSumSq = vpadalq_s32(vSumSq, vmull_s16(vget_high_s16(v), vget_high_s16(v)));
+      }
+      peak = vmaxvq_s16(vPeak);
+      positivePeak = vmaxvq_s16(vPositivePeak);
+      ret.positive = vaddvq_u32(vPositive);
+      ret.zeros = vaddvq_u32(vZeros);
+      sumSq = static_cast<uint64_t>(vaddvq_s64(vSumSq));
+      positiveSumSq = static_cast<uint64_t>(vaddvq_s64(vPositiveSumSq));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+      const auto v = static_cast<int>(src[i]);
+      peak = std::max(peak, std::min(std::abs(v), INT16_MAX));
+      positivePeak = std::max(positivePeak, v);
+      sumSq += static_cast<uint64_t>(v * v);
+      if (v > 0)
+      {
+        ++ret.positive;
+        positiveSumSq += static_cast<uint64_t>(v * v);
+      }
+      else if (v == 0)
+        ++ret.zeros;
+    }
+    ret.peak = peak;
+    ret.positivePeak = positivePeak;
+    if (n > 0)
+      ret.rms = static_cast<float>(std::sqrt(static_cast<double>(sumSq) / static_cast<double>(n)));
+    if (ret.positive > 0)
+      ret.positiveRms = static_cast<float>(std::sqrt(static_cast<double>(positiveSumSq) / static_cast<double>(ret.positive)));
+    return ret;
+  }
+
+  auto dot(const float *a, const float *b, size_t n) -> float
+  {
+    auto i = size_t{0};
+    auto ret = 0.f;
+#if defined(AUDIO_KERNELS_SSE2)
+    {
+      auto acc = _mm_setzero_ps();
+      for (; i + 4 <= n; i += 4)
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+      alignas(16) float sums[4];
+      _mm_store_ps(sums, acc);
+      ret = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    }
+#elif defined(AUDIO_KERNELS_NEON)
+    {
+      auto acc = vdupq_n_f32(0.f);
+      for (; i + 4 <= n; i += 4)
+        acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+      ret = vaddvq_f32(acc);
+    }
+#endif
+    for (; i < n; ++i)
+      ret += a[i] * b[i];
+    return ret;
+  }
+} // namespace AudioKernels
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+// Sample loops shared by the audio path, vectorized with SSE2 or NEON where available.
+namespace AudioKernels
+{
+  struct Levels
+  {
+    float rms = 0.f;
+    // largest magnitude, -32768 counts as 32767
+    int peak = 0;
+    // largest positive sample, the number of positive samples and their RMS
+    int positivePeak = 0;
+    size_t positive = 0;
+    float positiveRms = 0.f;
+    // the number of samples that are exactly 0
+    size_t zeros = 0;
+  };
+
+  auto levels(const int16_t *src, size_t n) -> Levels;
+
+  // sum of a[i] * b[i]
+  auto dot(const float *a, const float *b, size_t n) -> float;
+  // dst[i] = clamp(dst[i] + src[i]) to the int16 range
+  auto addSaturate(int16_t *dst, const int16_t *src, size_t n) -> void;
+} // namespace AudioKernels
@@ -4,8 +4,11 @@
 
 #include "audio-level.hpp"
 #include "audio-in.hpp"
+#include "render-scheduler.hpp"
+#include <cmath>
 
-AudioLevel::AudioLevel(class AudioIn &aAudioIn) : audioIn(aAudioIn)
+AudioLevel::AudioLevel(class AudioIn &aAudioIn, RenderScheduler *aScheduler)
+  : audioIn(aAudioIn), scheduler(aScheduler)
 {
   audioIn.get().reg(*this);
 }
@@ -20,18 +23,25 @@ auto AudioLevel::getLevel() const -> float
   return level;
 }
 
-auto AudioLevel::ingest(Wav wav, bool /*overlap*/) -> void
+auto AudioLevel::ingest(const AudioBlock &block) -> void
 {
-  for (auto v : wav)
+  // The follower used to move level 0.2% of the way towards 0.14 * ln(v / 0x7fff) + 1 on every
+  // positive sample. This takes one geometric step of (1 - 0.002)^positive towards the level of
+  // the block's positive RMS instead, so the log is taken once per block. It is an approximation:
+  // the log of the RMS sits above the mean of the per-sample logs, and the order of the samples
+  // within the block no longer matters, so the envelope reads a little higher and smoother.
+  // Silent samples count as they did, each one a step towards 0, so a muted mic lets go.
+  const auto &levels = block.levels();
+  if (levels.positive > 0)
   {
-    if (v < 0)
-      continue;
-    auto curLevel = std::max(0.f, 0.14f * log(1.f * v / 0x7fff) + 1.f);
-    level += 0.002f * (curLevel - level);
+    const auto target = std::max(0.f, 0.14f * std::log(levels.positiveRms / 0x7fff) + 1.f);
+    const auto decay = std::pow(1.f - Smoothing, static_cast<float>(levels.positive));
+    level = target + decay * (level - target);
+  }
+  level *= std::pow(1.f - Smoothing, static_cast<float>(levels.zeros));
+  if (scheduler && std::abs(level - scheduledLevel) > 0.005f)
+  {
+    scheduledLevel = level;
+    scheduler->invalidate();
   }
-}
-
-auto AudioLevel::sampleRate() const -> int
-{
-  return audioIn.get().sampleRate();
 }
@@ -1,17 +1,24 @@
 #pragma once
-#include "audio-sink.hpp"
+#include "capture-sink.hpp"
+#include <functional>
 
-class AudioLevel final : public AudioSink
+// Envelope of the capture level in 0..1. Nodes on the same input share one instance through
+// Lib::queryAudioLevel().
+class AudioLevel final : public CaptureSink
 {
 public:
-  explicit AudioLevel(class AudioIn &);
+  explicit AudioLevel(class AudioIn &, class RenderScheduler * = nullptr);
+  AudioLevel(const AudioLevel &) = delete;
   ~AudioLevel() final;
   auto getLevel() const -> float;
-  auto sampleRate() const -> int final;
+
+  static constexpr auto Smoothing = 0.002f;
 
 private:
   std::reference_wrapper<AudioIn> audioIn;
+  class RenderScheduler *scheduler;
   float level = 0.f;
+  float scheduledLevel = 0.f;
 
-  auto ingest(Wav, bool overlap) -> void final;
+  auto ingest(const AudioBlock &) -> void final;
 };
@@ -2,13 +2,15 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <iterator>
 
 #include <spdlog/spdlog.h>
 
 #include "preferences.hpp"
 
-AudioOut::AudioOut(const std::string &device, int sampleRate, int frameSize)
-  : want([sampleRate, frameSize]() {
+AudioOut::AudioOut(AudioDevices &aDevices, const std::string &device, int sampleRate, int frameSize)
+  : devices(aDevices),
+    want([sampleRate, frameSize]() {
       SDL_AudioSpec ret;
       SDL_zero(ret);
       ret.freq = sampleRate;
@@ -17,35 +19,150 @@ AudioOut::AudioOut(const std::string &device, int sampleRate, int frameSize)
       ret.samples = static_cast<Uint16>(frameSize);
       return ret;
     }()),
-    audio(makeDevice(device))
+    buf(static_cast<size_t>(std::max(sampleRate, MaxDeviceRate)) * MaxQueuedSeconds),
+    alive(std::make_shared<AudioOut *>(this))
 {
+  adopt(
+    devices.get().call([this, &device]() { return makeDevice(device, want, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE); }));
+  bank.emplace(deviceRate);
+}
+
+AudioOut::~AudioOut()
+{
+  // an open in flight closes its device when it finishes
+  *alive = nullptr;
 }
 
 auto AudioOut::updateDevice(const std::string &device) -> void
 {
-  audio = nullptr;
-  audio = makeDevice(device);
+  const auto seq = ++swapSeq;
+  // the new device is asked for the rate the producers already resample to and SDL converts if
+  // the hardware runs at another one, so the queued samples and the cue clock stay valid
+  auto spec = want;
+  spec.freq = deviceRate;
+  auto opened = std::make_shared<Opened>();
+  auto error = std::make_shared<std::string>();
+  devices.get().queue(
+    [this, opened, error, device, spec]() {
+      try
+      {
+        *opened = makeDevice(device, spec, 0);
+      }
+      catch (const std::runtime_error &e)
+      {
+        *error = e.what();
+      }
+    },
+    [opened, error, device, seq, alive = alive, devices = devices]() {
+      auto self = *alive;
+      if (!self)
+      {
+        // the device still closes on the device thread
+        devices.get().queue([opened]() { opened->audio = nullptr; }, nullptr);
+        return;
+      }
+      if (!opened->audio)
+      {
+        SPDLOG_ERROR("Cannot open output device {:?}: {}", device, *error);
+        return;
+      }
+      if (seq != self->swapSeq)
+      {
+        self->close(std::move(opened->audio));
+        return;
+      }
+      SPDLOG_INFO("switched output to {:?}", device);
+      self->adopt(std::move(*opened));
+    });
+}
+
+auto AudioOut::deviceRemoved(SDL_AudioDeviceID id) -> void
+{
+  if (!audio || audio->get() != id)
+    return;
+  SPDLOG_WARN("output device was removed, falling back to the default one");
+  updateDevice(Preferences::DefaultAudio);
 }
 
 auto AudioOut::ingest(Wav v, bool overlap) -> void
+{
+  queue(v, overlap);
+}
+
+auto AudioOut::ingest(Wav v, bool overlap, std::vector<VisemeCue> clipCues) -> void
+{
+  addCues(queue(v, overlap), clipCues);
+}
+
+auto AudioOut::play(SoundBank::Clip clip, bool overlap) -> void
+{
+  queue((*bank)[clip], overlap);
+}
+
+auto AudioOut::append(Wav v, std::vector<VisemeCue> clipCues) -> void
 {
   audio->lock();
-  if (overlap)
-    for (auto i = 0U; i < v.size(); ++i)
-    {
-      while (i >= buf.size())
-        buf.push_back(0);
-      buf[i] += v[i];
-    }
-  else
-    for (auto a : v)
-      buf.push_back(a);
+  const auto cursor = played.load(std::memory_order_relaxed);
+  const auto offset = voiceEnd > cursor ? voiceEnd - cursor : 0;
+  const auto queued = buf.mix(v.data(), v.size(), offset);
+  const auto start = cursor + offset;
+  voiceEnd = start + queued;
   audio->unlock();
+  if (queued < v.size())
+    SPDLOG_WARN("audio output queue is full, dropped {} samples", v.size() - queued);
+  addCues(start, clipCues);
+}
+
+auto AudioOut::addCues(uint64_t start, const std::vector<VisemeCue> &clipCues) -> void
+{
+  for (const auto &cue : clipCues)
+    cues.push_back(Cue{cue.viseme, start + cue.offset});
+  std::stable_sort(std::begin(cues), std::end(cues), [](const auto &a, const auto &b) { return a.at < b.at; });
+}
+
+// returns the value of the playback cursor at which the first sample plays
+auto AudioOut::queue(std::span<const int16_t> v, bool overlap) -> uint64_t
+{
+  audio->lock();
+  const auto start = played.load(std::memory_order_relaxed) + (overlap ? 0 : buf.size());
+  const auto queued = overlap ? buf.mix(v.data(), v.size()) : buf.append(v.data(), v.size());
+  voiceEnd = start + queued;
+  audio->unlock();
+  if (queued < v.size())
+    SPDLOG_WARN("audio output queue is full, dropped {} samples", v.size() - queued);
+  return start;
+}
+
+auto AudioOut::poll() -> void
+{
+  const auto cursor = played.load(std::memory_order_acquire);
+  auto due = std::begin(cues);
+  while (due != std::end(cues) && due->at <= cursor)
+    ++due;
+  if (due == std::begin(cues))
+    return;
+  // only the newest cue that is due matters when several came due within one frame
+  const auto v = std::prev(due)->viseme;
+  cues.erase(std::begin(cues), due);
+  for (auto sink : sinks)
+    sink.get().ingest(v);
+}
+
+auto AudioOut::reg(VisemesSink &v) -> void
+{
+  sinks.push_back(v);
+}
+
+auto AudioOut::unreg(VisemesSink &v) -> void
+{
+  sinks.erase(
+    std::remove_if(std::begin(sinks), std::end(sinks), [&](const auto &x) { return &x.get() == &v; }),
+    std::end(sinks));
 }
 
 auto AudioOut::sampleRate() const -> int
 {
-  return want.freq;
+  return deviceRate;
 }
 
 void AudioOut::callback(unsigned char *stream, int len)
@@ -53,24 +170,43 @@ void AudioOut::callback(unsigned char *stream, int len)
   std::size_t const stream_len = len / sizeof(int16_t);
   auto const stream_begin = reinterpret_cast<int16_t *>(stream);
   auto const stream_end = stream_begin + stream_len;
-  auto const to_copy = std::min(stream_len, buf.size());
 
-  std::fill(std::copy_n(buf.cbegin(), to_copy, stream_begin), stream_end, 0);
-  buf.erase(buf.begin(), buf.begin() + to_copy);
+  const auto n = buf.read(stream_begin, stream_len);
+  played.fetch_add(n, std::memory_order_release);
+  std::fill(stream_begin + n, stream_end, 0);
 }
 
-std::unique_ptr<sdl::Audio> AudioOut::makeDevice(const std::string &device)
+auto AudioOut::makeDevice(const std::string &name, SDL_AudioSpec spec, int allowedChanges) -> Opened
 {
   SDL_AudioSpec have;
   auto ret = std::make_unique<sdl::Audio>(
-    device != Preferences::DefaultAudio ? device.c_str() : nullptr,
+    name != Preferences::DefaultAudio ? name.c_str() : nullptr,
     0,
-    &want,
+    &spec,
     &have,
-    0,
+    allowedChanges,
     std::bind_front(&AudioOut::callback, this));
-  if (have.format != want.format)
+  if (have.format != spec.format)
     throw std::runtime_error("Failed to get the desired AudioSpec");
-  ret->pause(0);
-  return ret;
+  return Opened{std::move(ret), have.freq};
+}
+
+auto AudioOut::adopt(Opened v) -> void
+{
+  if (v.rate != want.freq)
+    SPDLOG_INFO("output device runs at {} Hz", v.rate);
+  deviceRate = v.rate;
+  // the old device is paused before the new one starts, so only one callback ever reads the
+  // queue; pausing waits for a callback in progress to return
+  if (audio)
+    audio->pause(1);
+  std::swap(audio, v.audio);
+  audio->pause(0);
+  if (v.audio)
+    close(std::move(v.audio));
+}
+
+auto AudioOut::close(std::unique_ptr<sdl::Audio> v) -> void
+{
+  devices.get().queue([old = std::move(v)]() mutable { old = nullptr; }, nullptr);
 }
@@ -1,32 +1,91 @@
 #pragma once
-#include <deque>
 #include <memory>
 #include <string>
 
 #include <sdlpp/sdlpp.hpp>
 
+#include "audio-devices.hpp"
 #include "audio-sink.hpp"
+#include "playback-ring.hpp"
 #include "shared_from_this.hpp"
+#include "uv.hpp"
+#include "visemes-sink.hpp"
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
 
 class AudioOut final : public AudioSink, public virtual enable_shared_from_this
 {
 public:
-  AudioOut(const std::string &device, int sampleRate = 44100, int frameSize = 1024);
+  AudioOut(AudioDevices &, const std::string &device, int sampleRate = 44100, int frameSize = 1024);
   AudioOut(AudioOut const &) = delete;
   AudioOut(AudioOut &&) = delete;
 
   AudioOut operator=(AudioOut const &) = delete;
   AudioOut operator=(AudioOut &&) = delete;
+  ~AudioOut();
 
+  // opens the device on the AudioDevices thread and switches over once it is open, the main loop
+  // never waits for the driver; the queued audio carries on from the new device where the old one
+  // stopped, and the old device keeps playing if the new one fails to open
   auto updateDevice(const std::string &) -> void;
+  // moves to the default device when the one playing was unplugged
+  auto deviceRemoved(SDL_AudioDeviceID) -> void;
   auto ingest(Wav, bool overlap) -> void final;
+  auto ingest(Wav, bool overlap, std::vector<VisemeCue>) -> void final;
+  auto append(Wav, std::vector<VisemeCue>) -> void final;
+  auto play(SoundBank::Clip, bool overlap) -> void final;
   auto sampleRate() const -> int final;
+  auto reg(VisemesSink &) -> void;
+  auto unreg(VisemesSink &) -> void;
+  // delivers the cues the playback cursor has reached, called by the main loop at frame start
+  auto poll() -> void;
+
+  // longest backlog of speech that can be queued at rates up to MaxDeviceRate, anything beyond is
+  // dropped
+  static constexpr auto MaxQueuedSeconds = 120;
+  static constexpr auto MaxDeviceRate = 48000;
 
 private:
+  struct Cue
+  {
+    Viseme viseme;
+    uint64_t at;
+  };
+
+  struct Opened
+  {
+    std::unique_ptr<sdl::Audio> audio;
+    int rate = 0;
+  };
+
+  std::reference_wrapper<AudioDevices> devices;
   SDL_AudioSpec want;
+  PlaybackRing buf;
+  // the rate the device actually plays at; producers resample to sampleRate() themselves, so
+  // SDL never converts
+  int deviceRate = 0;
+  // at deviceRate, which a device switch keeps
+  std::optional<SoundBank> bank;
+  // queued samples the device has played so far, the clock the cues run on
+  std::atomic<uint64_t> played = 0;
+  // cursor value right after the last queued sample of the clip queued last
+  uint64_t voiceEnd = 0;
+  std::vector<Cue> cues;
+  std::vector<std::reference_wrapper<VisemesSink>> sinks;
   std::unique_ptr<sdl::Audio> audio;
-  std::deque<int16_t> buf;
+  // the latest device asked for, an open that finishes after a newer request is thrown away
+  uint64_t swapSeq = 0;
+  std::shared_ptr<AudioOut *> alive;
 
   void callback(unsigned char *, int);
-  std::unique_ptr<sdl::Audio> makeDevice(const std::string &device);
+  auto queue(std::span<const int16_t>, bool overlap) -> uint64_t;
+  auto addCues(uint64_t start, const std::vector<VisemeCue> &) -> void;
+  // opens the device paused, safe on any thread
+  auto makeDevice(const std::string &name, SDL_AudioSpec spec, int allowedChanges) -> Opened;
+  auto adopt(Opened) -> void;
+  // closing can block on the driver as long as opening, so it is done on the device thread as well
+  auto close(std::unique_ptr<sdl::Audio>) -> void;
 };
@@ -1,11 +1,21 @@
 #pragma once
 
+#include "sound-bank.hpp"
+#include "viseme-cue.hpp"
 #include "wav.hpp"
+#include <vector>
 
 class AudioSink
 {
 public:
   virtual ~AudioSink() = default;
   virtual auto ingest(Wav, bool overlap = true) -> void = 0;
+  // same as ingest(), the cues are delivered when playback reaches them
+  virtual auto ingest(Wav, bool overlap, std::vector<VisemeCue>) -> void = 0;
+  // continues the clip queued last right where it ends, for speech that arrives in pieces; if
+  // playback already caught up the piece starts right away
+  virtual auto append(Wav, std::vector<VisemeCue>) -> void = 0;
+  // mixes a clip of the sink's bank into the output, with no Wav made for it
+  virtual auto play(SoundBank::Clip, bool overlap = true) -> void = 0;
   virtual auto sampleRate() const -> int = 0;
 };
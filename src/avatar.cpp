@@ -0,0 +1,87 @@
+#include "avatar.hpp"
+#include "file.hpp"
+#include "version.hpp"
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+
+Avatar::Avatar(VisemesSource &mic, const Registrar &registrar, std::string aName)
+  : name_(std::move(aName)), route(mic), output(true, fmt::format("{}-{}", FrameOutput::RingName, name_))
+{
+  registrar(factory, undo, route);
+}
+
+auto Avatar::load(const std::filesystem::path &p) -> bool
+{
+  const auto file = MappedFile{p};
+  if (!file)
+    return false;
+  IStrm strm(file.data(), file.data() + file.size());
+  uint32_t v;
+  ::deser(strm, v);
+  if (v != saveVersion())
+  {
+    SPDLOG_INFO("{:?}: version mismatch expected: {} received: {}", p, saveVersion(), v);
+    return false;
+  }
+  auto muted = false;
+  ::deser(strm, muted);
+  std::string className;
+  std::string name;
+  ::deser(strm, className);
+  ::deser(strm, name);
+  try
+  {
+    root = factory.ctor(className, name);
+    root->loadAll(factory, strm);
+  }
+  catch (std::runtime_error &e)
+  {
+    SPDLOG_ERROR("{:?}: {:t}", p, e);
+    root = nullptr;
+    return false;
+  }
+  route.mute(muted);
+  return true;
+}
+
+auto Avatar::render(glm::ivec2 size, float dt) -> void
+{
+  if (!root)
+    return;
+  output.begin(size);
+  root->renderAll(dt, nullptr, nullptr);
+  output.end(false);
+}
+
+auto Avatar::mute(bool v) -> void
+{
+  route.mute(v);
+}
+
+auto Avatar::snapshot() const -> std::string
+{
+  return root ? snapshot(*root, route.isMuted()) : std::string{};
+}
+
+auto Avatar::path(const std::string &name) -> std::filesystem::path
+{
+  return name + Extension;
+}
+
+auto Avatar::nameOf(const std::filesystem::path &p) -> std::string
+{
+  const auto file = p.filename().string();
+  const auto ext = std::string_view{Extension};
+  if (file.size() <= ext.size() || !file.ends_with(ext))
+    return {};
+  return file.substr(0, file.size() - ext.size());
+}
+
+auto Avatar::snapshot(const Node &scene, bool muted) -> std::string
+{
+  OStrm strm;
+  ::ser(strm, saveVersion());
+  ::ser(strm, muted);
+  scene.saveAll(strm);
+  return strm.str();
+}
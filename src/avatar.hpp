@@ -0,0 +1,53 @@
+#pragma once
+#include "frame-output.hpp"
+#include "node.hpp"
+#include "save-factory.hpp"
+#include "undo.hpp"
+#include "viseme-route.hpp"
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+
+// One more character of a collab stream, drawn by the same App as the project's scene: it shares
+// Lib's textures, fonts and connections, the capture and the recognizer, and has its own scene,
+// its own shared memory output and a mic that can be muted on its own. The scene is a snapshot
+// of the project's taken with "Save Scene as Avatar" and kept next to prj.tpp; it is played, not
+// edited, here.
+class Avatar
+{
+public:
+  // registers the node types on the avatar's own factory, bound to its undo and its route
+  using Registrar = std::function<auto(SaveFactory &, Undo &, VisemesSource &)->void>;
+
+  Avatar(VisemesSource &mic, const Registrar &, std::string name);
+  Avatar(const Avatar &) = delete;
+  auto name() const -> const std::string & { return name_; }
+  // false when the file is missing or from another version
+  auto load(const std::filesystem::path &) -> bool;
+  auto render(glm::ivec2 size, float dt) -> void;
+  auto isWatched() -> bool { return output.isRead(); }
+  auto isMuted() const -> bool { return route.isMuted(); }
+  auto mute(bool) -> void;
+  auto ringName() const -> const std::string & { return output.ringName(); }
+  // what the file holds, taken on the main thread for a worker to write
+  auto snapshot() const -> std::string;
+
+  // the file of an avatar next to prj.tpp
+  static auto path(const std::string &name) -> std::filesystem::path;
+  // the avatar the file holds, empty when it is not one
+  static auto nameOf(const std::filesystem::path &) -> std::string;
+  // the scene of a project written as an avatar
+  static auto snapshot(const Node &scene, bool muted) -> std::string;
+
+  static constexpr auto Extension = ".avatar.tpp";
+
+private:
+  std::string name_;
+  // nothing edits the scene, but its nodes record their changes somewhere
+  Undo undo;
+  VisemeRoute route;
+  SaveFactory factory;
+  FrameOutput output;
+  std::unique_ptr<Node> root;
+};
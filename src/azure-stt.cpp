@@ -1,156 +1,308 @@
 #include "azure-stt.hpp"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <sstream>
+#include <string_view>
 
 #include <fmt/std.h>
-#include <rapidjson/document.h>
 #include <spdlog/spdlog.h>
 
 #include "azure-token.hpp"
 #include "http-client.hpp"
+#include "json-fields.hpp"
+#include "resampler.hpp"
 #include "save-wav.hpp"
 
 AzureStt::AzureStt(uv::Uv &uv, AzureToken &aToken, HttpClient &aHttpClient)
-  : timer(uv.createTimer()), token(aToken), httpClient(aHttpClient)
+  : timer(uv.createTimer()), watchdog(uv.createTimer()), token(aToken), httpClient(aHttpClient)
 {
-  process();
 }
 
 auto AzureStt::process() -> void
 {
-  if (state == State::waiting)
+  if (fetchingToken || queue.empty() || inFlight.size() >= MaxInFlight)
     return;
-  if (queue.empty())
+  if (Clock::now() < retryAt)
   {
-    state = State::idle;
+    wake();
     return;
   }
-  state = State::waiting;
+  fetchingToken = true;
   token.get().get([alive = weak_self()](const std::string &t, const std::string &err) {
     if (auto self = alive.lock())
     {
+      self->fetchingToken = false;
       if (t.empty())
       {
         self->lastError = err;
-        self->timer.start([alive]() {
-          if (auto self = alive.lock())
-          {
-            self->state = State::idle;
-            self->process();
-          }
-          else
-          {
-            SPDLOG_INFO("this was destroyed");
-          }
-        });
+        self->retryAt = Clock::now() + RetryDelay;
+        self->wake();
         return;
       }
-      self->queue.front()(t, [alive](bool r) {
-        if (auto self = alive.lock())
-        {
-          self->timer.start([alive, r]() {
-            if (auto self = alive.lock())
-            {
-              if (r)
-                self->queue.pop();
-              self->state = State::idle;
-              self->process();
-            }
-            else
-
-            {
-              SPDLOG_INFO("this was destroyed");
-            }
-          });
-        }
-        else
-        {
-          SPDLOG_INFO("this was destroyed");
-        }
-      });
+      while (!self->queue.empty() && self->inFlight.size() < MaxInFlight)
+      {
+        auto s = std::move(self->queue.front());
+        self->queue.pop_front();
+        if (s->resolved)
+          continue;
+        self->send(std::move(s), t);
+      }
     }
     else
-
     {
       SPDLOG_INFO("this was destroyed");
     }
   });
 }
 
-auto AzureStt::perform(Wav wav, int sampleRate, Callback cb) -> void
+auto AzureStt::wake() -> void
 {
-  auto dur = 1.f * wav.size() / sampleRate;
-  total += dur;
-  SPDLOG_INFO("Azure {} seconds, total: {} minutes {} seconds", dur, std::floor(total / 60.f), static_cast<int>(total) % 60);
-  queue.emplace([cb = std::move(cb), sampleRate, alive = weak_self(), wav = std::move(wav)](
-                  const std::string &t, PostTask postTask) mutable {
-    if (auto self = alive.lock())
-    {
-      std::ostringstream ss;
-      saveWav(ss, wav, sampleRate);
-      self->httpClient.get().post(
-        "https://eastus.stt.speech.microsoft.com/speech/recognition/conversation/cognitiveservices/"
-        "v1?language=en-US",
-        ss.str(),
-        [cb = std::move(cb), postTask = std::move(postTask), alive](
-          CURLcode code, long httpStatus, std::string payload) mutable {
-          if (auto self = alive.lock())
-          {
-            if (code != CURLE_OK)
-            {
-              cb("");
-              postTask(false);
-              return;
-            }
-            if (httpStatus == 401)
-            {
-              SPDLOG_INFO("{} {}", curl_easy_strerror(code), httpStatus);
-              self->token.get().clear();
-              cb("");
-              postTask(false);
-              return;
-            }
-            if (httpStatus >= 400 && httpStatus < 500)
-            {
-              SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-              self->lastError = payload;
-              cb("");
-              postTask(true);
-              return;
-            }
-            if (httpStatus != 200)
-            {
-              SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-              self->lastError = payload;
-              cb("");
-              self->timer.start([postTask = std::move(postTask)]() mutable { postTask(false); }, 10'000);
-              return;
-            }
-
-            self->lastError = "";
-            rapidjson::Document document;
-            document.Parse(payload.data(), payload.size());
-            // {"RecognitionStatus":"Success","Offset":600000,"Duration":30000000,"DisplayText":"What do you think about it?"}
-            auto const &display_text = document["DisplayText"];
-            cb(std::string_view{display_text.GetString(), display_text.GetStringLength()});
-            postTask(true);
-          }
-          else
-          {
-            SPDLOG_INFO("this was destroyed");
-          }
-        },
-        {{"Accept", ""},
-         {"User-Agent", "curl/7.68.0"},
-         {"Authorization", "Bearer " + t},
-         {"Content-Type", "audio/wav"}});
-    }
-    else
+  const auto now = Clock::now();
+  const auto delay = retryAt > now ? std::chrono::duration_cast<std::chrono::milliseconds>(retryAt - now).count() : 0;
+  timer.start(
+    [alive = weak_self()]() {
+      if (auto self = alive.lock())
+        self->process();
+      else
+        SPDLOG_INFO("this was destroyed");
+    },
+    static_cast<uint64_t>(delay));
+}
+
+namespace
+{
+  constexpr auto Path = "/speech/recognition/conversation/cognitiveservices/v1?language=en-US";
 
+  auto appendPcm(std::string &out, std::span<const int16_t> wav) -> void
+  {
+    out.reserve(out.size() + wav.size() * 2);
+    for (auto v : wav)
     {
-      SPDLOG_INFO("this was destroyed");
+      out.push_back(static_cast<char>(static_cast<uint16_t>(v) & 0xff));
+      out.push_back(static_cast<char>(static_cast<uint16_t>(v) >> 8));
     }
+  }
+} // namespace
+
+auto AzureStt::headers(const std::string &t) -> HttpClient::Headers
+{
+  return {{"Accept", ""},
+          {"User-Agent", "curl/7.68.0"},
+          {"Authorization", "Bearer " + t},
+          {"Content-Type", "audio/wav"}};
+}
+
+auto AzureStt::send(std::shared_ptr<Stream> s, const std::string &t) -> void
+{
+  if (inFlight.empty())
+    watchdog.start(
+      [alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->checkTimeouts();
+        else
+          SPDLOG_INFO("this was destroyed");
+      },
+      1'000,
+      1'000);
+  inFlight.push_back(s);
+  // a retry sends everything recorded so far again
+  s->upload = httpClient.get().upload(
+    token.get().endpoint("stt") + Path,
+    [s, generation = s->generation, alive = weak_self()](CURLcode code, long httpStatus, std::string payload) {
+      auto self = alive.lock();
+      if (!self)
+      {
+        SPDLOG_INFO("this was destroyed");
+        return;
+      }
+      // abandoned by a timeout or a cancel, the request was already taken care of
+      if (generation != s->generation || s->resolved)
+        return;
+      s->upload = std::nullopt;
+      std::erase(self->inFlight, s);
+      self->wake();
+      self->onResponse(code, httpStatus, std::move(payload), std::move(s));
+    },
+    headers(t));
+  s->upload->write(s->body);
+  if (s->finished)
+  {
+    s->upload->finish();
+    s->sentAt = Clock::now();
+  }
+}
+
+auto AzureStt::onResponse(CURLcode code, long httpStatus, std::string payload, std::shared_ptr<Stream> s) -> void
+{
+  if (code != CURLE_OK)
+  {
+    SPDLOG_INFO("{}", curl_easy_strerror(code));
+    retry(std::move(s));
+    return;
+  }
+  if (httpStatus == 401)
+  {
+    SPDLOG_INFO("{} {}", curl_easy_strerror(code), httpStatus);
+    token.get().clear();
+    retry(std::move(s));
+    return;
+  }
+  if (httpStatus >= 400 && httpStatus < 500)
+  {
+    SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
+    lastError = payload;
+    resolve(*s, "");
+    return;
+  }
+  if (httpStatus != 200)
+  {
+    SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
+    lastError = payload;
+    retryAt = Clock::now() + RetryDelay;
+    retry(std::move(s));
+    return;
+  }
+
+  lastError = "";
+  token.get().reportLatency(AzureToken::Service::stt, Clock::now() - s->sentAt);
+  const auto dur = static_cast<float>(s->samples) / UploadRate;
+  total += dur;
+  SPDLOG_INFO("Azure {} seconds, total: {} minutes {} seconds", dur, std::floor(total / 60.f), static_cast<int>(total) % 60);
+  // {"RecognitionStatus":"Success","Offset":600000,"Duration":30000000,"DisplayText":"What do you think about it?"}
+  // silence comes back as {"RecognitionStatus":"NoMatch",...} without the text
+  static const auto response = JsonFields{"", {"DisplayText"}};
+  auto displayText = std::string{};
+  response.parse(payload, [&](auto values) {
+    displayText = values[0];
+    return false;
   });
+  resolve(*s, std::move(displayText));
+}
+
+auto AzureStt::retry(std::shared_ptr<Stream> s) -> void
+{
+  if (++s->attempts >= MaxAttempts)
+  {
+    SPDLOG_ERROR("Azure STT gave up after {} attempts", s->attempts);
+    resolve(*s, "");
+    return;
+  }
+  // ahead of the newer requests, its transcript is the next one due
+  queue.push_front(std::move(s));
+  process();
+}
+
+auto AzureStt::cancel(Stream &s) -> void
+{
+  ++s.generation;
+  if (s.upload)
+  {
+    s.upload->abort();
+    s.upload = std::nullopt;
+  }
+  if (std::erase_if(inFlight, [&s](const auto &v) { return v.get() == &s; }) > 0)
+    wake();
+  resolve(s, std::nullopt);
+}
+
+auto AzureStt::resolve(Stream &s, std::optional<std::string> txt) -> void
+{
+  if (s.resolved)
+    return;
+  s.resolved = true;
+  results.emplace(s.turn, std::pair{std::move(s.cb), std::move(txt)});
+  for (auto it = results.find(playhead); it != std::end(results); it = results.find(playhead))
+  {
+    // taken out before the call, the callback may start a new request or cancel one
+    auto [cb, ready] = std::move(it->second);
+    results.erase(it);
+    ++playhead;
+    if (ready && cb)
+      cb(*ready);
+  }
+}
+
+auto AzureStt::checkTimeouts() -> void
+{
+  if (inFlight.empty())
+  {
+    watchdog.stop();
+    return;
+  }
+  const auto now = Clock::now();
+  auto timedOut = std::vector<std::shared_ptr<Stream>>{};
+  for (const auto &s : inFlight)
+    if (s->finished && now > s->sentAt + RequestTimeout)
+      timedOut.push_back(s);
+  for (auto &s : timedOut)
+  {
+    SPDLOG_INFO("Azure STT request timed out");
+    ++s->generation;
+    s->upload->abort();
+    s->upload = std::nullopt;
+    std::erase(inFlight, s);
+    retry(std::move(s));
+  }
+}
+
+AzureStt::Stream::Stream(std::weak_ptr<AzureStt> aOwner, int sampleRate, Callback aCb, uint64_t aTurn)
+  : owner(std::move(aOwner)), resampler(sampleRate, UploadRate), cb(std::move(aCb)), turn(aTurn)
+{
+  std::ostringstream ss;
+  saveWavHeader(ss, UploadRate);
+  body = std::move(ss).str();
+}
+
+auto AzureStt::Stream::push(std::span<const int16_t> wav) -> void
+{
+  if (finished || cancelled)
+    return;
+  auto tmp = Wav{};
+  resampler.process(wav, tmp);
+  send(tmp);
+}
+
+auto AzureStt::Stream::finish() -> void
+{
+  if (finished || cancelled)
+    return;
+  auto tmp = Wav{};
+  resampler.flush(tmp);
+  send(tmp);
+  finished = true;
+  if (upload)
+  {
+    upload->finish();
+    sentAt = Clock::now();
+  }
+}
+
+auto AzureStt::Stream::cancel() -> void
+{
+  if (cancelled || resolved)
+    return;
+  cancelled = true;
+  if (auto self = owner.lock())
+    self->cancel(*this);
+  else if (upload)
+    upload->abort();
+}
+
+auto AzureStt::Stream::send(std::span<const int16_t> wav) -> void
+{
+  samples += wav.size();
+  const auto from = body.size();
+  appendPcm(body, wav);
+  if (upload)
+    upload->write(std::string_view{body}.substr(from));
+}
+
+auto AzureStt::stream(int sampleRate, Callback cb, Callback) -> std::shared_ptr<SttBackend::Stream>
+{
+  auto ret = std::shared_ptr<Stream>(new Stream{weak_self(), sampleRate, std::move(cb), nextTurn++});
+  queue.push_back(ret);
   process();
+  return ret;
 }
@@ -1,35 +1,99 @@
 #pragma once
+#include <chrono>
+#include <deque>
 #include <functional>
-#include <queue>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string>
+#include <vector>
 
+#include "http-client.hpp"
+#include "resampler.hpp"
 #include "shared_from_this.hpp"
+#include "stt-backend.hpp"
 #include "uv.hpp"
 #include "wav.hpp"
 
-class AzureStt : public virtual enable_shared_from_this
+// Recognition by the Azure speech service, the transcript of a stream is requested while the
+// speaker is still talking. No partial results, the REST endpoint only has the final one.
+class AzureStt final : public SttBackend, public virtual enable_shared_from_this
 {
 public:
-  using Callback = std::move_only_function<void(std::string_view)>;
+  using Clock = std::chrono::steady_clock;
   AzureStt(uv::Uv &, class AzureToken &, class HttpClient &);
-  auto perform(Wav, int sampleRate, Callback) -> void;
 
-  std::string lastError;
+  // Recognition request that is opened right away and fed while the speaker is still talking,
+  // so the transcript is back shortly after finish(). Transcripts are delivered in the order the
+  // requests were made.
+  class Stream final : public SttBackend::Stream
+  {
+  public:
+    auto push(std::span<const int16_t>) -> void final;
+    auto finish() -> void final;
+    auto cancel() -> void final;
+    auto done() const -> bool final { return resolved; }
 
-private:
-  enum class State {
-    idle,
-    waiting
+  private:
+    friend class AzureStt;
+    Stream(std::weak_ptr<AzureStt>, int sampleRate, Callback, uint64_t turn);
+    auto send(std::span<const int16_t>) -> void;
+
+    std::weak_ptr<AzureStt> owner;
+    Resampler resampler;
+    Callback cb;
+    uint64_t turn;
+    // everything recorded so far, a retry has to send it again
+    std::string body;
+    size_t samples = 0;
+    std::optional<HttpClient::Upload> upload;
+    bool finished = false;
+    bool cancelled = false;
+    bool resolved = false;
+    int attempts = 0;
+    // bumped when a request is abandoned, its response is ignored if it still comes
+    uint64_t generation = 0;
+    // when the service had the whole body, the request timeout counts from here
+    Clock::time_point sentAt;
   };
-  using PostTask = std::move_only_function<void(bool)>;
-  using Task = std::move_only_function<void(const std::string &t, PostTask)>;
+  auto stream(int sampleRate, Callback, Callback onPartial = nullptr) -> std::shared_ptr<SttBackend::Stream> final;
 
+  std::string lastError;
+
+  // audio is uploaded at this rate whatever rate it was recorded at
+  static constexpr auto UploadRate = 16000;
+  // recognitions running at once, one stalled on the network does not hold up the next
+  static constexpr auto MaxInFlight = size_t{3};
+  // a response slower than this after the upload completed is aborted and retried
+  static constexpr auto RequestTimeout = std::chrono::seconds{10};
+  static constexpr auto MaxAttempts = 3;
+  // wait after the service failed before any new request
+  static constexpr auto RetryDelay = std::chrono::seconds{10};
+
+private:
   uv::Timer timer;
+  uv::Timer watchdog;
   std::reference_wrapper<AzureToken> token;
   std::reference_wrapper<HttpClient> httpClient;
-  std::queue<Task> queue;
-  State state = State::idle;
+  std::deque<std::shared_ptr<Stream>> queue;
+  std::vector<std::shared_ptr<Stream>> inFlight;
+  bool fetchingToken = false;
+  Clock::time_point retryAt;
+  // transcripts that came back before the ones of earlier requests, nullopt for requests that
+  // were dropped
+  std::map<uint64_t, std::pair<Callback, std::optional<std::string>>> results;
+  uint64_t playhead = 0;
+  uint64_t nextTurn = 0;
   float total = 0.f;
 
   auto process() -> void;
+  auto wake() -> void;
+  auto send(std::shared_ptr<Stream>, const std::string &token) -> void;
+  auto onResponse(CURLcode, long httpStatus, std::string payload, std::shared_ptr<Stream>) -> void;
+  auto retry(std::shared_ptr<Stream>) -> void;
+  auto cancel(Stream &) -> void;
+  auto resolve(Stream &, std::optional<std::string>) -> void;
+  auto checkTimeouts() -> void;
+  static auto headers(const std::string &token) -> HttpClient::Headers;
 };
@@ -1,63 +1,237 @@
 #include "azure-token.hpp"
 
+#include <algorithm>
+#include <memory>
 #include <spdlog/spdlog.h>
 
 #include "http-client.hpp"
 
-AzureToken::AzureToken(std::string aKey, class HttpClient &aHttpClient)
-  : key(std::move(aKey)), httpClient(aHttpClient)
+namespace
 {
+  auto issueUrl(std::string_view region) -> std::string
+  {
+    return fmt::format("https://{}.api.cognitive.microsoft.com/sts/v1.0/issuetoken", region);
+  }
+
+  // it becomes part of host names
+  auto isRegionName(std::string_view v) -> bool
+  {
+    return !v.empty() && std::ranges::all_of(v, [](char c) { return (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'); });
+  }
+} // namespace
+
+AzureToken::AzureToken(uv::Uv &uv, std::string aKey, std::string aRegion, class HttpClient &aHttpClient)
+  : key(std::move(aKey)), region_(DefaultRegion), timer(uv.createTimer()), httpClient(aHttpClient)
+{
+  updateRegion(aRegion);
+}
+
+auto AzureToken::endpoint(std::string_view service) const -> std::string
+{
+  return fmt::format("https://{}.{}.speech.microsoft.com", region_, service);
 }
 
 auto AzureToken::get(Callback cb) -> void
 {
+  const auto now = Clock::now();
+  lastUsed = now;
+  if (!token.empty() && now < expiresAt)
+  {
+    cb(token, "");
+    return;
+  }
   callbacks.emplace_back(std::move(cb));
-  if (!token.empty())
+  fetch();
+}
+
+auto AzureToken::fetch() -> void
+{
+  if (fetching)
+    return;
+  if (setting == Auto && probedRegion.empty() &&
+      (probedAt == Clock::time_point{} || Clock::now() >= probedAt + ProbeRetry))
   {
-    for (auto &lCb : callbacks)
-      lCb(token, "");
-    callbacks.clear();
+    probe();
     return;
   }
+  fetching = true;
   httpClient.get().post(
-    "https://eastus.api.cognitive.microsoft.com/sts/v1.0/issuetoken",
+    issueUrl(region_),
     "",
-    [alive = weak_self()](CURLcode code, long httpStatus, std::string payload) {
+    [alive = weak_self(), generation = generation](CURLcode code, long httpStatus, std::string payload) {
       if (auto self = alive.lock())
       {
+        self->fetching = false;
+        if (generation != self->generation)
+        {
+          // the key changed or the token was rejected meanwhile, this one is stale
+          self->fetch();
+          return;
+        }
         if (code != CURLE_OK)
         {
           SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-          for (auto &lCb : self->callbacks)
-            lCb("", std::string{"CURL Error: "} + curl_easy_strerror(code));
-          self->callbacks.clear();
+          self->onFetched("", std::string{"CURL Error: "} + curl_easy_strerror(code));
           return;
         }
         if (httpStatus != 200)
         {
           SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-          for (auto &lCb : self->callbacks)
-            lCb("", "HTTP Status: " + std::to_string(httpStatus) + " " + payload);
-          self->callbacks.clear();
+          self->onFetched("", "HTTP Status: " + std::to_string(httpStatus) + " " + payload);
           return;
         }
-        self->token = std::move(payload);
-        for (auto &lCb : self->callbacks)
-          lCb(self->token, "");
-        self->callbacks.clear();
+        self->onFetched(std::move(payload), "");
       }
       else
+      {
+        SPDLOG_INFO("this was destroyed");
+      }
+    },
+    {{"Ocp-Apim-Subscription-Key", key}, {"Expect", ""}},
+    // a refresh ahead of expiry has nobody waiting on it
+    callbacks.empty() ? HttpClient::Priority::background : HttpClient::Priority::interactive);
+}
 
+auto AzureToken::probe() -> void
+{
+  fetching = true;
+  probedAt = Clock::now();
+  struct Probe
+  {
+    size_t left = Regions.size();
+    bool isDone = false;
+    std::string err;
+  };
+  auto state = std::make_shared<Probe>();
+  for (const auto *r : Regions)
+    // interactive, so every region starts at once and the key's own region answers without waiting
+    // for the others to refuse it
+    httpClient.get().post(
+      issueUrl(r),
+      "",
+      [alive = weak_self(), generation = generation, state, name = std::string{r}, start = Clock::now()](
+        CURLcode code, long httpStatus, std::string payload) {
+        --state->left;
+        if (state->isDone)
+          return;
+        auto self = alive.lock();
+        if (!self)
+        {
+          SPDLOG_INFO("this was destroyed");
+          return;
+        }
+        if (generation != self->generation)
+        {
+          state->isDone = true;
+          self->fetching = false;
+          self->fetch();
+          return;
+        }
+        if (code == CURLE_OK && httpStatus == 200)
+        {
+          state->isDone = true;
+          self->onProbed(name, Clock::now() - start, std::move(payload));
+          return;
+        }
+        // a key from another region is refused with a 401, the error of the last one is kept
+        state->err = code != CURLE_OK ? std::string{"CURL Error: "} + curl_easy_strerror(code)
+                                      : "HTTP Status: " + std::to_string(httpStatus) + " " + payload;
+        if (state->left > 0)
+          return;
+        SPDLOG_INFO("No Azure region issued a token: {}", state->err);
+        state->isDone = true;
+        self->fetching = false;
+        // the current region stays, the fetches until ProbeRetry ask it alone
+        self->onFetched("", state->err);
+      },
+      {{"Ocp-Apim-Subscription-Key", key}, {"Expect", ""}});
+}
+
+auto AzureToken::onProbed(std::string aRegion, Clock::duration rtt, std::string aToken) -> void
+{
+  fetching = false;
+  SPDLOG_INFO("Azure key is for region {}, which answered in {} ms",
+              aRegion,
+              std::chrono::duration_cast<std::chrono::milliseconds>(rtt).count());
+  probedRegion = aRegion;
+  if (aRegion != region_)
+  {
+    region_ = std::move(aRegion);
+    latencies = {};
+  }
+  onFetched(std::move(aToken), "");
+}
+
+auto AzureToken::reportLatency(Service service, Clock::duration v) -> void
+{
+  auto &l = latencies[static_cast<size_t>(service)];
+  l.average = l.reports == 0 ? v : (l.average * 7 + v) / 8;
+  if (++l.reports < WarmupReports)
+    return;
+  if (l.reports == WarmupReports || l.average < l.baseline)
+    l.baseline = l.average;
+  const auto now = Clock::now();
+  if (l.average < l.baseline * DegradeFactor || l.average - l.baseline < DegradeMin ||
+      (l.loggedAt != Clock::time_point{} && now < l.loggedAt + DegradeInterval))
+    return;
+  l.loggedAt = now;
+  // the key works in this region alone, so there is nowhere to move to
+  SPDLOG_WARN("Azure {} requests to {} slowed down from {} to {} ms",
+              service == Service::tts ? "TTS" : "STT",
+              region_,
+              std::chrono::duration_cast<std::chrono::milliseconds>(l.baseline).count(),
+              std::chrono::duration_cast<std::chrono::milliseconds>(l.average).count());
+}
+
+auto AzureToken::onFetched(std::string aToken, const std::string &err) -> void
+{
+  const auto now = Clock::now();
+  if (aToken.empty())
+  {
+    // a background refresh that failed leaves the current token in use until it expires
+    if (!token.empty() && now + RefreshRetry < expiresAt)
+      scheduleRefresh(RefreshRetry);
+    else
+      token.clear();
+  }
+  else
+  {
+    token = std::move(aToken);
+    expiresAt = now + Lifetime;
+    scheduleRefresh(Lifetime - RefreshMargin);
+  }
+  // the callbacks may ask for a token again, that goes to the next fetch
+  auto tmp = std::move(callbacks);
+  callbacks.clear();
+  for (auto &cb : tmp)
+    cb(token, token.empty() ? err : "");
+}
+
+auto AzureToken::scheduleRefresh(Clock::duration delay) -> void
+{
+  timer.start(
+    [alive = weak_self()]() {
+      if (auto self = alive.lock())
+      {
+        // nobody asked for a token for a whole lifetime, let it expire instead of polling forever
+        if (Clock::now() > self->lastUsed + Lifetime)
+          return;
+        self->fetch();
+      }
+      else
       {
         SPDLOG_INFO("this was destroyed");
       }
     },
-    {{"Ocp-Apim-Subscription-Key", key}, {"Expect", ""}});
+    static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(delay).count()));
 }
 
 auto AzureToken::clear() -> void
 {
   token.clear();
+  ++generation;
+  if (!key.empty())
+    fetch();
 }
 
 auto AzureToken::updateKey(const std::string &k) -> void
@@ -66,4 +240,26 @@ auto AzureToken::updateKey(const std::string &k) -> void
     return;
   key = k;
   token.clear();
+  ++generation;
+  // the key may be for another region
+  probedRegion.clear();
+  probedAt = {};
+}
+
+auto AzureToken::updateRegion(const std::string &v) -> void
+{
+  if (v == setting)
+    return;
+  if (v != Auto && !isRegionName(v))
+  {
+    SPDLOG_ERROR("{:?} is not an Azure region", v);
+    return;
+  }
+  setting = v;
+  if (setting != Auto)
+    region_ = setting;
+  else if (!probedRegion.empty())
+    region_ = probedRegion;
+  token.clear();
+  ++generation;
 }
@@ -1,22 +1,115 @@
 #pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "shared_from_this.hpp"
+#include "uv.hpp"
 
+// Azure speech access token. Tokens are valid for ten minutes; while the services are in use a
+// new one is fetched in the background before the old one runs out, so a speech request only
+// waits for auth on the first call or after a 401. Concurrent get() calls share one fetch.
+//
+// The token is issued by one region and only works there, so the services ask for their
+// endpoint here. A key belongs to the region of the Speech resource it was created for, and every
+// other region refuses it; in the Auto mode the first fetch for a key asks every candidate region
+// at once and keeps the one that issues the token. That is done once per key, as no other region
+// can answer it later; only a probe that no region answered is tried again. The services report
+// how long their requests take, each against a baseline of its own, and a region that degrades
+// well past what it started with is logged.
 class AzureToken : public virtual enable_shared_from_this
 {
 public:
   using Callback = std::move_only_function<auto(const std::string &token, const std::string &err)->void>;
-  AzureToken(std::string key, class HttpClient &);
+  using Clock = std::chrono::steady_clock;
+  AzureToken(uv::Uv &, std::string key, std::string region, class HttpClient &);
+  // drops a token the service rejected and starts fetching a new one right away
   auto clear() -> void;
   auto get(Callback) -> void;
   auto updateKey(const std::string &) -> void;
+  // a region name or Auto
+  auto updateRegion(const std::string &) -> void;
+  // the region the current token is for
+  auto region() const -> const std::string & { return region_; }
+  // e.g. https://westeurope.tts.speech.microsoft.com for "tts"
+  auto endpoint(std::string_view service) const -> std::string;
+  enum class Service { tts, stt };
+  // the time to the first chunk of synthesized speech or to a recognition result
+  auto reportLatency(Service, Clock::duration) -> void;
+
+  static constexpr auto Auto = "auto";
+  static constexpr auto DefaultRegion = "eastus";
+  // the public regions with the speech service that Auto picks from
+  static constexpr auto Regions = std::array{"eastus",
+                                             "eastus2",
+                                             "westus2",
+                                             "centralus",
+                                             "canadacentral",
+                                             "brazilsouth",
+                                             "northeurope",
+                                             "westeurope",
+                                             "uksouth",
+                                             "francecentral",
+                                             "germanywestcentral",
+                                             "swedencentral",
+                                             "switzerlandnorth",
+                                             "centralindia",
+                                             "southeastasia",
+                                             "eastasia",
+                                             "japaneast",
+                                             "koreacentral",
+                                             "australiaeast"};
+  // how much slower than the best average of the region the requests have to get, and by at
+  // least how much, before it is logged; not more often than DegradeInterval
+  static constexpr auto DegradeFactor = 2;
+  static constexpr auto DegradeMin = std::chrono::milliseconds{300};
+  static constexpr auto DegradeInterval = std::chrono::minutes{5};
+  // a probe that no region answered, e.g. while offline, runs again after this
+  static constexpr auto ProbeRetry = std::chrono::minutes{5};
+  // reports averaged before the region has a baseline
+  static constexpr auto WarmupReports = 3;
+
+  static constexpr auto Lifetime = std::chrono::minutes{10};
+  // the background refresh starts this long before the token expires
+  static constexpr auto RefreshMargin = std::chrono::minutes{2};
+  // a failed background refresh is tried again after this while the old token still works
+  static constexpr auto RefreshRetry = std::chrono::seconds{15};
 
 private:
   std::string key;
+  std::string setting;
+  std::string region_;
+  // the region the probe found the key in, empty until it did
+  std::string probedRegion;
+  // when the last probe started, zero while none ran for the key
+  Clock::time_point probedAt;
+  // running average of the reports and the best of it since the region was picked
+  struct Latency
+  {
+    Clock::duration average{};
+    Clock::duration baseline{};
+    int reports = 0;
+    Clock::time_point loggedAt;
+  };
+  // by Service, a first chunk of speech and a recognition result take very different times
+  std::array<Latency, 2> latencies;
+  uv::Timer timer;
   std::reference_wrapper<HttpClient> httpClient;
   std::vector<Callback> callbacks;
   std::string token;
+  Clock::time_point expiresAt;
+  Clock::time_point lastUsed;
+  bool fetching = false;
+  // bumped on clear() and key changes so a fetch started before does not store its token
+  uint64_t generation = 0;
+
+  auto fetch() -> void;
+  auto probe() -> void;
+  auto onProbed(std::string, Clock::duration, std::string token) -> void;
+  auto onFetched(std::string token, const std::string &err) -> void;
+  auto scheduleRefresh(Clock::duration) -> void;
 };
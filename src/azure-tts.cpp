@@ -2,14 +2,23 @@
 #include "audio-sink.hpp"
 #include "azure-token.hpp"
 #include "http-client.hpp"
-#include <rapidjson/document.h>
+#include "log.hpp"
+#include "ogg-opus-decoder.hpp"
+#include "resampler.hpp"
+#include "text-visemes.hpp"
+#include "tts-cache.hpp"
 #include <spdlog/spdlog.h>
+#include <utility>
 
-AzureTts::AzureTts(uv::Uv &uv,
+AzureTts::AzureTts(uv::Uv &aUv,
                    AzureToken &azureToken,
                    class HttpClient &aHttpClient,
                    class AudioSink &aAudioSink)
-  : timer(uv.createTimer()), token(azureToken), httpClient(aHttpClient), audioSink(aAudioSink)
+  : uv(aUv),
+    timer(aUv.createTimer()),
+    token(azureToken),
+    httpClient(aHttpClient),
+    audioSink(aAudioSink)
 {
   process();
 }
@@ -33,249 +42,434 @@ static std::string escape(std::string data)
   return buffer;
 }
 
-auto AzureTts::say(std::string voice, std::string msg, bool overlap) -> void
+// one attempt at speaking a message: the response is decoded and resampled on a uv worker and
+// buffered until it is the message's turn to play, from then on it is queued as it arrives
+struct AzureTts::Playback
 {
-  queue.emplace([msg = std::move(msg),
-                 alive = weak_self(),
-                 voice = std::move(voice),
-                 overlap](std::string_view t, PostTask postTask) {
-    if (auto self = alive.lock())
-    {
-      auto xml = R"(<speak version="1.0" xml:lang="en-us"><voice xml:lang="en-US" name=")" + voice +
-                 R"("><prosody rate="0.00%">)" + escape(msg) + R"(</prosody></voice></speak>)";
-      self->httpClient.get().post(
-        "https://eastus.tts.speech.microsoft.com/cognitiveservices/v1",
-        std::move(xml),
-        [overlap, postTask = std::move(postTask), alive](
-          CURLcode code, long httpStatus, std::string payload) mutable {
-          if (auto self = alive.lock())
-          {
-            if (code != CURLE_OK)
-            {
-              postTask(false);
-              return;
-            }
-            if (httpStatus == 401)
-            {
-              SPDLOG_INFO("{} {}", curl_easy_strerror(code), httpStatus);
-              self->token.get().clear();
-              postTask(false);
-              return;
-            }
-            if (httpStatus >= 400 && httpStatus < 500)
-            {
-              SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-              self->lastError = payload;
-              postTask(true);
-              return;
-            }
-            if (httpStatus != 200)
-            {
-              SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-              self->lastError = payload;
-              self->timer.start([postTask = std::move(postTask)]() mutable { postTask(false); }, 10'000);
-              return;
-            }
+  Playback(std::string_view msg, int rate, bool aCompressed, bool aOverlap, std::string aKey)
+    : resampler(OutputRate, rate),
+      visemes(msg, rate),
+      jitter(static_cast<size_t>(rate * JitterMs / 1000)),
+      window(static_cast<size_t>(rate * TextVisemes::WindowMs / 1000)),
+      compressed(aCompressed),
+      overlap(aOverlap),
+      key(std::move(aKey)),
+      opus(aCompressed ? std::make_unique<OggOpusDecoder>(OutputRate) : nullptr)
+  {
+  }
 
-            self->lastError = "";
-            Wav wav;
-            const auto inF = 24000;
-            const auto outF = self->audioSink.get().sampleRate();
-            const auto inSz = static_cast<int>(payload.size() / sizeof(int16_t));
-            const auto outSz = static_cast<int>(static_cast<int64_t>(inSz) * outF / inF);
-            wav.resize(outSz);
-            for (auto i = 0; i < outSz; ++i)
-              wav[i] = reinterpret_cast<int16_t *>(payload.data())[static_cast<int64_t>(i) * inF / outF];
-            self->audioSink.get().ingest(std::move(wav), overlap);
-            postTask(true);
-          }
-          else
+  // runs on a uv worker, one batch at a time
+  auto decode(std::string_view bytes) -> void
+  {
+    try
+    {
+      if (opus)
+      {
+        opus->push(bytes, pcm);
+        resampler.process(pcm, decoded);
+        pcm.clear();
+        return;
+      }
+      // chunks can split a sample in two
+      carry += bytes;
+      const auto n = carry.size() / sizeof(int16_t);
+      resampler.process(std::span{reinterpret_cast<const int16_t *>(carry.data()), n}, decoded);
+      carry.erase(0, n * sizeof(int16_t));
+    }
+    catch (std::runtime_error &e)
+    {
+      SPDLOG_ERROR("{:t}", e);
+      failed = true;
+    }
+  }
 
-          {
-            SPDLOG_INFO("this was destroyed");
-          }
-        },
-        {{"Accept", ""},
-         {"User-Agent", "curl/7.68.0"},
-         {"Authorization", fmt::format("Bearer {}", t)},
-         {"Content-Type", "application/ssml+xml"},
-         {"X-Microsoft-OutputFormat", "raw-24khz-16bit-mono-pcm"}});
+  // queues what is pending, the rest of the clip once complete is set
+  auto push(AudioSink &sink) -> void
+  {
+    if (!complete && !started && pending.size() < jitter)
+      return;
+    // whole cue windows only, so the cues line up no matter how the body was chunked
+    const auto n = complete || window == 0 ? pending.size() : pending.size() - pending.size() % window;
+    if (n == 0 && !complete)
+      return;
+    auto wav = Wav(std::begin(pending), std::begin(pending) + static_cast<ptrdiff_t>(n));
+    pending.erase(std::begin(pending), std::begin(pending) + static_cast<ptrdiff_t>(n));
+    auto cues = visemes.cues(wav);
+    if (complete && (started || !cues.empty()))
+      cues.push_back(VisemeCue{Viseme::sil, wav.size()});
+    clip.insert(std::end(clip), std::begin(wav), std::end(wav));
+    if (!started)
+    {
+      sink.ingest(std::move(wav), overlap, std::move(cues));
+      if (onStart)
+        std::exchange(onStart, nullptr)();
     }
     else
+      sink.append(std::move(wav), std::move(cues));
+    started = true;
+  }
+
+  Resampler resampler;
+  // the REST endpoint has no viseme events, the cues come from the text and the audio
+  TextVisemes visemes;
+  size_t jitter;
+  size_t window;
+  bool compressed;
+  bool overlap;
+  // cache key the finished clip is stored under, empty for clips that came from the cache
+  std::string key;
+  std::unique_ptr<OggOpusDecoder> opus;
+  // owned by the worker while decoding is set
+  std::string carry;
+  Wav pcm;
+  Wav decoded;
+  bool failed = false;
+  // response bytes waiting for the worker
+  std::string backlog;
+  bool decoding = false;
+  // replaced by a retry, what its worker still decodes is dropped
+  bool superseded = false;
+  // called once the backlog is decoded after the response is complete
+  std::move_only_function<void()> onDrained;
+  Wav pending;
+  bool complete = false;
+  // everything queued so far, what goes into the cache
+  Wav clip;
+  StartCallback onStart;
+  bool started = false;
+  Clock::time_point start = Clock::now();
+  // until the first decoded audio, not counting the wait for earlier messages
+  Clock::duration firstAudio{};
+  size_t bytes = 0;
+};
 
+auto AzureTts::say(std::string voice, std::string msg, bool overlap, StartCallback onStart) -> void
+{
+  auto waiting = std::count_if(std::begin(queue), std::end(queue), [](const auto &r) { return !r->task; });
+  if (backpressure.maxQueued > 0 && waiting >= backpressure.maxQueued)
+  {
+    auto last = std::find_if(std::rbegin(queue), std::rend(queue), [](const auto &r) { return !r->task; });
+    if (backpressure.merge && last != std::rend(queue) && (*last)->voice == voice &&
+        (*last)->overlap == overlap)
     {
-      SPDLOG_INFO("this was destroyed");
+      (*last)->msg += " " + msg;
+      return;
     }
-  });
+    static auto droppedLog = Log::RateLimit{"TTS queue", 5};
+    if (droppedLog.allow())
+      SPDLOG_INFO("TTS queue is full, dropped: {}", msg);
+    return;
+  }
+  auto request = std::make_shared<Request>();
+  request->voice = std::move(voice);
+  request->msg = std::move(msg);
+  request->overlap = overlap;
+  request->onStart = std::move(onStart);
+  request->turn = nextTurn++;
+  queue.push_back(std::move(request));
   process();
 }
 
-auto AzureTts::process() -> void
+auto AzureTts::speak(std::shared_ptr<Request> request, std::string_view t, PostTask postTask) -> void
 {
-  if (state == State::waiting)
-    return;
-  if (queue.empty())
+  auto xml = R"(<speak version="1.0" xml:lang="en-us"><voice xml:lang="en-US" name=")" + request->voice +
+             R"("><prosody rate="0.00%">)" + escape(request->msg) + R"(</prosody></voice></speak>)";
+  auto key = TtsCache::key(
+    request->voice, xml, compressed ? CompressedFormat : OutputFormat, audioSink.get().sampleRate());
+  if (auto wav = cache.find(key))
   {
-    state = State::idle;
+    play(*request, *wav);
+    postTask(true);
     return;
   }
-  state = State::waiting;
-  token.get().get([alive = weak_self()](const std::string &t, const std::string &err) {
-    if (auto self = alive.lock())
-    {
-
-      if (t.empty())
+  uv.get().queue(
+    weak_self(),
+    [dir = TtsCache::dir(), key]() { return TtsCache::load(dir, key); },
+    [request, key, xml = std::move(xml), t = std::string{t}, postTask = std::move(postTask)](
+      auto &self, std::shared_ptr<const Wav> loaded) mutable {
+      self.cache.onDiskLookup(key, loaded);
+      if (loaded)
       {
-        self->lastError = err;
-        self->timer.start([alive]() {
-          if (auto self = alive.lock())
-          {
-            self->state = State::idle;
-            self->process();
-          }
-          else
-          {
-            SPDLOG_INFO("this was destroyed");
-          }
-        });
+        self.play(*request, *loaded);
+        postTask(true);
         return;
       }
-      self->queue.front()(t, [alive](bool r) {
+      self.synthesize(*request, std::move(key), std::move(xml), t, std::move(postTask));
+    });
+}
+
+auto AzureTts::play(Request &request, const Wav &wav) -> void
+{
+  auto playback = std::make_shared<Playback>(request.msg, audioSink.get().sampleRate(), false, request.overlap, "");
+  playback->onStart = std::move(request.onStart);
+  playback->pending = wav;
+  playback->complete = true;
+  turns[request.turn] = std::move(playback);
+  advance();
+}
+
+auto AzureTts::synthesize(Request &request, std::string key, std::string xml, std::string_view t, PostTask postTask)
+  -> void
+{
+  auto playback = std::make_shared<Playback>(
+    request.msg, audioSink.get().sampleRate(), compressed, request.overlap, std::move(key));
+  playback->onStart = std::move(request.onStart);
+  // a retry replaces the attempt that failed before it played anything
+  auto &slot = turns[request.turn];
+  if (slot)
+    slot->superseded = true;
+  slot = playback;
+  httpClient.get().stream(
+    token.get().endpoint("tts") + "/cognitiveservices/v1",
+    std::move(xml),
+    HttpClient::Stream{
+      .onChunk = [playback, alive = weak_self()](std::string_view chunk) {
         if (auto self = alive.lock())
         {
-          self->timer.start([alive, r]() {
-            if (auto self = alive.lock())
+          if (playback->bytes == 0)
+            self->token.get().reportLatency(AzureToken::Service::tts, Clock::now() - playback->start);
+          playback->bytes += chunk.size();
+          playback->backlog += chunk;
+          self->decodeNext(playback);
+        }
+        else
+        {
+          SPDLOG_INFO("this was destroyed");
+        }
+      },
+      .onDone = [playback, turn = request.turn, postTask = std::move(postTask), alive = weak_self()](
+        CURLcode code, long httpStatus, std::string payload) mutable {
+        if (auto self = alive.lock())
+        {
+          if (code != CURLE_OK)
+          {
+            if (playback->started)
             {
-              if (r)
-                self->queue.pop();
-              self->state = State::idle;
-              self->process();
+              // replaying the message would repeat what was already said, close the mouth and move on
+              playback->key.clear();
+              playback->complete = true;
+              self->advance();
+              postTask(true);
+              return;
             }
+            postTask(false);
+            return;
+          }
+          if (httpStatus == 401)
+          {
+            SPDLOG_INFO("{} {}", curl_easy_strerror(code), httpStatus);
+            self->token.get().clear();
+            postTask(false);
+            return;
+          }
+          if (httpStatus >= 400 && httpStatus < 500)
+          {
+            SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
+            self->lastError = fmt::format("HTTP Status: {} {}", httpStatus, payload);
+            self->skip(turn);
+            postTask(true);
+            return;
+          }
+          if (httpStatus != 200)
+          {
+            SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
+            self->lastError = fmt::format("HTTP Status: {} {}", httpStatus, payload);
+            self->retryAt = Clock::now() + RetryDelay;
+            postTask(false);
+            return;
+          }
+
+          self->lastError = "";
+          // the playback outlives its own callback, a raw pointer avoids the cycle
+          playback->onDrained = [p = playback.get(), turn, postTask = std::move(postTask), alive]() mutable {
+            if (auto self = alive.lock())
+              self->finish(*p, turn, std::move(postTask));
             else
-            {
               SPDLOG_INFO("this was destroyed");
-            }
-          });
+          };
+          self->decodeNext(playback);
         }
         else
         {
           SPDLOG_INFO("this was destroyed");
-          return;
         }
-      });
-    }
-    else
+      }},
+    {{"Accept", ""},
+     {"User-Agent", "curl/7.68.0"},
+     {"Authorization", fmt::format("Bearer {}", t)},
+     {"Content-Type", "application/ssml+xml"},
+     {"X-Microsoft-OutputFormat", compressed ? CompressedFormat : OutputFormat}});
+}
+
+auto AzureTts::decodeNext(std::shared_ptr<Playback> playback) -> void
+{
+  if (playback->decoding || playback->superseded)
+    return;
+  if (playback->backlog.empty())
+  {
+    if (playback->onDrained)
+      std::exchange(playback->onDrained, nullptr)();
+    return;
+  }
+  playback->decoding = true;
+  uv.get().queueWork([playback, bytes = std::exchange(playback->backlog, {})]() { playback->decode(bytes); },
+                     [playback, alive = weak_self()](int) {
+                       if (auto self = alive.lock())
+                       {
+                         playback->decoding = false;
+                         if (playback->superseded)
+                           return;
+                         auto &p = *playback;
+                         p.pending.insert(std::end(p.pending), std::begin(p.decoded), std::end(p.decoded));
+                         p.decoded.clear();
+                         if (p.firstAudio == Clock::duration{} && !p.pending.empty())
+                           p.firstAudio = Clock::now() - p.start;
+                         self->advance();
+                         self->decodeNext(playback);
+                       }
+                       else
+                       {
+                         SPDLOG_INFO("this was destroyed");
+                       }
+                     });
+}
+
+auto AzureTts::finish(Playback &playback, uint64_t turn, PostTask postTask) -> void
+{
+  if (playback.failed)
+  {
+    lastError = "Cannot decode the TTS audio";
+    skip(turn);
+    postTask(true);
+    return;
+  }
+  playback.resampler.flush(playback.pending);
+  playback.complete = true;
+  const auto seconds = static_cast<double>(playback.clip.size() + playback.pending.size()) / audioSink.get().sampleRate();
+  auto &stats = transport[playback.compressed ? 1 : 0];
+  ++stats.messages;
+  stats.bytes += playback.bytes;
+  stats.seconds += seconds;
+  stats.firstAudio += playback.firstAudio;
+  SPDLOG_INFO("TTS {}: {} bytes for {:.1f} s of speech, first audio after {} ms",
+              playback.compressed ? CompressedFormat : OutputFormat,
+              playback.bytes,
+              seconds,
+              std::chrono::duration_cast<std::chrono::milliseconds>(playback.firstAudio).count());
+  advance();
+  postTask(true);
+}
+
+auto AzureTts::skip(uint64_t turn) -> void
+{
+  if (turn < playhead)
+    return;
+  turns[turn] = nullptr;
+  advance();
+}
+
+auto AzureTts::advance() -> void
+{
+  for (auto it = turns.find(playhead); it != std::end(turns); it = turns.find(playhead))
+  {
+    if (auto &playback = it->second)
     {
-      SPDLOG_INFO("this was destroyed");
+      if (playback->failed)
+        return;
+      playback->push(audioSink);
+      if (!playback->complete)
+        return;
+      if (!playback->key.empty())
+      {
+        auto clip = std::make_shared<const Wav>(std::move(playback->clip));
+        cache.insert(playback->key, clip);
+        uv.get().queue([dir = TtsCache::dir(), key = playback->key, clip]() { TtsCache::store(dir, key, *clip); },
+                       []() {});
+      }
     }
-  });
+    turns.erase(it);
+    ++playhead;
+  }
+}
+
+auto AzureTts::TransportStats::kbPerSecond() const -> double
+{
+  return seconds > 0. ? static_cast<double>(bytes) / 1024. / seconds : 0.;
 }
 
-auto AzureTts::listVoices(ListVoicesCallback cb) -> void
+auto AzureTts::TransportStats::firstAudioMs() const -> double
 {
-  queue.emplace([cb = std::move(cb), alive = weak_self()](std::string_view t, PostTask postTask) mutable {
+  return messages > 0 ? std::chrono::duration<double, std::milli>(firstAudio).count() / static_cast<double>(messages) : 0.;
+}
+
+auto AzureTts::wake() -> void
+{
+  // deferred so a request that completes synchronously does not recurse into process()
+  timer.start(
+    [alive = weak_self()]() {
+      if (auto self = alive.lock())
+        self->process();
+      else
+        SPDLOG_INFO("this was destroyed");
+    },
+    static_cast<uint64_t>(std::max(Clock::duration{}, retryAt - Clock::now()) / std::chrono::milliseconds{1}));
+}
+
+auto AzureTts::process() -> void
+{
+  if (fetchingToken || inFlight >= MaxInFlight || queue.empty())
+    return;
+  if (Clock::now() < retryAt)
+  {
+    wake();
+    return;
+  }
+  fetchingToken = true;
+  token.get().get([alive = weak_self()](const std::string &t, const std::string &err) {
     if (auto self = alive.lock())
     {
-      self->httpClient.get().get(
-        "https://eastus.tts.speech.microsoft.com/cognitiveservices/voices/list",
-        [cb = std::move(cb), postTask = std::move(postTask), alive](
-          CURLcode code, long httpStatus, std::string payload) mutable {
+      self->fetchingToken = false;
+      if (t.empty())
+      {
+        self->lastError = err;
+        self->wake();
+        return;
+      }
+      while (self->inFlight < MaxInFlight && !self->queue.empty())
+      {
+        auto request = std::move(self->queue.front());
+        self->queue.pop_front();
+        if (!request->task && self->backpressure.maxAgeSec > 0 &&
+            Clock::now() - request->queued > std::chrono::seconds{self->backpressure.maxAgeSec})
+        {
+          SPDLOG_INFO("TTS message waited too long, dropped: {}", request->msg);
+          self->skip(request->turn);
+          continue;
+        }
+        ++self->inFlight;
+        auto postTask = [alive, request](bool r) {
           if (auto self = alive.lock())
           {
-            if (code != CURLE_OK)
-            {
-              cb({});
-              postTask(false);
-              return;
-            }
-            if (httpStatus == 401)
-            {
-              SPDLOG_INFO("{} {}", curl_easy_strerror(code), httpStatus);
-              self->token.get().clear();
-              cb({});
-              postTask(false);
-              return;
-            }
-            if (httpStatus != 200)
-            {
-              SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-              self->lastError = payload;
-              cb({});
-              postTask(false);
-              return;
-            }
-
-            rapidjson::Document document;
-            document.Parse(payload.data(), payload.size());
-            std::vector<std::string_view> voices;
-            for (auto const &element : document.GetArray())
-            {
-              //[
-              //  {
-              //    "Name": "Microsoft Server Speech Text to Speech Voice (af-ZA, AdriNeural)",
-              //    "DisplayName": "Adri",
-              //    "LocalName": "Adri",
-              //    "ShortName": "af-ZA-AdriNeural",
-              //    "Gender": "Female",
-              //    "Locale": "af-ZA",
-              //    "LocaleName": "Afrikaans (South Africa)",
-              //    "SampleRateHertz": "48000",
-              //    "VoiceType": "Neural",
-              //    "Status": "GA",
-              //    "WordsPerMinute": "147"
-              //  },
-              //  {
-              //    "Name": "Microsoft Server Speech Text to Speech Voice (af-ZA, WillemNeural)",
-              //    "DisplayName": "Willem",
-              //    "LocalName": "Willem",
-              //    "ShortName": "af-ZA-WillemNeural",
-              //    "Gender": "Male",
-              //    "Locale": "af-ZA",
-              //    "LocaleName": "Afrikaans (South Africa)",
-              //    "SampleRateHertz": "48000",
-              //    "VoiceType": "Neural",
-              //    "Status": "GA",
-              //    "WordsPerMinute": "155"
-              //  },
-              //  {
-              //    "Name": "Microsoft Server Speech Text to Speech Voice (am-ET, AmehaNeural)",
-              //    "DisplayName": "Ameha",
-              //    "LocalName": "አምሀ",
-              //    "ShortName": "am-ET-AmehaNeural",
-              //    "Gender": "Male",
-              //    "Locale": "am-ET",
-              //    "LocaleName": "Amharic (Ethiopia)",
-              //    "SampleRateHertz": "48000",
-              //    "VoiceType": "Neural",
-              //    "Status": "GA",
-              //    "WordsPerMinute": "112"
-              //  }, ...
-
-              const auto locale = std::string_view{element["Locale"].GetString(), element["Locale"].GetStringLength()};
-              if (locale.starts_with("en-") != 0)
-                continue;
-              voices.emplace_back(std::string_view{element["ShortName"].GetString(), element["ShortName"].GetStringLength()});
-            }
-            self->lastError.clear();
-
-            cb(voices);
-            postTask(true);
+            --self->inFlight;
+            if (!r)
+              self->queue.push_front(request);
+            self->wake();
           }
           else
           {
             SPDLOG_INFO("this was destroyed");
           }
-        },
-        {
-          {"Accept", ""},
-          {"User-Agent", "curl/7.68.0"},
-          {"Authorization", fmt::format("Bearer {}", t)},
-        });
+        };
+        if (request->task)
+          request->task(t, std::move(postTask));
+        else
+          self->speak(request, t, std::move(postTask));
+      }
     }
     else
     {
       SPDLOG_INFO("this was destroyed");
     }
   });
-  process();
 }
+
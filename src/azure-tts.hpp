@@ -1,11 +1,14 @@
 #pragma once
+#include <chrono>
+#include <deque>
 #include <functional>
-#include <queue>
-#include <span>
+#include <map>
+#include <memory>
 #include <string>
 #include <string_view>
 
 #include "shared_from_this.hpp"
+#include "tts-cache.hpp"
 #include "uv.hpp"
 
 namespace uv
@@ -16,28 +19,101 @@ namespace uv
 class AzureTts : public virtual enable_shared_from_this
 {
 public:
-  using ListVoicesCallback = std::move_only_function<void(std::span<std::string_view>)>;
   AzureTts(uv::Uv &, class AzureToken &, class HttpClient &, class AudioSink &);
-  auto say(std::string voice, std::string msg, bool overlap = true) -> void;
-  auto listVoices(ListVoicesCallback) -> void;
+  using StartCallback = std::move_only_function<void()>;
+  // onStart runs when the first audio of the message goes to the sink
+  auto say(std::string voice, std::string msg, bool overlap = true, StartCallback onStart = nullptr) -> void;
+  using Clock = std::chrono::steady_clock;
 
-  std::string lastError;
+  // what speaking costs over one transport format, to compare the compressed one against raw PCM
+  struct TransportStats
+  {
+    uint64_t messages = 0;
+    uint64_t bytes = 0;
+    double seconds = 0.;
+    Clock::duration firstAudio{};
+    auto kbPerSecond() const -> double;
+    auto firstAudioMs() const -> double;
+  };
 
-private:
-  enum class State {
-    idle,
-    waiting,
+  auto cacheStats() const -> const TtsCache::Stats & { return cache.stats(); }
+  // messages waiting for synthesis, and the requests being synthesized
+  auto queued() const -> size_t { return queue.size(); }
+  auto synthesizing() const -> int { return inFlight; }
+  auto transportStats(bool aCompressed) const -> const TransportStats & { return transport[aCompressed ? 1 : 0]; }
+  // requests Ogg Opus instead of raw PCM from now on
+  auto setCompressed(bool v) -> void { compressed = v; }
+
+  // what say() does when the messages pile up faster than they are spoken
+  struct Backpressure
+  {
+    // messages waiting for synthesis beyond this are dropped, 0 is no limit
+    int maxQueued = 20;
+    // instead of dropping, a message joins the last waiting one if it has the same voice
+    bool merge = false;
+    // messages that waited longer than this are skipped, 0 is no limit
+    int maxAgeSec = 0;
   };
+  auto setBackpressure(Backpressure v) -> void { backpressure = v; }
+
+  std::string lastError;
+
+  // formats requested from the service, both decode to OutputRate
+  static constexpr auto OutputFormat = "raw-24khz-16bit-mono-pcm";
+  static constexpr auto CompressedFormat = "ogg-24khz-16bit-mono-opus";
+  static constexpr auto OutputRate = 24000;
+  // speech buffered before playback starts, covers the gaps between response chunks
+  static constexpr auto JitterMs = 200;
+  // requests synthesized ahead of playback
+  static constexpr auto MaxInFlight = 3;
+  // wait after the service failed before any new request
+  static constexpr auto RetryDelay = std::chrono::seconds{10};
 
+private:
   using PostTask = std::move_only_function<void(bool)>;
   using Task = std::move_only_function<void(std::string_view, PostTask)>;
+  struct Playback;
+
+  // a message to speak, or with task set any other call to the service
+  struct Request
+  {
+    Task task;
+    std::string voice;
+    std::string msg;
+    bool overlap = true;
+    StartCallback onStart = nullptr;
+    // place in the playback order
+    uint64_t turn = 0;
+    Clock::time_point queued = Clock::now();
+  };
 
+  std::reference_wrapper<uv::Uv> uv;
   uv::Timer timer;
   std::reference_wrapper<AzureToken> token;
   std::reference_wrapper<HttpClient> httpClient;
   std::reference_wrapper<AudioSink> audioSink;
-  std::queue<Task> queue;
-  State state = State::idle;
+  std::deque<std::shared_ptr<Request>> queue;
+  int inFlight = 0;
+  bool fetchingToken = false;
+  Clock::time_point retryAt;
+  Backpressure backpressure;
+  // messages play in the order say() was called, whichever synthesis finishes first; null marks
+  // a message that was given up
+  std::map<uint64_t, std::shared_ptr<Playback>> turns;
+  uint64_t playhead = 0;
+  uint64_t nextTurn = 0;
+  TtsCache cache;
+  bool compressed = false;
+  TransportStats transport[2];
 
   auto process() -> void;
+  auto wake() -> void;
+  auto speak(std::shared_ptr<Request>, std::string_view token, PostTask) -> void;
+  auto play(Request &, const Wav &) -> void;
+  auto synthesize(Request &, std::string key, std::string xml, std::string_view token, PostTask) -> void;
+  auto decodeNext(std::shared_ptr<Playback>) -> void;
+  auto finish(Playback &, uint64_t turn, PostTask) -> void;
+  auto skip(uint64_t turn) -> void;
+  // queues what the message whose turn it is has, and hands the turn on once it is complete
+  auto advance() -> void;
 };
@@ -5,7 +5,7 @@ template <typename S, typename ClassName>
 Blink<S, ClassName>::Blink(Lib &lib, Undo &aUndo, const std::filesystem::path &path)
   : Node(lib, aUndo, [&path]() { return path.filename().string(); }()),
     sprite(lib, aUndo, path),
-    nextEventTime(std::chrono::high_resolution_clock::now())
+    nextEventTime(frameCtx.get().now)
 {
 }
 
@@ -15,6 +15,12 @@ auto Blink<S, ClassName>::do_clone() const -> std::shared_ptr<Node>
   return std::make_shared<Blink>(*this);
 }
 
+template <typename S, typename ClassName>
+auto Blink<S, ClassName>::heldBytes(Counted &counted) const -> size_t
+{
+  return sizeof(*this) + sprite.textureBytes(counted);
+}
+
 template <typename S, typename ClassName>
 auto Blink<S, ClassName>::h() const -> float
 {
@@ -36,13 +42,9 @@ auto Blink<S, ClassName>::load(IStrm &strm) -> void
 }
 
 template <typename S, typename ClassName>
-auto Blink<S, ClassName>::render(float dt, Node *hovered, Node *selected) -> void
+auto Blink<S, ClassName>::animate(float /*dt*/) -> void
 {
-  if (sprite.numFrames() > 0)
-    sprite.frame((state == State::open ? openEyes : closedEyes) % sprite.numFrames());
-  sprite.render();
-  Node::render(dt, hovered, selected);
-  const auto now = std::chrono::high_resolution_clock::now();
+  const auto now = frameCtx.get().now;
   if (now > nextEventTime)
   {
     if (state == State::open)
@@ -53,6 +55,17 @@ auto Blink<S, ClassName>::render(float dt, Node *hovered, Node *selected) -> voi
                        ? std::chrono::microseconds(static_cast<int64_t>(blinkEvery * 1'000'000))
                        : std::chrono::microseconds(static_cast<int64_t>(blinkDuration * 1'000'000));
   }
+  // the frame woken up for the change shows it, rather than the one after
+  if (sprite.numFrames() > 0)
+    sprite.frame((state == State::open ? openEyes : closedEyes) % sprite.numFrames());
+  scheduler.get().wakeIn(std::chrono::duration_cast<RenderScheduler::Clock::duration>(nextEventTime - now));
+}
+
+template <typename S, typename ClassName>
+auto Blink<S, ClassName>::render(float dt, Node *hovered, Node *selected) -> void
+{
+  sprite.render();
+  Node::render(dt, hovered, selected);
 }
 
 template <typename S, typename ClassName>
@@ -72,12 +85,12 @@ auto Blink<S, ClassName>::renderUi() -> void
   Ui::textRj("Blink Every");
   ImGui::TableNextColumn();
   if (Ui::dragFloat(undo, "sec##BlinkEvery", blinkEvery, .1f, .01f, 120.f, "%.1f"))
-    nextEventTime = std::chrono::high_resolution_clock::now();
+    nextEventTime = frameCtx.get().now;
   ImGui::TableNextColumn();
   Ui::textRj("Duration");
   ImGui::TableNextColumn();
   if (Ui::dragFloat(undo, "sec##BlinkDuratin", blinkDuration, .01f, .01f, 1.f, "%.3f"))
-    nextEventTime = std::chrono::high_resolution_clock::now();
+    nextEventTime = frameCtx.get().now;
 }
 
 template <typename S, typename ClassName>
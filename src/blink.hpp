@@ -35,10 +35,12 @@ private:
   float blinkEvery = 3.5f;
   float blinkDuration = .25f;
   State state = State::open;
-  std::chrono::high_resolution_clock::time_point nextEventTime;
+  std::chrono::steady_clock::time_point nextEventTime;
 
   auto h() const -> float final;
+  auto heldBytes(Counted &) const -> size_t final;
   auto isTransparent(glm::vec2) const -> bool final;
+  auto animate(float dt) -> void final;
   auto load(IStrm &) -> void final;
   auto render(float dt, Node *hovered, Node *selected) -> void final;
   auto renderUi() -> void final;
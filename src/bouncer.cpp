@@ -2,11 +2,12 @@
 #include "audio-in.hpp"
 #include "ui.hpp"
 #include <SDL_opengl.h>
+#include <cmath>
 #include <limits>
 #include <spdlog/spdlog.h>
 
 Bouncer::Bouncer(Lib &lib, Undo &aUndo, class AudioIn &audioIn)
-  : Node(lib, aUndo, "bouncer"), audioLevel(audioIn)
+  : Node(lib, aUndo, "bouncer"), audioLevel(lib.queryAudioLevel(audioIn))
 {
 }
 
@@ -18,9 +19,15 @@ auto Bouncer::do_clone() const -> std::shared_ptr<Node>
 auto Bouncer::render(float dt, Node *hovered, Node *selected) -> void
 {
   zOrder = INT_MIN;
-  glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
-  glClear(GL_COLOR_BUFFER_BIT);
-  dLoc.y += std::min(1000.f * dt / 250.f, 1.f) * (strength * audioLevel.getLevel() - dLoc.y);
+  if (!frameCtx.get().transparent)
+  {
+    batch.get().flush();
+    glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
+  dLoc.y += std::min(1000.f * dt / 250.f, 1.f) * (strength * audioLevel->getLevel() - dLoc.y);
+  if (std::abs(strength * audioLevel->getLevel() - dLoc.y) > .5f)
+    scheduler.get().invalidate();
   Node::render(dt, hovered, selected);
 }
 
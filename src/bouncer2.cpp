@@ -1,12 +1,17 @@
 #include "bouncer2.hpp"
 #include "audio-in.hpp"
 #include "ui.hpp"
+#include "undo.hpp"
 #include <SDL_opengl.h>
+#include <cmath>
 #include <limits>
 #include <spdlog/spdlog.h>
 
-Bouncer2::Bouncer2(Lib &lib, Undo &aUndo, class AudioIn &audioIn, std::string aName)
-  : Node(lib, aUndo, std::move(aName)), audioLevel(audioIn)
+Bouncer2::Bouncer2(Lib &aLib, Undo &aUndo, class AudioIn &audioIn, std::string aName)
+  : Node(aLib, aUndo, std::move(aName)),
+    lib(aLib),
+    mainAudioIn(audioIn),
+    audioLevel(aLib.queryAudioLevel(audioIn))
 {
 }
 
@@ -15,15 +20,50 @@ auto Bouncer2::do_clone() const -> std::shared_ptr<Node>
   return std::make_shared<Bouncer2>(*this);
 }
 
-auto Bouncer2::render(float dt, Node *hovered, Node *selected) -> void
+auto Bouncer2::animate(float dt) -> void
 {
-  dLoc.y += std::min(1000.f * dt / easing, 1.f) * (strength * audioLevel.getLevel() - dLoc.y);
-  Node::render(dt, hovered, selected);
+  dLoc.y += std::min(1000.f * dt / easing, 1.f) * (strength * audioLevel->getLevel() - dLoc.y);
+  if (std::abs(strength * audioLevel->getLevel() - dLoc.y) > .5f)
+    scheduler.get().invalidate();
+}
+
+auto Bouncer2::listen(int source) -> void
+{
+  auto next = lib.get().queryMic(source);
+  // the old level lets go of its device before the old source closes it
+  audioLevel = lib.get().queryAudioLevel(next ? next->audioIn() : mainAudioIn.get());
+  micSource = std::move(next);
+  mic = source;
+}
+
+auto Bouncer2::loadAttrs(const std::map<std::string, std::string> &attrs) -> void
+{
+  if (const auto source = MicSource::load(attrs); source != mic)
+    listen(source);
+}
+
+auto Bouncer2::saveAttrs(std::map<std::string, std::string> &attrs) const -> void
+{
+  MicSource::save(mic, attrs);
 }
 
 auto Bouncer2::renderUi() -> void
 {
   Node::renderUi();
+  if (const auto picked = MicSource::combo(lib, mic))
+    undo.get().record(
+      [source = *picked, alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->listen(source);
+        else
+          SPDLOG_INFO("this was destroyed");
+      },
+      [source = mic, alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->listen(source);
+        else
+          SPDLOG_INFO("this was destroyed");
+      });
   ImGui::TableNextColumn();
   Ui::textRj("Bounce");
   ImGui::TableNextColumn();
@@ -1,5 +1,6 @@
 #pragma once
 #include "audio-level.hpp"
+#include "mic-source.hpp"
 #include "node.hpp"
 
 class Bouncer2 final : public Node
@@ -17,9 +18,17 @@ public:
 private:
   float strength = 100.f;
   float easing = 50.f;
-  AudioLevel audioLevel;
+  std::reference_wrapper<Lib> lib;
+  std::reference_wrapper<AudioIn> mainAudioIn;
+  // the source picked, 0 for the main mic; held ahead of the level that listens to it
+  int mic = 0;
+  std::shared_ptr<MicSource> micSource;
+  std::shared_ptr<AudioLevel> audioLevel;
 
-  auto render(float dt, Node *hovered, Node *selected) -> void final;
+  auto animate(float dt) -> void final;
+  auto listen(int source) -> void;
+  auto loadAttrs(const std::map<std::string, std::string> &) -> void final;
+  auto saveAttrs(std::map<std::string, std::string> &) const -> void final;
   auto renderUi() -> void final;
   auto save(OStrm &) const -> void final;
   auto load(IStrm &) -> void final;
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "audio-block.hpp"
+
+class CaptureSink
+{
+public:
+  virtual ~CaptureSink() = default;
+  virtual auto ingest(const AudioBlock &) -> void = 0;
+};
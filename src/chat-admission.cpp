@@ -0,0 +1,111 @@
+#include "chat-admission.hpp"
+#include "text-visemes.hpp"
+#include <algorithm>
+
+ChatAdmission::ChatAdmission(uv::Uv &uv, SayCallback aSay) : timer(uv.createTimer()), say(std::move(aSay)) {}
+
+auto ChatAdmission::push(std::string chatter, std::string voice, std::string intro, std::string text, Priority priority)
+  -> void
+{
+  auto entry = Entry{std::move(chatter), std::move(voice), std::move(intro), std::move(text), priority};
+  if (!admit(entry))
+  {
+    ++stats_.rateLimited;
+    return;
+  }
+  if (!pending.empty() && pending.back().chatter == entry.chatter && pending.back().voice == entry.voice)
+  {
+    auto &last = pending.back();
+    last.text += " " + entry.text;
+    last.priority = std::max(last.priority, entry.priority);
+    ++stats_.merged;
+  }
+  else
+    pending.push_back(std::move(entry));
+  trim();
+  release();
+}
+
+auto ChatAdmission::admit(const Entry &entry) -> bool
+{
+  const auto now = Clock::now();
+  auto it = lastAdmitted.find(entry.chatter);
+  if (it != std::end(lastAdmitted) && now < it->second + ChatterInterval && entry.priority == Priority::normal)
+    return false;
+  if (it != std::end(lastAdmitted))
+  {
+    it->second = now;
+    return true;
+  }
+  if (lastAdmitted.size() >= pruneAt)
+  {
+    std::erase_if(lastAdmitted, [&](const auto &v) { return now >= v.second + ChatterInterval; });
+    pruneAt = std::max(MinPrune, 2 * lastAdmitted.size());
+  }
+  lastAdmitted.emplace(entry.chatter, now);
+  return true;
+}
+
+auto ChatAdmission::trim() -> void
+{
+  // the oldest ordinary messages go first, they are the least interesting by the time they are due
+  while (queued() > MaxQueued)
+  {
+    auto it = std::find_if(
+      std::begin(pending), std::end(pending), [](const auto &e) { return e.priority == Priority::normal; });
+    if (it == std::end(pending))
+      break;
+    pending.erase(it);
+    ++stats_.dropped;
+  }
+}
+
+auto ChatAdmission::release() -> void
+{
+  const auto now = Clock::now();
+  if (pending.empty())
+    return;
+  if (busyUntil - now > Lead)
+  {
+    const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(busyUntil - now - Lead);
+    timer.start([this]() { release(); }, static_cast<uint64_t>(wait.count()));
+    return;
+  }
+  auto entry = std::move(pending.front());
+  pending.pop_front();
+  busyUntil = std::max(busyUntil, now) + estimate(entry);
+  auto text = entry.chatter != lastSpoken ? entry.intro + " " + entry.text : std::move(entry.text);
+  lastSpoken = std::move(entry.chatter);
+  ++stats_.spoken;
+  say(entry.voice, std::move(text));
+  release();
+}
+
+auto ChatAdmission::clear() -> void
+{
+  pending.clear();
+  timer.stop();
+  busyUntil = {};
+}
+
+auto ChatAdmission::queued() const -> Clock::duration
+{
+  auto ret = std::max(Clock::duration{}, busyUntil - Clock::now());
+  for (const auto &e : pending)
+    ret += estimate(e);
+  return ret;
+}
+
+auto ChatAdmission::stats() const -> Stats
+{
+  auto ret = stats_;
+  ret.queuedSec = std::chrono::duration<float>(queued()).count();
+  return ret;
+}
+
+auto ChatAdmission::estimate(const Entry &e) -> Clock::duration
+{
+  const auto letters = static_cast<float>(e.intro.size() + e.text.size() + 1);
+  return std::chrono::duration_cast<Clock::duration>(
+    std::chrono::duration<float>{letters / TextVisemes::LettersPerSecond});
+}
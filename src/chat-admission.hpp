@@ -0,0 +1,77 @@
+#pragma once
+#include "uv.hpp"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+// Decides which chat messages are read out when chat moves faster than speech, as in a raid.
+// Messages wait here instead of in the TTS queue and are handed on only shortly before the one
+// being spoken is estimated to end; meanwhile consecutive messages of one chatter are merged,
+// a chatter gets one message per ChatterInterval and the waiting speech is capped at MaxQueued by
+// dropping the oldest ordinary messages. Mods, first messages and subscribers are never dropped.
+class ChatAdmission
+{
+public:
+  using Clock = std::chrono::steady_clock;
+  using SayCallback = std::move_only_function<void(const std::string &voice, std::string text)>;
+
+  enum class Priority {
+    normal,
+    subscriber,
+    mod,
+  };
+
+  struct Stats
+  {
+    uint64_t spoken = 0;
+    uint64_t merged = 0;
+    uint64_t rateLimited = 0;
+    uint64_t dropped = 0;
+    float queuedSec = 0.f;
+  };
+
+  ChatAdmission(uv::Uv &, SayCallback);
+  // intro is said before the text unless the chatter was the last one heard
+  auto push(std::string chatter, std::string voice, std::string intro, std::string text, Priority) -> void;
+  // forgets the waiting messages, when TTS is turned off
+  auto clear() -> void;
+  auto stats() const -> Stats;
+
+  static constexpr auto ChatterInterval = std::chrono::seconds{10};
+  static constexpr auto MaxQueued = std::chrono::seconds{20};
+  // the next message is handed on this long before the current one is estimated to end, enough
+  // for the synthesis to start
+  static constexpr auto Lead = std::chrono::seconds{2};
+
+private:
+  struct Entry
+  {
+    std::string chatter;
+    std::string voice;
+    std::string intro;
+    std::string text;
+    Priority priority = Priority::normal;
+  };
+
+  uv::Timer timer;
+  SayCallback say;
+  std::deque<Entry> pending;
+  // when each chatter was last admitted, pruned as it grows
+  std::unordered_map<std::string, Clock::time_point> lastAdmitted;
+  size_t pruneAt = MinPrune;
+  // when the speech handed on so far is estimated to end
+  Clock::time_point busyUntil;
+  std::string lastSpoken;
+  Stats stats_;
+
+  static constexpr auto MinPrune = size_t{256};
+
+  auto admit(const Entry &) -> bool;
+  auto trim() -> void;
+  auto release() -> void;
+  auto queued() const -> Clock::duration;
+  static auto estimate(const Entry &) -> Clock::duration;
+};
@@ -0,0 +1,218 @@
+#include "chat-dedup.hpp"
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <fmt/format.h>
+#include <scn/scn.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace
+{
+  // polynomial hashes modulo two primes below 2^31, so the products fit in 64 bits everywhere;
+  // unlike plain 64-bit wrap-around there is no known word pattern that collides them
+  constexpr auto Mods = std::array<uint64_t, 2>{2'147'483'647, 2'147'483'629};
+  constexpr auto Bases = std::array<uint64_t, 2>{1'000'003, 999'983};
+
+  class Hashes
+  {
+  public:
+    explicit Hashes(const std::vector<uint32_t> &ids) : prefix(ids.size() + 1), pow(ids.size() + 1)
+    {
+      pow[0] = {1, 1};
+      for (auto i = size_t{0}; i < ids.size(); ++i)
+        for (auto m = size_t{0}; m < Mods.size(); ++m)
+        {
+          prefix[i + 1][m] = (prefix[i][m] * Bases[m] + ids[i] + 1) % Mods[m];
+          pow[i + 1][m] = pow[i][m] * Bases[m] % Mods[m];
+        }
+    }
+
+    // hash of the words [pos, pos + len)
+    auto at(size_t pos, size_t len) const -> uint64_t
+    {
+      auto ret = uint64_t{0};
+      for (auto m = size_t{0}; m < Mods.size(); ++m)
+        ret = (ret << 32) | (prefix[pos + len][m] + Mods[m] - prefix[pos][m] * pow[len][m] % Mods[m]) % Mods[m];
+      return ret;
+    }
+
+    // how many words match going forward from a and b
+    auto forward(size_t a, size_t b, size_t max) const -> size_t
+    {
+      auto lo = size_t{0};
+      auto hi = max;
+      while (lo < hi)
+      {
+        const auto mid = lo + (hi - lo + 1) / 2;
+        if (at(a, mid) == at(b, mid))
+          lo = mid;
+        else
+          hi = mid - 1;
+      }
+      return lo;
+    }
+
+    // how many words match going backward from just before a and b
+    auto backward(size_t a, size_t b, size_t max) const -> size_t
+    {
+      auto lo = size_t{0};
+      auto hi = max;
+      while (lo < hi)
+      {
+        const auto mid = lo + (hi - lo + 1) / 2;
+        if (at(a - mid, mid) == at(b - mid, mid))
+          lo = mid;
+        else
+          hi = mid - 1;
+      }
+      return lo;
+    }
+
+  private:
+    std::vector<std::array<uint64_t, 2>> prefix;
+    std::vector<std::array<uint64_t, 2>> pow;
+  };
+
+  // keeps one copy of every run of the phrase width words long repeated three or more times,
+  // returns false if there was none
+  auto collapse(std::vector<uint32_t> &ids, const Hashes &hashes, size_t width) -> bool
+  {
+    const auto n = ids.size();
+    auto keep = std::vector<uint32_t>{};
+    auto copied = size_t{0};
+    // a run of three periods contains two neighbouring checkpoints, so it is found from one of
+    // them; the checkpoints inside a run already collapsed are skipped, and those without a whole
+    // period after them, which the compare would read past the end from
+    for (auto j = width; j + 2 * width <= n; j += width)
+    {
+      if (j < copied)
+        continue;
+      // the checkpoint that finds a run is inside it, most checkpoints are told apart right away
+      if (ids[j] != ids[j + width])
+        continue;
+      const auto fwd = hashes.forward(j, j + width, n - j - width);
+      const auto bwd = hashes.backward(j, j + width, j - copied);
+      const auto len = bwd + fwd + width;
+      if (len < 3 * width)
+        continue;
+      const auto start = j - bwd;
+      keep.insert(std::end(keep), std::begin(ids) + copied, std::begin(ids) + start + width);
+      copied = start + len / width * width;
+    }
+    if (copied == 0)
+      return false;
+    keep.insert(std::end(keep), std::begin(ids) + copied, std::end(ids));
+    ids = std::move(keep);
+    return true;
+  }
+} // namespace
+
+auto dedup(std::string_view var) -> std::string
+{
+  std::vector<std::string_view> words;
+  [[maybe_unused]] auto const result = scn::scan_list(var, words);
+  assert(!result.error());
+
+  auto interned = std::unordered_map<std::string_view, uint32_t>{};
+  auto ids = std::vector<uint32_t>{};
+  ids.reserve(words.size());
+  auto unique = std::vector<std::string_view>{};
+  for (const auto &word : words)
+  {
+    const auto [it, isNew] = interned.try_emplace(word, static_cast<uint32_t>(unique.size()));
+    if (isNew)
+      unique.push_back(word);
+    ids.push_back(it->second);
+  }
+
+  // collapsing a phrase can line up a shorter one that repeats, so every width is tried again
+  // after a change, but only MaxPasses times: a message nested deeper than that is not worth
+  // giving up the linear bound for
+  constexpr auto MaxPasses = 3;
+  auto hashes = Hashes{ids};
+  for (auto pass = 0, changed = 1; pass < MaxPasses && changed; ++pass)
+  {
+    changed = 0;
+    for (auto width = size_t{1}; 3 * width <= ids.size(); ++width)
+      if (collapse(ids, hashes, width))
+      {
+        hashes = Hashes{ids};
+        changed = 1;
+      }
+  }
+
+  auto ret = std::string{};
+  ret.reserve(var.size());
+  for (auto id : ids)
+  {
+    if (!ret.empty())
+      ret += ' ';
+    ret += unique[id];
+  }
+  return ret;
+}
+
+auto benchDedup() -> int
+{
+  struct Case
+  {
+    std::string name;
+    std::string line;
+  };
+  auto cases = std::vector<Case>{};
+  auto repeat = [](std::string_view phrase, int times) {
+    auto ret = std::string{};
+    for (auto i = 0; i < times; ++i)
+      fmt::format_to(std::back_inserter(ret), "{}{}", i > 0 ? " " : "", phrase);
+    return ret;
+  };
+  cases.push_back({"one word x2000", repeat("LUL", 2000)});
+  cases.push_back({"phrase x300", repeat("never gonna give you up", 300)});
+  {
+    // no repeats at all, every width is checked and nothing is found
+    auto line = std::string{};
+    for (auto i = 0; i < 2000; ++i)
+      fmt::format_to(std::back_inserter(line), "{}w{}", i > 0 ? " " : "", i);
+    cases.push_back({"2000 distinct words", std::move(line)});
+  }
+  {
+    // pairs that just miss the third copy, the worst case of the old scan
+    auto line = std::string{};
+    for (auto i = 0; i < 500; ++i)
+      fmt::format_to(std::back_inserter(line), "{}a{} b{} a{} b{}", i > 0 ? " " : "", i, i, i, i);
+    cases.push_back({"near repeats", std::move(line)});
+  }
+  {
+    // every triple collapses on its own, the old scan started over after each of them
+    auto line = std::string{};
+    for (auto i = 0; i < 700; ++i)
+      fmt::format_to(std::back_inserter(line), "{}w{} w{} w{}", i > 0 ? " " : "", i, i, i);
+    cases.push_back({"many short runs", std::move(line)});
+  }
+  {
+    // Fibonacci words are full of squares but have no cubes
+    auto a = std::string{"a"};
+    auto b = std::string{"a b"};
+    while (b.size() < 8000)
+      a = std::exchange(b, b + " " + a);
+    cases.push_back({"Fibonacci word", std::move(b)});
+  }
+  cases.push_back({"nested copypasta", repeat(repeat("PogChamp Kappa", 4) + " " + repeat("LUL", 5), 60)});
+
+  for (const auto &c : cases)
+  {
+    const auto words = std::count(std::begin(c.line), std::end(c.line), ' ') + 1;
+    constexpr auto Runs = 20;
+    auto out = std::string{};
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < Runs; ++i)
+      out = dedup(c.line);
+    const auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Runs;
+    fmt::print("{}: {} words -> {} chars, {:.3f} ms\n", c.name, words, out.size(), ms);
+  }
+  return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+// Collapses a phrase repeated three or more times in a row to a single copy, "LUL LUL LUL LUL"
+// becomes "LUL", so spam is not read out in full. Words are interned and runs are found with
+// rolling hashes from checkpoints every period apart, which keeps the cost near linear in the
+// number of words however the message is built; shorter phrases are collapsed first.
+auto dedup(std::string_view) -> std::string;
+// times dedup() on pathological chat lines and prints the results, for VoiceTuber --bench-dedup
+auto benchDedup() -> int;
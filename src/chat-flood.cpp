@@ -0,0 +1,86 @@
+#include "chat-flood.hpp"
+#include "file.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fmt/std.h>
+#include <iterator>
+#include <stdexcept>
+
+namespace
+{
+  const char *const Texts[] = {
+    "hello chat",
+    "LUL LUL LUL LUL",
+    "what is the song called?",
+    "PogChamp that was so clean, how long did it take to get the timing right",
+    "!discord",
+    "Kappa",
+    "is this the same model as yesterday or did you change the hair",
+    "gg",
+  };
+  constexpr auto Chatters = 37;
+  constexpr auto PingEvery = 100;
+} // namespace
+
+ChatFlood::ChatFlood(const std::filesystem::path &capture)
+{
+  if (capture.empty())
+    return;
+  auto file = MappedFile{capture};
+  if (!file)
+    throw std::runtime_error(fmt::format("Error opening IRC capture {:?}: {}", capture, std::strerror(errno)));
+  constexpr auto Marker = std::string_view{"PRIVMSG #"};
+  for (auto rest = file.view(); !rest.empty();)
+  {
+    const auto eol = rest.find('\n');
+    const auto line = rest.substr(0, eol == std::string_view::npos ? rest.size() : eol);
+    rest.remove_prefix(eol == std::string_view::npos ? rest.size() : eol + 1);
+    const auto privMsg = line.find(Marker);
+    if (privMsg == std::string_view::npos)
+      continue;
+    const auto channelEnd = line.find(' ', privMsg + Marker.size());
+    if (channelEnd == std::string_view::npos)
+      continue;
+    auto tail = std::string{line.substr(channelEnd)};
+    if (!tail.ends_with('\r'))
+      tail += '\r';
+    tail += '\n';
+    recorded.push_back(Recorded{std::string{line.substr(0, privMsg + Marker.size())}, std::move(tail)});
+  }
+  if (recorded.empty())
+    throw std::runtime_error(fmt::format("No PRIVMSG lines in the IRC capture {:?}", capture));
+}
+
+auto ChatFlood::generate(std::string_view channel, int n, std::string &out) -> void
+{
+  for (auto i = 0; i < n; ++i, ++seq)
+  {
+    if (!recorded.empty())
+    {
+      const auto &r = recorded[seq % recorded.size()];
+      out += r.head;
+      out += channel;
+      out += r.tail;
+      continue;
+    }
+    // on top of the messages, so every channel gets n of them
+    if (seq % PingEvery == PingEvery - 1)
+      out += "PING :tmi.twitch.tv\r\n";
+    const auto user = static_cast<int>(seq % Chatters);
+    fmt::format_to(std::back_inserter(out),
+                   "@badge-info=subscriber/{0};badges=subscriber/{0};client-nonce={1:032x};color=#{2:06X};"
+                   "display-name=Viewer{3};emotes=;first-msg=0;flags=;id={1:08x}-9ed8-4c86-88df-ac25988c2f36;"
+                   "mod={4};returning-chatter=0;room-id=224389503;subscriber={5};tmi-sent-ts={6};turbo=0;"
+                   "user-id={7};user-type= :viewer{3}!viewer{3}@viewer{3}.tmi.twitch.tv PRIVMSG #{8} :{9}\r\n",
+                   user % 12,
+                   seq * 2654435761u,
+                   (user * 0x10101) & 0xffffff,
+                   user,
+                   user == 0 ? 1 : 0,
+                   user % 3 == 0 ? 1 : 0,
+                   1681529715041 + seq * 250,
+                   100000 + user,
+                   channel,
+                   Texts[seq % std::size(Texts)]);
+  }
+}
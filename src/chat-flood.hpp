@@ -0,0 +1,29 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// IRC traffic for the chat flood test and the micro-benchmarks. The PRIVMSG lines of a recorded
+// capture are replayed round robin, or without one, lines are made up in the shape Twitch sends:
+// full tags, a few dozen chatters, now and then a PING. Every line is aimed at the channel asked for.
+class ChatFlood
+{
+public:
+  // an empty path is the synthetic traffic; throws when the capture holds no PRIVMSG
+  explicit ChatFlood(const std::filesystem::path &capture = {});
+  // appends the next n messages for channel, given without the '#', and the PINGs among them
+  auto generate(std::string_view channel, int n, std::string &out) -> void;
+
+private:
+  struct Recorded
+  {
+    // everything up to and including "PRIVMSG #"
+    std::string head;
+    // from the space after the channel on, with the line ending
+    std::string tail;
+  };
+  std::vector<Recorded> recorded;
+  uint64_t seq = 0;
+};
@@ -1,10 +1,12 @@
 #include "chat.hpp"
 #include "audio-sink.hpp"
+#include "chat-dedup.hpp"
 #include "imgui-helpers.hpp"
 #include "lib.hpp"
-#include "no-voice.hpp"
 #include "ui.hpp"
 #include "undo.hpp"
+#include <algorithm>
+#include <ranges>
 #include <scn/scn.h>
 #include <sdlpp/sdlpp.hpp>
 #include <spdlog/spdlog.h>
@@ -15,13 +17,52 @@ Chat::Chat(class Lib &aLib, Undo &aUndo, uv::Uv &aUv, AudioSink &aAudioSink, std
   : Node(aLib, aUndo, n),
     lib(aLib),
     audioSink(aAudioSink),
+    uv(aUv),
     twitch(aLib.queryTwitch(n)),
     font(aLib.queryFont(sdl::get_base_path() / "assets/notepad_font/NotepadFont.ttf", ptsize)),
-    timer(std::make_shared<uv::Timer>(aUv.createTimer()))
+    timer(std::make_shared<uv::Timer>(aUv.createTimer())),
+    admission(aUv, say())
 {
   twitch->reg(*this);
 }
 
+Chat::Chat(const Chat &other)
+  : enable_shared_from_this(other),
+    Node(other),
+    TwitchSink(other),
+    ptsize(other.ptsize),
+    size(other.size),
+    lib(other.lib),
+    audioSink(other.audioSink),
+    uv(other.uv),
+    twitch(other.twitch),
+    font(other.font),
+    history(other.history),
+    historyBytes(other.historyBytes),
+    received_(other.received_),
+    timer(std::make_shared<uv::Timer>(uv.get().createTimer())),
+    admission(uv.get(), say()),
+    showChat(other.showChat),
+    tts(other.tts),
+    azureTts(other.azureTts),
+    voices(other.voices),
+    voicesMap(other.voicesMap),
+    chatterName(other.chatterName),
+    chatterVoice(other.chatterVoice),
+    hideChatSec(other.hideChatSec)
+{
+  twitch->reg(*this);
+}
+
+auto Chat::say() -> ChatAdmission::SayCallback
+{
+  // the admission is the node's own and goes with it
+  return [this](const std::string &voice, std::string text) {
+    if (azureTts && !lib.get().isTtsStubbed())
+      azureTts->say(voice, std::move(text));
+  };
+}
+
 Chat::~Chat()
 {
   twitch->unreg(*this);
@@ -44,50 +85,6 @@ static auto escName(std::string value) -> std::string
   return value;
 }
 
-static auto eq(const std::vector<std::string_view> &words, size_t i, size_t j, size_t w)
-{
-  if (i + w > words.size())
-    return false;
-  if (j + w > words.size())
-    return false;
-  for (auto k = 0U; k < w; ++k)
-    if (words[i + k] != words[j + k])
-      return false;
-  return true;
-}
-
-static auto dedup(std::string_view var)
-{
-  std::vector<std::string_view> words;
-  [[maybe_unused]] auto const result = scn::scan_list(var, words);
-  assert(!result.error());
-  for (bool didUpdate = true; didUpdate;)
-  {
-    didUpdate = false;
-    for (auto w = 1U; w < words.size() / 2 && !didUpdate; ++w)
-    {
-      for (auto i = 0U; i < words.size() - w && !didUpdate; ++i)
-      {
-        for (auto r = 1U; !didUpdate; ++r)
-        {
-          if (!eq(words, i, i + r * w, w))
-          {
-            if (r >= 3)
-            {
-              words.erase(std::begin(words) + i + w, std::begin(words) + i + r * w);
-              didUpdate = true;
-            }
-            else
-              break;
-          }
-        }
-      }
-    }
-  }
-
-  return fmt::format("{}", fmt::join(words, " "));
-}
-
 static auto getDialogLine(const std::string &text, bool isMe)
 {
   if (isMe)
@@ -99,8 +96,9 @@ static auto getDialogLine(const std::string &text, bool isMe)
   return "said:";
 }
 
-auto Chat::onMsg(Msg val) -> void
+auto Chat::onMsg(const MsgPtr &val) -> void
 {
+  ++received_;
   showChat = true;
   timer->stop();
   if (hideChatSec > 0)
@@ -109,6 +107,7 @@ auto Chat::onMsg(Msg val) -> void
         if (auto self = alive.lock())
         {
           self->showChat = false;
+          self->scheduler.get().invalidate();
         }
         else
         {
@@ -118,21 +117,67 @@ auto Chat::onMsg(Msg val) -> void
       hideChatSec * 1000);
   if (azureTts)
   {
-    const auto displayName = val.displayName;
-    const auto text = val.msg;
+    const auto &displayName = val->chatter->displayName;
+    const auto &text = val->msg;
     const auto isMe = false; // val.isMe;
-    const auto supressName = (lastName == displayName) && !isMe;
     const auto voice = getVoice(displayName);
     if (voice != mute)
-      azureTts->say(
-        voice,
-        (!supressName ? (escName(displayName) + " " + getDialogLine(text, isMe) + " ") : "") +
-          dedup(text));
+    {
+      const auto priority = val->isMod || val->isFirst ? ChatAdmission::Priority::mod
+                            : val->subscriber > 0      ? ChatAdmission::Priority::subscriber
+                                                       : ChatAdmission::Priority::normal;
+      admission.push(
+        displayName, voice, escName(displayName) + " " + getDialogLine(text, isMe), dedup(text), priority);
+    }
     else
-      audioSink.get().ingest(noVoice());
-    lastName = displayName;
+      audioSink.get().play(SoundBank::Clip::noVoice);
   }
-  msgs.emplace_back(std::move(val));
+  history.push_back(Entry{.msg = val});
+  relayout(history.back());
+  trimHistory();
+  scheduler.get().invalidate();
+}
+
+auto Chat::relayout(Entry &entry) -> void
+{
+  historyBytes -= entry.bytes;
+  entry.layout = layout(*entry.msg);
+  entry.bytes = sizeof(Entry) + sizeof(Msg) + entry.msg->msg.capacity();
+  for (const auto &emote : entry.msg->emotes)
+    entry.bytes += sizeof(emote) + emote.id.capacity() + emote.code.capacity();
+  for (const auto &line : entry.layout.lines)
+  {
+    entry.bytes += sizeof(line) + line.capacity() * sizeof(Segment);
+    for (const auto &segment : line)
+      entry.bytes += segment.text.capacity();
+  }
+  historyBytes += entry.bytes;
+}
+
+auto Chat::trimHistory() -> void
+{
+  // every message takes at least one line, so no more than this many can be on screen
+  const auto lineHeight = history.back().layout.lineHeight;
+  const auto visible = lineHeight > 0.f ? static_cast<size_t>(h() / lineHeight) + 1 : size_t{1};
+  while (history.size() > visible &&
+         (history.size() > visible + Scrollback || historyBytes > HistoryBudget))
+  {
+    historyBytes -= history.front().bytes;
+    history.pop_front();
+  }
+}
+
+auto Chat::layout(const Msg &val) const -> MsgLayout
+{
+  const auto displayNameDim = font->getSize(val.chatter->displayName);
+  auto ret = MsgLayout{.fontVersion = font->version(),
+                       .width = w(),
+                       .nameWidth = displayNameDim.x,
+                       .lineHeight = displayNameDim.y,
+                       .lines = {}};
+  for (const auto &line : wrapText(fmt::format(": {}", val.msg), displayNameDim.x, val))
+    ret.lines.push_back(segments(line, val, displayNameDim.y));
+  return ret;
 }
 
 static auto toLower(std::string v) -> std::string
@@ -169,7 +214,7 @@ auto Chat::load(IStrm &strm) -> void
     if (!azureTts)
     {
       azureTts = lib.get().queryAzureTts(audioSink);
-      azureTts->listVoices([alive = weak_self()](std::span<std::string_view> aVoices) {
+      lib.get().voiceCatalog().get([alive = weak_self()](std::span<const std::string> aVoices) {
         if (auto self = alive.lock())
         {
           self->voices.insert(self->voices.begin(), aVoices.begin(), aVoices.end());
@@ -187,6 +232,7 @@ auto Chat::render(float dt, Node *hovered, Node *selected) -> void
 {
   if (!twitch->isConnected())
   {
+    batch.get().immediate();
     glColor4f(.5f, .5f, .5f, 1.f);
     glBegin(GL_LINES);
     glVertex2f(.0f, .0f);
@@ -201,25 +247,23 @@ auto Chat::render(float dt, Node *hovered, Node *selected) -> void
     return;
   }
   auto y = 0.f;
-  for (auto it = msgs.rbegin(); it != msgs.rend(); ++it)
+  for (auto i = history.size(); i-- > 0;)
   {
-    const auto displayNameDim = font->getSize(it->displayName);
-    auto const msg = fmt::format(": {}", it->msg);
-
-    glColor3f(1.f, 1.f, 1.f);
-    const auto wrappedLines = wrapText(msg, displayNameDim.x);
-    for (auto ln = wrappedLines.rbegin(); ln != wrappedLines.rend(); ++ln)
+    auto &entry = history[i];
+    // only the visible messages are re-laid out after a font size or width change
+    if (entry.layout.fontVersion != font->version() || entry.layout.width != w())
+      relayout(entry);
+    const auto &msg = *entry.msg;
+    const auto &l = entry.layout;
+    for (auto ln = l.lines.rbegin(); ln != l.lines.rend(); ++ln)
     {
       if (y > h())
         break;
-      const auto isLast = ln == (wrappedLines.rend() - 1);
-      font->render(glm::vec2{isLast ? displayNameDim.x : 0, y}, *ln);
+      const auto isLast = ln == (l.lines.rend() - 1);
+      renderLine(glm::vec2{isLast ? l.nameWidth : 0, y}, *ln, l.lineHeight);
       if (isLast)
-      {
-        glColor3f(it->color.x, it->color.y, it->color.z);
-        font->render(glm::vec2{0.f, y}, it->displayName);
-      }
-      y += displayNameDim.y;
+        font->render(glm::vec2{0.f, y}, msg.chatter->displayName, glm::vec4{msg.chatter->color, 1.f});
+      y += l.lineHeight;
     }
 
     if (y > h())
@@ -229,7 +273,93 @@ auto Chat::render(float dt, Node *hovered, Node *selected) -> void
   Node::render(dt, hovered, selected);
 }
 
-auto Chat::wrapText(std::string_view text, float initial_offset) const -> std::vector<std::string>
+auto Chat::emoteOf(std::string_view word, const Msg &msg) -> const Emote *
+{
+  const auto it = std::find_if(
+    std::begin(msg.emotes), std::end(msg.emotes), [word](const auto &emote) { return emote.code == word; });
+  return it != std::end(msg.emotes) ? &*it : nullptr;
+}
+
+auto Chat::lineWidth(std::string_view line, const Msg &msg) const -> float
+{
+  if (msg.emotes.empty())
+    return font->getSize(std::string{line}).x;
+  const auto space = font->getSize(" ");
+  auto ret = 0.f;
+  auto text = std::string{};
+  for (auto word : std::views::split(line, ' '))
+  {
+    const auto token = std::string_view{std::begin(word), std::end(word)};
+    if (!emoteOf(token, msg))
+    {
+      if (!text.empty())
+        text += ' ';
+      text += token;
+      continue;
+    }
+    if (!text.empty())
+      ret += font->getSize(text).x + space.x;
+    text.clear();
+    ret += space.y + space.x;
+  }
+  return text.empty() ? std::max(0.f, ret - space.x) : ret + font->getSize(text).x;
+}
+
+auto Chat::segments(std::string_view line, const Msg &msg, float lineHeight) const -> Line
+{
+  auto ret = Line{};
+  if (msg.emotes.empty())
+  {
+    ret.push_back(Segment{.x = 0.f, .text = std::string{line}});
+    return ret;
+  }
+  const auto space = font->getSize(" ").x;
+  auto x = 0.f;
+  auto text = std::string{};
+  auto addText = [&]() {
+    if (text.empty())
+      return;
+    const auto width = font->getSize(text).x;
+    ret.push_back(Segment{.x = x, .text = std::move(text)});
+    x += width + space;
+    text.clear();
+  };
+  for (auto word : std::views::split(line, ' '))
+  {
+    const auto token = std::string_view{std::begin(word), std::end(word)};
+    const auto emote = emoteOf(token, msg);
+    if (!emote)
+    {
+      if (!text.empty())
+        text += ' ';
+      text += token;
+      continue;
+    }
+    addText();
+    ret.push_back(Segment{.x = x, .emote = emote});
+    x += lineHeight + space;
+  }
+  addText();
+  return ret;
+}
+
+auto Chat::renderLine(glm::vec2 pos, const Line &line, float lineHeight) -> void
+{
+  for (const auto &segment : line)
+  {
+    const auto at = glm::vec2{pos.x + segment.x, pos.y};
+    if (!segment.emote)
+    {
+      font->render(at, segment.text);
+      continue;
+    }
+    // an emote that cannot be loaded is shown as its code
+    if (!lib.get().emotes().draw(batch.get(), segment.emote->id, at, lineHeight))
+      font->render(at, segment.emote->code);
+  }
+}
+
+auto Chat::wrapText(std::string_view text, float initial_offset, const Msg &msg) const -> std::vector<std::string>
 {
   std::vector<std::string> lines;
   std::string line;
@@ -242,8 +372,7 @@ auto Chat::wrapText(std::string_view text, float initial_offset) const -> std::v
       line += word;
     else
       (line += " ") += word;
-    const auto text_dimensions = font->getSize(line);
-    if (text_dimensions.x > w() - initial_offset)
+    if (lineWidth(line, msg) > w() - initial_offset)
     {
       initial_offset = 0;
       line.resize(line.size() == word.size() ? 0 : line.size() - word.size() - 1);
@@ -329,7 +458,7 @@ auto Chat::renderUi() -> void
               if (!self->azureTts)
               {
                 self->azureTts = self->lib.get().queryAzureTts(self->audioSink);
-                self->azureTts->listVoices([alive](std::span<std::string_view> aVoices) {
+                self->lib.get().voiceCatalog().get([alive](std::span<const std::string> aVoices) {
                   if (auto self = alive.lock())
                   {
                     self->voices.clear();
@@ -345,6 +474,7 @@ auto Chat::renderUi() -> void
             else
             {
               self->azureTts = nullptr;
+              self->admission.clear();
             }
           }
           else
@@ -361,7 +491,7 @@ auto Chat::renderUi() -> void
               if (!self->azureTts)
               {
                 self->azureTts = self->lib.get().queryAzureTts(self->audioSink);
-                self->azureTts->listVoices([alive](std::span<std::string_view> voices) {
+                self->lib.get().voiceCatalog().get([alive](std::span<const std::string> voices) {
                   if (auto self = alive.lock())
                   {
                     self->voices.insert(self->voices.end(), voices.begin(), voices.end());
@@ -376,6 +506,7 @@ auto Chat::renderUi() -> void
             else
             {
               self->azureTts = nullptr;
+              self->admission.clear();
             }
           }
           else
@@ -393,6 +524,67 @@ auto Chat::renderUi() -> void
     ImGui::TableNextColumn();
     ImGui::TextF("{}", azureTts->lastError);
   }
+  if (azureTts && !lib.get().voiceCatalog().lastError().empty())
+  {
+    ImGui::TableNextColumn();
+    Ui::textRj("Voices");
+    ImGui::TableNextColumn();
+    ImGui::TextF("{}", lib.get().voiceCatalog().lastError());
+  }
+  if (azureTts)
+  {
+    const auto &stats = azureTts->cacheStats();
+    ImGui::TableNextColumn();
+    Ui::textRj("TTS Cache");
+    ImGui::TableNextColumn();
+    ImGui::TextF("{:.0f}% hits ({} memory, {} disk, {} misses) {:.1f} MB",
+                 stats.hitRate() * 100.f,
+                 stats.memoryHits,
+                 stats.diskHits,
+                 stats.misses,
+                 static_cast<double>(stats.memoryBytes) / (1 << 20));
+    const auto admitted = admission.stats();
+    ImGui::TableNextColumn();
+    Ui::textRj("TTS Admission");
+    ImGui::TableNextColumn();
+    ImGui::TextF("{} spoken, {} merged, {} rate limited, {} dropped, {:.1f} s waiting",
+                 admitted.spoken,
+                 admitted.merged,
+                 admitted.rateLimited,
+                 admitted.dropped,
+                 admitted.queuedSec);
+    ImGui::TableNextColumn();
+    Ui::textRj("TTS Transport");
+    ImGui::TableNextColumn();
+    for (auto compressed : {false, true})
+    {
+      const auto &transport = azureTts->transportStats(compressed);
+      if (transport.messages == 0)
+        continue;
+      ImGui::TextF("{}: {:.1f} KB/s of speech, first audio after {:.0f} ms",
+                   compressed ? "Opus" : "PCM",
+                   transport.kbPerSecond(),
+                   transport.firstAudioMs());
+    }
+  }
+  ImGui::TableNextColumn();
+  Ui::textRj("History");
+  ImGui::TableNextColumn();
+  ImGui::TextF("{} messages {:.1f} KB", history.size(), static_cast<double>(historyBytes) / 1024.);
+  if (const auto &timings = lib.get().httpClient().timings(); !timings.empty())
+  {
+    ImGui::TableNextColumn();
+    Ui::textRj("Network");
+    ImGui::TableNextColumn();
+    for (const auto &[host, t] : timings)
+      ImGui::TextF("{}: dns {:.0f} ms, connect {:.0f} ms, tls {:.0f} ms, first byte {:.0f} ms{}",
+                   host,
+                   t.dns,
+                   t.connect,
+                   t.tls,
+                   t.ttfb,
+                   t.reused ? " (reused)" : "");
+  }
 
   ImGui::TableNextColumn();
   ImGui::Text("Voices Mapping");
@@ -446,8 +638,8 @@ auto Chat::renderUi() -> void
   ImGui::TableNextColumn();
   if (auto chatListBox =
         Ui::ListBox{"##Chat", ImVec2(-FLT_MIN, 5 * ImGui::GetTextLineHeightWithSpacing())})
-    for (const auto &msg : msgs)
-      ImGui::TextF("{}: {}", msg.displayName, msg.msg);
+    for (const auto &entry : history)
+      ImGui::TextF("{}: {}", entry.msg->chatter->displayName, entry.msg->msg);
   if (!twitch->isConnected())
     ImGui::PopStyleColor();
 }
@@ -1,10 +1,12 @@
 #pragma once
 
+#include "chat-admission.hpp"
 #include "lib.hpp"
 #include "node.hpp"
 #include "twitch-sink.hpp"
 #include "twitch.hpp"
 #include "uv.hpp"
+#include <deque>
 #include <memory>
 
 class Chat : public Node, public TwitchSink
@@ -21,22 +23,65 @@ public:
   static constexpr const char *className = "Chat";
 
   Chat(Lib &, Undo &, uv::Uv &, class AudioSink &, std::string name);
+  // the copy reads the same channel with an admission and a timer of its own
+  Chat(const Chat &);
   ~Chat() override;
+  // what the chat holds on to, for the flood test
+  auto historySize() const -> size_t { return history.size(); }
+  auto received() const -> uint64_t { return received_; }
+  auto admissionStats() const -> ChatAdmission::Stats { return admission.stats(); }
 
 private:
+  // the words between two emotes in one piece, or an emote, at its offset in the line
+  struct Segment
+  {
+    float x = 0.f;
+    std::string text;
+    // points into the message the layout belongs to
+    const Emote *emote = nullptr;
+  };
+  using Line = std::vector<Segment>;
+  // wrapped lines of one message as renderLine() draws them, valid for the font and width they
+  // were measured with
+  struct MsgLayout
+  {
+    // Font::version(), which tells the font apart as well
+    uint64_t fontVersion = 0;
+    float width = 0.f;
+    float nameWidth = 0.f;
+    float lineHeight = 0.f;
+    std::vector<Line> lines;
+  };
+  struct Entry
+  {
+    MsgPtr msg;
+    MsgLayout layout;
+    // what the entry keeps alive, the display name excluded as it is shared
+    size_t bytes = 0;
+  };
+
+  // messages kept above the ones that fit the node, for the chat box in the UI
+  static constexpr auto Scrollback = size_t{200};
+  // the oldest scrollback goes before the history grows beyond this
+  static constexpr auto HistoryBudget = size_t{1} << 20;
+
   int ptsize = 40;
   glm::vec2 size = {400.f, 200.f};
   std::reference_wrapper<Lib> lib;
   std::reference_wrapper<AudioSink> audioSink;
+  std::reference_wrapper<uv::Uv> uv;
   std::shared_ptr<Twitch> twitch;
   std::shared_ptr<Font> font;
-  std::vector<Msg> msgs;
+  // oldest first, bounded to the visible messages plus Scrollback and HistoryBudget
+  std::deque<Entry> history;
+  size_t historyBytes = 0;
+  uint64_t received_ = 0;
   std::shared_ptr<uv::Timer> timer;
+  ChatAdmission admission;
   bool showChat = false;
   bool tts = false;
   std::shared_ptr<AzureTts> azureTts;
   std::vector<std::string> voices;
-  std::string lastName;
   std::map<std::string, std::string> voicesMap;
   std::string chatterName;
   std::string chatterVoice;
@@ -48,11 +93,22 @@ protected:
 
 private:
   auto h() const -> float final;
-  auto onMsg(Msg) -> void final;
+  auto layout(const Msg &) const -> MsgLayout;
+  auto relayout(Entry &) -> void;
+  auto trimHistory() -> void;
+  auto onMsg(const MsgPtr &) -> void final;
   auto render(float dt, Node *hovered, Node *selected) -> void final;
   auto renderUi() -> void final;
   auto w() const -> float final;
-  auto wrapText(std::string_view text, float initOffset) const -> std::vector<std::string>;
+  auto wrapText(std::string_view text, float initOffset, const Msg &) const -> std::vector<std::string>;
+  // an emote is as wide as it is high, a line height
+  auto lineWidth(std::string_view line, const Msg &) const -> float;
+  // spaced the way lineWidth() measures
+  auto segments(std::string_view line, const Msg &, float lineHeight) const -> Line;
+  auto renderLine(glm::vec2 pos, const Line &, float lineHeight) -> void;
+  static auto emoteOf(std::string_view word, const Msg &) -> const Emote *;
   auto getVoice(const std::string &name) const -> std::string;
+  // hands the admitted messages to this node's TTS
+  auto say() -> ChatAdmission::SayCallback;
   auto do_clone() const -> std::shared_ptr<Node>;
 };
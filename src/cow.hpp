@@ -0,0 +1,29 @@
+#pragma once
+#include <memory>
+#include <utility>
+
+// A value the clones of a node share until one of them changes it. Copying takes a reference,
+// edit() copies the value first while another node still holds it, so a duplicated subtree costs
+// the reference counts of its settings and nothing more until it is edited. Main thread only, as
+// the nodes it is used in.
+template <typename T>
+class Cow
+{
+public:
+  Cow() : value(std::make_shared<T>()) {}
+  Cow(T v) : value(std::make_shared<T>(std::move(v))) {}
+
+  auto operator*() const -> const T & { return *value; }
+  auto operator->() const -> const T * { return value.get(); }
+  // the clones made after edit() share what is written through the reference, do not keep it
+  auto edit() -> T &
+  {
+    if (value.use_count() > 1)
+      value = std::make_shared<T>(std::as_const(*value));
+    return *value;
+  }
+  auto isShared() const -> bool { return value.use_count() > 1; }
+
+private:
+  std::shared_ptr<T> value;
+};
@@ -0,0 +1,117 @@
+#include "editor-icons.hpp"
+#include <algorithm>
+#include <cstring>
+#include <sdlpp/sdlpp.hpp>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdisabled-macro-expansion"
+#pragma GCC diagnostic ignored "-Wextra-semi-stmt"
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#pragma GCC diagnostic ignored "-Wimplicit-int-conversion"
+#include <stb_image.h>
+#pragma GCC diagnostic pop
+
+namespace
+{
+  // in the order of EditorIcons::Icon
+  const char *const Files[] = {
+    "arrow-n-circle.png",
+    "arrow-ne-circle.png",
+    "arrow-e-circle.png",
+    "arrow-se-circle.png",
+    "arrow-s-circle.png",
+    "arrow-sw-circle.png",
+    "arrow-w-circle.png",
+    "arrow-nw-circle.png",
+    "center-circle.png",
+    "select.png",
+    "select-disabled.png",
+    "transalte.png",
+    "transalte-disabled.png",
+    "rotate.png",
+    "rotate-disabled.png",
+    "scale.png",
+    "scale-disabled.png",
+    "eye-sprite.png",
+    "not-visable.png",
+  };
+  static_assert(std::size(Files) == static_cast<size_t>(EditorIcons::Icon::count));
+
+  struct Decoded
+  {
+    unsigned char *data = nullptr;
+    int w = 0;
+    int h = 0;
+  };
+} // namespace
+
+EditorIcons::~EditorIcons()
+{
+  if (texture)
+    glDeleteTextures(1, &texture);
+}
+
+auto EditorIcons::button(const std::string &id, Icon icon, float w, float h) -> bool
+{
+  if (!texture)
+    load();
+  const auto &r = rects[static_cast<size_t>(icon)];
+  return ImGui::ImageButton(id.c_str(), (void *)(intptr_t)texture, ImVec2(w, h), r.uv0, r.uv1);
+}
+
+auto EditorIcons::load() -> void
+{
+  auto decoded = std::vector<Decoded>{};
+  auto cellW = 1;
+  auto cellH = 1;
+  for (const auto file : Files)
+  {
+    auto d = Decoded{};
+    int ch;
+    d.data = stbi_load((sdl::get_base_path() / "assets" / file).string().c_str(), &d.w, &d.h, &ch, STBI_rgb_alpha);
+    if (!d.data)
+    {
+      SPDLOG_ERROR("Error loading icon {}: {}", file, stbi_failure_reason());
+      d = Decoded{};
+    }
+    cellW = std::max(cellW, d.w);
+    cellH = std::max(cellH, d.h);
+    decoded.push_back(d);
+  }
+
+  // a grid of cells as big as the largest icon, each icon in the corner of its cell, with a 1px
+  // gutter so linear filtering does not bleed the neighbours in
+  ++cellW;
+  ++cellH;
+  constexpr auto Cols = 5;
+  constexpr auto Rows = (std::size(Files) + Cols - 1) / Cols;
+  const auto atlasW = Cols * cellW;
+  const auto atlasH = static_cast<int>(Rows) * cellH;
+  auto pixels = std::vector<unsigned char>(static_cast<size_t>(atlasW) * static_cast<size_t>(atlasH) * 4);
+  const auto stride = static_cast<size_t>(atlasW) * 4;
+  for (auto i = size_t{0}; i < decoded.size(); ++i)
+  {
+    const auto &d = decoded[i];
+    const auto x = static_cast<int>(i % Cols) * cellW;
+    const auto y = static_cast<int>(i / Cols) * cellH;
+    const auto rowBytes = static_cast<size_t>(d.w) * 4;
+    for (auto row = 0; row < d.h; ++row)
+      std::memcpy(pixels.data() + static_cast<size_t>(y + row) * stride + static_cast<size_t>(x) * 4,
+                  d.data + static_cast<size_t>(row) * rowBytes,
+                  rowBytes);
+    rects[i] = Rect{ImVec2{1.f * x / atlasW, 1.f * y / atlasH},
+                    ImVec2{1.f * (x + d.w) / atlasW, 1.f * (y + d.h) / atlasH}};
+    if (d.data)
+      stbi_image_free(d.data);
+  }
+
+  glGenTextures(1, &texture);
+  glBindTexture(GL_TEXTURE_2D, texture);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, atlasW, atlasH, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <SDL_opengl.h>
+#include <array>
+#include <imgui.h>
+#include <string>
+
+// The icons of the editor UI packed into one texture. Nothing is read until the first button is
+// drawn, so show mode and the nodes themselves never load or hold them. Main thread only.
+class EditorIcons
+{
+public:
+  enum class Icon {
+    arrowN,
+    arrowNE,
+    arrowE,
+    arrowSE,
+    arrowS,
+    arrowSW,
+    arrowW,
+    arrowNW,
+    center,
+    select,
+    selectDisabled,
+    translate,
+    translateDisabled,
+    rotate,
+    rotateDisabled,
+    scale,
+    scaleDisabled,
+    hide,
+    show,
+    count
+  };
+
+  EditorIcons() = default;
+  EditorIcons(const EditorIcons &) = delete;
+  auto operator=(const EditorIcons &) -> EditorIcons & = delete;
+  ~EditorIcons();
+  auto button(const std::string &id, Icon, float w, float h) -> bool;
+
+private:
+  struct Rect
+  {
+    ImVec2 uv0;
+    ImVec2 uv1;
+  };
+
+  GLuint texture = 0;
+  std::array<Rect, static_cast<size_t>(Icon::count)> rects{};
+
+  auto load() -> void;
+};
@@ -0,0 +1,253 @@
+#include "emote-atlas.hpp"
+#include "file.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <system_error>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdisabled-macro-expansion"
+#pragma GCC diagnostic ignored "-Wextra-semi-stmt"
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#pragma GCC diagnostic ignored "-Wimplicit-int-conversion"
+#include <stb_image.h>
+#pragma GCC diagnostic pop
+
+namespace
+{
+  // the 1.0 scale is 28 pixels high, bigger images are sampled down to the cell
+  auto decode(std::string_view bytes) -> std::optional<EmoteAtlas::Cell>
+  {
+    auto w = 0;
+    auto h = 0;
+    auto ch = 0;
+    auto data = stbi_load_from_memory(
+      reinterpret_cast<const stbi_uc *>(bytes.data()), static_cast<int>(bytes.size()), &w, &h, &ch, 4);
+    if (!data)
+      return std::nullopt;
+    constexpr auto Size = EmoteAtlas::CellSize;
+    const auto scale = std::max(1.f, static_cast<float>(std::max(w, h)) / static_cast<float>(Size));
+    const auto dstW = std::max(1, static_cast<int>(static_cast<float>(w) / scale));
+    const auto dstH = std::max(1, static_cast<int>(static_cast<float>(h) / scale));
+    const auto x0 = (Size - dstW) / 2;
+    const auto y0 = (Size - dstH) / 2;
+    auto ret = EmoteAtlas::Cell(static_cast<size_t>(Size * Size * 4), 0);
+    for (auto y = 0; y < dstH; ++y)
+      for (auto x = 0; x < dstW; ++x)
+      {
+        const auto sx = std::min(w - 1, static_cast<int>(static_cast<float>(x) * scale));
+        const auto sy = std::min(h - 1, static_cast<int>(static_cast<float>(y) * scale));
+        std::copy_n(data + (sx + sy * w) * 4, 4, ret.data() + ((x0 + x) + (y0 + y) * Size) * 4);
+      }
+    stbi_image_free(data);
+    return ret;
+  }
+
+  // ids are digits or emotesv2_ and hex, anything else is not a file name to trust
+  auto isValidId(const std::string &id) -> bool
+  {
+    return !id.empty() && std::all_of(std::begin(id), std::end(id), [](char c) {
+      return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+    });
+  }
+} // namespace
+
+EmoteAtlas::EmoteAtlas(uv::Uv &aUv, HttpClient &aHttpClient, RenderScheduler &aScheduler)
+  : uv(aUv),
+    httpClient(aHttpClient),
+    scheduler(aScheduler),
+    owners(Cells),
+    alive(std::make_shared<EmoteAtlas *>(this))
+{
+}
+
+EmoteAtlas::~EmoteAtlas()
+{
+  // downloads and decodes in flight drop their emote
+  *alive = nullptr;
+  if (texture != 0)
+    glDeleteTextures(1, &texture);
+}
+
+auto EmoteAtlas::dir() -> std::filesystem::path
+{
+  return std::filesystem::current_path() / ".cache" / "emotes";
+}
+
+auto EmoteAtlas::url(const std::string &id) -> std::string
+{
+  return fmt::format("https://static-cdn.jtvnw.net/emoticons/v2/{}/static/dark/1.0", id);
+}
+
+auto EmoteAtlas::draw(SpriteBatch &batch, const std::string &id, glm::vec2 pos, float size) -> bool
+{
+  auto [it, isNew] = entries.try_emplace(id);
+  auto &entry = it->second;
+  if (isNew)
+    fetch(id);
+  if (entry.isFailed)
+  {
+    // the code stays up while the retry is in flight
+    if (std::chrono::steady_clock::now() >= entry.retryAt)
+    {
+      entry.retryAt = std::chrono::steady_clock::time_point::max();
+      fetch(id);
+    }
+    return false;
+  }
+  if (entry.cell < 0)
+    return true;
+  entry.used = ++useCount;
+  const auto x = static_cast<float>(entry.cell % Columns * CellSize);
+  const auto y = static_cast<float>(entry.cell / Columns * CellSize);
+  // half a texel in so filtering never reaches the neighbours
+  const auto uv0 = glm::vec2{x + .5f, y + .5f} / static_cast<float>(AtlasSize);
+  const auto uv1 = glm::vec2{x + CellSize - .5f, y + CellSize - .5f} / static_cast<float>(AtlasSize);
+  // the rows are top down like the glyph pages
+  batch.quad(texture, glm::vec2{pos.x, pos.y + size}, glm::vec2{pos.x + size, pos.y}, uv0, uv1);
+  return true;
+}
+
+auto EmoteAtlas::bytes() const -> size_t
+{
+  return texture != 0 ? static_cast<size_t>(AtlasSize) * AtlasSize * 4 : 0;
+}
+
+auto EmoteAtlas::fetch(const std::string &id) -> void
+{
+  if (!isValidId(id))
+  {
+    fail(id);
+    return;
+  }
+  uv.get().queue(
+    [path = dir() / (id + ".png")]() -> std::optional<Cell> {
+      const auto file = MappedFile{path};
+      if (!file)
+        return std::nullopt;
+      return decode(file.view());
+    },
+    [id, alive = alive](std::optional<Cell> cell) {
+      auto self = *alive;
+      if (!self)
+        return;
+      if (cell)
+        self->place(id, *cell);
+      else
+        self->download(id);
+    });
+}
+
+auto EmoteAtlas::download(const std::string &id) -> void
+{
+  httpClient.get().get(
+    url(id),
+    [id, alive = alive](CURLcode code, long status, std::string body) {
+      auto self = *alive;
+      if (!self)
+        return;
+      if (code != CURLE_OK || status != 200)
+      {
+        SPDLOG_WARN("Cannot download emote {}: {} {}", id, curl_easy_strerror(code), status);
+        self->fail(id);
+        return;
+      }
+      self->uv.get().queue(
+        [path = dir() / (id + ".png"), body = std::move(body)]() -> std::optional<Cell> {
+          auto ret = decode(body);
+          // only what decodes is kept, a bad download is tried again on the next run
+          if (ret)
+          {
+            auto ec = std::error_code{};
+            std::filesystem::create_directories(path.parent_path(), ec);
+            if (!write_file_atomically(path, body))
+              SPDLOG_WARN("Cannot cache emote {}: {}", path.string(), std::strerror(errno));
+          }
+          return ret;
+        },
+        [id, alive](std::optional<Cell> cell) {
+          auto owner = *alive;
+          if (!owner)
+            return;
+          if (cell)
+            owner->place(id, *cell);
+          else
+            owner->fail(id);
+        });
+    },
+    {},
+    HttpClient::Priority::background);
+}
+
+auto EmoteAtlas::fail(const std::string &id) -> void
+{
+  if (auto it = entries.find(id); it != std::end(entries))
+  {
+    auto &entry = it->second;
+    entry.isFailed = true;
+    const auto backoff = std::min<std::chrono::steady_clock::duration>(
+      FirstRetry * (int64_t{1} << std::min(entry.failures++, 16)), MaxRetry);
+    // an id that cannot be a Twitch one never loads
+    entry.retryAt =
+      isValidId(id) ? std::chrono::steady_clock::now() + backoff : std::chrono::steady_clock::time_point::max();
+  }
+  scheduler.get().invalidate();
+}
+
+auto EmoteAtlas::freeCell() -> int
+{
+  if (const auto it = std::find_if(std::begin(owners), std::end(owners), [](const auto &v) { return v.empty(); });
+      it != std::end(owners))
+    return static_cast<int>(it - std::begin(owners));
+  const auto victim = std::min_element(std::begin(entries), std::end(entries), [](const auto &a, const auto &b) {
+    // entries without a cell never win
+    const auto usedA = a.second.cell < 0 ? UINT64_MAX : a.second.used;
+    const auto usedB = b.second.cell < 0 ? UINT64_MAX : b.second.used;
+    return usedA < usedB;
+  });
+  const auto ret = victim->second.cell;
+  owners[static_cast<size_t>(ret)].clear();
+  // drawn again it comes back from the disk cache
+  entries.erase(victim);
+  return ret;
+}
+
+auto EmoteAtlas::place(const std::string &id, const Cell &cell) -> void
+{
+  auto it = entries.find(id);
+  if (it == std::end(entries) || it->second.cell >= 0)
+    return;
+  it->second.isFailed = false;
+  if (texture == 0)
+  {
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    const auto zeros = std::vector<unsigned char>(static_cast<size_t>(AtlasSize) * AtlasSize * 4, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, AtlasSize, AtlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, zeros.data());
+  }
+  else
+    glBindTexture(GL_TEXTURE_2D, texture);
+  const auto idx = freeCell();
+  // the victim may have been the only other entry, the iterator is looked up again
+  it = entries.find(id);
+  it->second.cell = idx;
+  owners[static_cast<size_t>(idx)] = id;
+  glTexSubImage2D(GL_TEXTURE_2D,
+                  0,
+                  idx % Columns * CellSize,
+                  idx / Columns * CellSize,
+                  CellSize,
+                  CellSize,
+                  GL_RGBA,
+                  GL_UNSIGNED_BYTE,
+                  cell.data());
+  glBindTexture(GL_TEXTURE_2D, 0);
+  scheduler.get().invalidate();
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "http-client.hpp"
+#include "render-scheduler.hpp"
+#include "sprite-batch.hpp"
+#include "uv.hpp"
+#include <SDL_opengl.h>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Twitch emotes for the chat nodes, all in one texture so a message full of them batches with the
+// text around it. An emote is downloaded from the Twitch CDN once and kept in .cache/emotes for
+// later runs, decoded on the uv thread pool and fitted into a cell of the atlas; once the atlas is
+// full the emote drawn longest ago gives up its cell and comes back from the disk if needed again.
+// Main thread only.
+class EmoteAtlas
+{
+public:
+  EmoteAtlas(uv::Uv &, HttpClient &, RenderScheduler &);
+  EmoteAtlas(const EmoteAtlas &) = delete;
+  ~EmoteAtlas();
+  // queues the emote into the size by size square at pos, asking for one starts its download;
+  // false while it failed to load, the caller shows its code instead; a failed emote is asked for
+  // again after a backoff that doubles with every failure
+  auto draw(SpriteBatch &, const std::string &id, glm::vec2 pos, float size) -> bool;
+  auto bytes() const -> size_t;
+  auto size() const -> size_t { return entries.size(); }
+
+  static constexpr auto CellSize = 32;
+  static constexpr auto AtlasSize = 1024;
+  static constexpr auto Columns = AtlasSize / CellSize;
+  static constexpr auto Cells = Columns * Columns;
+  static constexpr auto FirstRetry = std::chrono::seconds{10};
+  static constexpr auto MaxRetry = std::chrono::minutes{10};
+
+  static auto dir() -> std::filesystem::path;
+  static auto url(const std::string &id) -> std::string;
+
+  // RGBA, CellSize by CellSize, the emote centered in it
+  using Cell = std::vector<unsigned char>;
+
+private:
+  struct Entry
+  {
+    int cell = -1;
+    bool isFailed = false;
+    int failures = 0;
+    std::chrono::steady_clock::time_point retryAt;
+    // when it was drawn last, the lowest gives up its cell
+    uint64_t used = 0;
+  };
+
+  std::reference_wrapper<uv::Uv> uv;
+  std::reference_wrapper<HttpClient> httpClient;
+  std::reference_wrapper<RenderScheduler> scheduler;
+  std::unordered_map<std::string, Entry> entries;
+  // the emote in every cell, empty for a free one
+  std::vector<std::string> owners;
+  GLuint texture = 0;
+  uint64_t useCount = 0;
+  std::shared_ptr<EmoteAtlas *> alive;
+
+  auto fetch(const std::string &id) -> void;
+  auto download(const std::string &id) -> void;
+  auto place(const std::string &id, const Cell &) -> void;
+  auto fail(const std::string &id) -> void;
+  auto freeCell() -> int;
+};
@@ -2,6 +2,7 @@
 #include "mouse-tracking.hpp"
 #include "ui.hpp"
 #include "undo.hpp"
+#include <glm/gtc/matrix_transform.hpp>
 #include <numbers>
 #include <spdlog/spdlog.h>
 
@@ -28,24 +29,21 @@ auto EyeV2::do_clone() const -> std::shared_ptr<Node>
   return std::make_shared<EyeV2>(*this);
 }
 
-auto EyeV2::render(float dt, Node *hovered, Node *selected) -> void
+auto EyeV2::animate(float dt) -> void
 {
-  auto clampMouse = [&]() {
-    const auto mousePivot = (mouse - pivot()) * followStrength / 100.f;
-    const auto distance = glm::length(mousePivot);
-
-    if (distance > radius)
-    {
-      auto normalizedDirection = glm::normalize(mousePivot);
-      return normalizedDirection * radius;
-    }
-    return mousePivot;
-  }();
+  AnimSprite::animate(dt);
+  const auto mousePivot = (mouse - pivot()) * followStrength / 100.f;
+  const auto distance = glm::length(mousePivot);
+  follow = distance > radius ? glm::normalize(mousePivot) * radius : mousePivot;
+}
 
-  glTranslatef(clampMouse.x, clampMouse.y, .0f);
+auto EyeV2::render(float dt, Node *hovered, Node *selected) -> void
+{
+  batch.get().modelView(glm::translate(batch.get().modelView(), glm::vec3{follow, .0f}));
   AnimSprite::render(dt, hovered, selected);
   if (selected == this)
   {
+    batch.get().immediate();
     glBegin(GL_LINE_LOOP);
     const auto NumSegments = 100;
     for (auto i = 0; i < NumSegments; ++i)
@@ -186,12 +184,17 @@ auto EyeV2::renderUi() -> void
   }
 }
 
-auto EyeV2::ingest(const glm::mat4 &projMat, glm::vec2 v) -> void
+auto EyeV2::ingest(const glm::mat4 &projMat, glm::vec2) -> void
+{
+  const auto v = mouseTracking.get().onDisplay(screenTopLeft, screenBottomRight);
+  const auto newMouse = screenToLocal(projMat, v);
+  if (newMouse != mouse)
+    scheduler.get().invalidate();
+  mouse = newMouse;
+}
+
+auto EyeV2::isStatic() const -> bool
 {
-  v.x -= screenTopLeft.x;
-  v.y -= screenTopLeft.y;
-  auto &io = ImGui::GetIO();
-  v.x = v.x * io.DisplaySize.x / (screenBottomRight.x - screenTopLeft.x);
-  v.y = v.y * io.DisplaySize.y / (screenBottomRight.y - screenTopLeft.y);
-  mouse = screenToLocal(projMat, v);
+  // follows the mouse from render()
+  return false;
 }
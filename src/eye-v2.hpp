@@ -22,15 +22,19 @@ private:
   float radius = 20.f;
   float followStrength = 4.f;
   glm::vec2 mouse;
+  // the offset of the eye towards the mouse, worked out in animate()
+  glm::vec2 follow = {0.f, 0.f};
   std::reference_wrapper<MouseTracking> mouseTracking;
   glm::ivec2 screenTopLeft;
   glm::ivec2 screenBottomRight;
   std::string selectedDisplay;
 
+  auto animate(float dt) -> void final;
   auto load(IStrm &) -> void final;
   auto render(float dt, Node *hovered, Node *selected) -> void final;
   auto renderUi() -> void final;
   auto save(OStrm &) const -> void final;
   auto ingest(const glm::mat4 &projMat, glm::vec2 v) -> void final;
+  auto isStatic() const -> bool final;
   auto do_clone() const -> std::shared_ptr<Node> final;
 };
@@ -39,6 +39,7 @@ auto Eye::render(float dt, Node *hovered, Node *selected) -> void
   AnimSprite::render(dt, hovered, selected);
   if (selected == this)
   {
+    batch.get().immediate();
     glBegin(GL_LINE_LOOP);
     const auto NumSegments = 100;
     for (auto i = 0; i < NumSegments; ++i)
@@ -99,5 +100,14 @@ auto Eye::renderUi() -> void
 
 auto Eye::ingest(const glm::mat4 &projMat, glm::vec2 v) -> void
 {
-  mouse = screenToLocal(projMat, v);
+  const auto newMouse = screenToLocal(projMat, v);
+  if (newMouse != mouse)
+    scheduler.get().invalidate();
+  mouse = newMouse;
+}
+
+auto Eye::isStatic() const -> bool
+{
+  // follows the mouse from render()
+  return false;
 }
@@ -0,0 +1,106 @@
+#include "fallback-stt.hpp"
+#include <spdlog/spdlog.h>
+
+FallbackStt::FallbackStt(std::shared_ptr<SttBackend> aFirst, std::shared_ptr<SttBackend> aSecond)
+  : first(std::move(aFirst)), second(std::move(aSecond))
+{
+}
+
+auto FallbackStt::stream(int sampleRate, Callback cb, Callback onPartial) -> std::shared_ptr<SttBackend::Stream>
+{
+  auto ret = std::shared_ptr<Stream>(new Stream{weak_self(), sampleRate, nextTurn++});
+  // the slot in the order is taken now, the transcript fills it later
+  results.emplace(ret->turn, std::pair{std::move(cb), std::optional<std::string>{}});
+  auto onText = [alive = weak_self(), s = std::weak_ptr<Stream>{ret}](std::string_view txt) {
+    auto self = alive.lock();
+    auto segment = s.lock();
+    if (!self || !segment)
+    {
+      SPDLOG_INFO("this was destroyed");
+      return;
+    }
+    if (segment->isFallback)
+      self->resolve(*segment, std::string{txt});
+    else
+      self->onFirst(segment, txt);
+  };
+  ret->isFallback = !first->isReady();
+  if (ret->isFallback)
+    ret->inner = second->stream(sampleRate, std::move(onText));
+  else
+    ret->inner = first->stream(sampleRate, std::move(onText), std::move(onPartial));
+  return ret;
+}
+
+auto FallbackStt::onFirst(const std::shared_ptr<Stream> &s, std::string_view txt) -> void
+{
+  if (!txt.empty())
+  {
+    resolve(*s, std::string{txt});
+    return;
+  }
+  SPDLOG_INFO("Nothing recognized, asking the fallback recognizer");
+  s->isFallback = true;
+  s->inner = second->perform(s->wav, s->sampleRate, [alive = weak_self(), w = std::weak_ptr<Stream>{s}](std::string_view v) {
+    auto self = alive.lock();
+    auto segment = w.lock();
+    if (self && segment)
+      self->resolve(*segment, std::string{v});
+    else
+      SPDLOG_INFO("this was destroyed");
+  });
+  s->wav = {};
+}
+
+auto FallbackStt::resolve(Stream &s, std::optional<std::string> txt) -> void
+{
+  if (s.resolved)
+    return;
+  s.resolved = true;
+  auto &[cb, ready] = results.find(s.turn)->second;
+  // a cancelled stream calls nothing, it only stops holding up the ones after it
+  if (!txt)
+    cb = nullptr;
+  ready = txt.value_or("");
+  for (auto it = results.find(playhead); it != std::end(results) && it->second.second; it = results.find(playhead))
+  {
+    // taken out before the call, the callback may open a new stream or cancel one
+    auto [next, text] = std::move(it->second);
+    results.erase(it);
+    ++playhead;
+    if (next)
+      next(*text);
+  }
+}
+
+FallbackStt::Stream::Stream(std::weak_ptr<FallbackStt> aOwner, int aSampleRate, uint64_t aTurn)
+  : owner(std::move(aOwner)), sampleRate(aSampleRate), turn(aTurn)
+{
+}
+
+auto FallbackStt::Stream::push(std::span<const int16_t> v) -> void
+{
+  if (finished || cancelled)
+    return;
+  if (!isFallback)
+    wav.insert(std::end(wav), std::begin(v), std::end(v));
+  inner->push(v);
+}
+
+auto FallbackStt::Stream::finish() -> void
+{
+  if (finished || cancelled)
+    return;
+  finished = true;
+  inner->finish();
+}
+
+auto FallbackStt::Stream::cancel() -> void
+{
+  if (cancelled || resolved)
+    return;
+  cancelled = true;
+  inner->cancel();
+  if (auto self = owner.lock())
+    self->resolve(*this, std::nullopt);
+}
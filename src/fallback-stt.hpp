@@ -0,0 +1,54 @@
+#pragma once
+#include "shared_from_this.hpp"
+#include "stt-backend.hpp"
+#include "wav.hpp"
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Recognizes with the first backend and asks the second one when the first one is not ready yet
+// or heard no words, e.g. local recognition first and the cloud for what it misses. The audio is
+// kept until the first backend is done, the second one only gets the segments it has to redo;
+// the transcripts still come back in the order the streams were opened.
+class FallbackStt final : public SttBackend, public virtual enable_shared_from_this
+{
+public:
+  FallbackStt(std::shared_ptr<SttBackend> first, std::shared_ptr<SttBackend> second);
+  auto stream(int sampleRate, Callback, Callback onPartial = nullptr) -> std::shared_ptr<SttBackend::Stream> final;
+
+  class Stream final : public SttBackend::Stream
+  {
+  public:
+    auto push(std::span<const int16_t>) -> void final;
+    auto finish() -> void final;
+    auto cancel() -> void final;
+    auto done() const -> bool final { return resolved; }
+
+  private:
+    friend class FallbackStt;
+    Stream(std::weak_ptr<FallbackStt>, int sampleRate, uint64_t turn);
+
+    std::weak_ptr<FallbackStt> owner;
+    int sampleRate;
+    uint64_t turn;
+    std::shared_ptr<SttBackend::Stream> inner;
+    // what the second backend gets, only kept while the first one has the stream
+    Wav wav;
+    bool isFallback = false;
+    bool finished = false;
+    bool cancelled = false;
+    bool resolved = false;
+  };
+
+private:
+  std::shared_ptr<SttBackend> first;
+  std::shared_ptr<SttBackend> second;
+  // transcripts that came back before the ones of earlier streams, nullopt for cancelled ones
+  std::map<uint64_t, std::pair<Callback, std::optional<std::string>>> results;
+  uint64_t playhead = 0;
+  uint64_t nextTurn = 0;
+
+  auto onFirst(const std::shared_ptr<Stream> &, std::string_view) -> void;
+  auto resolve(Stream &, std::optional<std::string>) -> void;
+};
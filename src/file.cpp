@@ -1,7 +1,24 @@
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
 #include "file.hpp"
 #include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <cerrno>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 UniqueFile open_file(std::filesystem::path const &path, char const *mode) noexcept
 {
@@ -22,3 +39,159 @@ UniqueFile open_file(std::filesystem::path const &path, char const *mode) noexce
   return UniqueFile(std::fopen(path.c_str(), mode));
 #endif
 }
+
+std::filesystem::path temp_path_for(std::filesystem::path const &path)
+{
+  static auto counter = std::atomic<unsigned long long>{0};
+#ifdef _WIN32
+  auto const pid = _getpid();
+#else
+  auto const pid = ::getpid();
+#endif
+  auto ret = path;
+  ret += "." + std::to_string(pid) + "." + std::to_string(counter.fetch_add(1, std::memory_order_relaxed)) + ".tmp";
+  return ret;
+}
+
+namespace
+{
+  bool sync_file(std::FILE *fp) noexcept
+  {
+    if (std::fflush(fp) != 0)
+      return false;
+#ifdef _WIN32
+    return _commit(_fileno(fp)) == 0;
+#else
+    return ::fsync(::fileno(fp)) == 0;
+#endif
+  }
+} // namespace
+
+bool write_file_atomically(std::filesystem::path const &path, std::string_view data) noexcept
+{
+  auto const tmp = temp_path_for(path);
+  auto ec = std::error_code{};
+  {
+    auto fp = open_file(tmp, "wb");
+    if (!fp)
+      return false;
+    if (std::fwrite(data.data(), 1, data.size(), fp.get()) != data.size() || !sync_file(fp.get()))
+    {
+      auto const err = errno;
+      fp.reset();
+      std::filesystem::remove(tmp, ec);
+      errno = err;
+      return false;
+    }
+  }
+  // replaces an existing file on Windows as well
+  std::filesystem::rename(tmp, path, ec);
+  if (ec)
+  {
+    std::filesystem::remove(tmp, ec);
+    errno = EIO;
+    return false;
+  }
+  return true;
+}
+
+bool append_file_synced(std::filesystem::path const &path, std::string_view data) noexcept
+{
+  auto fp = open_file(path, "ab");
+  if (!fp)
+    return false;
+  return std::fwrite(data.data(), 1, data.size(), fp.get()) == data.size() && sync_file(fp.get());
+}
+
+#ifdef _WIN32
+MappedFile::MappedFile(std::filesystem::path const &path) noexcept
+{
+  // a mapped bundle can be exported over, the rename replaces the name while the view stays valid
+  auto const file = CreateFileW(path.c_str(),
+                                GENERIC_READ,
+                                FILE_SHARE_READ | FILE_SHARE_DELETE,
+                                nullptr,
+                                OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL,
+                                nullptr);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    errno = ENOENT;
+    return;
+  }
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+  {
+    CloseHandle(file);
+    errno = EIO;
+    return;
+  }
+  size_ = static_cast<std::size_t>(size.QuadPart);
+  if (size_ == 0)
+  {
+    // an empty file cannot be mapped, and needs not be
+    CloseHandle(file);
+    ok = true;
+    return;
+  }
+  mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  // the mapping keeps the file open
+  CloseHandle(file);
+  if (!mapping)
+  {
+    errno = EIO;
+    return;
+  }
+  data_ = static_cast<char const *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (!data_)
+  {
+    errno = ENOMEM;
+    return;
+  }
+  ok = true;
+}
+
+MappedFile::~MappedFile()
+{
+  if (data_)
+    UnmapViewOfFile(data_);
+  if (mapping)
+    CloseHandle(mapping);
+}
+#else
+MappedFile::MappedFile(std::filesystem::path const &path) noexcept
+{
+  auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  struct stat st;
+  if (::fstat(fd, &st) != 0)
+  {
+    ::close(fd);
+    return;
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  if (size_ == 0)
+  {
+    // an empty file cannot be mapped, and needs not be
+    ::close(fd);
+    ok = true;
+    return;
+  }
+  auto const ptr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file open
+  ::close(fd);
+  if (ptr == MAP_FAILED)
+    return;
+  // read front to back once
+  ::madvise(ptr, size_, MADV_SEQUENTIAL);
+  data_ = static_cast<char const *>(ptr);
+  ok = true;
+}
+
+MappedFile::~MappedFile()
+{
+  if (data_)
+    ::munmap(const_cast<char *>(data_), size_);
+}
+#endif
@@ -3,6 +3,7 @@
 #include <cstdio>
 #include <filesystem>
 #include <memory>
+#include <string_view>
 
 struct FileDeleter
 {
@@ -13,3 +14,38 @@ using UniqueFile = std::unique_ptr<std::FILE, FileDeleter>;
 
 // just like fopen, return null on error setting errno
 UniqueFile open_file(std::filesystem::path const &path, char const *mode) noexcept;
+
+// a name next to path for a file that is renamed over it once written, not picked by another
+// writer of the same path in this or any other process
+std::filesystem::path temp_path_for(std::filesystem::path const &path);
+
+// writes data next to path, flushes it to the disk and renames it over path, so after a crash the
+// file holds either the old or the new contents; false on error setting errno
+bool write_file_atomically(std::filesystem::path const &path, std::string_view data) noexcept;
+
+// appends data to path, creating it if needed, and flushes it to the disk; a crash can leave a
+// part of data at the end; false on error setting errno
+bool append_file_synced(std::filesystem::path const &path, std::string_view data) noexcept;
+
+// A whole file mapped read-only into memory, so a reader can parse it in place without copying
+// it into a buffer first. False on error with errno set, like open_file.
+class MappedFile
+{
+public:
+  MappedFile(std::filesystem::path const &path) noexcept;
+  MappedFile(MappedFile const &) = delete;
+  MappedFile &operator=(MappedFile const &) = delete;
+  ~MappedFile();
+  explicit operator bool() const noexcept { return ok; }
+  auto data() const noexcept -> char const * { return data_; }
+  auto size() const noexcept -> std::size_t { return size_; }
+  auto view() const noexcept -> std::string_view { return {data_, size_}; }
+
+private:
+  char const *data_ = nullptr;
+  std::size_t size_ = 0;
+  bool ok = false;
+#ifdef _WIN32
+  void *mapping = nullptr;
+#endif
+};
@@ -1,5 +1,8 @@
 #include "font.hpp"
 #include "file.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <spdlog/spdlog.h>
 
 namespace
@@ -20,6 +23,85 @@ namespace
     ~FontInitializer() { TTF_Quit(); }
     static auto init() -> void { static FontInitializer init; }
   };
+
+  auto nextVersion() -> uint64_t
+  {
+    static auto last = std::atomic<uint64_t>{0};
+    return last.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+
+  // decodes one code point and advances it; malformed sequences become U+FFFD
+  auto nextCodePoint(std::string::const_iterator &it, std::string::const_iterator end) -> Uint32
+  {
+    const auto c = static_cast<unsigned char>(*it++);
+    auto len = 0;
+    auto ret = Uint32{};
+    if (c < 0x80)
+      return c;
+    if ((c & 0xe0) == 0xc0)
+    {
+      len = 1;
+      ret = c & 0x1f;
+    }
+    else if ((c & 0xf0) == 0xe0)
+    {
+      len = 2;
+      ret = c & 0x0f;
+    }
+    else if ((c & 0xf8) == 0xf0)
+    {
+      len = 3;
+      ret = c & 0x07;
+    }
+    else
+      return 0xfffd;
+    for (; len > 0; --len)
+    {
+      if (it == end || (static_cast<unsigned char>(*it) & 0xc0) != 0x80)
+        return 0xfffd;
+      ret = (ret << 6) | (static_cast<unsigned char>(*it++) & 0x3f);
+    }
+    return ret;
+  }
+
+  // white texels with the signed distance to the edge of the glyph's coverage in alpha, one half
+  // on the edge and Font::Spread texels of it on every side
+  auto distanceField(const SDL_Surface &surface) -> std::vector<unsigned char>
+  {
+    constexpr auto S = Font::Spread;
+    const auto w = surface.w + 2 * S;
+    const auto h = surface.h + 2 * S;
+    auto inside = std::vector<bool>(static_cast<size_t>(w * h));
+    for (auto y = 0; y < surface.h; ++y)
+    {
+      // ARGB8888 is BGRA in memory
+      const auto *row = static_cast<const unsigned char *>(surface.pixels) + y * surface.pitch;
+      for (auto x = 0; x < surface.w; ++x)
+        inside[static_cast<size_t>((y + S) * w + x + S)] = row[x * 4 + 3] >= 128;
+    }
+    auto ret = std::vector<unsigned char>(static_cast<size_t>(w * h * 4), 255);
+    for (auto y = 0; y < h; ++y)
+      for (auto x = 0; x < w; ++x)
+      {
+        const auto in = inside[static_cast<size_t>(y * w + x)];
+        // the nearest texel on the other side within the spread, squared
+        auto nearest = (S + 1) * (S + 1);
+        for (auto dy = -S; dy <= S; ++dy)
+          for (auto dx = -S; dx <= S; ++dx)
+          {
+            const auto nx = x + dx;
+            const auto ny = y + dy;
+            const auto other = nx >= 0 && nx < w && ny >= 0 && ny < h && inside[static_cast<size_t>(ny * w + nx)];
+            if (other != in)
+              nearest = std::min(nearest, dx * dx + dy * dy);
+          }
+        // the edge runs between the texel centers
+        const auto d = std::min(std::sqrt(static_cast<float>(nearest)) - .5f, static_cast<float>(S));
+        const auto v = .5f + (in ? d : -d) / (2.f * S);
+        ret[static_cast<size_t>((y * w + x) * 4 + 3)] = static_cast<unsigned char>(std::clamp(v, 0.f, 1.f) * 255.f + .5f);
+      }
+    return ret;
+  }
 } // namespace
 
 void Font::FontDeleter::operator()(TTF_Font *ptr) const noexcept
@@ -27,88 +109,212 @@ void Font::FontDeleter::operator()(TTF_Font *ptr) const noexcept
   TTF_CloseFont(ptr);
 }
 
-Font::Font(std::filesystem::path file, int ptsize)
-  : file_(std::move(file)),
+Font::Font(SpriteBatch &aBatch,
+           std::filesystem::path file,
+           int ptsize,
+           std::shared_ptr<const AssetBundle> aBundle,
+           bool distanceField)
+  : batch(aBatch),
+    file_(std::move(file)),
     ptsize_(ptsize),
+    bundle(std::move(aBundle)),
     font([this]() {
       FontInitializer::init();
+      if (auto bytes = bundle ? bundle->find(file_.string()) : std::nullopt)
+        return TTF_OpenFontRW(
+          SDL_RWFromConstMem(bytes->data(), static_cast<int>(bytes->size())), SDL_TRUE, this->ptsize());
       auto fp = open_file(this->file(), "rb");
       auto *rw = SDL_RWFromFP(fp.get(), SDL_FALSE);
       return TTF_OpenFontRW(rw, SDL_TRUE, this->ptsize());
-    }())
+    }()),
+    isDistanceField_(distanceField),
+    version_(nextVersion())
 {
   if (!font)
     SPDLOG_ERROR("TTF_OpenFont: {}", TTF_GetError());
+  else
+    height = TTF_FontHeight(font.get());
 }
 
 Font::~Font()
 {
+  for (auto &page : pages)
+    glDeleteTextures(1, &page.texture);
 }
 
-auto Font::render(glm::vec2 pos, const std::string &txt) -> void
-{
-  auto &tex = getTextureFromCache(txt);
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, tex.texture());
-  glBegin(GL_QUADS);
-  glTexCoord2f(.0f, .0f);
-  glVertex2f(pos.x, pos.y + tex.h());
-  glTexCoord2f(1.f, .0f);
-  glVertex2f(pos.x + tex.w(), pos.y + tex.h());
-  glTexCoord2f(1.f, 1.f);
-  glVertex2f(pos.x + tex.w(), pos.y);
-  glTexCoord2f(.0f, 1.f);
-  glVertex2f(pos.x, pos.y);
-  glEnd();
-  glBindTexture(GL_TEXTURE_2D, 0);
-  glDisable(GL_TEXTURE_2D);
+template <typename F>
+auto Font::layout(const std::string &txt, F &&f) const -> int
+{
+  auto pen = 0;
+  auto width = 0;
+  auto prev = Uint32{};
+  for (auto it = std::begin(txt); it != std::end(txt);)
+  {
+    const auto ch = nextCodePoint(it, std::end(txt));
+    if (prev && font)
+      pen += TTF_GetFontKerningSizeGlyphs32(font.get(), prev, ch);
+    // copied because rasterizing a later glyph may reset the atlas
+    const auto g = glyph(ch);
+    f(g, pen);
+    width = std::max({width, pen + g.advance, pen + g.maxX});
+    pen += g.advance;
+    prev = ch;
+  }
+  return width;
 }
 
-auto Font::getTextureFromCache(const std::string &txt) const -> Texture &
+auto Font::render(glm::vec2 pos, const std::string &txt, glm::vec4 color) -> void
 {
+  if (field)
   {
-    auto it = texturesCache.find(txt);
-    if (it != texturesCache.end())
-    {
-      cacheAge.erase(it->second.second);
-      cacheAge.push_back(txt);
-      it->second.second = std::end(cacheAge);
-      --it->second.second;
-      return it->second.first;
-    }
+    lastDrawn_ = std::chrono::steady_clock::now();
+    field->draw(pos, txt, color, static_cast<float>(ptsize_) / static_cast<float>(field->ptsize_));
+    return;
   }
+  draw(pos, txt, color, 1.f);
+}
+
+auto Font::draw(glm::vec2 pos, const std::string &txt, glm::vec4 color, float scale) -> void
+{
+  lastDrawn_ = std::chrono::steady_clock::now();
+  layout(txt, [&](const Glyph &g, int pen) {
+    if (g.w == 0 || g.h == 0)
+      return;
+    const auto x = pos.x + static_cast<float>(pen + g.xOffset - g.pad) * scale;
+    const auto y = pos.y - static_cast<float>(g.pad) * scale;
+    batch.get().quad(g.texture,
+                     glm::vec2{x, y + static_cast<float>(g.h) * scale},
+                     glm::vec2{x + static_cast<float>(g.w) * scale, y},
+                     g.uv0,
+                     g.uv1,
+                     color,
+                     isDistanceField_);
+  });
+}
+
+auto Font::glyph(Uint32 ch) const -> const Glyph &
+{
+  auto it = glyphs.find(ch);
+  if (it != std::end(glyphs))
+    return it->second;
+  auto g = rasterize(ch);
+  return glyphs.emplace(ch, g).first->second;
+}
+
+auto Font::rasterize(Uint32 ch) const -> Glyph
+{
+  auto ret = Glyph{};
+  if (!font)
+    return ret;
+  int minX, maxX, minY, maxY, advance;
+  if (TTF_GlyphMetrics32(font.get(), ch, &minX, &maxX, &minY, &maxY, &advance) != 0)
+    return ret;
+  ret.advance = advance;
+  ret.maxX = maxX;
+  // SDL_ttf shifts the bitmap right when the glyph overhangs the pen position
+  ret.xOffset = std::min(0, minX);
 
-  SDL_Surface *surface = TTF_RenderUTF8_Blended(font.get(), txt.c_str(), {255, 255, 255, 255});
+  auto surface = TTF_RenderGlyph32_Blended(font.get(), ch, {255, 255, 255, 255});
   if (!surface)
   {
-    SPDLOG_ERROR("TTF_RenderText_Blended: {}", TTF_GetError());
-    surface = SDL_CreateRGBSurfaceWithFormat(0,  // The flags are obsolete and should be set to 0.
-                                             16, //  The width in pixels of the surface to create.
-                                             16, //  The height in pixels of the surface to create.
-                                             32, // The depth in bits of the surface to create.
-                                             SDL_PIXELFORMAT_RGBA32);
+    SPDLOG_ERROR("TTF_RenderGlyph32_Blended: {}", TTF_GetError());
+    return ret;
+  }
+  if (surface->format->BytesPerPixel != 4)
+  {
+    auto tmp = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(surface);
+    if (!tmp)
+      return ret;
+    surface = tmp;
+  }
+  auto w = surface->w;
+  auto h = surface->h;
+  const void *pixels = surface->pixels;
+  auto rowLength = surface->pitch / 4;
+  auto distances = std::vector<unsigned char>{};
+  if (isDistanceField_ && w > 0 && h > 0)
+  {
+    distances = distanceField(*surface);
+    w += 2 * Spread;
+    h += 2 * Spread;
+    pixels = distances.data();
+    rowLength = 0;
+    ret.pad = Spread;
+  }
+  if (w <= 0 || h <= 0 || w + 1 > PageSize || h + 1 > PageSize)
+  {
+    SDL_FreeSurface(surface);
+    return ret;
   }
 
-  auto tmp = texturesCache.emplace(txt, std::pair{surface, std::begin(cacheAge)});
-  assert(tmp.second);
-
-  SDL_FreeSurface(surface);
-  cacheAge.push_back(txt);
-  tmp.first->second.second = std::end(cacheAge);
-  --tmp.first->second.second;
-  while (cacheAge.size() > 200)
+  // shelf packing with a 1px gutter so linear filtering does not bleed between glyphs
+  auto fits = [&](const Page &p) {
+    return (p.shelfX + w + 1 <= PageSize && p.shelfY + h + 1 <= PageSize) || p.shelfY + p.shelfH + h + 1 <= PageSize;
+  };
+  if (pages.empty() || !fits(pages.back()))
+  {
+    if (pages.size() >= MaxPages)
+      clearAtlas();
+    else
+    {
+      auto page = Page{};
+      glGenTextures(1, &page.texture);
+      glBindTexture(GL_TEXTURE_2D, page.texture);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      const auto zeros = std::vector<unsigned char>(PageSize * PageSize * 4);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, PageSize, PageSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, zeros.data());
+      pages.push_back(page);
+    }
+  }
+  auto &page = pages.back();
+  if (page.shelfX + w + 1 > PageSize || page.shelfY + h + 1 > PageSize)
   {
-    texturesCache.erase(cacheAge.front());
-    cacheAge.erase(std::begin(cacheAge));
+    page.shelfY += page.shelfH;
+    page.shelfX = 0;
+    page.shelfH = 0;
   }
-  return tmp.first->second.first;
+  const auto x = page.shelfX;
+  const auto y = page.shelfY;
+  page.shelfX += w + 1;
+  page.shelfH = std::max(page.shelfH, h + 1);
+
+  // Blended surfaces are ARGB8888, i.e. BGRA in memory; the text is white so only alpha matters
+  glBindTexture(GL_TEXTURE_2D, page.texture);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+  glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+  glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+  SDL_FreeSurface(surface);
+
+  ret.texture = page.texture;
+  ret.w = w;
+  ret.h = h;
+  ret.uv0 = glm::vec2{1.f * x / PageSize, 1.f * y / PageSize};
+  ret.uv1 = glm::vec2{1.f * (x + w) / PageSize, 1.f * (y + h) / PageSize};
+  return ret;
+}
+
+auto Font::clearAtlas() const -> void
+{
+  // queued quads still reference the glyphs that are about to be overwritten
+  batch.get().flush();
+  glyphs.clear();
+  for (auto it = std::begin(pages) + 1; it != std::end(pages); ++it)
+    glDeleteTextures(1, &it->texture);
+  pages.resize(1);
+  pages.front().shelfX = 0;
+  pages.front().shelfY = 0;
+  pages.front().shelfH = 0;
 }
 
 auto Font::getSize(const std::string &txt) const -> glm::vec2
 {
-  int w, h;
-  TTF_SizeUTF8(font.get(), txt.c_str(), &w, &h);
-  return glm::vec2{w, h};
+  if (field)
+    return field->getSize(txt) * (static_cast<float>(ptsize_) / static_cast<float>(field->ptsize_));
+  return glm::vec2{layout(txt, [](const Glyph &, int) {}), height};
 }
 
 auto Font::file() const -> const std::filesystem::path &
@@ -120,3 +326,33 @@ auto Font::ptsize() const -> int
 {
   return ptsize_;
 }
+
+auto Font::bytes() const -> size_t
+{
+  return pages.size() * PageSize * PageSize * 4;
+}
+
+auto Font::trim() -> size_t
+{
+  if (pages.size() <= 1)
+    return 0;
+  const auto before = bytes();
+  clearAtlas();
+  return before - bytes();
+}
+
+auto Font::useDistanceField(std::shared_ptr<Font> v) -> void
+{
+  if (v == field)
+    return;
+  // queued quads may still draw from the pages about to go
+  batch.get().flush();
+  field = std::move(v);
+  version_ = nextVersion();
+  if (!field)
+    return;
+  glyphs.clear();
+  for (auto &page : pages)
+    glDeleteTextures(1, &page.texture);
+  pages.clear();
+}
@@ -1,24 +1,57 @@
 #pragma once
-#include "texture.hpp"
+#include "asset-bundle.hpp"
+#include "sprite-batch.hpp"
 #include <SDL_opengl.h>
 #include <SDL_ttf.h>
+#include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
-#include <list>
+#include <glm/vec4.hpp>
+#include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
+// Text is drawn from a glyph atlas: every code point is rasterized once into a shelf packed page
+// and strings become one batched quad per glyph, so the cost does not grow with the number of
+// distinct strings.
+//
+// A distance field font rasterizes its glyphs once at DistanceFieldSize as signed distances to
+// the outline, and fonts of any size can draw from it scaled: the edge is where the distance
+// crosses one half, so it stays sharp however far the text is scaled up.
 class Font
 {
 public:
-  Font(std::filesystem::path, int);
+  // with a bundle the font is read from it rather than from the file, and keeps it mapped
+  Font(SpriteBatch &,
+       std::filesystem::path,
+       int,
+       std::shared_ptr<const AssetBundle> bundle = nullptr,
+       bool distanceField = false);
   ~Font();
 
-  auto render(glm::vec2, const std::string &) -> void;
+  auto render(glm::vec2, const std::string &, glm::vec4 color = glm::vec4{1.f, 1.f, 1.f, 1.f}) -> void;
   auto getSize(const std::string &) const -> glm::vec2;
   auto file() const -> const std::filesystem::path &;
   auto ptsize() const -> int;
+  // the glyph atlas pages on the GPU
+  auto bytes() const -> size_t;
+  auto lastDrawn() const -> std::chrono::steady_clock::time_point { return lastDrawn_; }
+  // drops the atlas down to its first page, the glyphs are rasterized again as they are drawn;
+  // returns the bytes freed
+  auto trim() -> size_t;
+  // draws the glyphs of a distance field font scaled to this size instead of its own, which are
+  // dropped; null goes back to them
+  auto useDistanceField(std::shared_ptr<Font>) -> void;
+  // changes with the metrics, when the font switches to or from a distance field; no two fonts
+  // share one, so it also tells a font apart from another made at the same address
+  auto version() const -> uint64_t { return version_; }
+
+  static constexpr auto DistanceFieldSize = 48;
+  // texels of distance around every glyph, the furthest the edge can be moved or smoothed
+  static constexpr auto Spread = 6;
 
 private:
   struct FontDeleter
@@ -26,11 +59,49 @@ private:
     void operator()(TTF_Font *ptr) const noexcept;
   };
 
+  struct Glyph
+  {
+    GLuint texture = 0;
+    glm::vec2 uv0;
+    glm::vec2 uv1;
+    int xOffset = 0;
+    int w = 0;
+    int h = 0;
+    int advance = 0;
+    int maxX = 0;
+    // the distance around the outline in the bitmap, not in the metrics
+    int pad = 0;
+  };
+
+  struct Page
+  {
+    GLuint texture = 0;
+    int shelfX = 0;
+    int shelfY = 0;
+    int shelfH = 0;
+  };
+
+  static constexpr auto PageSize = 1024;
+  static constexpr auto MaxPages = 4;
+
+  std::reference_wrapper<SpriteBatch> batch;
   std::filesystem::path file_;
   int ptsize_;
+  // SDL_ttf reads the file lazily, so the mapping has to outlive the font
+  std::shared_ptr<const AssetBundle> bundle;
   std::unique_ptr<TTF_Font, FontDeleter> font;
-  mutable std::unordered_map<std::string, std::pair<Texture, std::list<std::string>::iterator>> texturesCache;
-  mutable std::list<std::string> cacheAge;
+  int height = 0;
+  bool isDistanceField_;
+  std::shared_ptr<Font> field;
+  uint64_t version_;
+  mutable std::unordered_map<Uint32, Glyph> glyphs;
+  mutable std::vector<Page> pages;
+  std::chrono::steady_clock::time_point lastDrawn_;
 
-  auto getTextureFromCache(const std::string &text) const -> Texture &;
+  auto glyph(Uint32 ch) const -> const Glyph &;
+  auto rasterize(Uint32 ch) const -> Glyph;
+  auto clearAtlas() const -> void;
+  auto draw(glm::vec2, const std::string &, glm::vec4 color, float scale) -> void;
+  template <typename F>
+  auto layout(const std::string &, F &&) const -> int;
 };
@@ -0,0 +1,49 @@
+#include "frame-arena.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+FrameArena::FrameArena(size_t initialBytes)
+{
+  blocks.push_back(Block{std::make_unique_for_overwrite<std::byte[]>(initialBytes), initialBytes});
+}
+
+auto FrameArena::allocate(size_t bytes, size_t align) -> void *
+{
+  auto &block = blocks.back();
+  const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+  const auto start = (base + offset + align - 1) & ~(align - 1);
+  if (start + bytes <= base + block.size)
+  {
+    offset = start - base + bytes;
+    used_ += bytes;
+    return reinterpret_cast<void *>(start);
+  }
+  // a spill block, at least the size of the first one and only kept until reset()
+  const auto size = std::max(bytes + align, blocks.front().size);
+  blocks.push_back(Block{std::make_unique_for_overwrite<std::byte[]>(size), size});
+  offset = 0;
+  return allocate(bytes, align);
+}
+
+auto FrameArena::reset() -> void
+{
+  highWater = std::max(highWater, used_);
+  if (blocks.size() > 1)
+  {
+    // alignment padding is not in used_, the headroom covers it
+    blocks.clear();
+    const auto size = std::bit_ceil(highWater + highWater / 4);
+    blocks.push_back(Block{std::make_unique_for_overwrite<std::byte[]>(size), size});
+  }
+  offset = 0;
+  used_ = 0;
+}
+
+auto FrameArena::capacity() const -> size_t
+{
+  auto ret = size_t{0};
+  for (const auto &b : blocks)
+    ret += b.size;
+  return ret;
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for the temporaries of one frame: sorted copies, scratch lists, formatted text.
+// Nothing is freed on its own, reset() at the start of the next frame takes everything back. A
+// frame that outgrows the block spills into extra blocks, and the next reset() replaces them
+// with one block big enough for all of them, so a scene past its first frames no longer touches
+// the heap for its temporaries. Main thread only.
+class FrameArena
+{
+public:
+  explicit FrameArena(size_t initialBytes = 64 * 1024);
+  FrameArena(const FrameArena &) = delete;
+  auto allocate(size_t bytes, size_t align) -> void *;
+  // everything allocated since the last reset() is invalid after it
+  auto reset() -> void;
+  // allocated since the last reset()
+  auto used() const -> size_t { return used_; }
+  auto capacity() const -> size_t;
+
+  template <typename T>
+  class Allocator
+  {
+  public:
+    using value_type = T;
+    explicit Allocator(FrameArena &a) : arena(&a) {}
+    template <typename U>
+    Allocator(const Allocator<U> &other) : arena(other.arena)
+    {
+    }
+    auto allocate(size_t n) -> T * { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    // taken back by reset()
+    auto deallocate(T *, size_t) -> void {}
+    template <typename U>
+    auto operator==(const Allocator<U> &other) const -> bool
+    {
+      return arena == other.arena;
+    }
+
+  private:
+    template <typename U>
+    friend class Allocator;
+    FrameArena *arena;
+  };
+
+  template <typename T>
+  using Vector = std::vector<T, Allocator<T>>;
+
+  template <typename T>
+  auto vector() -> Vector<T>
+  {
+    return Vector<T>{Allocator<T>{*this}};
+  }
+
+private:
+  struct Block
+  {
+    std::unique_ptr<std::byte[]> data;
+    size_t size = 0;
+  };
+  // the first one is the one the frames normally fit in
+  std::vector<Block> blocks;
+  size_t offset = 0;
+  size_t used_ = 0;
+  // the most a frame used, what the block grows to
+  size_t highWater = 0;
+};
@@ -0,0 +1,119 @@
+#include "frame-atlas.hpp"
+#include "gl-ext.hpp"
+#include <algorithm>
+#include <cmath>
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+
+auto FrameAtlas::make(const std::vector<std::shared_ptr<const Texture>> &frames) -> std::shared_ptr<const FrameAtlas>
+{
+  if (!isUploaded(frames))
+    return nullptr;
+  // the frames are copied at the size they were uploaded with, which the texture limit may shrink
+  const auto w = frames.front()->sharedImage()->w;
+  const auto h = frames.front()->sharedImage()->h;
+  for (const auto &t : frames)
+    if (t->sharedImage()->w != w || t->sharedImage()->h != h)
+      return nullptr;
+  auto maxSize = GLint{0};
+  glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+  const auto n = static_cast<int>(frames.size());
+  const auto cellW = w + Gutter;
+  const auto cellH = h + Gutter;
+  const auto cols = std::min(std::min(n, static_cast<int>(std::ceil(std::sqrt(n)))), std::max(1, maxSize / cellW));
+  const auto rows = (n + cols - 1) / cols;
+  if (cols * cellW > maxSize || rows * cellH > maxSize)
+    return nullptr;
+
+  auto ret = std::make_shared<FrameAtlas>(w, h, cols, rows);
+  GLint prevRead;
+  GLint prevDraw;
+  GLfloat prevClearColor[4];
+  glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &prevRead);
+  glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &prevDraw);
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, prevClearColor);
+  const auto scissor = glIsEnabled(GL_SCISSOR_TEST);
+  glDisable(GL_SCISSOR_TEST);
+
+  GLuint fbo[2];
+  GlExt::genFramebuffers(2, fbo);
+  GlExt::bindFramebuffer(GL_DRAW_FRAMEBUFFER, fbo[1]);
+  GlExt::framebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ret->texture_, 0);
+  glClearColor(0.f, 0.f, 0.f, 0.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  GlExt::bindFramebuffer(GL_READ_FRAMEBUFFER, fbo[0]);
+  for (auto i = 0; i < n; ++i)
+  {
+    GlExt::framebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, frames[i]->texture(), 0);
+    if (GlExt::checkFramebufferStatus(GL_READ_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+      SPDLOG_ERROR("Cannot read frame {} of {:?} for the atlas", i, frames[i]->path());
+      ret = nullptr;
+      break;
+    }
+    const auto x = i % cols * cellW;
+    const auto y = i / cols * cellH;
+    GlExt::blitFramebuffer(0, 0, w, h, x, y, x + w, y + h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    ret->images.push_back(frames[i]->imageId());
+  }
+
+  GlExt::bindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(prevRead));
+  GlExt::bindFramebuffer(GL_DRAW_FRAMEBUFFER, static_cast<GLuint>(prevDraw));
+  GlExt::deleteFramebuffers(2, fbo);
+  glClearColor(prevClearColor[0], prevClearColor[1], prevClearColor[2], prevClearColor[3]);
+  if (scissor)
+    glEnable(GL_SCISSOR_TEST);
+  return ret;
+}
+
+auto FrameAtlas::isUploaded(const std::vector<std::shared_ptr<const Texture>> &frames) -> bool
+{
+  // a single frame is one texture already
+  if (frames.size() < 2)
+    return false;
+  return std::all_of(
+    std::begin(frames), std::end(frames), [](const auto &t) { return t->isLoaded() && t->sharedImage(); });
+}
+
+FrameAtlas::FrameAtlas(int aW, int aH, int aCols, int aRows) : w(aW), h(aH), cols(aCols), rows(aRows)
+{
+  glGenTextures(1, &texture_);
+  glBindTexture(GL_TEXTURE_2D, texture_);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexImage2D(
+    GL_TEXTURE_2D, 0, GL_RGBA8, cols * (w + Gutter), rows * (h + Gutter), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+FrameAtlas::~FrameAtlas()
+{
+  glDeleteTextures(1, &texture_);
+}
+
+auto FrameAtlas::uv(int i) const -> std::pair<glm::vec2, glm::vec2>
+{
+  const auto atlasW = static_cast<float>(cols * (w + Gutter));
+  const auto atlasH = static_cast<float>(rows * (h + Gutter));
+  const auto x = static_cast<float>(i % cols * (w + Gutter));
+  const auto y = static_cast<float>(i / cols * (h + Gutter));
+  return {glm::vec2{(x + .5f) / atlasW, (y + .5f) / atlasH},
+          glm::vec2{(x + static_cast<float>(w) - .5f) / atlasW, (y + static_cast<float>(h) - .5f) / atlasH}};
+}
+
+auto FrameAtlas::matches(const std::vector<std::shared_ptr<const Texture>> &frames) const -> bool
+{
+  if (frames.size() != images.size())
+    return false;
+  for (auto i = size_t{0}; i < frames.size(); ++i)
+    if (frames[i]->imageId() != images[i])
+      return false;
+  return true;
+}
+
+auto FrameAtlas::bytes() const -> size_t
+{
+  return static_cast<size_t>(cols * (w + Gutter)) * static_cast<size_t>(rows * (h + Gutter)) * 4;
+}
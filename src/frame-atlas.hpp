@@ -0,0 +1,43 @@
+#pragma once
+#include "texture.hpp"
+#include <SDL_opengl.h>
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// The frames of an ImageList copied side by side into one texture on the GPU, so switching the
+// mouth or the blink frame is a change of UV rather than of texture and the sprite batch can
+// merge them with whatever else draws from it. Built once every frame is uploaded and they all
+// have the same size; the fixed function pipeline has no texture arrays, so this is an atlas.
+class FrameAtlas
+{
+public:
+  // null while a frame is still loading, when the sizes differ or the atlas would not fit
+  static auto make(const std::vector<std::shared_ptr<const Texture>> &) -> std::shared_ptr<const FrameAtlas>;
+  // there are frames to put together and all of them are uploaded, so a null make() is for good
+  static auto isUploaded(const std::vector<std::shared_ptr<const Texture>> &) -> bool;
+
+  FrameAtlas(int w, int h, int cols, int rows);
+  FrameAtlas(const FrameAtlas &) = delete;
+  ~FrameAtlas();
+  auto texture() const -> GLuint { return texture_; }
+  // the corners of frame i, half a texel in so filtering never reaches the neighbours
+  auto uv(int i) const -> std::pair<glm::vec2, glm::vec2>;
+  // false once a frame was added, removed or reloaded since the atlas was built
+  auto matches(const std::vector<std::shared_ptr<const Texture>> &) const -> bool;
+  auto bytes() const -> size_t;
+
+  // transparent texels between the frames
+  static constexpr auto Gutter = 1;
+
+private:
+  int w;
+  int h;
+  int cols;
+  int rows;
+  GLuint texture_ = 0;
+  // Texture::imageId() of the uploads the frames were copied from
+  std::vector<uint64_t> images;
+};
@@ -0,0 +1,25 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+
+// Per-frame state published once by App::sdlEventsAndRender. Everything that used to query GL for
+// the projection or read its own clock during the frame reads it from here instead, so the nodes
+// of a frame all see the same moment and the benchmarks, which set it themselves, replay the same
+// animation every run.
+struct FrameCtx
+{
+  glm::mat4 projMat = glm::mat4{1.f};
+  glm::vec2 viewport = {0.f, 0.f};
+  float dt = 0.f;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+  uint64_t frame = 0;
+  // per node render timing for the Outliner; GPU timing also flushes the batch after every node
+  bool profile = false;
+  bool profileGpu = false;
+  // Preferences::cacheStaticLayers
+  bool cacheLayers = true;
+  // drawn into a FrameOutput, which keeps its transparent clear instead of the background colors
+  bool transparent = false;
+};
@@ -0,0 +1,97 @@
+#include "frame-output.hpp"
+#include "gl-ext.hpp"
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+
+FrameOutput::FrameOutput(bool aPublish, std::string aRingName)
+  : publish(aPublish), ringName_(std::move(aRingName))
+{
+  GlExt::genFramebuffers(1, &fbo);
+  glGenTextures(1, &color);
+  GlExt::genBuffers(2, pbo);
+}
+
+FrameOutput::~FrameOutput()
+{
+  GlExt::deleteBuffers(2, pbo);
+  glDeleteTextures(1, &color);
+  GlExt::deleteFramebuffers(1, &fbo);
+}
+
+auto FrameOutput::resize(glm::ivec2 v) -> void
+{
+  size = v;
+  glBindTexture(GL_TEXTURE_2D, color);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size.x, size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  GlExt::bindFramebuffer(GL_FRAMEBUFFER, fbo);
+  GlExt::framebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+  if (GlExt::checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    SPDLOG_ERROR("Output framebuffer {}x{} is incomplete", size.x, size.y);
+  GlExt::bindFramebuffer(GL_FRAMEBUFFER, 0);
+
+  const auto bytes = static_cast<size_t>(size.x) * size.y * 4;
+  if (publish && (!ring || ring->capacity() < bytes))
+  {
+    ring = nullptr;
+    try
+    {
+      ring = std::make_unique<SharedFrameRing>(ringName_, bytes);
+    }
+    catch (std::runtime_error &e)
+    {
+      SPDLOG_ERROR("{:t}", e);
+    }
+  }
+}
+
+auto FrameOutput::begin(glm::ivec2 v) -> void
+{
+  if (v != size)
+    resize(v);
+  GlExt::bindFramebuffer(GL_FRAMEBUFFER, fbo);
+  glClearColor(0.f, 0.f, 0.f, 0.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+}
+
+auto FrameOutput::end(bool toWindow) -> void
+{
+  if (publish)
+    readback();
+  ++frame;
+
+  GlExt::bindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+  GlExt::bindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+  if (toWindow)
+    GlExt::blitFramebuffer(0, 0, size.x, size.y, 0, 0, size.x, size.y, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+  else
+    glClear(GL_COLOR_BUFFER_BIT);
+  GlExt::bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+auto FrameOutput::readback() -> void
+{
+  const auto cur = frame % 2;
+  const auto prev = 1 - cur;
+  const auto bytes = static_cast<GLsizeiptr>(size.x) * size.y * 4;
+
+  GlExt::bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[cur]);
+  GlExt::bufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+  glReadPixels(0, 0, size.x, size.y, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  pboPending[cur] = true;
+  pboSize[cur] = size;
+
+  if (pboPending[prev])
+  {
+    GlExt::bindBuffer(GL_PIXEL_PACK_BUFFER, pbo[prev]);
+    if (auto pixels = static_cast<const unsigned char *>(GlExt::mapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY)))
+    {
+      if (ring)
+        ring->publish(pixels, pboSize[prev].x, pboSize[prev].y);
+      GlExt::unmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    pboPending[prev] = false;
+  }
+  GlExt::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "shared-frame-ring.hpp"
+#include <SDL_opengl.h>
+#include <glm/vec2.hpp>
+#include <memory>
+#include <string>
+
+// Renders the scene into an RGBA framebuffer object and publishes it to a SharedFrameRing.
+// Readback goes through two pixel buffer objects: frame N is read asynchronously while frame N-1
+// is mapped and copied out, so the render thread never waits for the GPU.
+class FrameOutput
+{
+public:
+  // every reader maps its ring by name, each avatar publishes under its own
+  explicit FrameOutput(bool publish = true, std::string ringName = RingName);
+  FrameOutput(const FrameOutput &) = delete;
+  ~FrameOutput();
+  // binds the framebuffer sized to the viewport and clears it to transparent
+  auto begin(glm::ivec2 size) -> void;
+  // unbinds, queues the readback and optionally copies the frame onto the window
+  auto end(bool toWindow) -> void;
+  // whether an external consumer maps the published frames
+  auto isRead() -> bool { return publish && (!ring || ring->isRead()); }
+  auto ringName() const -> const std::string & { return ringName_; }
+
+  static constexpr auto RingName = "voicetuber-frames";
+
+private:
+  GLuint fbo = 0;
+  GLuint color = 0;
+  GLuint pbo[2] = {0, 0};
+  bool pboPending[2] = {false, false};
+  glm::ivec2 pboSize[2] = {};
+  glm::ivec2 size = {0, 0};
+  int frame = 0;
+  bool publish;
+  std::string ringName_;
+  std::unique_ptr<SharedFrameRing> ring;
+
+  auto resize(glm::ivec2) -> void;
+  auto readback() -> void;
+};
@@ -0,0 +1,36 @@
+#include "frame-pacer.hpp"
+#include <thread>
+
+auto FramePacer::reset(int fps) -> void
+{
+  period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>{1. / fps});
+  deadline = Clock::now();
+  missed_ = 0;
+}
+
+auto FramePacer::isNear(Clock::time_point now) const -> bool
+{
+  return now + std::chrono::milliseconds{1} >= deadline;
+}
+
+auto FramePacer::waitForDeadline() const -> void
+{
+  while (Clock::now() < deadline)
+    std::this_thread::yield();
+}
+
+auto FramePacer::frameStarted(Clock::time_point now) -> void
+{
+  if (now > deadline + period / 2)
+  {
+    ++missed_;
+    deadline = now + period;
+    return;
+  }
+  deadline += period;
+}
+
+auto FramePacer::missed() const -> uint64_t
+{
+  return missed_;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+
+// Paces fixed fps rendering against absolute deadlines. The uv timer only has millisecond
+// resolution, so it is used to get within a millisecond of the deadline and the remainder is
+// spun away. Deadlines advance by the exact period, so render time does not accumulate as drift.
+class FramePacer
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  auto reset(int fps) -> void;
+  auto isNear(Clock::time_point now) const -> bool;
+  auto waitForDeadline() const -> void;
+  // advances the deadline; a frame that starts more than half a period late counts as missed and
+  // restarts the schedule instead of rendering a burst to catch up
+  auto frameStarted(Clock::time_point now) -> void;
+  auto missed() const -> uint64_t;
+
+private:
+  Clock::duration period = std::chrono::milliseconds{16};
+  Clock::time_point deadline = Clock::now();
+  uint64_t missed_ = 0;
+};
@@ -0,0 +1,139 @@
+#include "gif-decoder.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// a private copy of stb_image with only the GIF loader, for its frame by frame decoder the public
+// API does not expose
+#define STB_IMAGE_STATIC
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_GIF
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdisabled-macro-expansion"
+#pragma GCC diagnostic ignored "-Wextra-semi-stmt"
+#pragma GCC diagnostic ignored "-Wimplicit-fallthrough"
+#pragma GCC diagnostic ignored "-Wimplicit-int-conversion"
+#pragma GCC diagnostic ignored "-Wunused-function"
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#include <stb_image.h>
+#pragma GCC diagnostic pop
+
+namespace
+{
+  struct Scan
+  {
+    GifDecoder::Info info;
+    // some frame is disposed of by restoring the one before it
+    bool restores = false;
+  };
+
+  auto scanBlocks(std::string_view bytes) -> Scan
+  {
+    auto ret = Scan{};
+    const auto p = reinterpret_cast<const unsigned char *>(bytes.data());
+    const auto size = bytes.size();
+    if (size < 13 || (bytes.substr(0, 6) != "GIF87a" && bytes.substr(0, 6) != "GIF89a"))
+      return ret;
+    const auto colorTable = [](unsigned char packed) { return packed & 0x80 ? size_t{3} << ((packed & 7) + 1) : 0; };
+    auto pos = size_t{13} + colorTable(p[10]);
+    // the data sub-blocks behind an extension or an image, a zero length ends them
+    const auto skipSubBlocks = [&]() {
+      while (pos < size && p[pos] != 0)
+        pos += p[pos] + size_t{1};
+      ++pos;
+    };
+    while (pos < size)
+    {
+      const auto tag = p[pos++];
+      if (tag == 0x21 && pos < size)
+      {
+        const auto label = p[pos++];
+        // the graphic control extension: length, packed fields, delay, transparent index
+        if (label == 0xf9 && pos + 1 < size && p[pos] >= 1 && ((p[pos + 1] >> 2) & 7) == 3)
+          ret.restores = true;
+        skipSubBlocks();
+      }
+      else if (tag == 0x2c && pos + 9 <= size)
+      {
+        const auto packed = p[pos + 8];
+        pos += 9 + colorTable(packed);
+        // the LZW minimum code size
+        ++pos;
+        skipSubBlocks();
+        // a truncated last frame is not counted
+        if (pos > size)
+          break;
+        ++ret.info.frames;
+      }
+      else
+        break;
+    }
+    if (ret.info.frames > 0)
+    {
+      ret.info.w = p[6] | (p[7] << 8);
+      ret.info.h = p[8] | (p[9] << 8);
+    }
+    return ret;
+  }
+} // namespace
+
+struct GifDecoder::Impl
+{
+  stbi__context ctx;
+  stbi__gif gif;
+  bool restores = false;
+  // the frames before the current one, kept only for the "restore to previous" disposal
+  std::vector<unsigned char> prev;
+  std::vector<unsigned char> twoBack;
+
+  auto freeFrame() -> void
+  {
+    STBI_FREE(gif.out);
+    STBI_FREE(gif.background);
+    STBI_FREE(gif.history);
+    std::memset(&gif, 0, sizeof(gif));
+  }
+};
+
+GifDecoder::GifDecoder(std::string_view aBytes) : bytes(aBytes), impl(std::make_unique<Impl>())
+{
+  std::memset(&impl->gif, 0, sizeof(impl->gif));
+  impl->restores = scanBlocks(bytes).restores;
+  rewind();
+}
+
+GifDecoder::~GifDecoder()
+{
+  impl->freeFrame();
+}
+
+auto GifDecoder::rewind() -> void
+{
+  impl->freeFrame();
+  stbi__start_mem(&impl->ctx, reinterpret_cast<const stbi_uc *>(bytes.data()), static_cast<int>(bytes.size()));
+  impl->prev.clear();
+  impl->twoBack.clear();
+  index_ = 0;
+}
+
+auto GifDecoder::next() -> const unsigned char *
+{
+  auto comp = 0;
+  auto twoBack = impl->twoBack.empty() ? nullptr : impl->twoBack.data();
+  const auto ret = static_cast<stbi_uc *>(stbi__gif_load_next(&impl->ctx, &impl->gif, &comp, 4, twoBack));
+  // the context itself marks the end of the stream
+  if (!ret || ret == reinterpret_cast<stbi_uc *>(&impl->ctx))
+    return nullptr;
+  if (impl->restores)
+  {
+    std::swap(impl->twoBack, impl->prev);
+    impl->prev.assign(ret, ret + static_cast<size_t>(impl->gif.w) * impl->gif.h * 4);
+  }
+  ++index_;
+  return ret;
+}
+
+auto GifDecoder::scan(std::string_view bytes) -> Info
+{
+  return scanBlocks(bytes).info;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <memory>
+#include <string_view>
+
+// Decodes an animated GIF one frame at a time, so only the frame being composed is in memory
+// rather than every frame of the loop as stbi_load_gif_from_memory() would have it. The bytes are
+// not copied and have to outlive the decoder. Not thread safe, one worker at a time.
+class GifDecoder
+{
+public:
+  struct Info
+  {
+    int w = 0;
+    int h = 0;
+    int frames = 0;
+  };
+
+  explicit GifDecoder(std::string_view bytes);
+  GifDecoder(const GifDecoder &) = delete;
+  ~GifDecoder();
+  // the next frame composed over the ones before, RGBA with the top row first, valid until the
+  // next call; null after the last frame or on a corrupt one
+  auto next() -> const unsigned char *;
+  // the frame next() returns next
+  auto index() const -> int { return index_; }
+  auto rewind() -> void;
+
+  // the size and the number of frames from the block structure, without decoding any pixels;
+  // frames is 0 when the bytes are not a GIF
+  static auto scan(std::string_view bytes) -> Info;
+
+private:
+  struct Impl;
+  std::string_view bytes;
+  std::unique_ptr<Impl> impl;
+  int index_ = 0;
+};
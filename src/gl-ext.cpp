@@ -0,0 +1,80 @@
+#include "gl-ext.hpp"
+#include <SDL.h>
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace
+{
+  template <typename T>
+  auto load(T &fn, const char *name) -> void
+  {
+    fn = reinterpret_cast<T>(SDL_GL_GetProcAddress(name));
+    if (!fn)
+      throw std::runtime_error(fmt::format("OpenGL function {} is not available", name));
+  }
+
+  template <typename T>
+  auto loadOptional(T &fn, const char *name) -> void
+  {
+    fn = reinterpret_cast<T>(SDL_GL_GetProcAddress(name));
+  }
+} // namespace
+
+namespace GlExt
+{
+  auto init() -> void
+  {
+    load(genBuffers, "glGenBuffers");
+    load(deleteBuffers, "glDeleteBuffers");
+    load(bindBuffer, "glBindBuffer");
+    load(bufferData, "glBufferData");
+    load(mapBuffer, "glMapBuffer");
+    load(unmapBuffer, "glUnmapBuffer");
+    load(genFramebuffers, "glGenFramebuffers");
+    load(deleteFramebuffers, "glDeleteFramebuffers");
+    load(bindFramebuffer, "glBindFramebuffer");
+    load(framebufferTexture2D, "glFramebufferTexture2D");
+    load(checkFramebufferStatus, "glCheckFramebufferStatus");
+    load(blitFramebuffer, "glBlitFramebuffer");
+    // part of the framebuffer objects above
+    load(generateMipmap, "glGenerateMipmap");
+    load(blendFuncSeparate, "glBlendFuncSeparate");
+    loadOptional(genQueries, "glGenQueries");
+    loadOptional(deleteQueries, "glDeleteQueries");
+    loadOptional(beginQuery, "glBeginQuery");
+    loadOptional(endQuery, "glEndQuery");
+    loadOptional(getQueryObjectiv, "glGetQueryObjectiv");
+    loadOptional(getQueryObjectui64v, "glGetQueryObjectui64v");
+    if (!genQueries || !deleteQueries || !beginQuery || !endQuery || !getQueryObjectiv)
+      getQueryObjectui64v = nullptr;
+    loadOptional(createShader, "glCreateShader");
+    loadOptional(shaderSource, "glShaderSource");
+    loadOptional(compileShader, "glCompileShader");
+    loadOptional(getShaderiv, "glGetShaderiv");
+    loadOptional(getShaderInfoLog, "glGetShaderInfoLog");
+    loadOptional(deleteShader, "glDeleteShader");
+    loadOptional(createProgram, "glCreateProgram");
+    loadOptional(attachShader, "glAttachShader");
+    loadOptional(bindAttribLocation, "glBindAttribLocation");
+    loadOptional(linkProgram, "glLinkProgram");
+    loadOptional(getProgramiv, "glGetProgramiv");
+    loadOptional(getProgramInfoLog, "glGetProgramInfoLog");
+    loadOptional(deleteProgram, "glDeleteProgram");
+    loadOptional(useProgram, "glUseProgram");
+    loadOptional(getUniformLocation, "glGetUniformLocation");
+    loadOptional(uniform1i, "glUniform1i");
+    loadOptional(uniform1f, "glUniform1f");
+    loadOptional(uniformMatrix4fv, "glUniformMatrix4fv");
+    loadOptional(vertexAttribPointer, "glVertexAttribPointer");
+    loadOptional(enableVertexAttribArray, "glEnableVertexAttribArray");
+    loadOptional(disableVertexAttribArray, "glDisableVertexAttribArray");
+    loadOptional(activeTexture, "glActiveTexture");
+    loadOptional(texBuffer, "glTexBuffer");
+    loadOptional(drawArraysInstanced, "glDrawArraysInstanced");
+    instancing = createShader && shaderSource && compileShader && getShaderiv && getShaderInfoLog && deleteShader &&
+                 createProgram && attachShader && bindAttribLocation && linkProgram && getProgramiv &&
+                 getProgramInfoLog && deleteProgram && useProgram && getUniformLocation && uniform1i && uniform1f &&
+                 uniformMatrix4fv && vertexAttribPointer && enableVertexAttribArray && disableVertexAttribArray &&
+                 activeTexture && texBuffer && drawArraysInstanced;
+  }
+} // namespace GlExt
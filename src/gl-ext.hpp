@@ -0,0 +1,59 @@
+#pragma once
+#include <SDL_opengl.h>
+
+// OpenGL entry points newer than 1.1 are not exported by every platform's GL library (opengl32.dll
+// only has 1.1), so they are resolved through SDL once the context is current.
+namespace GlExt
+{
+  inline PFNGLGENBUFFERSPROC genBuffers = nullptr;
+  inline PFNGLDELETEBUFFERSPROC deleteBuffers = nullptr;
+  inline PFNGLBINDBUFFERPROC bindBuffer = nullptr;
+  inline PFNGLBUFFERDATAPROC bufferData = nullptr;
+  inline PFNGLMAPBUFFERPROC mapBuffer = nullptr;
+  inline PFNGLUNMAPBUFFERPROC unmapBuffer = nullptr;
+  inline PFNGLGENFRAMEBUFFERSPROC genFramebuffers = nullptr;
+  inline PFNGLDELETEFRAMEBUFFERSPROC deleteFramebuffers = nullptr;
+  inline PFNGLBINDFRAMEBUFFERPROC bindFramebuffer = nullptr;
+  inline PFNGLFRAMEBUFFERTEXTURE2DPROC framebufferTexture2D = nullptr;
+  inline PFNGLCHECKFRAMEBUFFERSTATUSPROC checkFramebufferStatus = nullptr;
+  inline PFNGLBLITFRAMEBUFFERPROC blitFramebuffer = nullptr;
+  inline PFNGLGENERATEMIPMAPPROC generateMipmap = nullptr;
+  inline PFNGLBLENDFUNCSEPARATEPROC blendFuncSeparate = nullptr;
+  // timer queries are GL 3.3 / ARB_timer_query and only used by the profiler, so they may stay null
+  inline PFNGLGENQUERIESPROC genQueries = nullptr;
+  inline PFNGLDELETEQUERIESPROC deleteQueries = nullptr;
+  inline PFNGLBEGINQUERYPROC beginQuery = nullptr;
+  inline PFNGLENDQUERYPROC endQuery = nullptr;
+  inline PFNGLGETQUERYOBJECTIVPROC getQueryObjectiv = nullptr;
+  inline PFNGLGETQUERYOBJECTUI64VPROC getQueryObjectui64v = nullptr;
+
+  // shaders, texture buffers and instancing are GL 3.1 and only used by the sprite batch, which
+  // transforms on the CPU without them; instancing is false unless all of them loaded
+  inline PFNGLCREATESHADERPROC createShader = nullptr;
+  inline PFNGLSHADERSOURCEPROC shaderSource = nullptr;
+  inline PFNGLCOMPILESHADERPROC compileShader = nullptr;
+  inline PFNGLGETSHADERIVPROC getShaderiv = nullptr;
+  inline PFNGLGETSHADERINFOLOGPROC getShaderInfoLog = nullptr;
+  inline PFNGLDELETESHADERPROC deleteShader = nullptr;
+  inline PFNGLCREATEPROGRAMPROC createProgram = nullptr;
+  inline PFNGLATTACHSHADERPROC attachShader = nullptr;
+  inline PFNGLBINDATTRIBLOCATIONPROC bindAttribLocation = nullptr;
+  inline PFNGLLINKPROGRAMPROC linkProgram = nullptr;
+  inline PFNGLGETPROGRAMIVPROC getProgramiv = nullptr;
+  inline PFNGLGETPROGRAMINFOLOGPROC getProgramInfoLog = nullptr;
+  inline PFNGLDELETEPROGRAMPROC deleteProgram = nullptr;
+  inline PFNGLUSEPROGRAMPROC useProgram = nullptr;
+  inline PFNGLGETUNIFORMLOCATIONPROC getUniformLocation = nullptr;
+  inline PFNGLUNIFORM1IPROC uniform1i = nullptr;
+  inline PFNGLUNIFORM1FPROC uniform1f = nullptr;
+  inline PFNGLUNIFORMMATRIX4FVPROC uniformMatrix4fv = nullptr;
+  inline PFNGLVERTEXATTRIBPOINTERPROC vertexAttribPointer = nullptr;
+  inline PFNGLENABLEVERTEXATTRIBARRAYPROC enableVertexAttribArray = nullptr;
+  inline PFNGLDISABLEVERTEXATTRIBARRAYPROC disableVertexAttribArray = nullptr;
+  inline PFNGLACTIVETEXTUREPROC activeTexture = nullptr;
+  inline PFNGLTEXBUFFERPROC texBuffer = nullptr;
+  inline PFNGLDRAWARRAYSINSTANCEDPROC drawArraysInstanced = nullptr;
+  inline bool instancing = false;
+
+  auto init() -> void;
+} // namespace GlExt
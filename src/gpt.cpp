@@ -1,26 +1,15 @@
 #define NOMINMAX
 
 #include "gpt.hpp"
-#include "http-client.hpp"
 #include "uv.hpp"
 
+#include <algorithm>
 #include <cctype>
 #include <cstring>
 #include <functional>
-#include <numeric>
 
-#include <rapidjson/document.h>
 #include <scn/scn.h>
 #include <spdlog/spdlog.h>
-#include <sstream>
-
-Gpt::Gpt(uv::Uv &uv, std::string aToken, HttpClient &aHttpClient)
-  : timer(uv.createTimer()),
-    token(std::move(aToken)),
-    httpClient(aHttpClient),
-    lastReply(std::chrono::high_resolution_clock::now())
-{
-}
 
 static auto esc(const std::string &str) -> std::string
 {
@@ -42,13 +31,21 @@ static auto esc(const std::string &str) -> std::string
   return result;
 }
 
+Gpt::Gpt(uv::Uv &uv, LlmBackend &aBackend)
+  : timer(uv.createTimer()),
+    backend(aBackend),
+    lastReply(std::chrono::high_resolution_clock::now())
+{
+  systemPromptEsc = esc(systemPrompt_);
+}
+
 static std::string_view stripWhiteSpaces(std::string_view v)
 {
   if (v.empty())
     goto done;
-  while (std::isspace(v.front()))
+  while (std::isspace(static_cast<unsigned char>(v.front())))
     v.remove_prefix(1);
-  while (std::isspace(v.back()))
+  while (std::isspace(static_cast<unsigned char>(v.back())))
     v.remove_suffix(1);
 done:
   return v;
@@ -68,14 +65,96 @@ static std::string_view stripHangingSentences(std::string_view v)
   return (pos != std::string_view::npos) ? v.substr(0, pos + 1) : v;
 }
 
-auto Gpt::prompt(std::string name, std::string p, Callback cb) -> void
+static auto isTerminator(char c) -> bool
 {
-  p = stripWhiteSpaces(p);
-  queuedMsgs.emplace_back(std::make_pair(Msg{std::move(name), std::move(p)}, std::move(cb)));
-  using namespace std::chrono_literals;
-  if (state == State::waiting || std::chrono::high_resolution_clock::now() < lastReply + 3s)
+  return c == '.' || c == '!' || c == '?';
+}
+
+auto Gpt::Reply::body() -> std::optional<std::string_view>
+{
+  auto v = std::string_view{text};
+  while (!v.empty() && std::isspace(static_cast<unsigned char>(v.front())))
+    v.remove_prefix(1);
+  if (prefix.empty())
+    return v;
+  if (v.size() < prefix.size())
+    return std::nullopt;
+  if (!v.starts_with(prefix))
+  {
+    rejected = true;
+    return std::nullopt;
+  }
+  return v.substr(prefix.size());
+}
+
+auto Gpt::Reply::onText(std::string_view v) -> void
+{
+  text += v;
+  emit(false);
+}
+
+auto Gpt::Reply::emit(bool final) -> void
+{
+  if (rejected || !onSentence || ticket->cancelled)
+    return;
+  const auto b = body();
+  if (!b)
     return;
+  for (;;)
+  {
+    const auto rest = b->substr(spoken);
+    auto end = std::string_view::npos;
+    for (auto i = size_t{0}; i < rest.size(); ++i)
+    {
+      if (!isTerminator(rest[i]))
+        continue;
+      // "..." and "?!" end one sentence
+      while (i + 1 < rest.size() && isTerminator(rest[i + 1]))
+        ++i;
+      // the next token may still be "5" of "1.5", only whitespace ends the sentence
+      if (i + 1 < rest.size() ? std::isspace(static_cast<unsigned char>(rest[i + 1])) : final)
+      {
+        end = i + 1;
+        break;
+      }
+    }
+    if (end == std::string_view::npos)
+      break;
+    spoken += end;
+    if (const auto sentence = stripWhiteSpaces(rest.substr(0, end)); !sentence.empty())
+      onSentence(sentence);
+  }
+  // the same as stripHangingSentences(): an unfinished sentence is dropped unless it is all
+  if (final && spoken == 0)
+  {
+    spoken = b->size();
+    if (const auto sentence = stripWhiteSpaces(*b); !sentence.empty())
+      onSentence(sentence);
+  }
+}
+
+auto Gpt::prompt(std::string name, std::string p, Callback cb, Callback onSentence) -> std::shared_ptr<Ticket>
+{
+  p = stripWhiteSpaces(p);
+  auto ticket = std::make_shared<Ticket>();
+  queuedMsgs.emplace_back(Queued{Msg{std::move(name), std::move(p)}, std::move(cb), std::move(onSentence), ticket});
+  if (state == State::waiting)
+    return ticket;
+  if (const auto now = std::chrono::high_resolution_clock::now(); now < lastReply + ReplyPause)
+  {
+    // picked up once the pause after the last reply is over instead of by the next prompt
+    timer.start(
+      [alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->process();
+        else
+          SPDLOG_INFO("this was destroyed");
+      },
+      static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(lastReply + ReplyPause - now).count()));
+    return ticket;
+  }
   process();
+  return ticket;
 }
 
 auto Gpt::process() -> void
@@ -84,161 +163,149 @@ auto Gpt::process() -> void
     return;
   if (queuedMsgs.empty())
     return;
+  // the first message still waiting for an answer gets the reply
+  const auto answer = std::ranges::find_if(queuedMsgs, [](const auto &q) { return !q.ticket->cancelled; });
+  if (answer == std::end(queuedMsgs))
+  {
+    // nobody wants an answer, the messages are still part of the conversation
+    for (auto &msg : queuedMsgs)
+      append(std::move(msg.msg));
+    queuedMsgs.clear();
+    return;
+  }
+  const auto answerIdx = static_cast<size_t>(answer - std::begin(queuedMsgs));
   state = State::waiting;
-  std::ostringstream ss;
-  const auto embedName = (rand() % 5 == 0) || msgs.empty();
-  ss << R"({
-    "model": "text-curie-001",
-    "prompt": ")";
-  ss << esc(systemPrompt_);
-  for (const auto &msg : msgs)
-    ss << esc("\n| ") << esc(msg.name) << ": " << esc(msg.msg);
-  for (const auto &msg : queuedMsgs)
+  // only a model that continues a transcript can be left to pick who speaks
+  const auto embedName = !backend.get().picksSpeaker() || (rand() % 5 == 0) || msgs.empty();
+  for (auto &msg : queuedMsgs)
+    append(std::move(msg.msg));
+  auto reply = std::shared_ptr<Reply>{};
+  if (answer->onSentence)
   {
-    ss << esc("\n| ") << esc(msg.first.name) << ": " << esc(msg.first.msg);
-    msgs.emplace_back(std::move(msg.first));
+    reply = std::make_shared<Reply>();
+    reply->onSentence = std::move(answer->onSentence);
+    reply->ticket = answer->ticket;
+    if (!embedName)
+      reply->prefix = cohost_ + ":";
   }
+  const auto cohostEsc = esc(cohost_);
+  const auto request = LlmBackend::Request{.systemPrompt = systemPromptEsc,
+                                           .history = std::string_view{history}.substr(historyStart),
+                                           .cohost = cohostEsc,
+                                           .embedName = embedName,
+                                           .stream = reply != nullptr};
 
-  if (embedName)
-    ss << R"(\n| )" << cohost_ << R"(:)";
-  else
-    ss << R"(\n|)";
-  ss << R"(", "temperature": 1, "max_tokens": 24, "top_p": 1.0, "frequency_penalty": 0.5, "presence_penalty": 0.6, "stop": ["\n| "]})";
+  auto onText = LlmBackend::TextCallback{};
+  if (reply)
+    onText = [reply](std::string_view v) { reply->onText(v); };
 
-  httpClient.get().post(
-    "https://api.openai.com/v1/completions",
-    ss.str(),
-    [embedName, qMsgs = std::move(queuedMsgs), jsonPrompt = ss.str(), alive = weak_self()](
-      CURLcode code, long httpStatus, std::string payload) mutable {
-      if (auto self = alive.lock())
+  auto onDone = [embedName, answerIdx, qMsgs = std::move(queuedMsgs), reply, alive = weak_self()](
+                  LlmBackend::Result result) mutable {
+    if (auto self = alive.lock())
+    {
+      if (!result.error.empty())
       {
-        if (code != CURLE_OK)
+        self->lastError = std::move(result.error);
+        for (auto &msg : qMsgs)
+          if (!msg.ticket->cancelled)
+            msg.cb("");
+        if (!result.isTransient)
         {
-          for (auto &msg : qMsgs)
-            msg.second("");
+          // the messages that queued up meanwhile still get their turn
           self->state = State::idle;
+          self->process();
           return;
         }
-        if (httpStatus >= 400 && httpStatus < 500)
-        {
-          SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-          SPDLOG_INFO("{}", jsonPrompt);
-          self->lastError = payload;
-          for (auto &msg : qMsgs)
-            msg.second("");
-          self->state = State::idle;
-          return;
-        }
-        if (httpStatus != 200)
-        {
-          SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-          SPDLOG_INFO("{}", jsonPrompt);
-          self->lastError = payload;
-          for (auto &msg : qMsgs)
-            msg.second("");
-          self->timer.start(
-            [alive]() {
-              if (auto self = alive.lock())
-              {
-                self->state = State::idle;
-                self->process();
-              }
-              else
-              {
-                SPDLOG_INFO("this was destroyed");
-              }
-            },
-            10'000);
-          return;
-        }
-        self->lastError.clear();
-        rapidjson::Document document;
-        document.Parse(payload.data(), payload.size());
-        // {
-        //   "id": "cmpl-7PJIyTy1pXJD3OvzekQOQnqOdcUF5",
-        //   "object": "text_completion",
-        //   "created": 1686266764,
-        //   "model": "text-davinci-003",
-        //   "choices": [
-        //     {
-        //       "text": " Is this thing on?\n",
-        //       "index": 0,
-        //       "logprobs": null,
-        //       "finish_reason": "stop"
-        //     }
-        //   ],
-        //   "usage": {
-        //     "prompt_tokens": 58,
-        //     "completion_tokens": 6,
-        //     "total_tokens": 64
-        //   }
-        // }
-        auto const &choices = document["choices"].GetArray();
-        if (choices.Empty())
+        self->timer.start(
+          [alive]() {
+            if (auto self = alive.lock())
+            {
+              self->state = State::idle;
+              self->process();
+            }
+            else
+            {
+              SPDLOG_INFO("this was destroyed");
+            }
+          },
+          10'000);
+        return;
+      }
+      self->lastError.clear();
+      if (reply)
+        reply->emit(true);
+      auto cohostMsg = stripHangingSentences(stripWhiteSpaces(result.text));
+      if (!embedName)
+      {
+        if (cohostMsg.find(self->cohost_ + std::string{":"}) != 0)
         {
-          SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
-          self->lastError = "0 Choices";
           for (auto &msg : qMsgs)
-            msg.second("");
+            if (!msg.ticket->cancelled)
+              msg.cb("");
           self->state = State::idle;
           self->process();
+          return;
         }
-        auto cohostMsg = stripHangingSentences(stripWhiteSpaces(std::string_view{choices[0]["text"].GetString(), choices[0]["text"].GetStringLength()}));
-        if (!embedName)
-        {
-          if (cohostMsg.find(self->cohost_ + std::string{":"}) != 0)
-          {
-            for (auto &msg : qMsgs)
-              msg.second("");
-            self->state = State::idle;
-            self->process();
-            return;
-          }
-          cohostMsg = stripWhiteSpaces(cohostMsg.substr(self->cohost_.size() + 1));
-        }
+        cohostMsg = stripWhiteSpaces(cohostMsg.substr(self->cohost_.size() + 1));
+      }
 
-        {
-          Msg msg;
-          msg.name = self->cohost_;
-          msg.msg = cohostMsg;
-          self->msgs.emplace_back(std::move(msg));
-        }
-        const auto MaxTokens = 2048 * 4 / 10;
-        const auto initWords = self->countWords();
-        for (auto words = initWords; words > MaxTokens;)
-        {
-          words -= self->countWords(self->msgs.front());
-          self->msgs.pop_front();
-        }
-        for (auto i = 0U; i < qMsgs.size(); ++i)
-        {
-          if (i == 0)
-            qMsgs[i].second(cohostMsg);
-          else
-            qMsgs[i].second("");
-        }
-        self->state = State::idle;
-        self->lastReply = std::chrono::high_resolution_clock::now();
-        self->process();
+      // an answer cancelled while it was generating was never said
+      if (!qMsgs[answerIdx].ticket->cancelled)
+      {
+        Msg msg;
+        msg.name = self->cohost_;
+        msg.msg = cohostMsg;
+        self->append(std::move(msg));
       }
-      else
+      const auto MaxTokens = 2048 * 4 / 10;
+      self->trim(MaxTokens);
+      for (auto i = 0U; i < qMsgs.size(); ++i)
       {
-        SPDLOG_INFO("this was destroyed");
+        if (qMsgs[i].ticket->cancelled)
+          continue;
+        if (i == answerIdx)
+          qMsgs[i].cb(cohostMsg);
+        else
+          qMsgs[i].cb("");
       }
-    },
-    {{"Content-Type", "application/json"}, {"Authorization", "Bearer " + token}});
+      self->state = State::idle;
+      self->lastReply = std::chrono::high_resolution_clock::now();
+      self->process();
+    }
+    else
+    {
+      SPDLOG_INFO("this was destroyed");
+    }
+  };
+
+  backend.get().complete(request, std::move(onText), std::move(onDone));
   queuedMsgs.clear();
 }
 
-auto Gpt::updateToken(std::string aToken) -> void
+auto Gpt::append(Msg msg) -> void
 {
-  token = std::move(aToken);
+  const auto line = esc("\n| ") + esc(msg.name) + ": " + esc(msg.msg);
+  msg.words = countWords(msg);
+  msg.escapedSize = line.size();
+  history += line;
+  words += msg.words;
+  msgs.emplace_back(std::move(msg));
 }
 
-auto Gpt::countWords() const -> int
+auto Gpt::trim(int maxWords) -> void
 {
-  return std::accumulate(
-    std::begin(msgs), std::end(msgs), 0, [this](int a, const auto &msg) { return a + countWords(msg); });
+  while (words > maxWords && !msgs.empty())
+  {
+    words -= msgs.front().words;
+    historyStart += msgs.front().escapedSize;
+    msgs.pop_front();
+  }
+  // each byte is moved at most once for every time the history doubles
+  if (historyStart > history.size() / 2)
+  {
+    history.erase(0, historyStart);
+    historyStart = 0;
+  }
 }
 
 auto Gpt::countWords(const Msg &msg) const -> int
@@ -257,6 +324,7 @@ auto Gpt::countWords(const Msg &msg) const -> int
 auto Gpt::systemPrompt(std::string v) -> void
 {
   systemPrompt_ = std::move(v);
+  systemPromptEsc = esc(systemPrompt_);
 }
 
 auto Gpt::systemPrompt() const -> const std::string &
@@ -2,30 +2,78 @@
 #include <chrono>
 #include <deque>
 #include <functional>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
+#include "llm-backend.hpp"
 #include "shared_from_this.hpp"
 #include "uv.hpp"
 
+// The cohost's side of the conversation: keeps the history, answers the first message still
+// waiting and leaves a pause after each reply. The model behind it is an LlmBackend.
 class Gpt : public virtual enable_shared_from_this
 {
 public:
   using Callback = std::move_only_function<void(std::string_view)>;
-  Gpt(uv::Uv &, std::string token, class HttpClient &);
+  Gpt(uv::Uv &, LlmBackend &);
   auto cohost() const -> std::string;
   auto cohost(std::string) -> void;
-  auto prompt(std::string name, std::string msg, Callback) -> void;
+  // set cancelled to drop the answer to a prompt: the callbacks get nothing more and the answer
+  // stays out of the history, the message itself is kept
+  struct Ticket
+  {
+    bool cancelled = false;
+  };
+  // with onSentence the completion is streamed and every finished sentence of the reply is
+  // handed out while the rest is still generating; the callback still gets the whole reply
+  auto prompt(std::string name, std::string msg, Callback, Callback onSentence = nullptr)
+    -> std::shared_ptr<Ticket>;
   auto systemPrompt() const -> const std::string &;
   auto systemPrompt(std::string) -> void;
-  auto updateToken(std::string token) -> void;
 
   std::string lastError;
 
+  // the cohost lets the conversation breathe this long after a reply before answering again
+  static constexpr auto ReplyPause = std::chrono::seconds{3};
+
 private:
   struct Msg
   {
     std::string name;
     std::string msg;
+    // counted once when the message joins the history
+    int words = 0;
+    // length of its line in history
+    size_t escapedSize = 0;
+  };
+  struct Queued
+  {
+    Msg msg;
+    Callback cb;
+    Callback onSentence;
+    std::shared_ptr<Ticket> ticket;
+  };
+  // completion streaming in
+  struct Reply
+  {
+    Callback onSentence;
+    // the name the model has to start with when the prompt does not end with it
+    std::string prefix;
+    std::shared_ptr<Ticket> ticket;
+    std::string text;
+    // characters of body() already handed out
+    size_t spoken = 0;
+    bool rejected = false;
+    // the reply without the name, nullopt while it is too short to check the name
+    auto body() -> std::optional<std::string_view>;
+    // the next piece of the completion
+    auto onText(std::string_view) -> void;
+    // hands out the finished sentences; at the end one without a full stop as well if that is
+    // all there is
+    auto emit(bool final) -> void;
   };
   enum class State {
     idle,
@@ -33,21 +81,28 @@ private:
   };
 
   uv::Timer timer;
-  std::string token;
+  std::reference_wrapper<LlmBackend> backend;
   std::string systemPrompt_ =
     R"(Clara is a virtual co-host for Mika's Twitch stream. She entertains
 the audience, keeps the energy high, and contributes to the fun
 atmosphere. She is funny and likes to make quirky jokes. She has
 extensive knowledge about games, game development, Unreal Engine, and
 C++.)";
-  std::reference_wrapper<HttpClient> httpClient;
-  std::vector<std::pair<Msg, Callback>> queuedMsgs;
+  std::vector<Queued> queuedMsgs;
   std::deque<Msg> msgs;
+  // the prompt is built from pieces escaped once: the system prompt and one line per message of
+  // msgs, starting at historyStart; the dropped lines are cut off once they are most of it
+  std::string systemPromptEsc;
+  std::string history;
+  size_t historyStart = 0;
+  int words = 0;
   State state = State::idle;
   std::chrono::high_resolution_clock::time_point lastReply;
   std::string cohost_ = "Clara";
 
-  auto countWords() const -> int;
+  auto append(Msg) -> void;
   auto countWords(const Msg &) const -> int;
+  // drops the oldest messages until the history fits
+  auto trim(int maxWords) -> void;
   auto process() -> void;
 };
@@ -0,0 +1,35 @@
+#include "hit-grid.hpp"
+#include <algorithm>
+#include <cmath>
+
+auto HitGrid::clear(glm::vec2 viewport) -> void
+{
+  cols = std::max(1, static_cast<int>(std::ceil(viewport.x / CellSize)));
+  rows = std::max(1, static_cast<int>(std::ceil(viewport.y / CellSize)));
+  // inner vectors are cleared rather than destroyed so steady-state rebuilds do not allocate
+  if (cells.size() < static_cast<size_t>(cols * rows))
+    cells.resize(cols * rows);
+  for (auto &cell : cells)
+    cell.clear();
+  valid = true;
+}
+
+auto HitGrid::insert(int idx, glm::vec2 min, glm::vec2 max) -> void
+{
+  const auto x0 = std::max(0, static_cast<int>(std::floor(min.x / CellSize)));
+  const auto y0 = std::max(0, static_cast<int>(std::floor(min.y / CellSize)));
+  const auto x1 = std::min(cols - 1, static_cast<int>(std::floor(max.x / CellSize)));
+  const auto y1 = std::min(rows - 1, static_cast<int>(std::floor(max.y / CellSize)));
+  for (auto y = y0; y <= y1; ++y)
+    for (auto x = x0; x <= x1; ++x)
+      cells[x + y * cols].push_back(idx);
+}
+
+auto HitGrid::query(glm::vec2 v) const -> const std::vector<int> &
+{
+  const auto x = static_cast<int>(std::floor(v.x / CellSize));
+  const auto y = static_cast<int>(std::floor(v.y / CellSize));
+  if (x < 0 || x >= cols || y < 0 || y >= rows)
+    return empty;
+  return cells[x + y * cols];
+}
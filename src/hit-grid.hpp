@@ -0,0 +1,24 @@
+#pragma once
+#include <glm/vec2.hpp>
+#include <vector>
+
+// Uniform screen-space grid of draw-list indices, rebuilt every frame from the node bounding boxes.
+// A mouse query only has to run the exact (matrix inverse + alpha) test on the nodes whose boxes
+// touch the cell under the cursor.
+class HitGrid
+{
+public:
+  auto clear(glm::vec2 viewport) -> void;
+  auto insert(int idx, glm::vec2 min, glm::vec2 max) -> void;
+  auto query(glm::vec2) const -> const std::vector<int> &;
+  auto isValid() const -> bool { return valid; }
+  auto invalidate() -> void { valid = false; }
+
+private:
+  static constexpr auto CellSize = 64.f;
+  int cols = 0;
+  int rows = 0;
+  bool valid = false;
+  std::vector<std::vector<int>> cells;
+  std::vector<int> empty;
+};
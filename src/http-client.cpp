@@ -3,7 +3,10 @@
 #endif
 
 #include "http-client.hpp"
+#include "trace.hpp"
 #include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <spdlog/spdlog.h>
 
 namespace
@@ -20,6 +23,20 @@ namespace
     static auto init() -> void { [[maybe_unused]] static auto curlInit = CurlInitializer{}; }
   };
 
+  auto hostOf(std::string_view url) -> std::string
+  {
+    if (auto scheme = url.find("://"); scheme != std::string_view::npos)
+      url.remove_prefix(scheme + 3);
+    return std::string{url.substr(0, url.find_first_of(":/?"))};
+  }
+
+  auto msOf(CURL *handle, CURLINFO info) -> float
+  {
+    auto us = curl_off_t{0};
+    curl_easy_getinfo(handle, info, &us);
+    return static_cast<float>(us) / 1000.f;
+  }
+
 } // namespace
 
 namespace uv
@@ -28,7 +45,12 @@ namespace uv
 }
 
 HttpClient::HttpClient(uv::Uv &aUv)
-  : uv(aUv), timeout(aUv.createTimer()), multiHandle(curl_multi_init())
+  : uv(aUv),
+    timeout(aUv.createTimer()),
+    multiHandle(curl_multi_init()),
+    shareHandle(curl_share_init()),
+    stubTimer(aUv.createTimer()),
+    deadlineTimer(aUv.createTimer())
 {
   CurlInitializer::init();
 #pragma GCC diagnostic ignored "-Wdisabled-macro-expansion"
@@ -36,6 +58,12 @@ HttpClient::HttpClient(uv::Uv &aUv)
   curl_multi_setopt(multiHandle, CURLMOPT_SOCKETFUNCTION, &HttpClient::socketFunc_);
   curl_multi_setopt(multiHandle, CURLMOPT_TIMERDATA, this);
   curl_multi_setopt(multiHandle, CURLMOPT_TIMERFUNCTION, HttpClient::startTimeout_);
+  // concurrent requests to one host go over one HTTP/2 connection instead of opening more
+  curl_multi_setopt(multiHandle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+  // everything runs on the uv thread, the share handle needs no lock callbacks
+  curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(shareHandle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
 }
 
 auto HttpClient::startTimeout_(CURLM *multi, long timeout_ms, void *userp) -> int
@@ -50,7 +78,11 @@ auto HttpClient::socketFunc_(CURL *easy, curl_socket_t s, int action, void *user
 
 HttpClient::~HttpClient()
 {
+  for (auto &q : queued)
+    for (auto handle : q)
+      release(handle);
   curl_multi_cleanup(multiHandle);
+  curl_share_cleanup(shareHandle);
 }
 
 auto HttpClient::socketFunc(CURL *, curl_socket_t s, int action, void *socketp) -> int
@@ -126,21 +158,157 @@ auto HttpClient::checkMultiInfo() -> void
       curl_easy_getinfo(easyHandle, CURLINFO_PRIVATE, &ctx);
       long codep;
       curl_easy_getinfo(easyHandle, CURLINFO_RESPONSE_CODE, &codep);
-      ctx->callback(message->data.result, codep, std::move(ctx->payloadOut));
-      curl_slist_free_all(ctx->headers);
-      delete ctx;
+      if (ctx->upload)
+        ctx->upload->handle = nullptr;
+      recordTiming(easyHandle);
+      // the slot is free before the callback runs, a request it makes can take it
+      if (--perHost[ctx->host] == 0)
+        perHost.erase(ctx->host);
+      if (ctx->priority == Priority::background)
+        --backgroundActive;
+      Trace::asyncEnd("http transfer", reinterpret_cast<uintptr_t>(easyHandle));
+      if (tap_)
+      {
+        ctx->tappedBody += ctx->payloadOut;
+        tap_(Exchange{std::move(ctx->url),
+                      message->data.result,
+                      codep,
+                      std::move(ctx->tappedHeaders),
+                      std::move(ctx->tappedBody),
+                      msOf(easyHandle, CURLINFO_TOTAL_TIME_T)});
+      }
+      {
+        auto span = Trace::Span{"http callback"};
+        ctx->callback(message->data.result, codep, std::move(ctx->payloadOut));
+      }
       curl_multi_remove_handle(multiHandle, easyHandle);
-      curl_easy_cleanup(easyHandle);
+      release(easyHandle);
       break;
     }
     case CURLMSG_NONE:
     case CURLMSG_LAST: fprintf(stderr, "CURLMSG default\n"); break;
     }
   }
+  schedule();
+}
+
+auto HttpClient::submit(CURL *handle) -> void
+{
+  CurlContext *ctx;
+  curl_easy_getinfo(handle, CURLINFO_PRIVATE, &ctx);
+  queued[static_cast<size_t>(ctx->priority)].push_back(handle);
+  Trace::asyncBegin("http queued", reinterpret_cast<uintptr_t>(handle));
+  schedule();
+}
+
+auto HttpClient::schedule() -> void
+{
+  const auto now = std::chrono::steady_clock::now();
+  auto expired = std::vector<CURL *>{};
+  for (auto &q : queued)
+    for (auto it = std::begin(q); it != std::end(q);)
+    {
+      CurlContext *ctx;
+      curl_easy_getinfo(*it, CURLINFO_PRIVATE, &ctx);
+      if (ctx->deadline && now >= *ctx->deadline)
+      {
+        Trace::asyncEnd("http queued", reinterpret_cast<uintptr_t>(*it));
+        expired.push_back(*it);
+        it = q.erase(it);
+        continue;
+      }
+      const auto background = ctx->priority == Priority::background;
+      if (perHost[ctx->host] >= MaxPerHost || (background && backgroundActive >= MaxBackground))
+      {
+        // another host may still have room
+        ++it;
+        continue;
+      }
+      ++perHost[ctx->host];
+      if (background)
+        ++backgroundActive;
+      // zero would mean no limit at all
+      if (ctx->deadline)
+        curl_easy_setopt(*it,
+                         CURLOPT_TIMEOUT_MS,
+                         std::max(1L,
+                                  static_cast<long>(
+                                    std::chrono::duration_cast<std::chrono::milliseconds>(*ctx->deadline - now).count())));
+      // HTTP/2 gives the interactive streams most of a shared connection
+      curl_easy_setopt(*it, CURLOPT_STREAM_WEIGHT, background ? 16L : 256L);
+      curl_multi_add_handle(multiHandle, *it);
+      Trace::asyncEnd("http queued", reinterpret_cast<uintptr_t>(*it));
+      Trace::asyncBegin("http transfer", reinterpret_cast<uintptr_t>(*it));
+      it = q.erase(it);
+    }
+  // a request left waiting still fails at its deadline when nothing else calls schedule()
+  auto earliest = std::optional<std::chrono::steady_clock::time_point>{};
+  for (const auto &q : queued)
+    for (auto handle : q)
+    {
+      CurlContext *ctx;
+      curl_easy_getinfo(handle, CURLINFO_PRIVATE, &ctx);
+      if (ctx->deadline && (!earliest || *ctx->deadline < *earliest))
+        earliest = ctx->deadline;
+    }
+  if (earliest)
+    deadlineTimer.start(
+      [this]() { schedule(); },
+      static_cast<uint64_t>(std::chrono::ceil<std::chrono::milliseconds>(*earliest - now).count()));
+  else
+    deadlineTimer.stop();
+  // called once the queues are consistent again, the callbacks may make new requests
+  for (auto handle : expired)
+  {
+    CurlContext *ctx;
+    curl_easy_getinfo(handle, CURLINFO_PRIVATE, &ctx);
+    if (ctx->upload)
+      ctx->upload->handle = nullptr;
+    ctx->callback(CURLE_OPERATION_TIMEDOUT, 0, std::move(ctx->payloadOut));
+    release(handle);
+  }
+}
+
+auto HttpClient::cancel(CURL *handle) -> void
+{
+  CurlContext *ctx;
+  curl_easy_getinfo(handle, CURLINFO_PRIVATE, &ctx);
+  if (ctx->upload)
+    ctx->upload->handle = nullptr;
+  auto wasQueued = false;
+  for (auto &q : queued)
+    if (auto it = std::find(std::begin(q), std::end(q), handle); it != std::end(q))
+    {
+      Trace::asyncEnd("http queued", reinterpret_cast<uintptr_t>(handle));
+      q.erase(it);
+      wasQueued = true;
+    }
+  if (!wasQueued)
+  {
+    if (--perHost[ctx->host] == 0)
+      perHost.erase(ctx->host);
+    if (ctx->priority == Priority::background)
+      --backgroundActive;
+    Trace::asyncEnd("http transfer", reinterpret_cast<uintptr_t>(handle));
+    curl_multi_remove_handle(multiHandle, handle);
+  }
+  ctx->callback(CURLE_ABORTED_BY_CALLBACK, 0, std::move(ctx->payloadOut));
+  release(handle);
+  schedule();
+}
+
+auto HttpClient::release(CURL *handle) -> void
+{
+  CurlContext *ctx;
+  curl_easy_getinfo(handle, CURLINFO_PRIVATE, &ctx);
+  curl_slist_free_all(ctx->headers);
+  delete ctx;
+  curl_easy_cleanup(handle);
 }
 
 void HttpClient::curlPerform(uv_poll_t *req, int /*status*/, int events)
 {
+  auto span = Trace::Span{"http perform"};
   auto context = static_cast<SockContext *>(req->data);
 
   int flags = 0;
@@ -157,6 +325,7 @@ void HttpClient::curlPerform(uv_poll_t *req, int /*status*/, int events)
 
 auto HttpClient::onTimeout(CURLM *multi) -> void
 {
+  auto span = Trace::Span{"http timeout"};
   int runningHandles;
   curl_multi_socket_action(multi, CURL_SOCKET_TIMEOUT, 0, &runningHandles);
   checkMultiInfo();
@@ -183,27 +352,9 @@ auto HttpClient::startTimeout(long timeoutMs, CURLM *multi) -> int
   return 0;
 }
 
-auto HttpClient::get(const std::string &url, Callback cb, const Headers &headers) -> void
+auto HttpClient::get(const std::string &url, Callback cb, const Headers &headers, Priority priority) -> void
 {
-  auto handle = curl_easy_init();
-  auto ctx = new CurlContext;
-  ctx->self = this;
-  ctx->callback = std::move(cb);
-  curl_easy_setopt(handle, CURLOPT_PRIVATE, ctx);
-  curl_easy_setopt(handle, CURLOPT_WRITEDATA, ctx);
-  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CurlContext::write_);
-  curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
-#ifdef _WIN32
-  curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
-#endif
-  if (!headers.empty())
-  {
-    for (const auto &h : headers)
-      ctx->headers = curl_slist_append(
-        ctx->headers, (h.first + ":" + (!h.second.empty() ? (" " + h.second) : "")).c_str());
-    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, ctx->headers);
-  }
-  curl_multi_add_handle(multiHandle, handle);
+  stream(url, std::nullopt, Stream{.onDone = std::move(cb), .priority = priority}, headers);
 }
 
 auto HttpClient::CurlContext::write_(char *in, unsigned size, unsigned nmemb, void *ctx) -> size_t
@@ -213,12 +364,79 @@ auto HttpClient::CurlContext::write_(char *in, unsigned size, unsigned nmemb, vo
 
 auto HttpClient::CurlContext::write(char *in, unsigned size, unsigned nmemb) -> size_t
 {
+  if (onChunk)
+  {
+    long status;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+    if (status >= 200 && status < 300)
+    {
+      if (self->tap_)
+        tappedBody += std::string_view{in, size * nmemb};
+      onChunk(std::string_view{in, size * nmemb});
+      return size * nmemb;
+    }
+  }
   payloadOut += std::string_view{in, size * nmemb};
   return size * nmemb;
 }
 
+auto HttpClient::CurlContext::header_(char *in, size_t size, size_t nitems, void *ctx) -> size_t
+{
+  return static_cast<CurlContext *>(ctx)->header(in, size, nitems);
+}
+
+auto HttpClient::CurlContext::header(char *in, size_t size, size_t nitems) -> size_t
+{
+  const auto line = std::string_view{in, size * nitems};
+  const auto colon = line.find(':');
+  // the status line and the blank line ending the headers have no colon
+  if (colon == std::string_view::npos)
+    return size * nitems;
+  auto trim = [](std::string_view v) {
+    while (!v.empty() && std::isspace(static_cast<unsigned char>(v.front())))
+      v.remove_prefix(1);
+    while (!v.empty() && std::isspace(static_cast<unsigned char>(v.back())))
+      v.remove_suffix(1);
+    return v;
+  };
+  const auto name = trim(line.substr(0, colon));
+  const auto value = trim(line.substr(colon + 1));
+  if (std::ranges::equal(name, std::string_view{"content-length"}, [](char a, char b) {
+        return std::tolower(static_cast<unsigned char>(a)) == b;
+      }))
+  {
+    // a streamed body never lands in the buffer
+    auto len = size_t{0};
+    if (!onChunk && std::from_chars(value.data(), value.data() + value.size(), len).ec == std::errc{})
+      payloadOut.reserve(std::min(len, MaxReserve));
+  }
+  if (self->tap_)
+    tappedHeaders.emplace_back(name, value);
+  if (onHeader)
+    onHeader(name, value);
+  return size * nitems;
+}
+
 auto HttpClient::CurlContext::read(char *out, unsigned size, unsigned nmemb) -> size_t
 {
+  if (upload)
+  {
+    auto &u = *upload;
+    if (u.aborted)
+      return CURL_READFUNC_ABORT;
+    if (u.pending.empty())
+    {
+      if (u.finished)
+        return 0;
+      // nothing to send yet, write() wakes the transfer up again
+      u.paused = true;
+      return CURL_READFUNC_PAUSE;
+    }
+    const auto ret = std::min(u.pending.size(), static_cast<size_t>(size) * nmemb);
+    std::copy(std::begin(u.pending), std::begin(u.pending) + static_cast<ptrdiff_t>(ret), out);
+    u.pending.erase(0, ret);
+    return ret;
+  }
   const auto ret = std::min(static_cast<unsigned>(payloadIn.size()), size * nmemb);
   std::copy(std::begin(payloadIn), std::begin(payloadIn) + ret, out);
   payloadIn.erase(0, ret);
@@ -230,14 +448,124 @@ auto HttpClient::CurlContext::read_(char *out, unsigned size, unsigned nmemb, vo
   return static_cast<CurlContext *>(ctx)->read(out, size, nmemb);
 }
 
-auto HttpClient::post(const std::string &url, std::string post, Callback cb, const Headers &headers)
-  -> void
+auto HttpClient::post(const std::string &url,
+                      std::string post,
+                      Callback cb,
+                      const Headers &headers,
+                      Priority priority) -> void
+{
+  stream(url, std::move(post), Stream{.onDone = std::move(cb), .priority = priority}, headers);
+}
+
+auto HttpClient::stream(const std::string &url,
+                        std::optional<std::string> post,
+                        Stream stream,
+                        const Headers &headers) -> void
+{
+  if (answerStubbed(url, post ? std::string_view{*post} : std::string_view{}, headers, stream))
+    return;
+  submit(createHandle(url, std::move(post), std::move(stream), headers));
+}
+
+auto HttpClient::active() const -> int
+{
+  auto ret = 0;
+  for (const auto &[host, n] : perHost)
+    ret += n;
+  return ret;
+}
+
+auto HttpClient::warm(const std::string &url) -> void
+{
+  if (isStubbed)
+    return;
+  const auto host = hostOf(url);
+  if (auto it = timings_.find(host);
+      it != std::end(timings_) && std::chrono::steady_clock::now() < it->second.at + WarmPeriod)
+    return;
+  auto handle = createHandle(url,
+                             std::nullopt,
+                             Stream{.onDone = [](CURLcode, long, std::string) {},
+                                    .priority = Priority::background,
+                                    .deadline = WarmDeadline},
+                             {});
+  curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+  submit(handle);
+}
+
+auto HttpClient::createHandle(const std::string &url,
+                              std::optional<std::string> post,
+                              Stream stream,
+                              const Headers &headers) -> CURL *
 {
+  auto handle = curl_easy_init();
+  auto ctx = new CurlContext;
+  ctx->self = this;
+  ctx->handle = handle;
+  ctx->callback = std::move(stream.onDone);
+  ctx->onChunk = std::move(stream.onChunk);
+  ctx->onHeader = std::move(stream.onHeader);
+  ctx->payloadOut = std::move(stream.sink);
+  ctx->payloadOut.clear();
+  ctx->host = hostOf(url);
+  ctx->url = url;
+  ctx->priority = stream.priority;
+  if (stream.deadline.count() > 0)
+    ctx->deadline = std::chrono::steady_clock::now() + stream.deadline;
+  curl_easy_setopt(handle, CURLOPT_PRIVATE, ctx);
+  curl_easy_setopt(handle, CURLOPT_WRITEDATA, ctx);
+  curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CurlContext::write_);
+  curl_easy_setopt(handle, CURLOPT_HEADERDATA, ctx);
+  curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, CurlContext::header_);
+  if (post)
+  {
+    ctx->payloadIn = std::move(*post);
+    curl_easy_setopt(handle, CURLOPT_READDATA, ctx);
+    curl_easy_setopt(handle, CURLOPT_READFUNCTION, CurlContext::read_);
+    curl_easy_setopt(handle, CURLOPT_POST, 1L);
+  }
+  curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+  setup(handle);
+  if (!headers.empty())
+  {
+    for (const auto &h : headers)
+      ctx->headers = curl_slist_append(
+        ctx->headers, (h.first + ":" + (!h.second.empty() ? (" " + h.second) : "")).c_str());
+    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, ctx->headers);
+  }
+  return handle;
+}
+
+auto HttpClient::upload(const std::string &url, Callback cb, const Headers &headers) -> Upload
+{
+  auto ret = Upload{};
+  if (isStubbed && responder)
+  {
+    // no handle, the writes go nowhere and the response is made up once the body would be sent
+    ret.state->onClose = [this, url, headers, cb = std::move(cb)](bool aborted) mutable {
+      auto stream = Stream{.onDone = std::move(cb)};
+      if (aborted)
+        enqueueAnswer(Exchange{.url = url, .result = CURLE_ABORTED_BY_CALLBACK}, std::move(stream));
+      else
+        answerStubbed(url, {}, headers, stream);
+    };
+    return ret;
+  }
+  if (isStubbed)
+  {
+    // no handle, the writes go nowhere
+    auto stream = Stream{.onDone = std::move(cb)};
+    answerStubbed(url, {}, headers, stream);
+    return ret;
+  }
   auto handle = curl_easy_init();
   auto ctx = new CurlContext;
   ctx->self = this;
   ctx->callback = std::move(cb);
-  ctx->payloadIn = std::move(post);
+  ctx->upload = ret.state;
+  ctx->host = hostOf(url);
+  ctx->url = url;
+  ret.state->handle = handle;
   curl_easy_setopt(handle, CURLOPT_PRIVATE, ctx);
   curl_easy_setopt(handle, CURLOPT_WRITEDATA, ctx);
   curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, CurlContext::write_);
@@ -245,17 +573,206 @@ auto HttpClient::post(const std::string &url, std::string post, Callback cb, con
   curl_easy_setopt(handle, CURLOPT_READFUNCTION, CurlContext::read_);
   curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
   curl_easy_setopt(handle, CURLOPT_POST, 1L);
+  setup(handle);
+  // without a size libcurl only streams the body when asked for chunked encoding; over HTTP/2
+  // the header is dropped and the body goes in DATA frames
+  ctx->headers = curl_slist_append(ctx->headers, "Transfer-Encoding: chunked");
+  for (const auto &h : headers)
+    ctx->headers = curl_slist_append(
+      ctx->headers, (h.first + ":" + (!h.second.empty() ? (" " + h.second) : "")).c_str());
+  curl_easy_setopt(handle, CURLOPT_HTTPHEADER, ctx->headers);
+  ret.state->cancel = [this, handle]() { cancel(handle); };
+
+  submit(handle);
+  return ret;
+}
+
+auto HttpClient::setup(CURL *handle) -> void
+{
+  curl_easy_setopt(handle, CURLOPT_SHARE, shareHandle);
+  curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  // a request that could share a connection still being set up waits for it instead of opening
+  // its own
+  curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, KeepAliveSeconds);
+  curl_easy_setopt(handle, CURLOPT_TCP_KEEPINTVL, KeepAliveSeconds);
+  curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, DnsCacheSeconds);
 #ifdef _WIN32
   curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L);
 #endif
-  if (!headers.empty())
+}
+
+auto HttpClient::recordTiming(CURL *handle) -> void
+{
+  // the curl times are cumulative from the start of the request
+  const auto dns = msOf(handle, CURLINFO_NAMELOOKUP_TIME_T);
+  const auto connect = msOf(handle, CURLINFO_CONNECT_TIME_T);
+  const auto tls = msOf(handle, CURLINFO_APPCONNECT_TIME_T);
+  auto newConnections = 0L;
+  curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &newConnections);
+  char *url = nullptr;
+  curl_easy_getinfo(handle, CURLINFO_EFFECTIVE_URL, &url);
+  auto timing = Timing{};
+  timing.dns = dns;
+  timing.connect = connect > 0.f ? connect - dns : 0.f;
+  timing.tls = tls > 0.f ? tls - connect : 0.f;
+  timing.ttfb = msOf(handle, CURLINFO_STARTTRANSFER_TIME_T);
+  timing.total = msOf(handle, CURLINFO_TOTAL_TIME_T);
+  timing.reused = newConnections == 0;
+  timing.at = std::chrono::steady_clock::now();
+  const auto host = hostOf(url ? url : "");
+  SPDLOG_DEBUG("{}: dns {:.0f} ms, connect {:.0f} ms, tls {:.0f} ms, ttfb {:.0f} ms, total {:.0f} ms{}",
+               host,
+               timing.dns,
+               timing.connect,
+               timing.tls,
+               timing.ttfb,
+               timing.total,
+               timing.reused ? " (reused)" : "");
+  timings_[host] = timing;
+}
+
+auto HttpClient::tap(Tap v) -> void
+{
+  tap_ = std::move(v);
+}
+
+auto HttpClient::stub(std::vector<Exchange> exchanges, float speed) -> void
+{
+  isStubbed = true;
+  stubSpeed = speed;
+  responder = nullptr;
+  stubs.clear();
+  for (auto &e : exchanges)
+    stubs[e.url].push_back(std::move(e));
+}
+
+auto HttpClient::mock(Responder v, float speed) -> void
+{
+  isStubbed = true;
+  stubSpeed = speed;
+  responder = std::move(v);
+  stubs.clear();
+}
+
+auto HttpClient::answerStubbed(const std::string &url,
+                               std::string_view post,
+                               const Headers &headers,
+                               Stream &stream) -> bool
+{
+  if (!isStubbed)
+    return false;
+  if (responder)
   {
-    for (const auto &h : headers)
+    enqueueAnswer(responder(url, post, headers), std::move(stream));
+    return true;
+  }
+  auto exchange = Exchange{.url = url, .result = CURLE_COULDNT_CONNECT};
+  if (auto it = stubs.find(url); it != std::end(stubs) && !it->second.empty())
+  {
+    exchange = std::move(it->second.front());
+    it->second.pop_front();
+  }
+  else
+    SPDLOG_WARN("no recorded response for {:?}", url);
+  enqueueAnswer(std::move(exchange), std::move(stream));
+  return true;
+}
 
-      ctx->headers = curl_slist_append(
-        ctx->headers, (h.first + ":" + (!h.second.empty() ? (" " + h.second) : "")).c_str());
-    curl_easy_setopt(handle, CURLOPT_HTTPHEADER, ctx->headers);
+auto HttpClient::enqueueAnswer(Exchange exchange, Stream stream) -> void
+{
+  const auto now = std::chrono::steady_clock::now();
+  // a stream starts with its first piece, everything else comes at once
+  const auto ms = !exchange.pieces.empty() && stream.onChunk ? exchange.pieces.front().ms : exchange.ms;
+  answers.emplace(now + stubDelay(ms), Answer{std::move(exchange), std::move(stream), now});
+  // the callback never runs inside the call that made the request, like a real one
+  scheduleAnswers();
+}
+
+auto HttpClient::deliverAnswers() -> void
+{
+  const auto now = std::chrono::steady_clock::now();
+  while (!answers.empty() && answers.begin()->first <= now)
+  {
+    auto answer = std::move(answers.begin()->second);
+    answers.erase(answers.begin());
+    auto &[e, stream, requested, piece, sent] = answer;
+    if (stream.onHeader && piece == 0)
+      for (const auto &[name, value] : e.headers)
+        stream.onHeader(name, value);
+    if (stream.onChunk && e.status >= 200 && e.status < 300)
+    {
+      if (piece < e.pieces.size())
+      {
+        const auto end = std::min(e.pieces[piece].end, e.body.size());
+        stream.onChunk(std::string_view{e.body}.substr(sent, end - sent));
+        sent = end;
+        if (++piece < e.pieces.size())
+        {
+          const auto at = requested + stubDelay(e.pieces[piece].ms);
+          answers.emplace(at, std::move(answer));
+          continue;
+        }
+      }
+      else if (!e.body.empty())
+        stream.onChunk(e.body);
+      e.body.clear();
+    }
+    if (stream.onDone)
+      stream.onDone(e.result, e.status, std::move(e.body));
   }
+  scheduleAnswers();
+}
+
+auto HttpClient::scheduleAnswers() -> void
+{
+  if (answers.empty())
+    return;
+  const auto next =
+    std::chrono::ceil<std::chrono::milliseconds>(answers.begin()->first - std::chrono::steady_clock::now());
+  stubTimer.start([this]() { deliverAnswers(); }, static_cast<uint64_t>(std::max<int64_t>(0, next.count())), 0);
+}
 
-  curl_multi_add_handle(multiHandle, handle);
+auto HttpClient::stubDelay(float ms) const -> std::chrono::steady_clock::duration
+{
+  return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+    std::chrono::duration<float, std::milli>{ms / stubSpeed});
+}
+
+auto HttpClient::Upload::State::resume() -> void
+{
+  if (!handle || !paused)
+    return;
+  paused = false;
+  curl_easy_pause(handle, CURLPAUSE_CONT);
+}
+
+auto HttpClient::Upload::write(std::string_view data) -> void
+{
+  if (!state->handle || state->finished || state->aborted)
+    return;
+  state->pending += data;
+  state->resume();
+}
+
+auto HttpClient::Upload::finish() -> void
+{
+  state->finished = true;
+  if (state->onClose)
+    std::exchange(state->onClose, nullptr)(false);
+  state->resume();
+}
+
+auto HttpClient::Upload::abort() -> void
+{
+  if (state->aborted)
+    return;
+  state->aborted = true;
+  if (state->onClose)
+    std::exchange(state->onClose, nullptr)(true);
+  // once the body is sent the read callback is not asked again, a response that never comes
+  // would keep the transfer
+  if (state->handle && state->cancel)
+    std::exchange(state->cancel, nullptr)();
 }
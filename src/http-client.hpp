@@ -1,6 +1,13 @@
 #pragma once
+#include <chrono>
+#include <array>
+#include <deque>
 #include <functional>
+#include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
@@ -19,20 +26,180 @@ class HttpClient : public virtual enable_shared_from_this
 public:
   using Headers = std::vector<std::pair<std::string, std::string>>;
   using Callback = std::move_only_function<void(CURLcode, long httpStatus, std::string payload)>;
+  // receives a successful response body piece by piece while it downloads
+  using ChunkCallback = std::move_only_function<void(std::string_view)>;
+  using HeaderCallback = std::move_only_function<void(std::string_view name, std::string_view value)>;
+
+  // interactive requests start before any queued background one, and background requests never
+  // take more than MaxBackground transfers
+  enum class Priority {
+    interactive,
+    background,
+  };
+
+  // a response delivered while it downloads
+  struct Stream
+  {
+    // every response header, before any of the body
+    HeaderCallback onHeader = nullptr;
+    // 2xx body data as it arrives; without it, and for error bodies, the body is collected in sink
+    ChunkCallback onChunk = nullptr;
+    // called once at the end with the collected body
+    Callback onDone = nullptr;
+    // where the body is collected; a buffer reused from an earlier response keeps its capacity,
+    // otherwise it is reserved from Content-Length
+    std::string sink = {};
+    Priority priority = Priority::interactive;
+    // the request fails with CURLE_OPERATION_TIMEDOUT if it has not completed this long after it
+    // was made, time waiting in the queue included; zero for no limit
+    std::chrono::milliseconds deadline = {};
+  };
+
+  // request body written while the request is already in flight, sent with chunked transfer
+  // encoding; it stays open until finish() or abort()
+  class Upload
+  {
+  public:
+    auto write(std::string_view) -> void;
+    auto finish() -> void;
+    auto abort() -> void;
+
+  private:
+    friend class HttpClient;
+    struct State
+    {
+      CURL *handle = nullptr;
+      std::string pending;
+      bool finished = false;
+      bool aborted = false;
+      bool paused = false;
+      // a mocked upload has no handle, its request is answered once finish() or abort() closes it
+      std::move_only_function<void(bool aborted)> onClose = nullptr;
+      // takes the transfer off the client, the read callback only sees an abort while the body
+      // is still being sent
+      std::move_only_function<void()> cancel = nullptr;
+      auto resume() -> void;
+    };
+    std::shared_ptr<State> state = std::make_shared<State>();
+  };
+
+  // where the time of a request went, in milliseconds; connect and tls are zero on a reused
+  // connection
+  struct Timing
+  {
+    float dns = 0.f;
+    float connect = 0.f;
+    float tls = 0.f;
+    // from the start of the request to the first byte of the response
+    float ttfb = 0.f;
+    float total = 0.f;
+    bool reused = false;
+    std::chrono::steady_clock::time_point at = {};
+  };
+
+  // a finished request as the session recorder keeps it
+  struct Exchange
+  {
+    std::string url = {};
+    CURLcode result = CURLE_OK;
+    long status = 0;
+    Headers headers = {};
+    std::string body = {};
+    // from the request to the response
+    float ms = 0.f;
+    // when a made up response delivers the body up to end, for a stream; never recorded
+    struct Piece
+    {
+      float ms;
+      size_t end;
+    };
+    std::vector<Piece> pieces = {};
+  };
+  using Tap = std::function<void(const Exchange &)>;
+  // makes up the response to a request, for mock()
+  using Responder = std::function<Exchange(const std::string &url, std::string_view post, const Headers &)>;
 
   HttpClient(uv::Uv &);
   HttpClient(const HttpClient &) = delete;
   ~HttpClient();
-  auto get(const std::string &url, Callback callback, const Headers &headers = Headers{}) -> void;
+  auto get(const std::string &url,
+           Callback callback,
+           const Headers &headers = Headers{},
+           Priority = Priority::interactive) -> void;
   auto post(const std::string &url,
             std::string post,
             Callback callback,
-            const Headers &chunks = Headers{}) -> void;
+            const Headers &chunks = Headers{},
+            Priority = Priority::interactive) -> void;
+  // get() when post is empty, post() otherwise, with the body delivered through the stream
+  auto stream(const std::string &url,
+              std::optional<std::string> post,
+              Stream,
+              const Headers &headers = Headers{}) -> void;
+  auto upload(const std::string &url, Callback callback, const Headers &headers = Headers{}) -> Upload;
+  // opens a connection to the host of url with a HEAD request so the next real request finds it
+  // ready; nothing is sent if a request to the host finished within WarmPeriod
+  auto warm(const std::string &url) -> void;
+  // the latest request to each host
+  auto timings() const -> const std::map<std::string, Timing> & { return timings_; }
+  // transfers running and requests waiting for a slot
+  auto active() const -> int;
+  auto waiting() const -> size_t { return queued[0].size() + queued[1].size(); }
+  // hands every finished request to tap as well, null stops
+  auto tap(Tap) -> void;
+  // answers requests from the exchanges instead of the network, the next one recorded for the
+  // URL, after its recorded time divided by speed; a request with none left fails at once
+  auto stub(std::vector<Exchange>, float speed) -> void;
+  // answers requests with what the responder makes up instead of the network, its times divided
+  // by speed; a stream gets the pieces at their times, an upload's time counts from its finish()
+  auto mock(Responder, float speed) -> void;
+
+  // servers commonly close a connection idle for a minute, a warm connection is refreshed before
+  static constexpr auto WarmIdle = std::chrono::seconds{45};
+  // how often warm() is called; a use skips one call, so the connection still sees a request
+  // within two periods, no later than WarmIdle
+  static constexpr auto WarmPeriod = WarmIdle / 2;
+  static constexpr auto WarmDeadline = std::chrono::seconds{10};
 
 private:
+  // Content-Length beyond this is not trusted for the reserve
+  static constexpr auto MaxReserve = size_t{64} << 20;
+  // idle connections are probed this often so the pool notices dead ones before a request does
+  static constexpr auto KeepAliveSeconds = 30L;
+  static constexpr auto DnsCacheSeconds = 300L;
+  // transfers running at once to one host, more wait in the queue
+  static constexpr auto MaxPerHost = 4;
+  static constexpr auto MaxBackground = 2;
+
   std::reference_wrapper<uv::Uv> uv;
   uv::Timer timeout;
   CURLM *multiHandle = nullptr;
+  // DNS, TLS sessions and connections are shared by every request
+  CURLSH *shareHandle = nullptr;
+  std::map<std::string, Timing> timings_;
+  // requests waiting for a free slot, one queue per priority
+  std::array<std::deque<CURL *>, 2> queued;
+  Tap tap_;
+  // replayed responses by URL, oldest first, and the ones waiting for their time
+  std::map<std::string, std::deque<Exchange>> stubs;
+  Responder responder;
+  float stubSpeed = 1.f;
+  bool isStubbed = false;
+  struct Answer
+  {
+    Exchange exchange;
+    Stream stream;
+    std::chrono::steady_clock::time_point requested;
+    // the next of the exchange's pieces and how much of the body went out
+    size_t piece = 0;
+    size_t sent = 0;
+  };
+  std::multimap<std::chrono::steady_clock::time_point, Answer> answers;
+  uv::Timer stubTimer;
+  // runs schedule() at the earliest deadline of a queued request
+  uv::Timer deadlineTimer;
+  std::map<std::string, int> perHost;
+  int backgroundActive = 0;
   struct SockContext
   {
     HttpClient *self;
@@ -42,17 +209,45 @@ private:
   struct CurlContext
   {
     HttpClient *self;
+    CURL *handle = nullptr;
     std::string payloadIn;
     std::string payloadOut;
     curl_slist *headers = nullptr;
     Callback callback;
+    ChunkCallback onChunk;
+    HeaderCallback onHeader;
+    std::shared_ptr<Upload::State> upload;
+    std::string host;
+    Priority priority = Priority::interactive;
+    std::optional<std::chrono::steady_clock::time_point> deadline;
+    // what the tap gets, collected only while there is one
+    std::string url;
+    Headers tappedHeaders;
+    std::string tappedBody;
     auto write(char *in, unsigned size, unsigned nmemb) -> size_t;
     static auto write_(char *in, unsigned size, unsigned nmemb, void *ctx) -> size_t;
+    auto header(char *in, size_t size, size_t nitems) -> size_t;
+    static auto header_(char *in, size_t size, size_t nitems, void *ctx) -> size_t;
     auto read(char *in, unsigned size, unsigned nmemb) -> size_t;
     static auto read_(char *out, unsigned size, unsigned nmemb, void *ctx) -> size_t;
     auto done() -> void;
   };
   auto checkMultiInfo() -> void;
+  auto createHandle(const std::string &url, std::optional<std::string> post, Stream, const Headers &)
+    -> CURL *;
+  auto setup(CURL *) -> void;
+  auto submit(CURL *) -> void;
+  auto schedule() -> void;
+  auto release(CURL *) -> void;
+  // ends a queued or running transfer with CURLE_ABORTED_BY_CALLBACK
+  auto cancel(CURL *) -> void;
+  auto recordTiming(CURL *) -> void;
+  // true when the request was answered from the stubs or the responder
+  auto answerStubbed(const std::string &url, std::string_view post, const Headers &, Stream &) -> bool;
+  auto enqueueAnswer(Exchange, Stream) -> void;
+  auto deliverAnswers() -> void;
+  auto scheduleAnswers() -> void;
+  auto stubDelay(float ms) const -> std::chrono::steady_clock::duration;
   auto createSockContext(curl_socket_t sockfd) -> SockContext *;
   auto curlPerform(uv_poll_t *req, int status, int events) -> void;
   auto destroySockContext(SockContext *context) -> void;
@@ -2,6 +2,7 @@
 #include "file-open.hpp"
 #include "imgui-helpers.hpp"
 #include "ui.hpp"
+#include <algorithm>
 #include <fmt/std.h>
 #include <spdlog/spdlog.h>
 
@@ -21,19 +22,33 @@ auto ImageList::frame(int v) -> void
   frame_ = v;
 }
 
+auto ImageList::textureBytes(Node::Counted &counted) const -> size_t
+{
+  auto ret = size_t{0};
+  // the frames of a list its clones still share are counted with the first of them
+  if (textures.isShared() && !counted.insert(&*textures).second)
+    return ret;
+  for (const auto &t : *textures)
+    if (t.use_count() == 1)
+      ret += t->bytes();
+  if (atlas && atlas.use_count() == 1)
+    ret += atlas->bytes();
+  return ret;
+}
+
 auto ImageList::h() const -> float
 {
-  if (textures.empty())
+  if (textures->empty())
     return 100;
-  return textures.front()->h();
+  return textures->front()->h();
 }
 
 auto ImageList::isTransparent(glm::vec2 v) const -> bool
 {
-  if (textures.empty())
+  if (textures->empty())
     return false;
 
-  auto &texture = textures[frame_ % textures.size()];
+  const auto &texture = (*textures)[static_cast<size_t>(frame_) % textures->size()];
 
   if (texture->ch() == 3)
     return false;
@@ -42,47 +57,54 @@ auto ImageList::isTransparent(glm::vec2 v) const -> bool
   if (x < 0 || x >= texture->w() || y < 0 || y >= texture->h())
     return true;
 
-  if (auto imageData = texture->imageData())
-    return imageData[(x + y * texture->w()) * texture->ch() + 3] < 127;
-  else
-    return false;
+  return texture->isTransparent(x, y);
 }
 
 auto ImageList::load(IStrm &strm) -> void
 {
   ::deser(strm, *this);
-  textures.clear();
+  auto &frames = textures.edit();
+  frames.clear();
   for (const auto &path : texturesForSaveLoad)
-    textures.emplace_back(lib.get().queryTex(path));
+    frames.emplace_back(lib.get().queryTex(path));
 }
 
 auto ImageList::numFrames() const -> int
 {
-  return static_cast<int>(textures.size());
+  return static_cast<int>(textures->size());
 }
 
 auto ImageList::render() -> void
 {
-  if (textures.empty())
+  if (textures->empty())
     return;
 
-  auto &texture = textures[frame_ % textures.size()];
-
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, texture->texture());
-  glBegin(GL_QUADS);
-  glColor4f(1.f, 1.f, 1.f, 1.f);
-  glTexCoord2f(.0f, .0f);
-  glVertex2f(.0f, .0f);
-  glTexCoord2f(1.f, .0f);
-  glVertex2f(w(), .0f);
-  glTexCoord2f(1.f, 1.f);
-  glVertex2f(w(), h());
-  glTexCoord2f(.0f, 1.f);
-  glVertex2f(.0f, h());
-  glEnd();
-  glBindTexture(GL_TEXTURE_2D, 0);
-  glDisable(GL_TEXTURE_2D);
+  // adding, removing or reloading a frame rebuilds the atlas
+  if (atlas && !atlas->matches(*textures))
+    atlas = nullptr;
+  if (!atlas && FrameAtlas::isUploaded(*textures) &&
+      !std::ranges::equal(
+        atlasFailed, *textures, [](uint64_t id, const auto &t) { return id == t->imageId(); }))
+  {
+    atlas = FrameAtlas::make(*textures);
+    if (!atlas)
+    {
+      atlasFailed.clear();
+      for (const auto &t : *textures)
+        atlasFailed.push_back(t->imageId());
+    }
+  }
+  if (atlas)
+  {
+    const auto [uv0, uv1] = atlas->uv(frame_ % static_cast<int>(textures->size()));
+    lib.get().spriteBatch().quad(atlas->texture(), glm::vec2{.0f, .0f}, glm::vec2{w(), h()}, uv0, uv1);
+    return;
+  }
+
+  const auto &texture = (*textures)[static_cast<size_t>(frame_) % textures->size()];
+
+  lib.get().spriteBatch().quad(
+    texture->texture(), glm::vec2{.0f, .0f}, glm::vec2{w(), h()}, glm::vec2{.0f, .0f}, glm::vec2{1.f, 1.f});
 }
 
 auto ImageList::renderUi() -> void
@@ -95,7 +117,7 @@ auto ImageList::renderUi() -> void
   ImGui::TableNextColumn();
   auto n = 0;
   auto toDel = -1;
-  for (auto &texture : textures)
+  for (const auto &texture : *textures)
   {
     auto const delStr = fmt::format("X##{} {}", n, texture->path());
     if (ImGui::Button(delStr.c_str()))
@@ -108,7 +130,8 @@ auto ImageList::renderUi() -> void
       [alive = weak_self(), toDel]() {
         if (auto self = alive.lock())
         {
-          self->textures.erase(std::begin(self->textures) + toDel);
+          auto &frames = self->textures.edit();
+          frames.erase(std::begin(frames) + toDel);
         }
         else
         {
@@ -133,7 +156,7 @@ auto ImageList::renderUi() -> void
           [alive = weak_self(), path]() {
             if (auto self = alive.lock())
             {
-              self->textures.emplace_back(self->lib.get().queryTex([&]() {
+              self->textures.edit().emplace_back(self->lib.get().queryTex([&]() {
                 try
                 {
                   if (!std::filesystem::exists(path.filename()))
@@ -155,7 +178,7 @@ auto ImageList::renderUi() -> void
           [alive = weak_self()]() {
             if (auto self = alive.lock())
             {
-              self->textures.pop_back();
+              self->textures.edit().pop_back();
             }
             else
             {
@@ -169,14 +192,14 @@ auto ImageList::renderUi() -> void
 auto ImageList::save(OStrm &strm) const -> void
 {
   texturesForSaveLoad.clear();
-  for (const auto &t : textures)
+  for (const auto &t : *textures)
     texturesForSaveLoad.emplace_back(t->path());
   ::ser(strm, *this);
 }
 
 auto ImageList::w() const -> float
 {
-  if (textures.empty())
+  if (textures->empty())
     return 100;
-  return textures.front()->w();
+  return textures->front()->w();
 }
@@ -1,5 +1,6 @@
 #pragma once
 #include "dialog.hpp"
+#include "frame-atlas.hpp"
 #include "lib.hpp"
 #include "node.hpp"
 #include "undo.hpp"
@@ -22,6 +23,9 @@ public:
   auto render() -> void;
   auto renderUi() -> void;
   auto save(OStrm &) const -> void;
+  // memory of the textures nobody else holds; the frames clones share go to the first of them
+  // counted
+  auto textureBytes(Node::Counted &) const -> size_t;
   auto w() const -> float;
 
 private:
@@ -29,6 +33,11 @@ private:
   std::reference_wrapper<Undo> undo;
   int frame_ = 0;
   mutable std::vector<std::string> texturesForSaveLoad;
-  std::vector<std::shared_ptr<const Texture>> textures;
+  // shared with the clones until one of them adds or removes a frame
+  Cow<std::vector<std::shared_ptr<const Texture>>> textures;
+  // the frames in one texture once they are all uploaded with the same size, shared by clones
+  std::shared_ptr<const FrameAtlas> atlas;
+  // the uploads of the frames the atlas could not be built from, not tried again until they change
+  std::vector<uint64_t> atlasFailed;
   std::shared_ptr<Dialog> dialog = nullptr;
 };
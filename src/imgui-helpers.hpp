@@ -1,7 +1,8 @@
 #pragma once
 
-#include <fmt/core.h>
+#include <fmt/format.h>
 #include <imgui.h>
+#include <iterator>
 
 namespace ImGui
 {
@@ -17,11 +18,13 @@ namespace ImGui
     return ImGui::TextUnformatted(text);
   }
 
+  // formats on the stack, the panels redrawn every frame would otherwise allocate for each line
   template <typename... Args>
   decltype(auto) TextF(fmt::format_string<Args...> format, Args &&...args)
   {
-    auto const text = fmt::format(std::move(format), std::forward<Args>(args)...);
-    return ImGui::TextUnformatted(text);
+    auto text = fmt::basic_memory_buffer<char, 256>{};
+    fmt::format_to(std::back_inserter(text), std::move(format), std::forward<Args>(args)...);
+    return ImGui::TextUnformatted(std::string_view{text.data(), text.size()});
   }
 
   inline decltype(auto) CalcTextSize(std::string_view text, bool hide_text_after_double_hash = false, float wrap_width = -1.0f)
@@ -0,0 +1,72 @@
+#include "io-thread.hpp"
+#include "trace.hpp"
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace
+{
+  auto initLoop(uv_loop_t *loop) -> uv_loop_t *
+  {
+    if (const auto r = uv_loop_init(loop); r < 0)
+      throw std::runtime_error(fmt::format("Cannot create the io loop: {}", uv_err_name(r)));
+    return loop;
+  }
+} // namespace
+
+IoThread::Io::Io(uv_loop_t *aLoop) : uv(aLoop), inbox(uv.createAsync()) {}
+
+IoThread::IoThread(uv::Uv &main)
+  : loop(std::make_unique<uv_loop_t>()),
+    io(std::make_unique<Io>(initLoop(loop.get()))),
+    outbox(main.createAsync()),
+    thread([this]() {
+      Trace::nameThread("io");
+      io->uv.run();
+    })
+{
+}
+
+IoThread::~IoThread()
+{
+  // the deletions posted by make() run before the loop stops
+  post([this]() {
+    {
+      auto lock = std::lock_guard{mutex};
+      stopping = true;
+    }
+    io->uv.stop();
+  });
+  thread.join();
+  io = nullptr;
+  // one more turn for the close callbacks of the inbox and of the connections just destroyed
+  uv_run(loop.get(), UV_RUN_NOWAIT);
+  if (uv_loop_close(loop.get()) < 0)
+  {
+    SPDLOG_WARN("The io loop still has open handles");
+    // freeing it would leave them dangling
+    [[maybe_unused]] auto leaked = loop.release();
+  }
+}
+
+auto IoThread::uv() -> uv::Uv &
+{
+  return io->uv;
+}
+
+auto IoThread::post(Task task) -> void
+{
+  {
+    auto lock = std::lock_guard{mutex};
+    if (!stopping)
+    {
+      io->inbox.post(std::move(task));
+      return;
+    }
+  }
+  // dropped outside the lock, what it holds may post again as it goes
+}
+
+auto IoThread::postMain(Task task) -> void
+{
+  outbox.post(std::move(task));
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "uv.hpp"
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// A second libuv loop on its own thread for the network connections that should neither wait for
+// a frame nor hold one up. The objects living there are created, used and destroyed only from
+// tasks posted with post(); what they produce comes back to the main loop through postMain().
+class IoThread
+{
+public:
+  using Task = uv::Async::Task;
+
+  IoThread(uv::Uv &main);
+  IoThread(const IoThread &) = delete;
+  // runs the tasks posted so far, then stops the thread
+  ~IoThread();
+  // for tasks running on the io thread only
+  auto uv() -> uv::Uv &;
+  // runs task on the io thread; dropped once the thread is stopping
+  auto post(Task) -> void;
+  // runs task on the main loop, in the order posted
+  auto postMain(Task) -> void;
+
+  // a shared_ptr that is destroyed on the io thread, wherever its last owner lets go
+  template <typename T, typename... Args>
+  auto make(Args &&...args) -> std::shared_ptr<T>
+  {
+    return std::shared_ptr<T>(new T(std::forward<Args>(args)...), [this](T *ptr) {
+      post([ptr]() { delete ptr; });
+    });
+  }
+
+private:
+  struct Io
+  {
+    Io(uv_loop_t *);
+    uv::Uv uv;
+    uv::Async inbox;
+  };
+
+  std::unique_ptr<uv_loop_t> loop;
+  std::unique_ptr<Io> io;
+  uv::Async outbox;
+  std::mutex mutex;
+  bool stopping = false;
+  std::thread thread;
+};
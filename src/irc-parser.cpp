@@ -0,0 +1,95 @@
+#include "irc-parser.hpp"
+#include <algorithm>
+
+namespace
+{
+  auto popToken(std::string_view &rest) -> std::string_view
+  {
+    const auto space = rest.find(' ');
+    const auto ret = rest.substr(0, space);
+    rest = space == std::string_view::npos ? std::string_view{} : rest.substr(space + 1);
+    while (!rest.empty() && rest.front() == ' ')
+      rest.remove_prefix(1);
+    return ret;
+  }
+} // namespace
+
+auto IrcParser::push(std::string_view data) -> void
+{
+  std::ranges::copy(data, prepare(data.size()).data());
+  commit(data.size());
+}
+
+auto IrcParser::prepare(size_t size) -> std::span<char>
+{
+  // moves each byte at most once for every time the buffer doubles
+  if (start > 0 && start >= end / 2)
+  {
+    std::copy(buf.data() + start, buf.data() + end, buf.data());
+    end -= start;
+    start = 0;
+  }
+  // the room is kept between reads, so a steady connection stops resizing
+  if (buf.size() - end < size)
+    buf.resize(std::max(end + size, buf.size() * 2));
+  return {buf.data() + end, buf.size() - end};
+}
+
+auto IrcParser::commit(size_t size) -> void
+{
+  end += std::min(size, buf.size() - end);
+}
+
+auto IrcParser::next() -> std::optional<Msg>
+{
+  for (;;)
+  {
+    const auto data = std::string_view{buf.data(), end};
+    const auto eol = data.find('\n', start + scanned);
+    if (eol == std::string_view::npos)
+    {
+      scanned = end - start;
+      return std::nullopt;
+    }
+    auto line = data.substr(start, eol - start);
+    start = eol + 1;
+    scanned = 0;
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (!line.empty())
+      return parse(line);
+  }
+}
+
+auto IrcParser::parse(std::string_view rest) -> Msg
+{
+  auto ret = Msg{};
+  while (!rest.empty() && rest.front() == ' ')
+    rest.remove_prefix(1);
+  if (rest.starts_with('@'))
+    ret.tags = popToken(rest).substr(1);
+  if (rest.starts_with(':'))
+    ret.source = popToken(rest).substr(1);
+  ret.command = popToken(rest);
+  while (!rest.empty() && ret.paramsCount < MaxParams)
+  {
+    if (rest.front() == ':')
+    {
+      ret.params[ret.paramsCount++] = rest.substr(1);
+      break;
+    }
+    ret.params[ret.paramsCount++] = popToken(rest);
+  }
+  return ret;
+}
+
+auto IrcParser::popTag(std::string_view &tags) -> std::pair<std::string_view, std::string_view>
+{
+  const auto semicolon = tags.find(';');
+  const auto tag = tags.substr(0, semicolon);
+  tags = semicolon == std::string_view::npos ? std::string_view{} : tags.substr(semicolon + 1);
+  const auto eq = tag.find('=');
+  if (eq == std::string_view::npos)
+    return {tag, {}};
+  return {tag.substr(0, eq), tag.substr(eq + 1)};
+}
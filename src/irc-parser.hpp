@@ -0,0 +1,49 @@
+#pragma once
+#include <array>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+
+// Splits the bytes of an IRC connection into messages without copying them: the fields are views
+// into one contiguous buffer, which is compacted only once most of it has been read. A scan offset
+// keeps a message that arrives in many reads from being searched for its end again and again.
+// A socket can read straight into the buffer through prepare() and commit().
+class IrcParser
+{
+public:
+  static constexpr auto MaxParams = size_t{15};
+
+  struct Msg
+  {
+    // the raw tags without the leading '@', see popTag()
+    std::string_view tags;
+    std::string_view source;
+    std::string_view command;
+    std::array<std::string_view, MaxParams> params;
+    size_t paramsCount = 0;
+  };
+
+  auto push(std::string_view) -> void;
+  // room for at least size more bytes at the end of the buffer, valid until the next call
+  auto prepare(size_t size) -> std::span<char>;
+  // the first size bytes of the last prepare() were filled
+  auto commit(size_t size) -> void;
+  // the next complete message; the views stay valid until the next push()
+  auto next() -> std::optional<Msg>;
+
+  // takes the first "name=value" off tags
+  static auto popTag(std::string_view &tags) -> std::pair<std::string_view, std::string_view>;
+
+private:
+  // only the bytes before end hold data, the rest is room for the next read
+  std::string buf;
+  size_t end = 0;
+  // start of the first message not returned yet
+  size_t start = 0;
+  // bytes after start already searched for the end of the line
+  size_t scanned = 0;
+
+  static auto parse(std::string_view line) -> Msg;
+};
@@ -0,0 +1,118 @@
+#include "job-system.hpp"
+#include "trace.hpp"
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned workers)
+{
+  for (auto i = 0U; i <= workers; ++i)
+    queues.push_back(std::make_unique<Queue>());
+  for (auto i = 1U; i <= workers; ++i)
+    threads.emplace_back([this, i]() {
+      Trace::nameThread("job worker");
+      run(i);
+    });
+}
+
+JobSystem::~JobSystem()
+{
+  {
+    auto lock = std::lock_guard{mutex};
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &thread : threads)
+    thread.join();
+}
+
+auto JobSystem::defaultWorkers() -> unsigned
+{
+  // the main thread is one of them and the audio and io threads need a core too
+  const auto cores = std::thread::hardware_concurrency();
+  return std::min(cores > 2 ? cores - 2 : 0U, 7U);
+}
+
+auto JobSystem::parallelFor(size_t n, size_t grain, const Fn &fn) -> void
+{
+  grain = std::max(grain, size_t{1});
+  if (n <= grain || threads.empty())
+  {
+    if (n > 0)
+      fn(0, n);
+    return;
+  }
+  const auto chunks = (n + grain - 1) / grain;
+  pending = chunks;
+  // contiguous shares keep the nodes a thread touches next to each other
+  const auto perQueue = (chunks + queues.size() - 1) / queues.size();
+  for (auto c = size_t{0}; c < chunks; ++c)
+  {
+    auto &queue = *queues[c / perQueue];
+    auto lock = std::lock_guard{queue.mutex};
+    // the previous loop drained every queue before it returned
+    if (queue.empty())
+    {
+      queue.chunks.clear();
+      queue.head = 0;
+    }
+    queue.chunks.push_back(Chunk{c * grain, std::min(n, (c + 1) * grain), &fn});
+  }
+  {
+    auto lock = std::lock_guard{mutex};
+    ++generation;
+  }
+  wake.notify_all();
+  work(0);
+  auto lock = std::unique_lock{mutex};
+  done.wait(lock, [this]() { return pending == 0; });
+}
+
+auto JobSystem::run(size_t self) -> void
+{
+  auto seen = uint64_t{0};
+  for (;;)
+  {
+    {
+      auto lock = std::unique_lock{mutex};
+      wake.wait(lock, [&]() { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+    work(self);
+  }
+}
+
+auto JobSystem::work(size_t self) -> void
+{
+  while (const auto chunk = take(self))
+  {
+    (*chunk->fn)(chunk->begin, chunk->end);
+    if (pending.fetch_sub(1) == 1)
+    {
+      auto lock = std::lock_guard{mutex};
+      done.notify_all();
+    }
+  }
+}
+
+auto JobSystem::take(size_t self) -> std::optional<Chunk>
+{
+  {
+    auto &own = *queues[self];
+    auto lock = std::lock_guard{own.mutex};
+    if (!own.empty())
+      return own.chunks[own.head++];
+  }
+  for (auto i = size_t{1}; i < queues.size(); ++i)
+  {
+    auto &other = *queues[(self + i) % queues.size()];
+    auto lock = std::lock_guard{other.mutex};
+    if (!other.empty())
+    {
+      const auto ret = other.chunks.back();
+      other.chunks.pop_back();
+      return ret;
+    }
+  }
+  return std::nullopt;
+}
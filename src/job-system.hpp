@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// A few worker threads that split a loop between them. Every thread starts on its own share of
+// the chunks and, once that is done, steals from the back of the others' shares, so uneven chunks
+// still finish together. The calling thread works along and parallelFor() returns when every
+// chunk has run.
+class JobSystem
+{
+public:
+  using Fn = std::function<auto(size_t begin, size_t end)->void>;
+
+  JobSystem(unsigned workers = defaultWorkers());
+  JobSystem(const JobSystem &) = delete;
+  ~JobSystem();
+  // fn over [0, n) in chunks of grain; a loop of one chunk runs inline
+  auto parallelFor(size_t n, size_t grain, const Fn &fn) -> void;
+
+  static auto defaultWorkers() -> unsigned;
+
+private:
+  struct Chunk
+  {
+    size_t begin;
+    size_t end;
+    const Fn *fn;
+  };
+
+  // the owner takes from the front at head, thieves from the back; a vector rather than a deque,
+  // which frees and allocates blocks as it is drained and refilled every frame
+  struct Queue
+  {
+    std::mutex mutex;
+    std::vector<Chunk> chunks;
+    size_t head = 0;
+    auto empty() const -> bool { return head == chunks.size(); }
+  };
+
+  // the caller's first, then one per worker
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::atomic<size_t> pending = 0;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  uint64_t generation = 0;
+  bool stopping = false;
+  std::vector<std::thread> threads;
+
+  auto run(size_t self) -> void;
+  auto work(size_t self) -> void;
+  auto take(size_t self) -> std::optional<Chunk>;
+};
@@ -0,0 +1,95 @@
+#include "json-fields.hpp"
+#include <rapidjson/reader.h>
+
+namespace
+{
+  class Handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, Handler>
+  {
+  public:
+    Handler(const std::string &aRecordPath, std::span<const std::string_view> aFields, JsonFields::Callback &aCb)
+      : recordPath(aRecordPath), fields(aFields), cb(aCb), values(aFields.size())
+    {
+    }
+
+    auto Key(const char *str, rapidjson::SizeType len, bool) -> bool
+    {
+      key = std::string_view{str, len};
+      return true;
+    }
+
+    auto String(const char *str, rapidjson::SizeType len, bool) -> bool
+    {
+      if (frames.empty() || !frames.back().isRecord)
+        return true;
+      for (auto i = size_t{0}; i < fields.size(); ++i)
+        if (fields[i] == key)
+          values[i] = std::string_view{str, len};
+      return true;
+    }
+
+    auto StartObject() -> bool { return start(false); }
+    auto EndObject(rapidjson::SizeType) -> bool { return end(); }
+    auto StartArray() -> bool { return start(true); }
+    auto EndArray(rapidjson::SizeType) -> bool { return end(); }
+
+  private:
+    struct Frame
+    {
+      size_t pathSize = 0;
+      bool isArray = false;
+      bool isRecord = false;
+    };
+
+    std::reference_wrapper<const std::string> recordPath;
+    std::span<const std::string_view> fields;
+    std::reference_wrapper<JsonFields::Callback> cb;
+    std::vector<std::string_view> values;
+    std::vector<Frame> frames;
+    std::string path;
+    std::string_view key;
+
+    auto start(bool isArray) -> bool
+    {
+      const auto pathSize = path.size();
+      if (!frames.empty())
+      {
+        if (!path.empty())
+          path += '.';
+        if (frames.back().isArray)
+          path += "[]";
+        else
+          path += key;
+      }
+      const auto isRecord = !isArray && path == recordPath.get();
+      if (isRecord)
+        std::fill(std::begin(values), std::end(values), std::string_view{});
+      frames.push_back(Frame{pathSize, isArray, isRecord});
+      return true;
+    }
+
+    auto end() -> bool
+    {
+      const auto frame = frames.back();
+      frames.pop_back();
+      path.resize(frame.pathSize);
+      if (!frame.isRecord)
+        return true;
+      return cb.get()(values);
+    }
+  };
+} // namespace
+
+JsonFields::JsonFields(std::string aRecordPath, std::vector<std::string_view> aFields)
+  : recordPath(std::move(aRecordPath)), fields(std::move(aFields))
+{
+}
+
+auto JsonFields::parse(std::string &payload, Callback cb) const -> bool
+{
+  auto handler = Handler{recordPath, fields, cb};
+  auto reader = rapidjson::Reader{};
+  auto ss = rapidjson::InsituStringStream{payload.data()};
+  const auto result = reader.Parse<rapidjson::kParseInsituFlag | rapidjson::kParseStopWhenDoneFlag>(ss, handler);
+  // the callback stopping the parse is not an error
+  return !result.IsError() || result.Code() == rapidjson::kParseErrorTermination;
+}
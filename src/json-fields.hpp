@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Pulls a few string fields out of a JSON response without building a document. The payload is
+// parsed in place, so the values are views into it and live as long as the payload does. A record
+// is every object found at the record path: keys joined with '.', "[]" for the elements of an
+// array, "" for the top level value; "choices.[]" are the elements of the top level "choices"
+// array. Only direct string members of a record are read, a missing one comes back empty.
+class JsonFields
+{
+public:
+  // gets one value per field in the order given to the constructor, returns false to stop parsing
+  using Callback = std::move_only_function<bool(std::span<const std::string_view> values)>;
+
+  JsonFields(std::string recordPath, std::vector<std::string_view> fields);
+  // returns false if the payload is not valid JSON; the payload is modified
+  auto parse(std::string &payload, Callback) const -> bool;
+
+private:
+  std::string recordPath;
+  std::vector<std::string_view> fields;
+};
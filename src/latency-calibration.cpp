@@ -0,0 +1,97 @@
+#include "latency-calibration.hpp"
+#include "audio-in.hpp"
+#include "audio-out.hpp"
+#include "imgui-helpers.hpp"
+#include "ui.hpp"
+#include "wav-2-visemes.hpp"
+#include <cstdlib>
+
+LatencyCalibration::LatencyCalibration(AudioIn &aAudioIn, AudioOut &aAudioOut, Wav2Visemes &aWav2Visemes)
+  : audioIn(aAudioIn), audioOut(aAudioOut), wav2Visemes(aWav2Visemes)
+{
+  audioIn.get().reg(*this);
+}
+
+LatencyCalibration::~LatencyCalibration()
+{
+  audioIn.get().unreg(*this);
+}
+
+auto LatencyCalibration::ingest(const AudioBlock &block) -> void
+{
+  if (!isListening || block.levels().peak < Threshold)
+    return;
+  const auto samples = block.samples();
+  auto idx = size_t{0};
+  while (idx < samples.size() && std::abs(samples[idx]) < Threshold)
+    ++idx;
+  // the block is dated by its newest sample, the onset is that many samples earlier
+  const auto onset =
+    block.captured() - std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>{
+                         static_cast<double>(samples.size() - idx) / audioIn.get().sampleRate()});
+  // a clap or a word before the beep started playing is not it
+  if (onset < beepAt)
+    return;
+  toMic.record(onset - beepAt);
+  heard = onset;
+  isListening = false;
+  isWaitingForMouth = true;
+}
+
+auto LatencyCalibration::tick(Clock::time_point now) -> bool
+{
+  const auto &shown = wav2Visemes.get().lastShown();
+  if (isWaitingForMouth && shown.captured >= heard)
+  {
+    toMouth.record(shown.at - beepAt);
+    isWaitingForMouth = false;
+  }
+  if (now - beepAt < Period)
+    return false;
+  if (isListening)
+    ++unheard;
+  audioOut.get().play(SoundBank::Clip::beep, true);
+  beepAt = now;
+  isListening = true;
+  isWaitingForMouth = false;
+  ++beeps;
+  return true;
+}
+
+auto LatencyCalibration::render() -> void
+{
+  auto calibrationWindow = Ui::Window("Latency Calibration");
+  ImGui::TextWrapped("Beeps and flashes every %.1f s. Turn the speakers up so the microphone hears them.",
+                     std::chrono::duration<float>(Period).count());
+  ImGui::TextF("{} beeps, {} not heard", beeps, unheard);
+  if (auto calibrationTable = Ui::Table{"##calibration", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp})
+  {
+    ImGui::TableSetupColumn("From the beep");
+    ImGui::TableSetupColumn("p50 ms");
+    ImGui::TableSetupColumn("p95 ms");
+    ImGui::TableSetupColumn("max ms");
+    ImGui::TableSetupColumn("n");
+    ImGui::TableHeadersRow();
+    for (const auto &[name, h] : {std::pair{"to the mic", &toMic}, std::pair{"to the mouth", &toMouth}})
+    {
+      ImGui::TableNextRow();
+      ImGui::TableNextColumn();
+      ImGui::TextUnformatted(name);
+      ImGui::TableNextColumn();
+      ImGui::TextF("{:.0f}", h->percentile(.5f));
+      ImGui::TableNextColumn();
+      ImGui::TextF("{:.0f}", h->percentile(.95f));
+      ImGui::TableNextColumn();
+      ImGui::TextF("{:.0f}", h->maxMs());
+      ImGui::TableNextColumn();
+      ImGui::TextF("{}", h->count());
+    }
+  }
+  if (ImGui::Button("Reset"))
+  {
+    toMic.clear();
+    toMouth.clear();
+    beeps = 0;
+    unheard = 0;
+  }
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "capture-sink.hpp"
+#include "latency-histogram.hpp"
+#include <chrono>
+#include <functional>
+
+// Loopback measurement of the whole path: once a Period it beeps through the speakers and flashes
+// the frame white, then listens for the beep on the microphone and waits for the mouth to react
+// to it. "Beep to mic" is the output plus the capture buffering, "beep to mouth" adds
+// recognition and the frame; a camera filming the screen can time the flash against the beep
+// too. The mic has to hear the speakers, headphones defeat it.
+class LatencyCalibration final : public CaptureSink
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  LatencyCalibration(class AudioIn &, class AudioOut &, class Wav2Visemes &);
+  LatencyCalibration(const LatencyCalibration &) = delete;
+  ~LatencyCalibration() final;
+  auto ingest(const AudioBlock &) -> void final;
+  // beeps when the next one is due, true for the frame that should flash
+  auto tick(Clock::time_point now) -> bool;
+  auto render() -> void;
+
+  static constexpr auto Period = std::chrono::milliseconds{1500};
+  // peak a captured sample has to reach to count as the beep
+  static constexpr auto Threshold = 8000;
+
+private:
+  std::reference_wrapper<AudioIn> audioIn;
+  std::reference_wrapper<AudioOut> audioOut;
+  std::reference_wrapper<Wav2Visemes> wav2Visemes;
+  Clock::time_point beepAt;
+  bool isListening = false;
+  // the onset of the beep on the microphone, until the mouth reacts to it
+  Clock::time_point heard;
+  bool isWaitingForMouth = false;
+  LatencyHistogram toMic;
+  LatencyHistogram toMouth;
+  int beeps = 0;
+  int unheard = 0;
+};
@@ -0,0 +1,34 @@
+#include "latency-histogram.hpp"
+#include <algorithm>
+
+auto LatencyHistogram::record(std::chrono::steady_clock::duration d) -> void
+{
+  // the clocks of two threads can put a stage a hair below zero
+  const auto ms = std::max(0.f, std::chrono::duration<float, std::milli>(d).count());
+  const auto idx = std::min(static_cast<size_t>(ms / BucketMs), buckets.size() - 1);
+  ++buckets[idx];
+  ++count_;
+  max_ = std::max(max_, ms);
+}
+
+auto LatencyHistogram::percentile(float p) const -> float
+{
+  if (count_ == 0)
+    return 0.f;
+  const auto target = static_cast<uint64_t>(p * static_cast<float>(count_));
+  auto seen = uint64_t{0};
+  for (auto i = size_t{0}; i + 1 < buckets.size(); ++i)
+  {
+    seen += buckets[i];
+    if (seen > target)
+      return std::min(static_cast<float>((i + 1) * BucketMs), max_);
+  }
+  return max_;
+}
+
+auto LatencyHistogram::clear() -> void
+{
+  buckets.fill(0);
+  count_ = 0;
+  max_ = 0.f;
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+// Counts of latencies in BucketMs wide buckets up to MaxMs, the rest in one overflow bucket.
+// Recording is a single increment and the percentiles are read off the counts, so a stage can
+// be measured on every viseme of a long stream without keeping the samples.
+class LatencyHistogram
+{
+public:
+  auto record(std::chrono::steady_clock::duration) -> void;
+  // upper edge of the bucket the percentile falls in, 0 when nothing was recorded
+  auto percentile(float p) const -> float;
+  auto count() const -> uint64_t { return count_; }
+  auto maxMs() const -> float { return max_; }
+  auto clear() -> void;
+
+  static constexpr auto BucketMs = 2;
+  static constexpr auto MaxMs = 1000;
+
+private:
+  std::array<uint32_t, MaxMs / BucketMs + 1> buckets{};
+  uint64_t count_ = 0;
+  float max_ = 0.f;
+};
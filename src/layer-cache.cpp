@@ -0,0 +1,113 @@
+#include "layer-cache.hpp"
+#include "gl-ext.hpp"
+#include <spdlog/spdlog.h>
+
+LayerCache::~LayerCache()
+{
+  for (auto &l : layers)
+    release(l);
+}
+
+auto LayerCache::begin(glm::ivec2 aViewport, uint64_t aGeneration) -> void
+{
+  if (aViewport == viewport && aGeneration == generation)
+    return;
+  viewport = aViewport;
+  generation = aGeneration;
+  for (auto &l : layers)
+  {
+    l.captured = false;
+    l.stableFrames = 0;
+  }
+}
+
+auto LayerCache::end(size_t layersUsed) -> void
+{
+  for (auto i = layersUsed; i < layers.size(); ++i)
+    release(layers[i]);
+  if (layersUsed < layers.size())
+    layers.resize(layersUsed);
+}
+
+auto LayerCache::hash(uint64_t seed, const void *data, size_t size) -> uint64_t
+{
+  // FNV-1a
+  auto p = static_cast<const unsigned char *>(data);
+  for (auto i = size_t{0}; i < size; ++i)
+    seed = (seed ^ p[i]) * 1099511628211u;
+  return seed;
+}
+
+auto LayerCache::layer(size_t idx, uint64_t key) -> Layer &
+{
+  if (idx >= layers.size())
+    layers.resize(idx + 1);
+  auto &l = layers[idx];
+  if (l.key != key)
+  {
+    l.key = key;
+    l.stableFrames = 0;
+    l.captured = false;
+  }
+  else if (l.stableFrames < SettleFrames)
+    ++l.stableFrames;
+  return l;
+}
+
+auto LayerCache::beginCapture(SpriteBatch &b, Layer &l) -> void
+{
+  // whatever was queued before the run belongs to the current target
+  b.flush();
+  if (!l.fbo)
+  {
+    GlExt::genFramebuffers(1, &l.fbo);
+    glGenTextures(1, &l.texture);
+  }
+  if (l.size != viewport)
+  {
+    l.size = viewport;
+    glBindTexture(GL_TEXTURE_2D, l.texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, l.size.x, l.size.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+  }
+  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &prevFbo);
+  glGetFloatv(GL_COLOR_CLEAR_VALUE, prevClearColor);
+  GlExt::bindFramebuffer(GL_FRAMEBUFFER, l.fbo);
+  GlExt::framebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, l.texture, 0);
+  if (GlExt::checkFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    SPDLOG_ERROR("Layer framebuffer {}x{} is incomplete", l.size.x, l.size.y);
+  glClearColor(0.f, 0.f, 0.f, 0.f);
+  glClear(GL_COLOR_BUFFER_BIT);
+  // the layer holds premultiplied color so compositing it matches drawing the nodes directly
+  GlExt::blendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+auto LayerCache::endCapture(SpriteBatch &b, Layer &l) -> void
+{
+  b.flush();
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  GlExt::bindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(prevFbo));
+  glClearColor(prevClearColor[0], prevClearColor[1], prevClearColor[2], prevClearColor[3]);
+  l.captured = true;
+}
+
+auto LayerCache::composite(SpriteBatch &b, Layer &l) -> void
+{
+  b.flush();
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  b.modelView(glm::mat4{1.f});
+  b.quad(l.texture, glm::vec2{0.f, 0.f}, glm::vec2{l.size}, glm::vec2{0.f, 0.f}, glm::vec2{1.f, 1.f});
+  b.flush();
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+auto LayerCache::release(Layer &l) -> void
+{
+  if (l.texture)
+    glDeleteTextures(1, &l.texture);
+  if (l.fbo)
+    GlExt::deleteFramebuffers(1, &l.fbo);
+  l = Layer{};
+}
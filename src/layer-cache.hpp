@@ -0,0 +1,72 @@
+#pragma once
+#include "sprite-batch.hpp"
+#include <SDL_opengl.h>
+#include <cstddef>
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <vector>
+
+// Screen sized render targets for runs of static nodes. A run whose key (nodes, transforms,
+// visibility) held for SettleFrames frames is drawn once into its layer and afterwards composited
+// as one premultiplied quad until the key or the generation (an edit, a texture upload, a resize)
+// changes. Runs that keep changing are never captured, so an animated layer costs nothing extra.
+class LayerCache
+{
+public:
+  LayerCache() = default;
+  // the GL objects belong to one instance, a copy starts without layers
+  LayerCache(const LayerCache &) : LayerCache() {}
+  auto operator=(const LayerCache &) -> LayerCache & { return *this; }
+  ~LayerCache();
+
+  auto begin(glm::ivec2 viewport, uint64_t generation) -> void;
+  template <typename F>
+  auto draw(SpriteBatch &b, size_t idx, uint64_t key, F &&renderRun) -> void
+  {
+    auto &l = layer(idx, key);
+    if (!l.captured && l.stableFrames < SettleFrames)
+    {
+      renderRun();
+      return;
+    }
+    if (!l.captured)
+    {
+      beginCapture(b, l);
+      renderRun();
+      endCapture(b, l);
+    }
+    composite(b, l);
+  }
+  // releases the layers of runs that no longer exist
+  auto end(size_t layersUsed) -> void;
+
+  static auto hash(uint64_t seed, const void *data, size_t size) -> uint64_t;
+
+  static constexpr auto SettleFrames = 2;
+  // shorter runs are cheaper to draw directly than to composite
+  static constexpr auto MinRun = 3;
+  static constexpr auto EmptyKey = uint64_t{14695981039346656037u};
+
+private:
+  struct Layer
+  {
+    uint64_t key = 0;
+    int stableFrames = 0;
+    bool captured = false;
+    GLuint fbo = 0;
+    GLuint texture = 0;
+    glm::ivec2 size = {0, 0};
+  };
+
+  std::vector<Layer> layers;
+  glm::ivec2 viewport = {0, 0};
+  uint64_t generation = 0;
+  GLint prevFbo = 0;
+  GLfloat prevClearColor[4] = {};
+
+  auto layer(size_t idx, uint64_t key) -> Layer &;
+  auto beginCapture(SpriteBatch &, Layer &) -> void;
+  auto endCapture(SpriteBatch &, Layer &) -> void;
+  auto composite(SpriteBatch &, Layer &) -> void;
+  static auto release(Layer &) -> void;
+};
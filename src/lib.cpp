@@ -1,15 +1,47 @@
 #include "lib.hpp"
 #include "preferences.hpp"
+#include "texture-cache.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <fmt/std.h>
+#include <functional>
 #include <spdlog/spdlog.h>
+#include <unordered_set>
+#include <vector>
 
-Lib::Lib(class Preferences &aPreferences, uv::Uv &aUv, HttpClient &aHttpClient)
+namespace
+{
+  auto megabytes(int mb) -> size_t
+  {
+    return static_cast<size_t>(std::max(0, mb)) << 20;
+  }
+} // namespace
+
+Lib::Lib(class Preferences &aPreferences,
+         uv::Uv &aUv,
+         AudioDevices &aAudioDevices,
+         HttpClient &aHttpClient,
+         const FrameCtx &aFrameCtx)
   : preferences(aPreferences),
     uv(aUv),
-    httpClient(aHttpClient),
-    azureToken(preferences.get().azureKey, httpClient),
-    gpt_(uv, preferences.get().openAiToken, httpClient)
+    audioDevices(aAudioDevices),
+    httpClient_(aHttpClient),
+    frameCtx_(aFrameCtx),
+    io(aUv),
+    assetWatcher(aUv),
+    textureStreamer(aUv),
+    azureToken(uv, preferences.get().azureKey, preferences.get().azureRegion, httpClient_),
+    voiceCatalog_(std::make_shared<VoiceCatalog>(aUv, azureToken, aHttpClient)),
+    llm_(aHttpClient, llmConfig()),
+    gpt_(aUv, llm_),
+    emotes_(aUv, aHttpClient, scheduler_),
+    physics_(scheduler_),
+    warmTimer(aUv.createTimer()),
+    budgetTimer(aUv.createTimer())
 {
+  retention->setBudget(megabytes(preferences.get().textureRetainMb));
+  budgetTimer.start([this]() { enforceBudgets(); }, 1000, 1000);
 }
 
 auto Lib::queryTex(const std::string &v, bool isUi) -> std::shared_ptr<const Texture>
@@ -17,34 +49,250 @@ auto Lib::queryTex(const std::string &v, bool isUi) -> std::shared_ptr<const Tex
   auto it = textures.find(std::pair{v, isUi});
   if (it != std::end(textures))
   {
-    auto shared = it->second.lock();
-    if (shared)
-      return shared;
+    if (auto handle = it->second.handle.lock())
+      return handle;
+    if (auto texture = it->second.texture.lock(); texture && retention->take(texture.get()))
+    {
+      auto handle = handOut(std::move(texture));
+      it->second.handle = handle;
+      return handle;
+    }
+    assetWatcher.unwatch(it->second.watch);
     textures.erase(it);
   }
-  auto shared = std::make_shared<Texture>(uv, v, isUi);
-  [[maybe_unused]] auto tmp = textures.emplace(std::pair{v, isUi}, shared);
+  const auto bundled = !isUi && bundle && bundle->find(v);
+  auto shared = std::make_shared<Texture>(textureStreamer,
+                                          scheduler_,
+                                          textureDedup,
+                                          v,
+                                          isUi,
+                                          !isUi && preferences.get().compactAlphaMasks,
+                                          textureQuality(isUi),
+                                          bundled ? bundle : nullptr);
+  auto handle = handOut(shared);
+  [[maybe_unused]] auto tmp = textures.emplace(std::pair{v, isUi}, TextureEntry{handle, shared});
   assert(tmp.second);
-  return shared;
+  // the bundle is what is drawn, its loose file is not watched
+  if (v.find("engine:") != 0 && !bundled)
+    tmp.first->second.watch = assetWatcher.watch(v, [weak = std::weak_ptr<Texture>{shared}]() {
+      auto texture = weak.lock();
+      if (!texture)
+        return false;
+      texture->reload();
+      return true;
+    });
+  return handle;
+}
+
+auto Lib::textureQuality(bool isUi) const -> Texture::Quality
+{
+  // the editor draws its icons at their size
+  if (isUi)
+    return {};
+  return {.maxSize = std::max(0, preferences.get().maxTextureSize), .mipmaps = preferences.get().mipmaps};
+}
+
+auto Lib::handOut(std::shared_ptr<Texture> texture) -> std::shared_ptr<const Texture>
+{
+  // the handle counts the users alone; when the last one lets go, the texture moves to the
+  // retention, or is freed once Lib is gone
+  const auto raw = texture.get();
+  return std::shared_ptr<const Texture>(
+    raw, [texture = std::move(texture), retention = std::weak_ptr{retention}](const Texture *) mutable {
+      // the deleter lives on as long as weak pointers to the handle do, the texture must not
+      auto last = std::move(texture);
+      if (auto r = retention.lock())
+        r->retain(std::move(last));
+    });
+}
+
+auto Lib::texturesLoading() const -> int
+{
+  auto ret = 0;
+  for (const auto &t : textures)
+    if (auto shared = t.second.handle.lock(); shared && !shared->isLoaded())
+      ++ret;
+  return ret;
+}
+
+auto Lib::memory() const -> Memory
+{
+  auto ret = Memory{};
+  // textures sharing an upload count it once
+  auto seen = std::unordered_set<const Texture::Image *>{};
+  for (const auto &t : textures)
+    if (auto shared = t.second.texture.lock())
+    {
+      ++ret.textures;
+      if (const auto image = shared->sharedImage(); image && !seen.insert(image).second)
+        continue;
+      ret.texturePixels += shared->pixelBytes();
+      ret.alphaMasks += shared->maskBytes();
+      ret.textureGpu += shared->gpuBytes();
+    }
+  for (const auto &f : fonts)
+    if (auto shared = f.second.lock())
+    {
+      ret.fontGpu += shared->bytes();
+      ++ret.fonts;
+    }
+  for (const auto &f : distanceFields)
+    if (auto shared = f.second.lock())
+      ret.fontGpu += shared->bytes();
+  ret.emoteGpu = emotes_.bytes();
+  ret.emotes = static_cast<int>(emotes_.size());
+  ret.retainedGpu = retention->bytes();
+  ret.retained = static_cast<int>(retention->size());
+  ret.deduplicated = textureDedup.saved();
+  ret.evicted = evicted;
+  return ret;
+}
+
+auto Lib::enforceBudgets() -> void
+{
+  retention->setBudget(megabytes(preferences.get().textureRetainMb));
+  // the entries of released resources are only dropped when they are asked for again otherwise
+  std::erase_if(textures, [this](const auto &t) {
+    if (!t.second.texture.expired())
+      return false;
+    assetWatcher.unwatch(t.second.watch);
+    return true;
+  });
+  std::erase_if(fonts, [](const auto &f) { return f.second.expired(); });
+  std::erase_if(distanceFields, [](const auto &f) { return f.second.expired(); });
+  // the pixels cached on disk for images deleted or changed since are dropped once per project
+  if (auto cacheDir = TextureCache::dir(); cacheDir != prunedCache)
+  {
+    prunedCache = cacheDir;
+    uv.get().queue([cacheDir]() { return TextureCache::prune(cacheDir); },
+                   [cacheDir](uintmax_t freed) {
+                     if (freed > 0)
+                       SPDLOG_INFO("dropped {} KB of stale texture cache in {:?}", freed >> 10, cacheDir);
+                   });
+  }
+
+  const auto cpuBudget = megabytes(preferences.get().cpuBudgetMb);
+  const auto gpuBudget = megabytes(preferences.get().gpuBudgetMb);
+  if (cpuBudget == 0 && gpuBudget == 0)
+    return;
+  const auto mem = memory();
+
+  if (cpuBudget > 0 && mem.cpu() > cpuBudget)
+  {
+    // the largest copies first, the fewest textures lose their pixels
+    auto candidates = std::vector<std::shared_ptr<Texture>>{};
+    for (const auto &t : textures)
+      if (auto shared = t.second.texture.lock(); shared && shared->pixelBytes() > 0)
+        candidates.push_back(std::move(shared));
+    std::ranges::sort(candidates, std::greater{}, [](const auto &t) { return t->pixelBytes(); });
+    auto cpu = mem.cpu();
+    for (const auto &t : candidates)
+    {
+      if (cpu <= cpuBudget)
+        break;
+      const auto freed = t->compact();
+      cpu -= std::min(cpu, freed);
+      evicted += freed;
+    }
+    if (cpu > cpuBudget && !overCpuBudget)
+      SPDLOG_WARN("Textures hold {} MB of CPU memory, over the {} MB budget", cpu >> 20, cpuBudget >> 20);
+    overCpuBudget = cpu > cpuBudget;
+  }
+  else
+    overCpuBudget = false;
+
+  if (gpuBudget > 0 && mem.gpu() > gpuBudget)
+  {
+    // textures in use cannot go; the retained ones and the font atlases can, the ones not drawn
+    // lately first
+    auto gpu = mem.gpu();
+    const auto retainedFreed = retention->shrink(mem.retainedGpu - std::min(mem.retainedGpu, gpu - gpuBudget));
+    gpu -= retainedFreed;
+    evicted += retainedFreed;
+    auto candidates = std::vector<std::shared_ptr<Font>>{};
+    for (const auto &f : fonts)
+      if (auto shared = f.second.lock(); shared && shared->bytes() > 0)
+        candidates.push_back(std::move(shared));
+    for (const auto &f : distanceFields)
+      if (auto shared = f.second.lock(); shared && shared->bytes() > 0)
+        candidates.push_back(std::move(shared));
+    std::ranges::sort(candidates, std::less{}, [](const auto &f) { return f->lastDrawn(); });
+    for (const auto &f : candidates)
+    {
+      if (gpu <= gpuBudget)
+        break;
+      const auto freed = f->trim();
+      gpu -= std::min(gpu, freed);
+      evicted += freed;
+    }
+    // warned once each time the budget is crossed
+    if (gpu > gpuBudget && !overGpuBudget)
+      SPDLOG_WARN("Textures and fonts hold {} MB of GPU memory, over the {} MB budget", gpu >> 20, gpuBudget >> 20);
+    overGpuBudget = gpu > gpuBudget;
+  }
+  else
+    overGpuBudget = false;
 }
 
-auto Lib::queryTwitch(const std::string &v) -> std::shared_ptr<Twitch>
+auto Lib::queryTwitch(const std::string &name) -> std::shared_ptr<Twitch>
 {
-  auto it = twitchChannels.find(v);
-  if (it != std::end(twitchChannels))
+  // one Twitch per channel however the nodes spell it, the connection joins it by its lower case
+  // name
+  auto v = name;
+  std::ranges::transform(v, std::begin(v), [](unsigned char c) { return std::tolower(c); });
+  auto it = twitchChannels_.find(v);
+  if (it != std::end(twitchChannels_))
   {
     auto shared = it->second.lock();
     if (shared)
       return shared;
-    twitchChannels.erase(it);
+    twitchChannels_.erase(it);
   }
-  auto shared =
-    std::make_shared<Twitch>(uv, preferences.get().twitchUser, preferences.get().twitchKey, v);
-  [[maybe_unused]] auto tmp = twitchChannels.emplace(v, shared);
+  // every channel shares the account's connection
+  auto connection = twitchConnection.lock();
+  if (!connection)
+  {
+    connection = TwitchConnection::create(io, preferences.get().twitchUser, preferences.get().twitchKey);
+    connection->tap(chatTap);
+    twitchConnection = connection;
+  }
+  auto shared = std::make_shared<Twitch>(std::move(connection), v);
+  [[maybe_unused]] auto tmp = twitchChannels_.emplace(v, shared);
   assert(tmp.second);
   return shared;
 }
 
+auto Lib::twitchChannels() const -> std::vector<std::string>
+{
+  auto ret = std::vector<std::string>{};
+  for (const auto &channel : twitchChannels_)
+    if (auto shared = channel.second.lock())
+      ret.push_back(shared->name());
+  return ret;
+}
+
+auto Lib::twitchMessages() const -> uint64_t
+{
+  auto ret = uint64_t{0};
+  for (const auto &channel : twitchChannels_)
+    if (auto shared = channel.second.lock())
+      ret += shared->received();
+  return ret;
+}
+
+auto Lib::replayChat(std::string bytes) -> void
+{
+  if (auto connection = twitchConnection.lock())
+    connection->replay(std::move(bytes));
+}
+
+auto Lib::tapChat(std::function<void(std::string_view)> v) -> void
+{
+  chatTap = std::move(v);
+  if (auto connection = twitchConnection.lock())
+    connection->tap(chatTap);
+}
+
 auto Lib::queryFont(const std::filesystem::path &path, int size) -> std::shared_ptr<Font>
 {
   auto it = fonts.find(std::make_pair(std::cref(path), size));
@@ -54,32 +302,133 @@ auto Lib::queryFont(const std::filesystem::path &path, int size) -> std::shared_
       return shared;
   }
 
-  auto font = std::make_shared<Font>(path, size);
+  auto font = std::make_shared<Font>(spriteBatch_, path, size, bundle && bundle->find(path.string()) ? bundle : nullptr);
+  if (preferences.get().distanceFieldFonts)
+    font->useDistanceField(distanceField(path));
   fonts.emplace_hint(
     it, std::piecewise_construct, std::forward_as_tuple(path, size), std::forward_as_tuple(font));
 
   return font;
 }
 
-auto Lib::flush() -> void
+auto Lib::distanceField(const std::filesystem::path &path) -> std::shared_ptr<Font>
 {
-  for (auto &twitch : twitchChannels)
+  auto it = distanceFields.find(path);
+  if (it != std::end(distanceFields))
   {
-    auto shared = twitch.second.lock();
-    if (!shared)
-      continue;
-    shared->updateUserKey(preferences.get().twitchUser, preferences.get().twitchKey);
+    if (auto shared = it->second.lock())
+      return shared;
   }
+  auto font = std::make_shared<Font>(spriteBatch_,
+                                     path,
+                                     Font::DistanceFieldSize,
+                                     bundle && bundle->find(path.string()) ? bundle : nullptr,
+                                     true);
+  distanceFields.insert_or_assign(path, font);
+  return font;
+}
+
+auto Lib::openBundle(const std::filesystem::path &path) -> void
+{
+  bundle = nullptr;
+  auto ec = std::error_code{};
+  if (!std::filesystem::exists(path, ec))
+    return;
+  try
+  {
+    bundle = std::make_shared<AssetBundle>(path);
+    SPDLOG_INFO("Asset bundle {:?} with {} files", path, bundle->size());
+  }
+  catch (std::runtime_error &e)
+  {
+    SPDLOG_ERROR("{:t}", e);
+  }
+}
+
+auto Lib::exportBundle(const std::filesystem::path &path) -> void
+{
+  auto paths = std::vector<std::string>{};
+  for (const auto &t : textures)
+    if (!t.first.second && t.first.first.find("engine:") != 0 && !t.second.handle.expired())
+      paths.push_back(t.first.first);
+  for (const auto &f : fonts)
+    if (!f.second.expired())
+      paths.push_back(f.first.first.string());
+  // one font file may be open at several sizes
+  std::ranges::sort(paths);
+  paths.erase(std::unique(std::begin(paths), std::end(paths)), std::end(paths));
+  const auto n = paths.size();
+  uv.get().queue(
+    [path = std::filesystem::absolute(path), paths = std::move(paths), bundle = bundle]() -> std::string {
+      // assets opened from the current bundle may have no loose file left, those are copied over
+      try
+      {
+        AssetBundle::write(path, paths, bundle.get());
+        return {};
+      }
+      catch (std::runtime_error &e)
+      {
+        return e.what();
+      }
+    },
+    [path, n](std::string err) {
+      if (!err.empty())
+        SPDLOG_ERROR("Cannot export asset bundle: {}", err);
+      else
+        SPDLOG_INFO("Exported {} assets to {:?}", n, path);
+    });
+}
+
+auto Lib::flush() -> void
+{
+  if (auto connection = twitchConnection.lock())
+    connection->updateUserKey(preferences.get().twitchUser, preferences.get().twitchKey);
   azureToken.updateKey(preferences.get().azureKey);
-  gpt_.updateToken(preferences.get().openAiToken);
+  azureToken.updateRegion(preferences.get().azureRegion);
+  llm_.configure(llmConfig());
+  if (auto tts = azureTts.lock())
+    updateTts(*tts);
+  for (const auto &t : textures)
+    if (auto texture = t.second.texture.lock())
+      texture->setQuality(textureQuality(t.first.second));
+  for (const auto &f : fonts)
+    if (auto font = f.second.lock())
+      font->useDistanceField(preferences.get().distanceFieldFonts ? distanceField(f.first.first) : nullptr);
+  // a source removed from the preferences keeps its device until its nodes pick another one
+  const auto &extra = preferences.get().extraAudioIn;
+  for (const auto &m : mics)
+    if (auto mic = m.second.lock(); mic && m.first <= static_cast<int>(extra.size()))
+      mic->update(extra[static_cast<size_t>(m.first - 1)],
+                  preferences.get().latencyBudgetMs,
+                  preferences.get().noiseFloor);
+}
+
+auto Lib::llmConfig() const -> OpenAiLlm::Config
+{
+  const auto &url = preferences.get().llmUrl;
+  return OpenAiLlm::Config{.api = OpenAiLlm::api(preferences.get().llmApi),
+                           .url = url,
+                           .model = preferences.get().llmModel,
+                           .token = OpenAiLlm::isOpenAi(url) ? preferences.get().openAiToken
+                                                             : preferences.get().llmToken};
+}
+
+auto Lib::updateTts(AzureTts &tts) -> void
+{
+  tts.setCompressed(preferences.get().compressedTts);
+  tts.setBackpressure({.maxQueued = preferences.get().ttsMaxQueued,
+                       .merge = preferences.get().ttsMerge,
+                       .maxAgeSec = preferences.get().ttsMaxAge});
 }
 
 auto Lib::queryAzureTts(class AudioSink &audioSink) -> std::shared_ptr<AzureTts>
 {
   if (auto ret = azureTts.lock())
     return ret;
-  auto ret = std::make_shared<AzureTts>(uv, azureToken, httpClient, audioSink);
+  auto ret = std::make_shared<AzureTts>(uv, azureToken, httpClient_, audioSink);
+  updateTts(*ret);
   azureTts = ret;
+  startWarming();
   return ret;
 }
 
@@ -87,12 +436,156 @@ auto Lib::queryAzureStt() -> std::shared_ptr<AzureStt>
 {
   if (auto ret = azureStt.lock())
     return ret;
-  auto ret = std::make_shared<AzureStt>(uv, azureToken, httpClient);
+  auto ret = std::make_shared<AzureStt>(uv, azureToken, httpClient_);
   azureStt = ret;
+  startWarming();
+  return ret;
+}
+
+auto Lib::queryLocalStt() -> std::shared_ptr<LocalStt>
+{
+  if (auto ret = localStt.lock())
+    return ret;
+  auto ret = std::make_shared<LocalStt>(uv);
+  localStt = ret;
+  return ret;
+}
+
+auto Lib::querySpeechToText() -> std::shared_ptr<SttBackend>
+{
+  const auto &mode = preferences.get().sttMode;
+  if (mode == "local")
+    return queryLocalStt();
+  if (mode != "local-first")
+    return queryAzureStt();
+  if (auto ret = localFirstStt.lock())
+    return ret;
+  // FallbackStt only opens local streams once the model is ready, so nothing else would load it
+  auto local = queryLocalStt();
+  local->prepare();
+  auto ret = std::make_shared<FallbackStt>(std::move(local), queryAzureStt());
+  localFirstStt = ret;
+  return ret;
+}
+
+auto Lib::startWarming() -> void
+{
+  warm();
+  const auto interval = static_cast<uint64_t>(std::chrono::milliseconds{HttpClient::WarmPeriod}.count());
+  warmTimer.start([this]() { warm(); }, interval, interval);
+}
+
+auto Lib::warm() -> void
+{
+  // Chat and AiMouth speak through AzureTts, only AiMouth listens and prompts the LLM
+  const auto tts = !azureTts.expired();
+  const auto stt = !azureStt.expired();
+  if (!tts && !stt)
+  {
+    warmTimer.stop();
+    return;
+  }
+  if (!preferences.get().azureKey.empty())
+  {
+    // the token is fetched ahead as well and its background refresh kept going
+    azureToken.get([](const std::string &, const std::string &) {});
+    if (tts)
+      httpClient_.get().warm(azureToken.endpoint("tts") + "/");
+    if (stt)
+      httpClient_.get().warm(azureToken.endpoint("stt") + "/");
+  }
+  if (stt && llm_.isUsable())
+    httpClient_.get().warm(llm_.url());
+}
+
+auto Lib::queryAudioLevel(AudioIn &audioIn) -> std::shared_ptr<AudioLevel>
+{
+  std::erase_if(audioLevels, [](const auto &l) { return l.second.expired(); });
+  auto &level = audioLevels[&audioIn];
+  if (auto ret = level.lock())
+    return ret;
+  auto ret = std::make_shared<AudioLevel>(audioIn, &scheduler_);
+  level = ret;
   return ret;
 }
 
+auto Lib::queryMic(int source) -> std::shared_ptr<MicSource>
+{
+  const auto &extra = preferences.get().extraAudioIn;
+  if (source <= 0 || source > static_cast<int>(extra.size()))
+    return nullptr;
+  std::erase_if(mics, [](const auto &m) { return m.second.expired(); });
+  auto &mic = mics[source];
+  if (auto ret = mic.lock())
+    return ret;
+  SPDLOG_INFO("opening mic {} {:?}", source, extra[static_cast<size_t>(source - 1)]);
+  auto ret = std::make_shared<MicSource>(uv,
+                                         audioDevices,
+                                         extra[static_cast<size_t>(source - 1)],
+                                         preferences.get().latencyBudgetMs,
+                                         preferences.get().noiseFloor);
+  mic = ret;
+  return ret;
+}
+
+auto Lib::micNames() const -> std::vector<std::string>
+{
+  auto ret = std::vector<std::string>{fmt::format("Main: {}", preferences.get().audioIn)};
+  for (const auto &device : preferences.get().extraAudioIn)
+    ret.push_back(fmt::format("{}: {}", ret.size(), device));
+  return ret;
+}
+
+auto Lib::pollMics() -> void
+{
+  for (const auto &m : mics)
+    if (auto mic = m.second.lock())
+      mic->poll();
+}
+
+auto Lib::micDeviceRemoved(SDL_AudioDeviceID id) -> void
+{
+  for (const auto &m : mics)
+    if (auto mic = m.second.lock())
+      mic->audioIn().deviceRemoved(id);
+}
+
 auto Lib::gpt() -> Gpt &
 {
   return gpt_;
 }
+
+auto Lib::voiceCatalog() -> VoiceCatalog &
+{
+  return *voiceCatalog_;
+}
+
+auto Lib::httpClient() -> HttpClient &
+{
+  return httpClient_;
+}
+
+auto Lib::spriteBatch() -> SpriteBatch &
+{
+  return spriteBatch_;
+}
+
+auto Lib::scheduler() -> RenderScheduler &
+{
+  return scheduler_;
+}
+
+auto Lib::physics() -> Physics &
+{
+  return physics_;
+}
+
+auto Lib::jobs() -> JobSystem &
+{
+  return jobs_;
+}
+
+auto Lib::frameCtx() const -> const FrameCtx &
+{
+  return frameCtx_;
+}
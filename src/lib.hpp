@@ -1,37 +1,186 @@
 #pragma once
+#include "asset-bundle.hpp"
+#include "asset-watcher.hpp"
+#include "audio-level.hpp"
 #include "azure-stt.hpp"
 #include "azure-token.hpp"
 #include "azure-tts.hpp"
+#include "editor-icons.hpp"
+#include "emote-atlas.hpp"
+#include "fallback-stt.hpp"
 #include "font.hpp"
+#include "frame-arena.hpp"
+#include "frame-ctx.hpp"
 #include "gpt.hpp"
+#include "io-thread.hpp"
+#include "job-system.hpp"
+#include "local-stt.hpp"
+#include "mic-source.hpp"
+#include "openai-llm.hpp"
+#include "physics.hpp"
+#include "render-scheduler.hpp"
+#include "sprite-batch.hpp"
+#include "texture-dedup.hpp"
+#include "texture-retention.hpp"
+#include "texture-streamer.hpp"
 #include "texture.hpp"
 #include "twitch.hpp"
+#include "voice-catalog.hpp"
 #include <filesystem>
+#include <functional>
 #include <map>
 #include <memory>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 class Lib
 {
 public:
-  Lib(class Preferences &, uv::Uv &, HttpClient &);
+  Lib(class Preferences &, uv::Uv &, AudioDevices &, HttpClient &, const FrameCtx &);
   auto flush() -> void;
+  // textures and fonts of the project resolve from this bundle before the filesystem; a missing
+  // file just means loose files. Bundled textures are not watched, an edit of the loose file only
+  // shows once the bundle is exported again or removed
+  auto openBundle(const std::filesystem::path &) -> void;
+  // packs the images and fonts in use into a bundle on a worker
+  auto exportBundle(const std::filesystem::path &) -> void;
   auto queryFont(const std::filesystem::path &path, int size) -> std::shared_ptr<Font>;
   auto queryTex(const std::string &, bool isUi = false) -> std::shared_ptr<const Texture>;
+  auto texturesLoading() const -> int;
   auto queryTwitch(const std::string &) -> std::shared_ptr<Twitch>;
+  // the channels in use, as their messages name them
+  auto twitchChannels() const -> std::vector<std::string>;
+  // IRC bytes delivered to the channels as if Twitch had sent them, for the chat flood test
+  auto replayChat(std::string) -> void;
+  // the IRC bytes read from Twitch, for the session recorder; null stops
+  auto tapChat(std::function<void(std::string_view)>) -> void;
+  // chat nodes stop handing their messages on to TTS while set
+  auto stubTts(bool v) -> void { ttsStubbed = v; }
+  auto isTtsStubbed() const -> bool { return ttsStubbed; }
   auto queryAzureTts(class AudioSink &) -> std::shared_ptr<AzureTts>;
+  // the TTS service if something uses it, without starting it
+  auto activeTts() const -> std::shared_ptr<AzureTts> { return azureTts.lock(); }
+  // messages delivered to all channels so far
+  auto twitchMessages() const -> uint64_t;
+  struct Memory
+  {
+    // RGBA copies kept for hit testing
+    size_t texturePixels = 0;
+    size_t alphaMasks = 0;
+    size_t textureGpu = 0;
+    size_t fontGpu = 0;
+    size_t emoteGpu = 0;
+    int textures = 0;
+    int fonts = 0;
+    int emotes = 0;
+    // released textures kept for reuse, part of textureGpu
+    size_t retainedGpu = 0;
+    int retained = 0;
+    // GPU bytes identical images did not upload again
+    size_t deduplicated = 0;
+    // bytes freed by the budgets since startup
+    size_t evicted = 0;
+    auto cpu() const -> size_t { return texturePixels + alphaMasks; }
+    auto gpu() const -> size_t { return textureGpu + fontGpu + emoteGpu; }
+  };
+  // what the live textures and font atlases hold
+  auto memory() const -> Memory;
   auto queryAzureStt() -> std::shared_ptr<AzureStt>;
+  auto queryLocalStt() -> std::shared_ptr<LocalStt>;
+  // the recognizer Preferences::sttMode picks
+  auto querySpeechToText() -> std::shared_ptr<SttBackend>;
+  auto queryAudioLevel(class AudioIn &) -> std::shared_ptr<AudioLevel>;
+  // source n > 0 is the device of Preferences::extraAudioIn[n - 1], open while a node holds it;
+  // null for 0, the main mic App owns, and for a source the preferences no longer have
+  auto queryMic(int source) -> std::shared_ptr<MicSource>;
+  // the sources a node can pick from, the main mic first
+  auto micNames() const -> std::vector<std::string>;
+  auto pollMics() -> void;
+  auto micDeviceRemoved(SDL_AudioDeviceID) -> void;
   auto gpt() -> Gpt &;
+  auto voiceCatalog() -> VoiceCatalog &;
+  auto httpClient() -> HttpClient &;
+  auto spriteBatch() -> SpriteBatch &;
+  auto editorIcons() -> EditorIcons & { return editorIcons_; }
+  auto emotes() -> EmoteAtlas & { return emotes_; }
+  auto scheduler() -> RenderScheduler &;
+  // for decodes that should queue with the textures
+  auto streamer() -> TextureStreamer & { return textureStreamer; }
+  auto physics() -> Physics &;
+  auto jobs() -> JobSystem &;
+  auto frameCtx() const -> const FrameCtx &;
+  // the temporaries of the frame being drawn, App resets it when a frame starts
+  auto frameArena() -> FrameArena & { return frameArena_; }
 
 private:
   std::reference_wrapper<Preferences> preferences;
   std::reference_wrapper<uv::Uv> uv;
-  std::reference_wrapper<HttpClient> httpClient;
-  std::map<std::pair<std::string, bool>, std::weak_ptr<const Texture>> textures;
-  std::unordered_map<std::string, std::weak_ptr<Twitch>> twitchChannels;
+  // the extra mics open their devices there
+  std::reference_wrapper<AudioDevices> audioDevices;
+  std::reference_wrapper<HttpClient> httpClient_;
+  std::reference_wrapper<const FrameCtx> frameCtx_;
+  // outlives the connections living on it
+  IoThread io;
+  AssetWatcher assetWatcher;
+  TextureStreamer textureStreamer;
+  std::shared_ptr<const AssetBundle> bundle;
+  TextureDedup textureDedup;
+  struct TextureEntry
+  {
+    // what the users share, expired once released
+    std::weak_ptr<const Texture> handle;
+    // alive as long as there are users or the retention holds it
+    std::weak_ptr<Texture> texture;
+    // reloads the texture when its file changes
+    AssetWatcher::Id watch = 0;
+  };
+  std::map<std::pair<std::string, bool>, TextureEntry> textures;
+  std::shared_ptr<TextureRetention> retention = std::make_shared<TextureRetention>();
+  std::weak_ptr<TwitchConnection> twitchConnection;
+  // given to the connection when it is made
+  std::function<void(std::string_view)> chatTap;
+  std::unordered_map<std::string, std::weak_ptr<Twitch>> twitchChannels_;
   std::map<std::pair<std::filesystem::path, int>, std::weak_ptr<Font>> fonts;
+  // one per file, shared by its fonts of every size while distance field fonts are on
+  std::map<std::filesystem::path, std::weak_ptr<Font>> distanceFields;
   AzureToken azureToken;
+  std::shared_ptr<VoiceCatalog> voiceCatalog_;
   std::weak_ptr<AzureTts> azureTts;
   std::weak_ptr<AzureStt> azureStt;
+  std::weak_ptr<LocalStt> localStt;
+  std::weak_ptr<FallbackStt> localFirstStt;
+  // by capture device, the bouncers of the same mic share one envelope
+  std::map<const AudioIn *, std::weak_ptr<AudioLevel>> audioLevels;
+  std::map<int, std::weak_ptr<MicSource>> mics;
+  bool ttsStubbed = false;
+  // the model behind gpt_
+  OpenAiLlm llm_;
   Gpt gpt_;
+  SpriteBatch spriteBatch_;
+  EditorIcons editorIcons_;
+  RenderScheduler scheduler_;
+  EmoteAtlas emotes_;
+  Physics physics_;
+  JobSystem jobs_;
+  FrameArena frameArena_;
+  // keeps the connections of the speech and LLM services open while nodes use them
+  uv::Timer warmTimer;
+  // checks the memory budgets of Preferences once a second
+  uv::Timer budgetTimer;
+  size_t evicted = 0;
+  // the texture cache directory last pruned
+  std::filesystem::path prunedCache;
+  // warned about since the budget was last crossed
+  bool overCpuBudget = false;
+  bool overGpuBudget = false;
+
+  auto distanceField(const std::filesystem::path &) -> std::shared_ptr<Font>;
+  auto enforceBudgets() -> void;
+  auto handOut(std::shared_ptr<Texture>) -> std::shared_ptr<const Texture>;
+  auto llmConfig() const -> OpenAiLlm::Config;
+  auto textureQuality(bool isUi) const -> Texture::Quality;
+  auto startWarming() -> void;
+  auto updateTts(AzureTts &) -> void;
+  auto warm() -> void;
 };
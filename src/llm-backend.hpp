@@ -0,0 +1,39 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+
+// A model Gpt sends the conversation to. The pieces of the prompt come JSON escaped, the way Gpt
+// keeps them, and the reply goes back as text: in pieces while it generates when the request
+// streams, and whole once it is done.
+class LlmBackend
+{
+public:
+  struct Request
+  {
+    std::string_view systemPrompt;
+    // a "\n| name: message" line for every message
+    std::string_view history;
+    std::string_view cohost;
+    // the prompt ends with the cohost's name; otherwise the model picks who speaks and starts its
+    // reply with the name
+    bool embedName = true;
+    bool stream = false;
+  };
+  struct Result
+  {
+    std::string text = {};
+    // empty on success
+    std::string error = {};
+    // the service failed rather than the request, Gpt waits before sending the next one
+    bool isTransient = false;
+  };
+  using TextCallback = std::move_only_function<void(std::string_view)>;
+  using DoneCallback = std::move_only_function<void(Result)>;
+
+  virtual ~LlmBackend() = default;
+  // onText is only called when the request streams
+  virtual auto complete(const Request &, TextCallback onText, DoneCallback) -> void = 0;
+  // continues a transcript that does not end with a name; chat models always answer as the cohost
+  virtual auto picksSpeaker() const -> bool = 0;
+};
@@ -0,0 +1,205 @@
+#include "local-stt.hpp"
+#include "trace.hpp"
+#include <chrono>
+#include <pocketsphinx.h>
+#include <spdlog/spdlog.h>
+#include <utility>
+
+struct LocalStt::Model
+{
+  ps_config_t *config = nullptr;
+  ps_decoder_t *decoder = nullptr;
+  // set on the loop thread once the load is back, the decoder is only read after that
+  bool isLoaded = false;
+
+  Model()
+  {
+    config = ps_config_init(nullptr);
+    ps_default_search_args(config);
+    ps_config_set_str(config, "hmm", "assets/pocketsphinx-model/en-us/en-us");
+    ps_config_set_str(config, "lm", "assets/pocketsphinx-model/en-us/en-us.lm.bin");
+    ps_config_set_str(config, "dict", "assets/pocketsphinx-model/en-us/cmudict-en-us.dict");
+    ps_config_set_int(config, "samprate", LocalStt::ModelRate);
+  }
+  Model(const Model &) = delete;
+  ~Model()
+  {
+    if (decoder)
+      ps_free(decoder);
+    ps_config_free(config);
+  }
+};
+
+namespace
+{
+  // the audio of a stream that arrived since the last job and what the decoder makes of it
+  struct Job
+  {
+    Wav samples;
+    bool start = false;
+    bool end = false;
+    std::string hyp = {};
+    bool ok = true;
+  };
+} // namespace
+
+LocalStt::LocalStt(uv::Uv &aUv) : uv(aUv), model(std::make_shared<Model>()) {}
+
+auto LocalStt::isReady() const -> bool
+{
+  return model->isLoaded && !isFailed_;
+}
+
+auto LocalStt::stream(int sampleRate, Callback cb, Callback onPartial) -> std::shared_ptr<SttBackend::Stream>
+{
+  prepare();
+  auto ret = std::shared_ptr<Stream>(new Stream{weak_self(), sampleRate, std::move(cb), std::move(onPartial)});
+  queue.push_back(ret);
+  return ret;
+}
+
+auto LocalStt::prepare() -> void
+{
+  if (!isLoading)
+    load();
+}
+
+auto LocalStt::load() -> void
+{
+  isLoading = true;
+  // ps_init reads the model for a second or two
+  uv.get().queueWork([m = model]() { m->decoder = ps_init(m->config); },
+                     [alive = weak_self(), m = model, start = std::chrono::steady_clock::now()](int) {
+                       m->isLoaded = true;
+                       auto self = alive.lock();
+                       if (!self)
+                       {
+                         SPDLOG_INFO("this was destroyed");
+                         return;
+                       }
+                       if (!m->decoder)
+                       {
+                         SPDLOG_ERROR("PocketSphinx decoder init failed, no local speech recognition");
+                         self->isFailed_ = true;
+                       }
+                       else
+                         SPDLOG_INFO("local speech model loaded in {} ms",
+                                     std::chrono::duration_cast<std::chrono::milliseconds>(
+                                       std::chrono::steady_clock::now() - start)
+                                       .count());
+                       self->pump();
+                     });
+}
+
+auto LocalStt::pump() -> void
+{
+  if (isBusy || !model->isLoaded)
+    return;
+  while (!queue.empty())
+  {
+    auto &s = *queue.front();
+    // nothing reached the decoder yet, so there is no utterance to close
+    if ((s.cancelled || (s.finished && s.pending.empty())) && !s.started)
+    {
+      resolve(s, "");
+      queue.pop_front();
+      continue;
+    }
+    if (!isFailed_)
+      break;
+    if (!s.finished && !s.cancelled)
+      return;
+    resolve(s, "");
+    queue.pop_front();
+  }
+  if (queue.empty())
+    return;
+  auto s = queue.front();
+  const auto end = s->finished || s->cancelled;
+  if (s->pending.empty() && !end)
+    return;
+  isBusy = true;
+  auto job = std::make_shared<Job>(Job{.samples = std::exchange(s->pending, {}), .start = !s->started, .end = end});
+  s->started = true;
+  uv.get().queueWork(
+    [m = model, job]() {
+      auto span = Trace::Span{"local stt"};
+      if (job->start && ps_start_utt(m->decoder) < 0)
+        job->ok = false;
+      if (!job->samples.empty() && ps_process_raw(m->decoder, job->samples.data(), job->samples.size(), FALSE, FALSE) < 0)
+        job->ok = false;
+      if (job->end && ps_end_utt(m->decoder) < 0)
+        job->ok = false;
+      if (const auto *hyp = ps_get_hyp(m->decoder, nullptr))
+        job->hyp = hyp;
+    },
+    [alive = weak_self(), job, s](int status) {
+      auto self = alive.lock();
+      if (!self)
+      {
+        SPDLOG_INFO("this was destroyed");
+        return;
+      }
+      self->isBusy = false;
+      if (status != 0 || !job->ok)
+        SPDLOG_ERROR("local speech recognition failed");
+      if (job->end)
+      {
+        std::erase(self->queue, s);
+        self->resolve(*s, std::move(job->hyp));
+      }
+      else if (!s->cancelled && s->onPartial && job->hyp != s->partial)
+      {
+        s->partial = std::move(job->hyp);
+        s->onPartial(s->partial);
+      }
+      self->pump();
+    });
+}
+
+auto LocalStt::resolve(Stream &s, std::string txt) -> void
+{
+  if (s.resolved)
+    return;
+  s.resolved = true;
+  // taken out before the call, the callback may open the next stream
+  if (auto cb = std::exchange(s.cb, nullptr))
+    cb(txt);
+}
+
+LocalStt::Stream::Stream(std::weak_ptr<LocalStt> aOwner, int sampleRate, Callback aCb, Callback aOnPartial)
+  : owner(std::move(aOwner)), resampler(sampleRate, ModelRate), cb(std::move(aCb)), onPartial(std::move(aOnPartial))
+{
+}
+
+auto LocalStt::Stream::push(std::span<const int16_t> wav) -> void
+{
+  if (finished || cancelled)
+    return;
+  resampler.process(wav, pending);
+  if (auto self = owner.lock())
+    self->pump();
+}
+
+auto LocalStt::Stream::finish() -> void
+{
+  if (finished || cancelled)
+    return;
+  resampler.flush(pending);
+  finished = true;
+  if (auto self = owner.lock())
+    self->pump();
+}
+
+auto LocalStt::Stream::cancel() -> void
+{
+  if (cancelled || resolved)
+    return;
+  cancelled = true;
+  resolved = true;
+  cb = nullptr;
+  onPartial = nullptr;
+  // an utterance the decoder started is closed by the next job
+  if (auto self = owner.lock())
+    self->pump();
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include "resampler.hpp"
+#include "shared_from_this.hpp"
+#include "stt-backend.hpp"
+#include "uv.hpp"
+#include "wav.hpp"
+#include <deque>
+#include <memory>
+#include <string>
+
+// Recognition in the process with PocketSphinx and its US English word model, for answers that do
+// not wait on the network and keep coming offline. There is one decoder, so the streams are
+// decoded one after another in the order they were opened; the decoding happens on the thread
+// pool, one job at a time, and every job takes all the audio that arrived while the one before it
+// ran. The words recognized after each job are the partial result. Less accurate than the cloud,
+// which is what the local-first mode falls back to when nothing is recognized.
+class LocalStt final : public SttBackend, public virtual enable_shared_from_this
+{
+public:
+  explicit LocalStt(uv::Uv &);
+  // the model starts loading in the background with the first stream, the streams opened before
+  // it is loaded wait for it
+  auto stream(int sampleRate, Callback, Callback onPartial = nullptr) -> std::shared_ptr<SttBackend::Stream> final;
+  auto isReady() const -> bool final;
+  // starts loading the model ahead of the first stream, for a caller that asks isReady() before
+  // it opens one; does nothing once it is loading
+  auto prepare() -> void;
+  // the model did not load, every transcript is empty
+  auto isFailed() const -> bool { return isFailed_; }
+
+  class Stream final : public SttBackend::Stream
+  {
+  public:
+    auto push(std::span<const int16_t>) -> void final;
+    auto finish() -> void final;
+    auto cancel() -> void final;
+    auto done() const -> bool final { return resolved; }
+
+  private:
+    friend class LocalStt;
+    Stream(std::weak_ptr<LocalStt>, int sampleRate, Callback, Callback onPartial);
+
+    std::weak_ptr<LocalStt> owner;
+    Resampler resampler;
+    Callback cb;
+    Callback onPartial;
+    // resampled and not handed to the decoder yet
+    Wav pending;
+    std::string partial;
+    bool started = false;
+    bool finished = false;
+    bool cancelled = false;
+    bool resolved = false;
+  };
+
+  // the rate of the acoustic model
+  static constexpr auto ModelRate = 16000;
+
+private:
+  struct Model;
+  std::reference_wrapper<uv::Uv> uv;
+  // shared with the job running, the decoder outlives this until it is done
+  std::shared_ptr<Model> model;
+  std::deque<std::shared_ptr<Stream>> queue;
+  bool isLoading = false;
+  bool isBusy = false;
+  bool isFailed_ = false;
+
+  auto load() -> void;
+  auto pump() -> void;
+  auto resolve(Stream &, std::string) -> void;
+};
@@ -0,0 +1,48 @@
+#include "log.hpp"
+#include <chrono>
+#include <memory>
+#include <spdlog/async.h>
+#include <spdlog/sinks/stdout_color_sinks.h>
+#include <spdlog/spdlog.h>
+
+namespace Log
+{
+  AsyncBackend::AsyncBackend()
+  {
+    spdlog::init_thread_pool(QueueSize, 1);
+    auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
+    auto logger = std::make_shared<spdlog::async_logger>(
+      "async", std::move(sink), spdlog::thread_pool(), spdlog::async_overflow_policy::overrun_oldest);
+    logger->set_level(spdlog::default_logger()->level());
+    // errors are flushed right away so a crash does not eat them
+    logger->flush_on(spdlog::level::err);
+    spdlog::set_default_logger(std::move(logger));
+  }
+
+  AsyncBackend::~AsyncBackend()
+  {
+    if (const auto lost = spdlog::thread_pool()->overrun_counter(); lost > 0)
+      SPDLOG_WARN("the log queue overflowed, {} messages were lost", lost);
+    spdlog::shutdown();
+  }
+
+  RateLimit::RateLimit(const char *aCategory, int aPerSecond) : category(aCategory), perSecond(aPerSecond) {}
+
+  auto RateLimit::allow() -> bool
+  {
+    const auto now =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+    auto start = windowStart.load(std::memory_order_relaxed);
+    if (now - start >= 1000 && windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed))
+    {
+      count.store(0, std::memory_order_relaxed);
+      if (const auto n = suppressed.exchange(0, std::memory_order_relaxed); n > 0)
+        SPDLOG_WARN("{}: {} messages suppressed", category, n);
+    }
+    if (count.fetch_add(1, std::memory_order_relaxed) < perSecond)
+      return true;
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+} // namespace Log
@@ -0,0 +1,38 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+namespace Log
+{
+  // Routes the default spdlog logger through a preallocated queue drained by a background
+  // thread, which applies the pattern and does the console I/O. A full queue overwrites the oldest
+  // messages rather than stalling the caller, a frame never waits on the terminal. Lives for the
+  // whole of main(), the destructor flushes.
+  class AsyncBackend
+  {
+  public:
+    AsyncBackend();
+    ~AsyncBackend();
+    AsyncBackend(const AsyncBackend &) = delete;
+    auto operator=(const AsyncBackend &) -> AsyncBackend & = delete;
+
+    static constexpr auto QueueSize = size_t{8192};
+  };
+
+  // Lets at most perSecond messages of a chatty category through, and logs how many were
+  // suppressed once the next second starts letting them through again. Approximate under
+  // contention, but safe to share between threads.
+  class RateLimit
+  {
+  public:
+    RateLimit(const char *category, int perSecond);
+    auto allow() -> bool;
+
+  private:
+    const char *category;
+    int perSecond;
+    std::atomic<int64_t> windowStart = 0;
+    std::atomic<int> count = 0;
+    std::atomic<uint64_t> suppressed = 0;
+  };
+} // namespace Log
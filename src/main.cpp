@@ -4,12 +4,19 @@
 // folder + read the top of imgui.cpp. Read online: https://github.com/ocornut/imgui/tree/master/docs
 
 #include "app.hpp"
+#include "chat-dedup.hpp"
+#include "log.hpp"
+#include "micro-bench.hpp"
+#include "mock-api.hpp"
 #include <chrono>
+#include <cstdlib>
 #include <filesystem>
 #include <imgui.h>
+#include <optional>
 #include <spdlog/spdlog.h>
 #include <sdlpp/sdlpp.hpp>
 #include <stdio.h>
+#include <string_view>
 #if defined(IMGUI_IMPL_OPENGL_ES2)
 #include <SDL_opengles2.h>
 #else
@@ -24,6 +31,49 @@
 // Main code
 int main(int argc, char **argv)
 {
+  auto logging = Log::AsyncBackend{};
+  // VoiceTuber --bench-dedup: chat spam collapsing on pathological lines, no window at all
+  if (argc == 2 && std::string_view{argv[1]} == "--bench-dedup")
+    return benchDedup();
+  // VoiceTuber --micro-bench [results.json]: parsing and DSP hot paths, no window either
+  if ((argc == 2 || argc == 3) && std::string_view{argv[1]} == "--micro-bench")
+    return microBench(argc == 3 ? argv[2] : nullptr);
+  // VoiceTuber --bench <frames> <project-dir>: hidden window, no audio devices, stats on stdout
+  const auto benchFrames = argc == 4 && std::string_view{argv[1]} == "--bench" ? std::atoi(argv[2]) : 0;
+  // VoiceTuber --flood <seconds> <msgs/s> <project-dir> [irc-capture] [--stub-tts]: the same with
+  // chat replayed into the project at a rising rate
+  const auto isFlood = argc >= 5 && argc <= 7 && std::string_view{argv[1]} == "--flood";
+  auto floodCapture = std::filesystem::path{};
+  auto floodStubTts = false;
+  for (auto i = 5; isFlood && i < argc; ++i)
+    if (std::string_view{argv[i]} == "--stub-tts")
+      floodStubTts = true;
+    else
+      // made absolute before the working directory moves to the executable
+      floodCapture = std::filesystem::absolute(argv[i]);
+  // VoiceTuber --replay <session> <project-dir> [speed] [--mock-api <latency-ms> <jitter-ms> [seed]]:
+  // a recorded session played into the project offscreen, at speed times the recorded pace; with
+  // --mock-api the speech and LLM services answer with canned responses after the given latency
+  const auto isReplay = argc >= 4 && argc <= 9 && std::string_view{argv[1]} == "--replay";
+  // made absolute before the working directory moves to the executable
+  const auto replaySession = isReplay ? std::filesystem::absolute(argv[2]) : std::filesystem::path{};
+  auto replaySpeed = 1.f;
+  auto replayMock = std::optional<MockApi::Config>{};
+  for (auto i = 4; isReplay && i < argc; ++i)
+    if (std::string_view{argv[i]} == "--mock-api" && i + 2 < argc)
+    {
+      replayMock = MockApi::Config{.latency = static_cast<float>(std::atof(argv[i + 1])),
+                                   .jitter = static_cast<float>(std::atof(argv[i + 2]))};
+      i += 2;
+      if (i + 1 < argc)
+        replayMock->seed = static_cast<unsigned>(std::atoi(argv[++i]));
+    }
+    else
+      replaySpeed = static_cast<float>(std::atof(argv[i]));
+  const auto isTool = benchFrames > 0 || isFlood || isReplay;
+  if (isTool)
+    SDL_SetHint(SDL_HINT_AUDIODRIVER, "dummy");
+
   // Setup SDL
   auto init = sdl::Init{SDL_INIT_VIDEO | SDL_INIT_TIMER | SDL_INIT_AUDIO};
   SDL_EventState(SDL_DROPFILE, SDL_ENABLE);
@@ -40,7 +90,8 @@ int main(int argc, char **argv)
   SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
   SDL_GL_SetAttribute(SDL_GL_STENCIL_SIZE, 8);
   SDL_WindowFlags window_flags =
-    (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED);
+    isTool ? (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN)
+           : (SDL_WindowFlags)(SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE | SDL_WINDOW_MAXIMIZED);
 
   auto window =
     sdl::Window{"VoiceTuber", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1280, 720, window_flags};
@@ -129,6 +180,26 @@ int main(int argc, char **argv)
     // style.Colors[ImGuiCol_ModalWindowDimBg] = ImVec4{0x6f / 255.f, 0x7d / 255.f, 0xaa / 255.f, 1.f};
   }
 
+  if (benchFrames > 0)
+  {
+    char *benchArgv[] = {argv[0], argv[3], nullptr};
+    auto app = App{window, 2, benchArgv};
+    return app.benchmark(benchFrames);
+  }
+  if (isFlood)
+  {
+    char *floodArgv[] = {argv[0], argv[4], nullptr};
+    auto app = App{window, 2, floodArgv};
+    return app.floodTest(std::atoi(argv[2]), std::atoi(argv[3]), floodCapture, floodStubTts);
+  }
+
+  if (isReplay)
+  {
+    char *replayArgv[] = {argv[0], argv[3], nullptr};
+    auto app = App{window, 2, replayArgv};
+    return app.replaySession(replaySession, replaySpeed > 0.f ? replaySpeed : 1.f, replayMock);
+  }
+
   auto app = App{window, argc, argv};
 
 #ifdef __EMSCRIPTEN__
@@ -0,0 +1,69 @@
+#include "mic-source.hpp"
+#include "lib.hpp"
+#include "ui.hpp"
+#include <charconv>
+#include <fmt/format.h>
+#include <imgui.h>
+
+MicSource::MicSource(
+  uv::Uv &uv, AudioDevices &devices, const std::string &aDevice, int latencyBudgetMs, float noiseFloor)
+  : audioIn_(uv, devices, aDevice, wav2Visemes.sampleRate(), latencyBudgetMs), device(aDevice)
+{
+  wav2Visemes.setNoiseFloor(noiseFloor);
+  audioIn_.reg(wav2Visemes);
+}
+
+MicSource::~MicSource()
+{
+  audioIn_.unreg(wav2Visemes);
+}
+
+auto MicSource::update(const std::string &aDevice, int latencyBudgetMs, float noiseFloor) -> void
+{
+  wav2Visemes.setNoiseFloor(noiseFloor);
+  audioIn_.setLatencyBudget(latencyBudgetMs);
+  if (aDevice == device)
+    return;
+  device = aDevice;
+  audioIn_.updateDevice(device);
+}
+
+auto MicSource::poll() -> void
+{
+  wav2Visemes.poll();
+}
+
+auto MicSource::combo(const Lib &lib, int source) -> std::optional<int>
+{
+  ImGui::TableNextColumn();
+  Ui::textRj("Mic");
+  ImGui::TableNextColumn();
+  const auto names = lib.micNames();
+  // a source removed from the preferences is kept, the node listens to the main mic meanwhile
+  const auto current = source < static_cast<int>(names.size()) ? names[static_cast<size_t>(source)]
+                                                                : fmt::format("{}: not set, main mic", source);
+  auto ret = std::optional<int>{};
+  if (auto c = Ui::Combo("##Mic", current.c_str(), 0))
+    for (auto i = 0; i < static_cast<int>(names.size()); ++i)
+      if (ImGui::Selectable(names[static_cast<size_t>(i)].c_str(), i == source) && i != source)
+        ret = i;
+  return ret;
+}
+
+auto MicSource::load(const std::map<std::string, std::string> &attrs) -> int
+{
+  const auto it = attrs.find("mic");
+  if (it == std::end(attrs))
+    return 0;
+  auto ret = 0;
+  const auto &v = it->second;
+  if (std::from_chars(v.data(), v.data() + v.size(), ret).ec != std::errc{} || ret < 0)
+    return 0;
+  return ret;
+}
+
+auto MicSource::save(int source, std::map<std::string, std::string> &attrs) -> void
+{
+  if (source != 0)
+    attrs["mic"] = std::to_string(source);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "audio-in.hpp"
+#include "wav-2-visemes.hpp"
+#include <map>
+#include <optional>
+#include <string>
+
+// A capture device besides the main mic with its own front end: the device, the voice activity
+// gate and lip sync. Lib::queryMic() makes one while a node listens to it, a source nobody listens
+// to opens no device and runs no recognizer. Main thread only.
+class MicSource
+{
+public:
+  MicSource(uv::Uv &, AudioDevices &, const std::string &device, int latencyBudgetMs, float noiseFloor);
+  MicSource(const MicSource &) = delete;
+  ~MicSource();
+
+  auto audioIn() -> AudioIn & { return audioIn_; }
+  auto visemes() -> VisemesSource & { return wav2Visemes; }
+  auto update(const std::string &device, int latencyBudgetMs, float noiseFloor) -> void;
+  // hands the visemes recognized since the last frame to the sinks
+  auto poll() -> void;
+
+  // the "Mic" row of the ui of a node that listens to a source, returns the source picked
+  static auto combo(const class Lib &, int source) -> std::optional<int>;
+  // the source of a node in its attributes, 0 when there is none
+  static auto load(const std::map<std::string, std::string> &attrs) -> int;
+  static auto save(int source, std::map<std::string, std::string> &attrs) -> void;
+
+private:
+  Wav2Visemes wav2Visemes;
+  AudioIn audioIn_;
+  std::string device;
+};
@@ -0,0 +1,236 @@
+#include "micro-bench.hpp"
+#include "audio-block.hpp"
+#include "audio-kernels.hpp"
+#include "chat-dedup.hpp"
+#include "chat-flood.hpp"
+#include "file.hpp"
+#include "irc-parser.hpp"
+#include "resampler.hpp"
+#include "transform-store.hpp"
+#include "version.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fmt/format.h>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct Result
+  {
+    std::string name;
+    // what one item is: a message, a sample, a node
+    std::string unit;
+    double nsPerItem = 0.;
+    // 0 when the case has no natural byte count
+    double mbPerSec = 0.;
+  };
+
+  // keeps the results alive so the work is not optimized away
+  volatile size_t sink = 0;
+
+  auto consume(size_t v) -> void
+  {
+    sink = sink + v;
+  }
+
+  constexpr auto Batches = 15;
+
+  // f() does items units of work over bytes bytes of input
+  template <typename F>
+  auto measure(std::string name, std::string unit, size_t items, size_t bytes, F &&f) -> Result
+  {
+    using Clock = std::chrono::steady_clock;
+    f();
+    auto perBatch = 1;
+    for (;;)
+    {
+      const auto start = Clock::now();
+      for (auto i = 0; i < perBatch; ++i)
+        f();
+      if (Clock::now() - start >= std::chrono::milliseconds{10})
+        break;
+      perBatch *= 2;
+    }
+    auto times = std::vector<double>{};
+    for (auto b = 0; b < Batches; ++b)
+    {
+      const auto start = Clock::now();
+      for (auto i = 0; i < perBatch; ++i)
+        f();
+      times.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / perBatch);
+    }
+    std::ranges::sort(times);
+    const auto ns = times[times.size() / 2];
+    auto ret = Result{std::move(name), std::move(unit), ns / static_cast<double>(items), 0.};
+    if (bytes > 0)
+      ret.mbPerSec = static_cast<double>(bytes) / ns * 1e3;
+    fmt::print("{:<32} {:>12.1f} ns/{}", ret.name, ret.nsPerItem, ret.unit);
+    if (ret.mbPerSec > 0.)
+      fmt::print(" {:>10.1f} MB/s", ret.mbPerSec);
+    fmt::print("\n");
+    return ret;
+  }
+
+  auto benchIrc() -> Result
+  {
+    constexpr auto Messages = 1000;
+    // a TCP segment at a time, so messages split across reads as they do on the socket
+    constexpr auto Segment = size_t{1460};
+    auto traffic = std::string{};
+    ChatFlood{}.generate("channel", Messages, traffic);
+    return measure("irc parse", "msg", Messages, traffic.size(), [&]() {
+      auto parser = IrcParser{};
+      auto n = size_t{0};
+      for (auto pos = size_t{0}; pos < traffic.size(); pos += Segment)
+      {
+        parser.push(std::string_view{traffic}.substr(pos, Segment));
+        while (auto msg = parser.next())
+        {
+          n += msg->paramsCount;
+          for (auto tags = msg->tags; !tags.empty();)
+            n += IrcParser::popTag(tags).second.size();
+        }
+      }
+      consume(n);
+    });
+  }
+
+  auto benchDedupLines() -> Result
+  {
+    const auto lines = std::vector<std::string>{
+      "hello chat",
+      "LUL LUL LUL LUL LUL LUL",
+      "what is the song called?",
+      "PogChamp that was so clean, how long did it take to get the timing right",
+      "Kappa Kappa Kappa Keepo Kappa Kappa Kappa",
+      "never gonna give you up never gonna give you up never gonna give you up never gonna let you down",
+      "gg",
+      "is this the same model as yesterday or did you change the hair",
+    };
+    auto bytes = size_t{0};
+    for (const auto &l : lines)
+      bytes += l.size();
+    return measure("dedup chat line", "line", lines.size(), bytes, [&]() {
+      for (const auto &l : lines)
+        consume(dedup(l).size());
+    });
+  }
+
+  auto tone(size_t n, int rate) -> Wav
+  {
+    auto ret = Wav(n);
+    for (auto i = size_t{0}; i < n; ++i)
+    {
+      const auto t = static_cast<float>(i) / static_cast<float>(rate);
+      ret[i] = static_cast<int16_t>(0x3000 * std::sin(t * 2.f * 3.14159265f * 220.f) *
+                                    (.5f + .5f * std::sin(t * 2.f * 3.14159265f * 2.f)));
+    }
+    return ret;
+  }
+
+  auto benchAudioBlock() -> Result
+  {
+    // what AudioIn makes out of every 10 ms of a 48 kHz capture, the levels every sink reads
+    constexpr auto Samples = size_t{480};
+    const auto wav = tone(Samples, 48'000);
+    return measure("audio block levels", "sample", Samples, Samples * sizeof(int16_t), [&]() {
+      const auto block = AudioBlock{wav};
+      consume(static_cast<size_t>(block.levels().positive));
+    });
+  }
+
+  auto benchMix() -> Result
+  {
+    constexpr auto Samples = size_t{480};
+    const auto wav = tone(Samples, 48'000);
+    auto mix = Wav(Samples);
+    return measure("playback mix", "sample", Samples, Samples * sizeof(int16_t), [&]() {
+      AudioKernels::addSaturate(mix.data(), wav.data(), Samples);
+      consume(static_cast<size_t>(mix[Samples / 2]));
+    });
+  }
+
+  auto benchResampler(int inRate, int outRate) -> Result
+  {
+    // a second of speech streamed in the chunk sizes a TTS download arrives in
+    constexpr auto Chunk = size_t{2048};
+    const auto wav = tone(static_cast<size_t>(inRate), inRate);
+    auto out = Wav{};
+    out.reserve(static_cast<size_t>(outRate) + Chunk);
+    return measure(fmt::format("resample {} -> {}", inRate, outRate),
+                   "in sample",
+                   wav.size(),
+                   wav.size() * sizeof(int16_t),
+                   [&]() {
+                     auto resampler = Resampler{inRate, outRate};
+                     out.clear();
+                     for (auto pos = size_t{0}; pos < wav.size(); pos += Chunk)
+                       resampler.process(std::span{wav}.subspan(pos, std::min(Chunk, wav.size() - pos)), out);
+                     resampler.flush(out);
+                     consume(out.size());
+                   });
+  }
+
+  // the flattened transforms Node::renderAll sets and updates once per frame
+  auto benchTransforms(std::string name, size_t nodes, size_t fanOut) -> Result
+  {
+    auto store = TransformStore{};
+    return measure(std::move(name), "node", nodes, 0, [&]() {
+      store.clear();
+      auto handles = std::vector<TransformStore::Handle>{};
+      handles.reserve(nodes);
+      for (auto i = size_t{0}; i < nodes; ++i)
+      {
+        const auto parent = i == 0 ? TransformStore::None : handles[(i - 1) / fanOut];
+        const auto h = store.add(parent);
+        handles.push_back(h);
+        const auto f = static_cast<float>(i);
+        store.set(h, glm::vec2{f, -f}, glm::vec2{1.f, 1.f}, glm::vec2{.5f, .5f}, f * .01f);
+      }
+      store.update();
+      consume(static_cast<size_t>(store.world(handles.back())[3][0]));
+    });
+  }
+
+  auto toJson(const std::vector<Result> &results) -> std::string
+  {
+    auto ret = fmt::format("{{\"version\":{:?},\"results\":[", appVersion());
+    for (auto i = size_t{0}; i < results.size(); ++i)
+    {
+      const auto &r = results[i];
+      fmt::format_to(std::back_inserter(ret),
+                     "{}{{\"name\":{:?},\"unit\":{:?},\"nsPerItem\":{:.3f},\"mbPerSec\":{:.3f}}}",
+                     i > 0 ? "," : "",
+                     r.name,
+                     r.unit,
+                     r.nsPerItem,
+                     r.mbPerSec);
+    }
+    ret += "]}\n";
+    return ret;
+  }
+} // namespace
+
+auto microBench(const char *out) -> int
+{
+  auto results = std::vector<Result>{};
+  results.push_back(benchIrc());
+  results.push_back(benchDedupLines());
+  results.push_back(benchAudioBlock());
+  results.push_back(benchMix());
+  results.push_back(benchResampler(24'000, 48'000));
+  results.push_back(benchResampler(16'000, 44'100));
+  results.push_back(benchTransforms("transforms wide", 1000, 1000));
+  results.push_back(benchTransforms("transforms deep", 1000, 1));
+  results.push_back(benchTransforms("transforms binary", 1023, 2));
+  if (!out)
+    return 0;
+  if (!write_file_atomically(out, toJson(results)))
+  {
+    fmt::print(stderr, "Cannot write {}\n", out);
+    return 1;
+  }
+  return 0;
+}
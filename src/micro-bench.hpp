@@ -0,0 +1,8 @@
+#pragma once
+
+// Times the parsing and DSP hot paths in isolation, for VoiceTuber --micro-bench [results.json].
+// Nothing here needs a window, an audio device or the network. Every case is run in batches of
+// about 10 ms and the median batch is reported, so one slow batch does not move the number. The
+// table goes to stdout; with a file name the results are also written there as JSON tagged with
+// the version, so runs of different releases can be compared.
+auto microBench(const char *out) -> int;
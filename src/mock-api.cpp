@@ -0,0 +1,133 @@
+#include "mock-api.hpp"
+#include "azure-tts.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fmt/format.h>
+#include <numbers>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+  auto contains(std::string_view s, std::string_view what) -> bool
+  {
+    return s.find(what) != std::string_view::npos;
+  }
+
+  auto header(const HttpClient::Headers &headers, std::string_view name) -> std::string_view
+  {
+    for (const auto &[k, v] : headers)
+      if (k == name)
+        return v;
+    return {};
+  }
+
+  // the characters of the SSML that are spoken
+  auto spokenLength(std::string_view ssml) -> size_t
+  {
+    auto ret = size_t{0};
+    auto isTag = false;
+    for (auto ch : ssml)
+      if (ch == '<')
+        isTag = true;
+      else if (ch == '>')
+        isTag = false;
+      else if (!isTag)
+        ++ret;
+    return ret;
+  }
+} // namespace
+
+MockApi::MockApi(Config aConfig) : config(aConfig), rng(aConfig.seed) {}
+
+auto MockApi::operator()(const std::string &url, std::string_view post, const HttpClient::Headers &headers)
+  -> HttpClient::Exchange
+{
+  auto ret = HttpClient::Exchange{.url = url, .status = 200};
+  const auto at = startsAfter();
+  ret.ms = at;
+  if (contains(url, "/sts/v1.0/issuetoken"))
+    ret.body = Token;
+  else if (contains(url, ".stt.speech.microsoft.com"))
+    ret.body = fmt::format(
+      R"({{"RecognitionStatus":"Success","Offset":0,"Duration":10000000,"DisplayText":"{}"}})", Transcript);
+  else if (contains(url, "/cognitiveservices/voices/list"))
+    ret.body = R"([{"ShortName":"en-US-JennyNeural","Gender":"Female","Locale":"en-US"}])";
+  else if (contains(url, ".tts.speech.microsoft.com"))
+    tts(ret, post, headers, at);
+  else if (contains(url, "completions"))
+    llm(ret, post, at);
+  else
+  {
+    SPDLOG_WARN("mock API: nothing canned for {:?}", url);
+    ret.status = 404;
+  }
+  return ret;
+}
+
+auto MockApi::startsAfter() -> float
+{
+  if (config.jitter <= 0.f)
+    return std::max(0.f, config.latency);
+  auto dist = std::uniform_real_distribution<float>{-config.jitter, config.jitter};
+  return std::max(0.f, config.latency + dist(rng));
+}
+
+auto MockApi::tts(HttpClient::Exchange &e, std::string_view post, const HttpClient::Headers &headers, float at)
+  -> void
+{
+  if (header(headers, "X-Microsoft-OutputFormat") != AzureTts::OutputFormat)
+  {
+    // there is no canned Opus stream
+    SPDLOG_WARN("mock API: only {} is synthesized", AzureTts::OutputFormat);
+    e.status = 400;
+    return;
+  }
+  // about 15 characters a second, hummed at a syllable rate so the mouth has something to show
+  const auto seconds = std::max(.5f, static_cast<float>(spokenLength(post)) / 15.f);
+  const auto samples = static_cast<size_t>(seconds * AzureTts::OutputRate);
+  e.body.reserve(samples * 2);
+  for (auto i = size_t{0}; i < samples; ++i)
+  {
+    const auto t = static_cast<float>(i) / AzureTts::OutputRate;
+    const auto envelope = std::abs(std::sin(std::numbers::pi_v<float> * 4.f * t));
+    const auto v = static_cast<int16_t>(8000.f * envelope * std::sin(2.f * std::numbers::pi_v<float> * 180.f * t));
+    e.body.push_back(static_cast<char>(static_cast<uint16_t>(v) & 0xff));
+    e.body.push_back(static_cast<char>(static_cast<uint16_t>(v) >> 8));
+  }
+  constexpr auto PieceBytes = size_t{AzureTts::OutputRate * TtsPieceMs / 1000 * 2};
+  for (auto end = size_t{0}; end < e.body.size();)
+  {
+    end = std::min(end + PieceBytes, e.body.size());
+    e.pieces.push_back(HttpClient::Exchange::Piece{at, end});
+    at += TtsPieceMs / TtsRealtimeFactor;
+  }
+  e.ms = e.pieces.back().ms;
+}
+
+auto MockApi::llm(HttpClient::Exchange &e, std::string_view post, float at) -> void
+{
+  const auto isChat = contains(post, R"("messages":)");
+  if (!contains(post, R"("stream": true)"))
+  {
+    e.body = isChat ? fmt::format(R"({{"choices":[{{"message":{{"role":"assistant","content":"{}"}}}}]}})", Reply)
+                    : fmt::format(R"({{"choices":[{{"text":"{}"}}]}})", Reply);
+    return;
+  }
+  // one event per word, each word with the space in front of it
+  const auto reply = std::string_view{Reply};
+  for (auto start = size_t{0}; start < reply.size();)
+  {
+    const auto end = std::min(reply.find(' ', start + 1), reply.size());
+    const auto word = reply.substr(start, end - start);
+    e.body += isChat ? fmt::format(R"(data: {{"choices":[{{"delta":{{"content":"{}"}}}}]}})", word)
+                     : fmt::format(R"(data: {{"choices":[{{"text":"{}"}}]}})", word);
+    e.body += "\n\n";
+    e.pieces.push_back(HttpClient::Exchange::Piece{at, e.body.size()});
+    at += TokenMs;
+    start = end;
+  }
+  e.body += "data: [DONE]\n\n";
+  e.pieces.push_back(HttpClient::Exchange::Piece{at, e.body.size()});
+  e.ms = at;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include "http-client.hpp"
+#include <random>
+#include <string>
+#include <string_view>
+
+// Stands in for the speech and LLM services when HttpClient::mock() hands it the requests: a token
+// for issuetoken, one canned transcript for STT, a voice for the voice list, a hummed tone as long
+// as the text for TTS streamed in PCM pieces faster than real time, and one canned reply for the
+// OpenAI completions and chat APIs, streamed word by word when asked. Every response starts
+// latency give or take jitter milliseconds after its request, the jitter drawn from a generator
+// seeded with seed, so the same requests in the same order take the same time on every run.
+class MockApi
+{
+public:
+  struct Config
+  {
+    float latency = 150.f;
+    float jitter = 0.f;
+    unsigned seed = 1;
+  };
+
+  explicit MockApi(Config);
+  auto operator()(const std::string &url, std::string_view post, const HttpClient::Headers &)
+    -> HttpClient::Exchange;
+
+  static constexpr auto Token = "mock-token";
+  static constexpr auto Transcript = "What do you think about it?";
+  static constexpr auto Reply = " That sounds like a lot of fun, tell me more about it.";
+  // as fast as the service streams the audio, and the word rate of the LLM
+  static constexpr auto TtsRealtimeFactor = 4.f;
+  static constexpr auto TtsPieceMs = 100;
+  static constexpr auto TokenMs = 25.f;
+
+private:
+  Config config;
+  std::mt19937 rng;
+
+  auto llm(HttpClient::Exchange &, std::string_view post, float at) -> void;
+  auto startsAfter() -> float;
+  auto tts(HttpClient::Exchange &, std::string_view post, const HttpClient::Headers &, float at) -> void;
+};
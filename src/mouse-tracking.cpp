@@ -1,33 +1,73 @@
 #include "mouse-tracking.hpp"
+#include "preferences.hpp"
 #include "uv.hpp"
-#include <SDL_opengl.h>
-#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 #include <sdlpp/sdlpp.hpp>
 
-static auto getProjMat() -> glm::mat4
+MouseTracking::MouseTracking(uv::Uv &uv, const FrameCtx &aFrameCtx, const Preferences &aPreferences)
+  : frameCtx(aFrameCtx), preferences(aPreferences), timer(uv.createTimer())
 {
-  GLfloat projMatData[16];
-  glGetFloatv(GL_PROJECTION_MATRIX, projMatData);
-  return glm::make_mat4(projMatData);
 }
 
-MouseTracking::MouseTracking(uv::Uv &uv) : prepare(uv.createPrepare())
+auto MouseTracking::updateRate() -> void
 {
-  prepare.start([this]() { tick(); });
+  if (mouseSinks.empty())
+    return;
+  const auto interval = static_cast<uint64_t>(1000 / std::clamp(preferences.get().mouseHz, 1, 1000));
+  timer.start([this]() { tick(); }, 0, interval);
 }
 
 auto MouseTracking::tick() -> void
 {
-  const auto projMat = getProjMat();
   int x, y;
-  SDL_GetGlobalMouseState(&x, &y);
+  if (replayed)
+  {
+    x = replayed->x;
+    y = replayed->y;
+  }
+  else
+    SDL_GetGlobalMouseState(&x, &y);
+  const auto &newProjMat = frameCtx.get().projMat;
+  if (glm::ivec2{x, y} != mouse || newProjMat != projMat)
+  {
+    if (tap_ && glm::ivec2{x, y} != mouse)
+      tap_(glm::ivec2{x, y});
+    mouse = glm::ivec2{x, y};
+    projMat = newProjMat;
+    mapped.clear();
+  }
+  // the sinks get the still mouse as well, an eye on a moving parent looks at it from elsewhere
   for (auto mouseSink : mouseSinks)
     mouseSink.get().ingest(projMat, glm::vec2{1.f * x, 1.f * y});
 }
 
+auto MouseTracking::tap(std::function<void(glm::ivec2)> v) -> void
+{
+  tap_ = std::move(v);
+}
+
+auto MouseTracking::replay(glm::ivec2 v) -> void
+{
+  replayed = v;
+}
+
+auto MouseTracking::onDisplay(glm::ivec2 topLeft, glm::ivec2 bottomRight) -> glm::vec2
+{
+  for (const auto &m : mapped)
+    if (m.topLeft == topLeft && m.bottomRight == bottomRight)
+      return m.v;
+  const auto &viewport = frameCtx.get().viewport;
+  const auto size = glm::vec2{bottomRight - topLeft};
+  const auto v = glm::vec2{mouse - topLeft} * viewport / size;
+  mapped.push_back(Mapped{topLeft, bottomRight, v});
+  return v;
+}
+
 auto MouseTracking::reg(MouseSink &v) -> void
 {
   mouseSinks.push_back(v);
+  if (mouseSinks.size() == 1)
+    updateRate();
 }
 
 auto MouseTracking::unreg(MouseSink &v) -> void
@@ -36,4 +76,6 @@ auto MouseTracking::unreg(MouseSink &v) -> void
                                   std::end(mouseSinks),
                                   [&](const auto &x) { return &x.get() == &v; }),
                    std::end(mouseSinks));
+  if (mouseSinks.empty())
+    timer.stop();
 }
@@ -1,17 +1,47 @@
 #pragma once
+#include "frame-ctx.hpp"
 #include "mouse-sink.hpp"
 #include "uv.hpp"
+#include <functional>
+#include <optional>
 #include <vector>
 
+// Samples the global mouse position at Preferences::mouseHz and hands it to the sinks; the display
+// mapping is only worked out again when the mouse moved or the projection changed. With no sinks
+// registered there is no timer at all.
 class MouseTracking
 {
 public:
-  MouseTracking(uv::Uv &);
+  MouseTracking(uv::Uv &, const FrameCtx &, const class Preferences &);
   auto reg(MouseSink &) -> void;
   auto unreg(MouseSink &) -> void;
+  // picks up a changed Preferences::mouseHz
+  auto updateRate() -> void;
+  // every new position goes to tap as well, for the session recorder; null stops
+  auto tap(std::function<void(glm::ivec2)>) -> void;
+  // the position the next samples take instead of the real mouse, for the session replay
+  auto replay(glm::ivec2) -> void;
+  // the current sample mapped from a display rectangle onto the viewport, worked out once per
+  // sample and rectangle however many eyes watch that display
+  auto onDisplay(glm::ivec2 topLeft, glm::ivec2 bottomRight) -> glm::vec2;
 
 private:
-  uv::Prepare prepare;
+  struct Mapped
+  {
+    glm::ivec2 topLeft;
+    glm::ivec2 bottomRight;
+    glm::vec2 v;
+  };
+
+  std::reference_wrapper<const FrameCtx> frameCtx;
+  std::reference_wrapper<const Preferences> preferences;
+  uv::Timer timer;
   std::vector<std::reference_wrapper<MouseSink>> mouseSinks;
+  glm::ivec2 mouse = {0, 0};
+  std::function<void(glm::ivec2)> tap_;
+  std::optional<glm::ivec2> replayed;
+  glm::mat4 projMat = glm::mat4{0.f};
+  std::vector<Mapped> mapped;
+
   auto tick() -> void;
 };
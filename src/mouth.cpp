@@ -1,44 +1,47 @@
 #include "mouth.hpp"
+#include "animated-image.hpp"
 #include "image-list.hpp"
 #include "sprite-sheet.hpp"
 #include "ui.hpp"
 #include "undo.hpp"
-#include "wav-2-visemes.hpp"
 #include <fmt/core.h>
 #include <imgui.h>
 #include <spdlog/spdlog.h>
 
 template <typename S, typename ClassName>
-Mouth<S, ClassName>::Mouth(Wav2Visemes &wav2Visemes,
-                           Lib &lib,
+Mouth<S, ClassName>::Mouth(VisemesSource &aVisemes,
+                           Lib &aLib,
                            Undo &aUndo,
                            const std::filesystem::path &path)
-  : Node(lib, aUndo, [&path]() { return path.filename().string(); }()),
-    sprite(lib, aUndo, path),
-    wav2Visemes(wav2Visemes)
+  : Node(aLib, aUndo, [&path]() { return path.filename().string(); }()),
+    sprite(aLib, aUndo, path),
+    lib(aLib),
+    mainVisemes(aVisemes),
+    visemes(aVisemes)
 {
-  viseme2Sprite[Viseme::sil] = 0;
-  viseme2Sprite[Viseme::PP] = 1;
-  viseme2Sprite[Viseme::FF] = 2;
-  viseme2Sprite[Viseme::TH] = 3;
-  viseme2Sprite[Viseme::DD] = 4;
-  viseme2Sprite[Viseme::kk] = 5;
-  viseme2Sprite[Viseme::CH] = 6;
-  viseme2Sprite[Viseme::SS] = 7;
-  viseme2Sprite[Viseme::nn] = 8;
-  viseme2Sprite[Viseme::RR] = 9;
-  viseme2Sprite[Viseme::aa] = 10;
-  viseme2Sprite[Viseme::E] = 11;
-  viseme2Sprite[Viseme::I] = 12;
-  viseme2Sprite[Viseme::O] = 13;
-  viseme2Sprite[Viseme::U] = 14;
-  wav2Visemes.reg(*this);
+  auto &sprites = viseme2Sprite.edit();
+  sprites[Viseme::sil] = 0;
+  sprites[Viseme::PP] = 1;
+  sprites[Viseme::FF] = 2;
+  sprites[Viseme::TH] = 3;
+  sprites[Viseme::DD] = 4;
+  sprites[Viseme::kk] = 5;
+  sprites[Viseme::CH] = 6;
+  sprites[Viseme::SS] = 7;
+  sprites[Viseme::nn] = 8;
+  sprites[Viseme::RR] = 9;
+  sprites[Viseme::aa] = 10;
+  sprites[Viseme::E] = 11;
+  sprites[Viseme::I] = 12;
+  sprites[Viseme::O] = 13;
+  sprites[Viseme::U] = 14;
+  aVisemes.reg(*this);
 }
 
 template <typename S, typename ClassName>
 Mouth<S, ClassName>::~Mouth()
 {
-  wav2Visemes.get().unreg(*this);
+  visemes.get().unreg(*this);
 }
 
 template <typename S, typename ClassName>
@@ -51,7 +54,10 @@ template <typename S, typename ClassName>
 auto Mouth<S, ClassName>::render(float dt, Node *hovered, Node *selected) -> void
 {
   if (sprite.numFrames() > 0)
-    sprite.frame(viseme2Sprite[viseme] % sprite.numFrames());
+  {
+    const auto it = viseme2Sprite->find(viseme);
+    sprite.frame((it != std::end(*viseme2Sprite) ? it->second : 0) % sprite.numFrames());
+  }
   sprite.render();
   Node::render(dt, hovered, selected);
 }
@@ -61,6 +67,20 @@ auto Mouth<S, ClassName>::renderUi() -> void
 {
   Node::renderUi();
   sprite.renderUi();
+  if (const auto picked = MicSource::combo(lib, mic))
+    undo.get().record(
+      [source = *picked, alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->listen(source);
+        else
+          SPDLOG_INFO("this was destroyed");
+      },
+      [source = mic, alive = weak_self()]() {
+        if (auto self = alive.lock())
+          self->listen(source);
+        else
+          SPDLOG_INFO("this was destroyed");
+      });
   ImGui::TableNextColumn();
 
   {
@@ -88,12 +108,14 @@ auto Mouth<S, ClassName>::renderUi() -> void
     case Viseme::O: strcpy(str, "O"); break;
     case Viseme::U: strcpy(str, "U"); break;
     }
+    if (!visemes.get().isReady())
+      strcpy(str, "loading model");
     ImGui::InputText("##Viseme", str, ImGuiInputTextFlags_ReadOnly);
     ImGui::PopStyleColor(); // Restore the original text color
   }
 
   auto visUi = [&](auto vis, auto txt, auto txt2) {
-    auto &f = viseme2Sprite[vis];
+    auto f = viseme2Sprite->contains(vis) ? viseme2Sprite->at(vis) : 0;
     ImGui::TableNextColumn();
     Ui::textRj(txt);
     ImGui::TableNextColumn();
@@ -101,13 +123,13 @@ auto Mouth<S, ClassName>::renderUi() -> void
     if (ImGui::InputInt(txt2, &f))
     {
       undo.get().record(
-        [&f, newF = f, alive = weak_self(), vis]() {
+        [newF = f, alive = weak_self(), vis]() {
           if (auto self = alive.lock())
           {
             using namespace std::chrono_literals;
-            f = std::move(newF);
+            self->viseme2Sprite.edit()[vis] = newF;
             self->viseme = std::move(vis);
-            self->freezeTime = std::chrono::high_resolution_clock::now() + 1s;
+            self->freezeTime = self->frameCtx.get().now + 1s;
           }
           else
           {
@@ -115,13 +137,13 @@ auto Mouth<S, ClassName>::renderUi() -> void
             return;
           }
         },
-        [&f, oldF, alive = weak_self(), vis]() {
+        [oldF, alive = weak_self(), vis]() {
           if (auto self = alive.lock())
           {
             using namespace std::chrono_literals;
-            f = std::move(oldF);
+            self->viseme2Sprite.edit()[vis] = oldF;
             self->viseme = std::move(vis);
-            self->freezeTime = std::chrono::high_resolution_clock::now() + 1s;
+            self->freezeTime = self->frameCtx.get().now + 1s;
           }
           else
           {
@@ -139,7 +161,7 @@ auto Mouth<S, ClassName>::renderUi() -> void
     {
       viseme = vis;
       using namespace std::chrono_literals;
-      freezeTime = std::chrono::high_resolution_clock::now() + 1s;
+      freezeTime = frameCtx.get().now + 1s;
     }
   };
   visUi(Viseme::sil, "sil", "##sil");
@@ -159,11 +181,40 @@ auto Mouth<S, ClassName>::renderUi() -> void
   visUi(Viseme::U, "U", "##U");
 }
 
+template <typename S, typename ClassName>
+auto Mouth<S, ClassName>::listen(int source) -> void
+{
+  visemes.get().unreg(*this);
+  mic = source;
+  micSource = lib.get().queryMic(source);
+  visemes = micSource ? micSource->visemes() : mainVisemes.get();
+  visemes.get().reg(*this);
+}
+
+template <typename S, typename ClassName>
+auto Mouth<S, ClassName>::loadAttrs(const std::map<std::string, std::string> &attrs) -> void
+{
+  if (const auto source = MicSource::load(attrs); source != mic)
+    listen(source);
+}
+
+template <typename S, typename ClassName>
+auto Mouth<S, ClassName>::saveAttrs(std::map<std::string, std::string> &attrs) const -> void
+{
+  MicSource::save(mic, attrs);
+}
+
 template <typename S, typename ClassName>
 auto Mouth<S, ClassName>::ingest(Viseme v) -> void
 {
-  if (std::chrono::high_resolution_clock::now() < freezeTime)
+  if (frameCtx.get().now < freezeTime)
+  {
+    // the loop may be rendering on demand, the freeze ends with a frame
+    scheduler.get().invalidate();
     return;
+  }
+  if (viseme != v)
+    scheduler.get().invalidate();
   viseme = v;
 }
 
@@ -185,6 +236,12 @@ auto Mouth<S, ClassName>::load(IStrm &strm) -> void
   Node::load(strm);
 }
 
+template <typename S, typename ClassName>
+auto Mouth<S, ClassName>::heldBytes(Counted &counted) const -> size_t
+{
+  return sizeof(*this) + sprite.textureBytes(counted);
+}
+
 template <typename S, typename ClassName>
 auto Mouth<S, ClassName>::h() const -> float
 {
@@ -205,3 +262,4 @@ auto Mouth<S, ClassName>::w() const -> float
 
 template class Mouth<SpriteSheet, SpriteSheetMouthClassName>;
 template class Mouth<ImageList, ImageListMouthClassName>;
+template class Mouth<AnimatedImage, AnimatedImageMouthClassName>;
@@ -1,8 +1,11 @@
 #pragma once
+#include "animated-image.hpp"
 #include "image-list.hpp"
+#include "mic-source.hpp"
 #include "node.hpp"
 #include "sprite-sheet.hpp"
 #include "visemes-sink.hpp"
+#include "visemes-source.hpp"
 #include <chrono>
 #include <filesystem>
 
@@ -14,25 +17,36 @@ public:
   SER_DEF_PROPS()
 #undef SER_PROP_LIST
 
-  Mouth(class Wav2Visemes &, Lib &, Undo &, const std::filesystem::path &);
+  Mouth(VisemesSource &, Lib &, Undo &, const std::filesystem::path &);
   ~Mouth() final;
 
   constexpr static const char *className = ClassName::v;
 
 private:
   S sprite;
-  std::map<Viseme, int> viseme2Sprite;
+  // shared with the clones until one of them remaps a viseme
+  Cow<std::map<Viseme, int>> viseme2Sprite;
   Viseme viseme = Viseme{};
-  std::chrono::high_resolution_clock::time_point freezeTime;
-  std::reference_wrapper<Wav2Visemes> wav2Visemes;
+  std::chrono::steady_clock::time_point freezeTime;
+  std::reference_wrapper<Lib> lib;
+  // the visemes of the main mic, or of the avatar the mouth is part of
+  std::reference_wrapper<VisemesSource> mainVisemes;
+  // the source picked, 0 for the main mic
+  int mic = 0;
+  std::shared_ptr<MicSource> micSource;
+  std::reference_wrapper<VisemesSource> visemes;
 
   auto h() const -> float final;
+  auto heldBytes(Counted &) const -> size_t final;
   auto ingest(Viseme) -> void final;
   auto isTransparent(glm::vec2) const -> bool final;
+  auto listen(int source) -> void;
   auto load(IStrm &) -> void final;
+  auto loadAttrs(const std::map<std::string, std::string> &) -> void final;
   auto render(float dt, Node *hovered, Node *selected) -> void final;
   auto renderUi() -> void final;
   auto save(OStrm &) const -> void final;
+  auto saveAttrs(std::map<std::string, std::string> &) const -> void final;
   auto w() const -> float final;
   auto do_clone() const -> std::shared_ptr<Node> final;
 };
@@ -47,5 +61,11 @@ struct ImageListMouthClassName
   constexpr static const char *v = "ImageListMouth";
 };
 
+struct AnimatedImageMouthClassName
+{
+  constexpr static const char *v = "AnimatedImageMouth";
+};
+
 using SpriteSheetMouth = Mouth<SpriteSheet, SpriteSheetMouthClassName>;
 using ImageListMouth = Mouth<ImageList, ImageListMouthClassName>;
+using AnimatedImageMouth = Mouth<AnimatedImage, AnimatedImageMouthClassName>;
@@ -1,6 +1,6 @@
 #include "no-voice.hpp"
 
-static unsigned char chat_s16le[] = {
+alignas(int16_t) static const unsigned char chat_s16le[] = {
   0x7e, 0x04, 0xe2, 0x05, 0x55, 0x08, 0xa7, 0x0b, 0x80, 0x0e, 0x8c, 0x11, 0x6b, 0x14, 0x4d, 0x16, 0x52,
   0x18, 0xe4, 0x18, 0x8c, 0x19, 0xcb, 0x19, 0x37, 0x18, 0x6e, 0x16, 0xc4, 0x12, 0xb5, 0x0e, 0x37, 0x0a,
   0x52, 0x04, 0x38, 0xff, 0x2a, 0xf9, 0xe3, 0xf2, 0x76, 0xec, 0x81, 0xe5, 0xef, 0xdf, 0x95, 0xda, 0x19,
@@ -1575,13 +1575,9 @@ static unsigned char chat_s16le[] = {
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
   0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-static unsigned int chat_s16le_len = 26750;
+static const unsigned int chat_s16le_len = 26750;
 
-auto noVoice() -> Wav
+auto noVoice() -> std::span<const int16_t>
 {
-  auto ret = Wav{};
-  ret.insert(std::end(ret),
-             reinterpret_cast<int16_t *>(chat_s16le),
-             reinterpret_cast<int16_t *>(chat_s16le) + chat_s16le_len / sizeof(int16_t));
-  return ret;
+  return {reinterpret_cast<const int16_t *>(chat_s16le), chat_s16le_len / sizeof(int16_t)};
 }
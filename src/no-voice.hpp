@@ -1,4 +1,7 @@
 #pragma once
-#include "wav.hpp"
+#include <cstdint>
+#include <span>
 
-auto noVoice() -> Wav;
+// the chime for a muted chatter as it is embedded, SoundBank holds it at the output rate
+auto noVoice() -> std::span<const int16_t>;
+constexpr auto NoVoiceRate = 44100;
@@ -0,0 +1,44 @@
+#include "node-profile.hpp"
+#include "gl-ext.hpp"
+
+NodeProfile::~NodeProfile()
+{
+  if (query)
+    GlExt::deleteQueries(1, &query);
+}
+
+auto NodeProfile::addCpu(std::chrono::steady_clock::duration d) -> void
+{
+  const auto ms = std::chrono::duration<float, std::milli>{d}.count();
+  cpuMs_ += (ms - cpuMs_) * Smoothing;
+}
+
+auto NodeProfile::beginGpu() -> bool
+{
+  if (queryPending)
+  {
+    auto available = GLint{GL_FALSE};
+    GlExt::getQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return false;
+    auto ns = GLuint64{0};
+    GlExt::getQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+    gpuMs_ += (static_cast<float>(ns) / 1'000'000.f - gpuMs_) * Smoothing;
+    queryPending = false;
+  }
+  if (!query)
+    GlExt::genQueries(1, &query);
+  GlExt::beginQuery(GL_TIME_ELAPSED, query);
+  return true;
+}
+
+auto NodeProfile::endGpu() -> void
+{
+  GlExt::endQuery(GL_TIME_ELAPSED);
+  queryPending = true;
+}
+
+auto NodeProfile::hasGpuTimer() -> bool
+{
+  return GlExt::getQueryObjectui64v != nullptr;
+}
@@ -0,0 +1,33 @@
+#pragma once
+#include <SDL_opengl.h>
+#include <chrono>
+
+// Rolling frame cost of one node's own render(). CPU time is sampled every profiled frame; GPU time
+// comes from a GL_TIME_ELAPSED query that is read back once the driver has it, usually a frame or
+// two later, so the GPU never stalls waiting for the result.
+class NodeProfile
+{
+public:
+  NodeProfile() = default;
+  // a clone starts with its own samples and query
+  NodeProfile(const NodeProfile &) : NodeProfile() {}
+  auto operator=(const NodeProfile &) -> NodeProfile & { return *this; }
+  ~NodeProfile();
+
+  auto cpuMs() const -> float { return cpuMs_; }
+  auto gpuMs() const -> float { return gpuMs_; }
+  auto addCpu(std::chrono::steady_clock::duration) -> void;
+  // returns false while the previous query is still in flight, in which case endGpu() is skipped
+  auto beginGpu() -> bool;
+  auto endGpu() -> void;
+  static auto hasGpuTimer() -> bool;
+
+  // weight of the newest sample in the exponential moving average
+  static constexpr auto Smoothing = .05f;
+
+private:
+  float cpuMs_ = 0.f;
+  float gpuMs_ = 0.f;
+  GLuint query = 0;
+  bool queryPending = false;
+};
@@ -1,11 +1,14 @@
 #include "node.hpp"
 #include "imgui-helpers.hpp"
 #include "save-factory.hpp"
+#include "trace.hpp"
 #include "ui.hpp"
 #include "undo.hpp"
 #include <SDL_opengl.h>
 #include <algorithm>
+#include <chrono>
 #include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include <limits>
 #include <numbers>
 #include <spdlog/spdlog.h>
@@ -43,31 +46,44 @@ namespace Internal
   }
 } // namespace Internal
 
-static auto getModelViewMatrix() -> glm::mat4
-{
-  GLfloat modelMatrixData[16];
-  glGetFloatv(GL_MODELVIEW_MATRIX, modelMatrixData);
-  return glm::make_mat4(modelMatrixData);
-}
-
-static auto setModelViewMatrix(glm::mat4 v) -> void
-{
-  glMatrixMode(GL_MODELVIEW);
-  glLoadMatrixf(glm::value_ptr(v));
-}
-
 Node::Node(Lib &lib, Undo &undo, std::string name)
   : name(std::move(name)),
     undo(undo),
-    arrowN(lib.queryTex("engine:arrow-n-circle.png", true)),
-    arrowNE(lib.queryTex("engine:arrow-ne-circle.png", true)),
-    arrowE(lib.queryTex("engine:arrow-e-circle.png", true)),
-    arrowSE(lib.queryTex("engine:arrow-se-circle.png", true)),
-    arrowS(lib.queryTex("engine:arrow-s-circle.png", true)),
-    arrowSW(lib.queryTex("engine:arrow-sw-circle.png", true)),
-    arrowW(lib.queryTex("engine:arrow-w-circle.png", true)),
-    arrowNW(lib.queryTex("engine:arrow-nw-circle.png", true)),
-    center(lib.queryTex("engine:center-circle.png", true))
+    batch(lib.spriteBatch()),
+    frameCtx(lib.frameCtx()),
+    scheduler(lib.scheduler()),
+    icons(lib.editorIcons()),
+    jobs(lib.jobs()),
+    arena(lib.frameArena())
+{
+}
+
+Node::Node(const Node &other)
+  : enable_shared_from_this(other),
+    visible(other.visible),
+    name(other.name),
+    loc(other.loc),
+    scale(other.scale),
+    pivot_(other.pivot_),
+    rot(other.rot),
+    uniformScaling(other.uniformScaling),
+    dRot(other.dRot),
+    dLoc(other.dLoc),
+    dScale(other.dScale),
+    undo(other.undo),
+    batch(other.batch),
+    frameCtx(other.frameCtx),
+    scheduler(other.scheduler),
+    icons(other.icons),
+    zOrder(other.zOrder),
+    jobs(other.jobs),
+    arena(other.arena),
+    modelViewMat(other.modelViewMat),
+    startMousePos(other.startMousePos),
+    initLoc(other.initLoc),
+    initScale(other.initScale),
+    initRot(other.initRot),
+    editMode_(other.editMode_)
 {
 }
 
@@ -75,39 +91,170 @@ Node::~Node() {}
 
 auto Node::renderAll(float dt, Node *hovered, Node *selected) -> void
 {
-  auto ns = Nodes{};
-  getAllNodesCalcModelView(ns);
+  auto span = Trace::Span{"render all"};
+  // zOrder is a plain property edited from many places (UI, undo, Root and Bouncer pin it every
+  // frame), so instead of hooking every writer the snapshot taken at build time is compared here
+  if (!drawListDirty)
+    drawListDirty = std::any_of(std::begin(drawList), std::end(drawList), [](const auto &item) {
+      return item.node.get().zOrder != item.zOrder;
+    });
 
-  std::stable_sort(std::begin(ns), std::end(ns), [](const auto a, const auto b) {
-    return a.get().zOrder < b.get().zOrder;
-  });
+  if (drawListDirty)
+  {
+    drawList.clear();
+    transforms.clear();
+    collectDrawList(drawList, transforms, TransformStore::None);
+    // the handles are in collection order, they keep the tree order within a zOrder without the
+    // buffer a stable sort allocates
+    std::sort(std::begin(drawList), std::end(drawList), [](const auto &a, const auto &b) {
+      return a.zOrder != b.zOrder ? a.zOrder < b.zOrder : a.transform < b.transform;
+    });
+    drawListDirty = false;
+  }
 
+  for (const auto &item : drawList)
+  {
+    const auto &n = item.node.get();
+    transforms.set(item.transform, n.loc + n.dLoc, n.scale + n.dScale, n.pivot_, n.rot + n.dRot);
+  }
+  transforms.update();
+  // the nodes keep a copy for the code that works on a single node (gizmos, reparenting, picking)
+  for (const auto &item : drawList)
+    item.node.get().modelViewMat = transforms.world(item.transform);
+  jobs.get().parallelFor(drawList.size(), AnimateGrain, [&](size_t begin, size_t end) {
+    for (auto i = begin; i < end; ++i)
+      if (auto &n = drawList[i].node.get(); n.visible)
+        n.animate(dt);
+  });
+  updateHitGrid();
+
+  auto &b = batch.get();
+  const auto &ctx = frameCtx.get();
+  // profiling wants every node drawn and timed on its own
+  const auto useLayers = ctx.cacheLayers && !ctx.profile;
+  auto isCacheable = [&](const DrawItem &item) {
+    const auto &n = item.node.get();
+    return useLayers && &n != hovered && &n != selected && n.isStatic();
+  };
+  if (useLayers)
+    layers.begin(glm::ivec2{ctx.viewport}, undo.get().version() + scheduler.get().layersGeneration());
+  auto layersUsed = size_t{0};
+
+  b.begin();
   glPushMatrix();
-  for (auto &n : ns)
+  for (auto i = size_t{0}; i < drawList.size();)
   {
-    setModelViewMatrix(n.get().modelViewMat);
-    if (n.get().visible)
-      n.get().render(dt, hovered, selected);
+    auto runEnd = i;
+    while (runEnd < drawList.size() && isCacheable(drawList[runEnd]))
+      ++runEnd;
+    if (runEnd - i < LayerCache::MinRun)
+    {
+      for (const auto last = std::max(runEnd, i + 1); i < last; ++i)
+        renderItem(drawList[i], dt, hovered, selected);
+      continue;
+    }
+    auto key = LayerCache::EmptyKey;
+    for (auto j = i; j < runEnd; ++j)
+    {
+      const auto n = &drawList[j].node.get();
+      key = LayerCache::hash(key, &n, sizeof(n));
+      key = LayerCache::hash(key, &n->visible, sizeof(n->visible));
+      key = LayerCache::hash(key, &transforms.world(drawList[j].transform), sizeof(glm::mat4));
+    }
+    layers.draw(b, layersUsed++, key, [&]() {
+      for (auto j = i; j < runEnd; ++j)
+        renderItem(drawList[j], dt, hovered, selected);
+    });
+    i = runEnd;
   }
+  b.end();
   glPopMatrix();
+  layers.end(layersUsed);
 }
 
-auto Node::getAllNodesCalcModelView(Nodes &out) -> void
+auto Node::renderOutline(Node *hovered, Node *selected) -> void
 {
+  if (!visible)
+    return;
+  auto &b = batch.get();
+  b.begin();
   glPushMatrix();
-  // Apply transformations
-  glTranslatef(loc.x + dLoc.x, loc.y + dLoc.y, 0.0f);     // Move the sprite
-  glRotatef(rot + dRot, 0.0f, 0.0f, 1.0f);                // Rotate the sprite
-  glScalef(scale.x + dScale.x, scale.y + dScale.y, 1.0f); // Scale the sprite
-  glTranslatef(-pivot_.x, -pivot_.y, 0.0f);               // Move the pivot point back
-  modelViewMat = getModelViewMatrix();
-
-  out.push_back(*this);
-  for (auto &n : nodes)
-    n->getAllNodesCalcModelView(out);
+  b.modelView(modelViewMat);
+  Node::render(0.f, hovered, selected);
+  b.end();
   glPopMatrix();
 }
 
+auto Node::renderItem(DrawItem &item, float dt, Node *hovered, Node *selected) -> void
+{
+  auto &b = batch.get();
+  auto &n = item.node.get();
+  b.modelView(transforms.world(item.transform));
+  const auto &ctx = frameCtx.get();
+  if (!ctx.profile)
+  {
+    if (n.visible)
+      n.render(dt, hovered, selected);
+    return;
+  }
+  if (!n.visible)
+  {
+    n.profile_.addCpu({});
+    return;
+  }
+  // quads are only submitted on flush, so GPU time can only be attributed with a flush per node
+  const auto gpu = ctx.profileGpu && n.profile_.beginGpu();
+  const auto start = std::chrono::steady_clock::now();
+  n.render(dt, hovered, selected);
+  n.profile_.addCpu(std::chrono::steady_clock::now() - start);
+  if (ctx.profileGpu)
+    b.flush();
+  if (gpu)
+    n.profile_.endGpu();
+}
+
+auto Node::collectDrawList(std::vector<DrawItem> &out, TransformStore &store, TransformStore::Handle parent)
+  -> void
+{
+  const auto handle = store.add(parent);
+  out.push_back(DrawItem{*this, zOrder, handle});
+  for (auto &n : nodes)
+    n->collectDrawList(out, store, handle);
+}
+
+auto Node::invalidateDrawList() -> void
+{
+  auto top = this;
+  while (top->parent_)
+    top = top->parent_;
+  top->drawListDirty = true;
+  top->hitGrid.invalidate();
+}
+
+auto Node::updateHitGrid() -> void
+{
+  const auto &ctx = frameCtx.get();
+  hitGrid.clear(ctx.viewport);
+  for (auto i = 0; i < static_cast<int>(drawList.size()); ++i)
+  {
+    auto &item = drawList[i];
+    auto &n = item.node.get();
+    const auto mvp = ctx.projMat * transforms.world(item.transform);
+    item.hitMin = glm::vec2{std::numeric_limits<float>::max()};
+    item.hitMax = glm::vec2{-std::numeric_limits<float>::max()};
+    const glm::vec2 corners[] = {{0.f, 0.f}, {n.w(), 0.f}, {n.w(), n.h()}, {0.f, n.h()}};
+    for (const auto corner : corners)
+    {
+      const auto clip = mvp * glm::vec4{corner, 0.f, 1.f};
+      // mouse coordinates: origin at the top-left, Y pointing down
+      const auto screen = glm::vec2{(clip.x * .5f + .5f) * ctx.viewport.x, (.5f - clip.y * .5f) * ctx.viewport.y};
+      item.hitMin = glm::min(item.hitMin, screen);
+      item.hitMax = glm::max(item.hitMax, screen);
+    }
+    hitGrid.insert(i, item.hitMin, item.hitMax);
+  }
+}
+
 auto Node::renderUi() -> void
 {
   ImGui::TableNextColumn();
@@ -166,7 +313,8 @@ auto Node::renderUi() -> void
                            std::numeric_limits<float>::max(),
                            "%.2f"))
       {
-        undo.get().record(
+        undo.get().recordEdit(
+          &scale,
           [avgScale, alive = weak_self()]() {
             if (auto self = alive.lock())
             {
@@ -248,7 +396,7 @@ auto Node::renderUi() -> void
                 std::numeric_limits<float>::max(),
                 "%.1f");
   const auto sz = 2 * ImGui::GetFontSize();
-  if (Ui::btnImg("nw", *arrowNW, sz, sz))
+  if (icons.get().button("nw", EditorIcons::Icon::arrowNW, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{0, h()}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -271,7 +419,7 @@ auto Node::renderUi() -> void
         }
       });
   ImGui::SameLine();
-  if (Ui::btnImg("n", *arrowN, sz, sz))
+  if (icons.get().button("n", EditorIcons::Icon::arrowN, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{w() / 2, h()}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -294,7 +442,7 @@ auto Node::renderUi() -> void
         }
       });
   ImGui::SameLine();
-  if (Ui::btnImg("ne", *arrowNE, sz, sz))
+  if (icons.get().button("ne", EditorIcons::Icon::arrowNE, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{w(), h()}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -316,7 +464,7 @@ auto Node::renderUi() -> void
           SPDLOG_INFO("this was destroyed");
         }
       });
-  if (Ui::btnImg("w", *arrowW, sz, sz))
+  if (icons.get().button("w", EditorIcons::Icon::arrowW, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{0, h() / 2}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -339,7 +487,7 @@ auto Node::renderUi() -> void
         }
       });
   ImGui::SameLine();
-  if (Ui::btnImg("c", *center, sz, sz))
+  if (icons.get().button("c", EditorIcons::Icon::center, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{w() / 2, h() / 2}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -362,7 +510,7 @@ auto Node::renderUi() -> void
         }
       });
   ImGui::SameLine();
-  if (Ui::btnImg("e", *arrowE, sz, sz))
+  if (icons.get().button("e", EditorIcons::Icon::arrowE, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{w(), h() / 2}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -384,7 +532,7 @@ auto Node::renderUi() -> void
           SPDLOG_INFO("this was destroyed");
         }
       });
-  if (Ui::btnImg("sw", *arrowSW, sz, sz))
+  if (icons.get().button("sw", EditorIcons::Icon::arrowSW, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{0, 0}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -407,7 +555,7 @@ auto Node::renderUi() -> void
         }
       });
   ImGui::SameLine();
-  if (Ui::btnImg("s", *arrowS, sz, sz))
+  if (icons.get().button("s", EditorIcons::Icon::arrowS, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{w() / 2, 0}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -430,7 +578,7 @@ auto Node::renderUi() -> void
         }
       });
   ImGui::SameLine();
-  if (Ui::btnImg("se", *arrowSE, sz, sz))
+  if (icons.get().button("se", EditorIcons::Icon::arrowSE, sz, sz))
     undo.get().record(
       [newPivot = glm::vec2{w() / 2, 0}, alive = weak_self()]() {
         if (auto self = alive.lock())
@@ -514,33 +662,60 @@ auto Node::localToScreen(const glm::mat4 &projMat, glm::vec2 local) const -> glm
 
 auto Node::nodeUnder(const glm::mat4 &projMat, glm::vec2 v) -> Node *
 {
-  Nodes underNodes;
+  if (!drawListDirty && hitGrid.isValid())
+  {
+    // the draw list is in paint order, so the first hit walking it backwards is the topmost node
+    const auto &candidates = hitGrid.query(v);
+    for (auto it = candidates.rbegin(); it != candidates.rend(); ++it)
+    {
+      auto &item = drawList[*it];
+      if (v.x < item.hitMin.x || v.x > item.hitMax.x || v.y < item.hitMin.y || v.y > item.hitMax.y)
+        continue;
+      if (item.node.get().isUnder(projMat, v))
+        return &item.node.get();
+    }
+    return nullptr;
+  }
+
+  auto underNodes = arena.get().vector<std::reference_wrapper<Node>>();
   collectUnderNodes(projMat, v, underNodes);
 
-  std::stable_sort(underNodes.begin(), underNodes.end(), [](const auto a, const auto b) {
-    return a.get().zOrder > b.get().zOrder;
+  // the first of the highest zOrder, a scan rather than a sort, which would allocate
+  const auto top = std::max_element(underNodes.begin(), underNodes.end(), [](const auto a, const auto b) {
+    return a.get().zOrder < b.get().zOrder;
   });
-
-  if (!underNodes.empty())
-    return &underNodes.front().get();
+  if (top != underNodes.end())
+    return &top->get();
   return nullptr;
 }
 
-auto Node::collectUnderNodes(const glm::mat4 &projMat, glm::vec2 v, Nodes &underNodes) -> void
+auto Node::collectUnderNodes(const glm::mat4 &projMat,
+                             glm::vec2 v,
+                             FrameArena::Vector<std::reference_wrapper<Node>> &underNodes) -> void
 {
   for (auto it = nodes.rbegin(); it != nodes.rend(); ++it)
     (*it)->collectUnderNodes(projMat, v, underNodes);
 
-  auto localPos = screenToLocal(projMat, v);
-  if (!(localPos.x < 0.f || localPos.x > w() || localPos.y < 0.f || localPos.y > h() ||
-        isTransparent(localPos) || !visible))
+  if (isUnder(projMat, v))
     underNodes.push_back(*this);
 }
 
+auto Node::isUnder(const glm::mat4 &projMat, glm::vec2 v) -> bool
+{
+  if (!visible)
+    return false;
+  auto localPos = screenToLocal(projMat, v);
+  return !(localPos.x < 0.f || localPos.x > w() || localPos.y < 0.f || localPos.y > h() ||
+           isTransparent(localPos));
+}
+
+auto Node::animate(float /*dt*/) -> void {}
+
 auto Node::render(float /*dt*/, Node *hovered, Node *selected) -> void
 {
   if (selected != this && hovered != this)
     return;
+  batch.get().immediate();
   if (selected == this && hovered == this)
     glColor4f(1.f, .9f, .2f, 1.f);
   else if (selected == this)
@@ -569,6 +744,7 @@ auto Node::addChild(std::shared_ptr<Node> v) -> void
 {
   v->parent_ = this;
   nodes.emplace_back(std::move(v));
+  invalidateDrawList();
 }
 
 auto Node::getNodes() const -> const PNodes &
@@ -590,6 +766,7 @@ auto Node::moveUp() -> void
         assert(it != std::end(self->parent()->nodes));
         auto prev = it - 1;
         std::swap(*it, *prev);
+        self->invalidateDrawList();
       }
       else
       {
@@ -603,6 +780,7 @@ auto Node::moveUp() -> void
         assert(it != std::end(self->parent()->nodes));
         auto prev = it + 1;
         std::swap(*it, *prev);
+        self->invalidateDrawList();
       }
       else
       {
@@ -627,6 +805,7 @@ auto Node::moveDown() -> void
         assert(it != std::end(self->parent()->nodes));
         auto prev = it + 1;
         std::swap(*it, *prev);
+        self->invalidateDrawList();
       }
       else
 
@@ -641,6 +820,7 @@ auto Node::moveDown() -> void
         assert(it != std::end(self->parent()->nodes));
         auto prev = it - 1;
         std::swap(*it, *prev);
+        self->invalidateDrawList();
       }
       else
 
@@ -672,6 +852,7 @@ auto Node::unparent() -> void
         newParent->nodes.emplace_back(std::move(other));
         oldParent->nodes.erase(it);
         self->parent_ = newParent;
+        self->invalidateDrawList();
       }
       {
         SPDLOG_INFO("this was destroyed");
@@ -686,6 +867,7 @@ auto Node::unparent() -> void
         newParent->nodes.erase(it2);
         oldParent->nodes.emplace(it, std::move(other));
         self->parent_ = oldParent;
+        self->invalidateDrawList();
       }
       else
       {
@@ -721,6 +903,7 @@ auto Node::parentWithBellow() -> void
         newParent->nodes.emplace_back(std::move(other));
         self->parent_->nodes.erase(it);
         self->parent_ = newParent;
+        self->invalidateDrawList();
       }
       else
       {
@@ -736,6 +919,7 @@ auto Node::parentWithBellow() -> void
         newParent->nodes.erase(it2);
         oldParent->nodes.emplace(it, std::move(other));
         self->parent_ = oldParent;
+        self->invalidateDrawList();
       }
       else
       {
@@ -752,30 +936,39 @@ auto Node::del(Node **ppNode) -> void
   if (!pNode->parent_)
     return;
   auto &undo = pNode->undo.get();
-  auto &parentNodes = pNode->parent_->nodes;
+  auto parent = pNode->parent_;
+  auto &parentNodes = parent->nodes;
   auto it = std::find_if(
     parentNodes.begin(), parentNodes.end(), [&pNode](const auto &v) { return pNode == v.get(); });
   assert(it != parentNodes.end());
+  // the rollback keeps the subtree alive for as long as the entry stays in the history
+  const auto heldBytes = pNode->footprint();
   undo.record(
-    [&parentNodes, it, ppNode]() {
+    [parent, &parentNodes, it, ppNode]() {
       parentNodes.erase(it);
       *ppNode = nullptr;
+      parent->invalidateDrawList();
     },
-    [&parentNodes, it, ppNode, spNode = std::move(*it)]() mutable {
+    [parent, &parentNodes, it, ppNode, spNode = std::move(*it)]() mutable {
       *ppNode = spNode.get();
       parentNodes.emplace(it, std::move(spNode));
-    });
+      parent->invalidateDrawList();
+    },
+    "",
+    heldBytes);
 }
 
 auto Node::delNoUndo(Node &node) -> void
 {
   if (!node.parent_)
     return;
-  auto &parentNodes = node.parent_->nodes;
+  auto parent = node.parent_;
+  auto &parentNodes = parent->nodes;
   auto it = std::find_if(
     parentNodes.begin(), parentNodes.end(), [&node](const auto &v) { return &node == v.get(); });
   assert(it != parentNodes.end());
   parentNodes.erase(it);
+  parent->invalidateDrawList();
 }
 
 auto Node::translateCancel() -> void
@@ -878,6 +1071,20 @@ auto Node::loadAll(const class SaveFactory &saveFactory, IStrm &strm) -> void
   }
 }
 
+auto Node::saveOwn(OStrm &strm) const -> void
+{
+  save(strm);
+}
+
+auto Node::loadOwn(IStrm &strm) -> void
+{
+  std::string className;
+  std::string n;
+  ::deser(strm, className);
+  ::deser(strm, n);
+  load(strm);
+}
+
 auto Node::save(OStrm &strm) const -> void
 {
   ::ser(strm, *this);
@@ -888,11 +1095,39 @@ auto Node::load(IStrm &strm) -> void
   ::deser(strm, *this);
 }
 
+auto Node::loadAttrs(const std::map<std::string, std::string> &) -> void {}
+
+auto Node::saveAttrs(std::map<std::string, std::string> &) const -> void {}
+
 auto Node::isTransparent(glm::vec2) const -> bool
 {
   return false;
 }
 
+auto Node::isStatic() const -> bool
+{
+  return false;
+}
+
+auto Node::heldBytes(Counted &) const -> size_t
+{
+  return sizeof(Node);
+}
+
+auto Node::footprint() const -> size_t
+{
+  auto counted = Counted{};
+  return footprint(counted);
+}
+
+auto Node::footprint(Counted &counted) const -> size_t
+{
+  auto ret = heldBytes(counted);
+  for (const auto &n : nodes)
+    ret += n->footprint(counted);
+  return ret;
+}
+
 auto Node::h() const -> float
 {
   return 1.f;
@@ -912,9 +1147,19 @@ auto Node::clone() const -> std::shared_ptr<Node>
 {
   auto n = this->do_clone();
   assert(typeid(*this) == typeid(*n));
+  // the copy gets clones of the children instead of sharing them; the settings the nodes keep in
+  // a Cow are shared until either side edits them
+  n->nodes.reserve(nodes.size());
+  for (const auto &child : nodes)
+    n->addChild(child->clone());
   return n;
 }
 
+auto Node::profile() const -> const NodeProfile &
+{
+  return profile_;
+}
+
 auto Node::parent() -> Node *
 {
   return parent_;
@@ -1059,6 +1304,7 @@ auto Node::parentWith(Node &newParent) -> void
         newParent.nodes.emplace_back(std::move(other));
         self->parent_->nodes.erase(it);
         self->parent_ = &newParent;
+        self->invalidateDrawList();
       }
       else
       {
@@ -1074,6 +1320,7 @@ auto Node::parentWith(Node &newParent) -> void
         newParent.nodes.erase(it2);
         oldParent->nodes.emplace(it, std::move(other));
         self->parent_ = oldParent;
+        self->invalidateDrawList();
       }
       else
       {
@@ -1101,6 +1348,7 @@ auto Node::placeBellow(Node &newSibling) -> void
         assert(newSiblingIt != std::end(newSibling.parent()->nodes));
         ++newSiblingIt;
         newSibling.parent()->nodes.insert(newSiblingIt, std::move(other));
+        newSibling.invalidateDrawList();
       }
       else
       {
@@ -1116,6 +1364,7 @@ auto Node::placeBellow(Node &newSibling) -> void
         self->parent()->nodes.erase(selfIt);
         oldParent->nodes = nodes;
         self->parent_ = oldParent;
+        self->invalidateDrawList();
       }
       else
 
@@ -1,13 +1,21 @@
 #pragma once
+#include "cow.hpp"
+#include "frame-arena.hpp"
+#include "hit-grid.hpp"
+#include "layer-cache.hpp"
 #include "lib.hpp"
+#include "node-profile.hpp"
+#include "transform-store.hpp"
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/vec2.hpp>
 #include <imgui.h>
+#include <map>
 #include <memory>
 #include <ser/istrm.hpp>
 #include <ser/macro.hpp>
 #include <ser/ostrm.hpp>
 #include <string>
+#include <unordered_set>
 #include <vector>
 
 namespace Internal
@@ -18,9 +26,29 @@ namespace Internal
   auto deserVal(IStrm &strm, ImVec4 &value) noexcept -> void;
   auto serVal(OStrm &strm, const glm::ivec2 &value) noexcept -> void;
   auto deserVal(IStrm &strm, glm::ivec2 &value) noexcept -> void;
+  // a shared value is saved as the value itself
+  template <typename T>
+  auto serVal(OStrm &strm, const Cow<T> &value) -> void;
+  template <typename T>
+  auto deserVal(IStrm &strm, Cow<T> &value) -> void;
 } // namespace Internal
 #include <ser/ser.hpp>
 
+namespace Internal
+{
+  template <typename T>
+  auto serVal(OStrm &strm, const Cow<T> &value) -> void
+  {
+    ::ser(strm, *value);
+  }
+
+  template <typename T>
+  auto deserVal(IStrm &strm, Cow<T> &value) -> void
+  {
+    ::deser(strm, value.edit());
+  }
+} // namespace Internal
+
 class Node : public virtual enable_shared_from_this
 {
 public:
@@ -36,6 +64,8 @@ public:
 
   using PNodes = std::vector<std::shared_ptr<Node>>;
   using Nodes = std::vector<std::reference_wrapper<Node>>;
+  // the values clones share that footprint() has counted already, so they count once
+  using Counted = std::unordered_set<const void *>;
   enum class EditMode {
     select,
     translate,
@@ -44,13 +74,20 @@ public:
   };
 
   Node(Lib &, class Undo &, std::string name);
+  // a copy outside of any tree: the settings of the original, no children, and caches of its own
+  // instead of the original's draw list and hit grid
+  Node(const Node &);
   auto addChild(std::shared_ptr<Node>) -> void;
   auto cancel() -> void;
   auto commit() -> void;
   auto editMode() const -> EditMode;
+  // rough memory the subtree keeps alive, textures only when nothing else uses them
+  auto footprint() const -> size_t;
   auto getName() const -> std::string;
   auto getNodes() const -> const PNodes &;
   auto loadAll(const class SaveFactory &, IStrm &) -> void;
+  // a record of saveOwn() read past its class name and name
+  auto loadOwn(IStrm &) -> void;
   auto localToScreen(const glm::mat4 &projMat, glm::vec2 local) const -> glm::vec2;
   auto moveDown() -> void;
   auto moveUp() -> void;
@@ -59,10 +96,19 @@ public:
   auto parentWith(Node &) -> void;
   auto parentWithBellow() -> void;
   auto pivot() const -> glm::vec2;
+  auto profile() const -> const NodeProfile &;
   auto placeBellow(Node &) -> void;
   auto renderAll(float dt, Node *hovered, Node *selected) -> void;
+  // the edit outline alone, at the transform of the last renderAll()
+  auto renderOutline(Node *hovered, Node *selected) -> void;
   auto rotStart(glm::vec2 mouse) -> void;
   auto saveAll(OStrm &) const -> void;
+  // what saveAll() writes ahead of the children: the class name, the name and the properties
+  auto saveOwn(OStrm &) const -> void;
+  // settings kept by name next to the properties, for what a node gains after projects were saved
+  // with its properties; only the ProjectFormat files have them
+  virtual auto loadAttrs(const std::map<std::string, std::string> &) -> void;
+  virtual auto saveAttrs(std::map<std::string, std::string> &) const -> void;
   auto scaleStart(glm::vec2 mouse) -> void;
   auto translateStart(glm::vec2 mouse) -> void;
   auto unparent() -> void;
@@ -80,16 +126,39 @@ public:
 
 protected:
   auto screenToLocal(const glm::mat4 &projMat, glm::vec2) const -> glm::vec2;
+  // true when render() draws the same pixels for the same transform and has no side effects, so
+  // the node can be drawn from a cached layer instead
+  virtual auto isStatic() const -> bool;
+  // the node's own share of footprint()
+  virtual auto heldBytes(Counted &) const -> size_t;
   virtual auto load(IStrm &) -> void;
+  // advances the per-frame state before anything is drawn: no GL, and nothing shared but the
+  // scheduler, as the nodes of a large scene animate on the job system workers
+  virtual auto animate(float dt) -> void;
   virtual auto render(float dt, Node *hovered, Node *selected) -> void;
   virtual auto save(OStrm &) const -> void;
 
   std::string name;
 
 private:
+  struct DrawItem
+  {
+    std::reference_wrapper<Node> node;
+    int zOrder;
+    TransformStore::Handle transform;
+    glm::vec2 hitMin = {0.f, 0.f};
+    glm::vec2 hitMax = {0.f, 0.f};
+  };
+
   virtual auto do_clone() const -> std::shared_ptr<Node>;
-  auto collectUnderNodes(const glm::mat4 &projMat, glm::vec2 v, Nodes &) -> void;
-  auto getAllNodesCalcModelView(Nodes &) -> void;
+  auto footprint(Counted &) const -> size_t;
+  auto collectUnderNodes(const glm::mat4 &projMat, glm::vec2 v, FrameArena::Vector<std::reference_wrapper<Node>> &)
+    -> void;
+  auto collectDrawList(std::vector<DrawItem> &, TransformStore &, TransformStore::Handle parent) -> void;
+  auto invalidateDrawList() -> void;
+  auto renderItem(DrawItem &, float dt, Node *hovered, Node *selected) -> void;
+  auto isUnder(const glm::mat4 &projMat, glm::vec2) -> bool;
+  auto updateHitGrid() -> void;
   auto rotCancel() -> void;
   auto rotUpdate(const glm::mat4 &projMat, glm::vec2 mouse) -> void;
   auto scaleCancel() -> void;
@@ -109,13 +178,32 @@ protected:
   glm::vec2 dLoc = {.0f, .0f};
   glm::vec2 dScale = {0.f, 0.f};
   std::reference_wrapper<class Undo> undo;
+  std::reference_wrapper<SpriteBatch> batch;
+  std::reference_wrapper<const FrameCtx> frameCtx;
+  std::reference_wrapper<RenderScheduler> scheduler;
+  // the atlas is only loaded once an editor button is drawn
+  std::reference_wrapper<EditorIcons> icons;
   int zOrder = 0;
 
+private:
+  // the nodes animate in chunks of this many, smaller scenes stay on the main thread
+  static constexpr auto AnimateGrain = size_t{64};
+  std::reference_wrapper<JobSystem> jobs;
+  // for the picking fallback while the draw list is stale
+  std::reference_wrapper<FrameArena> arena;
+
 private:
   PNodes nodes;
+  // flattened zOrder-sorted subtree, only built on the node renderAll is called on
+  std::vector<DrawItem> drawList;
+  TransformStore transforms;
+  LayerCache layers;
+  bool drawListDirty = true;
+  HitGrid hitGrid;
+  NodeProfile profile_;
 
 protected:
-  glm::mat4 modelViewMat;
+  glm::mat4 modelViewMat = glm::mat4{1.f};
 
 private:
   Node *parent_ = nullptr;
@@ -124,13 +212,4 @@ private:
   glm::vec2 initScale;
   float initRot;
   EditMode editMode_ = EditMode::select;
-  std::shared_ptr<const Texture> arrowN;
-  std::shared_ptr<const Texture> arrowNE;
-  std::shared_ptr<const Texture> arrowE;
-  std::shared_ptr<const Texture> arrowSE;
-  std::shared_ptr<const Texture> arrowS;
-  std::shared_ptr<const Texture> arrowSW;
-  std::shared_ptr<const Texture> arrowW;
-  std::shared_ptr<const Texture> arrowNW;
-  std::shared_ptr<const Texture> center;
 };
@@ -0,0 +1,107 @@
+#include "ogg-opus-decoder.hpp"
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace
+{
+  // "OggS", version, header type, granule position, serial, sequence, CRC and segment count
+  constexpr auto PageHeaderSize = size_t{27};
+  // 120 ms at 48 kHz, the longest Opus packet
+  constexpr auto MaxFrameSamples = 5760;
+
+  auto byte(std::string_view v, size_t i) -> size_t
+  {
+    return static_cast<unsigned char>(v[i]);
+  }
+} // namespace
+
+void OggOpusDecoder::DecoderDeleter::operator()(OpusDecoder *ptr) const noexcept
+{
+  opus_decoder_destroy(ptr);
+}
+
+OggOpusDecoder::OggOpusDecoder(int aRate) : rate(aRate) {}
+
+auto OggOpusDecoder::push(std::string_view data, Wav &out) -> void
+{
+  pending += data;
+  auto pos = size_t{0};
+  while (pending.size() - pos >= PageHeaderSize)
+  {
+    const auto page = std::string_view{pending}.substr(pos);
+    if (!page.starts_with("OggS"))
+      throw std::runtime_error("Expected an Ogg page in the TTS stream");
+    const auto segments = byte(page, 26);
+    if (page.size() < PageHeaderSize + segments)
+      break;
+    auto bodySize = size_t{0};
+    for (auto i = size_t{0}; i < segments; ++i)
+      bodySize += byte(page, PageHeaderSize + i);
+    if (page.size() < PageHeaderSize + segments + bodySize)
+      break;
+    auto body = PageHeaderSize + segments;
+    for (auto i = size_t{0}; i < segments; ++i)
+    {
+      const auto lacing = byte(page, PageHeaderSize + i);
+      packet.append(page.substr(body, lacing));
+      body += lacing;
+      // a lacing value of 255 continues the packet, possibly on the next page
+      if (lacing < 255)
+      {
+        onPacket(packet, out);
+        packet.clear();
+      }
+    }
+    pos += PageHeaderSize + segments + bodySize;
+  }
+  pending.erase(0, pos);
+}
+
+auto OggOpusDecoder::onPacket(std::string_view data, Wav &out) -> void
+{
+  switch (packets++)
+  {
+  case 0: {
+    if (!data.starts_with("OpusHead") || data.size() < 19)
+      throw std::runtime_error("Expected an Opus header in the TTS stream");
+    channels = static_cast<int>(byte(data, 9));
+    if (channels < 1 || channels > 2)
+      throw std::runtime_error(fmt::format("Unsupported Opus channel count {}", channels));
+    // the pre-skip is counted at 48 kHz whatever the decode rate
+    skip = (byte(data, 10) | byte(data, 11) << 8) * static_cast<size_t>(rate) / 48000;
+    auto err = OPUS_OK;
+    decoder.reset(opus_decoder_create(rate, channels, &err));
+    if (err != OPUS_OK)
+      throw std::runtime_error(fmt::format("Cannot create the Opus decoder: {}", opus_strerror(err)));
+    frame.resize(static_cast<size_t>(MaxFrameSamples * channels));
+    break;
+  }
+  case 1:
+    // OpusTags
+    break;
+  default: decode(data, out); break;
+  }
+}
+
+auto OggOpusDecoder::decode(std::string_view data, Wav &out) -> void
+{
+  const auto n = opus_decode(decoder.get(),
+                             reinterpret_cast<const unsigned char *>(data.data()),
+                             static_cast<opus_int32>(data.size()),
+                             frame.data(),
+                             MaxFrameSamples,
+                             0);
+  if (n < 0)
+    throw std::runtime_error(fmt::format("Cannot decode Opus: {}", opus_strerror(n)));
+  for (auto i = 0; i < n; ++i)
+  {
+    if (skip > 0)
+    {
+      --skip;
+      continue;
+    }
+    const auto s = channels == 1 ? frame[static_cast<size_t>(i)]
+                                 : static_cast<int16_t>((frame[static_cast<size_t>(2 * i)] + frame[static_cast<size_t>(2 * i + 1)]) / 2);
+    out.push_back(s);
+  }
+}
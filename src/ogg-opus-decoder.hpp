@@ -0,0 +1,37 @@
+#pragma once
+#include "wav.hpp"
+#include <memory>
+#include <opus.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Decodes an Ogg Opus stream while it downloads. Only the Ogg framing is parsed here, the packets
+// go to libopus; pages may be split across push() calls at any byte. Stereo streams are
+// mixed down to mono and the encoder pre-skip is dropped.
+class OggOpusDecoder
+{
+public:
+  // rate is one of the rates libopus decodes to: 8, 12, 16, 24 or 48 kHz
+  OggOpusDecoder(int rate);
+  // appends the decoded samples, throws on a stream that is not Ogg Opus
+  auto push(std::string_view, Wav &out) -> void;
+
+private:
+  struct DecoderDeleter
+  {
+    void operator()(OpusDecoder *ptr) const noexcept;
+  };
+
+  int rate;
+  int channels = 0;
+  size_t skip = 0;
+  int packets = 0;
+  std::string pending;
+  std::string packet;
+  std::unique_ptr<OpusDecoder, DecoderDeleter> decoder;
+  std::vector<int16_t> frame;
+
+  auto onPacket(std::string_view, Wav &out) -> void;
+  auto decode(std::string_view, Wav &out) -> void;
+};
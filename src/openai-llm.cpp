@@ -0,0 +1,198 @@
+#include "openai-llm.hpp"
+#include "http-client.hpp"
+#include "json-fields.hpp"
+#include "sse-parser.hpp"
+#include <memory>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+  auto esc(std::string_view str) -> std::string
+  {
+    auto ret = std::string{};
+    for (auto c : str)
+      switch (c)
+      {
+      case '"': ret += "\\\""; break;
+      case '\\': ret += "\\\\"; break;
+      case '\n': ret += "\\n"; break;
+      case '\r': ret += "\\r"; break;
+      case '\t': ret += "\\t"; break;
+      default: ret += c; break;
+      }
+    return ret;
+  }
+
+  // the text of the first choice, in a streamed event or in the whole response
+  auto text(OpenAiLlm::Api api, bool stream) -> const JsonFields &
+  {
+    // completions: {"choices": [{"text": " Is", "index": 0, "logprobs": null, "finish_reason": null}], ...}
+    static const auto completions = JsonFields{"choices.[]", {"text"}};
+    // chat: {"choices": [{"index": 0, "delta": {"content": " Is"}, "finish_reason": null}], ...}
+    static const auto delta = JsonFields{"choices.[].delta", {"content"}};
+    static const auto message = JsonFields{"choices.[].message", {"content"}};
+    if (api == OpenAiLlm::Api::completions)
+      return completions;
+    return stream ? delta : message;
+  }
+
+  auto isLocalhost(std::string_view url) -> bool
+  {
+    for (auto scheme : {"http://", "https://"})
+      if (url.starts_with(scheme))
+      {
+        url.remove_prefix(std::string_view{scheme}.size());
+        return url.starts_with("localhost") || url.starts_with("127.0.0.1") || url.starts_with("[::1]");
+      }
+    return false;
+  }
+} // namespace
+
+OpenAiLlm::OpenAiLlm(HttpClient &aHttpClient, Config aConfig) : httpClient(aHttpClient), config(std::move(aConfig)) {}
+
+auto OpenAiLlm::api(std::string_view v) -> Api
+{
+  return v == name(Api::chat) ? Api::chat : Api::completions;
+}
+
+auto OpenAiLlm::name(Api v) -> std::string_view
+{
+  switch (v)
+  {
+  case Api::completions: return "completions";
+  case Api::chat: return "chat";
+  }
+  return "completions";
+}
+
+auto OpenAiLlm::isOpenAi(std::string_view url) -> bool
+{
+  constexpr auto host = std::string_view{"https://api.openai.com"};
+  return url.starts_with(host) && (url.size() == host.size() || url[host.size()] == '/' || url[host.size()] == ':');
+}
+
+auto OpenAiLlm::configure(Config v) -> void
+{
+  config = std::move(v);
+}
+
+auto OpenAiLlm::isUsable() const -> bool
+{
+  return !config.url.empty() && (!config.token.empty() || isLocalhost(config.url));
+}
+
+auto OpenAiLlm::picksSpeaker() const -> bool
+{
+  return config.api == Api::completions;
+}
+
+auto OpenAiLlm::completionsBody(const Request &r) const -> std::string
+{
+  auto ret = std::string{};
+  ret.reserve(r.systemPrompt.size() + r.history.size() + 256);
+  ret += R"({"model": ")";
+  ret += esc(config.model);
+  ret += R"(", "prompt": ")";
+  ret += r.systemPrompt;
+  ret += r.history;
+  if (r.embedName)
+  {
+    ret += R"(\n| )";
+    ret += r.cohost;
+    ret += ":";
+  }
+  else
+    ret += R"(\n|)";
+  ret += fmt::format(
+    R"(", "temperature": 1, "max_tokens": {}, "top_p": 1.0, "frequency_penalty": 0.5, "presence_penalty": 0.6, "stop": ["\n| "])",
+    MaxTokens);
+  return ret;
+}
+
+auto OpenAiLlm::chatBody(const Request &r) const -> std::string
+{
+  auto ret = std::string{};
+  ret.reserve(r.systemPrompt.size() + r.history.size() + 512);
+  ret += R"({"model": ")";
+  ret += esc(config.model);
+  // the chat reads like the transcript the completions continue, the model answers as the cohost
+  ret += R"(", "messages": [{"role": "system", "content": ")";
+  ret += r.systemPrompt;
+  ret += R"(\n\nYou are )";
+  ret += r.cohost;
+  ret += R"(. Reply to the last message of the chat as )";
+  ret += r.cohost;
+  ret += R"( in one or two short sentences, without a name in front."}, {"role": "user", "content": ")";
+  ret += r.history;
+  ret += fmt::format(R"("}}], "temperature": 1, "max_tokens": {}, "stop": ["\n| "])", MaxTokens);
+  return ret;
+}
+
+auto OpenAiLlm::complete(const Request &r, TextCallback onText, DoneCallback done) -> void
+{
+  auto body = config.api == Api::chat ? chatBody(r) : completionsBody(r);
+  if (r.stream)
+    body += R"(, "stream": true)";
+  body += "}";
+
+  const auto api = config.api;
+  // the streamed pieces are collected for the result as well
+  auto streamed = std::make_shared<std::string>();
+  auto onChunk = HttpClient::ChunkCallback{};
+  if (r.stream)
+    onChunk = [sse = SseParser{[api, streamed, onText = std::move(onText), event = std::string{}](
+                                 std::string_view data) mutable {
+                 if (data == "[DONE]")
+                   return;
+                 // parsed in place, the buffer is reused for every event
+                 event.assign(data);
+                 text(api, true).parse(event, [&](auto values) {
+                   *streamed += values[0];
+                   onText(values[0]);
+                   return false;
+                 });
+               }}](std::string_view chunk) mutable { sse.push(chunk); };
+
+  auto onDone = [api, stream = r.stream, streamed, jsonPrompt = body, done = std::move(done)](
+                  CURLcode code, long httpStatus, std::string payload) mutable {
+    if (code != CURLE_OK)
+    {
+      SPDLOG_INFO("{}", curl_easy_strerror(code));
+      done(Result{.error = curl_easy_strerror(code)});
+      return;
+    }
+    if (httpStatus != 200)
+    {
+      SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
+      SPDLOG_INFO("{}", jsonPrompt);
+      // an error body can be empty, the status alone still has to read as an error
+      done(Result{.error = fmt::format("HTTP Status: {} {}", httpStatus, payload),
+                  .isTransient = httpStatus < 400 || httpStatus >= 500});
+      return;
+    }
+    if (stream)
+    {
+      done(Result{.text = std::move(*streamed)});
+      return;
+    }
+    auto ret = Result{};
+    auto found = false;
+    text(api, false).parse(payload, [&](auto values) {
+      ret.text = values[0];
+      found = true;
+      return false;
+    });
+    if (!found)
+    {
+      SPDLOG_INFO("{} {} no choices", curl_easy_strerror(code), httpStatus);
+      ret.error = "0 Choices";
+    }
+    done(std::move(ret));
+  };
+
+  auto headers = HttpClient::Headers{{"Content-Type", "application/json"}};
+  if (!config.token.empty())
+    headers.emplace_back("Authorization", "Bearer " + config.token);
+  httpClient.get().stream(
+    config.url, std::move(body), HttpClient::Stream{.onChunk = std::move(onChunk), .onDone = std::move(onDone)}, headers);
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "llm-backend.hpp"
+#include <functional>
+#include <string>
+#include <string_view>
+
+// The OpenAI HTTP APIs, and the inference servers that serve the same ones (llama.cpp, Ollama,
+// vLLM): the completions endpoint continues the transcript, a chat completions endpoint gets the
+// system prompt and the transcript as one user message. A server on localhost needs no token and
+// answers over the connection HttpClient keeps alive, without a TLS or an internet round trip.
+class OpenAiLlm final : public LlmBackend
+{
+public:
+  enum class Api {
+    completions,
+    chat,
+  };
+  struct Config
+  {
+    Api api = Api::completions;
+    std::string url;
+    std::string model;
+    // sent to url as a Bearer token
+    std::string token;
+  };
+
+  OpenAiLlm(class HttpClient &, Config);
+  auto complete(const Request &, TextCallback onText, DoneCallback) -> void final;
+  auto picksSpeaker() const -> bool final;
+  auto configure(Config) -> void;
+  // has a token or needs none, worth keeping a connection open to
+  auto isUsable() const -> bool;
+  auto url() const -> const std::string & { return config.url; }
+
+  // the names preferences keep the APIs under, unknown ones are completions
+  static auto api(std::string_view) -> Api;
+  static auto name(Api) -> std::string_view;
+  // the url is OpenAI's own, the one server the OpenAI token may go to
+  static auto isOpenAi(std::string_view url) -> bool;
+  // a line or two, what the cohost says in one breath
+  static constexpr auto MaxTokens = 24;
+
+private:
+  std::reference_wrapper<HttpClient> httpClient;
+  Config config;
+
+  auto completionsBody(const Request &) const -> std::string;
+  auto chatBody(const Request &) const -> std::string;
+};
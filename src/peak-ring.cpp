@@ -0,0 +1,93 @@
+#include "peak-ring.hpp"
+#include <algorithm>
+
+PeakRing::PeakRing(size_t capacity) : buf(std::max(capacity, BlockSize)) {}
+
+auto PeakRing::at(uint64_t abs) const -> int16_t
+{
+  return buf[(start + (abs - tail)) % buf.size()];
+}
+
+auto PeakRing::maxOf(uint64_t from, uint64_t to) const -> int16_t
+{
+  auto ret = int16_t{INT16_MIN};
+  for (auto i = from; i < to; ++i)
+    ret = std::max(ret, at(i));
+  return ret;
+}
+
+auto PeakRing::push(std::span<const int16_t> wav) -> void
+{
+  if (wav.size() > buf.size())
+    wav = wav.subspan(wav.size() - buf.size());
+  if (size_ + wav.size() > buf.size())
+    dropOldest(size_ + wav.size() - buf.size());
+  for (auto v : wav)
+  {
+    const auto abs = tail + size_;
+    buf[(start + size_) % buf.size()] = v;
+    ++size_;
+    headMax = std::max(headMax, v);
+    if ((abs + 1) % BlockSize != 0)
+      continue;
+    // the block is complete, older blocks that are not larger can never be the peak again
+    while (!maxima.empty() && maxima.back().second <= headMax)
+      maxima.pop_back();
+    maxima.emplace_back(abs / BlockSize, headMax);
+    headMax = INT16_MIN;
+  }
+}
+
+auto PeakRing::keepLast(size_t n) -> void
+{
+  if (size_ > n)
+    dropOldest(size_ - n);
+}
+
+auto PeakRing::dropOldest(size_t n) -> void
+{
+  n = std::min(n, size_);
+  start = (start + n) % buf.size();
+  size_ -= n;
+  tail += n;
+  const auto head = tail + size_;
+  const auto tailBlock = tail / BlockSize;
+  while (!maxima.empty() && maxima.front().first < tailBlock)
+    maxima.pop_front();
+  if (tail % BlockSize == 0)
+    return;
+  if (tailBlock == head / BlockSize)
+  {
+    // the oldest sample is in the block still being filled
+    headMax = maxOf(tail, head);
+    return;
+  }
+  // the oldest block lost some of its samples, its maximum can only go down
+  if (maxima.empty() || maxima.front().first != tailBlock)
+    return;
+  const auto m = maxOf(tail, (tailBlock + 1) * BlockSize);
+  if (maxima.size() > 1 && maxima[1].second >= m)
+    maxima.pop_front();
+  else
+    maxima.front().second = m;
+}
+
+auto PeakRing::peak() const -> int16_t
+{
+  if (size_ == 0)
+    return 0;
+  auto ret = headMax;
+  if (!maxima.empty())
+    ret = std::max(ret, maxima.front().second);
+  return ret;
+}
+
+auto PeakRing::linear() -> std::span<const int16_t>
+{
+  if (start + size_ > buf.size())
+  {
+    std::rotate(std::begin(buf), std::begin(buf) + static_cast<ptrdiff_t>(start), std::end(buf));
+    start = 0;
+  }
+  return std::span<const int16_t>{buf}.subspan(start, size_);
+}
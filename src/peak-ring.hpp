@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <span>
+#include <utility>
+#include <vector>
+
+// Fixed capacity window of the most recent samples with their running maximum. The maximum is
+// kept per block of samples in a monotonic queue, so neither pushing, trimming nor asking for the
+// peak scans the whole window.
+class PeakRing
+{
+public:
+  explicit PeakRing(size_t capacity);
+  // the oldest samples make room when the window is full
+  auto push(std::span<const int16_t>) -> void;
+  // drops everything but the newest n samples
+  auto keepLast(size_t n) -> void;
+  auto size() const -> size_t { return size_; }
+  auto capacity() const -> size_t { return buf.size(); }
+  // largest sample value in the window, 0 when it is empty
+  auto peak() const -> int16_t;
+  // rotates the storage in place so the window is one contiguous run, oldest sample first
+  auto linear() -> std::span<const int16_t>;
+
+  static constexpr auto BlockSize = size_t{256};
+
+private:
+  std::vector<int16_t> buf;
+  // physical index of the oldest sample
+  size_t start = 0;
+  size_t size_ = 0;
+  // absolute index of the oldest sample, blocks are aligned on absolute indices
+  uint64_t tail = 0;
+  // maximum of every complete block that can still be the peak, oldest first and decreasing
+  std::deque<std::pair<uint64_t, int16_t>> maxima;
+  // maximum of the block the newest samples are going into
+  int16_t headMax = INT16_MIN;
+
+  auto at(uint64_t abs) const -> int16_t;
+  auto maxOf(uint64_t from, uint64_t to) const -> int16_t;
+  auto dropOldest(size_t n) -> void;
+};
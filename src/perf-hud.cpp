@@ -0,0 +1,267 @@
+#include "perf-hud.hpp"
+#include "audio-in.hpp"
+#include "http-client.hpp"
+#include "imgui-helpers.hpp"
+#include "lib.hpp"
+#include "preferences.hpp"
+#include "ui.hpp"
+#include "uv.hpp"
+#include "wav-2-visemes.hpp"
+#include <algorithm>
+#include <numeric>
+#include <span>
+#include <utility>
+
+namespace
+{
+  auto percentile(std::span<float> v, float p) -> float
+  {
+    if (v.empty())
+      return 0.f;
+    const auto n = std::min(v.size() - 1, static_cast<size_t>(p * static_cast<float>(v.size())));
+    std::nth_element(std::begin(v), std::begin(v) + static_cast<ptrdiff_t>(n), std::end(v));
+    return v[n];
+  }
+
+  // the percentiles reorder the samples, so they work on a copy that lives until the next frame
+  template <typename Samples>
+  auto frameCopy(FrameArena &arena, const Samples &samples, size_t count) -> FrameArena::Vector<float>
+  {
+    auto ret = arena.vector<float>();
+    ret.assign(std::begin(samples), std::begin(samples) + static_cast<ptrdiff_t>(count));
+    return ret;
+  }
+
+  auto ms(std::chrono::steady_clock::duration d) -> float
+  {
+    return std::chrono::duration<float, std::milli>(d).count();
+  }
+
+  auto mb(size_t bytes) -> float
+  {
+    return static_cast<float>(bytes) / static_cast<float>(1 << 20);
+  }
+
+  // viseme latency at which the mouth visibly trails the voice
+  constexpr auto LateVisemesMs = 250.f;
+  constexpr auto LongTtsQueue = size_t{5};
+
+  const auto Good = ImVec4{.3f, .9f, .3f, 1.f};
+  const auto Bad = ImVec4{1.f, .35f, .35f, 1.f};
+} // namespace
+
+PerfHud::PerfHud(uv::Uv &aUv,
+                 Preferences &aPreferences,
+                 AudioIn &aAudioIn,
+                 Wav2Visemes &aWav2Visemes,
+                 HttpClient &aHttpClient,
+                 Lib &aLib)
+  : uv(aUv),
+    preferences(aPreferences),
+    audioIn(aAudioIn),
+    wav2Visemes(aWav2Visemes),
+    httpClient(aHttpClient),
+    lib(aLib),
+    windowIdle(aUv.idleTime()),
+    windowOverruns(aAudioIn.overruns())
+{
+}
+
+auto PerfHud::frame(Clock::time_point start, Clock::duration render) -> void
+{
+  if (lastStart != Clock::time_point{})
+  {
+    intervalMs[next] = ms(start - lastStart);
+    renderMs[next] = ms(render);
+    next = (next + 1) % History;
+    count = std::min(count + 1, History);
+  }
+  lastStart = start;
+  windowRender += render;
+  if (const auto now = Clock::now(); now - windowStart >= std::chrono::seconds{1})
+    rollWindow(now);
+}
+
+auto PerfHud::waited(Clock::duration d) -> void
+{
+  windowWaited += d;
+}
+
+auto PerfHud::rollWindow(Clock::time_point now) -> void
+{
+  const auto wall = ms(now - windowStart);
+  const auto idle = uv.get().idleTime();
+  const auto idleMs = static_cast<float>(idle - windowIdle) / 1e6f;
+  const auto overruns = audioIn.get().overruns();
+  const auto messages = lib.get().twitchMessages();
+  // per second, whatever the exact length of the window was
+  const auto scale = 1000.f / wall;
+  renderPerSec = ms(windowRender) * scale;
+  idlePerSec = idleMs * scale;
+  callbacksPerSec = std::max(0.f, (wall - idleMs - ms(windowRender) - ms(windowWaited)) * scale);
+  overrunsPerSec = overruns - windowOverruns;
+  // the sum goes down when a channel is left
+  messagesPerSec = messages >= windowMessages ? static_cast<float>(messages - windowMessages) * scale : 0.f;
+
+  windowStart = now;
+  windowIdle = idle;
+  windowRender = {};
+  windowWaited = {};
+  windowOverruns = overruns;
+  windowMessages = messages;
+
+  issues.clear();
+  auto intervals = frameCopy(lib.get().frameArena(), intervalMs, count);
+  auto renders = frameCopy(lib.get().frameArena(), renderMs, count);
+  // on demand rendering has no frame rate to keep, only the cost of a frame matters there
+  const auto fps = preferences.get().fps;
+  const auto budget = 1000.f / static_cast<float>(fps > 0 ? fps : 60);
+  if (fps > 0 && percentile(intervals, .95f) > 1.5f * budget)
+    issues.push_back("Frames are late, lower the FPS or the output size");
+  if (percentile(renders, .95f) > budget)
+    issues.push_back(fmt::format("A frame takes longer than {:.1f} ms to render", budget));
+  if (overrunsPerSec > 0)
+    issues.push_back("The microphone is dropping samples");
+  if (const auto budget = preferences.get().latencyBudgetMs;
+      budget > 0 && wav2Visemes.get().metrics().capture.percentile(.95f) > static_cast<float>(budget))
+    issues.push_back("Capture takes longer than the latency budget, raise it or lower the FPS");
+  if (wav2Visemes.get().isReady() && ms(wav2Visemes.get().latency()) > LateVisemesMs)
+    issues.push_back("The mouth trails the voice");
+  if (auto tts = lib.get().activeTts(); tts && tts->queued() > LongTtsQueue)
+    issues.push_back("Speech is piling up, chat moves faster than it is read");
+}
+
+auto PerfHud::render() -> void
+{
+  auto perfWindow = Ui::Window("Performance");
+  if (issues.empty())
+    ImGui::TextColored(Good, "All good");
+  for (const auto &issue : issues)
+    ImGui::TextColored(Bad, "%s", issue.c_str());
+  ImGui::Separator();
+
+  auto intervals = frameCopy(lib.get().frameArena(), intervalMs, count);
+  const auto mean = intervals.empty() ? 0.f
+                                      : std::accumulate(std::begin(intervals), std::end(intervals), 0.f) /
+                                          static_cast<float>(intervals.size());
+  const auto worst = intervals.empty() ? 0.f : *std::max_element(std::begin(intervals), std::end(intervals));
+  ImGui::TextF("{:.1f} FPS, frame ms p50 {:.2f} p95 {:.2f} p99 {:.2f} max {:.2f}",
+               mean > 0.f ? 1000.f / mean : 0.f,
+               percentile(intervals, .5f),
+               percentile(intervals, .95f),
+               percentile(intervals, .99f),
+               worst);
+  // oldest on the left
+  const auto offset = count == History ? static_cast<int>(next) : 0;
+  ImGui::PlotLines("##frame ms",
+                   intervalMs.data(),
+                   static_cast<int>(count),
+                   offset,
+                   "frame ms",
+                   0.f,
+                   std::max(worst, 1000.f / 30.f),
+                   ImVec2{-1.f, 60.f});
+  ImGui::TextF("main loop per second: render {:.0f} ms, other callbacks {:.0f} ms, idle {:.0f} ms",
+               renderPerSec,
+               callbacksPerSec,
+               idlePerSec);
+
+  ImGui::SeparatorText("Audio");
+  ImGui::TextF("capture ring {:.0f}% full, {} samples dropped in the last second, {} in total",
+               100.f * audioIn.get().ringFill(),
+               overrunsPerSec,
+               audioIn.get().overruns());
+  ImGui::TextF("capture buffer {} samples, {:.1f} ms", audioIn.get().bufferSamples(), audioIn.get().bufferMs());
+  if (wav2Visemes.get().isReady())
+    ImGui::TextF("mic to viseme {:.0f} ms", ms(wav2Visemes.get().latency()));
+  else
+    ImGui::TextUnformatted("mic to viseme: the model is loading");
+  const auto &metrics = wav2Visemes.get().metrics();
+  if (metrics.total.count() > 0)
+    if (auto latencyTable = Ui::Table{"##latency", 5, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp})
+    {
+      ImGui::TableSetupColumn("Mic to mouth");
+      ImGui::TableSetupColumn("p50 ms");
+      ImGui::TableSetupColumn("p95 ms");
+      ImGui::TableSetupColumn("p99 ms");
+      ImGui::TableSetupColumn("max ms");
+      ImGui::TableHeadersRow();
+      for (const auto &[stage, h] : {std::pair{"capture", &metrics.capture},
+                                     std::pair{"recognize", &metrics.recognize},
+                                     std::pair{"dispatch", &metrics.dispatch},
+                                     std::pair{"present", &metrics.present},
+                                     std::pair{"total", &metrics.total}})
+      {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(stage);
+        for (const auto p : {.5f, .95f, .99f})
+        {
+          ImGui::TableNextColumn();
+          ImGui::TextF("{:.0f}", h->percentile(p));
+        }
+        ImGui::TableNextColumn();
+        ImGui::TextF("{:.0f}", h->maxMs());
+      }
+    }
+  if (metrics.total.count() > 0 && ImGui::Button("Reset latency"))
+    wav2Visemes.get().clearMetrics();
+
+  ImGui::SeparatorText("Speech");
+  if (auto tts = lib.get().activeTts())
+  {
+    ImGui::TextF("{} waiting, {} being synthesized", tts->queued(), tts->synthesizing());
+    for (const auto compressed : {false, true})
+      if (const auto &stats = tts->transportStats(compressed); stats.messages > 0)
+        ImGui::TextF("{}: first audio after {:.0f} ms on average over {} messages",
+                     compressed ? "Opus" : "PCM",
+                     stats.firstAudioMs(),
+                     stats.messages);
+  }
+  else
+    ImGui::TextUnformatted("not in use");
+
+  ImGui::SeparatorText("Network");
+  ImGui::TextF("HTTP: {} in flight, {} waiting", httpClient.get().active(), httpClient.get().waiting());
+  if (!httpClient.get().timings().empty())
+    if (auto netTable = Ui::Table{"##http", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp})
+    {
+      ImGui::TableSetupColumn("Host");
+      ImGui::TableSetupColumn("First byte ms");
+      ImGui::TableSetupColumn("Total ms");
+      ImGui::TableSetupColumn("Age s");
+      ImGui::TableHeadersRow();
+      const auto now = Clock::now();
+      for (const auto &[host, timing] : httpClient.get().timings())
+      {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(host);
+        ImGui::TableNextColumn();
+        ImGui::TextF("{:.0f}{}", timing.ttfb, timing.reused ? "" : " (new)");
+        ImGui::TableNextColumn();
+        ImGui::TextF("{:.0f}", timing.total);
+        ImGui::TableNextColumn();
+        ImGui::TextF("{:.0f}", std::chrono::duration<float>(now - timing.at).count());
+      }
+    }
+  ImGui::TextF("Twitch: {:.1f} messages per second", messagesPerSec);
+
+  ImGui::SeparatorText("Memory");
+  const auto mem = lib.get().memory();
+  ImGui::TextF("{} textures: {:.1f} MB on the GPU, {:.1f} MB of pixels and {:.1f} MB of alpha masks in RAM",
+               mem.textures,
+               mb(mem.textureGpu),
+               mb(mem.texturePixels),
+               mb(mem.alphaMasks));
+  ImGui::TextF("{} of them released and kept for reuse, {:.1f} MB", mem.retained, mb(mem.retainedGpu));
+  ImGui::TextF("identical images share their upload, {:.1f} MB saved", mb(mem.deduplicated));
+  ImGui::TextF("{} fonts: {:.1f} MB of glyph atlases", mem.fonts, mb(mem.fontGpu));
+  ImGui::TextF("{} emotes: {:.1f} MB of atlas", mem.emotes, mb(mem.emoteGpu));
+  const auto &prefs = preferences.get();
+  if (prefs.cpuBudgetMb > 0 || prefs.gpuBudgetMb > 0)
+    ImGui::TextF("budgets: CPU {} MB, GPU {} MB, {:.1f} MB freed so far",
+                 prefs.cpuBudgetMb,
+                 prefs.gpuBudgetMb,
+                 mb(mem.evicted));
+}
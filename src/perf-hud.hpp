@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace uv
+{
+  class Uv;
+}
+
+// The "Performance" window: what a frame costs and whether capture, recognition, speech, HTTP and
+// chat keep up, with a verdict on top so one glance on stream tells whether to lower settings.
+// App reports every frame; the subsystems are read while the window is drawn, and the counters
+// are turned into per second rates once a second.
+class PerfHud
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  PerfHud(uv::Uv &, class Preferences &, class AudioIn &, class Wav2Visemes &, class HttpClient &, class Lib &);
+  // start is when the frame began, render how long it took up to the swap
+  auto frame(Clock::time_point start, Clock::duration render) -> void;
+  // time the frame pacer spun away before a frame, which is not work
+  auto waited(Clock::duration) -> void;
+  auto render() -> void;
+
+  static constexpr auto History = size_t{240};
+
+private:
+  std::reference_wrapper<uv::Uv> uv;
+  std::reference_wrapper<Preferences> preferences;
+  std::reference_wrapper<AudioIn> audioIn;
+  std::reference_wrapper<Wav2Visemes> wav2Visemes;
+  std::reference_wrapper<HttpClient> httpClient;
+  std::reference_wrapper<Lib> lib;
+
+  // the last History frames, oldest at next once full
+  std::array<float, History> intervalMs{};
+  std::array<float, History> renderMs{};
+  size_t next = 0;
+  size_t count = 0;
+  Clock::time_point lastStart;
+
+  // the current one second window
+  Clock::time_point windowStart = Clock::now();
+  uint64_t windowIdle = 0;
+  Clock::duration windowRender{};
+  Clock::duration windowWaited{};
+  uint64_t windowOverruns = 0;
+  uint64_t windowMessages = 0;
+
+  // the last complete window
+  float renderPerSec = 0.f;
+  float callbacksPerSec = 0.f;
+  float idlePerSec = 0.f;
+  uint64_t overrunsPerSec = 0;
+  float messagesPerSec = 0.f;
+  std::vector<std::string> issues;
+
+  auto rollWindow(Clock::time_point now) -> void;
+};
@@ -0,0 +1,119 @@
+#include "physics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+Physics::Physics(RenderScheduler &aScheduler) : scheduler(aScheduler) {}
+
+auto Physics::step(float dt) -> void
+{
+  if (dt <= 0.f)
+    return;
+
+  // the pivot is only observed once per frame, so its acceleration is a per frame finite
+  // difference that is held constant over the fixed steps
+  const auto gForce = glm::vec2{0.f, .3f};
+  for (auto &b : bodies)
+  {
+    if (!b.used || !b.fresh)
+      continue;
+    if (!b.primed)
+    {
+      b.lastProjPivot = b.projPivot;
+      b.primed = true;
+    }
+    const auto v = (b.projPivot - b.lastProjPivot) / dt;
+    b.accel = (v - b.lastProjPivotV) / dt + gForce;
+    b.lastProjPivot = b.projPivot;
+    b.lastProjPivotV = v;
+  }
+
+  accumulator = std::min(accumulator + dt, Step * MaxSteps);
+  while (accumulator >= Step)
+  {
+    for (auto &b : bodies)
+    {
+      if (!b.used || !b.fresh || !b.active)
+        continue;
+      const auto pivotToEnd = b.projEnd - b.projPivot;
+      const auto normal = glm::normalize(glm::vec2{-pivotToEnd.y, pivotToEnd.x});
+      const auto projection = glm::dot(b.accel, normal);
+      b.prevRot = b.rot;
+      b.rotV += (-b.force * projection - b.rot * b.springiness - b.rotV * b.damping) * Step;
+      b.rot += b.rotV * Step;
+    }
+    accumulator -= Step;
+  }
+
+  const auto alpha = accumulator / Step;
+  auto settling = false;
+  for (auto &b : bodies)
+  {
+    if (!b.used || !b.fresh)
+      continue;
+    b.fresh = false;
+    if (!b.active || !b.out)
+      continue;
+    *b.out = glm::mix(b.prevRot, b.rot, alpha);
+    settling = settling || std::abs(b.rotV) > 1e-3f || std::abs(b.rot) > 1e-3f;
+  }
+  // keep rendering until the springs settle
+  if (settling)
+    scheduler.get().invalidate();
+}
+
+auto Physics::add() -> uint32_t
+{
+  if (freeSlots.empty())
+  {
+    bodies.emplace_back().used = true;
+    return static_cast<uint32_t>(bodies.size() - 1);
+  }
+  const auto slot = freeSlots.back();
+  freeSlots.pop_back();
+  bodies[slot] = Body{};
+  bodies[slot].used = true;
+  return slot;
+}
+
+auto Physics::remove(uint32_t slot) -> void
+{
+  bodies[slot] = Body{};
+  freeSlots.push_back(slot);
+}
+
+PhysicsBody::PhysicsBody(Physics &aPhysics) : physics(aPhysics), slot(aPhysics.add()) {}
+
+PhysicsBody::PhysicsBody(const PhysicsBody &other) : physics(other.physics), slot(other.physics.get().add()) {}
+
+PhysicsBody::~PhysicsBody()
+{
+  physics.get().remove(slot);
+}
+
+auto PhysicsBody::sample(glm::vec2 projPivot,
+                         glm::vec2 projEnd,
+                         bool active,
+                         float force,
+                         float damping,
+                         float springiness,
+                         float *dRot) -> void
+{
+  auto &b = physics.get().bodies[slot];
+  b.projPivot = projPivot;
+  b.projEnd = projEnd;
+  b.active = active;
+  b.force = force;
+  b.damping = damping;
+  b.springiness = springiness;
+  b.out = dRot;
+  b.fresh = true;
+}
+
+auto PhysicsBody::reset() -> void
+{
+  auto &b = physics.get().bodies[slot];
+  b.rotV = 0.f;
+  b.rot = 0.f;
+  b.prevRot = 0.f;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "render-scheduler.hpp"
+#include <cstdint>
+#include <functional>
+#include <glm/vec2.hpp>
+#include <vector>
+
+// Spring simulation for the sprites with physics enabled. The bodies live in one contiguous array
+// and are stepped at a fixed rate before the scene is rendered; the rotation handed back to the
+// sprites is interpolated between the last two steps, so the motion is the same at any frame rate.
+// Bodies do not read each other, so the step loop can be split across threads if it ever matters.
+class Physics
+{
+public:
+  explicit Physics(RenderScheduler &);
+  auto step(float dt) -> void;
+
+  static constexpr auto Step = 1.f / 240.f;
+  // caps the catch up after a stall instead of simulating the whole gap
+  static constexpr auto MaxSteps = 16;
+
+private:
+  friend class PhysicsBody;
+
+  struct Body
+  {
+    bool used = false;
+    bool active = false;
+    bool fresh = false;
+    bool primed = false;
+    glm::vec2 projPivot = {0.f, 0.f};
+    glm::vec2 projEnd = {0.f, 0.f};
+    float force = 0.f;
+    float damping = 0.f;
+    float springiness = 0.f;
+    glm::vec2 lastProjPivot = {0.f, 0.f};
+    glm::vec2 lastProjPivotV = {0.f, 0.f};
+    glm::vec2 accel = {0.f, 0.f};
+    float rotV = 0.f;
+    float rot = 0.f;
+    float prevRot = 0.f;
+    float *out = nullptr;
+  };
+
+  std::reference_wrapper<RenderScheduler> scheduler;
+  std::vector<Body> bodies;
+  std::vector<uint32_t> freeSlots;
+  float accumulator = 0.f;
+
+  auto add() -> uint32_t;
+  auto remove(uint32_t) -> void;
+};
+
+// A sprite's slot in Physics. Copies get a slot of their own with the spring at rest.
+class PhysicsBody
+{
+public:
+  explicit PhysicsBody(Physics &);
+  PhysicsBody(const PhysicsBody &);
+  auto operator=(const PhysicsBody &) -> PhysicsBody & = delete;
+  ~PhysicsBody();
+  // called while rendering with the sprite's pivot and end in clip space; the next steps write the
+  // interpolated rotation to *dRot while active
+  auto sample(glm::vec2 projPivot,
+              glm::vec2 projEnd,
+              bool active,
+              float force,
+              float damping,
+              float springiness,
+              float *dRot) -> void;
+  auto reset() -> void;
+
+private:
+  std::reference_wrapper<Physics> physics;
+  uint32_t slot;
+};
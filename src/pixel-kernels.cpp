@@ -0,0 +1,68 @@
+#include "pixel-kernels.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PIXEL_KERNELS_SSE2
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#define PIXEL_KERNELS_SSSE3
+#endif
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PIXEL_KERNELS_NEON
+#endif
+
+namespace PixelKernels
+{
+  auto isOpaque(const unsigned char *rgba, size_t pixels) -> bool
+  {
+    auto i = size_t{0};
+#if defined(PIXEL_KERNELS_SSE2)
+    {
+      const auto alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+      for (; i + 4 <= pixels; i += 4)
+      {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgba + i * 4));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(v, alpha), alpha)) != 0xffff)
+          return false;
+      }
+    }
+#elif defined(PIXEL_KERNELS_NEON)
+    for (; i + 16 <= pixels; i += 16)
+      if (vminvq_u8(vld4q_u8(rgba + i * 4).val[3]) != 255)
+        return false;
+#endif
+    for (; i < pixels; ++i)
+      if (rgba[i * 4 + 3] != 255)
+        return false;
+    return true;
+  }
+
+  auto rgbaToRgb(unsigned char *dst, const unsigned char *rgba, size_t pixels) -> void
+  {
+    auto i = size_t{0};
+#if defined(PIXEL_KERNELS_SSSE3)
+    {
+      // the 16 byte store reaches 4 bytes past the 12 it means, which in place have been read already
+      const auto pick = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+      for (; i + 8 <= pixels; i += 4)
+      {
+        const auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rgba + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 3), _mm_shuffle_epi8(v, pick));
+      }
+    }
+#elif defined(PIXEL_KERNELS_NEON)
+    for (; i + 16 <= pixels; i += 16)
+    {
+      const auto v = vld4q_u8(rgba + i * 4);
+      vst3q_u8(dst + i * 3, uint8x16x3_t{{v.val[0], v.val[1], v.val[2]}});
+    }
+#endif
+    for (; i < pixels; ++i)
+    {
+      dst[i * 3] = rgba[i * 4];
+      dst[i * 3 + 1] = rgba[i * 4 + 1];
+      dst[i * 3 + 2] = rgba[i * 4 + 2];
+    }
+  }
+} // namespace PixelKernels
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstddef>
+
+// Pixel loops of the texture decode workers, vectorized with SSE2 (SSSE3 for the shuffles) or
+// NEON where available.
+namespace PixelKernels
+{
+  // every alpha is 255
+  auto isOpaque(const unsigned char *rgba, size_t pixels) -> bool;
+  // drops the alpha bytes; dst may be rgba itself, the rows shrink in place
+  auto rgbaToRgb(unsigned char *dst, const unsigned char *rgba, size_t pixels) -> void;
+} // namespace PixelKernels
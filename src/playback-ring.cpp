@@ -0,0 +1,47 @@
+#include "playback-ring.hpp"
+#include "audio-kernels.hpp"
+#include <algorithm>
+
+PlaybackRing::PlaybackRing(size_t capacity) : buf(capacity) {}
+
+auto PlaybackRing::append(const int16_t *data, size_t n) -> size_t
+{
+  const auto count = std::min(n, buf.size() - size_);
+  const auto tail = (head + size_) % buf.size();
+  const auto first = std::min(count, buf.size() - tail);
+  std::copy_n(data, first, buf.data() + tail);
+  std::copy_n(data + first, count - first, buf.data());
+  size_ += count;
+  return count;
+}
+
+auto PlaybackRing::mix(const int16_t *data, size_t n, size_t offset) -> size_t
+{
+  if (offset > size_)
+  {
+    const auto gap = std::min(offset - size_, buf.size() - size_);
+    const auto tail = (head + size_) % buf.size();
+    const auto first = std::min(gap, buf.size() - tail);
+    std::fill_n(buf.data() + tail, first, int16_t{0});
+    std::fill_n(buf.data(), gap - first, int16_t{0});
+    size_ += gap;
+    offset = size_;
+  }
+  const auto overlap = std::min(n, size_ - offset);
+  const auto start = (head + offset) % buf.size();
+  const auto first = std::min(overlap, buf.size() - start);
+  AudioKernels::addSaturate(buf.data() + start, data, first);
+  AudioKernels::addSaturate(buf.data(), data + first, overlap - first);
+  return overlap + append(data + overlap, n - overlap);
+}
+
+auto PlaybackRing::read(int16_t *out, size_t n) -> size_t
+{
+  const auto count = std::min(n, size_);
+  const auto first = std::min(count, buf.size() - head);
+  std::copy_n(buf.data() + head, first, out);
+  std::copy_n(buf.data(), count - first, out + first);
+  head = (head + count) % buf.size();
+  size_ -= count;
+  return count;
+}
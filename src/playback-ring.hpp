@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed capacity queue of samples waiting to be played. Reading, appending and mixing a voice into
+// the queued audio cost only the samples involved, never the length of what is already pending.
+class PlaybackRing
+{
+public:
+  explicit PlaybackRing(size_t capacity);
+  // returns how many samples fit
+  auto append(const int16_t *, size_t n) -> size_t;
+  // adds the samples on top of the queued audio offset samples after the play position,
+  // saturating instead of wrapping around; what runs past the queued audio is appended, a gap
+  // before it is filled with silence
+  auto mix(const int16_t *, size_t n, size_t offset = 0) -> size_t;
+  auto read(int16_t *out, size_t n) -> size_t;
+  auto size() const -> size_t { return size_; }
+  auto capacity() const -> size_t { return buf.size(); }
+
+private:
+  std::vector<int16_t> buf;
+  size_t head = 0;
+  size_t size_ = 0;
+};
@@ -1,9 +1,11 @@
 #include "preferences-dialog.hpp"
 #include "audio-in.hpp"
 #include "audio-out.hpp"
+#include "imgui-helpers.hpp"
 #include "preferences.hpp"
 #include "ui.hpp"
 #include <SDL.h>
+#include <fmt/format.h>
 #include <imgui.h>
 #include <spdlog/spdlog.h>
 
@@ -70,6 +72,44 @@ auto PreferencesDialog::internalDraw() -> DialogState
       ImGui::Text("e.g.: 1e3b7527b4e3ec61dee69a83979ef9d6");
       ImGui::PopItemWidth();
     }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Azure Region:");
+      ImGui::TableNextColumn();
+      ImGui::PushItemWidth(ImGui::GetFontSize() * 20.f);
+      char buf[1024];
+      strcpy(buf, preferences.get().azureRegion.data());
+      if (ImGui::InputText("##Azure Region", buf, sizeof(buf)))
+        preferences.get().azureRegion = buf;
+      ImGui::Text("e.g.: westeurope, the region of the Speech resource the key is from; auto finds it");
+      ImGui::PopItemWidth();
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Compressed TTS:");
+      ImGui::TableNextColumn();
+      ImGui::Checkbox("Opus instead of raw PCM, about a tenth of the bandwidth##compressedTts",
+                      &preferences.get().compressedTts);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("TTS Queue:");
+      ImGui::TableNextColumn();
+      ImGui::DragInt("messages, 0 = no limit##ttsMaxQueued", &preferences.get().ttsMaxQueued, 1, 0, 1000);
+      ImGui::Checkbox("Merge into the last waiting message instead of dropping##ttsMerge",
+                      &preferences.get().ttsMerge);
+      ImGui::DragInt("s max wait, 0 = no limit##ttsMaxAge", &preferences.get().ttsMaxAge, 1, 0, 600);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Speech Recognition:");
+      ImGui::TableNextColumn();
+      auto combo = Ui::Combo("##sttMode", preferences.get().sttMode.c_str(), 0);
+      if (combo)
+        for (const auto *mode : {"cloud", "local", "local-first"})
+          if (ImGui::Selectable(mode, preferences.get().sttMode == mode))
+            preferences.get().sttMode = mode;
+    }
     {
       ImGui::TableNextColumn();
       Ui::textRj("Open AI Token:");
@@ -81,6 +121,51 @@ auto PreferencesDialog::internalDraw() -> DialogState
         preferences.get().openAiToken = buf;
       ImGui::PopItemWidth();
     }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("LLM API:");
+      ImGui::TableNextColumn();
+      auto combo = Ui::Combo("##LLM API", preferences.get().llmApi.c_str(), 0);
+      if (combo)
+        for (const auto *api : {"completions", "chat"})
+          if (ImGui::Selectable(api, preferences.get().llmApi == api))
+            preferences.get().llmApi = api;
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("LLM URL:");
+      ImGui::TableNextColumn();
+      ImGui::PushItemWidth(ImGui::GetFontSize() * 40.f);
+      char buf[1024];
+      strcpy(buf, preferences.get().llmUrl.data());
+      if (ImGui::InputText("##LLM URL", buf, sizeof(buf)))
+        preferences.get().llmUrl = buf;
+      ImGui::Text("e.g.: http://localhost:8080/v1/chat/completions for a local server, no token needed");
+      ImGui::PopItemWidth();
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("LLM Model:");
+      ImGui::TableNextColumn();
+      ImGui::PushItemWidth(ImGui::GetFontSize() * 20.f);
+      char buf[1024];
+      strcpy(buf, preferences.get().llmModel.data());
+      if (ImGui::InputText("##LLM Model", buf, sizeof(buf)))
+        preferences.get().llmModel = buf;
+      ImGui::PopItemWidth();
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("LLM Token:");
+      ImGui::TableNextColumn();
+      ImGui::PushItemWidth(ImGui::GetFontSize() * 40.f);
+      char buf[1024];
+      strcpy(buf, preferences.get().llmToken.data());
+      if (ImGui::InputText("##LLM Token", buf, sizeof(buf), ImGuiInputTextFlags_Password))
+        preferences.get().llmToken = buf;
+      ImGui::Text("for a server other than api.openai.com, which gets the Open AI Token");
+      ImGui::PopItemWidth();
+    }
     {
       ImGui::TableNextColumn();
       ImGui::Text("Audio Settings");
@@ -131,6 +216,60 @@ auto PreferencesDialog::internalDraw() -> DialogState
       }
       ImGui::ProgressBar(audioLevel.getLevel(), ImVec2(0.0f, 0.0f));
     }
+    {
+      auto &extra = preferences.get().extraAudioIn;
+      // the nodes keep the number of their source, only the last one is removed so the others
+      // stay where they are
+      for (auto i = size_t{0}; i < extra.size(); ++i)
+      {
+        ImGui::TableNextColumn();
+        Ui::textRj(fmt::format("Input {}:", i + 1));
+        ImGui::TableNextColumn();
+        const auto id = fmt::format("##Input{}", i + 1);
+        auto combo = Ui::Combo(id.c_str(), extra[i].c_str(), 0);
+        if (combo)
+        {
+          if (ImGui::Selectable(("Default" + id).c_str(), extra[i] == Preferences::DefaultAudio))
+            extra[i] = Preferences::DefaultAudio;
+          const auto n = SDL_GetNumAudioDevices(1 /*input*/);
+          for (auto j = 0; j < n; ++j)
+          {
+            auto dev = SDL_GetAudioDeviceName(j, 1 /*input*/);
+            if (ImGui::Selectable((dev + id).c_str(), extra[i] == dev))
+              extra[i] = dev;
+          }
+        }
+      }
+      ImGui::TableNextColumn();
+      ImGui::TableNextColumn();
+      if (ImGui::Button("Add Input"))
+        extra.push_back(Preferences::DefaultAudio);
+      if (!extra.empty())
+      {
+        ImGui::SameLine();
+        if (ImGui::Button(fmt::format("Remove Input {}", extra.size()).c_str()))
+          extra.pop_back();
+      }
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Noise Floor:");
+      ImGui::TableNextColumn();
+      ImGui::DragFloat("dBFS, quieter input skips lip sync##noiseFloor", &preferences.get().noiseFloor, .5f, -96.f, 0.f, "%.1f");
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Latency Budget:");
+      ImGui::TableNextColumn();
+      ImGui::DragInt("ms of capture buffering, 0 is the smallest the device allows##latencyBudget",
+                     &preferences.get().latencyBudgetMs,
+                     1,
+                     0,
+                     200);
+      ImGui::TextF("capture buffer: {} samples, {:.1f} ms",
+                   audioIn.get().bufferSamples(),
+                   audioIn.get().bufferMs());
+    }
 
     {
       ImGui::TableNextColumn();
@@ -148,7 +287,94 @@ auto PreferencesDialog::internalDraw() -> DialogState
       ImGui::TableNextColumn();
       Ui::textRj("FPS:");
       ImGui::TableNextColumn();
-      ImGui::DragInt("0 = unbounded##fps", &preferences.get().fps, 1, 0, 240);
+      ImGui::DragInt("0 = on demand##fps", &preferences.get().fps, 1, 0, 240);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Compact Alpha:");
+      ImGui::TableNextColumn();
+      ImGui::Checkbox("Free pixel data after upload, hit test with 1-bit masks##compactAlpha",
+                      &preferences.get().compactAlphaMasks);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Max Texture Size:");
+      ImGui::TableNextColumn();
+      ImGui::DragInt("0 = full size##maxTextureSize", &preferences.get().maxTextureSize, 16, 0, 16384);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Mipmaps:");
+      ImGui::TableNextColumn();
+      ImGui::Checkbox("Smooth sprites drawn smaller than their art##mipmaps", &preferences.get().mipmaps);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Distance Field Fonts:");
+      ImGui::TableNextColumn();
+      ImGui::Checkbox("One glyph atlas per font for every size, sharp when scaled up##distanceFieldFonts",
+                      &preferences.get().distanceFieldFonts);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Layer Cache:");
+      ImGui::TableNextColumn();
+      ImGui::Checkbox("Draw runs of static sprites from cached layers##cacheStaticLayers",
+                      &preferences.get().cacheStaticLayers);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Mouse Rate:");
+      ImGui::TableNextColumn();
+      ImGui::DragInt("Hz the eyes follow the mouse at##mouseHz", &preferences.get().mouseHz, 1, 1, 240);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("CPU Budget:");
+      ImGui::TableNextColumn();
+      ImGui::DragInt("MB of texture pixels, 0 = no limit##cpuBudget", &preferences.get().cpuBudgetMb, 1, 0, 16384);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("GPU Budget:");
+      ImGui::TableNextColumn();
+      ImGui::DragInt("MB of textures and fonts, 0 = no limit##gpuBudget", &preferences.get().gpuBudgetMb, 1, 0, 16384);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Texture Retention:");
+      ImGui::TableNextColumn();
+      ImGui::DragInt("MB of released textures kept uploaded, 0 = free at once##textureRetain",
+                     &preferences.get().textureRetainMb,
+                     1,
+                     0,
+                     16384);
+    }
+    {
+      ImGui::TableNextColumn();
+      ImGui::Text("Output Settings");
+      ImGui::TableNextColumn();
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Shared Memory:");
+      ImGui::TableNextColumn();
+      ImGui::Checkbox("Publish RGBA frames to \"voicetuber-frames\"##sharedOutput",
+                      &preferences.get().sharedOutput);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Window:");
+      ImGui::TableNextColumn();
+      auto disabled = Ui::Disabled{!preferences.get().sharedOutput};
+      ImGui::Checkbox("Draw the scene in the window##outputToWindow", &preferences.get().outputToWindow);
+    }
+    {
+      ImGui::TableNextColumn();
+      Ui::textRj("Low Power:");
+      ImGui::TableNextColumn();
+      ImGui::Checkbox("Stop drawing while minimized and nothing reads the shared memory##lowPower",
+                      &preferences.get().lowPower);
     }
   }
   ImGui::SetCursorPosX(ImGui::GetWindowWidth() - BtnSz - ImGui::GetStyle().WindowPadding.x);
@@ -63,10 +63,36 @@ Preferences::Preferences()
     twitchKey = config->get_qualified_as<std::string>("twitch.key").value_or("");
     audioOut = config->get_qualified_as<std::string>("audio.out").value_or("Default");
     audioIn = config->get_qualified_as<std::string>("audio.in").value_or("Default");
+    extraAudioIn =
+      config->get_qualified_array_of<std::string>("audio.extra-in").value_or(std::vector<std::string>{});
+    noiseFloor = static_cast<float>(config->get_qualified_as<double>("audio.noise-floor").value_or(-60.));
+    latencyBudgetMs = config->get_qualified_as<int>("audio.latency-budget-ms").value_or(DefaultLatencyBudgetMs);
     azureKey = config->get_qualified_as<std::string>("azure.key").value_or("");
+    azureRegion = config->get_qualified_as<std::string>("azure.region").value_or("eastus");
+    compressedTts = config->get_qualified_as<bool>("azure.compressed-tts").value_or(false);
+    ttsMaxQueued = config->get_qualified_as<int>("azure.tts-max-queued").value_or(20);
+    ttsMerge = config->get_qualified_as<bool>("azure.tts-merge").value_or(false);
+    ttsMaxAge = config->get_qualified_as<int>("azure.tts-max-age").value_or(0);
+    sttMode = config->get_qualified_as<std::string>("azure.stt-mode").value_or("cloud");
     openAiToken = config->get_qualified_as<std::string>("open-ai.token").value_or("");
+    llmApi = config->get_qualified_as<std::string>("llm.api").value_or("completions");
+    llmUrl = config->get_qualified_as<std::string>("llm.url").value_or("https://api.openai.com/v1/completions");
+    llmModel = config->get_qualified_as<std::string>("llm.model").value_or("text-curie-001");
+    llmToken = config->get_qualified_as<std::string>("llm.token").value_or("");
     vsync = config->get_qualified_as<bool>("graphics.vsync").value_or(true);
     fps = config->get_qualified_as<int>("graphics.fps").value_or(0);
+    compactAlphaMasks = config->get_qualified_as<bool>("graphics.compact-alpha-masks").value_or(false);
+    maxTextureSize = config->get_qualified_as<int>("graphics.max-texture-size").value_or(0);
+    mipmaps = config->get_qualified_as<bool>("graphics.mipmaps").value_or(true);
+    distanceFieldFonts = config->get_qualified_as<bool>("graphics.distance-field-fonts").value_or(false);
+    cacheStaticLayers = config->get_qualified_as<bool>("graphics.cache-static-layers").value_or(true);
+    mouseHz = config->get_qualified_as<int>("graphics.mouse-hz").value_or(60);
+    cpuBudgetMb = config->get_qualified_as<int>("graphics.cpu-budget-mb").value_or(0);
+    gpuBudgetMb = config->get_qualified_as<int>("graphics.gpu-budget-mb").value_or(0);
+    textureRetainMb = config->get_qualified_as<int>("graphics.texture-retain-mb").value_or(256);
+    sharedOutput = config->get_qualified_as<bool>("output.shared-memory").value_or(false);
+    outputToWindow = config->get_qualified_as<bool>("output.window").value_or(true);
+    lowPower = config->get_qualified_as<bool>("output.low-power").value_or(true);
   }
   catch (const cpptoml::parse_exception &e)
   {
@@ -94,11 +120,23 @@ auto Preferences::save() -> void
       auto audioTable = cpptoml::make_table();
       audioTable->insert("out", audioOut);
       audioTable->insert("in", audioIn);
+      auto extraIn = cpptoml::make_array();
+      for (const auto &device : extraAudioIn)
+        extraIn->push_back(device);
+      audioTable->insert("extra-in", extraIn);
+      audioTable->insert("noise-floor", static_cast<double>(noiseFloor));
+      audioTable->insert("latency-budget-ms", latencyBudgetMs);
       config->insert("audio", audioTable);
     }
     {
       auto azureTable = cpptoml::make_table();
       azureTable->insert("key", azureKey);
+      azureTable->insert("region", azureRegion);
+      azureTable->insert("compressed-tts", compressedTts);
+      azureTable->insert("tts-max-queued", ttsMaxQueued);
+      azureTable->insert("tts-merge", ttsMerge);
+      azureTable->insert("tts-max-age", ttsMaxAge);
+      azureTable->insert("stt-mode", sttMode);
       config->insert("azure", azureTable);
     }
     {
@@ -106,12 +144,36 @@ auto Preferences::save() -> void
       openAiTable->insert("token", openAiToken);
       config->insert("open-ai", openAiTable);
     }
+    {
+      auto llmTable = cpptoml::make_table();
+      llmTable->insert("api", llmApi);
+      llmTable->insert("url", llmUrl);
+      llmTable->insert("model", llmModel);
+      llmTable->insert("token", llmToken);
+      config->insert("llm", llmTable);
+    }
     {
       auto graphicsTable = cpptoml::make_table();
       graphicsTable->insert("vsync", vsync);
       graphicsTable->insert("fps", fps);
+      graphicsTable->insert("compact-alpha-masks", compactAlphaMasks);
+      graphicsTable->insert("max-texture-size", maxTextureSize);
+      graphicsTable->insert("mipmaps", mipmaps);
+      graphicsTable->insert("distance-field-fonts", distanceFieldFonts);
+      graphicsTable->insert("cache-static-layers", cacheStaticLayers);
+      graphicsTable->insert("mouse-hz", mouseHz);
+      graphicsTable->insert("cpu-budget-mb", cpuBudgetMb);
+      graphicsTable->insert("gpu-budget-mb", gpuBudgetMb);
+      graphicsTable->insert("texture-retain-mb", textureRetainMb);
       config->insert("graphics", graphicsTable);
     }
+    {
+      auto outputTable = cpptoml::make_table();
+      outputTable->insert("shared-memory", sharedOutput);
+      outputTable->insert("window", outputToWindow);
+      outputTable->insert("low-power", lowPower);
+      config->insert("output", outputTable);
+    }
 
     auto configFile = std::ofstream{configFilePath};
     if (!configFile.is_open())
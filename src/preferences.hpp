@@ -1,5 +1,6 @@
 #pragma once
 #include <string>
+#include <vector>
 
 class Preferences
 {
@@ -8,13 +9,55 @@ public:
   auto save() -> void;
 
   constexpr static const char *DefaultAudio = "Default";
+  // a 512 sample buffer at 48 kHz, 128 at 16 kHz: the loop wakes about a hundred times a second
+  // instead of the 250 to 750 of the smallest buffer, for under 10 ms more mic to mouth latency
+  constexpr static int DefaultLatencyBudgetMs = 30;
 
   std::string twitchUser = "mika314";
   std::string twitchKey;
   std::string audioOut = DefaultAudio;
   std::string audioIn = DefaultAudio;
+  // more capture devices for the nodes that listen to someone besides the host, source 1 onwards
+  std::vector<std::string> extraAudioIn;
+  float noiseFloor = -60.f;
+  // ms the capture device buffer may add to the mic to mouth latency, 0 is the smallest buffer
+  int latencyBudgetMs = DefaultLatencyBudgetMs;
   std::string azureKey;
+  // the region of the Speech resource the key is from, or "auto" to find it
+  std::string azureRegion = "eastus";
+  bool compressedTts = false;
+  int ttsMaxQueued = 20;
+  bool ttsMerge = false;
+  int ttsMaxAge = 0;
+  // how AiMouth recognizes the host: "cloud", "local", or "local-first" with the cloud for what
+  // local recognition misses
+  std::string sttMode = "cloud";
   std::string openAiToken;
+  // "completions" or "chat", the OpenAI API the server at llmUrl speaks; a local inference
+  // server needs no token
+  std::string llmApi = "completions";
+  std::string llmUrl = "https://api.openai.com/v1/completions";
+  std::string llmModel = "text-curie-001";
+  // what a server at llmUrl other than OpenAI's is sent, the OpenAI token only goes to OpenAI
+  std::string llmToken;
   bool vsync = true;
   int fps = 0;
+  bool compactAlphaMasks = false;
+  // the longest side textures are uploaded with, larger art is scaled down on load; 0 is no limit
+  int maxTextureSize = 0;
+  bool mipmaps = true;
+  // text of every size drawn from one distance field atlas per font file
+  bool distanceFieldFonts = false;
+  bool cacheStaticLayers = true;
+  // how often the eyes sample the mouse
+  int mouseHz = 60;
+  // MB, 0 is no limit; over them Lib frees the pixel copies of textures and the font atlases
+  int cpuBudgetMb = 0;
+  int gpuBudgetMb = 0;
+  // MB of textures kept on the GPU after their last user is gone, 0 frees them at once
+  int textureRetainMb = 256;
+  bool sharedOutput = false;
+  bool outputToWindow = true;
+  // stop drawing while the window is minimized and no shared memory reader is attached
+  bool lowPower = true;
 };
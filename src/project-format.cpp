@@ -0,0 +1,145 @@
+#include "project-format.hpp"
+#include "node.hpp"
+#include "session-format.hpp"
+#include "version.hpp"
+#include <algorithm>
+#include <fmt/format.h>
+#include <stdexcept>
+
+namespace
+{
+  constexpr auto Truncated = "The project file is truncated";
+
+  auto collect(const Node &node, int32_t parent, std::vector<ProjectFormat::Record> &out) -> void
+  {
+    OStrm strm;
+    node.saveOwn(strm);
+    auto blob = strm.str();
+    // the class name is only known to the node's save()
+    auto in = IStrm(blob.data(), blob.data() + blob.size());
+    auto className = std::string{};
+    ::deser(in, className);
+    auto attrs = ProjectFormat::Attrs{};
+    node.saveAttrs(attrs);
+    const auto self = static_cast<int32_t>(out.size());
+    out.push_back(ProjectFormat::Record{
+      std::move(className), node.getName(), parent, std::move(blob), ProjectFormat::encode(attrs)});
+    for (const auto &n : node.getNodes())
+      collect(*n, self, out);
+  }
+} // namespace
+
+namespace ProjectFormat
+{
+  auto records(const Node &root) -> std::vector<Record>
+  {
+    auto ret = std::vector<Record>{};
+    collect(root, -1, ret);
+    return ret;
+  }
+
+  auto write(const Node &root) -> std::string
+  {
+    return write(records(root));
+  }
+
+  auto write(const std::vector<Record> &all) -> std::string
+  {
+    // the blobs start after the header and the index
+    auto offset = uint64_t{4 * sizeof(uint32_t)};
+    for (const auto &r : all)
+      offset += sizeof(uint32_t) + r.className.size() + sizeof(uint32_t) + r.name.size() + sizeof(int32_t) +
+                2 * sizeof(uint64_t) + sizeof(uint32_t) + r.attrs.size();
+    auto ret = std::string{};
+    auto blobs = size_t{0};
+    for (const auto &r : all)
+      blobs += r.blob.size();
+    ret.reserve(offset + blobs);
+    SessionFormat::put(ret, Magic);
+    SessionFormat::put(ret, Version);
+    SessionFormat::put(ret, saveVersion());
+    SessionFormat::put(ret, static_cast<uint32_t>(all.size()));
+    for (const auto &r : all)
+    {
+      SessionFormat::putStr(ret, r.className);
+      SessionFormat::putStr(ret, r.name);
+      SessionFormat::put(ret, r.parent);
+      SessionFormat::put(ret, offset);
+      SessionFormat::put(ret, static_cast<uint64_t>(r.blob.size()));
+      SessionFormat::putStr(ret, r.attrs);
+      offset += r.blob.size();
+    }
+    for (const auto &r : all)
+      ret += r.blob;
+    return ret;
+  }
+
+  auto isContainer(std::string_view data) -> bool
+  {
+    return data.size() >= sizeof(Magic) && SessionFormat::Reader{data}.get<uint32_t>() == Magic;
+  }
+
+  auto encode(const Attrs &attrs) -> std::string
+  {
+    auto ret = std::string{};
+    if (attrs.empty())
+      return ret;
+    SessionFormat::put(ret, static_cast<uint32_t>(attrs.size()));
+    for (const auto &[k, v] : attrs)
+    {
+      SessionFormat::putStr(ret, k);
+      SessionFormat::putStr(ret, v);
+    }
+    return ret;
+  }
+
+  auto decode(std::string_view attrs) -> Attrs
+  {
+    auto ret = Attrs{};
+    if (attrs.empty())
+      return ret;
+    auto r = SessionFormat::Reader{attrs, "The node attributes are truncated"};
+    const auto n = r.get<uint32_t>();
+    for (auto i = uint32_t{0}; i < n; ++i)
+    {
+      auto k = std::string{r.getStr()};
+      ret[std::move(k)] = std::string{r.getStr()};
+    }
+    return ret;
+  }
+
+  auto index(std::string_view data) -> std::vector<Entry>
+  {
+    auto r = SessionFormat::Reader{data, Truncated};
+    if (r.get<uint32_t>() != Magic)
+      throw std::runtime_error("Not a project file");
+    const auto version = r.get<uint32_t>();
+    if (version < 1 || version > Version)
+      throw std::runtime_error(fmt::format("Project format version {}, expected {}", version, Version));
+    if (const auto v = r.get<uint32_t>(); v != saveVersion())
+      throw std::runtime_error(fmt::format("Save version {}, expected {}", v, saveVersion()));
+    const auto n = r.get<uint32_t>();
+    auto ret = std::vector<Entry>{};
+    ret.reserve(std::min<size_t>(n, data.size()));
+    for (auto i = uint32_t{0}; i < n; ++i)
+    {
+      auto &e = ret.emplace_back();
+      e.className = r.getStr();
+      e.name = r.getStr();
+      e.parent = r.get<int32_t>();
+      const auto offset = r.get<uint64_t>();
+      const auto size = r.get<uint64_t>();
+      if (version >= 2)
+        e.attrs = r.getStr();
+      // only the root has no parent, and a parent comes ahead of its children
+      if ((i == 0) != (e.parent < 0) || e.parent >= static_cast<int32_t>(i))
+        throw std::runtime_error(fmt::format("Node {} of the project index has parent {}", i, e.parent));
+      if (offset > data.size() || size > data.size() - offset)
+        throw std::runtime_error(Truncated);
+      e.blob = data.substr(offset, size);
+    }
+    if (ret.empty())
+      throw std::runtime_error("The project has no root");
+    return ret;
+  }
+} // namespace ProjectFormat
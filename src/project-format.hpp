@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class Node;
+
+// The prj.tpp a project is saved to: Magic, Version, the save version and the number of nodes,
+// then the index, one entry per node with its class, its name, the entry of its parent, where
+// its blob is in the file and its attributes, then the blobs. A blob is what the node's saveOwn() writes, so any node
+// is read without reading the ones before it and a damaged blob only loses its own node. Entries
+// are in depth first order, each parent ahead of its children, the children in their order.
+// The attributes are the Node::saveAttrs() of the node, by name, version 1 files have none.
+// Files without Magic are the sequential stream the saves before it wrote.
+namespace ProjectFormat
+{
+  // "VTPJ"
+  constexpr auto Magic = uint32_t{0x4a505456};
+  constexpr auto Version = uint32_t{2};
+
+  using Attrs = std::map<std::string, std::string>;
+
+  struct Entry
+  {
+    std::string_view className;
+    std::string_view name;
+    // the entry of the parent, -1 for the root
+    int32_t parent;
+    std::string_view blob;
+    std::string_view attrs = {};
+  };
+
+  // an entry of the index with the blob it points to, as a save collects them
+  struct Record
+  {
+    std::string className;
+    std::string name;
+    int32_t parent;
+    std::string blob;
+    std::string attrs = {};
+  };
+
+  // the tree under root in index order
+  auto records(const Node &root) -> std::vector<Record>;
+  auto write(const std::vector<Record> &) -> std::string;
+  auto write(const Node &root) -> std::string;
+  auto isContainer(std::string_view) -> bool;
+  auto encode(const Attrs &) -> std::string;
+  // throws when the attributes are damaged
+  auto decode(std::string_view attrs) -> Attrs;
+  // views into data; throws when the header or the index is damaged or from another save version
+  auto index(std::string_view data) -> std::vector<Entry>;
+} // namespace ProjectFormat
@@ -0,0 +1,112 @@
+#include "project-journal.hpp"
+#include "session-format.hpp"
+#include <algorithm>
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace
+{
+  // FNV-1a
+  auto hash(uint64_t h, std::string_view data) -> uint64_t
+  {
+    for (auto ch : data)
+    {
+      h ^= static_cast<unsigned char>(ch);
+      h *= 0x100000001b3ull;
+    }
+    return h;
+  }
+
+  constexpr auto Seed = 0xcbf29ce484222325ull;
+} // namespace
+
+auto ProjectJournal::save(const Node &root) -> Save
+{
+  auto records = ProjectFormat::records(root);
+  auto newShape = Seed;
+  auto newBlobs = std::vector<uint64_t>{};
+  newBlobs.reserve(records.size());
+  for (const auto &r : records)
+  {
+    newShape = hash(hash(newShape, r.className), r.name);
+    newShape = hash(newShape, {reinterpret_cast<const char *>(&r.parent), sizeof(r.parent)});
+    newBlobs.push_back(hash(hash(Seed, r.blob), r.attrs));
+  }
+  if (blobs.empty() || newShape != shape || journalBytes > std::max(snapshotBytes, MinCompactBytes))
+  {
+    auto ret = Save{true, ProjectFormat::write(records)};
+    shape = newShape;
+    blobs = std::move(newBlobs);
+    snapshotBytes = ret.data.size();
+    journalBytes = 0;
+    return ret;
+  }
+  auto ret = Save{false, {}};
+  for (auto i = size_t{0}; i < records.size(); ++i)
+  {
+    if (newBlobs[i] == blobs[i])
+      continue;
+    SessionFormat::put(ret.data, static_cast<uint32_t>(i));
+    SessionFormat::putStr(ret.data, records[i].blob);
+    SessionFormat::putStr(ret.data, records[i].attrs);
+    blobs[i] = newBlobs[i];
+  }
+  journalBytes += ret.data.size();
+  return ret;
+}
+
+auto ProjectJournal::invalidate() -> void
+{
+  blobs.clear();
+}
+
+auto ProjectJournal::header(std::string_view snapshot) -> std::string
+{
+  auto ret = std::string{};
+  SessionFormat::put(ret, Magic);
+  SessionFormat::put(ret, Version);
+  SessionFormat::put(ret, static_cast<uint64_t>(snapshot.size()));
+  SessionFormat::put(ret, hash(Seed, snapshot));
+  return ret;
+}
+
+auto ProjectJournal::apply(std::string_view snapshot,
+                           std::string_view journal,
+                           std::vector<ProjectFormat::Entry> &entries) -> size_t
+{
+  const auto expected = header(snapshot);
+  if (!journal.starts_with(expected))
+  {
+    if (!journal.empty())
+      SPDLOG_INFO("the journal is of another snapshot, ignored");
+    return 0;
+  }
+  auto r = SessionFormat::Reader{journal.substr(expected.size()), "The journal ends early"};
+  auto ret = size_t{0};
+  try
+  {
+    while (!r.empty())
+    {
+      const auto entry = r.get<uint32_t>();
+      const auto blob = r.getStr();
+      const auto attrs = r.getStr();
+      if (entry >= entries.size())
+        throw std::runtime_error("The journal names a node the project does not have");
+      entries[entry].blob = blob;
+      entries[entry].attrs = attrs;
+      ++ret;
+    }
+  }
+  catch (std::runtime_error &e)
+  {
+    // what came before the damage is still good
+    SPDLOG_WARN("{:t} after {} records", e, ret);
+  }
+  return ret;
+}
+
+auto ProjectJournal::path(const std::filesystem::path &project) -> std::filesystem::path
+{
+  return std::filesystem::path{project}.replace_extension(".tpj");
+}
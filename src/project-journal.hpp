@@ -0,0 +1,55 @@
+#pragma once
+#include "project-format.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keeps most saves of a project to the nodes that changed. A save serializes the tree in memory,
+// compares every node's blob and attributes with the ones written last, and appends only the nodes
+// that differ to the journal next to prj.tpp, each blob after the number of its entry in the index
+// and ahead of its attributes. The journal starts with the size and the hash of the snapshot it
+// goes with, a journal next to any other snapshot is ignored. A full snapshot is written instead,
+// and the journal started over, when the tree changed shape (nodes added, removed, moved or
+// renamed), when the journal outgrew the snapshot, and for the first save after the project was
+// opened. Main thread only, apart from the static functions.
+class ProjectJournal
+{
+public:
+  struct Save
+  {
+    // a full snapshot for prj.tpp, otherwise records to append to the journal, empty when no
+    // node changed
+    bool isSnapshot;
+    std::string data;
+  };
+
+  auto save(const Node &root) -> Save;
+  // the next save writes a snapshot, after a failed write or another project was opened
+  auto invalidate() -> void;
+
+  // what the journal of a snapshot starts with
+  static auto header(std::string_view snapshot) -> std::string;
+  // points the entries of the snapshot's index at the newer blobs of the journal, the latest one of
+  // each entry; a record cut short by a crash ends the journal; returns the number of records
+  static auto apply(std::string_view snapshot,
+                    std::string_view journal,
+                    std::vector<ProjectFormat::Entry> &) -> size_t;
+  static auto path(const std::filesystem::path &project) -> std::filesystem::path;
+
+  // "VTJN"
+  static constexpr auto Magic = uint32_t{0x4e4a5456};
+  static constexpr auto Version = uint32_t{2};
+  // a journal this small is not compacted, however small the snapshot
+  static constexpr auto MinCompactBytes = size_t{1} << 20;
+
+private:
+  // of the class names, names and parents of the entries
+  uint64_t shape = 0;
+  // of the blobs and attributes written last by entry, none when the next save is a snapshot
+  std::vector<uint64_t> blobs;
+  size_t snapshotBytes = 0;
+  size_t journalBytes = 0;
+};
@@ -0,0 +1,90 @@
+#include "project-loader.hpp"
+#include "node.hpp"
+#include "project-journal.hpp"
+#include "save-factory.hpp"
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+ProjectLoader::ProjectLoader(std::unique_ptr<const MappedFile> aFile,
+                             std::unique_ptr<const MappedFile> aJournal,
+                             const SaveFactory &saveFactory)
+  : file(std::move(aFile)), journal(std::move(aJournal)), entries(ProjectFormat::index(file->view()))
+{
+  if (journal && *journal)
+    if (const auto n = ProjectJournal::apply(file->view(), journal->view(), entries); n > 0)
+      SPDLOG_INFO("{} changes from the journal", n);
+  const auto &r = entries.front();
+  root = saveFactory.ctor(std::string{r.className}, std::string{r.name});
+  if (!root)
+    throw std::runtime_error(fmt::format("Unknown class {:?} of the project root", r.className));
+  load(*root, 0);
+  nodes.resize(entries.size());
+  auto parents = std::vector<Node *>(entries.size(), nullptr);
+  parents[0] = root.get();
+  for (auto i = size_t{1}; i < entries.size(); ++i)
+  {
+    const auto &e = entries[i];
+    auto parent = parents[static_cast<size_t>(e.parent)];
+    if (!parent)
+      continue;
+    auto node = std::shared_ptr<Node>{saveFactory.ctor(std::string{e.className}, std::string{e.name})};
+    if (!node)
+    {
+      SPDLOG_ERROR("Unknown class {:?} of node {:?}, left out with its children", e.className, e.name);
+      continue;
+    }
+    node->visible = false;
+    parents[i] = node.get();
+    nodes[i] = node;
+    parent->addChild(std::move(node));
+  }
+  SPDLOG_INFO("{} {}, {} nodes", r.className, r.name, entries.size());
+}
+
+ProjectLoader::~ProjectLoader() = default;
+
+auto ProjectLoader::takeRoot() -> std::unique_ptr<Node>
+{
+  return std::move(root);
+}
+
+auto ProjectLoader::step(Clock::time_point deadline) -> bool
+{
+  for (; next < entries.size(); ++next)
+  {
+    if (Clock::now() >= deadline)
+      return true;
+    if (auto node = nodes[next].lock())
+    {
+      load(*node, next);
+      node->visible = true;
+    }
+  }
+  return false;
+}
+
+auto ProjectLoader::finish() -> void
+{
+  step(Clock::time_point::max());
+}
+
+auto ProjectLoader::progress() const -> float
+{
+  return entries.size() > 1 ? static_cast<float>(next - 1) / static_cast<float>(entries.size() - 1) : 1.f;
+}
+
+auto ProjectLoader::load(Node &node, size_t entry) -> void
+{
+  const auto &e = entries[entry];
+  try
+  {
+    auto strm = IStrm(e.blob.data(), e.blob.data() + e.blob.size());
+    node.loadOwn(strm);
+    node.loadAttrs(ProjectFormat::decode(e.attrs));
+  }
+  catch (std::runtime_error &err)
+  {
+    SPDLOG_ERROR("Node {:?} of class {:?} did not load, left at its defaults: {:t}", e.name, e.className, err);
+  }
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "file.hpp"
+#include "project-format.hpp"
+#include <chrono>
+#include <memory>
+#include <vector>
+
+class Node;
+
+// Opens a ProjectFormat file in two goes. The constructor makes every node of the index and puts
+// the tree together, so the outliner has the whole project at once; the root gets its properties
+// right away, the other nodes stay hidden at their defaults. step() then reads the blobs in index
+// order until its deadline and shows each node once it has its properties. A node of an unknown
+// class is left out with its subtree, a blob that does not read leaves its node at the defaults,
+// the rest of the project loads either way. As step() overwrites what it reads, the nodes are
+// not edited, nor shown or hidden, before finish(). The blobs are read on the main thread, a node's
+// load() asks Lib for its textures and fonts. The blobs of a ProjectJournal that goes with the
+// file take the place of the ones in it.
+class ProjectLoader
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // throws when the index is damaged or the root cannot be made
+  // the journal may be null
+  ProjectLoader(std::unique_ptr<const MappedFile>, std::unique_ptr<const MappedFile> journal, const class SaveFactory &);
+  ProjectLoader(const ProjectLoader &) = delete;
+  ~ProjectLoader();
+  // once, right after the constructor
+  auto takeRoot() -> std::unique_ptr<Node>;
+  // false once every blob is read
+  auto step(Clock::time_point deadline) -> bool;
+  auto finish() -> void;
+  auto progress() const -> float;
+
+private:
+  std::unique_ptr<const MappedFile> file;
+  std::unique_ptr<const MappedFile> journal;
+  std::vector<ProjectFormat::Entry> entries;
+  std::unique_ptr<Node> root;
+  // by entry, the root and the nodes left out are empty; expired once the project drops the node
+  std::vector<std::weak_ptr<Node>> nodes;
+  size_t next = 1;
+
+  auto load(Node &, size_t entry) -> void;
+};
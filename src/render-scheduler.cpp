@@ -0,0 +1,38 @@
+#include "render-scheduler.hpp"
+
+auto RenderScheduler::invalidate() -> void
+{
+  dirty = true;
+}
+
+auto RenderScheduler::invalidateLayers() -> void
+{
+  ++layersGeneration_;
+  invalidate();
+}
+
+auto RenderScheduler::wakeAt(Clock::time_point t) -> void
+{
+  const auto value = t.time_since_epoch().count();
+  auto current = deadline.load(std::memory_order_relaxed);
+  while (value < current)
+    if (deadline.compare_exchange_weak(current, value, std::memory_order_relaxed))
+      return;
+}
+
+auto RenderScheduler::wakeIn(Clock::duration d) -> void
+{
+  wakeAt(Clock::now() + d);
+}
+
+auto RenderScheduler::isDue(Clock::time_point now) const -> bool
+{
+  const auto value = deadline.load(std::memory_order_relaxed);
+  return dirty || (value != NoDeadline && now.time_since_epoch().count() >= value);
+}
+
+auto RenderScheduler::beginFrame() -> void
+{
+  dirty = false;
+  deadline = NoDeadline;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Decides when a frame is due while rendering on demand (Preferences::fps == 0). Anything that
+// changes what would be drawn calls invalidate(); time based animation registers the moment it
+// changes next with wakeAt(). With neither pending the app only services the uv loop.
+// invalidate() and wakeAt() may be called from the nodes animating on the job system workers.
+class RenderScheduler
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  auto invalidate() -> void;
+  // for changes cached layers cannot see in their nodes, like a texture finishing its upload
+  auto invalidateLayers() -> void;
+  auto layersGeneration() const -> uint64_t { return layersGeneration_; }
+  auto wakeAt(Clock::time_point) -> void;
+  auto wakeIn(Clock::duration) -> void;
+  auto isDue(Clock::time_point now) const -> bool;
+  // called at the start of a frame; requests made while rendering apply to the next one
+  auto beginFrame() -> void;
+
+private:
+  static constexpr auto NoDeadline = Clock::duration::max().count();
+
+  std::atomic<bool> dirty = true;
+  uint64_t layersGeneration_ = 0;
+  // the earliest wake up as a time since the epoch of Clock
+  std::atomic<Clock::rep> deadline = NoDeadline;
+};
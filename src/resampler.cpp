@@ -0,0 +1,128 @@
+#include "resampler.hpp"
+#include "audio-kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+#include <numbers>
+#include <numeric>
+
+struct Resampler::Table
+{
+  int up = 1;
+  int down = 1;
+  size_t taps = 0;
+  std::vector<float> coeffs;
+
+  auto row(int phase) const -> const float * { return coeffs.data() + static_cast<size_t>(phase) * taps; }
+};
+
+namespace
+{
+  auto makeTable(int up, int down) -> Resampler::Table
+  {
+    auto ret = Resampler::Table{};
+    ret.up = up;
+    ret.down = down;
+    const auto scale = std::min(1., static_cast<double>(up) / down);
+    // rounded up to the SIMD width
+    ret.taps = (static_cast<size_t>(std::ceil(Resampler::BaseTaps / scale)) + 3) / 4 * 4;
+    ret.coeffs.resize(ret.taps * static_cast<size_t>(up));
+    const auto half = static_cast<double>(ret.taps) / 2.;
+    // a little below Nyquist so the transition band stays out of the audible range of the output
+    const auto cutoff = .9 * scale;
+    for (auto p = 0; p < up; ++p)
+    {
+      auto row = ret.coeffs.data() + static_cast<size_t>(p) * ret.taps;
+      auto sum = 0.;
+      for (auto j = size_t{0}; j < ret.taps; ++j)
+      {
+        // distance from the tap to the output sample, in input samples
+        const auto x = static_cast<double>(j) - (half - 1.) - static_cast<double>(p) / up;
+        const auto arg = std::numbers::pi * cutoff * x;
+        const auto sinc = x == 0. ? 1. : std::sin(arg) / arg;
+        // Blackman window over the span of the taps
+        const auto w = (x + half) / (2. * half);
+        const auto window = .42 - .5 * std::cos(2. * std::numbers::pi * w) + .08 * std::cos(4. * std::numbers::pi * w);
+        row[j] = static_cast<float>(sinc * window);
+        sum += row[j];
+      }
+      // unity gain at DC for every phase
+      for (auto j = size_t{0}; j < ret.taps; ++j)
+        row[j] = static_cast<float>(row[j] / sum);
+    }
+    return ret;
+  }
+
+  auto queryTable(int up, int down) -> std::shared_ptr<const Resampler::Table>
+  {
+    static std::mutex mutex;
+    static std::map<std::pair<int, int>, std::shared_ptr<const Resampler::Table>> tables;
+    auto lock = std::lock_guard{mutex};
+    auto &ret = tables[std::pair{up, down}];
+    if (!ret)
+      ret = std::make_shared<const Resampler::Table>(makeTable(up, down));
+    return ret;
+  }
+} // namespace
+
+Resampler::Resampler(int aInRate, int aOutRate)
+  : inRate_(aInRate), outRate_(aOutRate), table([&]() {
+      const auto g = std::gcd(aInRate, aOutRate);
+      return queryTable(aOutRate / g, aInRate / g);
+    }())
+{
+  reset();
+}
+
+auto Resampler::reset() -> void
+{
+  // the first output sample is centred on the first input sample
+  history.assign(table->taps / 2 - 1, 0.f);
+  pos = 0;
+  phase = 0;
+  samplesIn = 0;
+  samplesOut = 0;
+}
+
+auto Resampler::process(std::span<const int16_t> in, Wav &out) -> void
+{
+  history.insert(std::end(history), std::begin(in), std::end(in));
+  samplesIn += in.size();
+  const auto &t = *table;
+  const auto before = out.size();
+  out.reserve(out.size() + (history.size() - pos) * static_cast<size_t>(t.up) / static_cast<size_t>(t.down) + 1);
+  while (pos + t.taps <= history.size())
+  {
+    const auto y = AudioKernels::dot(history.data() + pos, t.row(phase), t.taps);
+    out.push_back(static_cast<int16_t>(std::clamp(std::lround(y), long{INT16_MIN}, long{INT16_MAX})));
+    phase += t.down;
+    pos += static_cast<size_t>(phase / t.up);
+    phase %= t.up;
+  }
+  samplesOut += out.size() - before;
+  const auto consumed = std::min(pos, history.size());
+  history.erase(std::begin(history), std::begin(history) + static_cast<ptrdiff_t>(consumed));
+  pos -= consumed;
+}
+
+auto Resampler::flush(Wav &out) -> void
+{
+  const auto total = static_cast<uint64_t>(std::llround(static_cast<double>(samplesIn) * outRate_ / inRate_));
+  const auto expected = out.size() + static_cast<size_t>(total - std::min(total, samplesOut));
+  const auto zeros = std::vector<int16_t>(table->taps / 2 + 1);
+  process(zeros, out);
+  out.resize(std::min(out.size(), expected));
+  reset();
+}
+
+auto Resampler::resample(std::span<const int16_t> in, int inRate, int outRate) -> Wav
+{
+  if (inRate == outRate)
+    return Wav(std::begin(in), std::end(in));
+  auto r = Resampler{inRate, outRate};
+  auto ret = Wav{};
+  r.process(in, ret);
+  r.flush(ret);
+  return ret;
+}
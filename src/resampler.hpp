@@ -0,0 +1,43 @@
+#pragma once
+#include "wav.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+// Polyphase windowed-sinc sample rate converter. The rates are reduced to an L/M ratio and every
+// one of the L phases gets its own row of taps; rows are cached per ratio and shared by all
+// resamplers. When downsampling the cutoff follows the output rate so nothing folds back.
+class Resampler
+{
+public:
+  Resampler(int inRate, int outRate);
+  // appends the converted samples; the newest Taps / 2 input samples are held back until more
+  // input or flush() arrives
+  auto process(std::span<const int16_t>, Wav &out) -> void;
+  // pads the held back input with silence and starts over, the total output is in * out / in
+  auto flush(Wav &out) -> void;
+  auto inRate() const -> int { return inRate_; }
+  auto outRate() const -> int { return outRate_; }
+
+  // converts a whole clip in one go
+  static auto resample(std::span<const int16_t>, int inRate, int outRate) -> Wav;
+
+  // taps per phase when upsampling, downsampling widens the filter by the ratio
+  static constexpr auto BaseTaps = 32;
+
+  struct Table;
+
+private:
+  int inRate_;
+  int outRate_;
+  std::shared_ptr<const Table> table;
+  std::vector<float> history;
+  size_t pos = 0;
+  int phase = 0;
+  uint64_t samplesIn = 0;
+  uint64_t samplesOut = 0;
+
+  auto reset() -> void;
+};
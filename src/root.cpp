@@ -18,8 +18,12 @@ auto Root::do_clone() const -> std::shared_ptr<Node>
 auto Root::render(float dt, Node *hovered, Node *selected) -> void
 {
   zOrder = INT_MIN;
-  glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
-  glClear(GL_COLOR_BUFFER_BIT);
+  if (!frameCtx.get().transparent)
+  {
+    batch.get().flush();
+    glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
+    glClear(GL_COLOR_BUFFER_BIT);
+  }
   Node::render(dt, hovered, selected);
 }
 
@@ -13,7 +13,7 @@ namespace little_endian_io
 } // namespace little_endian_io
 using namespace little_endian_io;
 
-auto saveWav(std::ostream &f, const Wav &pcm, int sampleRate) -> void
+auto saveWav(std::ostream &f, std::span<const int16_t> pcm, int sampleRate) -> void
 {
   // Write the file headers
   f << "RIFF----WAVEfmt ";                    // (chunk size to be filled in later)
@@ -43,3 +43,19 @@ auto saveWav(std::ostream &f, const Wav &pcm, int sampleRate) -> void
   f.seekp(0 + 4);
   writeWord(f, fileLength - 8, 4);
 }
+
+auto saveWavHeader(std::ostream &f, int sampleRate) -> void
+{
+  f << "RIFF";
+  writeWord(f, 0xffffffffu, 4);
+  f << "WAVEfmt ";
+  writeWord(f, 16, 4);
+  writeWord(f, 1, 2);
+  writeWord(f, 1, 2);
+  writeWord(f, sampleRate, 4);
+  writeWord(f, (sampleRate * 16 * 1) / 8, 4);
+  writeWord(f, 2, 2);
+  writeWord(f, 16, 2);
+  f << "data";
+  writeWord(f, 0xffffffffu, 4);
+}
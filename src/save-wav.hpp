@@ -1,7 +1,11 @@
 #pragma once
 #include "wav.hpp"
+#include <cstdint>
 #include <iosfwd>
+#include <span>
 #include <string>
 #include <vector>
 
-auto saveWav(std::ostream &, const Wav &wav, int sampleRate) -> void;
+auto saveWav(std::ostream &, std::span<const int16_t> wav, int sampleRate) -> void;
+// header of a WAV stream whose length is not known yet, both sizes are left at their maximum
+auto saveWavHeader(std::ostream &, int sampleRate) -> void;
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// The file a SessionRecorder writes and a SessionReplay reads: Magic, Version and the capture
+// sample rate, then one record after another, each its Kind, the microseconds since the start of
+// the recording and the length of its payload. Numbers are in the byte order of the machine that
+// recorded, sessions are for profiling on the same kind of machine.
+namespace SessionFormat
+{
+  enum class Kind : uint8_t {
+    // the samples of a capture block
+    mic,
+    // IRC bytes as read from Twitch
+    chat,
+    // two int32, the global mouse position
+    mouse,
+    // url, result, status, headers, body and the time it took
+    http,
+  };
+
+  // "VTSN"
+  constexpr auto Magic = uint32_t{0x4e535456};
+  constexpr auto Version = uint32_t{1};
+
+  template <typename T>
+  auto put(std::string &out, T v) -> void
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    out.append(reinterpret_cast<const char *>(&v), sizeof(v));
+  }
+
+  inline auto putStr(std::string &out, std::string_view v) -> void
+  {
+    put(out, static_cast<uint32_t>(v.size()));
+    out.append(v);
+  }
+
+  // reads a payload front to back, throws what when it ends early
+  class Reader
+  {
+  public:
+    explicit Reader(std::string_view aData, const char *aWhat = "The session file is truncated")
+      : data(aData), what(aWhat)
+    {
+    }
+    template <typename T>
+    auto get() -> T
+    {
+      static_assert(std::is_trivially_copyable_v<T>);
+      auto ret = T{};
+      std::memcpy(&ret, take(sizeof(T)).data(), sizeof(T));
+      return ret;
+    }
+    auto getStr() -> std::string_view { return take(get<uint32_t>()); }
+    auto take(size_t n) -> std::string_view
+    {
+      if (n > data.size())
+        throw std::runtime_error(what);
+      const auto ret = data.substr(0, n);
+      data.remove_prefix(n);
+      return ret;
+    }
+    auto empty() const -> bool { return data.empty(); }
+
+  private:
+    std::string_view data;
+    const char *what;
+  };
+} // namespace SessionFormat
@@ -0,0 +1,137 @@
+#include "session-recorder.hpp"
+#include "audio-in.hpp"
+#include "http-client.hpp"
+#include "lib.hpp"
+#include "mouse-tracking.hpp"
+#include "trace.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+
+namespace
+{
+  // the bodies of these are credentials, a session file gets passed around with bug reports
+  auto isTokenEndpoint(std::string_view url) -> bool
+  {
+    return url.find("/sts/v1.0/issuetoken") != std::string_view::npos;
+  }
+} // namespace
+
+SessionRecorder::SessionRecorder(AudioIn &aAudioIn,
+                                 Lib &aLib,
+                                 MouseTracking &aMouseTracking,
+                                 HttpClient &aHttpClient,
+                                 std::filesystem::path aPath)
+  : audioIn(aAudioIn),
+    lib(aLib),
+    mouseTracking(aMouseTracking),
+    httpClient(aHttpClient),
+    path_(std::move(aPath)),
+    file(open_file(path_, "wb"))
+{
+  if (!file)
+    throw std::runtime_error(fmt::format("Error creating session {:?}: {}", path_, std::strerror(errno)));
+  SessionFormat::put(buf, SessionFormat::Magic);
+  SessionFormat::put(buf, SessionFormat::Version);
+  SessionFormat::put(buf, static_cast<int32_t>(audioIn.get().sampleRate()));
+  writer = std::thread{&SessionRecorder::run, this};
+  audioIn.get().reg(*this);
+  lib.get().tapChat([this](std::string_view bytes) { record(SessionFormat::Kind::chat, bytes); });
+  mouseTracking.get().tap([this](glm::ivec2 v) {
+    auto payload = std::string{};
+    SessionFormat::put(payload, static_cast<int32_t>(v.x));
+    SessionFormat::put(payload, static_cast<int32_t>(v.y));
+    record(SessionFormat::Kind::mouse, payload);
+  });
+  httpClient.get().tap([this](const HttpClient::Exchange &e) {
+    auto payload = std::string{};
+    SessionFormat::putStr(payload, e.url);
+    SessionFormat::put(payload, static_cast<int32_t>(e.result));
+    SessionFormat::put(payload, static_cast<int64_t>(e.status));
+    SessionFormat::put(payload, static_cast<uint32_t>(e.headers.size()));
+    for (const auto &[name, value] : e.headers)
+    {
+      SessionFormat::putStr(payload, name);
+      SessionFormat::putStr(payload, value);
+    }
+    // the replay only hands the token back to the stubs, which do not check it
+    SessionFormat::putStr(payload, isTokenEndpoint(e.url) && !e.body.empty() ? std::string_view{"redacted"} : e.body);
+    SessionFormat::put(payload, e.ms);
+    record(SessionFormat::Kind::http, payload);
+  });
+  SPDLOG_INFO("recording the session to {:?}", path_);
+}
+
+SessionRecorder::~SessionRecorder()
+{
+  httpClient.get().tap(nullptr);
+  mouseTracking.get().tap(nullptr);
+  lib.get().tapChat(nullptr);
+  audioIn.get().unreg(*this);
+  flush();
+  {
+    auto lock = std::lock_guard{mutex};
+    done = true;
+  }
+  wake.notify_one();
+  writer.join();
+  SPDLOG_INFO("session {:?} recorded, {} bytes", path_, bytes_);
+}
+
+auto SessionRecorder::ingest(const AudioBlock &block) -> void
+{
+  const auto samples = block.samples();
+  if (samples.empty())
+    return;
+  record(SessionFormat::Kind::mic,
+         std::string_view{reinterpret_cast<const char *>(samples.data()), samples.size_bytes()});
+}
+
+auto SessionRecorder::record(SessionFormat::Kind kind, std::string_view payload) -> void
+{
+  const auto us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+  const auto before = buf.size();
+  SessionFormat::put(buf, kind);
+  SessionFormat::put(buf, static_cast<int64_t>(us));
+  SessionFormat::putStr(buf, payload);
+  bytes_ += buf.size() - before;
+  if (buf.size() >= FlushBytes)
+    flush();
+}
+
+auto SessionRecorder::flush() -> void
+{
+  if (buf.empty())
+    return;
+  {
+    auto lock = std::lock_guard{mutex};
+    chunks.push_back(std::exchange(buf, {}));
+  }
+  wake.notify_one();
+  buf.reserve(FlushBytes + FlushBytes / 4);
+}
+
+auto SessionRecorder::run() -> void
+{
+  Trace::nameThread("session recorder");
+  auto ready = std::vector<std::string>{};
+  for (;;)
+  {
+    {
+      auto lock = std::unique_lock{mutex};
+      wake.wait(lock, [this]() { return done || !chunks.empty(); });
+      std::swap(ready, chunks);
+      if (ready.empty() && done)
+        break;
+    }
+    for (const auto &chunk : ready)
+      if (std::fwrite(chunk.data(), 1, chunk.size(), file.get()) != chunk.size())
+      {
+        SPDLOG_ERROR("Error writing session {:?}: {}", path_, std::strerror(errno));
+        break;
+      }
+    ready.clear();
+  }
+  std::fflush(file.get());
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "capture-sink.hpp"
+#include "file.hpp"
+#include "session-format.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Records what drives a stream, the microphone, the chat, the mouse and the HTTP responses, with
+// the time each arrived, so SessionReplay can play the load of a bad evening back offline. The
+// records collect in memory and a thread of its own appends them to the file every FlushBytes,
+// an evening of it never sits in memory and the main thread never waits for the disk.
+class SessionRecorder final : public CaptureSink
+{
+public:
+  // throws when the file cannot be created
+  SessionRecorder(class AudioIn &,
+                  class Lib &,
+                  class MouseTracking &,
+                  class HttpClient &,
+                  std::filesystem::path);
+  SessionRecorder(const SessionRecorder &) = delete;
+  // stops the taps and waits for the rest to be written
+  ~SessionRecorder() final;
+  auto ingest(const AudioBlock &) -> void final;
+  auto path() const -> const std::filesystem::path & { return path_; }
+  // recorded so far, written or not
+  auto bytes() const -> uint64_t { return bytes_; }
+
+  static constexpr auto FlushBytes = size_t{256} << 10;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  std::reference_wrapper<AudioIn> audioIn;
+  std::reference_wrapper<Lib> lib;
+  std::reference_wrapper<MouseTracking> mouseTracking;
+  std::reference_wrapper<class HttpClient> httpClient;
+  std::filesystem::path path_;
+  Clock::time_point start = Clock::now();
+  std::string buf;
+  uint64_t bytes_ = 0;
+
+  // the writer thread's
+  UniqueFile file;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::vector<std::string> chunks;
+  bool done = false;
+  std::thread writer;
+
+  auto record(SessionFormat::Kind, std::string_view payload) -> void;
+  auto flush() -> void;
+  auto run() -> void;
+};
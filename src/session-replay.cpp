@@ -0,0 +1,102 @@
+#include "session-replay.hpp"
+#include "audio-in.hpp"
+#include "http-client.hpp"
+#include "lib.hpp"
+#include "mouse-tracking.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+
+SessionReplay::SessionReplay(const std::filesystem::path &path,
+                             AudioIn &aAudioIn,
+                             Lib &aLib,
+                             MouseTracking &aMouseTracking,
+                             HttpClient &httpClient,
+                             float aSpeed)
+  : file(path), audioIn(aAudioIn), lib(aLib), mouseTracking(aMouseTracking), speed(aSpeed)
+{
+  if (!file)
+    throw std::runtime_error(fmt::format("Error opening session {:?}: {}", path, std::strerror(errno)));
+  auto reader = SessionFormat::Reader{file.view()};
+  if (reader.get<uint32_t>() != SessionFormat::Magic)
+    throw std::runtime_error(fmt::format("{:?} is not a session", path));
+  if (const auto v = reader.get<uint32_t>(); v != SessionFormat::Version)
+    throw std::runtime_error(fmt::format("{:?}: session version {}, expected {}", path, v, SessionFormat::Version));
+  if (const auto rate = reader.get<int32_t>(); rate != audioIn.get().sampleRate())
+    SPDLOG_WARN("the session was captured at {} Hz, replaying it at {} Hz", rate, audioIn.get().sampleRate());
+  auto exchanges = std::vector<HttpClient::Exchange>{};
+  while (!reader.empty())
+  {
+    const auto kind = reader.get<SessionFormat::Kind>();
+    const auto us = reader.get<int64_t>();
+    const auto payload = reader.getStr();
+    if (kind != SessionFormat::Kind::http)
+    {
+      events.push_back(Event{kind, us, payload});
+      continue;
+    }
+    // the responses wait in the stubs for the requests the replay makes
+    auto r = SessionFormat::Reader{payload};
+    auto &e = exchanges.emplace_back();
+    e.url = r.getStr();
+    e.result = static_cast<CURLcode>(r.get<int32_t>());
+    e.status = static_cast<long>(r.get<int64_t>());
+    const auto headers = r.get<uint32_t>();
+    for (auto i = uint32_t{0}; i < headers; ++i)
+    {
+      const auto name = r.getStr();
+      e.headers.emplace_back(name, r.getStr());
+    }
+    e.body = r.getStr();
+    e.ms = r.get<float>();
+    ++http;
+  }
+  httpClient.stub(std::move(exchanges), speed);
+}
+
+auto SessionReplay::start(Clock::time_point v) -> void
+{
+  started = v;
+}
+
+auto SessionReplay::tick(Clock::time_point now) -> bool
+{
+  const auto at = std::chrono::duration_cast<std::chrono::microseconds>((now - started) * speed).count();
+  for (; next < events.size() && events[next].us <= at; ++next)
+  {
+    const auto &e = events[next];
+    switch (e.kind)
+    {
+    case SessionFormat::Kind::mic:
+      samples.resize(e.payload.size() / sizeof(int16_t));
+      std::memcpy(samples.data(), e.payload.data(), samples.size() * sizeof(int16_t));
+      audioIn.get().inject(samples);
+      ++mic;
+      break;
+    case SessionFormat::Kind::chat:
+      lib.get().replayChat(std::string{e.payload});
+      ++chat;
+      break;
+    case SessionFormat::Kind::mouse: {
+      auto r = SessionFormat::Reader{e.payload};
+      const auto x = r.get<int32_t>();
+      mouseTracking.get().replay(glm::ivec2{x, r.get<int32_t>()});
+      ++mouse;
+      break;
+    }
+    case SessionFormat::Kind::http: break;
+    }
+  }
+  return next < events.size();
+}
+
+auto SessionReplay::duration() const -> Clock::duration
+{
+  return events.empty() ? Clock::duration{} : std::chrono::microseconds{events.back().us};
+}
+
+auto SessionReplay::counts() const -> std::string
+{
+  return fmt::format("{} mic blocks, {} chat reads, {} mouse moves, {} HTTP responses", mic, chat, mouse, http);
+}
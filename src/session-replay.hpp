@@ -0,0 +1,58 @@
+#pragma once
+#include "file.hpp"
+#include "session-format.hpp"
+#include "wav.hpp"
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+// Plays a recorded session back through the entry points the live sources use: the samples into
+// AudioIn's sinks, the chat into the Twitch parser, the mouse into MouseTracking, and the HTTP
+// responses from stubs in HttpClient instead of the network. At a speed above 1 everything,
+// the HTTP round trips included, arrives that much sooner.
+class SessionReplay
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // throws when the file is not a session; the HTTP stubs are in place once it returns
+  SessionReplay(const std::filesystem::path &,
+                class AudioIn &,
+                class Lib &,
+                class MouseTracking &,
+                class HttpClient &,
+                float speed);
+  // the recording's time 0, right before the first tick(); loading the project and the models
+  // in between would otherwise deliver their share of the session at once
+  auto start(Clock::time_point) -> void;
+  // delivers what was recorded up to now, false once everything is delivered
+  auto tick(Clock::time_point now) -> bool;
+  // the length of the recording, at the recorded speed
+  auto duration() const -> Clock::duration;
+  auto counts() const -> std::string;
+
+private:
+  struct Event
+  {
+    SessionFormat::Kind kind;
+    int64_t us;
+    std::string_view payload;
+  };
+
+  MappedFile file;
+  std::reference_wrapper<AudioIn> audioIn;
+  std::reference_wrapper<Lib> lib;
+  std::reference_wrapper<MouseTracking> mouseTracking;
+  float speed;
+  std::vector<Event> events;
+  size_t next = 0;
+  Clock::time_point started = Clock::now();
+  // the samples of one record, copied out of the mapping for alignment
+  Wav samples;
+  size_t mic = 0;
+  size_t chat = 0;
+  size_t mouse = 0;
+  size_t http = 0;
+};
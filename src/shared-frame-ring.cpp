@@ -0,0 +1,102 @@
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "shared-frame-ring.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include <new>
+#include <stdexcept>
+
+SharedFrameRing::SharedFrameRing(std::string aName, size_t aSlotBytes)
+  : name(std::move(aName)), slotBytes(aSlotBytes), size(sizeof(Header) + Slots * aSlotBytes)
+{
+#ifdef _WIN32
+  mapping = CreateFileMappingA(INVALID_HANDLE_VALUE,
+                               nullptr,
+                               PAGE_READWRITE,
+                               static_cast<DWORD>(static_cast<uint64_t>(size) >> 32),
+                               static_cast<DWORD>(size & 0xffffffff),
+                               ("Local\\" + name).c_str());
+  if (!mapping)
+    throw std::runtime_error(fmt::format("CreateFileMapping {}: {}", name, GetLastError()));
+  mem = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (!mem)
+  {
+    CloseHandle(mapping);
+    throw std::runtime_error(fmt::format("MapViewOfFile {}: {}", name, GetLastError()));
+  }
+#else
+  const auto fd = shm_open(("/" + name).c_str(), O_CREAT | O_RDWR, 0600);
+  if (fd < 0)
+    throw std::runtime_error(fmt::format("shm_open {}: {}", name, strerror(errno)));
+  if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+  {
+    close(fd);
+    throw std::runtime_error(fmt::format("ftruncate {}: {}", name, strerror(errno)));
+  }
+  mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mem == MAP_FAILED)
+  {
+    mem = nullptr;
+    throw std::runtime_error(fmt::format("mmap {}: {}", name, strerror(errno)));
+  }
+#endif
+  auto header = new (mem) Header{};
+  header->magic = Magic;
+  header->version = Version;
+  header->slots = Slots;
+  header->slotBytes = static_cast<uint32_t>(slotBytes);
+  for (auto i = 0U; i < Slots; ++i)
+    header->slot[i].offset = static_cast<uint32_t>(sizeof(Header) + i * slotBytes);
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+#ifdef _WIN32
+  UnmapViewOfFile(mem);
+  CloseHandle(mapping);
+#else
+  munmap(mem, size);
+  shm_unlink(("/" + name).c_str());
+#endif
+}
+
+auto SharedFrameRing::publish(const unsigned char *rgba, int w, int h) -> void
+{
+  const auto stride = static_cast<size_t>(w) * 4;
+  if (stride * h > slotBytes)
+    return;
+  auto header = static_cast<Header *>(mem);
+  ++seq;
+  auto &slot = header->slot[seq % Slots];
+  slot.seq.store(0, std::memory_order_release);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.w = static_cast<uint32_t>(w);
+  slot.h = static_cast<uint32_t>(h);
+  slot.stride = static_cast<uint32_t>(stride);
+  std::memcpy(static_cast<unsigned char *>(mem) + slot.offset, rgba, stride * h);
+  slot.seq.store(seq, std::memory_order_release);
+  header->latest.store(seq, std::memory_order_release);
+}
+
+auto SharedFrameRing::isRead() -> bool
+{
+  // a reader polls at its own frame rate, a couple of seconds of silence means it is gone
+  constexpr auto ReaderTimeout = std::chrono::seconds{2};
+  const auto polls = static_cast<Header *>(mem)->readerPolls.load(std::memory_order_relaxed);
+  const auto now = std::chrono::steady_clock::now();
+  if (polls != lastPolls)
+  {
+    lastPolls = polls;
+    lastPollChange = now;
+  }
+  return polls == 0 || now - lastPollChange < ReaderTimeout;
+}
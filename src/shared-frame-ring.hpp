@@ -0,0 +1,60 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Named shared memory ring that external consumers (an OBS source, a virtual camera bridge) map
+// to read the rendered frames without capturing the window. Pixels are RGBA8 with straight
+// alpha, rows bottom-up as OpenGL reads them. Each slot is guarded by a sequence number: it is
+// zero while the slot is being written and readers retry when it changes under them. Readers bump
+// readerPolls every time they look for a frame, which is how the app knows someone is watching.
+class SharedFrameRing
+{
+public:
+  static constexpr uint32_t Magic = 0x52465456; // "VTFR"
+  static constexpr uint32_t Version = 1;
+  static constexpr uint32_t Slots = 3;
+
+  struct Slot
+  {
+    std::atomic<uint64_t> seq;
+    uint32_t w;
+    uint32_t h;
+    uint32_t stride;
+    uint32_t offset;
+  };
+
+  struct Header
+  {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slotBytes;
+    std::atomic<uint64_t> latest;
+    Slot slot[Slots];
+    // appended after version 1 shipped, older readers never touch it
+    std::atomic<uint64_t> readerPolls;
+  };
+
+  SharedFrameRing(std::string name, size_t slotBytes);
+  SharedFrameRing(const SharedFrameRing &) = delete;
+  ~SharedFrameRing();
+  auto capacity() const -> size_t { return slotBytes; }
+  auto publish(const unsigned char *rgba, int w, int h) -> void;
+  // true while a reader polled recently, or when none ever did, since an old reader cannot say
+  auto isRead() -> bool;
+
+private:
+  std::string name;
+  size_t slotBytes;
+  size_t size;
+  void *mem = nullptr;
+#ifdef _WIN32
+  void *mapping = nullptr;
+#endif
+  uint64_t seq = 0;
+  uint64_t lastPolls = 0;
+  std::chrono::steady_clock::time_point lastPollChange = std::chrono::steady_clock::now();
+};
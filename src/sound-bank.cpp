@@ -0,0 +1,22 @@
+#include "sound-bank.hpp"
+#include "no-voice.hpp"
+#include "resampler.hpp"
+#include <cmath>
+#include <numbers>
+
+SoundBank::SoundBank(int sampleRate) : sampleRate_(sampleRate)
+{
+  const auto chime = noVoice();
+  clips[static_cast<size_t>(Clip::noVoice)] =
+    NoVoiceRate == sampleRate ? Wav(std::begin(chime), std::end(chime)) : Resampler::resample(chime, NoVoiceRate, sampleRate);
+  auto &beep = clips[static_cast<size_t>(Clip::beep)];
+  beep.resize(static_cast<size_t>(sampleRate * BeepMs / 1000));
+  for (auto i = size_t{0}; i < beep.size(); ++i)
+    beep[i] = static_cast<int16_t>(
+      0x5fff * std::sin(2.f * std::numbers::pi_v<float> * BeepHz * static_cast<float>(i) / static_cast<float>(sampleRate)));
+}
+
+auto SoundBank::operator[](Clip v) const -> std::span<const int16_t>
+{
+  return clips[static_cast<size_t>(v)];
+}
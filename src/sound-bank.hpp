@@ -0,0 +1,27 @@
+#pragma once
+#include "wav.hpp"
+#include <array>
+#include <cstddef>
+#include <span>
+
+// The short clips the app plays on its own: the chime for a muted chatter and the calibration
+// beep. Each is converted to the output rate once when the bank is built, and playing one mixes
+// the bank's samples into the playback ring, the one copy the device needs, so a burst of chat
+// allocates nothing and makes no Wav per message.
+class SoundBank
+{
+public:
+  enum class Clip { noVoice, beep, count };
+
+  explicit SoundBank(int sampleRate);
+  SoundBank(const SoundBank &) = delete;
+  auto operator[](Clip) const -> std::span<const int16_t>;
+  auto sampleRate() const -> int { return sampleRate_; }
+
+  static constexpr auto BeepMs = 60;
+  static constexpr auto BeepHz = 1000.f;
+
+private:
+  int sampleRate_;
+  std::array<Wav, static_cast<size_t>(Clip::count)> clips;
+};
@@ -0,0 +1,444 @@
+#include "sprite-batch.hpp"
+#include "gl-ext.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <glm/common.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <spdlog/spdlog.h>
+#include <string>
+
+namespace
+{
+  // GLSL 1.40 is what GL 3.1 brings; the fixed function projection is passed in as a uniform
+  const char *VertexShader = R"(#version 140
+uniform mat4 projection;
+uniform samplerBuffer transforms;
+uniform samplerBuffer instances;
+uniform int first;
+in vec2 corner;
+out vec2 uv;
+out vec4 color;
+flat out float field;
+void main()
+{
+  int i = (first + gl_InstanceID) * 4;
+  vec4 xy = texelFetch(instances, i);
+  vec4 uvs = texelFetch(instances, i + 1);
+  color = texelFetch(instances, i + 2);
+  vec4 transform = texelFetch(instances, i + 3);
+  field = transform.y;
+  int t = int(transform.x) * 2;
+  vec4 axes = texelFetch(transforms, t);
+  vec2 origin = texelFetch(transforms, t + 1).xy;
+  vec2 p = mix(xy.xy, xy.zw, corner);
+  uv = mix(uvs.xy, uvs.zw, corner);
+  gl_Position = projection * vec4(origin + p.x * axes.xy + p.y * axes.zw, 0.0, 1.0);
+}
+)";
+
+  // the alpha test of the fixed function pipeline does not apply to shaders, so it is done here
+  const char *FragmentShader = R"(#version 140
+uniform sampler2D tex;
+uniform float alphaRef;
+in vec2 uv;
+in vec4 color;
+flat in float field;
+out vec4 fragColor;
+void main()
+{
+  vec4 c = texture(tex, uv);
+  // derivatives are taken outside of the branch, where every fragment of the quad has them
+  float edge = fwidth(c.a);
+  if (field > 0.5)
+    c.a = smoothstep(0.5 - edge, 0.5 + edge, c.a);
+  c *= color;
+  if (c.a <= alphaRef)
+    discard;
+  fragColor = c;
+}
+)";
+
+  auto compile(GLenum type, const char *src) -> GLuint
+  {
+    const auto ret = GlExt::createShader(type);
+    GlExt::shaderSource(ret, 1, &src, nullptr);
+    GlExt::compileShader(ret);
+    auto ok = GLint{0};
+    GlExt::getShaderiv(ret, GL_COMPILE_STATUS, &ok);
+    if (ok)
+      return ret;
+    char log[1024] = {};
+    GlExt::getShaderInfoLog(ret, sizeof(log), nullptr, log);
+    SPDLOG_INFO("sprite shader does not compile, transforming on the CPU: {}", log);
+    GlExt::deleteShader(ret);
+    return 0;
+  }
+} // namespace
+
+SpriteBatch::~SpriteBatch()
+{
+  if (vbo != 0)
+    GlExt::deleteBuffers(1, &vbo);
+  if (program == 0)
+    return;
+  GlExt::deleteProgram(program);
+  GlExt::deleteBuffers(1, &cornerVbo);
+  GlExt::deleteBuffers(2, buffers);
+  glDeleteTextures(2, bufferTextures);
+}
+
+auto SpriteBatch::canInstance() const -> bool
+{
+  return GlExt::instancing && !isProgramFailed;
+}
+
+auto SpriteBatch::instanced(bool v) -> void
+{
+  wantInstanced = v;
+}
+
+auto SpriteBatch::begin() -> void
+{
+  flush();
+  isInstanced_ = wantInstanced && canInstance() && (program != 0 || initProgram());
+  frameBinds = 0;
+  frameDrawCalls = 0;
+  frameQuads = 0;
+  modelView_ = glm::mat4{1.f};
+}
+
+auto SpriteBatch::end() -> void
+{
+  flush();
+  binds_ = frameBinds;
+  drawCalls_ = frameDrawCalls;
+  quads_ = frameQuads;
+}
+
+auto SpriteBatch::modelView(const glm::mat4 &v) -> void
+{
+  modelView_ = v;
+  isTransformQueued = false;
+}
+
+auto SpriteBatch::quad(GLuint texture,
+                       glm::vec2 xy0,
+                       glm::vec2 xy1,
+                       glm::vec2 uv0,
+                       glm::vec2 uv1,
+                       glm::vec4 color,
+                       bool distanceField) -> void
+{
+  // the model-view is affine in XY, so the corners are origin + x * axisX + y * axisY
+  const auto origin = glm::vec2{modelView_[3]};
+  const auto axisX = glm::vec2{modelView_[0]};
+  const auto axisY = glm::vec2{modelView_[1]};
+  auto toView = [&](float x, float y) { return origin + x * axisX + y * axisY; };
+
+  const auto v0 = Vertex{toView(xy0.x, xy0.y), uv0, color};
+  const auto v1 = Vertex{toView(xy1.x, xy0.y), glm::vec2{uv1.x, uv0.y}, color};
+  const auto v2 = Vertex{toView(xy1.x, xy1.y), uv1, color};
+  const auto v3 = Vertex{toView(xy0.x, xy1.y), glm::vec2{uv0.x, uv1.y}, color};
+
+  const auto min = glm::min(glm::min(v0.xy, v1.xy), glm::min(v2.xy, v3.xy));
+  const auto max = glm::max(glm::max(v0.xy, v1.xy), glm::max(v2.xy, v3.xy));
+  if (isInstanced_)
+  {
+    // the instance buffer is a texture and cannot grow past the texture buffer limit
+    if (queuedInstances == maxInstances)
+      flush();
+    if (!isTransformQueued)
+    {
+      transforms.push_back(glm::vec4{axisX, axisY});
+      transforms.push_back(glm::vec4{origin, 0.f, 0.f});
+      isTransformQueued = true;
+    }
+    auto &run = runFor(texture, distanceField, min, max);
+    run.min = glm::min(run.min, min);
+    run.max = glm::max(run.max, max);
+    const auto index = static_cast<float>(transforms.size() / TransformTexels - 1);
+    run.instances.push_back(
+      Instance{glm::vec4{xy0, xy1}, glm::vec4{uv0, uv1}, color, glm::vec4{index, distanceField ? 1.f : 0.f, 0.f, 0.f}});
+    ++queuedInstances;
+    ++frameQuads;
+    return;
+  }
+
+  auto &run = runFor(texture, distanceField, min, max);
+  run.min = glm::min(run.min, min);
+  run.max = glm::max(run.max, max);
+  run.vertices.push_back(v0);
+  run.vertices.push_back(v1);
+  run.vertices.push_back(v2);
+  run.vertices.push_back(v0);
+  run.vertices.push_back(v2);
+  run.vertices.push_back(v3);
+  ++frameQuads;
+}
+
+auto SpriteBatch::runFor(GLuint texture, bool distanceField, glm::vec2 min, glm::vec2 max) -> Run &
+{
+  // walk back over the runs queued after the candidate; any overlap would change what is on top
+  const auto stop = runCount > MaxLookback ? runCount - MaxLookback : size_t{0};
+  for (auto i = runCount; i > stop; --i)
+  {
+    auto &run = runs[i - 1];
+    if (run.texture == texture && run.distanceField == distanceField)
+      return run;
+    if (min.x < run.max.x && run.min.x < max.x && min.y < run.max.y && run.min.y < max.y)
+      break;
+  }
+  if (runCount == runs.size())
+    runs.emplace_back();
+  auto &run = runs[runCount++];
+  run.texture = texture;
+  run.distanceField = distanceField;
+  run.min = min;
+  run.max = max;
+  run.vertices.clear();
+  run.instances.clear();
+  return run;
+}
+
+auto SpriteBatch::flush() -> void
+{
+  if (runCount == 0)
+    return;
+  if (isInstanced_)
+    flushInstances();
+  else
+    flushVertices();
+  runCount = 0;
+}
+
+auto SpriteBatch::flushVertices() -> void
+{
+  vertices.clear();
+  for (auto i = size_t{0}; i < runCount; ++i)
+    vertices.insert(std::end(vertices), std::begin(runs[i].vertices), std::end(runs[i].vertices));
+
+  if (vbo == 0)
+    GlExt::genBuffers(1, &vbo);
+
+  glMatrixMode(GL_MODELVIEW);
+  glLoadIdentity();
+
+  GlExt::bindBuffer(GL_ARRAY_BUFFER, vbo);
+  // re-specifying the whole store each flush lets the driver orphan the previous one instead of
+  // waiting for the GPU to finish reading it
+  GlExt::bufferData(GL_ARRAY_BUFFER,
+                    static_cast<GLsizeiptr>(vertices.size() * sizeof(Vertex)),
+                    vertices.data(),
+                    GL_STREAM_DRAW);
+
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+  glEnableClientState(GL_COLOR_ARRAY);
+  glVertexPointer(2, GL_FLOAT, sizeof(Vertex), reinterpret_cast<const void *>(offsetof(Vertex, xy)));
+  glTexCoordPointer(2, GL_FLOAT, sizeof(Vertex), reinterpret_cast<const void *>(offsetof(Vertex, uv)));
+  glColorPointer(4, GL_FLOAT, sizeof(Vertex), reinterpret_cast<const void *>(offsetof(Vertex, color)));
+
+  glEnable(GL_TEXTURE_2D);
+  // the alpha test and blending the distance fields replace, read the first time one is drawn
+  auto isField = false;
+  auto isAlphaSaved = false;
+  auto alphaTest = GLboolean{GL_FALSE};
+  auto alphaFunc = GLint{GL_ALWAYS};
+  auto alphaRef = GLfloat{0.f};
+  auto blend = GLboolean{GL_FALSE};
+  auto restoreAlpha = [&]() {
+    glAlphaFunc(static_cast<GLenum>(alphaFunc), alphaRef);
+    if (!alphaTest)
+      glDisable(GL_ALPHA_TEST);
+    if (blend)
+      glEnable(GL_BLEND);
+  };
+  auto first = GLint{0};
+  auto bound = GLuint{0};
+  for (auto i = size_t{0}; i < runCount; ++i)
+  {
+    const auto &run = runs[i];
+    if (run.distanceField != isField)
+    {
+      isField = run.distanceField;
+      if (!isField)
+        restoreAlpha();
+      else
+      {
+        if (!isAlphaSaved)
+        {
+          alphaTest = glIsEnabled(GL_ALPHA_TEST);
+          glGetIntegerv(GL_ALPHA_TEST_FUNC, &alphaFunc);
+          glGetFloatv(GL_ALPHA_TEST_REF, &alphaRef);
+          blend = glIsEnabled(GL_BLEND);
+          isAlphaSaved = true;
+        }
+        // the edge is where the distance crosses one half; what passes is the distance as alpha,
+        // so the glyph is drawn opaque instead of blended, like the shader's solid interior
+        glEnable(GL_ALPHA_TEST);
+        glAlphaFunc(GL_GEQUAL, .5f);
+        glDisable(GL_BLEND);
+      }
+    }
+    // GL_TEXTURE_2D is disabled outside of the batch, so the last binding does not leak anywhere
+    if (i == 0 || run.texture != bound)
+    {
+      glBindTexture(GL_TEXTURE_2D, run.texture);
+      bound = run.texture;
+      ++frameBinds;
+    }
+    const auto count = static_cast<GLsizei>(run.vertices.size());
+    glDrawArrays(GL_TRIANGLES, first, count);
+    first += count;
+    ++frameDrawCalls;
+  }
+  if (isField)
+    restoreAlpha();
+  glDisable(GL_TEXTURE_2D);
+
+  glDisableClientState(GL_COLOR_ARRAY);
+  glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  GlExt::bindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+auto SpriteBatch::flushInstances() -> void
+{
+  instances.clear();
+  for (auto i = size_t{0}; i < runCount; ++i)
+    instances.insert(std::end(instances), std::begin(runs[i].instances), std::end(runs[i].instances));
+
+  // orphaned on every flush like the vertex buffer
+  GlExt::bindBuffer(GL_TEXTURE_BUFFER, buffers[0]);
+  GlExt::bufferData(GL_TEXTURE_BUFFER,
+                    static_cast<GLsizeiptr>(transforms.size() * sizeof(glm::vec4)),
+                    transforms.data(),
+                    GL_STREAM_DRAW);
+  GlExt::bindBuffer(GL_TEXTURE_BUFFER, buffers[1]);
+  GlExt::bufferData(GL_TEXTURE_BUFFER,
+                    static_cast<GLsizeiptr>(instances.size() * sizeof(Instance)),
+                    instances.data(),
+                    GL_STREAM_DRAW);
+  GlExt::bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  GLfloat projection[16];
+  glGetFloatv(GL_PROJECTION_MATRIX, projection);
+  auto alphaRef = GLfloat{-1.f};
+  if (glIsEnabled(GL_ALPHA_TEST))
+    glGetFloatv(GL_ALPHA_TEST_REF, &alphaRef);
+
+  GlExt::useProgram(program);
+  GlExt::uniformMatrix4fv(projectionLoc, 1, GL_FALSE, projection);
+  GlExt::uniform1f(alphaRefLoc, alphaRef);
+  GlExt::activeTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, bufferTextures[0]);
+  GlExt::activeTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_BUFFER, bufferTextures[1]);
+  GlExt::activeTexture(GL_TEXTURE0);
+  GlExt::bindBuffer(GL_ARRAY_BUFFER, cornerVbo);
+  GlExt::vertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+  GlExt::enableVertexAttribArray(0);
+
+  auto first = GLint{0};
+  auto bound = GLuint{0};
+  for (auto i = size_t{0}; i < runCount; ++i)
+  {
+    const auto &run = runs[i];
+    if (i == 0 || run.texture != bound)
+    {
+      glBindTexture(GL_TEXTURE_2D, run.texture);
+      bound = run.texture;
+      ++frameBinds;
+    }
+    const auto count = static_cast<GLsizei>(run.instances.size());
+    GlExt::uniform1i(firstLoc, first);
+    GlExt::drawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    first += count;
+    ++frameDrawCalls;
+  }
+
+  GlExt::disableVertexAttribArray(0);
+  GlExt::bindBuffer(GL_ARRAY_BUFFER, 0);
+  GlExt::activeTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  GlExt::activeTexture(GL_TEXTURE2);
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  GlExt::activeTexture(GL_TEXTURE0);
+  GlExt::useProgram(0);
+
+  transforms.clear();
+  isTransformQueued = false;
+  queuedInstances = 0;
+}
+
+auto SpriteBatch::initProgram() -> bool
+{
+  const auto vs = compile(GL_VERTEX_SHADER, VertexShader);
+  const auto fs = vs != 0 ? compile(GL_FRAGMENT_SHADER, FragmentShader) : 0;
+  if (fs == 0)
+  {
+    if (vs != 0)
+      GlExt::deleteShader(vs);
+    isProgramFailed = true;
+    return false;
+  }
+  program = GlExt::createProgram();
+  GlExt::attachShader(program, vs);
+  GlExt::attachShader(program, fs);
+  GlExt::bindAttribLocation(program, 0, "corner");
+  GlExt::linkProgram(program);
+  GlExt::deleteShader(vs);
+  GlExt::deleteShader(fs);
+  auto ok = GLint{0};
+  GlExt::getProgramiv(program, GL_LINK_STATUS, &ok);
+  if (!ok)
+  {
+    char log[1024] = {};
+    GlExt::getProgramInfoLog(program, sizeof(log), nullptr, log);
+    SPDLOG_INFO("sprite shader does not link, transforming on the CPU: {}", log);
+    GlExt::deleteProgram(program);
+    program = 0;
+    isProgramFailed = true;
+    return false;
+  }
+  projectionLoc = GlExt::getUniformLocation(program, "projection");
+  firstLoc = GlExt::getUniformLocation(program, "first");
+  alphaRefLoc = GlExt::getUniformLocation(program, "alphaRef");
+  GlExt::useProgram(program);
+  GlExt::uniform1i(GlExt::getUniformLocation(program, "tex"), 0);
+  GlExt::uniform1i(GlExt::getUniformLocation(program, "transforms"), 1);
+  GlExt::uniform1i(GlExt::getUniformLocation(program, "instances"), 2);
+  GlExt::useProgram(0);
+
+  // a strip in the order the shader interpolates the corners in
+  const GLfloat corners[] = {0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 1.f, 1.f};
+  GlExt::genBuffers(1, &cornerVbo);
+  GlExt::bindBuffer(GL_ARRAY_BUFFER, cornerVbo);
+  GlExt::bufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  GlExt::bindBuffer(GL_ARRAY_BUFFER, 0);
+
+  // the buffer objects stay attached to their textures when their storage is respecified
+  GlExt::genBuffers(2, buffers);
+  glGenTextures(2, bufferTextures);
+  for (auto i = 0; i < 2; ++i)
+  {
+    GlExt::bindBuffer(GL_TEXTURE_BUFFER, buffers[i]);
+    GlExt::bufferData(GL_TEXTURE_BUFFER, sizeof(glm::vec4), nullptr, GL_STREAM_DRAW);
+    glBindTexture(GL_TEXTURE_BUFFER, bufferTextures[i]);
+    GlExt::texBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffers[i]);
+  }
+  glBindTexture(GL_TEXTURE_BUFFER, 0);
+  GlExt::bindBuffer(GL_TEXTURE_BUFFER, 0);
+
+  auto maxTexels = GLint{0};
+  glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+  maxInstances = static_cast<size_t>(std::max(maxTexels, InstanceTexels)) / InstanceTexels;
+  return true;
+}
+
+auto SpriteBatch::immediate() -> void
+{
+  flush();
+  glMatrixMode(GL_MODELVIEW);
+  glLoadMatrixf(glm::value_ptr(modelView_));
+}
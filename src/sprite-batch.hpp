@@ -0,0 +1,122 @@
+#pragma once
+#include <SDL_opengl.h>
+#include <cstddef>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+#include <vector>
+
+// Collects textured quads for the whole frame into one streaming vertex buffer. Vertices are
+// transformed on the CPU with the current model-view matrix, so quads sharing a texture end up in
+// a single draw call regardless of which node emitted them. A quad may also join an earlier run of
+// its texture when nothing queued in between overlaps it, which keeps the paint order visible on
+// screen while interleaved textures (eyes, mouth, body) still collapse into few binds.
+//
+// With GL 3.1 the quads are not expanded on the CPU: each model-view goes once into a texture
+// buffer, each quad becomes one instance that refers to it, and a shader builds the corners, so a
+// run is a single instanced draw. The overlap test still needs the screen bounds of every quad.
+//
+// A quad from a distance field has the distance to the edge in alpha rather than coverage: the
+// fixed function path cuts it with the alpha test at one half, the shader smooths the edge over
+// about a pixel.
+class SpriteBatch
+{
+public:
+  SpriteBatch() = default;
+  SpriteBatch(const SpriteBatch &) = delete;
+  ~SpriteBatch();
+
+  auto begin() -> void;
+  auto end() -> void;
+  auto flush() -> void;
+  // flushes pending quads and loads the current model-view into GL, so the caller can issue
+  // immediate-mode GL calls (outlines, gizmos) in node-local coordinates
+  auto immediate() -> void;
+  auto modelView() const -> const glm::mat4 & { return modelView_; }
+  auto modelView(const glm::mat4 &) -> void;
+  auto quad(GLuint texture,
+            glm::vec2 xy0,
+            glm::vec2 xy1,
+            glm::vec2 uv0,
+            glm::vec2 uv1,
+            glm::vec4 color = glm::vec4{1.f, 1.f, 1.f, 1.f},
+            bool distanceField = false) -> void;
+
+  // the shader path is used from the next begin() on when the context has it
+  auto instanced(bool) -> void;
+  auto isInstanced() const -> bool { return isInstanced_; }
+  auto canInstance() const -> bool;
+
+  auto binds() const -> int { return binds_; }
+  auto drawCalls() const -> int { return drawCalls_; }
+  auto quads() const -> int { return quads_; }
+
+  // how many runs back a quad looks for one with its texture
+  static constexpr auto MaxLookback = size_t{16};
+  // texels a quad takes in the instance buffer, and a model-view in the transform buffer
+  static constexpr auto InstanceTexels = 4;
+  static constexpr auto TransformTexels = 2;
+
+private:
+  struct Vertex
+  {
+    glm::vec2 xy;
+    glm::vec2 uv;
+    glm::vec4 color;
+  };
+  // the quad as queued, the corners are interpolated in the shader
+  struct Instance
+  {
+    glm::vec4 xy;
+    glm::vec4 uv;
+    glm::vec4 color;
+    // x is the index of the model-view, y is one for a distance field
+    glm::vec4 transform;
+  };
+  struct Run
+  {
+    GLuint texture;
+    bool distanceField;
+    // screen bounds of the run's quads, for the overlap test
+    glm::vec2 min;
+    glm::vec2 max;
+    std::vector<Vertex> vertices;
+    std::vector<Instance> instances;
+  };
+
+  glm::mat4 modelView_ = glm::mat4{1.f};
+  std::vector<Vertex> vertices;
+  // runs are reused between flushes so their vertex storage stays allocated
+  std::vector<Run> runs;
+  size_t runCount = 0;
+  GLuint vbo = 0;
+  bool wantInstanced = true;
+  bool isInstanced_ = false;
+  bool isProgramFailed = false;
+  // the axes then the origin of every model-view quads were queued with since the last flush
+  std::vector<glm::vec4> transforms;
+  bool isTransformQueued = false;
+  std::vector<Instance> instances;
+  size_t queuedInstances = 0;
+  size_t maxInstances = 0;
+  GLuint program = 0;
+  GLint projectionLoc = -1;
+  GLint firstLoc = -1;
+  GLint alphaRefLoc = -1;
+  // the corners of the quad every instance is drawn from
+  GLuint cornerVbo = 0;
+  // transforms, then instances
+  GLuint buffers[2] = {};
+  GLuint bufferTextures[2] = {};
+  int binds_ = 0;
+  int drawCalls_ = 0;
+  int quads_ = 0;
+  int frameBinds = 0;
+  int frameDrawCalls = 0;
+  int frameQuads = 0;
+
+  auto runFor(GLuint texture, bool distanceField, glm::vec2 min, glm::vec2 max) -> Run &;
+  auto initProgram() -> bool;
+  auto flushVertices() -> void;
+  auto flushInstances() -> void;
+};
@@ -8,7 +8,9 @@
 #include <spdlog/spdlog.h>
 
 SpriteSheet::SpriteSheet(Lib &lib, Undo &aUndo, const std::filesystem::path &path)
-  : undo(aUndo), texture(lib.queryTex([&]() {
+  : undo(aUndo),
+    batch(lib.spriteBatch()),
+    texture(lib.queryTex([&]() {
       try
       {
         if (!std::filesystem::exists(path.filename()))
@@ -26,25 +28,15 @@ SpriteSheet::SpriteSheet(Lib &lib, Undo &aUndo, const std::filesystem::path &pat
 
 auto SpriteSheet::render() -> void
 {
-  glEnable(GL_TEXTURE_2D);
-  glBindTexture(GL_TEXTURE_2D, texture->texture());
-  glBegin(GL_QUADS);
   const auto fCols = static_cast<float>(cols);
   const auto fRows = static_cast<float>(rows);
   const auto i = frame_ % cols / fCols;
   const auto j = (fRows - 1.f - frame_ / cols) / fRows;
-  glColor4f(1.f, 1.f, 1.f, 1.f);
-  glTexCoord2f(.0f + i, .0f + j);
-  glVertex2f(.0f, .0f);
-  glTexCoord2f(1.f / fCols + i, .0f + j);
-  glVertex2f(w(), .0f);
-  glTexCoord2f(1.f / fCols + i, 1.f / fRows + j);
-  glVertex2f(w(), h());
-  glTexCoord2f(.0f + i, 1.f / fRows + j);
-  glVertex2f(.0f, h());
-  glEnd();
-  glBindTexture(GL_TEXTURE_2D, 0);
-  glDisable(GL_TEXTURE_2D);
+  batch.get().quad(texture->texture(),
+                   glm::vec2{.0f, .0f},
+                   glm::vec2{w(), h()},
+                   glm::vec2{.0f + i, .0f + j},
+                   glm::vec2{1.f / fCols + i, 1.f / fRows + j});
 }
 
 auto SpriteSheet::renderUi() -> void
@@ -84,6 +76,11 @@ auto SpriteSheet::w() const -> float
   return 1.f * texture->w() / cols;
 }
 
+auto SpriteSheet::textureBytes(Node::Counted &) const -> size_t
+{
+  return texture && texture.use_count() == 1 ? texture->bytes() : 0;
+}
+
 auto SpriteSheet::h() const -> float
 {
   return 1.f * texture->h() / rows;
@@ -98,10 +95,7 @@ auto SpriteSheet::isTransparent(glm::vec2 v) const -> bool
   if (x < 0 || x >= texture->w() || y < 0 || y >= texture->h())
     return true;
 
-  if (auto imageData = texture->imageData())
-    return imageData[(x + y * texture->w()) * texture->ch() + 3] < 127;
-  else
-    return false;
+  return texture->isTransparent(x, y);
 }
 
 auto SpriteSheet::frame(int v) -> void
@@ -27,10 +27,13 @@ public:
   auto render() -> void;
   auto renderUi() -> void;
   auto save(OStrm &) const -> void;
+  // memory of the textures nobody else holds
+  auto textureBytes(Node::Counted &) const -> size_t;
   auto w() const -> float;
 
 private:
   std::reference_wrapper<Undo> undo;
+  std::reference_wrapper<SpriteBatch> batch;
   int cols = 1;
   int rows = 1;
   int frame_ = 0;
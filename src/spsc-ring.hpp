@@ -0,0 +1,65 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed capacity single-producer/single-consumer queue. Neither side locks or allocates, so the
+// producer can be a real-time audio callback. When the consumer falls behind the newest items are
+// dropped and counted in overruns().
+template <typename T>
+class SpscRing
+{
+public:
+  explicit SpscRing(size_t minCapacity)
+    : buf(std::bit_ceil(std::max(minCapacity, size_t{2}))), mask(buf.size() - 1)
+  {
+  }
+  SpscRing(const SpscRing &) = delete;
+
+  // producer side, returns how many items were queued
+  auto push(const T *data, size_t n) -> size_t
+  {
+    const auto h = head.load(std::memory_order_relaxed);
+    const auto t = tail.load(std::memory_order_acquire);
+    const auto count = std::min(n, buf.size() - (h - t));
+    const auto first = std::min(count, buf.size() - (h & mask));
+    std::copy_n(data, first, buf.data() + (h & mask));
+    std::copy_n(data + first, count - first, buf.data());
+    head.store(h + count, std::memory_order_release);
+    if (count < n)
+      overruns_.fetch_add(n - count, std::memory_order_relaxed);
+    return count;
+  }
+
+  // consumer side, returns how many items were copied out
+  auto pop(T *out, size_t n) -> size_t
+  {
+    const auto t = tail.load(std::memory_order_relaxed);
+    const auto h = head.load(std::memory_order_acquire);
+    const auto count = std::min(n, h - t);
+    const auto first = std::min(count, buf.size() - (t & mask));
+    std::copy_n(buf.data() + (t & mask), first, out);
+    std::copy_n(buf.data(), count - first, out + first);
+    tail.store(t + count, std::memory_order_release);
+    return count;
+  }
+
+  // exact on the consumer side, a lower bound on the producer side
+  auto size() const -> size_t
+  {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+  auto capacity() const -> size_t { return buf.size(); }
+  auto overruns() const -> uint64_t { return overruns_.load(std::memory_order_relaxed); }
+
+private:
+  std::vector<T> buf;
+  size_t mask;
+  // the indices only ever grow, the wrap around of size_t is harmless for power of two sizes
+  alignas(64) std::atomic<size_t> head = 0;
+  alignas(64) std::atomic<size_t> tail = 0;
+  std::atomic<uint64_t> overruns_ = 0;
+};
@@ -0,0 +1,41 @@
+#include "sse-parser.hpp"
+
+SseParser::SseParser(Callback aOnEvent) : onEvent(std::move(aOnEvent)) {}
+
+auto SseParser::push(std::string_view chunk) -> void
+{
+  for (auto eol = chunk.find('\n'); eol != std::string_view::npos; eol = chunk.find('\n'))
+  {
+    line += chunk.substr(0, eol);
+    chunk.remove_prefix(eol + 1);
+    onLine();
+  }
+  line += chunk;
+}
+
+auto SseParser::onLine() -> void
+{
+  auto v = std::string_view{line};
+  if (!v.empty() && v.back() == '\r')
+    v.remove_suffix(1);
+  if (v.empty())
+  {
+    // a blank line ends the event
+    if (hasData)
+      onEvent(data);
+    data.clear();
+    hasData = false;
+  }
+  else if (v.starts_with("data:"))
+  {
+    v.remove_prefix(5);
+    if (!v.empty() && v.front() == ' ')
+      v.remove_prefix(1);
+    if (hasData)
+      data += '\n';
+    data += v;
+    hasData = true;
+  }
+  // comments, event names, ids and retry hints are not used
+  line.clear();
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+
+// Splits a text/event-stream body into events while it downloads; chunks may end anywhere, even
+// inside a line. Only the data field is kept, the data lines of one event are joined with '\n'.
+class SseParser
+{
+public:
+  using Callback = std::move_only_function<void(std::string_view data)>;
+  SseParser(Callback);
+  auto push(std::string_view) -> void;
+
+private:
+  Callback onEvent;
+  std::string line;
+  std::string data;
+  bool hasData = false;
+
+  auto onLine() -> void;
+};
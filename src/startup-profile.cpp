@@ -0,0 +1,27 @@
+#include "startup-profile.hpp"
+#include <fmt/format.h>
+#include <spdlog/spdlog.h>
+
+StartupProfile::Mark::Mark(StartupProfile &profile, const char *phase)
+{
+  profile.mark(phase);
+}
+
+StartupProfile::StartupProfile() : start(Clock::now()), last(start) {}
+
+auto StartupProfile::mark(const char *phase) -> void
+{
+  const auto now = Clock::now();
+  phases.push_back(Phase{phase, now - last});
+  last = now;
+}
+
+auto StartupProfile::done() -> void
+{
+  using Ms = std::chrono::duration<double, std::milli>;
+  auto line = std::string{};
+  for (const auto &p : phases)
+    line += fmt::format(", {} {:.1f} ms", p.name, Ms{p.duration}.count());
+  SPDLOG_INFO("startup {:.1f} ms{}", Ms{last - start}.count(), line);
+  phases.clear();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <chrono>
+#include <vector>
+
+// Times the phases of the startup and logs them in one line once done() is called. A phase ends
+// at its mark, so marks can also sit between members to time their construction.
+class StartupProfile
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // a member that marks the phase made of the members declared before it
+  struct Mark
+  {
+    Mark(StartupProfile &, const char *phase);
+  };
+
+  StartupProfile();
+  auto mark(const char *phase) -> void;
+  auto done() -> void;
+
+private:
+  struct Phase
+  {
+    const char *name;
+    Clock::duration duration;
+  };
+
+  Clock::time_point start;
+  Clock::time_point last;
+  std::vector<Phase> phases;
+};
@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string_view>
+
+// A speech recognizer AiMouth hands the host's talking to, one stream per stretch of speech its
+// voice activity detection cut out. Transcripts come back in the order the streams were opened.
+class SttBackend
+{
+public:
+  using Callback = std::move_only_function<void(std::string_view)>;
+
+  class Stream
+  {
+  public:
+    virtual ~Stream() = default;
+    virtual auto push(std::span<const int16_t>) -> void = 0;
+    virtual auto finish() -> void = 0;
+    // drops the segment, the callback is never called and later transcripts do not wait for it
+    virtual auto cancel() -> void = 0;
+    // the transcript was delivered or the request was given up or cancelled
+    virtual auto done() const -> bool = 0;
+  };
+
+  virtual ~SttBackend() = default;
+  // onPartial gets the words recognized so far while the speaker is still talking, from the
+  // backends that have them
+  virtual auto stream(int sampleRate, Callback, Callback onPartial = nullptr) -> std::shared_ptr<Stream> = 0;
+  // false while the backend gets ready to recognize, its streams wait until then
+  virtual auto isReady() const -> bool { return true; }
+  // the samples are taken before perform() returns, they do not need to outlive it
+  auto perform(std::span<const int16_t> wav, int sampleRate, Callback cb) -> std::shared_ptr<Stream>
+  {
+    auto ret = stream(sampleRate, std::move(cb));
+    ret->push(wav);
+    ret->finish();
+    return ret;
+  }
+};
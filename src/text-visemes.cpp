@@ -0,0 +1,105 @@
+#include "text-visemes.hpp"
+#include "audio-kernels.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+  auto lower(std::string_view text, size_t i) -> int
+  {
+    return i < text.size() ? std::tolower(static_cast<unsigned char>(text[i])) : 0;
+  }
+
+  // th, ch and sh
+  auto isDigraph(std::string_view text, size_t i) -> bool
+  {
+    const auto c = lower(text, i);
+    return (c == 't' || c == 'c' || c == 's') && lower(text, i + 1) == 'h';
+  }
+
+  auto letterViseme(std::string_view text, size_t i) -> Viseme
+  {
+    const auto c = lower(text, i);
+    const auto next = lower(text, i + 1);
+    switch (c)
+    {
+    case 'a': return Viseme::aa;
+    case 'e': return Viseme::E;
+    case 'i':
+    case 'y': return Viseme::I;
+    case 'o': return Viseme::O;
+    case 'u':
+    case 'w': return Viseme::U;
+    case 'b':
+    case 'm':
+    case 'p': return Viseme::PP;
+    case 'f':
+    case 'v': return Viseme::FF;
+    case 't': return next == 'h' ? Viseme::TH : Viseme::DD;
+    case 'd': return Viseme::DD;
+    case 'c': return next == 'h' ? Viseme::CH : Viseme::kk;
+    case 's': return next == 'h' ? Viseme::CH : Viseme::SS;
+    case 'g':
+    case 'k':
+    case 'q': return Viseme::kk;
+    case 'h':
+    case 'j': return Viseme::CH;
+    case 'x':
+    case 'z': return Viseme::SS;
+    case 'l':
+    case 'n': return Viseme::nn;
+    case 'r': return Viseme::RR;
+    default: return Viseme::sil;
+    }
+  }
+
+  // windows quieter than this RMS count as pauses
+  constexpr auto VoicedRms = 300.f;
+} // namespace
+
+TextVisemes::TextVisemes(std::string_view text, int sampleRate, float lettersPerSecond)
+  : window(static_cast<size_t>(sampleRate * WindowMs / 1000)), lettersPerWindow(lettersPerSecond * WindowMs / 1000.f)
+{
+  for (auto i = size_t{0}; i < text.size(); ++i)
+  {
+    if (!std::isalpha(static_cast<unsigned char>(text[i])))
+      continue;
+    letters.push_back(letterViseme(text, i));
+    if (isDigraph(text, i))
+      ++i;
+  }
+}
+
+auto TextVisemes::voiced(const Wav &wav) const -> std::vector<bool>
+{
+  auto ret = std::vector<bool>{};
+  if (window == 0)
+    return ret;
+  for (auto i = size_t{0}; i < wav.size(); i += window)
+    ret.push_back(AudioKernels::levels(wav.data() + i, std::min(window, wav.size() - i)).rms > VoicedRms);
+  return ret;
+}
+
+auto TextVisemes::cues(const Wav &wav) -> std::vector<VisemeCue>
+{
+  auto ret = std::vector<VisemeCue>{};
+  if (letters.empty())
+    return ret;
+  auto emit = [&](Viseme v, size_t offset) {
+    if (ret.empty() || ret.back().viseme != v)
+      ret.push_back(VisemeCue{v, offset});
+  };
+  const auto v = voiced(wav);
+  for (auto w = size_t{0}; w < v.size(); ++w)
+  {
+    if (!v[w])
+    {
+      emit(Viseme::sil, w * window);
+      continue;
+    }
+    // the letter that falls on this share of the voiced time
+    emit(letters[std::min(static_cast<size_t>(pos), letters.size() - 1)], w * window);
+    pos += lettersPerWindow;
+  }
+  return ret;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "viseme-cue.hpp"
+#include "wav.hpp"
+#include <string_view>
+#include <vector>
+
+// Lip sync cues for synthesized speech when the text is known. Letters are mapped to visemes and
+// spread over the voiced part of the audio, pauses in the audio close the mouth. It is an
+// approximation, but it costs nothing compared to running the recognizer on the clip.
+class TextVisemes
+{
+public:
+  TextVisemes(std::string_view text, int sampleRate, float lettersPerSecond = LettersPerSecond);
+  // cues for the next stretch of the audio while it is still arriving, the offsets are relative to
+  // its start
+  auto cues(const Wav &) -> std::vector<VisemeCue>;
+
+  // typical pace of the neural voices, used while the length of the speech is not known yet
+  static constexpr auto LettersPerSecond = 14.f;
+  static constexpr auto WindowMs = 10;
+
+private:
+  std::vector<Viseme> letters;
+  size_t window;
+  float lettersPerWindow;
+  float pos = 0.f;
+
+  auto voiced(const Wav &) const -> std::vector<bool>;
+};
@@ -0,0 +1,191 @@
+#include "texture-cache.hpp"
+#include "file.hpp"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+#include <string>
+
+namespace TextureCache
+{
+  namespace
+  {
+    constexpr uint32_t Magic = 0x32435456; // "VTC2"
+
+    struct Header
+    {
+      uint32_t magic = Magic;
+      uint32_t flip = 0;
+      int32_t w = 0;
+      int32_t h = 0;
+      int32_t ch = 0;
+      uint32_t pathLen = 0;
+      int64_t mtime = 0;
+      uint64_t size = 0;
+      // of the pixels, for TextureDedup
+      uint64_t hash = 0;
+    };
+
+    struct Key
+    {
+      std::string path;
+      int64_t mtime = 0;
+      uint64_t size = 0;
+    };
+
+    auto key(const std::filesystem::path &src) -> std::optional<Key>
+    {
+      auto ec = std::error_code{};
+      auto abs = std::filesystem::absolute(src, ec);
+      if (ec)
+        return std::nullopt;
+      const auto size = std::filesystem::file_size(abs, ec);
+      if (ec)
+        return std::nullopt;
+      const auto mtime = std::filesystem::last_write_time(abs, ec);
+      if (ec)
+        return std::nullopt;
+      return Key{abs.string(),
+                 static_cast<int64_t>(mtime.time_since_epoch().count()),
+                 static_cast<uint64_t>(size)};
+    }
+
+    auto entryPath(const std::filesystem::path &cacheDir, const Key &k, bool flip) -> std::filesystem::path
+    {
+      return cacheDir / fmt::format("{:016x}{}.bin", std::hash<std::string>{}(k.path), flip ? "f" : "");
+    }
+
+    // a temporary younger than this may still be written
+    constexpr auto TmpGrace = std::chrono::minutes{1};
+
+    auto isCurrent(const std::filesystem::path &entry) -> bool
+    {
+      auto fp = open_file(entry, "rb");
+      if (!fp)
+        return true;
+      auto header = Header{};
+      if (std::fread(&header, sizeof(header), 1, fp.get()) != 1 || header.magic != Magic)
+        return false;
+      auto path = std::string(header.pathLen, '\0');
+      if (std::fread(path.data(), 1, path.size(), fp.get()) != path.size())
+        return false;
+      const auto k = key(path);
+      return k && k->mtime == header.mtime && k->size == header.size;
+    }
+  } // namespace
+
+  auto dir() -> std::filesystem::path
+  {
+    return std::filesystem::current_path() / ".cache" / "textures";
+  }
+
+  auto load(const std::filesystem::path &cacheDir, const std::filesystem::path &src, bool flip)
+    -> std::optional<Texture::Decoded>
+  {
+    const auto k = key(src);
+    if (!k)
+      return std::nullopt;
+    auto fp = open_file(entryPath(cacheDir, *k, flip), "rb");
+    if (!fp)
+      return std::nullopt;
+    auto header = Header{};
+    if (std::fread(&header, sizeof(header), 1, fp.get()) != 1)
+      return std::nullopt;
+    if (header.magic != Magic || header.flip != (flip ? 1u : 0u) || header.mtime != k->mtime ||
+        header.size != k->size || header.pathLen != k->path.size() || header.w <= 0 || header.h <= 0)
+      return std::nullopt;
+    auto path = std::string(header.pathLen, '\0');
+    if (std::fread(path.data(), 1, path.size(), fp.get()) != path.size() || path != k->path)
+      return std::nullopt;
+    const auto bytes = static_cast<size_t>(header.w) * header.h * 4;
+    // allocated with malloc so the buffer can be released with stbi_image_free like a decoded one
+    auto data = static_cast<unsigned char *>(std::malloc(bytes));
+    if (!data)
+      return std::nullopt;
+    if (std::fread(data, 1, bytes, fp.get()) != bytes)
+    {
+      std::free(data);
+      return std::nullopt;
+    }
+    auto ret = Texture::Decoded{};
+    ret.data = data;
+    ret.w = header.w;
+    ret.h = header.h;
+    ret.ch = header.ch;
+    ret.hash = header.hash;
+    return ret;
+  }
+
+  auto store(const std::filesystem::path &cacheDir,
+             const std::filesystem::path &src,
+             bool flip,
+             const Texture::Decoded &decoded) -> void
+  {
+    const auto k = key(src);
+    if (!k || !decoded.data)
+      return;
+    auto ec = std::error_code{};
+    std::filesystem::create_directories(cacheDir, ec);
+    if (ec)
+    {
+      SPDLOG_ERROR("Cannot create texture cache {:?}: {}", cacheDir, ec.message());
+      return;
+    }
+    const auto entry = entryPath(cacheDir, *k, flip);
+    // written under a temporary name and renamed so a concurrent reader never sees half an entry
+    const auto tmp = temp_path_for(entry);
+    {
+      auto fp = open_file(tmp, "wb");
+      if (!fp)
+        return;
+      auto header = Header{};
+      header.flip = flip ? 1 : 0;
+      header.w = decoded.w;
+      header.h = decoded.h;
+      header.ch = decoded.ch;
+      header.pathLen = static_cast<uint32_t>(k->path.size());
+      header.mtime = k->mtime;
+      header.size = k->size;
+      header.hash = decoded.hash;
+      const auto bytes = static_cast<size_t>(decoded.w) * decoded.h * 4;
+      if (std::fwrite(&header, sizeof(header), 1, fp.get()) != 1 ||
+          std::fwrite(k->path.data(), 1, k->path.size(), fp.get()) != k->path.size() ||
+          std::fwrite(decoded.data, 1, bytes, fp.get()) != bytes)
+      {
+        fp.reset();
+        std::filesystem::remove(tmp, ec);
+        return;
+      }
+    }
+    std::filesystem::rename(tmp, entry, ec);
+    if (ec)
+    {
+      SPDLOG_ERROR("Cannot write texture cache entry {:?}: {}", entry, ec.message());
+      std::filesystem::remove(tmp, ec);
+    }
+  }
+
+  auto prune(const std::filesystem::path &cacheDir) -> uintmax_t
+  {
+    auto ret = uintmax_t{0};
+    auto ec = std::error_code{};
+    const auto tmpBefore = std::filesystem::file_time_type::clock::now() - TmpGrace;
+    for (auto it = std::filesystem::directory_iterator{cacheDir, ec}; !ec && it != std::filesystem::directory_iterator{};
+         it.increment(ec))
+    {
+      auto fileEc = std::error_code{};
+      if (!it->is_regular_file(fileEc))
+        continue;
+      const auto &entry = it->path();
+      const auto stale =
+        entry.extension() == ".bin" ? !isCurrent(entry) : it->last_write_time(fileEc) < tmpBefore && !fileEc;
+      if (!stale)
+        continue;
+      const auto bytes = it->file_size(fileEc);
+      if (std::filesystem::remove(entry, fileEc) && bytes != static_cast<uintmax_t>(-1))
+        ret += bytes;
+    }
+    return ret;
+  }
+} // namespace TextureCache
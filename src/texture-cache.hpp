@@ -0,0 +1,24 @@
+#pragma once
+#include "texture.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+// Project-local store of already decoded RGBA pixels and their hash, one entry per source image,
+// keyed by the absolute path, file size, modification time and flip. A hit is a header check plus
+// one read straight into the upload buffer; a miss decodes as usual and writes the entry for the
+// next run.
+// load() and store() are called from the texture decode workers, prune() from any worker.
+namespace TextureCache
+{
+  auto dir() -> std::filesystem::path;
+  auto load(const std::filesystem::path &cacheDir, const std::filesystem::path &src, bool flip)
+    -> std::optional<Texture::Decoded>;
+  auto store(const std::filesystem::path &cacheDir,
+             const std::filesystem::path &src,
+             bool flip,
+             const Texture::Decoded &) -> void;
+  // removes the entries of images that were deleted or changed, and the temporaries of writes
+  // that never finished; returns the bytes freed
+  auto prune(const std::filesystem::path &cacheDir) -> uintmax_t;
+} // namespace TextureCache
@@ -0,0 +1,53 @@
+#include "texture-dedup.hpp"
+#include <cstring>
+
+auto TextureDedup::find(const Key &key, const unsigned char *pixels) -> std::shared_ptr<Texture::Image>
+{
+  auto it = images.find(key);
+  if (it == std::end(images))
+    return nullptr;
+  auto ret = it->second.lock();
+  if (!ret)
+  {
+    images.erase(it);
+    return nullptr;
+  }
+  // the hash only narrows it down, two images colliding must not show each other's pixels
+  const auto size = static_cast<size_t>(key.w) * static_cast<size_t>(key.h) * static_cast<size_t>(key.ch);
+  if (!pixels || !ret->data || ret->w != key.w || ret->h != key.h || std::memcmp(ret->data, pixels, size) != 0)
+    return nullptr;
+  return ret;
+}
+
+auto TextureDedup::add(const Key &key, std::shared_ptr<Texture::Image> image) -> void
+{
+  // the uploads of released textures are only found stale here, so they go when new ones come
+  std::erase_if(images, [](const auto &i) { return i.second.expired(); });
+  images[key] = std::move(image);
+}
+
+auto TextureDedup::saved() const -> size_t
+{
+  auto ret = size_t{0};
+  for (const auto &[key, image] : images)
+    if (const auto n = image.use_count(); n > 1)
+      ret += static_cast<size_t>(n - 1) * static_cast<size_t>(key.w) * static_cast<size_t>(key.h) * 4;
+  return ret;
+}
+
+auto TextureDedup::hash(const unsigned char *data, size_t size) -> uint64_t
+{
+  // a word at a time, the pixels of a big image are tens of megabytes
+  auto ret = uint64_t{0xcbf29ce484222325u} ^ size;
+  auto i = size_t{0};
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+  {
+    auto word = uint64_t{};
+    std::memcpy(&word, data + i, sizeof(word));
+    ret = (ret ^ word) * 0x9e3779b97f4a7c15u;
+    ret ^= ret >> 29;
+  }
+  for (; i < size; ++i)
+    ret = (ret ^ data[i]) * 1099511628211u;
+  return ret != 0 ? ret : 1;
+}
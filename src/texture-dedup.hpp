@@ -0,0 +1,40 @@
+#pragma once
+#include "texture.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+// Finds the upload of an identical image among the live textures, so the same PNG copied into
+// several folders, or the repeated frames of an ImageList, are on the GPU once. Keyed by a hash of
+// the decoded pixels, computed on the decode worker and kept in the texture cache entries; a hit is
+// only shared once its pixels compare equal, so an upload that kept no pixels, an RGB or compacted
+// one, is not shared. Main thread only, apart from hash().
+class TextureDedup
+{
+public:
+  struct Key
+  {
+    uint64_t hash = 0;
+    int w = 0;
+    int h = 0;
+    int ch = 0;
+    auto operator==(const Key &) const -> bool = default;
+  };
+
+  // the upload of the same pixels, w * h * ch bytes of them
+  auto find(const Key &, const unsigned char *pixels) -> std::shared_ptr<Texture::Image>;
+  auto add(const Key &, std::shared_ptr<Texture::Image>) -> void;
+  // GPU bytes the textures sharing an upload did not upload again
+  auto saved() const -> size_t;
+
+  // never 0, which stands for not hashed
+  static auto hash(const unsigned char *, size_t) -> uint64_t;
+
+private:
+  struct KeyHash
+  {
+    auto operator()(const Key &k) const -> size_t { return static_cast<size_t>(k.hash); }
+  };
+  std::unordered_map<Key, std::weak_ptr<Texture::Image>, KeyHash> images;
+};
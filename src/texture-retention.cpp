@@ -0,0 +1,52 @@
+#include "texture-retention.hpp"
+#include "texture.hpp"
+
+auto TextureRetention::setBudget(size_t v) -> void
+{
+  budget = v;
+  shrink(budget);
+}
+
+auto TextureRetention::retain(std::shared_ptr<Texture> texture) -> void
+{
+  if (budget == 0)
+    return;
+  const auto raw = texture.get();
+  lru.push_front(std::move(texture));
+  pos[raw] = std::begin(lru);
+  shrink(budget);
+}
+
+auto TextureRetention::take(const Texture *texture) -> bool
+{
+  auto it = pos.find(texture);
+  if (it == std::end(pos))
+    return false;
+  lru.erase(it->second);
+  pos.erase(it);
+  return true;
+}
+
+auto TextureRetention::shrink(size_t keep) -> size_t
+{
+  // a reload or the CPU budget may have changed what a retained texture holds, so it is summed here
+  auto total = bytes();
+  auto ret = size_t{0};
+  while (total > keep && !lru.empty())
+  {
+    const auto freed = lru.back()->bytes();
+    total -= freed;
+    ret += freed;
+    pos.erase(lru.back().get());
+    lru.pop_back();
+  }
+  return ret;
+}
+
+auto TextureRetention::bytes() const -> size_t
+{
+  auto ret = size_t{0};
+  for (const auto &t : lru)
+    ret += t->bytes();
+  return ret;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+class Texture;
+
+// Textures nobody holds any more, kept on the GPU up to a byte budget so that undo, re-adding a
+// sprite or switching back to the other outfit finds them uploaded. Least recently released go
+// first. Lib hands textures out through handles whose last release gives the texture here.
+// Main thread only.
+class TextureRetention
+{
+public:
+  auto setBudget(size_t) -> void;
+  // the least recently released are evicted once over the budget, with a budget of 0 at once
+  auto retain(std::shared_ptr<Texture>) -> void;
+  // takes a retained texture back out of the LRU, false when it is not in it
+  auto take(const Texture *) -> bool;
+  // evicts until at most keep bytes are retained; returns the bytes freed
+  auto shrink(size_t keep) -> size_t;
+  auto bytes() const -> size_t;
+  auto size() const -> size_t { return lru.size(); }
+
+private:
+  using Lru = std::list<std::shared_ptr<Texture>>;
+  // most recently released at the front
+  Lru lru;
+  std::unordered_map<const Texture *, Lru::iterator> pos;
+  size_t budget = 0;
+};
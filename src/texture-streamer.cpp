@@ -0,0 +1,53 @@
+#include "texture-streamer.hpp"
+#include "trace.hpp"
+
+TextureStreamer::TextureStreamer(uv::Uv &aUv) : uv_(aUv), alive(std::make_shared<TextureStreamer *>(this)) {}
+
+TextureStreamer::~TextureStreamer()
+{
+  *alive = nullptr;
+}
+
+auto TextureStreamer::add(const void *owner, Start start) -> void
+{
+  remove(owner);
+  queue.push_back(Entry{owner, std::move(start)});
+  index.emplace(owner, std::prev(std::end(queue)));
+  pump();
+}
+
+auto TextureStreamer::prioritize(const void *owner) -> void
+{
+  auto it = index.find(owner);
+  if (it == std::end(index))
+    return;
+  queue.splice(std::begin(queue), queue, it->second);
+}
+
+auto TextureStreamer::remove(const void *owner) -> void
+{
+  auto it = index.find(owner);
+  if (it == std::end(index))
+    return;
+  queue.erase(it->second);
+  index.erase(it);
+}
+
+auto TextureStreamer::pump() -> void
+{
+  while (inFlight < MaxInFlight && !queue.empty())
+  {
+    auto entry = std::move(queue.front());
+    index.erase(entry.owner);
+    queue.pop_front();
+    ++inFlight;
+    Trace::counter("textures waiting", static_cast<double>(queue.size()));
+    entry.start([alive = alive]() {
+      auto self = *alive;
+      if (!self)
+        return;
+      --self->inFlight;
+      self->pump();
+    });
+  }
+}
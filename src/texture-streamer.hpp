@@ -0,0 +1,50 @@
+#pragma once
+#include "texture-uploader.hpp"
+#include "uv.hpp"
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Hands texture decodes to the uv thread pool a few at a time. The pool queue is first in first
+// out, and a big project would fill it with hundreds of decodes; held back here, the textures the
+// frame actually draws can still jump ahead of the rest, and the pool stays free for other work.
+// The decoded pixels then go through the uploader, a few megabytes a frame. Main thread only.
+class TextureStreamer
+{
+public:
+  // starts the decode and calls finished from its after callback, cancelled or not
+  using Finished = std::move_only_function<auto()->void>;
+  using Start = std::move_only_function<auto(Finished)->void>;
+
+  TextureStreamer(uv::Uv &);
+  ~TextureStreamer();
+  TextureStreamer(const TextureStreamer &) = delete;
+  auto operator=(const TextureStreamer &) -> TextureStreamer & = delete;
+  auto uv() -> uv::Uv & { return uv_; }
+  auto uploader() -> TextureUploader & { return uploader_; }
+  // queues behind everything else, replacing a decode the owner still has waiting
+  auto add(const void *owner, Start) -> void;
+  // moves the owner's waiting decode to the front, a no-op once it has started
+  auto prioritize(const void *owner) -> void;
+  auto remove(const void *owner) -> void;
+  auto waiting() const -> size_t { return queue.size(); }
+
+  static constexpr auto MaxInFlight = 3;
+
+private:
+  struct Entry
+  {
+    const void *owner;
+    Start start;
+  };
+
+  std::reference_wrapper<uv::Uv> uv_;
+  std::list<Entry> queue;
+  std::unordered_map<const void *, std::list<Entry>::iterator> index;
+  int inFlight = 0;
+  TextureUploader uploader_;
+  std::shared_ptr<TextureStreamer *> alive;
+
+  auto pump() -> void;
+};
@@ -0,0 +1,82 @@
+#include "texture-uploader.hpp"
+#include "gl-ext.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <cstring>
+
+TextureUploader::~TextureUploader()
+{
+  if (pbos[0] != 0)
+    GlExt::deleteBuffers(2, pbos);
+}
+
+auto TextureUploader::add(const void *owner, GLuint texture, const unsigned char *pixels, int w, int h, int ch, Done done)
+  -> void
+{
+  cancel(owner);
+  jobs.push_back(Job{owner, texture, pixels, w, h, ch, 0, std::move(done)});
+}
+
+auto TextureUploader::cancel(const void *owner) -> void
+{
+  std::erase_if(jobs, [owner](const auto &job) { return job.owner == owner; });
+}
+
+auto TextureUploader::pump(size_t budget) -> bool
+{
+  if (jobs.empty())
+    return false;
+  auto span = Trace::Span{"texture uploads"};
+  if (pbos[0] == 0)
+    GlExt::genBuffers(2, pbos);
+  auto left = budget;
+  while (!jobs.empty() && left > 0)
+  {
+    auto &job = jobs.front();
+    const auto rowBytes = static_cast<size_t>(job.w) * static_cast<size_t>(job.ch);
+    // at least a row, so an image wider than the budget still gets there
+    const auto rows = std::clamp(static_cast<int>(left / rowBytes), 1, job.h - job.row);
+    const auto bytes = rowBytes * static_cast<size_t>(rows);
+    const auto src = job.pixels + rowBytes * static_cast<size_t>(job.row);
+
+    GlExt::bindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPbo]);
+    nextPbo = 1 - nextPbo;
+    // respecifying the store orphans the one the driver may still be reading
+    GlExt::bufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(bytes), nullptr, GL_STREAM_DRAW);
+    const auto dst = GlExt::mapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+    if (dst)
+    {
+      std::memcpy(dst, src, bytes);
+      GlExt::unmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    else
+      // the buffer could not be mapped, the rows go from client memory instead
+      GlExt::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, job.texture);
+    // the rows of packed RGB are not 4 byte aligned
+    if (job.ch == 3)
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D,
+                    0,
+                    0,
+                    job.row,
+                    job.w,
+                    rows,
+                    job.ch == 4 ? GL_RGBA : GL_RGB,
+                    GL_UNSIGNED_BYTE,
+                    dst ? nullptr : src);
+    if (job.ch == 3)
+      glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    GlExt::bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    job.row += rows;
+    left -= std::min(left, bytes);
+    if (job.row < job.h)
+      continue;
+    auto done = std::move(job.done);
+    jobs.pop_front();
+    done();
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+  Trace::counter("texture uploads", static_cast<double>(jobs.size()));
+  return !jobs.empty();
+}
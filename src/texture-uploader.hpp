@@ -0,0 +1,48 @@
+#pragma once
+#include <SDL_opengl.h>
+#include <cstddef>
+#include <deque>
+#include <functional>
+
+// Copies decoded pixels into their textures a band of rows at a time, through a pixel buffer
+// object so glTexSubImage2D returns as soon as the copy is queued and the driver moves the rows
+// to the GPU on its own. pump() runs once per frame under a byte budget, which keeps a 4K image or
+// a project's worth of textures from landing in one frame. Main thread only.
+class TextureUploader
+{
+public:
+  // called from pump() once the last row is in
+  using Done = std::move_only_function<auto()->void>;
+
+  TextureUploader() = default;
+  TextureUploader(const TextureUploader &) = delete;
+  ~TextureUploader();
+  // the texture has its storage already; the pixels stay valid until done runs or the owner
+  // cancels, and a new upload of the owner replaces its pending one
+  auto add(const void *owner, GLuint texture, const unsigned char *pixels, int w, int h, int ch, Done) -> void;
+  auto cancel(const void *owner) -> void;
+  // true while uploads are left for the next frame
+  auto pump(size_t budget = BytesPerFrame) -> bool;
+  auto pending() const -> size_t { return jobs.size(); }
+
+  // what a frame uploads at most, unless a single row is larger
+  static constexpr auto BytesPerFrame = size_t{8} << 20;
+
+private:
+  struct Job
+  {
+    const void *owner;
+    GLuint texture;
+    const unsigned char *pixels;
+    int w;
+    int h;
+    int ch;
+    int row = 0;
+    Done done;
+  };
+
+  std::deque<Job> jobs;
+  // alternated so a band does not wait for the previous one to be read
+  GLuint pbos[2] = {};
+  int nextPbo = 0;
+};
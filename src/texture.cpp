@@ -1,10 +1,19 @@
 #include "texture.hpp"
 #include "file.hpp"
+#include "gl-ext.hpp"
+#include "pixel-kernels.hpp"
+#include "texture-cache.hpp"
+#include "texture-dedup.hpp"
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cerrno>
+#include <cstring>
 #include <fmt/std.h>
 #include <sdlpp/sdlpp.hpp>
 #include <spdlog/spdlog.h>
 #include <stdio.h>
+#include <vector>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdisabled-macro-expansion"
@@ -14,99 +23,240 @@
 #include <stb_image.h>
 #pragma GCC diagnostic pop
 
-Texture::Texture(uv::Uv &uv, std::string aPath, bool isUi)
-  : path_(std::move(aPath)),
-    imageData_([&]() {
-      stbi_set_flip_vertically_on_load(!isUi ? 1 : 0);
-      if (path_.find("engine:") != 0)
-      {
-        try
-        {
-          auto ret = stbi_load(path_.c_str(), &w_, &h_, &ch_, STBI_rgb_alpha);
-          if (!ret)
-            throw std::runtime_error(fmt::format("Error loading image from {:?}: {}", path_, stbi_failure_reason()));
+struct Texture::Decoded
+{
+  unsigned char *data = nullptr;
+  // of the pixels
+  int w = 0;
+  int h = 0;
+  // of the image before it was scaled down, what the nodes lay out with; 0 when not scaled
+  int srcW = 0;
+  int srcH = 0;
+  int ch = 4;
+  AlphaMask alphaMask;
+  // of the pixels, 0 when unknown
+  uint64_t hash = 0;
+};
 
-          return ret;
-        }
-        catch (std::runtime_error &e)
-        {
-          SPDLOG_ERROR("{:t}", e);
-          auto engineImgPath = sdl::get_base_path() / "assets/corrupted.png";
-          auto fp = open_file(engineImgPath, "rb");
-          auto ret = stbi_load_from_file(fp.get(), &w_, &h_, &ch_, STBI_rgb_alpha);
-          if (!ret)
-            throw std::runtime_error(fmt::format("Error loading image from {:?}: {}", engineImgPath, stbi_failure_reason()));
+namespace
+{
+  auto resolvePath(const std::string &path) -> std::filesystem::path
+  {
+    if (path.find("engine:") != 0)
+      return path;
+    return sdl::get_base_path() / "assets" / path.substr(7);
+  }
 
-          return ret;
+  auto flipRows(Texture::Decoded &decoded) -> void
+  {
+    const auto stride = static_cast<size_t>(decoded.w) * 4;
+    auto tmp = std::vector<unsigned char>(stride);
+    for (auto y = 0; y < decoded.h / 2; ++y)
+    {
+      auto a = decoded.data + y * stride;
+      auto b = decoded.data + (decoded.h - 1 - y) * stride;
+      std::memcpy(tmp.data(), a, stride);
+      std::memcpy(a, b, stride);
+      std::memcpy(b, tmp.data(), stride);
+    }
+  }
+
+  auto decodeFile(const std::filesystem::path &path, bool flip) -> Texture::Decoded
+  {
+    auto fp = open_file(path, "rb");
+    if (!fp)
+      throw std::runtime_error(fmt::format("Error opening image {:?}: {}", path, std::strerror(errno)));
+    auto ret = Texture::Decoded{};
+    ret.data = stbi_load_from_file(fp.get(), &ret.w, &ret.h, &ret.ch, STBI_rgb_alpha);
+    if (!ret.data)
+      throw std::runtime_error(fmt::format("Error loading image from {:?}: {}", path, stbi_failure_reason()));
+    // stbi_set_flip_vertically_on_load() is a global and decodes run concurrently, so flip here
+    if (flip)
+      flipRows(ret);
+    return ret;
+  }
+
+  auto decodeBundled(std::string_view bytes, const std::string &path, bool flip) -> Texture::Decoded
+  {
+    auto ret = Texture::Decoded{};
+    ret.data = stbi_load_from_memory(reinterpret_cast<const stbi_uc *>(bytes.data()),
+                                     static_cast<int>(bytes.size()),
+                                     &ret.w,
+                                     &ret.h,
+                                     &ret.ch,
+                                     STBI_rgb_alpha);
+    if (!ret.data)
+      throw std::runtime_error(
+        fmt::format("Error loading image {:?} from the bundle: {}", path, stbi_failure_reason()));
+    if (flip)
+      flipRows(ret);
+    return ret;
+  }
+
+  auto createTexture() -> GLuint
+  {
+    GLuint ret;
+    glGenTextures(1, &ret);
+    glBindTexture(GL_TEXTURE_2D, ret);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    return ret;
+  }
+
+  auto hashed(Texture::Decoded decoded) -> Texture::Decoded
+  {
+    if (decoded.data)
+      decoded.hash = TextureDedup::hash(decoded.data, static_cast<size_t>(decoded.w) * decoded.h * 4);
+    return decoded;
+  }
+
+  // halves the image until its longest side fits maxSize, each texel the alpha weighted average
+  // of the 2x2 block under it so transparent texels do not darken the edges
+  auto downscale(Texture::Decoded &decoded, int maxSize) -> void
+  {
+    if (!decoded.data || maxSize <= 0 || std::max(decoded.w, decoded.h) <= maxSize)
+      return;
+    decoded.srcW = decoded.w;
+    decoded.srcH = decoded.h;
+    while (std::max(decoded.w, decoded.h) > maxSize)
+    {
+      const auto w = std::max(1, decoded.w / 2);
+      const auto h = std::max(1, decoded.h / 2);
+      const auto src = decoded.data;
+      const auto srcStride = static_cast<size_t>(decoded.w) * 4;
+      for (auto y = 0; y < h; ++y)
+      {
+        const auto row0 = src + static_cast<size_t>(std::min(2 * y, decoded.h - 1)) * srcStride;
+        const auto row1 = src + static_cast<size_t>(std::min(2 * y + 1, decoded.h - 1)) * srcStride;
+        // the rows shrink in place, the destination never overtakes the rows still to be read
+        auto dst = src + static_cast<size_t>(y) * w * 4;
+        for (auto x = 0; x < w; ++x)
+        {
+          const auto x0 = static_cast<size_t>(std::min(2 * x, decoded.w - 1)) * 4;
+          const auto x1 = static_cast<size_t>(std::min(2 * x + 1, decoded.w - 1)) * 4;
+          const unsigned char *texels[] = {row0 + x0, row0 + x1, row1 + x0, row1 + x1};
+          auto a = 0;
+          int c[3] = {0, 0, 0};
+          for (const auto t : texels)
+          {
+            a += t[3];
+            for (auto i = 0; i < 3; ++i)
+              c[i] += t[i] * t[3];
+          }
+          for (auto i = 0; i < 3; ++i)
+            dst[x * 4 + i] = static_cast<unsigned char>(a > 0 ? (c[i] + a / 2) / a : 0);
+          dst[x * 4 + 3] = static_cast<unsigned char>((a + 2) / 4);
         }
       }
-      else
+      decoded.w = w;
+      decoded.h = h;
+    }
+  }
+
+  // what the upload and hit testing want, done on the worker: opaque images lose their alpha
+  // bytes, the rest get their mask when the pixels are not kept
+  auto prepare(Texture::Decoded &decoded, bool compact) -> void
+  {
+    if (!decoded.data)
+      return;
+    const auto pixels = static_cast<size_t>(decoded.w) * static_cast<size_t>(decoded.h);
+    if (decoded.ch == 3 || PixelKernels::isOpaque(decoded.data, pixels))
+    {
+      PixelKernels::rgbaToRgb(decoded.data, decoded.data, pixels);
+      decoded.ch = 3;
+    }
+    else if (compact)
+      decoded.alphaMask = AlphaMask{decoded.data, decoded.w, decoded.h};
+  }
+
+  auto decode(const std::string &path,
+              bool flip,
+              const std::filesystem::path &cacheDir,
+              const AssetBundle *bundle) -> Texture::Decoded
+  {
+    try
+    {
+      // bundled images decode straight from the mapping, which is already as fast as the cache
+      if (auto bytes = bundle ? bundle->find(path) : std::nullopt)
+        return hashed(decodeBundled(*bytes, path, flip));
+      if (!cacheDir.empty())
       {
-        auto engineImgPath = sdl::get_base_path() / "assets" / path_.substr(7);
-        auto fp = open_file(engineImgPath, "rb");
-        auto ret = stbi_load_from_file(fp.get(), &w_, &h_, &ch_, STBI_rgb_alpha);
-        if (!ret)
-          throw std::runtime_error(fmt::format("Error loading image from {:?}: {}", engineImgPath, stbi_failure_reason()));
+        // the cache entry carries the hash, a hit does not read the pixels twice
+        if (auto cached = TextureCache::load(cacheDir, path, flip))
+          return *cached;
+        auto ret = hashed(decodeFile(path, flip));
+        TextureCache::store(cacheDir, path, flip, ret);
         return ret;
       }
-    }()),
-    texture_([&]() {
-      assert((ch_ == 4 || ch_ == 3) && "The number of channels should be 3 or 4.");
-
-      GLuint ret;
-      glGenTextures(1, &ret);
-      glBindTexture(GL_TEXTURE_2D, ret);
-
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-      if (ch_ == 4)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w_, h_, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData_);
-      else
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w_, h_, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData_);
+      return hashed(decodeFile(resolvePath(path), flip));
+    }
+    catch (std::runtime_error &e)
+    {
+      if (path.find("engine:") == 0)
+        throw;
+      SPDLOG_ERROR("{:t}", e);
+      return hashed(decodeFile(sdl::get_base_path() / "assets/corrupted.png", flip));
+    }
+  }
+
+  auto nextImageId() -> uint64_t
+  {
+    static auto last = std::atomic<uint64_t>{0};
+    return last.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+} // namespace
+
+Texture::Image::Image() : id(nextImageId()) {}
+
+Texture::Image::~Image()
+{
+  glDeleteTextures(1, &texture);
+  if (data)
+    stbi_image_free(data);
+}
+
+Texture::Texture(TextureStreamer &aStreamer,
+                 RenderScheduler &aScheduler,
+                 TextureDedup &aDedup,
+                 std::string aPath,
+                 bool aIsUi,
+                 bool aCompactAlpha,
+                 Quality aQuality,
+                 std::shared_ptr<const AssetBundle> aBundle)
+  : streamer(&aStreamer),
+    scheduler(&aScheduler),
+    dedup(&aDedup),
+    path_(std::move(aPath)),
+    bundle(std::move(aBundle)),
+    isUi(aIsUi),
+    compactAlpha(aCompactAlpha),
+    quality(aQuality),
+    texture_([]() {
+      const auto ret = createTexture();
+      const unsigned char placeholder[] = {0, 0, 0, 0};
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
       return ret;
     }()),
-    event(std::make_unique<uv::FsEvent>(uv.createFsEvent()))
-{
-  event->start(
-    [this](std::string file, int /*events*/, int status) {
-      if (status != 0)
-        return;
-      path_ = std::move(file);
-      try
-      {
-        auto ret = stbi_load(path_.c_str(), &w_, &h_, &ch_, STBI_rgb_alpha);
-        if (!ret)
-          throw std::runtime_error(fmt::format("Error loading image from {:?}: {}", path_, stbi_failure_reason()));
-        imageData_ = ret;
-        glBindTexture(GL_TEXTURE_2D, texture_);
-        if (ch_ == 4)
-          glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w_, h_, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData_);
-        else
-          glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w_, h_, 0, GL_RGBA, GL_UNSIGNED_BYTE, imageData_);
-      }
-      catch (std::runtime_error &e)
-      {
-        SPDLOG_ERROR("{:t}", e);
-      }
-    },
-    path_,
-    0);
+    alive(std::make_shared<Texture *>(this))
+{
+  // only the header is parsed synchronously so the nodes get their size right away
+  const auto bytes = bundle ? bundle->find(path_) : std::nullopt;
+  const auto hasInfo = bytes ? stbi_info_from_memory(reinterpret_cast<const stbi_uc *>(bytes->data()),
+                                                     static_cast<int>(bytes->size()),
+                                                     &w_,
+                                                     &h_,
+                                                     &ch_)
+                             : stbi_info(resolvePath(path_).string().c_str(), &w_, &h_, &ch_);
+  if (!hasInfo)
+    ch_ = 4;
+  load();
 }
 
 Texture::Texture(SDL_Surface *surface)
   : ch_(4), w_(surface->w), h_(surface->h), texture_([&]() {
-      GLuint texture;
-      glGenTextures(1, &texture);
-      glBindTexture(GL_TEXTURE_2D, texture);
-
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
+      const auto texture = createTexture();
       glPixelStorei(GL_UNPACK_ROW_LENGTH, surface->pitch / surface->format->BytesPerPixel);
       glTexImage2D(GL_TEXTURE_2D,
                    0,
@@ -120,20 +270,212 @@ Texture::Texture(SDL_Surface *surface)
       glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
       return texture;
-    }())
+    }()),
+    isLoaded_(true)
 {
 }
 
 Texture::~Texture()
 {
-  if (event)
-    event->stop();
+  // pending decodes see the null owner and drop their pixels
+  if (alive)
+    *alive = nullptr;
+  if (streamer)
+  {
+    streamer->remove(this);
+    streamer->uploader().cancel(this);
+  }
+  decoding.cancel();
   glDeleteTextures(1, &texture_);
-  if (imageData_)
-    stbi_image_free(imageData_);
+}
+
+auto Texture::load() -> void
+{
+  auto gen = ++loadGen;
+  // a decode that has not started yet would only be thrown away
+  decoding.cancel();
+  // the cache directory is resolved here because the project may change the working directory
+  auto cacheDir = isUi || path_.find("engine:") == 0 || bundle ? std::filesystem::path{} : TextureCache::dir();
+  // the streamer drops the entry when the texture goes away before its turn, so this stays valid
+  streamer->add(this, [this, gen, cacheDir = std::move(cacheDir)](TextureStreamer::Finished finished) mutable {
+    // an upload cancelled halfway still frees the pixels
+    auto decoded = std::shared_ptr<Decoded>(new Decoded{}, [](Decoded *v) {
+      if (v->data)
+        stbi_image_free(v->data);
+      delete v;
+    });
+    decoding = streamer->uv().queueWork(
+      [decoded,
+       path = path_,
+       flip = !isUi,
+       compact = compactAlpha,
+       maxSize = quality.maxSize,
+       cacheDir = std::move(cacheDir),
+       bundle = bundle]() {
+        try
+        {
+          *decoded = decode(path, flip, cacheDir, bundle.get());
+          downscale(*decoded, maxSize);
+          prepare(*decoded, compact);
+        }
+        catch (std::runtime_error &e)
+        {
+          SPDLOG_ERROR("{:t}", e);
+        }
+      },
+      [decoded, gen, alive = alive, finished = std::move(finished)](int status) mutable {
+        finished();
+        auto self = *alive;
+        if (status != 0 || !self || gen != self->loadGen)
+        {
+          // cancelled, destroyed or superseded by a newer reload
+          return;
+        }
+        self->upload(std::move(decoded));
+      });
+  });
+}
+
+auto Texture::upload(std::shared_ptr<Decoded> decoded) -> void
+{
+  if (!decoded->data)
+    return;
+  assert((decoded->ch == 4 || decoded->ch == 3) && "The number of channels should be 3 or 4.");
+  w_ = decoded->srcW > 0 ? decoded->srcW : decoded->w;
+  h_ = decoded->srcH > 0 ? decoded->srcH : decoded->h;
+  ch_ = decoded->ch;
+  // the pixel size tells apart the same image scaled down to different limits
+  const auto key = TextureDedup::Key{decoded->hash, decoded->w, decoded->h, ch_};
+  auto shared = decoded->hash != 0 && dedup ? dedup->find(key, decoded->data) : nullptr;
+  // an upload made before the mipmap preference changed is not shared with the reloads after it
+  if (shared && shared->isMipmapped == quality.mipmaps)
+  {
+    if (streamer)
+      streamer->uploader().cancel(this);
+    uploaded(*decoded, std::move(shared));
+    return;
+  }
+  shared = std::make_shared<Image>();
+  shared->texture = createTexture();
+  shared->w = decoded->w;
+  shared->h = decoded->h;
+  // only the storage here, the rows follow over the next frames
+  glTexImage2D(GL_TEXTURE_2D,
+               0,
+               ch_ == 4 ? GL_RGBA8 : GL_RGB8,
+               decoded->w,
+               decoded->h,
+               0,
+               ch_ == 4 ? GL_RGBA : GL_RGB,
+               GL_UNSIGNED_BYTE,
+               nullptr);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  const auto pixels = decoded->data;
+  const auto w = decoded->w;
+  const auto h = decoded->h;
+  streamer->uploader().add(this, shared->texture, pixels, w, h, ch_, [this, decoded, shared, key]() mutable {
+    glBindTexture(GL_TEXTURE_2D, shared->texture);
+    // sprites drawn far below their size sample a level near their size on screen instead of
+    // skipping texels, which is what shimmers
+    if (quality.mipmaps)
+    {
+      GlExt::generateMipmap(GL_TEXTURE_2D);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+      shared->isMipmapped = true;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    shared->alphaMask = std::move(decoded->alphaMask);
+    // hit testing is the only reader of the pixels once they are uploaded, and opaque images are
+    // solid everywhere without them
+    if (!compactAlpha && ch_ == 4)
+      std::swap(shared->data, decoded->data);
+    if (decoded->hash != 0 && dedup)
+      dedup->add(key, shared);
+    uploaded(*decoded, std::move(shared));
+  });
+  // the bands go in from the frames a render pumps, an idle scene draws none on its own
+  if (scheduler)
+    scheduler->invalidate();
+}
+
+auto Texture::uploaded(Decoded &decoded, std::shared_ptr<Image> shared) -> void
+{
+  if (decoded.data)
+    stbi_image_free(decoded.data);
+  decoded.data = nullptr;
+  image = std::move(shared);
+  isLoaded_ = true;
+  if (scheduler)
+    scheduler->invalidateLayers();
+}
+
+auto Texture::isTransparent(int x, int y) const -> bool
+{
+  if (ch_ == 3 || !image)
+    return false;
+  // the pixels may be scaled down from the size the nodes see
+  if (image->w != w_ || image->h != h_)
+  {
+    x = static_cast<int>(static_cast<int64_t>(x) * image->w / std::max(1, w_));
+    y = static_cast<int>(static_cast<int64_t>(y) * image->h / std::max(1, h_));
+  }
+  if (!image->alphaMask.empty())
+    return !image->alphaMask.isOpaque(x, y);
+  if (image->data)
+    return image->data[(x + y * image->w) * 4 + 3] < AlphaMask::Threshold;
+  return false;
+}
+
+auto Texture::pixelBytes() const -> size_t
+{
+  return imageData() ? static_cast<size_t>(image->w) * static_cast<size_t>(image->h) * 4 : 0;
+}
+
+auto Texture::gpuBytes() const -> size_t
+{
+  // the 1x1 placeholder until the decode is uploaded
+  if (!isLoaded_)
+    return 4;
+  if (!image)
+    return static_cast<size_t>(w_) * static_cast<size_t>(h_) * 4;
+  const auto bytes = static_cast<size_t>(image->w) * static_cast<size_t>(image->h) * static_cast<size_t>(ch_);
+  // the chain of smaller levels adds a third
+  return image->isMipmapped ? bytes * 4 / 3 : bytes;
+}
+
+auto Texture::compact() -> size_t
+{
+  compactAlpha = true;
+  if (!imageData())
+    return 0;
+  const auto pixels = pixelBytes();
+  const auto mask = maskBytes();
+  // RGB images are opaque everywhere and need no mask
+  if (ch_ != 3 && image->alphaMask.empty())
+    image->alphaMask = AlphaMask{image->data, image->w, image->h};
+  stbi_image_free(image->data);
+  image->data = nullptr;
+  return pixels - std::min(pixels, maskBytes() - mask);
 }
 
 auto Texture::path() const -> std::string
 {
   return path_;
 }
+
+auto Texture::setQuality(Quality v) -> void
+{
+  if (v.maxSize == quality.maxSize && v.mipmaps == quality.mipmaps)
+    return;
+  quality = v;
+  reload();
+}
+
+auto Texture::reload() -> void
+{
+  if (!streamer)
+    return;
+  load();
+  // an edited asset is what the user is looking at
+  streamer->prioritize(this);
+}
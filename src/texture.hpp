@@ -1,30 +1,119 @@
 #pragma once
+#include "alpha-mask.hpp"
+#include "asset-bundle.hpp"
+#include "render-scheduler.hpp"
+#include "texture-streamer.hpp"
 #include "uv.hpp"
 #include <SDL.h>
 #include <SDL_opengl.h>
+#include <cstdint>
 #include <memory>
 #include <string>
 
 class Texture
 {
 public:
-  Texture(uv::Uv &, std::string path, bool isUi = false);
+  struct Quality
+  {
+    // the longest side of the upload, larger images are halved until they fit; 0 for no limit
+    int maxSize = 0;
+    bool mipmaps = false;
+  };
+
+  // the pixels are decoded on the uv thread pool in the streamer's order; until they are uploaded
+  // texture() is a 1x1 transparent placeholder while w() and h() already come from the image header
+  // with a bundle the image is read from it rather than from the file; textures whose pixels turn
+  // out identical share one upload through the dedup; w() and h() stay the size of the file when
+  // the quality scales the upload down
+  Texture(TextureStreamer &,
+          RenderScheduler &,
+          class TextureDedup &,
+          std::string path,
+          bool isUi = false,
+          bool compactAlpha = false,
+          Quality = {},
+          std::shared_ptr<const AssetBundle> bundle = nullptr);
   Texture(SDL_Surface *);
   ~Texture();
   Texture(const Texture &) = delete;
   auto ch() const -> int { return ch_; }
   auto w() const -> int { return w_; }
   auto h() const -> int { return h_; }
-  auto imageData() const -> const unsigned char * { return imageData_; }
-  auto texture() const -> GLuint { return texture_; }
+  auto imageData() const -> const unsigned char * { return image ? image->data : nullptr; }
+  auto isLoaded() const -> bool { return isLoaded_; }
+  auto isTransparent(int x, int y) const -> bool;
+  // the GPU copy plus what is kept for hit testing
+  auto bytes() const -> size_t { return gpuBytes() + pixelBytes() + maskBytes(); }
+  // the RGBA copy kept for hit testing
+  auto pixelBytes() const -> size_t;
+  auto maskBytes() const -> size_t { return image ? image->alphaMask.bytes() : 0; }
+  // what the uploaded image holds on the GPU, with its mipmaps
+  auto gpuBytes() const -> size_t;
+  // replaces the CPU copy of the pixels with an alpha mask, as compactAlpha does after upload, and
+  // keeps later reloads compact; returns the bytes freed, nothing when another texture sharing the
+  // upload already did
+  auto compact() -> size_t;
+  // asking for a texture that is still waiting for its decode moves it to the front of the queue
+  auto texture() const -> GLuint
+  {
+    if (!isLoaded_ && streamer)
+      streamer->prioritize(this);
+    return image ? image->texture : texture_;
+  }
   auto path() const -> std::string;
+  // decodes the file again in the background and swaps the pixels in once they are ready
+  auto reload() -> void;
+  // reloads when the limit or the mipmaps change
+  auto setQuality(Quality) -> void;
+
+  struct Decoded;
+
+  // what an upload leaves behind, shared by the textures whose decoded pixels are identical
+  struct Image
+  {
+    Image();
+    Image(const Image &) = delete;
+    ~Image();
+    // no two uploads share one, unlike the address of a freed one
+    uint64_t id;
+    GLuint texture = 0;
+    // of the pixels, less than the texture's when it was scaled down
+    int w = 0;
+    int h = 0;
+    bool isMipmapped = false;
+    // the RGBA pixels for hit testing, unless compacted
+    unsigned char *data = nullptr;
+    AlphaMask alphaMask;
+  };
+  // identifies the upload for accounting, null until there is one
+  auto sharedImage() const -> const Image * { return image.get(); }
+  // Image::id of the upload, 0 until there is one
+  auto imageId() const -> uint64_t { return image ? image->id : 0; }
 
 private:
+  TextureStreamer *streamer = nullptr;
+  RenderScheduler *scheduler = nullptr;
+  TextureDedup *dedup = nullptr;
   std::string path_;
+  std::shared_ptr<const AssetBundle> bundle;
+  bool isUi = false;
   int ch_ = 4;
   int w_ = 0;
   int h_ = 0;
-  unsigned char *imageData_ = nullptr;
+  bool compactAlpha = false;
+  Quality quality;
+  std::shared_ptr<Image> image;
+  // the placeholder, or the whole texture when made from a surface
   GLuint texture_;
-  std::unique_ptr<uv::FsEvent> event;
+  bool isLoaded_ = false;
+  uint64_t loadGen = 0;
+  // the decode in the background, cancelled when a newer reload supersedes it
+  uv::Work decoding;
+  std::shared_ptr<Texture *> alive;
+
+  auto load() -> void;
+  // the pixels go to the streamer's uploader and the texture keeps showing what it showed until
+  // the last row is in
+  auto upload(std::shared_ptr<Decoded>) -> void;
+  auto uploaded(Decoded &, std::shared_ptr<Image>) -> void;
 };
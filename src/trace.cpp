@@ -0,0 +1,225 @@
+#include "trace.hpp"
+#include "file.hpp"
+#include <cerrno>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Trace
+{
+  namespace
+  {
+    enum class Type : char { complete = 'X', counter = 'C', asyncBegin = 'b', asyncEnd = 'e' };
+
+    struct Event
+    {
+      const char *name;
+      int64_t ts;
+      // the duration of a complete event, the value of a counter or the id of an async one
+      union
+      {
+        int64_t dur;
+        double value;
+        uint64_t id;
+      };
+      Type type;
+    };
+
+    struct Buffer
+    {
+      Buffer(int aTid) : tid(aTid) {}
+      int tid;
+      std::atomic<const char *> name = nullptr;
+      // EventsPerThread once the thread records its first event, a thread that is only named or
+      // never traced keeps none
+      std::vector<Event> events;
+      // only the owning thread writes, the exporter reads once stop() has seen busy cleared
+      std::atomic<uint64_t> head = 0;
+      std::atomic<bool> busy = false;
+    };
+
+    struct Registry
+    {
+      std::mutex mutex;
+      std::vector<std::shared_ptr<Buffer>> buffers;
+    };
+
+    auto registry() -> Registry &
+    {
+      static auto ret = Registry{};
+      return ret;
+    }
+
+    // the registry keeps the buffer of a thread that has exited until the next export
+    auto buffer() -> Buffer &
+    {
+      thread_local auto ret = [] {
+        auto &r = registry();
+        auto lock = std::lock_guard{r.mutex};
+        r.buffers.push_back(std::make_shared<Buffer>(static_cast<int>(r.buffers.size()) + 1));
+        return r.buffers.back();
+      }();
+      return *ret;
+    }
+
+    auto push(Event e) -> void
+    {
+      auto &b = buffer();
+      // paired with stop(): either this sees recording off, or stop() waits for the write
+      b.busy.store(true);
+      if (Internal::enabled.load())
+      {
+        if (b.events.empty())
+          b.events.resize(EventsPerThread);
+        const auto h = b.head.load(std::memory_order_relaxed);
+        b.events[h % EventsPerThread] = e;
+        b.head.store(h + 1, std::memory_order_relaxed);
+      }
+      b.busy.store(false, std::memory_order_release);
+    }
+
+    auto escape(std::string_view v) -> std::string
+    {
+      auto ret = std::string{};
+      for (auto c : v)
+      {
+        if (c == '"' || c == '\\')
+          ret += '\\';
+        ret += c;
+      }
+      return ret;
+    }
+
+    const auto epoch = std::chrono::steady_clock::now();
+  } // namespace
+
+  namespace Internal
+  {
+    std::atomic<bool> enabled = false;
+
+    auto now() -> int64_t
+    {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    auto complete(const char *name, int64_t begin, int64_t end) -> void
+    {
+      auto e = Event{name, begin, {}, Type::complete};
+      e.dur = end - begin;
+      push(e);
+    }
+  } // namespace Internal
+
+  auto start() -> void
+  {
+    {
+      auto &r = registry();
+      auto lock = std::lock_guard{r.mutex};
+      for (auto &b : r.buffers)
+        b->head.store(0, std::memory_order_relaxed);
+    }
+    Internal::enabled.store(true);
+  }
+
+  auto stop(const std::filesystem::path &path) -> bool
+  {
+    Internal::enabled.store(false);
+    auto &r = registry();
+    auto lock = std::lock_guard{r.mutex};
+    auto out = std::string{"{\"traceEvents\":[\n"};
+    auto first = true;
+    auto sep = [&]() -> std::string & {
+      if (!first)
+        out += ",\n";
+      first = false;
+      return out;
+    };
+    for (const auto &b : r.buffers)
+    {
+      while (b->busy.load())
+        std::this_thread::yield();
+      if (const auto name = b->name.load(std::memory_order_relaxed))
+        fmt::format_to(std::back_inserter(sep()),
+                       R"({{"ph":"M","pid":1,"tid":{},"name":"thread_name","args":{{"name":"{}"}}}})",
+                       b->tid,
+                       escape(name));
+      const auto h = b->head.load(std::memory_order_acquire);
+      const auto begin = h > EventsPerThread ? h - EventsPerThread : 0;
+      for (auto i = begin; i < h; ++i)
+      {
+        const auto &e = b->events[i % EventsPerThread];
+        const auto name = escape(e.name);
+        const auto ts = static_cast<double>(e.ts) / 1000.;
+        switch (e.type)
+        {
+        case Type::complete:
+          fmt::format_to(std::back_inserter(sep()),
+                         R"({{"ph":"X","pid":1,"tid":{},"name":"{}","ts":{:.3f},"dur":{:.3f}}})",
+                         b->tid,
+                         name,
+                         ts,
+                         static_cast<double>(e.dur) / 1000.);
+          break;
+        case Type::counter:
+          fmt::format_to(std::back_inserter(sep()),
+                         R"({{"ph":"C","pid":1,"tid":{},"name":"{}","ts":{:.3f},"args":{{"value":{}}}}})",
+                         b->tid,
+                         name,
+                         ts,
+                         e.value);
+          break;
+        case Type::asyncBegin:
+        case Type::asyncEnd:
+          fmt::format_to(std::back_inserter(sep()),
+                         R"({{"ph":"{}","cat":"async","pid":1,"tid":{},"name":"{}","id":{},"ts":{:.3f}}})",
+                         static_cast<char>(e.type),
+                         b->tid,
+                         name,
+                         e.id,
+                         ts);
+          break;
+        }
+      }
+      b->head.store(0, std::memory_order_relaxed);
+    }
+    out += "\n]}\n";
+    // the buffers of exited threads are not coming back
+    std::erase_if(r.buffers, [](const auto &b) { return b.use_count() == 1; });
+    return write_file_atomically(path, out);
+  }
+
+  auto nameThread(const char *name) -> void
+  {
+    buffer().name.store(name, std::memory_order_relaxed);
+  }
+
+  auto counter(const char *name, double value) -> void
+  {
+    if (!enabled())
+      return;
+    auto e = Event{name, Internal::now(), {}, Type::counter};
+    e.value = value;
+    push(e);
+  }
+
+  auto asyncBegin(const char *name, uint64_t id) -> void
+  {
+    if (!enabled())
+      return;
+    auto e = Event{name, Internal::now(), {}, Type::asyncBegin};
+    e.id = id;
+    push(e);
+  }
+
+  auto asyncEnd(const char *name, uint64_t id) -> void
+  {
+    if (!enabled())
+      return;
+    auto e = Event{name, Internal::now(), {}, Type::asyncEnd};
+    e.id = id;
+    push(e);
+  }
+} // namespace Trace
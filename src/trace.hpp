@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// Timeline tracing exported as Chrome trace JSON, which chrome://tracing and ui.perfetto.dev
+// open. Every thread writes into a ring buffer of its own without locking, the oldest events are
+// overwritten once it is full. While recording is off a span or a counter is one relaxed load.
+// Names must be string literals or otherwise outlive the recording.
+namespace Trace
+{
+  namespace Internal
+  {
+    extern std::atomic<bool> enabled;
+    auto now() -> int64_t;
+    auto complete(const char *name, int64_t begin, int64_t end) -> void;
+  } // namespace Internal
+
+  inline auto enabled() -> bool
+  {
+    return Internal::enabled.load(std::memory_order_relaxed);
+  }
+
+  // drops what an earlier recording left in the buffers
+  auto start() -> void;
+  // stops the recording and writes it, false on error with errno set
+  auto stop(const std::filesystem::path &) -> bool;
+  // names the calling thread in the exported timeline
+  auto nameThread(const char *) -> void;
+  auto counter(const char *name, double value) -> void;
+  // an operation that starts and ends in different callbacks, matched by name and id
+  auto asyncBegin(const char *name, uint64_t id) -> void;
+  auto asyncEnd(const char *name, uint64_t id) -> void;
+
+  // times its own scope
+  class Span
+  {
+  public:
+    explicit Span(const char *aName) : name(enabled() ? aName : nullptr), begin(name ? Internal::now() : 0) {}
+    ~Span()
+    {
+      if (name)
+        Internal::complete(name, begin, Internal::now());
+    }
+    Span(const Span &) = delete;
+    auto operator=(const Span &) -> Span & = delete;
+
+  private:
+    const char *name;
+    int64_t begin;
+  };
+
+  static constexpr auto EventsPerThread = size_t{1} << 16;
+} // namespace Trace
@@ -0,0 +1,52 @@
+#include "transform-store.hpp"
+#include <cassert>
+#include <cmath>
+#include <glm/trigonometric.hpp>
+
+auto TransformStore::clear() -> void
+{
+  parents.clear();
+  locs.clear();
+  scales.clear();
+  pivots.clear();
+  rots.clear();
+  worlds.clear();
+}
+
+auto TransformStore::add(Handle parent) -> Handle
+{
+  assert((parent == None || parent < parents.size()) && "parents are added before their children");
+  parents.push_back(parent);
+  locs.emplace_back(0.f, 0.f);
+  scales.emplace_back(1.f, 1.f);
+  pivots.emplace_back(0.f, 0.f);
+  rots.push_back(0.f);
+  worlds.emplace_back(1.f);
+  return static_cast<Handle>(parents.size() - 1);
+}
+
+auto TransformStore::set(Handle h, glm::vec2 loc, glm::vec2 scale, glm::vec2 pivot, float rot) -> void
+{
+  locs[h] = loc;
+  scales[h] = scale;
+  pivots[h] = pivot;
+  rots[h] = rot;
+}
+
+auto TransformStore::update() -> void
+{
+  for (auto i = size_t{0}; i < parents.size(); ++i)
+  {
+    // translate(loc) * rotate(rot) * scale(scale) * translate(-pivot), built directly
+    const auto c = std::cos(glm::radians(rots[i]));
+    const auto s = std::sin(glm::radians(rots[i]));
+    const auto x = glm::vec2{c, s} * scales[i].x;
+    const auto y = glm::vec2{-s, c} * scales[i].y;
+    const auto t = locs[i] - x * pivots[i].x - y * pivots[i].y;
+    const auto local = glm::mat4{glm::vec4{x, 0.f, 0.f},
+                                 glm::vec4{y, 0.f, 0.f},
+                                 glm::vec4{0.f, 0.f, 1.f, 0.f},
+                                 glm::vec4{t, 0.f, 1.f}};
+    worlds[i] = parents[i] == None ? local : worlds[parents[i]] * local;
+  }
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
+#include <vector>
+
+// Structure-of-arrays copy of a node tree's transforms in pre-order, so every parent precedes its
+// children and the world matrices are computed in one forward pass over contiguous arrays instead
+// of a recursion through the heap allocated nodes. The nodes stay the source of truth for editing,
+// undo and serialization; the owner copies the local values in with set() once per frame.
+class TransformStore
+{
+public:
+  using Handle = uint32_t;
+  static constexpr auto None = UINT32_MAX;
+
+  auto clear() -> void;
+  // the parent has to be added first
+  auto add(Handle parent) -> Handle;
+  auto set(Handle, glm::vec2 loc, glm::vec2 scale, glm::vec2 pivot, float rot) -> void;
+  auto size() const -> size_t { return parents.size(); }
+  auto update() -> void;
+  auto world(Handle h) const -> const glm::mat4 & { return worlds[h]; }
+
+private:
+  std::vector<Handle> parents;
+  std::vector<glm::vec2> locs;
+  std::vector<glm::vec2> scales;
+  std::vector<glm::vec2> pivots;
+  std::vector<float> rots;
+  std::vector<glm::mat4> worlds;
+};
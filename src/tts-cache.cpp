@@ -0,0 +1,181 @@
+#include "tts-cache.hpp"
+#include "file.hpp"
+#include <algorithm>
+#include <fmt/std.h>
+#include <spdlog/spdlog.h>
+#include <vector>
+
+namespace
+{
+  constexpr uint32_t Magic = 0x31535456; // "VTS1"
+
+  struct Header
+  {
+    uint32_t magic = Magic;
+    uint32_t keyLen = 0;
+    uint64_t samples = 0;
+  };
+
+  auto entryPath(const std::filesystem::path &cacheDir, const std::string &key) -> std::filesystem::path
+  {
+    return cacheDir / fmt::format("{:016x}.pcm", std::hash<std::string>{}(key));
+  }
+} // namespace
+
+auto TtsCache::Stats::hitRate() const -> float
+{
+  const auto lookups = memoryHits + diskHits + misses;
+  return lookups > 0 ? static_cast<float>(memoryHits + diskHits) / static_cast<float>(lookups) : 0.f;
+}
+
+TtsCache::TtsCache(size_t aMemoryBudget) : memoryBudget(aMemoryBudget) {}
+
+auto TtsCache::find(const std::string &key) -> std::shared_ptr<const Wav>
+{
+  auto it = index.find(key);
+  if (it == std::end(index))
+    return nullptr;
+  lru.splice(std::begin(lru), lru, it->second);
+  ++stats_.memoryHits;
+  return it->second->wav;
+}
+
+auto TtsCache::onDiskLookup(const std::string &key, std::shared_ptr<const Wav> wav) -> void
+{
+  if (!wav)
+  {
+    ++stats_.misses;
+    return;
+  }
+  ++stats_.diskHits;
+  insert(key, std::move(wav));
+}
+
+auto TtsCache::insert(const std::string &key, std::shared_ptr<const Wav> wav) -> void
+{
+  if (auto it = index.find(key); it != std::end(index))
+  {
+    stats_.memoryBytes -= it->second->wav->size() * sizeof(int16_t);
+    lru.erase(it->second);
+    index.erase(it);
+  }
+  stats_.memoryBytes += wav->size() * sizeof(int16_t);
+  lru.push_front(Entry{key, std::move(wav)});
+  // the key lives in the list node, which does not move
+  index.emplace(lru.front().key, std::begin(lru));
+  while (stats_.memoryBytes > memoryBudget && lru.size() > 1)
+  {
+    stats_.memoryBytes -= lru.back().wav->size() * sizeof(int16_t);
+    index.erase(lru.back().key);
+    lru.pop_back();
+  }
+}
+
+auto TtsCache::key(std::string_view voice, std::string_view ssml, std::string_view format, int rate)
+  -> std::string
+{
+  return fmt::format("{}\n{}\n{}\n{}", voice, format, rate, ssml);
+}
+
+auto TtsCache::dir() -> std::filesystem::path
+{
+  return std::filesystem::current_path() / ".cache" / "tts";
+}
+
+auto TtsCache::load(const std::filesystem::path &cacheDir, const std::string &key) -> std::shared_ptr<const Wav>
+{
+  const auto entry = entryPath(cacheDir, key);
+  auto fp = open_file(entry, "rb");
+  if (!fp)
+    return nullptr;
+  auto header = Header{};
+  if (std::fread(&header, sizeof(header), 1, fp.get()) != 1)
+    return nullptr;
+  if (header.magic != Magic || header.keyLen != key.size() || header.samples > DiskBudget / sizeof(int16_t))
+    return nullptr;
+  auto storedKey = std::string(header.keyLen, '\0');
+  if (std::fread(storedKey.data(), 1, storedKey.size(), fp.get()) != storedKey.size() || storedKey != key)
+    return nullptr;
+  auto ret = std::make_shared<Wav>(header.samples);
+  if (std::fread(ret->data(), sizeof(int16_t), ret->size(), fp.get()) != ret->size())
+    return nullptr;
+  fp.reset();
+  // the modification time is the recency trim() goes by
+  auto ec = std::error_code{};
+  std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), ec);
+  return ret;
+}
+
+auto TtsCache::store(const std::filesystem::path &cacheDir, const std::string &key, const Wav &wav) -> void
+{
+  auto ec = std::error_code{};
+  std::filesystem::create_directories(cacheDir, ec);
+  if (ec)
+  {
+    SPDLOG_ERROR("Cannot create TTS cache {:?}: {}", cacheDir, ec.message());
+    return;
+  }
+  const auto entry = entryPath(cacheDir, key);
+  // written under a temporary name and renamed so a concurrent reader never sees half an entry
+  const auto tmp = temp_path_for(entry);
+  {
+    auto fp = open_file(tmp, "wb");
+    if (!fp)
+      return;
+    auto header = Header{};
+    header.keyLen = static_cast<uint32_t>(key.size());
+    header.samples = wav.size();
+    if (std::fwrite(&header, sizeof(header), 1, fp.get()) != 1 ||
+        std::fwrite(key.data(), 1, key.size(), fp.get()) != key.size() ||
+        std::fwrite(wav.data(), sizeof(int16_t), wav.size(), fp.get()) != wav.size())
+    {
+      fp.reset();
+      std::filesystem::remove(tmp, ec);
+      return;
+    }
+  }
+  std::filesystem::rename(tmp, entry, ec);
+  if (ec)
+  {
+    SPDLOG_ERROR("Cannot write TTS cache entry {:?}: {}", entry, ec.message());
+    std::filesystem::remove(tmp, ec);
+    return;
+  }
+  trim(cacheDir);
+}
+
+auto TtsCache::trim(const std::filesystem::path &cacheDir) -> void
+{
+  struct File
+  {
+    std::filesystem::path path;
+    std::filesystem::file_time_type mtime;
+    uintmax_t size;
+  };
+  auto files = std::vector<File>{};
+  auto total = uintmax_t{0};
+  auto ec = std::error_code{};
+  for (const auto &e : std::filesystem::directory_iterator{cacheDir, ec})
+  {
+    if (e.path().extension() != ".pcm")
+      continue;
+    const auto size = e.file_size(ec);
+    if (ec)
+      continue;
+    const auto mtime = e.last_write_time(ec);
+    if (ec)
+      continue;
+    files.push_back(File{e.path(), mtime, size});
+    total += size;
+  }
+  if (total <= DiskBudget)
+    return;
+  std::ranges::sort(files, {}, &File::mtime);
+  for (const auto &f : files)
+  {
+    if (total <= DiskBudget)
+      break;
+    if (std::filesystem::remove(f.path, ec))
+      total -= f.size;
+  }
+}
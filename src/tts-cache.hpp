@@ -0,0 +1,58 @@
+#pragma once
+#include "wav.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Synthesized speech keyed by voice, SSML, service format and output rate, stored already
+// resampled so a hit plays without touching the network. The most recent clips stay in memory up
+// to MemoryBudget; every clip is also written to the project-local disk cache, which is trimmed to
+// DiskBudget least recently used first. The memory side runs on the main thread, load() and
+// store() are for the uv workers.
+class TtsCache
+{
+public:
+  struct Stats
+  {
+    uint64_t memoryHits = 0;
+    uint64_t diskHits = 0;
+    uint64_t misses = 0;
+    size_t memoryBytes = 0;
+    auto hitRate() const -> float;
+  };
+
+  TtsCache(size_t memoryBudget = MemoryBudget);
+  auto find(const std::string &key) -> std::shared_ptr<const Wav>;
+  // result of a disk lookup after a memory miss, null if the disk had nothing either
+  auto onDiskLookup(const std::string &key, std::shared_ptr<const Wav>) -> void;
+  auto insert(const std::string &key, std::shared_ptr<const Wav>) -> void;
+  auto stats() const -> const Stats & { return stats_; }
+
+  static auto key(std::string_view voice, std::string_view ssml, std::string_view format, int rate)
+    -> std::string;
+  static auto dir() -> std::filesystem::path;
+  static auto load(const std::filesystem::path &cacheDir, const std::string &key) -> std::shared_ptr<const Wav>;
+  static auto store(const std::filesystem::path &cacheDir, const std::string &key, const Wav &) -> void;
+
+  static constexpr auto MemoryBudget = size_t{64} << 20;
+  static constexpr auto DiskBudget = uintmax_t{512} << 20;
+
+private:
+  struct Entry
+  {
+    std::string key;
+    std::shared_ptr<const Wav> wav;
+  };
+
+  size_t memoryBudget;
+  // most recently used first
+  std::list<Entry> lru;
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+  Stats stats_;
+
+  static auto trim(const std::filesystem::path &cacheDir) -> void;
+};
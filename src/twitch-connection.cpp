@@ -0,0 +1,683 @@
+#ifdef _WIN32
+#define NOMINMAX
+#endif
+
+#include "twitch-connection.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+#include "twitch.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <charconv>
+#include <scn/scn.h>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+
+namespace
+{
+  const char *RPL_WELCOME = "001";
+  //  const char *RPL_YOURHOST = "002";
+  //  const char *RPL_CREATED = "003";
+  //  const char *RPL_MYINFO = "004";
+  //  const char *RPL_ISUPPORT = "005";
+  //  const char *RPL_BOUNCE = "010";
+  //  const char *RPL_UMODEIS = "221";
+  //  const char *RPL_LUSERCLIENT = "251";
+  //  const char *RPL_LUSEROP = "252";
+  //  const char *RPL_LUSERUNKNOWN = "253";
+  //  const char *RPL_LUSERCHANNELS = "254";
+  //  const char *RPL_LUSERME = "255";
+  //  const char *RPL_ADMINME = "256";
+  //  const char *RPL_ADMINLOC1 = "257";
+  //  const char *RPL_ADMINLOC2 = "258";
+  //  const char *RPL_ADMINEMAIL = "259";
+  //  const char *RPL_TRYAGAIN = "263";
+  //  const char *RPL_LOCALUSERS = "265";
+  //  const char *RPL_GLOBALUSERS = "266";
+  //  const char *RPL_WHOISCERTFP = "276";
+  //  const char *RPL_NONE = "300";
+  //  const char *RPL_AWAY = "301";
+  //  const char *RPL_USERHOST = "302";
+  //  const char *RPL_UNAWAY = "305";
+  //  const char *RPL_NOWAWAY = "306";
+  //  const char *RPL_WHOREPLY = "352";
+  //  const char *RPL_ENDOFWHO = "315";
+  //  const char *RPL_WHOISREGNICK = "307";
+  //  const char *RPL_WHOISUSER = "311";
+  //  const char *RPL_WHOISSERVER = "312";
+  //  const char *RPL_WHOISOPERATOR = "313";
+  //  const char *RPL_WHOWASUSER = "314";
+  //  const char *RPL_WHOISIDLE = "317";
+  //  const char *RPL_ENDOFWHOIS = "318";
+  //  const char *RPL_WHOISCHANNELS = "319";
+  //  const char *RPL_WHOISSPECIAL = "320";
+  //  const char *RPL_LISTSTART = "321";
+  //  const char *RPL_LIST = "322";
+  //  const char *RPL_LISTEND = "323";
+  //  const char *RPL_CHANNELMODEIS = "324";
+  //  const char *RPL_CREATIONTIME = "329";
+  //  const char *RPL_WHOISACCOUNT = "330";
+  //  const char *RPL_NOTOPIC = "331";
+  //  const char *RPL_TOPIC = "332";
+  //  const char *RPL_TOPICWHOTIME = "333";
+  //  const char *RPL_INVITELIST = "336";
+  //  const char *RPL_ENDOFINVITELIST = "337";
+  //  const char *RPL_WHOISACTUALLY = "338";
+  //  const char *RPL_INVITING = "341";
+  //  const char *RPL_INVEXLIST = "346";
+  //  const char *RPL_ENDOFINVEXLIST = "347";
+  //  const char *RPL_EXCEPTLIST = "348";
+  //  const char *RPL_ENDOFEXCEPTLIST = "349";
+  //  const char *RPL_VERSION = "351";
+  //  const char *RPL_NAMREPLY = "353";
+  //  const char *RPL_ENDOFNAMES = "366";
+  //  const char *RPL_LINKS = "364";
+  //  const char *RPL_ENDOFLINKS = "365";
+  //  const char *RPL_BANLIST = "367";
+  //  const char *RPL_ENDOFBANLIST = "368";
+  //  const char *RPL_ENDOFWHOWAS = "369";
+  //  const char *RPL_INFO = "371";
+  //  const char *RPL_ENDOFINFO = "374";
+  //  const char *RPL_MOTDSTART = "375";
+  //  const char *RPL_MOTD = "372";
+  //  const char *RPL_ENDOFMOTD = "376";
+  //  const char *RPL_WHOISHOST = "378";
+  //  const char *RPL_WHOISMODES = "379";
+  //  const char *RPL_YOUREOPER = "381";
+  //  const char *RPL_REHASHING = "382";
+  //  const char *RPL_TIME = "391";
+  //  const char *ERR_UNKNOWNERROR = "400";
+  //  const char *ERR_NOSUCHNICK = "401";
+  //  const char *ERR_NOSUCHSERVER = "402";
+  //  const char *ERR_NOSUCHCHANNEL = "403";
+  //  const char *ERR_CANNOTSENDTOCHAN = "404";
+  //  const char *ERR_TOOMANYCHANNELS = "405";
+  //  const char *ERR_WASNOSUCHNICK = "406";
+  //  const char *ERR_NOORIGIN = "409";
+  //  const char *ERR_INPUTTOOLONG = "417";
+  //  const char *ERR_UNKNOWNCOMMAND = "421";
+  //  const char *ERR_NOMOTD = "422";
+  //  const char *ERR_ERRONEUSNICKNAME = "432";
+  //  const char *ERR_NICKNAMEINUSE = "433";
+  //  const char *ERR_USERNOTINCHANNEL = "441";
+  //  const char *ERR_NOTONCHANNEL = "442";
+  //  const char *ERR_USERONCHANNEL = "443";
+  //  const char *ERR_NOTREGISTERED = "451";
+  //  const char *ERR_NEEDMOREPARAMS = "461";
+  //  const char *ERR_ALREADYREGISTERED = "462";
+  //  const char *ERR_PASSWDMISMATCH = "464";
+  //  const char *ERR_YOUREBANNEDCREEP = "465";
+  //  const char *ERR_CHANNELISFULL = "471";
+  //  const char *ERR_UNKNOWNMODE = "472";
+  //  const char *ERR_INVITEONLYCHAN = "473";
+  //  const char *ERR_BANNEDFROMCHAN = "474";
+  //  const char *ERR_BADCHANNELKEY = "475";
+  //  const char *ERR_BADCHANMASK = "476";
+  //  const char *ERR_NOPRIVILEGES = "481";
+  //  const char *ERR_CHANOPRIVSNEEDED = "482";
+  //  const char *ERR_CANTKILLSERVER = "483";
+  //  const char *ERR_NOOPERHOST = "491";
+  //  const char *ERR_UMODEUNKNOWNFLAG = "501";
+  //  const char *ERR_USERSDONTMATCH = "502";
+  //  const char *ERR_HELPNOTFOUND = "524";
+  //  const char *ERR_INVALIDKEY = "525";
+  //  const char *RPL_STARTTLS = "670";
+  //  const char *RPL_WHOISSECURE = "671";
+  //  const char *ERR_STARTTLS = "691";
+  //  const char *ERR_INVALIDMODEPARAM = "696";
+  //  const char *RPL_HELPSTART = "704";
+  //  const char *RPL_HELPTXT = "705";
+  //  const char *RPL_ENDOFHELP = "706";
+  //  const char *ERR_NOPRIVS = "723";
+  //  const char *RPL_LOGGEDIN = "900";
+  //  const char *RPL_LOGGEDOUT = "901";
+  //  const char *ERR_NICKLOCKED = "902";
+  //  const char *RPL_SASLSUCCESS = "903";
+  //  const char *ERR_SASLFAIL = "904";
+  //  const char *ERR_SASLTOOLONG = "905";
+  //  const char *ERR_SASLABORTED = "906";
+  //  const char *ERR_SASLALREADY = "907";
+  //  const char *RPL_SASLMECHS = "908";
+
+  // the byte offset of a code point, the emotes tag counts code points
+  auto byteOffset(std::string_view text, size_t codePoint) -> size_t
+  {
+    auto ret = size_t{0};
+    for (; ret < text.size(); ++ret)
+      if ((static_cast<unsigned char>(text[ret]) & 0xc0) != 0x80 && codePoint-- == 0)
+        break;
+    return ret;
+  }
+
+  // "25:0-4,12-16/1902:6-10", every emote with the ranges it covers in the message
+  auto parseEmotes(std::string_view tag, std::string_view text) -> std::vector<TwitchSink::Emote>
+  {
+    auto ret = std::vector<TwitchSink::Emote>{};
+    while (!tag.empty())
+    {
+      const auto slash = tag.find('/');
+      const auto emote = tag.substr(0, slash);
+      tag = slash == std::string_view::npos ? std::string_view{} : tag.substr(slash + 1);
+      const auto colon = emote.find(':');
+      if (colon == std::string_view::npos)
+        continue;
+      // the code is the same wherever the emote is used, the first range gives it
+      const auto range = emote.substr(colon + 1, emote.find(',') - colon - 1);
+      auto first = size_t{0};
+      auto last = size_t{0};
+      const auto dash = range.find('-');
+      if (dash == std::string_view::npos ||
+          std::from_chars(range.data(), range.data() + dash, first).ec != std::errc{} ||
+          std::from_chars(range.data() + dash + 1, range.data() + range.size(), last).ec != std::errc{} ||
+          last < first)
+        continue;
+      const auto begin = byteOffset(text, first);
+      const auto end = byteOffset(text, last + 1);
+      if (end > text.size() || begin >= end)
+        continue;
+      ret.push_back(TwitchSink::Emote{std::string{emote.substr(0, colon)}, std::string{text.substr(begin, end - begin)}});
+    }
+    return ret;
+  }
+} // namespace
+
+static const char *server = "irc.chat.twitch.tv";
+static const char *port = "6667";
+
+TwitchConnection::TwitchConnection(IoThread &aIo, std::string aUser, std::string aKey)
+  : io(aIo), user(std::move(aUser)), key(std::move(aKey))
+{
+}
+
+auto TwitchConnection::create(IoThread &io, std::string user, std::string key)
+  -> std::shared_ptr<TwitchConnection>
+{
+  auto ret = io.make<TwitchConnection>(io, std::move(user), std::move(key));
+  io.post([alive = std::weak_ptr{ret}]() {
+    if (auto self = alive.lock())
+      self->start();
+    else
+      SPDLOG_INFO("this was destroyed");
+  });
+  return ret;
+}
+
+auto TwitchConnection::start() -> void
+{
+  retryTimer.emplace(io.get().uv().createTimer());
+  pingTimer.emplace(io.get().uv().createTimer());
+  init();
+}
+
+auto TwitchConnection::setState(State value) -> void
+{
+  state = value;
+  connected = value == State::connected;
+}
+
+auto TwitchConnection::init() -> void
+{
+  SPDLOG_INFO("Init: {}:{} user {}", server, port, user);
+  setState(State::connecting);
+  retryTimer->stop();
+  retryPending = false;
+  pingTimer->stop();
+  // a line cut off by the old connection never ends
+  parser = IrcParser{};
+
+  auto s = io.get().uv().connect(server, port, [alive = weak_self()](int status, uv::Tcp aTcp) {
+    if (auto self = alive.lock())
+    {
+      if (status < 0)
+      {
+        SPDLOG_ERROR("{}", uv_err_name(status));
+        self->initiateRetry();
+        return;
+      }
+      self->tcp = std::move(aTcp);
+      self->sendPassNickUser();
+    }
+    else
+
+    {
+      SPDLOG_INFO("this was destroyed");
+    }
+  });
+  if (s < 0)
+  {
+    SPDLOG_ERROR("{}", uv_err_name(s));
+    initiateRetry();
+    return;
+  }
+}
+
+auto TwitchConnection::sendPassNickUser() -> void
+{
+  std::string buff;
+  fmt::format_to(std::back_inserter(buff), "PASS {}\r\n", key);
+  fmt::format_to(std::back_inserter(buff), "NICK {}\r\n", user);
+  fmt::format_to(std::back_inserter(buff), "USER nobody unknown unknown :noname\r\n");
+
+  auto s = tcp.write(std::move(buff), [alive = weak_self()](int status) {
+    if (auto self = alive.lock())
+    {
+      if (status < 0)
+      {
+        SPDLOG_ERROR("{}", uv_err_name(status));
+        self->initiateRetry();
+        return;
+      }
+      self->readStart();
+    }
+    else
+    {
+      SPDLOG_INFO("this was destroyed");
+    }
+  });
+  if (s < 0)
+  {
+    SPDLOG_ERROR("{}", uv_err_name(s));
+    initiateRetry();
+    return;
+  }
+}
+
+auto TwitchConnection::readStart() -> void
+{
+  // the socket reads straight into the parser buffer, the view is what it filled
+  auto s = tcp.readStart(
+    [alive = weak_self()](int status, std::string_view msg) {
+      if (auto self = alive.lock())
+      {
+        if (status < 0)
+        {
+          SPDLOG_ERROR("{}", uv_err_name(status));
+          self->initiateRetry();
+          return;
+        }
+        if (self->isTapped.load(std::memory_order_relaxed))
+          self->tapped += msg;
+        self->parser.commit(msg.size());
+        self->parseMsg();
+      }
+      else
+      {
+        SPDLOG_INFO("this was destroyed");
+      }
+    },
+    [alive = weak_self()](size_t suggested) {
+      if (auto self = alive.lock())
+        return self->parser.prepare(suggested);
+      return std::span<char>{};
+    });
+  if (s < 0)
+  {
+    SPDLOG_ERROR("{}", uv_err_name(s));
+    initiateRetry();
+    return;
+  }
+}
+
+auto TwitchConnection::parseMsg() -> void
+{
+  auto span = Trace::Span{"twitch parse"};
+  while (auto msg = parser.next())
+  {
+    const auto command = msg->command;
+    if (command == "PRIVMSG")
+      onPrivMsg(*msg);
+    else if (command == RPL_WELCOME)
+      onWelcome();
+    else if (command == "PING")
+    {
+      if (msg->paramsCount == 0)
+      {
+        SPDLOG_ERROR("Parameters on PING message are empty");
+        continue;
+      }
+      onPing(msg->params[0]);
+    }
+    else if (command == "PONG")
+    {
+      onPong();
+    }
+  }
+  postBatch();
+}
+
+auto TwitchConnection::replay(std::string bytes) -> void
+{
+  io.get().post([alive = weak_self(), bytes = std::move(bytes)]() mutable {
+    if (auto self = alive.lock())
+      self->onReplay(std::move(bytes));
+    else
+      SPDLOG_INFO("this was destroyed");
+  });
+}
+
+auto TwitchConnection::tap(std::function<void(std::string_view)> v) -> void
+{
+  tap_ = std::move(v);
+  isTapped.store(tap_ != nullptr, std::memory_order_relaxed);
+}
+
+auto TwitchConnection::onReplay(std::string bytes) -> void
+{
+  auto span = Trace::Span{"twitch replay"};
+  replayParser.push(bytes);
+  while (auto msg = replayParser.next())
+    if (msg->command == "PRIVMSG")
+      onPrivMsg(*msg);
+  postBatch();
+}
+
+auto TwitchConnection::postBatch() -> void
+{
+  if (batch.empty() && tapped.empty())
+    return;
+  io.get().postMain([alive = weak_self(), msgs = std::exchange(batch, {}), raw = std::exchange(tapped, {})]() mutable {
+    if (auto self = alive.lock())
+    {
+      self->deliver(std::move(msgs));
+      if (!raw.empty() && self->tap_)
+        self->tap_(raw);
+    }
+    else
+      SPDLOG_INFO("this was destroyed");
+  });
+}
+
+auto TwitchConnection::onPrivMsg(const IrcParser::Msg &msg) -> void
+{
+  if (msg.paramsCount < 2)
+  {
+    SPDLOG_ERROR("Expected 2 parameters on PRIVMSG");
+    return;
+  }
+  // the first parameter is the channel the message was sent to
+  auto channelName = std::string{msg.params[0].starts_with('#') ? msg.params[0].substr(1) : msg.params[0]};
+  // joined by the lower case names Twitch keeps, a replayed or relayed line may not be
+  std::ranges::transform(channelName, std::begin(channelName), [](unsigned char c) { return std::tolower(c); });
+  if (!joined.contains(channelName))
+    return;
+  // the tags are only read here, and only the ones the sinks show are copied
+  auto displayName = std::string_view{"noname"};
+  auto colorTag = std::string_view{};
+  auto isFirst = false;
+  auto isMod = false;
+  auto subscriber = -1;
+  auto emotesTag = std::string_view{};
+  for (auto tags = msg.tags; !tags.empty();)
+  {
+    const auto [name, value] = IrcParser::popTag(tags);
+    if (name == "display-name")
+    {
+      displayName = value;
+      continue;
+    }
+    if (name == "color")
+    {
+      colorTag = value;
+      continue;
+    }
+    if (name == "first-msg")
+    {
+      isFirst = value == "1";
+      continue;
+    }
+    if (name == "mod")
+    {
+      isMod = value == "1";
+      continue;
+    }
+    if (name == "subscriber")
+    {
+      std::from_chars(value.data(), value.data() + value.size(), subscriber);
+      continue;
+    }
+    if (name == "emotes")
+    {
+      emotesTag = value;
+      continue;
+    }
+  }
+  const auto privMsg = msg.params[1];
+  // a raid or a spam wave would otherwise be a log line per message
+  static auto chatLog = Log::RateLimit{"chat", 20};
+  if (chatLog.allow())
+    SPDLOG_INFO("{} {}:{}", channelName, displayName, privMsg);
+  batch.emplace_back(std::move(channelName),
+                     std::make_shared<const TwitchSink::Msg>(TwitchSink::Msg{intern(displayName, colorTag),
+                                                                             std::string{privMsg},
+                                                                             isFirst,
+                                                                             isMod,
+                                                                             subscriber,
+                                                                             parseEmotes(emotesTag, privMsg)}));
+}
+
+auto TwitchConnection::deliver(Batch msgs) -> void
+{
+  for (const auto &[channelName, msg] : msgs)
+    if (const auto it = channels.find(channelName); it != std::end(channels))
+      it->second.get().onMsg(msg);
+}
+
+auto TwitchConnection::intern(std::string_view displayName, std::string_view colorTag)
+  -> std::shared_ptr<const TwitchSink::Chatter>
+{
+  auto it = chatters.find(displayName);
+  if (it != std::end(chatters) && it->second.colorTag == colorTag)
+    return it->second.chatter;
+  const auto color = [](std::string_view hexString) {
+    if (hexString.size() != 7 || hexString[0] != '#')
+    {
+      return glm::vec3{0.f, 0.f, 0.f};
+    }
+
+    int r, g, b;
+    [[maybe_unused]] auto const result = scn::scan(hexString, "#{:2x}{:2x}{:2x}", r, g, b);
+    assert(!result.error());
+
+    return glm::vec3(r / 255.0f, g / 255.0f, b / 255.0f);
+  }(colorTag);
+  auto chatter = std::make_shared<const TwitchSink::Chatter>(TwitchSink::Chatter{std::string{displayName}, color});
+  if (it != std::end(chatters))
+  {
+    // the chatter changed the color, the messages already shown keep the old one
+    it->second = Interned{std::string{colorTag}, chatter};
+    return chatter;
+  }
+  if (chatters.size() >= pruneAt)
+  {
+    std::erase_if(chatters, [](const auto &v) { return v.second.chatter.use_count() == 1; });
+    pruneAt = std::max(MinPrune, 2 * chatters.size());
+  }
+  chatters.emplace(std::string{displayName}, Interned{std::string{colorTag}, chatter});
+  return chatter;
+}
+
+auto TwitchConnection::onPing(std::string_view val) -> void
+{
+  send(fmt::format("PONG {}\r\n", val));
+}
+
+auto TwitchConnection::onPong() -> void
+{
+  pingTimer->stop();
+  schedulePing();
+}
+
+auto TwitchConnection::onWelcome() -> void
+{
+  std::string buf;
+  fmt::format_to(std::back_inserter(buf), "CAP REQ :twitch.tv/tags\r\n");
+  fmt::format_to(std::back_inserter(buf), "CAP REQ :twitch.tv/tags twitch.tv/commands\r\n");
+  if (!send(std::move(buf)))
+    return;
+  SPDLOG_INFO("Connected to twitch");
+  setState(State::connected);
+  initRetry = 1000;
+  // every channel in one JOIN
+  if (!joined.empty())
+  {
+    auto join = std::string{"JOIN "};
+    auto sep = "";
+    for (const auto &channel : joined)
+    {
+      fmt::format_to(std::back_inserter(join), "{}#{}", sep, channel);
+      sep = ",";
+    }
+    join += "\r\n";
+    send(std::move(join));
+  }
+  schedulePing();
+}
+
+auto TwitchConnection::send(std::string buf) -> bool
+{
+  if (tcp.queuedBytes() > MaxQueuedBytes)
+  {
+    SPDLOG_ERROR("The write queue is stalled at {} bytes", tcp.queuedBytes());
+    initiateRetry();
+    return false;
+  }
+  auto s = tcp.write(std::move(buf), [alive = weak_self()](int status) {
+    if (auto self = alive.lock())
+    {
+      if (status < 0)
+      {
+        SPDLOG_ERROR("{}", uv_err_name(status));
+        self->initiateRetry();
+        return;
+      }
+    }
+    else
+    {
+      SPDLOG_INFO("this was destroyed");
+    }
+  });
+  if (s < 0)
+  {
+    SPDLOG_ERROR("{}", uv_err_name(s));
+    initiateRetry();
+    return false;
+  }
+  return true;
+}
+
+auto TwitchConnection::schedulePing() -> void
+{
+  pingTimer->start(
+    [alive = weak_self()]() {
+      if (auto self = alive.lock())
+      {
+        if (!self->send("PING :tmi.twitch.tv\r\n"))
+          return;
+        self->pingTimer->start(
+          [alive]() {
+            if (auto self = alive.lock())
+            {
+              SPDLOG_ERROR("PING timeout");
+              self->initiateRetry();
+            }
+            else
+            {
+              SPDLOG_INFO("this was destroyed");
+            }
+          },
+          2'000);
+      }
+      else
+      {
+        SPDLOG_INFO("this was destroyed");
+      }
+    },
+    120'000);
+}
+
+auto TwitchConnection::join(Twitch &channel) -> void
+{
+  channels.emplace(channel.name(), channel);
+  io.get().post([alive = weak_self(), name = channel.name()]() mutable {
+    if (auto self = alive.lock())
+      self->onJoin(std::move(name));
+    else
+      SPDLOG_INFO("this was destroyed");
+  });
+}
+
+auto TwitchConnection::part(Twitch &channel) -> void
+{
+  const auto it = channels.find(channel.name());
+  if (it == std::end(channels) || &it->second.get() != &channel)
+    return;
+  channels.erase(it);
+  io.get().post([alive = weak_self(), name = channel.name()]() mutable {
+    if (auto self = alive.lock())
+      self->onPart(std::move(name));
+    else
+      SPDLOG_INFO("this was destroyed");
+  });
+}
+
+auto TwitchConnection::onJoin(std::string channel) -> void
+{
+  // joined along with the rest once the server welcomes us otherwise
+  if (state == State::connected)
+    send(fmt::format("JOIN #{}\r\n", channel));
+  joined.insert(std::move(channel));
+}
+
+auto TwitchConnection::onPart(std::string channel) -> void
+{
+  if (joined.erase(channel) > 0 && state == State::connected)
+    send(fmt::format("PART #{}\r\n", channel));
+}
+
+auto TwitchConnection::initiateRetry() -> void
+{
+  if (retryPending)
+    return;
+  retryPending = true;
+  setState(State::connecting);
+  retryTimer->start(
+    [alive = weak_self()]() {
+      if (auto self = alive.lock())
+      {
+        SPDLOG_INFO("Retrying...");
+        self->init();
+      }
+      else
+      {
+        SPDLOG_INFO("this was destroyed");
+      }
+    },
+    initRetry);
+  SPDLOG_INFO("Retry in", initRetry);
+  initRetry = std::min(32000, initRetry * 2);
+}
+
+auto TwitchConnection::updateUserKey(const std::string &aUser, const std::string &aKey) -> void
+{
+  io.get().post([alive = weak_self(), aUser, aKey]() mutable {
+    if (auto self = alive.lock())
+      self->onUserKey(std::move(aUser), std::move(aKey));
+    else
+      SPDLOG_INFO("this was destroyed");
+  });
+}
+
+auto TwitchConnection::onUserKey(std::string aUser, std::string aKey) -> void
+{
+  if (user == aUser && key == aKey)
+    return;
+  user = std::move(aUser);
+  key = std::move(aKey);
+  init();
+}
+
+auto TwitchConnection::isConnected() const -> bool
+{
+  return connected;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "io-thread.hpp"
+#include "irc-parser.hpp"
+#include "shared_from_this.hpp"
+#include "twitch-sink.hpp"
+#include "uv.hpp"
+
+// One authenticated IRC connection of a Twitch account. It JOINs every channel registered with it
+// and routes each PRIVMSG to its channel; all of them share the reconnect and the ping.
+// The socket, the parser and the timers live on the io thread, so a chat flood does not delay a
+// frame and a slow frame does not delay the PONG. The public calls are for the main thread; the
+// messages of one read are handed back to it in one batch.
+class TwitchConnection : public virtual enable_shared_from_this
+{
+public:
+  TwitchConnection(IoThread &, std::string user, std::string key);
+  TwitchConnection(const TwitchConnection &) = delete;
+  // created through the io thread, which also gets to destroy it
+  static auto create(IoThread &, std::string user, std::string key) -> std::shared_ptr<TwitchConnection>;
+  auto isConnected() const -> bool;
+  auto join(class Twitch &) -> void;
+  auto part(class Twitch &) -> void;
+  auto updateUserKey(const std::string &user, const std::string &key) -> void;
+  // parses IRC bytes as if the socket had read them and delivers their PRIVMSGs, for the chat
+  // flood test; the rest of the commands are ignored and nothing is sent back
+  auto replay(std::string) -> void;
+  // hands the bytes read from the socket to tap as well, on the main thread; null stops
+  auto tap(std::function<void(std::string_view)>) -> void;
+
+private:
+  static constexpr auto MinPrune = size_t{1024};
+  // IRC lines are tiny, this much unsent means the server stopped reading
+  static constexpr auto MaxQueuedBytes = size_t{64} << 10;
+
+  using Batch = std::vector<std::pair<std::string, TwitchSink::MsgPtr>>;
+
+  std::reference_wrapper<IoThread> io;
+  // main thread: by channel name without the '#'
+  std::map<std::string, std::reference_wrapper<Twitch>, std::less<>> channels;
+  std::atomic<bool> connected = false;
+  std::function<void(std::string_view)> tap_;
+  std::atomic<bool> isTapped = false;
+
+  // io thread from here on
+  std::string user;
+  std::string key;
+  uv::Tcp tcp;
+  enum class State {
+    connecting,
+    connected
+  };
+  State state = State::connecting;
+  IrcParser parser;
+  // kept apart so a replayed line never splices into a half read one
+  IrcParser replayParser;
+  std::set<std::string, std::less<>> joined;
+  // the messages of the current read, for the main thread
+  Batch batch;
+  // the bytes of the current read while tapped
+  std::string tapped;
+  struct Interned
+  {
+    std::string colorTag;
+    std::shared_ptr<const TwitchSink::Chatter> chatter;
+  };
+  // by display name; the chatters no message refers to any more are pruned as the map grows
+  std::map<std::string, Interned, std::less<>> chatters;
+  size_t pruneAt = MinPrune;
+  int initRetry = 1000;
+  // every queued write of a batch fails with it; only the first starts the retry
+  bool retryPending = false;
+  // created on the io thread
+  std::optional<uv::Timer> retryTimer;
+  std::optional<uv::Timer> pingTimer;
+
+  auto start() -> void;
+  auto deliver(Batch) -> void;
+  auto setState(State) -> void;
+  auto onJoin(std::string channel) -> void;
+  auto onPart(std::string channel) -> void;
+  auto onUserKey(std::string user, std::string key) -> void;
+  auto init() -> void;
+  auto initiateRetry() -> void;
+  auto sendPassNickUser() -> void;
+  auto readStart() -> void;
+  auto parseMsg() -> void;
+  auto onReplay(std::string) -> void;
+  // hands the messages parsed so far to the main thread
+  auto postBatch() -> void;
+  auto onPrivMsg(const IrcParser::Msg &) -> void;
+  auto intern(std::string_view displayName, std::string_view colorTag) -> std::shared_ptr<const TwitchSink::Chatter>;
+  auto onWelcome() -> void;
+  auto onPing(std::string_view) -> void;
+  auto onPong() -> void;
+  auto schedulePing() -> void;
+  // returns false if the write failed and a reconnect is on its way
+  auto send(std::string) -> bool;
+};
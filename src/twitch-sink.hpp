@@ -1,22 +1,39 @@
 #pragma once
 #include <glm/vec3.hpp>
+#include <memory>
 #include <string>
+#include <vector>
 
 class TwitchSink
 {
 public:
   virtual ~TwitchSink() = default;
 
-  struct Msg
+  // who wrote a message; one object per chatter and color, shared by all their messages
+  struct Chatter
   {
     std::string displayName;
-    std::string msg;
     glm::vec3 color = glm::vec3{0.f, 0.f, 0.f};
+  };
+  // a Twitch emote the message uses, by the word it is typed as
+  struct Emote
+  {
+    std::string id;
+    std::string code;
+  };
+  // immutable once parsed, every sink of the channel gets the same one
+  struct Msg
+  {
+    std::shared_ptr<const Chatter> chatter;
+    std::string msg;
     bool isFirst = false;
     bool isMod = false;
     int subscriber = -1;
+    // one per distinct emote, however often it is used
+    std::vector<Emote> emotes = {};
   };
-  virtual auto onMsg(Msg) -> void = 0;
+  using MsgPtr = std::shared_ptr<const Msg>;
+  virtual auto onMsg(const MsgPtr &) -> void = 0;
 };
 
 // color
@@ -1,52 +1,30 @@
 #pragma once
-#include <deque>
 #include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
-#include "shared_from_this.hpp"
+#include "twitch-connection.hpp"
 #include "twitch-sink.hpp"
-#include "uv.hpp"
 
-namespace uv
-{
-  class Uv;
-}
-
-class Twitch : public virtual enable_shared_from_this
+// The chat of one channel, joined over the account's shared connection.
+class Twitch
 {
 public:
-  Twitch(uv::Uv &, std::string user, std::string key, std::string channel);
+  Twitch(std::shared_ptr<TwitchConnection>, std::string channel);
   Twitch(const Twitch &) = delete;
+  ~Twitch();
   auto isConnected() const -> bool;
+  auto name() const -> const std::string & { return channel; }
+  auto onMsg(const TwitchSink::MsgPtr &) -> void;
+  // messages delivered since the channel was joined
+  auto received() const -> uint64_t { return received_; }
   auto reg(TwitchSink &) -> void;
   auto unreg(TwitchSink &) -> void;
-  auto updateUserKey(const std::string &user, const std::string &key) -> void;
 
 private:
-  std::reference_wrapper<uv::Uv> uv;
-  std::string user;
-  std::string key;
+  std::shared_ptr<TwitchConnection> connection;
   std::string channel;
-  uv::Tcp tcp;
-  enum class State {
-    connecting,
-    connected
-  };
-  State state = State::connecting;
-  std::deque<char> buf;
   std::vector<std::reference_wrapper<TwitchSink>> sinks;
-  int initRetry = 1000;
-  uv::Timer retryTimer;
-  uv::Timer pingTimer;
-
-  auto init() -> void;
-  auto initiateRetry() -> void;
-  auto sendPassNickUser() -> void;
-  auto readStart() -> void;
-  auto parseMsg() -> void;
-  auto onWelcome() -> void;
-  auto onPing(const std::string &) -> void;
-  auto onPong() -> void;
-  auto schedulePing() -> void;
+  uint64_t received_ = 0;
 };
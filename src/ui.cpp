@@ -1,6 +1,5 @@
 #include "ui.hpp"
 #include "imgui-helpers.hpp"
-#include "texture.hpp"
 #include "undo.hpp"
 #include <imgui.h>
 
@@ -14,11 +13,6 @@ namespace Ui
     ImGui::TextUnformatted(v);
   }
 
-  auto btnImg(const std::string &id, const class Texture &t, float w, float h) -> bool
-  {
-    return ImGui::ImageButton(id.c_str(), (void *)(intptr_t)t.texture(), ImVec2(w, h));
-  }
-
   auto dragFloat(class Undo &undo,
                  const char *label,
                  float &v,
@@ -31,7 +25,7 @@ namespace Ui
     const auto oldV = v;
     if (ImGui::DragFloat(label, &v, v_speed, v_min, v_max, format, flags))
     {
-      undo.record([newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; }, label);
+      undo.recordEdit(&v, [newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; }, label);
       return true;
     }
     return false;
@@ -47,7 +41,7 @@ namespace Ui
     const auto oldV = v;
     if (ImGui::InputInt(label, &v, step, step_fast, flags))
     {
-      undo.record([newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; }, label);
+      undo.recordEdit(&v, [newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; }, label);
       return true;
     }
     return false;
@@ -64,7 +58,7 @@ namespace Ui
     const auto oldV = v;
     if (ImGui::SliderFloat(label, &v, v_min, v_max, format, flags))
     {
-      undo.record([newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; }, label);
+      undo.recordEdit(&v, [newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; }, label);
       return true;
     }
     return false;
@@ -75,7 +69,7 @@ namespace Ui
     const auto oldV = v;
     if (ImGui::Checkbox(label, &v))
     {
-      undo.record([newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; });
+      undo.recordEdit(&v, [newV = v, &v]() { v = newV; }, [oldV, &v]() { v = oldV; }, label);
       return true;
     }
     return false;
@@ -64,7 +64,6 @@
     bool isEmpty = false;                                                 \
   }
 
-class Texture;
 class Undo;
 
 namespace Ui
@@ -101,7 +100,6 @@ namespace Ui
     bool isEmpty = false;
   };
 
-  auto btnImg(const std::string &id, const Texture &, float w, float h) -> bool;
   auto dragFloat(Undo &,
                  const char *label,
                  float &v,
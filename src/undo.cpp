@@ -1,17 +1,47 @@
 #include "undo.hpp"
 #include <cmath>
 
-auto Undo::record(Operation action, Operation rollback, std::string tag) -> void
+auto Undo::record(Operation action, Operation rollback, std::string tag, size_t heldBytes) -> void
 {
   action();
-  undoStack.emplace_back(std::move(tag), SDL_GetTicks(), std::move(action), std::move(rollback));
-  redoStack.clear();
+  ++version_;
+  clearRedo();
+  undoStack.emplace_back(
+    std::move(tag), SDL_GetTicks(), std::move(action), std::move(rollback), nullptr, heldBytes);
+  bytes_ += cost(undoStack.back());
+  trim();
+}
+
+auto Undo::recordEdit(const void *target, Operation action, Operation rollback, std::string tag) -> void
+{
+  const auto now = SDL_GetTicks();
+  // after an undo the top entry is no longer the edit in progress
+  if (redoStack.empty() && !undoStack.empty())
+  {
+    auto &top = undoStack.back();
+    if (top.target == target && top.tag == tag && now - top.timestamp < MergeMs)
+    {
+      action();
+      ++version_;
+      // the rollback of the first edit is kept
+      top.action = std::move(action);
+      top.timestamp = now;
+      return;
+    }
+  }
+  action();
+  ++version_;
+  clearRedo();
+  undoStack.emplace_back(std::move(tag), now, std::move(action), std::move(rollback), target);
+  bytes_ += cost(undoStack.back());
+  trim();
 }
 
 auto Undo::undo() -> void
 {
   if (!hasUndo())
     return;
+  ++version_;
   std::string lastTag;
   Uint32 lastTimestamp;
   do
@@ -30,6 +60,7 @@ auto Undo::redo() -> void
 {
   if (!hasRedo())
     return;
+  ++version_;
   std::string lastTag;
   Uint32 lastTimestamp;
   do
@@ -44,6 +75,28 @@ auto Undo::redo() -> void
            std::abs(static_cast<int64_t>(lastTimestamp) - redoStack.back().timestamp) < 500);
 }
 
+auto Undo::clearRedo() -> void
+{
+  for (const auto &rec : redoStack)
+    bytes_ -= cost(rec);
+  redoStack.clear();
+}
+
+auto Undo::trim() -> void
+{
+  // the newest entry stays even when it alone is over the budget
+  while (undoStack.size() > 1 && (undoStack.size() > MaxEntries || bytes_ > MaxBytes))
+  {
+    bytes_ -= cost(undoStack.front());
+    undoStack.pop_front();
+  }
+}
+
+auto Undo::cost(const Action &rec) -> size_t
+{
+  return sizeof(Action) + rec.tag.capacity() + rec.heldBytes;
+}
+
 auto Undo::hasUndo() const -> bool
 {
   return !undoStack.empty();
@@ -1,34 +1,67 @@
 #pragma once
 #include <SDL.h>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <string>
 #include <vector>
 
+// The history is bounded by MaxEntries and MaxBytes, the oldest entries are dropped past either.
+// An entry costs its own size plus what the caller says its closures keep alive, which matters
+// for deletes: an undoable delete holds the whole subtree and its textures.
 class Undo
 {
 public:
   using Operation = std::move_only_function<void()>;
   struct Action
   {
-    Action(std::string aTag, Uint32 aTimestamp, Operation aAction, Operation aRollback)
+    Action(std::string aTag,
+           Uint32 aTimestamp,
+           Operation aAction,
+           Operation aRollback,
+           const void *aTarget = nullptr,
+           size_t aHeldBytes = 0)
       : tag(std::move(aTag)),
         timestamp(aTimestamp),
         action(std::move(aAction)),
-        rollback(std::move(aRollback))
+        rollback(std::move(aRollback)),
+        target(aTarget),
+        heldBytes(aHeldBytes)
     {
     }
     std::string tag;
     Uint32 timestamp;
     Operation action;
     Operation rollback;
+    // the value an edit changes, see recordEdit()
+    const void *target;
+    size_t heldBytes;
   };
-  auto record(Operation action, Operation rollback, std::string tag = "") -> void;
+  auto record(Operation action, Operation rollback, std::string tag = "", size_t heldBytes = 0) -> void;
+  // like record, but folds into the previous entry when that edited the same target less than
+  // MergeMs ago, so a drag leaves a single entry that rolls back to the value before it started
+  auto recordEdit(const void *target, Operation action, Operation rollback, std::string tag = "") -> void;
   auto undo() -> void;
   auto redo() -> void;
   auto hasUndo() const -> bool;
   auto hasRedo() const -> bool;
+  // bumped by every record, undo and redo, so caches can tell that the scene was edited
+  auto version() const -> uint64_t { return version_; }
+  auto entries() const -> size_t { return undoStack.size() + redoStack.size(); }
+  auto bytes() const -> size_t { return bytes_; }
+
+  static constexpr auto MaxEntries = size_t{1000};
+  static constexpr auto MaxBytes = size_t{256} << 20;
+  static constexpr auto MergeMs = Uint32{500};
 
 private:
-  std::vector<Action> undoStack;
+  uint64_t version_ = 0;
+  size_t bytes_ = 0;
+  // oldest first, trimmed from the front
+  std::deque<Action> undoStack;
   std::vector<Action> redoStack;
+
+  auto clearRedo() -> void;
+  auto trim() -> void;
+  static auto cost(const Action &) -> size_t;
 };
@@ -1,10 +1,59 @@
 #include "uv.hpp"
+#include "trace.hpp"
+#include <algorithm>
 #include <spdlog/spdlog.h>
 #include <sstream>
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 namespace uv
 {
+  namespace
+  {
+    // Read buffers for the connections without their own. A slab is out only from the allocation
+    // to the read callback, so idle connections hold no buffer and a few slabs serve them all.
+    class SlabPool
+    {
+    public:
+      static constexpr auto SlabSize = size_t{64} << 10;
+
+      auto get() -> std::unique_ptr<char[]>
+      {
+        if (slabs.empty())
+          return std::make_unique_for_overwrite<char[]>(SlabSize);
+        auto ret = std::move(slabs.back());
+        slabs.pop_back();
+        return ret;
+      }
+
+      auto put(std::unique_ptr<char[]> slab) -> void
+      {
+        if (slab && slabs.size() < MaxFree)
+          slabs.push_back(std::move(slab));
+      }
+
+    private:
+      static constexpr auto MaxFree = size_t{8};
+      std::vector<std::unique_ptr<char[]>> slabs;
+    };
+
+    // the handles are only touched from the loop thread
+    auto slabPool() -> SlabPool &
+    {
+      static auto pool = SlabPool{};
+      return pool;
+    }
+
+    // the handle is freed only once the loop is done with it
+    template <typename Handle>
+    auto close(Handle *handle) -> void
+    {
+      uv_close(reinterpret_cast<uv_handle_t *>(handle),
+               [](uv_handle_t *aHandle) { delete reinterpret_cast<Handle *>(aHandle); });
+    }
+  } // namespace
+
   Tcp::Tcp(uv_loop_t *loop)
     : socket(std::make_unique<uv_tcp_t>())
   {
@@ -13,7 +62,7 @@ namespace uv
     socket->data = this;
   }
 
-  auto Tcp::readStart(ReadCallback cb) -> int
+  auto Tcp::readStart(ReadCallback cb, AllocCallback alloc) -> int
   {
     SPDLOG_DEBUG("{}: {}", this, socket);
     if (!socket)
@@ -23,6 +72,7 @@ namespace uv
       return -1;
     }
     readCb = std::move(cb);
+    allocCb = std::move(alloc);
     socket->data = this;
     return uv_read_start((uv_stream_t *)socket.get(),
                          [](uv_handle_t *handle, size_t suggestedSize, uv_buf_t *aBuf) {
@@ -30,14 +80,23 @@ namespace uv
                            if (!self)
                            {
                              SPDLOG_DEBUG("self is nullptr");
+                             // a null buffer makes libuv report UV_ENOBUFS
+                             *aBuf = uv_buf_init(nullptr, 0);
                              return;
                            }
-                           self->buf.resize(suggestedSize);
-                           aBuf->base = self->buf.data();
+                           auto room = self->allocCb ? self->allocCb(suggestedSize) : std::span<char>{};
+                           if (room.empty())
+                           {
+                             if (!self->slab)
+                               self->slab = slabPool().get();
+                             room = {self->slab.get(), SlabPool::SlabSize};
+                           }
+                           aBuf->base = room.data();
                            // NOTE: uv_buf_t::len type is system dependant
-                           aBuf->len = static_cast<decltype(uv_buf_t::len)>(suggestedSize);
+                           aBuf->len = static_cast<decltype(uv_buf_t::len)>(std::min(room.size(), suggestedSize));
                          },
                          [](uv_stream_t *stream, ssize_t nread, const uv_buf_t *aBuf) {
+                           auto span = Trace::Span{"uv read"};
                            auto self = static_cast<Tcp *>(stream->data);
                            if (!self)
                            {
@@ -48,47 +107,111 @@ namespace uv
                          });
   }
 
-  namespace
-  {
-    struct WriteCtx
-    {
-      Tcp *tcp;
-      std::string buf;
-      uv_buf_t uvBuf;
-      Tcp::WriteCallback cb;
-    };
-  } // namespace
-
   auto Tcp::write(std::string val, WriteCallback cb) -> int
   {
     if (!socket)
     {
       SPDLOG_DEBUG("{}: uninitialized TCP connection", this);
-      cb(-1);
       return -1;
     }
 
     socket->data = this;
-    struct Request : uv_write_t
+    if (!inFlight && !queued)
     {
-      WriteCtx ctx;
-    };
+      // the usual small IRC line fits in the socket buffer and needs no request at all
+      auto uvBuf = uv_buf_init(val.data(), static_cast<unsigned>(val.size()));
+      const auto r = uv_try_write((uv_stream_t *)socket.get(), &uvBuf, 1);
+      if (r >= 0 && static_cast<size_t>(r) == val.size())
+      {
+        if (cb)
+          cb(0);
+        return 0;
+      }
+      if (r < 0 && r != UV_EAGAIN)
+      {
+        SPDLOG_ERROR("{}", uv_err_name(r));
+        return r;
+      }
+      if (r > 0)
+        val.erase(0, static_cast<size_t>(r));
+    }
 
-    auto req = std::make_unique<Request>();
-    req->ctx.tcp = this;
-    const auto sz = static_cast<int>(val.size());
-    req->ctx.buf = std::move(val);
-    req->ctx.uvBuf = uv_buf_init(req->ctx.buf.data(), sz);
-    req->ctx.cb = std::move(cb);
-    return uv_write(
-      req.release(), (uv_stream_t *)socket.get(), &req->ctx.uvBuf, 1, [](uv_write_t *aReq, int status) {
-        auto req = std::unique_ptr<Request>(static_cast<Request *>(aReq));
-        req->ctx.tcp->onWrite(status, std::move(req->ctx.cb));
-      });
+    if (!queued)
+    {
+      queued = spare ? std::move(spare) : std::make_unique<WriteBatch>();
+      queued->bytes = 0;
+    }
+    queued->bytes += val.size();
+    queuedBytes_ += val.size();
+    queued->bufs.push_back(std::move(val));
+    queued->cbs.push_back(std::move(cb));
+    if (inFlight)
+      return 0;
+    return flush(true);
+  }
+
+  auto Tcp::flush(bool isFromWrite) -> int
+  {
+    auto batch = std::move(queued);
+    batch->uvBufs.clear();
+    for (auto &buf : batch->bufs)
+      batch->uvBufs.push_back(uv_buf_init(buf.data(), static_cast<unsigned>(buf.size())));
+    const auto r = uv_write(batch.get(),
+                            (uv_stream_t *)socket.get(),
+                            batch->uvBufs.data(),
+                            static_cast<unsigned>(batch->uvBufs.size()),
+                            [](uv_write_t *aReq, int status) {
+                              auto span = Trace::Span{"uv write"};
+                              auto req = std::unique_ptr<WriteBatch>(static_cast<WriteBatch *>(aReq));
+                              if (auto self = static_cast<Tcp *>(aReq->handle->data))
+                              {
+                                self->onWrite(std::move(req), status);
+                                return;
+                              }
+                              // the connection was closed while the write was in flight
+                              for (auto &cb : req->cbs)
+                                if (cb)
+                                  cb(status);
+                            });
+    if (r < 0)
+    {
+      SPDLOG_ERROR("{}", uv_err_name(r));
+      queuedBytes_ -= batch->bytes;
+      if (!isFromWrite)
+        for (auto &cb : batch->cbs)
+          if (cb)
+            cb(r);
+      return r;
+    }
+    inFlight = batch.release();
+    return 0;
+  }
+
+  auto Tcp::onWrite(std::unique_ptr<WriteBatch> batch, int status) -> void
+  {
+    inFlight = nullptr;
+    queuedBytes_ -= batch->bytes;
+    auto cbs = std::move(batch->cbs);
+    batch->bufs.clear();
+    batch->cbs.clear();
+    spare = std::move(batch);
+    if (queued)
+      flush(false);
+    // last, a callback may close the connection
+    for (auto &cb : cbs)
+      if (cb)
+        cb(status);
   }
 
   auto Tcp::onRead(ssize_t nread, const uv_buf_t *aBuf) -> void
   {
+    // the slab goes back once the callback is done with the view, whatever the outcome
+    struct SlabReturn
+    {
+      std::unique_ptr<char[]> slab;
+      ~SlabReturn() { slabPool().put(std::move(slab)); }
+    };
+    const auto slabReturn = SlabReturn{std::move(slab)};
     if (nread < 0)
     {
       SPDLOG_ERROR("{}", uv_err_name(static_cast<int>(nread)));
@@ -100,13 +223,38 @@ namespace uv
       SPDLOG_DEBUG("{}: The TCP read callback is not set up", this);
       return;
     }
-    readCb(0, std::string_view{aBuf->base, aBuf->base + nread});
+    if (nread == 0)
+      return;
+    readCb(0, std::string_view{aBuf->base, static_cast<size_t>(nread)});
   }
 
   Uv::Uv()
     : loop_(uv_default_loop())
   {
     loop_->data = this;
+    uv_loop_configure(loop_, UV_METRICS_IDLE_TIME);
+  }
+
+  Uv::Uv(uv_loop_t *aLoop)
+    : loop_(aLoop)
+  {
+    loop_->data = this;
+    uv_loop_configure(loop_, UV_METRICS_IDLE_TIME);
+  }
+
+  auto Uv::idleTime() const -> uint64_t
+  {
+    return uv_metrics_idle_time(loop_);
+  }
+
+  auto Uv::run() -> int
+  {
+    return uv_run(loop_, UV_RUN_DEFAULT);
+  }
+
+  auto Uv::stop() -> void
+  {
+    uv_stop(loop_);
   }
 
   auto Uv::tick() -> int
@@ -114,6 +262,11 @@ namespace uv
     return uv_run(loop_, UV_RUN_ONCE);
   }
 
+  auto Uv::poll() -> int
+  {
+    return uv_run(loop_, UV_RUN_NOWAIT);
+  }
+
   namespace
   {
     struct ConnectCtx
@@ -152,6 +305,7 @@ namespace uv
       loop_,
       req.release(),
       [](uv_getaddrinfo_t *aReq, int status, struct addrinfo *res) -> void {
+        auto span = Trace::Span{"uv resolved"};
         auto req = std::unique_ptr<Request>(static_cast<Request *>(aReq));
         req->ctx.uv->onResolved(status, res, std::move(req->ctx.cb));
       },
@@ -190,6 +344,7 @@ namespace uv
                             sock,
                             (const struct sockaddr *)result->ai_addr,
                             [](uv_connect_t *aReq, int aStatus) {
+                              auto span = Trace::Span{"uv connected"};
                               auto req = std::unique_ptr<Request>(static_cast<Request *>(aReq));
                               SPDLOG_INFO("Connected");
 
@@ -210,6 +365,101 @@ namespace uv
     cb(status, std::move(tcp));
   }
 
+  auto Uv::queueWork(WorkCb work, AfterWorkCb after) -> Work
+  {
+    struct Request : uv_work_t
+    {
+      WorkCb work;
+      AfterWorkCb after;
+      // keeps the request alive until the after callback; Work handles only watch it
+      std::shared_ptr<Request> keep;
+    };
+    auto req = std::make_shared<Request>();
+    req->work = std::move(work);
+    req->after = std::move(after);
+    req->keep = req;
+    const auto r = uv_queue_work(
+      loop_,
+      req.get(),
+      [](uv_work_t *aReq) {
+        auto span = Trace::Span{"uv work"};
+        static_cast<Request *>(aReq)->work();
+      },
+      [](uv_work_t *aReq, int status) {
+        auto span = Trace::Span{"uv after work"};
+        auto req = std::move(static_cast<Request *>(aReq)->keep);
+        req->after(status);
+      });
+    if (r < 0)
+    {
+      SPDLOG_ERROR("{}", uv_err_name(r));
+      req->keep = nullptr;
+      return Work{};
+    }
+    return Work{req};
+  }
+
+  Work::Work(std::weak_ptr<uv_work_t> aReq) : req(std::move(aReq)) {}
+
+  auto Work::cancel() -> bool
+  {
+    // the request is alive until its after callback, which runs on this same loop thread
+    auto r = req.lock();
+    return r && uv_cancel(reinterpret_cast<uv_req_t *>(r.get())) == 0;
+  }
+
+  Async::Async(uv_loop_t *loop)
+    : async(new uv_async_t)
+  {
+    uv_async_init(loop, async, [](uv_async_t *handle) {
+      auto span = Trace::Span{"uv async"};
+      static_cast<Async *>(handle->data)->run();
+    });
+    async->data = this;
+  }
+
+  Async::~Async()
+  {
+    close(async);
+  }
+
+  auto Async::post(Task task) -> int
+  {
+    {
+      auto lock = std::lock_guard{mutex};
+      tasks.push_back(std::move(task));
+    }
+    return uv_async_send(async);
+  }
+
+  auto Async::wake() -> int
+  {
+    return uv_async_send(async);
+  }
+
+  auto Async::run() -> void
+  {
+    auto ready = std::vector<Task>{};
+    {
+      auto lock = std::lock_guard{mutex};
+      std::swap(ready, tasks);
+    }
+    for (auto &task : ready)
+      task();
+    if (woken)
+      woken();
+  }
+
+  auto Async::onWake(Task v) -> void
+  {
+    woken = std::move(v);
+  }
+
+  auto Uv::createAsync() -> Async
+  {
+    return Async{loop_};
+  }
+
   auto Uv::createTimer() -> Timer
   {
     return Timer{loop_};
@@ -226,7 +476,14 @@ namespace uv
   }
 
   Tcp::Tcp(Tcp &&other)
-    : socket(std::move(other.socket)), readCb(std::move(other.readCb)), buf(std::move(other.buf))
+    : socket(std::move(other.socket)),
+      readCb(std::move(other.readCb)),
+      allocCb(std::move(other.allocCb)),
+      slab(std::move(other.slab)),
+      queued(std::move(other.queued)),
+      inFlight(std::exchange(other.inFlight, nullptr)),
+      spare(std::move(other.spare)),
+      queuedBytes_(std::exchange(other.queuedBytes_, 0))
   {
     if (socket)
       socket->data = this;
@@ -239,20 +496,27 @@ namespace uv
     {
       SPDLOG_DEBUG("{}: graceful disconnect", this);
       socket->data = nullptr;
+      // the write in flight completes on its own, the queued one is never sent
+      queued = nullptr;
+      inFlight = nullptr;
+      queuedBytes_ = 0;
       auto rawSocket = socket.release();
       uv_read_stop((uv_stream_t *)rawSocket);
-      struct Request : uv_shutdown_t
-      {
-        Request(uv_tcp_t *tcp) { this->handle = reinterpret_cast<uv_stream_t *>(tcp); }
-        ~Request() { delete static_cast<uv_tcp_t *>(this->data); }
-      };
-      auto req = std::make_unique<uv_shutdown_t>(rawSocket);
-      uv_shutdown(req.release(), (uv_stream_t *)rawSocket, [](uv_shutdown_t *aReq, int status) {
-        auto req = std::unique_ptr<Request>(static_cast<Request *>(aReq));
+      auto req = std::make_unique<uv_shutdown_t>();
+      const auto r = uv_shutdown(req.get(), (uv_stream_t *)rawSocket, [](uv_shutdown_t *aReq, int status) {
+        auto req = std::unique_ptr<uv_shutdown_t>(aReq);
         SPDLOG_DEBUG("Disconnected");
         if (status < 0)
           SPDLOG_ERROR("{}", uv_err_name(status));
+        close(reinterpret_cast<uv_tcp_t *>(req->handle));
       });
+      if (r < 0)
+      {
+        // never connected
+        close(rawSocket);
+        return;
+      }
+      req.release();
     }
   }
 
@@ -262,7 +526,12 @@ namespace uv
 
     socket = std::move(other.socket);
     readCb = std::move(other.readCb);
-    buf = std::move(other.buf);
+    allocCb = std::move(other.allocCb);
+    slab = std::move(other.slab);
+    queued = std::move(other.queued);
+    inFlight = std::exchange(other.inFlight, nullptr);
+    spare = std::move(other.spare);
+    queuedBytes_ = std::exchange(other.queuedBytes_, 0);
     if (socket)
       socket->data = this;
     other.socket = nullptr;
@@ -288,6 +557,7 @@ namespace uv
     return uv_timer_start(
       timer.get(),
       [](uv_timer_t *handle) {
+        auto span = Trace::Span{"uv timer"};
         auto self = static_cast<Timer *>(handle->data);
         if (!self->callback)
         {
@@ -312,7 +582,8 @@ namespace uv
 
   Timer::~Timer()
   {
-    stop();
+    if (timer)
+      close(timer.release());
   }
 
   auto Uv::loop() const -> uv_loop_t *
@@ -337,6 +608,7 @@ namespace uv
     cb = std::move(aCb);
     idle->data = this;
     return uv_idle_start(idle.get(), [](uv_idle_t *handle) {
+      auto span = Trace::Span{"uv idle"};
       auto self = static_cast<Idle *>(handle->data);
       if (!self->cb)
       {
@@ -374,6 +646,7 @@ namespace uv
     cb = std::move(aCb);
     prepare->data = this;
     return uv_prepare_start(prepare.get(), [](uv_prepare_t *handle) {
+      auto span = Trace::Span{"uv prepare"};
       auto self = static_cast<Prepare *>(handle->data);
       if (!self->cb)
       {
@@ -413,6 +686,7 @@ namespace uv
     return uv_fs_event_start(
       event.get(),
       [](uv_fs_event_t *handle, const char *filename, int events, int status) {
+        auto span = Trace::Span{"uv fs event"};
         auto self = static_cast<FsEvent *>(handle->data);
         if (!self->cb)
         {
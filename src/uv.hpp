@@ -1,8 +1,14 @@
 #pragma once
 #include <functional>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <span>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <uv.h>
+#include <vector>
 
 namespace uv
 {
@@ -12,6 +18,8 @@ namespace uv
 
   public:
     using ReadCallback = std::move_only_function<void(int status, std::string_view)>;
+    // memory for the next read of at most suggested bytes
+    using AllocCallback = std::move_only_function<std::span<char>(size_t suggested)>;
     using WriteCallback = std::move_only_function<void(int status)>;
 
     Tcp() = default;
@@ -19,17 +27,46 @@ namespace uv
     Tcp(uv_loop_t *);
     Tcp &operator=(Tcp &&);
     ~Tcp();
-    auto readStart(ReadCallback) -> int;
+    // without alloc every read lands in a slab borrowed from a pool shared by all connections and
+    // the view is valid during the callback only; with alloc the view is the filled front of the
+    // memory it returned
+    auto readStart(ReadCallback, AllocCallback alloc = nullptr) -> int;
+    // Sends right away when nothing is waiting, otherwise the buffer joins the ones queued behind
+    // the write in flight and they all go out in one vectored write. cb runs once the bytes are
+    // with the kernel, which is before write() returns when they went out at once; it is not
+    // called when write() returns an error.
     auto write(std::string, WriteCallback) -> int;
+    // bytes accepted by write() that the kernel has not taken yet, growing when the peer stalls
+    auto queuedBytes() const -> size_t { return queuedBytes_; }
     auto isInitialized() const -> bool { return socket != nullptr; }
 
   private:
     std::unique_ptr<uv_tcp_t> socket = nullptr;
     ReadCallback readCb;
-    std::string buf;
+    AllocCallback allocCb;
+    // the pooled slab between the allocation and the read
+    std::unique_ptr<char[]> slab;
+
+    struct WriteBatch : uv_write_t
+    {
+      std::vector<std::string> bufs;
+      std::vector<uv_buf_t> uvBufs;
+      std::vector<WriteCallback> cbs;
+      size_t bytes = 0;
+    };
+    // the buffers waiting for the write in flight to complete
+    std::unique_ptr<WriteBatch> queued;
+    // owned by libuv until its callback; one at a time keeps the bytes in order
+    WriteBatch *inFlight = nullptr;
+    // the last completed batch, reused so steady traffic does not allocate requests
+    std::unique_ptr<WriteBatch> spare;
+    size_t queuedBytes_ = 0;
 
     auto onRead(ssize_t nread, const uv_buf_t *buf) -> void;
-    auto onWrite(int status, WriteCallback cb) -> void { cb(status); }
+    // a batch that cannot be sent fails its callbacks, except for the one write() is sending on
+    // its own, which has only the return value report it
+    auto flush(bool isFromWrite) -> int;
+    auto onWrite(std::unique_ptr<WriteBatch>, int status) -> void;
     auto deinit() -> void;
   };
 
@@ -102,19 +139,108 @@ namespace uv
     Cb cb = nullptr;
   };
 
+  // Work queued on the thread pool. Dropping the handle does not cancel the work.
+  class Work
+  {
+    friend class Uv;
+
+  public:
+    Work() = default;
+    // true if the work had not started yet; it never runs and its after callback gets
+    // UV_ECANCELED
+    auto cancel() -> bool;
+
+  private:
+    Work(std::weak_ptr<uv_work_t>);
+    std::weak_ptr<uv_work_t> req;
+  };
+
+  // Runs tasks posted from any thread on the loop thread, in order. Posts that arrive before the
+  // loop gets to them are handled in one wakeup.
+  class Async
+  {
+    friend class Uv;
+
+  public:
+    using Task = std::move_only_function<auto()->void>;
+    Async(const Async &) = delete;
+    ~Async();
+    auto post(Task) -> int;
+    // only wakes the loop, for a real time thread that must neither lock nor allocate
+    auto wake() -> int;
+    // runs on the loop after the posted tasks every time it is woken; wakes that come before the
+    // loop gets to it are folded into one
+    auto onWake(Task) -> void;
+
+  private:
+    Async(uv_loop_t *);
+    uv_async_t *async;
+    std::mutex mutex;
+    std::vector<Task> tasks;
+    Task woken = nullptr;
+
+    auto run() -> void;
+  };
+
   class Uv
   {
   public:
     using ConnectCb = std::function<auto(int status, Tcp)->void>;
+    using WorkCb = std::move_only_function<auto()->void>;
+    using AfterWorkCb = std::move_only_function<auto(int status)->void>;
 
     Uv();
+    // a loop the caller initialized, to run on another thread
+    explicit Uv(uv_loop_t *);
     auto connect(const std::string &domain, const std::string &port, ConnectCb) -> int;
+    auto createAsync() -> Async;
     auto createFsEvent() -> FsEvent;
     auto createIdle() -> Idle;
     auto createPrepare() -> Prepare;
     auto createTimer() -> Timer;
     auto loop() const -> uv_loop_t *;
+    // runs work on the libuv thread pool and then after on the loop thread
+    auto queueWork(WorkCb work, AfterWorkCb after) -> Work;
+
+    // runs fn on the thread pool and then(result) on the loop thread, or then() for a void fn; then
+    // is skipped if the work failed to run or was cancelled
+    template <typename Fn, typename Then>
+    auto queue(Fn fn, Then then) -> Work
+    {
+      using Result = std::invoke_result_t<Fn &>;
+      if constexpr (std::is_void_v<Result>)
+        return queueWork(std::move(fn), [then = std::move(then)](int status) mutable {
+          if (status == 0)
+            then();
+        });
+      else
+      {
+        auto result = std::make_shared<std::optional<Result>>();
+        return queueWork([result, fn = std::move(fn)]() mutable { result->emplace(fn()); },
+                         [result, then = std::move(then)](int status) mutable {
+                           if (status == 0 && *result)
+                             then(std::move(**result));
+                         });
+      }
+    }
+
+    // as above with then(self, result), skipped as well once alive has expired
+    template <typename T, typename Fn, typename Then>
+    auto queue(std::weak_ptr<T> alive, Fn fn, Then then) -> Work
+    {
+      return queue(std::move(fn), [alive = std::move(alive), then = std::move(then)](auto &&...result) mutable {
+        if (auto self = alive.lock())
+          then(*self, std::forward<decltype(result)>(result)...);
+      });
+    }
     auto tick() -> int;
+    // runs until stop() or until nothing is left to wait for
+    auto run() -> int;
+    auto stop() -> void;
+    // runs the ready callbacks without blocking
+    auto poll() -> int;
+    // nanoseconds the loop spent waiting for events, the rest of the time went to callbacks
+    auto idleTime() const -> uint64_t;
 
   private:
     uv_loop_t *loop_;
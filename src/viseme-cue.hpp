@@ -0,0 +1,10 @@
+#pragma once
+#include "viseme.hpp"
+#include <cstddef>
+
+// viseme that starts offset samples into a clip
+struct VisemeCue
+{
+  Viseme viseme = Viseme::sil;
+  size_t offset = 0;
+};
@@ -0,0 +1,47 @@
+#include "viseme-route.hpp"
+#include <algorithm>
+
+VisemeRoute::VisemeRoute(VisemesSource &aSource) : source(aSource)
+{
+  source.get().reg(*this);
+}
+
+VisemeRoute::~VisemeRoute()
+{
+  source.get().unreg(*this);
+}
+
+auto VisemeRoute::reg(VisemesSink &v) -> void
+{
+  sinks.push_back(v);
+}
+
+auto VisemeRoute::unreg(VisemesSink &v) -> void
+{
+  sinks.erase(
+    std::remove_if(std::begin(sinks), std::end(sinks), [&](const auto &x) { return &x.get() == &v; }),
+    std::end(sinks));
+}
+
+auto VisemeRoute::isReady() const -> bool
+{
+  return source.get().isReady();
+}
+
+auto VisemeRoute::ingest(Viseme v) -> void
+{
+  if (muted)
+    return;
+  for (auto sink : sinks)
+    sink.get().ingest(v);
+}
+
+auto VisemeRoute::mute(bool v) -> void
+{
+  if (v == muted)
+    return;
+  // a mouth muted mid-word would otherwise stay open
+  if (v)
+    ingest(Viseme::sil);
+  muted = v;
+}
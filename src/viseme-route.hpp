@@ -0,0 +1,27 @@
+#pragma once
+#include "visemes-sink.hpp"
+#include "visemes-source.hpp"
+#include <functional>
+#include <vector>
+
+// Fans the visemes of a shared source out to the mouths of one scene, so several avatars hear
+// the same capture and recognizer and each can be muted on its own. A muted route closes its
+// mouths once and lets nothing through until it is unmuted.
+class VisemeRoute final : public VisemesSource, public VisemesSink
+{
+public:
+  explicit VisemeRoute(VisemesSource &);
+  VisemeRoute(const VisemeRoute &) = delete;
+  ~VisemeRoute() final;
+  auto reg(VisemesSink &) -> void final;
+  auto unreg(VisemesSink &) -> void final;
+  auto isReady() const -> bool final;
+  auto ingest(Viseme) -> void final;
+  auto isMuted() const -> bool { return muted; }
+  auto mute(bool) -> void;
+
+private:
+  std::reference_wrapper<VisemesSource> source;
+  std::vector<std::reference_wrapper<VisemesSink>> sinks;
+  bool muted = false;
+};
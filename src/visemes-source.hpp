@@ -0,0 +1,15 @@
+#pragma once
+
+#include "visemes-sink.hpp"
+
+// Where the mouths of a scene take their visemes from: the recognizer itself, or the route of
+// one avatar that passes the recognizer's visemes on only while its mic is on.
+class VisemesSource
+{
+public:
+  virtual ~VisemesSource() = default;
+  virtual auto reg(VisemesSink &) -> void = 0;
+  virtual auto unreg(VisemesSink &) -> void = 0;
+  // the recognizer model is loaded
+  virtual auto isReady() const -> bool = 0;
+};
@@ -0,0 +1,287 @@
+#include "voice-catalog.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <fmt/std.h>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+#include "azure-token.hpp"
+#include "file.hpp"
+#include "http-client.hpp"
+#include "json-fields.hpp"
+
+namespace
+{
+  constexpr auto Magic = std::string_view{"VVC1"};
+  constexpr auto Path = "/cognitiveservices/voices/list";
+
+  auto iequals(std::string_view a, std::string_view b) -> bool
+  {
+    return std::ranges::equal(a, b, [](char x, char y) {
+      return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+  }
+} // namespace
+
+VoiceCatalog::VoiceCatalog(uv::Uv &aUv, AzureToken &aToken, HttpClient &aHttpClient)
+  : uv(aUv), token(aToken), httpClient(aHttpClient)
+{
+}
+
+auto VoiceCatalog::get(Callback cb) -> void
+{
+  if (state == State::ready && !entry.voices.empty())
+  {
+    cb(entry.voices);
+    if (isStale())
+      revalidate();
+    return;
+  }
+  callbacks.emplace_back(std::move(cb));
+  if (state == State::unloaded)
+    load();
+  else if (state == State::ready)
+    revalidate();
+}
+
+auto VoiceCatalog::isStale() const -> bool
+{
+  return Clock::now() > entry.fetchedAt + Ttl;
+}
+
+auto VoiceCatalog::load() -> void
+{
+  state = State::loading;
+  uv.get().queue(
+    weak_self(), [path = path()]() { return read(path); }, [](auto &self, std::optional<Entry> loaded) {
+      self.onLoaded(std::move(loaded));
+    });
+}
+
+auto VoiceCatalog::onLoaded(std::optional<Entry> loaded) -> void
+{
+  state = State::ready;
+  if (loaded)
+    entry = std::move(*loaded);
+  // a stale list is still better than an empty dropdown while it is revalidated
+  if (!entry.voices.empty())
+    deliver();
+  if (entry.voices.empty() || isStale())
+    revalidate();
+}
+
+auto VoiceCatalog::revalidate() -> void
+{
+  if (fetching)
+    return;
+  fetching = true;
+  token.get().get([alive = weak_self()](const std::string &t, const std::string &err) {
+    auto self = alive.lock();
+    if (!self)
+    {
+      SPDLOG_INFO("this was destroyed");
+      return;
+    }
+    if (t.empty())
+    {
+      self->fetching = false;
+      self->isAuthRetry = false;
+      self->lastError_ = err;
+      self->deliver();
+      return;
+    }
+    auto headers = HttpClient::Headers{
+      {"Accept", ""},
+      {"User-Agent", "curl/7.68.0"},
+      {"Authorization", fmt::format("Bearer {}", t)},
+    };
+    // only a list that is still there can be revalidated
+    if (!self->entry.voices.empty())
+    {
+      if (!self->entry.etag.empty())
+        headers.emplace_back("If-None-Match", self->entry.etag);
+      if (!self->entry.lastModified.empty())
+        headers.emplace_back("If-Modified-Since", self->entry.lastModified);
+    }
+    auto validators = std::make_shared<Entry>();
+    self->httpClient.get().stream(
+      token.get().endpoint("tts") + Path,
+      std::nullopt,
+      HttpClient::Stream{
+        .onHeader =
+          [validators](std::string_view name, std::string_view value) {
+            if (iequals(name, "etag"))
+              validators->etag = value;
+            else if (iequals(name, "last-modified"))
+              validators->lastModified = value;
+          },
+        .onDone =
+          [validators, alive](CURLcode code, long httpStatus, std::string payload) {
+            if (auto self = alive.lock())
+              self->onFetched(code, httpStatus, std::move(payload), std::move(*validators));
+            else
+              SPDLOG_INFO("this was destroyed");
+          },
+        // the list is large and a stale copy is already showing
+        .priority = self->callbacks.empty() ? HttpClient::Priority::background : HttpClient::Priority::interactive},
+      headers);
+  });
+}
+
+auto VoiceCatalog::onFetched(CURLcode code, long httpStatus, std::string payload, Entry validators) -> void
+{
+  fetching = false;
+  if (code != CURLE_OK)
+  {
+    SPDLOG_INFO("{} {}", curl_easy_strerror(code), httpStatus);
+    isAuthRetry = false;
+    lastError_ = std::string{"CURL Error: "} + curl_easy_strerror(code);
+    deliver();
+    return;
+  }
+  if (httpStatus == 401)
+  {
+    SPDLOG_INFO("{} {}", curl_easy_strerror(code), httpStatus);
+    token.get().clear();
+    // the token expired or the key changed since it was issued, a new one is tried once
+    if (!isAuthRetry)
+    {
+      isAuthRetry = true;
+      revalidate();
+      return;
+    }
+    isAuthRetry = false;
+    lastError_ = "HTTP Status: 401";
+    deliver();
+    return;
+  }
+  isAuthRetry = false;
+  if (httpStatus == 304)
+  {
+    SPDLOG_INFO("Azure voice list has not changed");
+    lastError_.clear();
+    entry.fetchedAt = Clock::now();
+    // the server may leave out the validators on a 304
+    if (!validators.etag.empty())
+      entry.etag = std::move(validators.etag);
+    if (!validators.lastModified.empty())
+      entry.lastModified = std::move(validators.lastModified);
+  }
+  else if (httpStatus == 200)
+  {
+    //[
+    //  {
+    //    "Name": "Microsoft Server Speech Text to Speech Voice (af-ZA, AdriNeural)",
+    //    "DisplayName": "Adri",
+    //    "LocalName": "Adri",
+    //    "ShortName": "af-ZA-AdriNeural",
+    //    "Gender": "Female",
+    //    "Locale": "af-ZA",
+    //    "LocaleName": "Afrikaans (South Africa)",
+    //    "SampleRateHertz": "48000",
+    //    "VoiceType": "Neural",
+    //    "Status": "GA",
+    //    "WordsPerMinute": "147"
+    //  }, ...
+    static const auto voice = JsonFields{"[]", {"Locale", "ShortName"}};
+    auto voices = std::vector<std::string>{};
+    if (!voice.parse(payload, [&](auto values) {
+          const auto locale = values[0];
+          if (locale.starts_with("en-") != 0)
+            return true;
+          voices.emplace_back(values[1]);
+          return true;
+        }))
+    {
+      lastError_ = "Cannot parse the voice list";
+      deliver();
+      return;
+    }
+    lastError_.clear();
+    entry.voices = std::move(voices);
+    entry.etag = std::move(validators.etag);
+    entry.lastModified = std::move(validators.lastModified);
+    entry.fetchedAt = Clock::now();
+  }
+  else
+  {
+    SPDLOG_INFO("{} {} {}", curl_easy_strerror(code), httpStatus, payload);
+    lastError_ = payload;
+    deliver();
+    return;
+  }
+  uv.get().queue([path = path(), e = entry]() { write(path, e); }, []() {});
+  deliver();
+}
+
+auto VoiceCatalog::deliver() -> void
+{
+  // a callback may ask for the list again, that is answered from memory
+  auto tmp = std::move(callbacks);
+  callbacks.clear();
+  for (auto &cb : tmp)
+    cb(entry.voices);
+}
+
+auto VoiceCatalog::path() -> std::filesystem::path
+{
+  return std::filesystem::current_path() / ".cache" / "azure-voices.txt";
+}
+
+// VVC1, the download time in seconds since the epoch, the ETag, the Last-Modified and then one
+// voice per line
+auto VoiceCatalog::read(const std::filesystem::path &path) -> std::optional<Entry>
+{
+  auto st = std::ifstream{path};
+  if (!st)
+    return std::nullopt;
+  auto magic = std::string{};
+  auto fetchedAt = std::string{};
+  auto ret = Entry{};
+  if (!std::getline(st, magic) || magic != Magic || !std::getline(st, fetchedAt) || !std::getline(st, ret.etag) ||
+      !std::getline(st, ret.lastModified))
+    return std::nullopt;
+  auto seconds = int64_t{};
+  if (std::from_chars(fetchedAt.data(), fetchedAt.data() + fetchedAt.size(), seconds).ec != std::errc{})
+    return std::nullopt;
+  ret.fetchedAt = Clock::time_point{std::chrono::seconds{seconds}};
+  for (auto voice = std::string{}; std::getline(st, voice);)
+    if (!voice.empty())
+      ret.voices.emplace_back(std::move(voice));
+  if (ret.voices.empty())
+    return std::nullopt;
+  return ret;
+}
+
+auto VoiceCatalog::write(const std::filesystem::path &path, const Entry &e) -> void
+{
+  auto ec = std::error_code{};
+  std::filesystem::create_directories(path.parent_path(), ec);
+  if (ec)
+  {
+    SPDLOG_ERROR("Cannot create cache directory {:?}: {}", path.parent_path(), ec.message());
+    return;
+  }
+  // written under a temporary name and renamed so a crash never leaves half a list
+  const auto tmp = temp_path_for(path);
+  {
+    auto st = std::ofstream{tmp};
+    st << Magic << '\n'
+       << std::chrono::duration_cast<std::chrono::seconds>(e.fetchedAt.time_since_epoch()).count() << '\n'
+       << e.etag << '\n'
+       << e.lastModified << '\n';
+    for (const auto &voice : e.voices)
+      st << voice << '\n';
+    if (!st)
+    {
+      SPDLOG_ERROR("Cannot write {:?}", tmp);
+      return;
+    }
+  }
+  std::filesystem::rename(tmp, path, ec);
+  if (ec)
+    SPDLOG_ERROR("Cannot write {:?}: {}", path, ec.message());
+}
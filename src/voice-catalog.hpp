@@ -0,0 +1,67 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+#include "shared_from_this.hpp"
+#include "uv.hpp"
+
+// Names of the Azure voices, shared by every node that offers a voice. The list rarely changes and
+// is a large download, so it is kept in the project-local cache: a cached copy is handed out
+// right away and, once it is older than Ttl, revalidated in the background with the ETag and
+// Last-Modified of the download it came from.
+class VoiceCatalog : public virtual enable_shared_from_this
+{
+public:
+  using Callback = std::move_only_function<void(std::span<const std::string> voices)>;
+  using Clock = std::chrono::system_clock;
+  VoiceCatalog(uv::Uv &, class AzureToken &, class HttpClient &);
+  // calls back right away when the list is in memory, otherwise after the disk cache or the
+  // download; with an empty list if neither has it
+  auto get(Callback) -> void;
+  auto lastError() const -> const std::string & { return lastError_; }
+
+  static constexpr auto Ttl = std::chrono::hours{24};
+
+private:
+  struct Entry
+  {
+    std::vector<std::string> voices;
+    std::string etag;
+    std::string lastModified;
+    Clock::time_point fetchedAt;
+  };
+  enum class State {
+    unloaded,
+    loading,
+    ready,
+  };
+
+  std::reference_wrapper<uv::Uv> uv;
+  std::reference_wrapper<AzureToken> token;
+  std::reference_wrapper<HttpClient> httpClient;
+  State state = State::unloaded;
+  bool fetching = false;
+  // the fetch in flight follows a 401 with a new token
+  bool isAuthRetry = false;
+  Entry entry;
+  std::vector<Callback> callbacks;
+  std::string lastError_;
+
+  auto load() -> void;
+  auto onLoaded(std::optional<Entry>) -> void;
+  auto revalidate() -> void;
+  auto onFetched(CURLcode, long httpStatus, std::string payload, Entry validators) -> void;
+  auto deliver() -> void;
+  auto isStale() const -> bool;
+
+  static auto path() -> std::filesystem::path;
+  static auto read(const std::filesystem::path &) -> std::optional<Entry>;
+  static auto write(const std::filesystem::path &, const Entry &) -> void;
+};
@@ -1,9 +1,146 @@
 #include "wav-2-visemes.hpp"
+#include "log.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <optional>
 #include <pocketsphinx.h>
-#include <scn/scn.h>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
+
+namespace
+{
+  struct PhoneViseme
+  {
+    std::string_view phone;
+    Viseme viseme;
+  };
+
+  constexpr PhoneViseme phones[] = {
+    {"AA", Viseme::aa},
+    {"AE", Viseme::aa},
+    {"AH", Viseme::aa},
+    {"AO", Viseme::O},
+    {"AW", Viseme::O},
+    {"AY", Viseme::aa},
+    {"B", Viseme::PP},
+    {"CH", Viseme::CH},
+    {"D", Viseme::DD},
+    {"DH", Viseme::TH},
+    {"EH", Viseme::E},
+    {"ER", Viseme::E},
+    {"EY", Viseme::E},
+    {"F", Viseme::FF},
+    {"G", Viseme::kk},
+    {"HH", Viseme::CH},
+    {"IH", Viseme::I},
+    {"IY", Viseme::I},
+    {"JH", Viseme::CH},
+    {"K", Viseme::kk},
+    {"L", Viseme::nn},
+    {"M", Viseme::nn},
+    {"N", Viseme::nn},
+    {"NG", Viseme::nn},
+    {"OW", Viseme::O},
+    {"OY", Viseme::O},
+    {"P", Viseme::PP},
+    {"R", Viseme::RR},
+    {"S", Viseme::SS},
+    {"SH", Viseme::SS},
+    {"SIL", Viseme::sil},
+    {"T", Viseme::DD},
+    {"TH", Viseme::TH},
+    {"UH", Viseme::U},
+    {"UW", Viseme::U},
+    {"V", Viseme::FF},
+    {"W", Viseme::RR},
+    {"Y", Viseme::nn},
+    {"Z", Viseme::SS},
+    {"ZH", Viseme::SS},
+  };
+
+  // phones are at most 3 letters, so packing them into an integer is lossless
+  constexpr auto pack(std::string_view phone) -> uint32_t
+  {
+    if (phone.empty() || phone.size() > 3)
+      return 0;
+    auto ret = uint32_t{0};
+    for (auto c : phone)
+      ret = (ret << 8) | static_cast<unsigned char>(c);
+    return ret;
+  }
+
+  constexpr auto TableBits = 8;
+
+  constexpr auto slot(uint32_t key, uint32_t mul) -> size_t
+  {
+    return (key * mul) >> (32 - TableBits);
+  }
+
+  // multiplicative perfect hash, the search for a collision free multiplier runs at compile time
+  constexpr auto multiplier = []() {
+    for (auto mul = uint32_t{0x9e3779b1};; mul += 2)
+    {
+      auto used = std::array<bool, 1 << TableBits>{};
+      auto ok = true;
+      for (const auto &p : phones)
+      {
+        auto &u = used[slot(pack(p.phone), mul)];
+        if (u)
+        {
+          ok = false;
+          break;
+        }
+        u = true;
+      }
+      if (ok)
+        return mul;
+    }
+  }();
+
+  constexpr auto table = []() {
+    auto ret = std::array<int8_t, 1 << TableBits>{};
+    ret.fill(-1);
+    for (auto i = size_t{0}; i < std::size(phones); ++i)
+      ret[slot(pack(phones[i].phone), multiplier)] = static_cast<int8_t>(i);
+    return ret;
+  }();
+
+  auto phoneToViseme(std::string_view phone) -> std::optional<Viseme>
+  {
+    const auto key = pack(phone);
+    if (key == 0)
+      return std::nullopt;
+    const auto idx = table[slot(key, multiplier)];
+    if (idx < 0 || phones[static_cast<size_t>(idx)].phone != phone)
+      return std::nullopt;
+    return phones[static_cast<size_t>(idx)].viseme;
+  }
+
+  // the hypothesis grows with the utterance; the last phone is found from its end so the cost
+  // does not depend on how long the speaker has been talking
+  auto lastPhone(std::string_view hyp) -> std::string_view
+  {
+    auto end = hyp.size();
+    while (end > 0)
+    {
+      while (end > 0 && std::isspace(static_cast<unsigned char>(hyp[end - 1])))
+        --end;
+      auto begin = end;
+      while (begin > 0 && !std::isspace(static_cast<unsigned char>(hyp[begin - 1])))
+        --begin;
+      if (begin < end && hyp[begin] != '+')
+        return hyp.substr(begin, end - begin);
+      end = begin;
+    }
+    return "SIL";
+  }
+} // namespace
 
 Wav2Visemes::Wav2Visemes()
   : config([]() {
@@ -18,121 +155,196 @@ Wav2Visemes::Wav2Visemes()
 
       return ret;
     }()),
-    decoder([this]() {
-      auto ret = ps_init(config);
-      if (!ret)
-        throw std::runtime_error("PocketSphinx decoder init failed");
-      return ret;
-    }()),
     ep([]() {
       auto ret = ps_endpointer_init(0.15f, 0.45f, PS_VAD_LOOSE, 0, 0);
       if (!ret)
         throw std::runtime_error("PocketSphinx endpointer init failed");
       return ret;
-    }())
+    }()),
+    input(static_cast<size_t>(sampleRate()) * InputSeconds),
+    output(OutputEvents),
+    worker(&Wav2Visemes::run, this)
 {
+  unpresented.reserve(OutputEvents);
 }
 
 Wav2Visemes::~Wav2Visemes()
 {
+  done.store(true, std::memory_order_release);
+  inputSeq.fetch_add(1, std::memory_order_release);
+  inputSeq.notify_one();
+  worker.join();
   ps_endpointer_free(ep);
-  ps_free(decoder);
+  if (decoder)
+    ps_free(decoder);
   ps_config_free(config);
 }
-auto Wav2Visemes::ingest(Wav wav, bool /*overlap*/) -> void
+auto Wav2Visemes::ingest(const AudioBlock &block) -> void
 {
-  while (!wav.empty())
+  auto span = Trace::Span{"visemes ingest"};
+  const auto wav = block.samples();
+  if (wav.empty())
+    return;
+  const auto now = Clock::now();
+  metrics_.capture.record(now - block.captured());
+  if (block.levels().rms < noiseFloor)
   {
-    const auto fs = frameSize();
-    const auto c = std::min(static_cast<int>(wav.size()), fs);
-    buf.insert(std::end(buf), std::begin(wav), std::begin(wav) + c);
-    wav.erase(std::begin(wav), std::begin(wav) + c);
-    if (static_cast<int>(buf.size()) != fs)
-      continue;
-    const auto prevInSpeech = ps_endpointer_in_speech(ep);
+    gatedSamples += wav.size();
+    if (gatedSamples > static_cast<size_t>(sampleRate()) * GateHangoverMs / 1000)
+      return;
+  }
+  else
+    gatedSamples = 0;
+  if (!isReady())
+  {
+    const auto keep = static_cast<size_t>(sampleRate()) * BacklogMs / 1000;
+    backlog.insert(std::end(backlog), std::begin(wav), std::end(wav));
+    if (backlog.size() > keep)
+      backlog.erase(std::begin(backlog), std::end(backlog) - static_cast<ptrdiff_t>(keep));
+    return;
+  }
+  if (!backlog.empty())
+  {
+    pushed.fetch_add(input.push(backlog.data(), backlog.size()), std::memory_order_release);
+    backlog = {};
+  }
+  static auto behindLog = Log::RateLimit{"visemes", 1};
+  const auto n = input.push(wav.data(), wav.size());
+  if (n < wav.size() && behindLog.allow())
+    SPDLOG_WARN("viseme recognition is behind, dropped {} samples", wav.size() - n);
+  lastCaptured.store(block.captured().time_since_epoch().count(), std::memory_order_relaxed);
+  lastQueued.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+  pushed.fetch_add(n, std::memory_order_release);
+  inputSeq.fetch_add(1, std::memory_order_release);
+  inputSeq.notify_one();
+}
 
-    auto speech = ps_endpointer_process(ep, buf.data());
-    buf.clear();
-    if (!speech)
+auto Wav2Visemes::poll() -> void
+{
+  const auto now = Clock::now();
+  // a poll without a swap after it, the low power loop for one, shows nothing
+  unpresented.clear();
+  auto e = Event{};
+  while (output.pop(&e, 1) == 1)
+  {
+    // after a stall only the newest of the late visemes is worth showing
+    if (now - e.time > StaleAfter && output.size() > 0)
       continue;
-    if (!prevInSpeech)
-      ps_start_utt(decoder);
-    const auto ret = ps_process_raw(decoder, speech, fs, FALSE, FALSE);
-    if (ret < 0)
-      throw std::runtime_error("ps_process_raw() failed");
-    const auto hyp = ps_get_hyp(decoder, nullptr);
-    if (hyp)
+    latency_ = latency_ == Clock::duration{} ? now - e.captured : (latency_ * 7 + (now - e.captured)) / 8;
+    metrics_.recognize.record(e.time - e.queued);
+    metrics_.dispatch.record(now - e.time);
+    // the time it is dispatched at stands in for the one it was made at from here on
+    e.time = now;
+    if (unpresented.size() < OutputEvents)
+      unpresented.push_back(e);
+    for (auto sink : sinks)
+      sink.get().ingest(e.viseme);
+  }
+}
+
+auto Wav2Visemes::run() -> void
+{
+  Trace::nameThread("recognizer");
+  const auto start = Clock::now();
+  decoder = ps_init(config);
+  if (!decoder)
+  {
+    SPDLOG_ERROR("PocketSphinx decoder init failed, no visemes from the microphone");
+    return;
+  }
+  SPDLOG_INFO("recognizer model loaded in {} ms",
+              std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count());
+  // ingest() kept the newest of the capture meanwhile and queues it with the next block
+  ready.store(true, std::memory_order_release);
+  auto popped = uint64_t{0};
+  const auto fs = static_cast<size_t>(frameSize());
+  auto frame = std::vector<int16_t>(fs);
+  auto filled = size_t{0};
+  while (!done.load(std::memory_order_acquire))
+  {
+    const auto seq = inputSeq.load(std::memory_order_acquire);
+    const auto n = input.pop(frame.data() + filled, fs - filled);
+    filled += n;
+    popped += n;
+    if (filled == fs)
     {
-      std::string_view str = hyp;
-      std::string_view phoneme = "SIL";
-      while (auto result = scn::scan_value<std::string_view>(str))
+      // the samples taken after the frame arrived after it, at the capture rate
+      const auto total = pushed.load(std::memory_order_acquire);
+      const auto behind = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>{
+        static_cast<double>(total > popped ? total - popped : 0) / sampleRate()});
+      const auto captured = Clock::time_point{Clock::duration{lastCaptured.load(std::memory_order_relaxed)}};
+      const auto queued = Clock::time_point{Clock::duration{lastQueued.load(std::memory_order_relaxed)}};
+      try
       {
-        str = result.range_as_string_view();
-        auto const tmp = result.value();
-        if (tmp[0] != '+')
-          phoneme = tmp;
+        process(frame.data(), captured - behind, queued - behind);
       }
-      using namespace std::literals;
-      static auto const phonToViseme = std::unordered_map<std::string_view, Viseme>{
-        {"AA"sv, Viseme::aa},
-        {"AE"sv, Viseme::aa},
-        {"AH"sv, Viseme::aa},
-        {"AO"sv, Viseme::O},
-        {"AW"sv, Viseme::O},
-        {"AY"sv, Viseme::aa},
-        {"B"sv, Viseme::PP},
-        {"CH"sv, Viseme::CH},
-        {"D"sv, Viseme::DD},
-        {"DH"sv, Viseme::TH},
-        {"EH"sv, Viseme::E},
-        {"ER"sv, Viseme::E},
-        {"EY"sv, Viseme::E},
-        {"F"sv, Viseme::FF},
-        {"G"sv, Viseme::kk},
-        {"HH"sv, Viseme::CH},
-        {"IH"sv, Viseme::I},
-        {"IY"sv, Viseme::I},
-        {"JH"sv, Viseme::CH},
-        {"K"sv, Viseme::kk},
-        {"L"sv, Viseme::nn},
-        {"M"sv, Viseme::nn},
-        {"N"sv, Viseme::nn},
-        {"NG"sv, Viseme::nn},
-        {"OW"sv, Viseme::O},
-        {"OY"sv, Viseme::O},
-        {"P"sv, Viseme::PP},
-        {"R"sv, Viseme::RR},
-        {"S"sv, Viseme::SS},
-        {"SH"sv, Viseme::SS},
-        {"SIL"sv, Viseme::sil},
-        {"T"sv, Viseme::DD},
-        {"TH"sv, Viseme::TH},
-        {"UH"sv, Viseme::U},
-        {"UW"sv, Viseme::U},
-        {"V"sv, Viseme::FF},
-        {"W"sv, Viseme::RR},
-        {"Y"sv, Viseme::nn},
-        {"Z"sv, Viseme::SS},
-        {"ZH"sv, Viseme::SS},
-      };
-
-      auto it = phonToViseme.find(phoneme);
-      if (it != std::end(phonToViseme))
+      catch (std::runtime_error &e)
       {
-        for (auto v : sinks)
-          v.get().ingest(it->second);
+        SPDLOG_ERROR("{:t}", e);
       }
-      else
-        SPDLOG_ERROR("Did not find phone mapping for: {}", phoneme);
+      filled = 0;
+      continue;
     }
-    if (!ps_endpointer_in_speech(ep))
+    if (n == 0)
+      inputSeq.wait(seq, std::memory_order_acquire);
+  }
+}
+
+auto Wav2Visemes::process(const int16_t *frame, Clock::time_point captured, Clock::time_point queued) -> void
+{
+  auto span = Trace::Span{"recognize"};
+  const auto prevInSpeech = ps_endpointer_in_speech(ep);
+
+  auto speech = ps_endpointer_process(ep, frame);
+  if (!speech)
+    return;
+  if (!prevInSpeech)
+    ps_start_utt(decoder);
+  const auto ret = ps_process_raw(decoder, speech, static_cast<size_t>(frameSize()), FALSE, FALSE);
+  if (ret < 0)
+    throw std::runtime_error("ps_process_raw() failed");
+  const auto hyp = ps_get_hyp(decoder, nullptr);
+  if (hyp)
+  {
+    const auto phoneme = lastPhone(hyp);
+    if (const auto viseme = phoneToViseme(phoneme))
     {
-      ps_end_utt(decoder);
-      ps_get_hyp(decoder, nullptr);
+      const auto e = Event{*viseme, Clock::now(), captured, queued};
+      if (output.push(&e, 1) == 0)
+        SPDLOG_WARN("viseme queue is full");
     }
+    else
+      SPDLOG_ERROR("Did not find phone mapping for: {}", phoneme);
+  }
+  if (!ps_endpointer_in_speech(ep))
+  {
+    ps_end_utt(decoder);
+    ps_get_hyp(decoder, nullptr);
   }
 }
 
+auto Wav2Visemes::presented(Clock::time_point at) -> void
+{
+  for (const auto &e : unpresented)
+  {
+    metrics_.present.record(at - e.time);
+    metrics_.total.record(at - e.captured);
+  }
+  if (!unpresented.empty())
+    lastShown_ = Shown{unpresented.back().captured, at};
+  unpresented.clear();
+}
+
+auto Wav2Visemes::clearMetrics() -> void
+{
+  metrics_ = Metrics{};
+}
+
+auto Wav2Visemes::setNoiseFloor(float db) -> void
+{
+  noiseFloor = 0x7fff * std::pow(10.f, db / 20.f);
+}
+
 auto Wav2Visemes::sampleRate() const -> int
 {
   return ps_endpointer_sample_rate(ep);
@@ -143,6 +355,11 @@ auto Wav2Visemes::frameSize() const -> int
   return static_cast<int>(ps_endpointer_frame_size(ep));
 }
 
+auto Wav2Visemes::isReady() const -> bool
+{
+  return ready.load(std::memory_order_acquire);
+}
+
 auto Wav2Visemes::reg(VisemesSink &v) -> void
 {
   sinks.push_back(v);
@@ -154,3 +371,9 @@ auto Wav2Visemes::unreg(VisemesSink &v) -> void
     std::remove_if(std::begin(sinks), std::end(sinks), [&](const auto &x) { return &x.get() == &v; }),
     std::end(sinks));
 }
+
+auto Wav2Visemes::emit(Viseme v) -> void
+{
+  for (auto sink : sinks)
+    sink.get().ingest(v);
+}
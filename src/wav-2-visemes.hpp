@@ -1,26 +1,114 @@
 #pragma once
-#include "audio-sink.hpp"
+#include "capture-sink.hpp"
+#include "latency-histogram.hpp"
+#include "spsc-ring.hpp"
 #include "viseme.hpp"
 #include "visemes-sink.hpp"
+#include "visemes-source.hpp"
 #include "wav.hpp"
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <pocketsphinx.h>
+#include <thread>
+#include <vector>
 
-class Wav2Visemes final : public AudioSink
+// PocketSphinx runs on a thread of its own: ingest() only queues the samples, and the recognized
+// visemes come back through a lock-free queue that poll() drains on the main thread at frame start.
+// The same thread loads the model first, so the rest of the startup does not wait for ps_init.
+// Only the endpointer, which sets the sample rate and frame size, is created up front; capture
+// runs and queues while the model loads, and the sinks start seeing visemes once it is ready.
+class Wav2Visemes final : public CaptureSink, public VisemesSource
 {
 public:
   Wav2Visemes();
   ~Wav2Visemes() final;
-  auto ingest(Wav, bool overlap) -> void final;
-  auto sampleRate() const -> int final;
+  auto ingest(const AudioBlock &) -> void final;
+  auto sampleRate() const -> int;
   auto frameSize() const -> int;
-  auto reg(VisemesSink &) -> void;
-  auto unreg(VisemesSink &) -> void;
+  // the model is loaded and the queued samples are being recognized
+  auto isReady() const -> bool final;
+  auto reg(VisemesSink &) -> void final;
+  auto unreg(VisemesSink &) -> void final;
+  // delivers a viseme to the sinks without recognition, used by the benchmark mode
+  auto emit(Viseme) -> void;
+  // dispatches the visemes recognized since the last call to the sinks
+  auto poll() -> void;
+  // blocks quieter than this RMS level in dBFS never reach the endpointer once the hangover ran out
+  auto setNoiseFloor(float db) -> void;
+
+  using Clock = std::chrono::steady_clock;
+  // from the capture of the samples of the last dispatched viseme to its dispatch, smoothed
+  auto latency() const -> Clock::duration { return latency_; }
+  // the mic to mouth path of every dispatched viseme, stage by stage
+  struct Metrics
+  {
+    // the device delivering the samples to them reaching ingest()
+    LatencyHistogram capture;
+    // queued for the recognizer and recognized
+    LatencyHistogram recognize;
+    // waiting for the frame that dispatches it
+    LatencyHistogram dispatch;
+    // the frame drawing it up to the swap
+    LatencyHistogram present;
+    LatencyHistogram total;
+  };
+  auto metrics() const -> const Metrics & { return metrics_; }
+  auto clearMetrics() -> void;
+  // the frame with the visemes dispatched since the last call was swapped at the time given
+  auto presented(Clock::time_point) -> void;
+  struct Shown
+  {
+    // capture of the samples behind the newest presented viseme and its swap
+    Clock::time_point captured;
+    Clock::time_point at;
+  };
+  auto lastShown() const -> const Shown & { return lastShown_; }
+  static constexpr auto InputSeconds = 2;
+  static constexpr auto OutputEvents = 256;
+  static constexpr auto StaleAfter = std::chrono::milliseconds{200};
+  // silence keeps being fed for a while so the endpointer closes the utterance itself
+  static constexpr auto GateHangoverMs = 500;
+  // how much of the audio queued during the model load is still recognized once it is loaded
+  static constexpr auto BacklogMs = 300;
 
 private:
+  struct Event
+  {
+    Viseme viseme = Viseme::sil;
+    Clock::time_point time;
+    // estimated capture of the newest sample of the recognized frame and its ingest()
+    Clock::time_point captured;
+    Clock::time_point queued;
+  };
+
   std::vector<std::reference_wrapper<VisemesSink>> sinks;
+  // the decoder and the endpointer are only touched by the worker once it runs
   ps_config_t *config = nullptr;
   ps_decoder_t *decoder = nullptr;
   ps_endpointer_t *ep = nullptr;
-  Wav buf;
+  float noiseFloor = 0.f;
+  size_t gatedSamples = 0;
+  SpscRing<int16_t> input;
+  // the newest BacklogMs of the capture while the model loads, input only takes samples once it
+  // is loaded, as a full ring would keep the oldest
+  std::vector<int16_t> backlog;
+  SpscRing<Event> output;
+  std::atomic<uint32_t> inputSeq = 0;
+  // samples input took so far and the capture and ingest time of the newest of them, the worker
+  // dates a frame by how far behind it they are
+  std::atomic<uint64_t> pushed = 0;
+  std::atomic<int64_t> lastCaptured = 0;
+  std::atomic<int64_t> lastQueued = 0;
+  std::atomic<bool> ready = false;
+  std::atomic<bool> done = false;
+  std::thread worker;
+  Clock::duration latency_{};
+  Metrics metrics_;
+  // dispatched and not on screen yet, reserved for OutputEvents so a frame does not allocate
+  std::vector<Event> unpresented;
+  Shown lastShown_;
+
+  auto run() -> void;
+  auto process(const int16_t *frame, Clock::time_point captured, Clock::time_point queued) -> void;
 };